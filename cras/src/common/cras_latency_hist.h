@@ -0,0 +1,121 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Helpers for the audio thread latency histograms, shared by the server
+ * that records them and the clients that read them.
+ */
+
+#ifndef CRAS_LATENCY_HIST_H_
+#define CRAS_LATENCY_HIST_H_
+
+#include <stdint.h>
+
+#include "cras_types.h"
+
+#define LATENCY_HIST_SUB_BUCKETS (1 << AUDIO_THREAD_LATENCY_SUB_BUCKET_BITS)
+
+/* Returns the index of the bucket counting duration ns. */
+static inline unsigned int latency_hist_bucket(uint64_t ns)
+{
+	unsigned int exp, idx;
+
+	if (ns < LATENCY_HIST_SUB_BUCKETS)
+		return ns;
+
+	exp = 63 - __builtin_clzll(ns);
+	idx = (exp - AUDIO_THREAD_LATENCY_SUB_BUCKET_BITS + 1) *
+		      LATENCY_HIST_SUB_BUCKETS +
+	      ((ns >> (exp - AUDIO_THREAD_LATENCY_SUB_BUCKET_BITS)) &
+	       (LATENCY_HIST_SUB_BUCKETS - 1));
+	if (idx >= AUDIO_THREAD_LATENCY_NUM_BUCKETS)
+		idx = AUDIO_THREAD_LATENCY_NUM_BUCKETS - 1;
+	return idx;
+}
+
+/* Returns the shortest duration counted in bucket idx. */
+static inline uint64_t latency_hist_bucket_lower(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < LATENCY_HIST_SUB_BUCKETS)
+		return idx;
+
+	shift = idx / LATENCY_HIST_SUB_BUCKETS - 1;
+	return (uint64_t)(LATENCY_HIST_SUB_BUCKETS +
+			  idx % LATENCY_HIST_SUB_BUCKETS)
+	       << shift;
+}
+
+/* Returns the longest duration counted in bucket idx. */
+static inline uint64_t latency_hist_bucket_upper(unsigned int idx)
+{
+	if (idx + 1 >= AUDIO_THREAD_LATENCY_NUM_BUCKETS)
+		return UINT64_MAX;
+	return latency_hist_bucket_lower(idx + 1) - 1;
+}
+
+/* Counts duration ns in hist. */
+static inline void latency_hist_add(struct audio_thread_latency_hist *hist,
+				    uint64_t ns)
+{
+	hist->count++;
+	hist->sum_ns += ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+	hist->buckets[latency_hist_bucket(ns)]++;
+}
+
+/*
+ * Returns an upper bound of quantile q, between 0 and 1, of the durations
+ * in hist, or 0 if it is empty. The bound is within one bucket of the
+ * exact quantile and never more than the longest duration.
+ */
+static inline uint64_t
+latency_hist_quantile(const struct audio_thread_latency_hist *hist, double q)
+{
+	uint64_t rank, seen = 0;
+	uint64_t upper;
+	unsigned int i;
+
+	if (hist->count == 0)
+		return 0;
+
+	rank = (uint64_t)(q * hist->count);
+	if (rank >= hist->count)
+		rank = hist->count - 1;
+
+	for (i = 0; i < AUDIO_THREAD_LATENCY_NUM_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen > rank)
+			break;
+	}
+	if (i == AUDIO_THREAD_LATENCY_NUM_BUCKETS)
+		return hist->max_ns;
+
+	upper = latency_hist_bucket_upper(i);
+	return upper < hist->max_ns ? upper : hist->max_ns;
+}
+
+static inline const char *
+audio_thread_latency_phase_name(enum AUDIO_THREAD_LATENCY_PHASE phase)
+{
+	switch (phase) {
+	case AUDIO_THREAD_LATENCY_CAPTURE:
+		return "capture";
+	case AUDIO_THREAD_LATENCY_FETCH:
+		return "playback_fetch";
+	case AUDIO_THREAD_LATENCY_WRITE:
+		return "playback_write";
+	case AUDIO_THREAD_LATENCY_DSP:
+		return "dsp";
+	case AUDIO_THREAD_LATENCY_CONVERSION:
+		return "conversion";
+	case AUDIO_THREAD_LATENCY_WAKE_JITTER:
+		return "wake_jitter";
+	default:
+		return "unknown";
+	}
+}
+
+#endif /* CRAS_LATENCY_HIST_H_ */
@@ -8,20 +8,55 @@
 #include <stdlib.h>
 
 #include "cras_sbc_codec.h"
+#include "cras_sbc_native.h"
 
 /* SBC library encodes one PCM input block to one SBC output block. This
  * structure holds related info about the SBC codec.
  * Members:
  *    sbc - The main structure for SBC codec.
+ *    native - The built in codec used instead of libsbc, or NULL.
  *    codesize - The size of one PCM input block in bytes.
  *    frame_length - The size of one SBC output block in bytes.
  */
 struct cras_sbc_data {
 	sbc_t sbc;
+	struct cras_sbc_native *native;
 	unsigned int codesize;
 	unsigned int frame_length;
 };
 
+/* Set by cras_sbc_codec_init(), which codec new instances use. */
+static int use_native;
+static unsigned int native_cpu_flags;
+
+void cras_sbc_codec_init(int native, unsigned int cpu_flags)
+{
+	use_native = native;
+	native_cpu_flags = cpu_flags;
+}
+
+static ssize_t data_decode(struct cras_sbc_data *data, const void *input,
+			   size_t input_len, void *output, size_t output_len,
+			   size_t *written)
+{
+	if (data->native)
+		return cras_sbc_native_decode(data->native, input, input_len,
+					      output, output_len, written);
+	return sbc_decode(&data->sbc, input, input_len, output, output_len,
+			  written);
+}
+
+static ssize_t data_encode(struct cras_sbc_data *data, const void *input,
+			   size_t input_len, void *output, size_t output_len,
+			   ssize_t *written)
+{
+	if (data->native)
+		return cras_sbc_native_encode(data->native, input, input_len,
+					      output, output_len, written);
+	return sbc_encode(&data->sbc, input, input_len, output, output_len,
+			  written);
+}
+
 int cras_msbc_decode(struct cras_audio_codec *codec, const void *input,
 		     size_t input_len, void *output, size_t output_len,
 		     size_t *count)
@@ -34,8 +69,8 @@ int cras_msbc_decode(struct cras_audio_codec *codec, const void *input,
 	 * Proceed decode when there is buffer left in input and room in
 	 * output.
 	 */
-	decoded = sbc_decode(&data->sbc, input, input_len, output, output_len,
-			     &written);
+	decoded = data_decode(data, input, input_len, output, output_len,
+			      &written);
 
 	*count = written;
 	return decoded;
@@ -56,8 +91,8 @@ int cras_msbc_encode(struct cras_audio_codec *codec, const void *input,
 	if (input_len < data->codesize)
 		return -EINVAL;
 
-	encoded = sbc_encode(&data->sbc, input, data->codesize, output,
-			     output_len, &written);
+	encoded = data_encode(data, input, data->codesize, output,
+			      output_len, &written);
 
 	*count = written;
 	return encoded;
@@ -77,9 +112,9 @@ int cras_sbc_decode(struct cras_audio_codec *codec, const void *input,
 	 * output.
 	 */
 	while (input_len > processed && output_len > result) {
-		decoded = sbc_decode(&data->sbc, input + processed,
-				     input_len - processed, output + result,
-				     output_len - result, &written);
+		decoded = data_decode(data, input + processed,
+				      input_len - processed, output + result,
+				      output_len - result, &written);
 		if (decoded <= 0)
 			break;
 
@@ -103,9 +138,9 @@ int cras_sbc_encode(struct cras_audio_codec *codec, const void *input,
 	 */
 	while (input_len - processed >= data->codesize &&
 	       output_len >= result) {
-		encoded = sbc_encode(&data->sbc, input + processed,
-				     data->codesize, output + result,
-				     output_len - result, &written);
+		encoded = data_encode(data, input + processed,
+				      data->codesize, output + result,
+				      output_len - result, &written);
 		if (encoded == -ENOSPC)
 			break;
 		else if (encoded < 0)
@@ -118,6 +153,30 @@ int cras_sbc_encode(struct cras_audio_codec *codec, const void *input,
 	return processed;
 }
 
+int cras_sbc_codec_set_bitpool(struct cras_audio_codec *codec,
+			       uint8_t bitpool)
+{
+	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
+	int rc;
+
+	if (data->native) {
+		rc = cras_sbc_native_set_bitpool(data->native, bitpool);
+		if (rc)
+			return rc;
+		data->frame_length =
+			cras_sbc_native_get_frame_length(data->native);
+		return 0;
+	}
+
+	/* libsbc picks up a new bitpool on the next encode, without
+	 * resetting the encoder. */
+	if (bitpool < 2)
+		return -EINVAL;
+	data->sbc.bitpool = bitpool;
+	data->frame_length = sbc_get_frame_length(&data->sbc);
+	return 0;
+}
+
 int cras_sbc_get_codesize(struct cras_audio_codec *codec)
 {
 	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
@@ -147,9 +206,17 @@ struct cras_audio_codec *cras_msbc_codec_create()
 	}
 
 	data = (struct cras_sbc_data *)codec->priv_data;
-	sbc_init_msbc(&data->sbc, 0L);
-	data->codesize = sbc_get_codesize(&data->sbc);
-	data->frame_length = sbc_get_frame_length(&data->sbc);
+	if (use_native)
+		data->native = cras_msbc_native_create(native_cpu_flags);
+	if (data->native) {
+		data->codesize = cras_sbc_native_get_codesize(data->native);
+		data->frame_length =
+			cras_sbc_native_get_frame_length(data->native);
+	} else {
+		sbc_init_msbc(&data->sbc, 0L);
+		data->codesize = sbc_get_codesize(&data->sbc);
+		data->frame_length = sbc_get_frame_length(&data->sbc);
+	}
 
 	codec->decode = cras_msbc_decode;
 	codec->encode = cras_msbc_encode;
@@ -173,6 +240,17 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq, uint8_t mode,
 		goto create_error;
 
 	data = (struct cras_sbc_data *)codec->priv_data;
+	if (use_native)
+		data->native = cras_sbc_native_create(freq, mode, subbands,
+						      alloc, blocks, bitpool,
+						      native_cpu_flags);
+	if (data->native) {
+		data->codesize = cras_sbc_native_get_codesize(data->native);
+		data->frame_length =
+			cras_sbc_native_get_frame_length(data->native);
+		goto create_done;
+	}
+
 	sbc_init(&data->sbc, 0L);
 	data->sbc.endian = SBC_LE;
 	data->sbc.frequency = freq;
@@ -184,6 +262,7 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq, uint8_t mode,
 	data->codesize = sbc_get_codesize(&data->sbc);
 	data->frame_length = sbc_get_frame_length(&data->sbc);
 
+create_done:
 	codec->decode = cras_sbc_decode;
 	codec->encode = cras_sbc_encode;
 	return codec;
@@ -195,7 +274,12 @@ create_error:
 
 void cras_sbc_codec_destroy(struct cras_audio_codec *codec)
 {
-	sbc_finish(&((struct cras_sbc_data *)codec->priv_data)->sbc);
+	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
+
+	if (data->native)
+		cras_sbc_native_destroy(data->native);
+	else
+		sbc_finish(&data->sbc);
 	free(codec->priv_data);
 	free(codec);
 }
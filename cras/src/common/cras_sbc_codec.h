@@ -10,6 +10,15 @@
 
 #include "cras_audio_codec.h"
 
+/* Picks the codec that cras_sbc_codec_create() and cras_msbc_codec_create()
+ * use from then on.
+ * Args:
+ *    native - Non-zero to use the codec built into CRAS rather than libsbc.
+ *    cpu_flags - The CPU_X86_* flags from cpu_get_flags(), to pick the
+ *        native codec's filterbank kernels.
+ */
+void cras_sbc_codec_init(int native, unsigned int cpu_flags);
+
 /* Creates an sbc codec.
  * Args:
  *    freq: frequency for sbc encoder settings.
@@ -33,6 +42,17 @@ struct cras_audio_codec *cras_msbc_codec_create();
  */
 void cras_sbc_codec_destroy(struct cras_audio_codec *codec);
 
+/* Changes the bitpool of the frames encoded from now on. The next frames
+ * are a different size, see cras_sbc_get_frame_length().
+ * Args:
+ *    codec: the sbc codec.
+ *    bitpool: the new bitpool.
+ * Returns:
+ *    0 on success, -EINVAL if the bitpool is out of range.
+ */
+int cras_sbc_codec_set_bitpool(struct cras_audio_codec *codec,
+			       uint8_t bitpool);
+
 /* Gets codesize, the input block size of sbc codec in bytes.
  */
 int cras_sbc_get_codesize(struct cras_audio_codec *codec);
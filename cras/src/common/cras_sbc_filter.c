@@ -0,0 +1,383 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+
+#include "cras_sbc_filter.h"
+#include "cras_util.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/* The AVX2 kernels are built for the target on their own, so one binary
+ * runs on CPUs with and without AVX2. */
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SBC_FILTER_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+/* Proto_4_40 and Proto_8_80 of the A2DP specification, the prototype
+ * filters of the analysis filterbank with the sign of every other 2M
+ * coefficients flipped. */
+static const float proto_4_40[40] = {
+	0.00000000E+00,	 5.36548976E-04,  1.49188357E-03,  2.73370904E-03,
+	3.83720193E-03,	 3.89205149E-03,  1.86581691E-03,  -3.06012286E-03,
+	1.09137620E-02,	 2.04385087E-02,  2.88757392E-02,  3.21939290E-02,
+	2.58767811E-02,	 6.13245186E-03,  -2.88217274E-02, -7.76463494E-02,
+	1.35593274E-01,	 1.94987841E-01,  2.46636662E-01,  2.81828203E-01,
+	2.94315332E-01,	 2.81828203E-01,  2.46636662E-01,  1.94987841E-01,
+	-1.35593274E-01, -7.76463494E-02, -2.88217274E-02, 6.13245186E-03,
+	2.58767811E-02,	 3.21939290E-02,  2.88757392E-02,  2.04385087E-02,
+	-1.09137620E-02, -3.06012286E-03, 1.86581691E-03,  3.89205149E-03,
+	3.83720193E-03,	 2.73370904E-03,  1.49188357E-03,  5.36548976E-04
+};
+
+static const float proto_8_80[80] = {
+	0.00000000E+00,	 1.56575398E-04,  3.43256425E-04,  5.54620202E-04,
+	8.23919506E-04,	 1.13992507E-03,  1.47640169E-03,  1.78371725E-03,
+	2.01182542E-03,	 2.10371989E-03,  1.99454554E-03,  1.61656283E-03,
+	9.02154502E-04,	 -1.78805361E-04, -1.64973098E-03, -3.49717454E-03,
+	5.65949473E-03,	 8.02941163E-03,  1.04584443E-02,  1.27472335E-02,
+	1.46525263E-02,	 1.59045603E-02,  1.62208471E-02,  1.53184106E-02,
+	1.29371806E-02,	 8.85757540E-03,  2.92408442E-03,  -4.91578024E-03,
+	-1.46404076E-02, -2.61098752E-02, -3.90751381E-02, -5.31873032E-02,
+	6.79989431E-02,	 8.29847578E-02,  9.75753918E-02,  1.11196689E-01,
+	1.23264548E-01,	 1.33264415E-01,  1.40753505E-01,  1.45389847E-01,
+	1.46955068E-01,	 1.45389847E-01,  1.40753505E-01,  1.33264415E-01,
+	1.23264548E-01,	 1.11196689E-01,  9.75753918E-02,  8.29847578E-02,
+	-6.79989431E-02, -5.31873032E-02, -3.90751381E-02, -2.61098752E-02,
+	-1.46404076E-02, -4.91578024E-03, 2.92408442E-03,  8.85757540E-03,
+	1.29371806E-02,	 1.53184106E-02,  1.62208471E-02,  1.59045603E-02,
+	1.46525263E-02,	 1.27472335E-02,  1.04584443E-02,  8.02941163E-03,
+	-5.65949473E-03, -3.49717454E-03, -1.64973098E-03, -1.78805361E-04,
+	9.02154502E-04,	 1.61656283E-03,  1.99454554E-03,  2.10371989E-03,
+	2.01182542E-03,	 1.78371725E-03,  1.47640169E-03,  1.13992507E-03,
+	8.23919506E-04,	 5.54620202E-04,  3.43256425E-04,  1.56575398E-04
+};
+
+void cras_sbc_filter_init(struct cras_sbc_filter *f, unsigned int subbands)
+{
+	const float *proto = subbands == 4 ? proto_4_40 : proto_8_80;
+	const unsigned int m = subbands, n = 2 * subbands;
+	unsigned int i, k, r;
+
+	f->subbands = m;
+	for (i = 0; i < 10 * m; i++) {
+		f->analysis_win[i] = proto[10 * m - 1 - i];
+		f->synthesis_win[i] = -(float)m * proto[i];
+	}
+
+	/* The specification's matrices are cos((k + 0.5)(i - M/2)pi/M) for
+	 * analysis, which is applied to the window reversed here, and
+	 * cos((i + 0.5)(k + M/2)pi/M) for synthesis. */
+	for (r = 0; r < n; r++)
+		for (k = 0; k < m; k++)
+			f->analysis_mat[r * m + k] =
+				cos((k + 0.5) * ((n - 1.0 - r) - m / 2.0) *
+				    M_PI / m);
+	for (i = 0; i < m; i++)
+		for (k = 0; k < n; k++)
+			f->synthesis_mat[i * n + k] =
+				cos((i + 0.5) * (k + m / 2.0) * M_PI / m);
+}
+
+/*
+ * Kernels. All of them do the same float operations in the same order per
+ * sample, the SIMD ones on four or eight samples at a time.
+ */
+
+static void analyze_c(const struct cras_sbc_filter *f, const float *x,
+		      float *s)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->analysis_win;
+	float y[2 * SBC_MAX_SUBBANDS];
+	unsigned int j, k, r;
+
+	for (r = 0; r < n; r++) {
+		y[r] = win[r] * x[r];
+		for (j = 1; j < 5; j++)
+			y[r] += win[r + j * n] * x[r + j * n];
+	}
+	for (k = 0; k < m; k++)
+		s[k] = 0;
+	for (r = 0; r < n; r++)
+		for (k = 0; k < m; k++)
+			s[k] += f->analysis_mat[r * m + k] * y[r];
+}
+
+static void synthesize_c(const struct cras_sbc_filter *f, const float *s,
+			 float *v, float *out)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->synthesis_win;
+	const float *even, *odd;
+	unsigned int i, j, k;
+
+	for (k = 0; k < n; k++)
+		v[k] = 0;
+	for (i = 0; i < m; i++)
+		for (k = 0; k < n; k++)
+			v[k] += f->synthesis_mat[i * n + k] * s[i];
+
+	/* Blocks b, b - 2, ... give the first M samples of each 2M of the
+	 * window, blocks b - 1, b - 3, ... the last M. */
+	for (j = 0; j < m; j++)
+		out[j] = 0;
+	for (i = 0; i < 5; i++) {
+		even = v - 2 * i * n;
+		odd = v - (2 * i + 1) * n + m;
+		for (j = 0; j < m; j++) {
+			out[j] += win[i * n + j] * even[j];
+			out[j] += win[i * n + m + j] * odd[j];
+		}
+	}
+}
+
+const struct cras_sbc_filter_ops cras_sbc_filter_ops_c = {
+	.analyze = analyze_c,
+	.synthesize = synthesize_c,
+};
+
+#if defined(__ARM_NEON)
+
+static void analyze_neon(const struct cras_sbc_filter *f, const float *x,
+			 float *s)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->analysis_win;
+	float y[2 * SBC_MAX_SUBBANDS];
+	float32x4_t acc;
+	unsigned int j, k, r;
+
+	for (r = 0; r < n; r += 4) {
+		acc = vmulq_f32(vld1q_f32(win + r), vld1q_f32(x + r));
+		for (j = 1; j < 5; j++)
+			acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(win + r + j * n),
+						       vld1q_f32(x + r + j * n)));
+		vst1q_f32(y + r, acc);
+	}
+	for (k = 0; k < m; k += 4) {
+		acc = vdupq_n_f32(0);
+		for (r = 0; r < n; r++)
+			acc = vaddq_f32(
+				acc,
+				vmulq_f32(vld1q_f32(f->analysis_mat + r * m + k),
+					  vdupq_n_f32(y[r])));
+		vst1q_f32(s + k, acc);
+	}
+}
+
+static void synthesize_neon(const struct cras_sbc_filter *f, const float *s,
+			    float *v, float *out)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->synthesis_win;
+	const float *even, *odd;
+	float32x4_t acc;
+	unsigned int i, j, k;
+
+	for (k = 0; k < n; k += 4) {
+		acc = vdupq_n_f32(0);
+		for (i = 0; i < m; i++)
+			acc = vaddq_f32(
+				acc,
+				vmulq_f32(vld1q_f32(f->synthesis_mat + i * n + k),
+					  vdupq_n_f32(s[i])));
+		vst1q_f32(v + k, acc);
+	}
+	for (j = 0; j < m; j += 4) {
+		acc = vdupq_n_f32(0);
+		for (i = 0; i < 5; i++) {
+			even = v - 2 * i * n;
+			odd = v - (2 * i + 1) * n + m;
+			acc = vaddq_f32(acc,
+					vmulq_f32(vld1q_f32(win + i * n + j),
+						  vld1q_f32(even + j)));
+			acc = vaddq_f32(acc,
+					vmulq_f32(vld1q_f32(win + i * n + m + j),
+						  vld1q_f32(odd + j)));
+		}
+		vst1q_f32(out + j, acc);
+	}
+}
+
+static const struct cras_sbc_filter_ops filter_ops_neon = {
+	.analyze = analyze_neon,
+	.synthesize = synthesize_neon,
+};
+
+#elif defined(__SSE__)
+
+static void analyze_sse(const struct cras_sbc_filter *f, const float *x,
+			float *s)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->analysis_win;
+	float y[2 * SBC_MAX_SUBBANDS];
+	__m128 acc;
+	unsigned int j, k, r;
+
+	for (r = 0; r < n; r += 4) {
+		acc = _mm_mul_ps(_mm_loadu_ps(win + r), _mm_loadu_ps(x + r));
+		for (j = 1; j < 5; j++)
+			acc = _mm_add_ps(acc,
+					 _mm_mul_ps(_mm_loadu_ps(win + r + j * n),
+						    _mm_loadu_ps(x + r + j * n)));
+		_mm_storeu_ps(y + r, acc);
+	}
+	for (k = 0; k < m; k += 4) {
+		acc = _mm_setzero_ps();
+		for (r = 0; r < n; r++)
+			acc = _mm_add_ps(
+				acc,
+				_mm_mul_ps(_mm_loadu_ps(f->analysis_mat + r * m + k),
+					   _mm_set1_ps(y[r])));
+		_mm_storeu_ps(s + k, acc);
+	}
+}
+
+static void synthesize_sse(const struct cras_sbc_filter *f, const float *s,
+			   float *v, float *out)
+{
+	const unsigned int m = f->subbands, n = 2 * f->subbands;
+	const float *win = f->synthesis_win;
+	const float *even, *odd;
+	__m128 acc;
+	unsigned int i, j, k;
+
+	for (k = 0; k < n; k += 4) {
+		acc = _mm_setzero_ps();
+		for (i = 0; i < m; i++)
+			acc = _mm_add_ps(
+				acc, _mm_mul_ps(_mm_loadu_ps(f->synthesis_mat +
+							     i * n + k),
+						_mm_set1_ps(s[i])));
+		_mm_storeu_ps(v + k, acc);
+	}
+	for (j = 0; j < m; j += 4) {
+		acc = _mm_setzero_ps();
+		for (i = 0; i < 5; i++) {
+			even = v - 2 * i * n;
+			odd = v - (2 * i + 1) * n + m;
+			acc = _mm_add_ps(acc,
+					 _mm_mul_ps(_mm_loadu_ps(win + i * n + j),
+						    _mm_loadu_ps(even + j)));
+			acc = _mm_add_ps(
+				acc, _mm_mul_ps(_mm_loadu_ps(win + i * n + m + j),
+						_mm_loadu_ps(odd + j)));
+		}
+		_mm_storeu_ps(out + j, acc);
+	}
+}
+
+static const struct cras_sbc_filter_ops filter_ops_sse = {
+	.analyze = analyze_sse,
+	.synthesize = synthesize_sse,
+};
+
+#endif
+
+#if defined(HAVE_SBC_FILTER_AVX2)
+
+/* Eight samples at a time, which needs eight subbands. Four subbands go
+ * through the SSE kernels. */
+AVX2_TARGET
+static void analyze_avx2(const struct cras_sbc_filter *f, const float *x,
+			 float *s)
+{
+	const unsigned int n = 2 * SBC_MAX_SUBBANDS;
+	const float *win = f->analysis_win;
+	float y[2 * SBC_MAX_SUBBANDS];
+	__m256 acc;
+	unsigned int j, r;
+
+	if (f->subbands != SBC_MAX_SUBBANDS) {
+		analyze_sse(f, x, s);
+		return;
+	}
+
+	for (r = 0; r < n; r += 8) {
+		acc = _mm256_mul_ps(_mm256_loadu_ps(win + r),
+				    _mm256_loadu_ps(x + r));
+		for (j = 1; j < 5; j++)
+			acc = _mm256_add_ps(
+				acc, _mm256_mul_ps(_mm256_loadu_ps(win + r + j * n),
+						   _mm256_loadu_ps(x + r + j * n)));
+		_mm256_storeu_ps(y + r, acc);
+	}
+	acc = _mm256_setzero_ps();
+	for (r = 0; r < n; r++)
+		acc = _mm256_add_ps(
+			acc, _mm256_mul_ps(_mm256_loadu_ps(f->analysis_mat +
+							   r * SBC_MAX_SUBBANDS),
+					   _mm256_set1_ps(y[r])));
+	_mm256_storeu_ps(s, acc);
+}
+
+AVX2_TARGET
+static void synthesize_avx2(const struct cras_sbc_filter *f, const float *s,
+			    float *v, float *out)
+{
+	const unsigned int m = SBC_MAX_SUBBANDS, n = 2 * SBC_MAX_SUBBANDS;
+	const float *win = f->synthesis_win;
+	const float *even, *odd;
+	__m256 acc;
+	unsigned int i, k;
+
+	if (f->subbands != SBC_MAX_SUBBANDS) {
+		synthesize_sse(f, s, v, out);
+		return;
+	}
+
+	for (k = 0; k < n; k += 8) {
+		acc = _mm256_setzero_ps();
+		for (i = 0; i < m; i++)
+			acc = _mm256_add_ps(
+				acc,
+				_mm256_mul_ps(_mm256_loadu_ps(f->synthesis_mat +
+							      i * n + k),
+					      _mm256_set1_ps(s[i])));
+		_mm256_storeu_ps(v + k, acc);
+	}
+	acc = _mm256_setzero_ps();
+	for (i = 0; i < 5; i++) {
+		even = v - 2 * i * n;
+		odd = v - (2 * i + 1) * n + m;
+		acc = _mm256_add_ps(acc,
+				    _mm256_mul_ps(_mm256_loadu_ps(win + i * n),
+						  _mm256_loadu_ps(even)));
+		acc = _mm256_add_ps(acc,
+				    _mm256_mul_ps(_mm256_loadu_ps(win + i * n + m),
+						  _mm256_loadu_ps(odd)));
+	}
+	_mm256_storeu_ps(out, acc);
+}
+
+static const struct cras_sbc_filter_ops filter_ops_avx2 = {
+	.analyze = analyze_avx2,
+	.synthesize = synthesize_avx2,
+};
+
+#endif
+
+const struct cras_sbc_filter_ops *cras_sbc_filter_get_ops(unsigned int cpu_flags)
+{
+#if defined(HAVE_SBC_FILTER_AVX2)
+	if (cpu_flags & CPU_X86_AVX2)
+		return &filter_ops_avx2;
+#endif
+#if defined(__ARM_NEON)
+	return &filter_ops_neon;
+#elif defined(__SSE__)
+	return &filter_ops_sse;
+#else
+	return &cras_sbc_filter_ops_c;
+#endif
+}
@@ -0,0 +1,66 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef COMMON_CRAS_SBC_FILTER_H_
+#define COMMON_CRAS_SBC_FILTER_H_
+
+#define SBC_MAX_SUBBANDS 8
+
+/* Coefficients of the SBC analysis and synthesis filterbanks for one number
+ * of subbands, per the A2DP specification appendix B, laid out so that the
+ * kernels walk them in order.
+ * Members:
+ *    subbands - Number of subbands M, 4 or 8.
+ *    analysis_win - The prototype filter reversed, to window 10M samples
+ *        that are in time order.
+ *    analysis_mat - The 2M x M analysis matrix, row r holds the coefficient
+ *        of windowed sample r for each subband.
+ *    synthesis_win - The synthesis window, the prototype filter times -M.
+ *    synthesis_mat - The M x 2M synthesis matrix, row i holds the
+ *        coefficient of subband i for each of the 2M outputs.
+ */
+struct cras_sbc_filter {
+	unsigned int subbands;
+	float analysis_win[10 * SBC_MAX_SUBBANDS];
+	float analysis_mat[2 * SBC_MAX_SUBBANDS * SBC_MAX_SUBBANDS];
+	float synthesis_win[10 * SBC_MAX_SUBBANDS];
+	float synthesis_mat[SBC_MAX_SUBBANDS * 2 * SBC_MAX_SUBBANDS];
+};
+
+/* Filterbank kernels, one set per instruction set.
+ * analyze - Computes the M subband samples of one block.
+ *    x - The last 10M input samples, oldest first.
+ *    s - Filled with the M subband samples.
+ * synthesize - Computes the M output samples of one block.
+ *    s - The M subband samples.
+ *    v - Where to store this block's 2M matrixed samples. The ones of the
+ *        previous nine blocks are at v - 2M, v - 4M, ..., v - 18M.
+ *    out - Filled with the M output samples, oldest first.
+ */
+struct cras_sbc_filter_ops {
+	void (*analyze)(const struct cras_sbc_filter *f, const float *x,
+			float *s);
+	void (*synthesize)(const struct cras_sbc_filter *f, const float *s,
+			   float *v, float *out);
+};
+
+/* The plain C kernels, which the SIMD ones match. */
+extern const struct cras_sbc_filter_ops cras_sbc_filter_ops_c;
+
+/* Fills in the coefficients for the given number of subbands.
+ * Args:
+ *    f - The filter to fill in.
+ *    subbands - 4 or 8.
+ */
+void cras_sbc_filter_init(struct cras_sbc_filter *f, unsigned int subbands);
+
+/* Gets the fastest kernels the CPU supports.
+ * Args:
+ *    cpu_flags - The CPU_X86_* flags from cpu_get_flags().
+ */
+const struct cras_sbc_filter_ops *
+cras_sbc_filter_get_ops(unsigned int cpu_flags);
+
+#endif /* COMMON_CRAS_SBC_FILTER_H_ */
@@ -0,0 +1,728 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cras_sbc_filter.h"
+#include "cras_sbc_native.h"
+
+#define SBC_SYNCWORD 0x9c
+#define MSBC_SYNCWORD 0xad
+#define MSBC_BLOCKS 15
+#define MSBC_BITPOOL 26
+#define SBC_MAX_BLOCKS 16
+#define SBC_MAX_CHANNELS 2
+#define SBC_MAX_SCALE_FACTOR 15
+#define SBC_CRC_INIT 0x0f
+#define SBC_CRC_POLY 0x1d
+
+/* Bitstream codes of the channel modes and allocation methods. */
+#define SBC_CODE_MONO 0
+#define SBC_CODE_DUAL_CHANNEL 1
+#define SBC_CODE_STEREO 2
+#define SBC_CODE_JOINT_STEREO 3
+#define SBC_CODE_LOUDNESS 0
+
+/* Samples kept from the previous frame by the filterbanks, the analysis
+ * window is 10 blocks long and the synthesis one is spread over 10 blocks of
+ * twice the size. */
+#define ANALYSIS_HISTORY (9 * SBC_MAX_SUBBANDS)
+#define SYNTHESIS_HISTORY (9 * 2 * SBC_MAX_SUBBANDS)
+
+/* Loudness offsets of the bit allocation, per sampling frequency. */
+static const int offset4[4][4] = {
+	{ -1, 0, 0, 0 },
+	{ -2, 0, 0, 1 },
+	{ -2, 0, 0, 1 },
+	{ -2, 0, 0, 1 },
+};
+
+static const int offset8[4][8] = {
+	{ -2, 0, 0, 0, 0, 0, 0, 1 },
+	{ -3, 0, 0, 0, 0, 0, 1, 2 },
+	{ -4, 0, 0, 0, 0, 0, 1, 2 },
+	{ -4, 0, 0, 0, 0, 0, 1, 2 },
+};
+
+/* Configuration of the frames, as coded in the header.
+ * Members:
+ *    freq - Sampling frequency code, 0 to 3 for 16 to 48kHz.
+ *    blocks - Number of blocks, 4, 8, 12, 15 or 16.
+ *    mode - Channel mode code.
+ *    alloc - Allocation method code.
+ *    subbands - Number of subbands, 4 or 8.
+ *    bitpool - Size of the bit pool.
+ *    channels - Number of channels, from the mode.
+ */
+struct sbc_params {
+	unsigned int freq;
+	unsigned int blocks;
+	unsigned int mode;
+	unsigned int alloc;
+	unsigned int subbands;
+	unsigned int bitpool;
+	unsigned int channels;
+};
+
+/* One frame, between the bitstream and the filterbanks.
+ * Members:
+ *    join - Bit sb set if subband sb is coded as mid and side.
+ *    scale_factor - Scale factor per channel and subband.
+ *    bits - Bits per sample per channel and subband.
+ *    sb_sample - Subband samples per block, channel and subband.
+ */
+struct sbc_frame {
+	unsigned int join;
+	int scale_factor[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	int bits[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	float sb_sample[SBC_MAX_BLOCKS][SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+};
+
+/* Members:
+ *    msbc - Non-zero for mSBC frames.
+ *    params - The configuration.
+ *    codesize - Size of the PCM of one frame in bytes.
+ *    frame_length - Size of one encoded frame in bytes.
+ *    ops - The filterbank kernels.
+ *    filter - The filterbank coefficients for params.subbands.
+ *    frame - The frame being encoded or decoded.
+ *    x - Analysis input per channel, oldest first. The first
+ *        ANALYSIS_HISTORY samples are kept from the previous frame.
+ *    v - Synthesis state per channel, 2M per block, oldest first. The first
+ *        SYNTHESIS_HISTORY are kept from the previous frame.
+ */
+struct cras_sbc_native {
+	int msbc;
+	struct sbc_params params;
+	size_t codesize;
+	size_t frame_length;
+	const struct cras_sbc_filter_ops *ops;
+	struct cras_sbc_filter filter;
+	struct sbc_frame frame;
+	float x[SBC_MAX_CHANNELS]
+	       [ANALYSIS_HISTORY + SBC_MAX_BLOCKS * SBC_MAX_SUBBANDS];
+	float v[SBC_MAX_CHANNELS]
+	       [SYNTHESIS_HISTORY + SBC_MAX_BLOCKS * 2 * SBC_MAX_SUBBANDS];
+};
+
+static size_t frame_length(const struct sbc_params *p)
+{
+	unsigned int data_bits;
+
+	switch (p->mode) {
+	case SBC_CODE_MONO:
+	case SBC_CODE_DUAL_CHANNEL:
+		data_bits = p->blocks * p->channels * p->bitpool;
+		break;
+	case SBC_CODE_STEREO:
+		data_bits = p->blocks * p->bitpool;
+		break;
+	default:
+		data_bits = p->subbands + p->blocks * p->bitpool;
+		break;
+	}
+	return 4 + 4 * p->subbands * p->channels / 8 + (data_bits + 7) / 8;
+}
+
+/* Applies params to the codec, clearing the filterbank state if they
+ * change. */
+static void set_params(struct cras_sbc_native *sbc, const struct sbc_params *p)
+{
+	if (sbc->params.subbands != p->subbands ||
+	    sbc->params.channels != p->channels) {
+		cras_sbc_filter_init(&sbc->filter, p->subbands);
+		memset(sbc->x, 0, sizeof(sbc->x));
+		memset(sbc->v, 0, sizeof(sbc->v));
+	}
+	sbc->params = *p;
+	sbc->codesize = p->blocks * p->subbands * p->channels * 2;
+	sbc->frame_length = frame_length(p);
+}
+
+static int params_valid(const struct sbc_params *p)
+{
+	unsigned int max_bitpool;
+
+	max_bitpool = p->subbands *
+		      (p->mode == SBC_CODE_MONO ||
+				       p->mode == SBC_CODE_DUAL_CHANNEL ?
+			       16 :
+			       32);
+	return p->bitpool >= 2 && p->bitpool <= max_bitpool;
+}
+
+/* Splits the header byte after the syncword. */
+static void parse_config(uint8_t config, uint8_t bitpool, struct sbc_params *p)
+{
+	p->freq = config >> 6;
+	p->blocks = 4 * (((config >> 4) & 0x03) + 1);
+	p->mode = (config >> 2) & 0x03;
+	p->alloc = (config >> 1) & 0x01;
+	p->subbands = config & 0x01 ? 8 : 4;
+	p->bitpool = bitpool;
+	p->channels = p->mode == SBC_CODE_MONO ? 1 : 2;
+}
+
+static struct cras_sbc_native *create(const struct sbc_params *p, int msbc,
+				      unsigned int cpu_flags)
+{
+	struct cras_sbc_native *sbc;
+
+	if (!params_valid(p))
+		return NULL;
+
+	sbc = (struct cras_sbc_native *)calloc(1, sizeof(*sbc));
+	if (!sbc)
+		return NULL;
+	sbc->msbc = msbc;
+	sbc->ops = cras_sbc_filter_get_ops(cpu_flags);
+	set_params(sbc, p);
+	return sbc;
+}
+
+struct cras_sbc_native *cras_sbc_native_create(uint8_t freq, uint8_t mode,
+					       uint8_t subbands, uint8_t alloc,
+					       uint8_t blocks, uint8_t bitpool,
+					       unsigned int cpu_flags)
+{
+	struct sbc_params p;
+
+	parse_config((freq & 0x03) << 6 | (blocks & 0x03) << 4 |
+			     (mode & 0x03) << 2 | (alloc & 0x01) << 1 |
+			     (subbands & 0x01),
+		     bitpool, &p);
+	return create(&p, 0, cpu_flags);
+}
+
+struct cras_sbc_native *cras_msbc_native_create(unsigned int cpu_flags)
+{
+	struct sbc_params p = {
+		.freq = 0,
+		.blocks = MSBC_BLOCKS,
+		.mode = SBC_CODE_MONO,
+		.alloc = SBC_CODE_LOUDNESS,
+		.subbands = 8,
+		.bitpool = MSBC_BITPOOL,
+		.channels = 1,
+	};
+
+	return create(&p, 1, cpu_flags);
+}
+
+void cras_sbc_native_destroy(struct cras_sbc_native *sbc)
+{
+	free(sbc);
+}
+
+int cras_sbc_native_set_bitpool(struct cras_sbc_native *sbc, uint8_t bitpool)
+{
+	struct sbc_params p = sbc->params;
+
+	p.bitpool = bitpool;
+	if (sbc->msbc || !params_valid(&p))
+		return -EINVAL;
+	set_params(sbc, &p);
+	return 0;
+}
+
+size_t cras_sbc_native_get_codesize(const struct cras_sbc_native *sbc)
+{
+	return sbc->codesize;
+}
+
+size_t cras_sbc_native_get_frame_length(const struct cras_sbc_native *sbc)
+{
+	return sbc->frame_length;
+}
+
+/*
+ * Bit allocation, as in section 12.6.3 of the A2DP specification.
+ */
+
+static void calc_bitneed(const struct sbc_params *p, const int *scale_factor,
+			 int *bitneed, int *max_bitneed)
+{
+	const int *offset = p->subbands == 4 ? offset4[p->freq] :
+					       offset8[p->freq];
+	unsigned int sb;
+	int loudness;
+
+	for (sb = 0; sb < p->subbands; sb++) {
+		if (p->alloc != SBC_CODE_LOUDNESS) {
+			bitneed[sb] = scale_factor[sb];
+		} else if (scale_factor[sb] == 0) {
+			bitneed[sb] = -5;
+		} else {
+			loudness = scale_factor[sb] - offset[sb];
+			bitneed[sb] = loudness > 0 ? loudness / 2 : loudness;
+		}
+		if (bitneed[sb] > *max_bitneed)
+			*max_bitneed = bitneed[sb];
+	}
+}
+
+/* Allocates the bitpool to the subbands of nch channels together. */
+static void allocate_bits(const struct sbc_params *p, unsigned int nch,
+			  int (*scale_factor)[SBC_MAX_SUBBANDS],
+			  int (*bits)[SBC_MAX_SUBBANDS])
+{
+	int bitneed[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	int max_bitneed = 0;
+	int bitcount = 0, slicecount = 0, bitslice;
+	int bitpool = p->bitpool;
+	unsigned int ch, sb;
+
+	for (ch = 0; ch < nch; ch++)
+		calc_bitneed(p, scale_factor[ch], bitneed[ch], &max_bitneed);
+
+	/* Lower the slice until the bitpool is used up. */
+	bitslice = max_bitneed + 1;
+	do {
+		bitslice--;
+		bitcount += slicecount;
+		slicecount = 0;
+		for (ch = 0; ch < nch; ch++)
+			for (sb = 0; sb < p->subbands; sb++) {
+				if (bitneed[ch][sb] > bitslice + 1 &&
+				    bitneed[ch][sb] < bitslice + 16)
+					slicecount++;
+				else if (bitneed[ch][sb] == bitslice + 1)
+					slicecount += 2;
+			}
+	} while (bitcount + slicecount < bitpool);
+
+	if (bitcount + slicecount == bitpool) {
+		bitcount += slicecount;
+		bitslice--;
+	}
+
+	for (ch = 0; ch < nch; ch++)
+		for (sb = 0; sb < p->subbands; sb++) {
+			if (bitneed[ch][sb] < bitslice + 2)
+				bits[ch][sb] = 0;
+			else if (bitneed[ch][sb] - bitslice > 16)
+				bits[ch][sb] = 16;
+			else
+				bits[ch][sb] = bitneed[ch][sb] - bitslice;
+		}
+
+	/* Hand out what is left, alternating channels within a subband. */
+	ch = 0;
+	sb = 0;
+	while (bitcount < bitpool && sb < p->subbands) {
+		if (bits[ch][sb] >= 2 && bits[ch][sb] < 16) {
+			bits[ch][sb]++;
+			bitcount++;
+		} else if (bitneed[ch][sb] == bitslice + 1 &&
+			   bitpool > bitcount + 1) {
+			bits[ch][sb] = 2;
+			bitcount += 2;
+		}
+		if (++ch == nch) {
+			ch = 0;
+			sb++;
+		}
+	}
+
+	ch = 0;
+	sb = 0;
+	while (bitcount < bitpool && sb < p->subbands) {
+		if (bits[ch][sb] < 16) {
+			bits[ch][sb]++;
+			bitcount++;
+		}
+		if (++ch == nch) {
+			ch = 0;
+			sb++;
+		}
+	}
+}
+
+static void calc_bits(const struct sbc_params *p, struct sbc_frame *frame)
+{
+	unsigned int ch;
+
+	if (p->mode == SBC_CODE_MONO || p->mode == SBC_CODE_DUAL_CHANNEL) {
+		for (ch = 0; ch < p->channels; ch++)
+			allocate_bits(p, 1, &frame->scale_factor[ch],
+				      &frame->bits[ch]);
+	} else {
+		allocate_bits(p, 2, frame->scale_factor, frame->bits);
+	}
+}
+
+/*
+ * Bitstream.
+ */
+
+struct bit_writer {
+	uint8_t *p;
+	uint32_t acc;
+	unsigned int n;
+};
+
+static inline void put_bits(struct bit_writer *w, uint32_t value,
+			    unsigned int count)
+{
+	w->acc = (w->acc << count) | value;
+	w->n += count;
+	while (w->n >= 8) {
+		w->n -= 8;
+		*w->p++ = w->acc >> w->n;
+	}
+}
+
+static inline void flush_bits(struct bit_writer *w)
+{
+	if (w->n)
+		*w->p++ = w->acc << (8 - w->n);
+	w->n = 0;
+}
+
+struct bit_reader {
+	const uint8_t *p;
+	uint32_t acc;
+	unsigned int n;
+};
+
+/* Reads count bits, up to 16. Callers check the frame is long enough. */
+static inline uint32_t get_bits(struct bit_reader *r, unsigned int count)
+{
+	while (r->n < count) {
+		r->acc = (r->acc << 8) | *r->p++;
+		r->n += 8;
+	}
+	r->n -= count;
+	return (r->acc >> r->n) & ((1u << count) - 1);
+}
+
+/* CRC-8 of the first nbits of data, most significant bit first. */
+static uint8_t crc8(uint8_t crc, const uint8_t *data, unsigned int nbits)
+{
+	unsigned int i;
+	int bit;
+
+	for (i = 0; i < nbits; i++) {
+		bit = (data[i / 8] >> (7 - i % 8)) & 1;
+		if (((crc >> 7) ^ bit) & 1)
+			crc = (crc << 1) ^ SBC_CRC_POLY;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
+/* The CRC covers the two bytes after the syncword, then the join flags and
+ * scale factors that follow it. */
+static uint8_t frame_crc(const struct sbc_params *p, const uint8_t *frame)
+{
+	unsigned int nbits = 4 * p->subbands * p->channels;
+	uint8_t crc;
+
+	if (p->mode == SBC_CODE_JOINT_STEREO)
+		nbits += p->subbands;
+	crc = crc8(SBC_CRC_INIT, frame + 1, 16);
+	return crc8(crc, frame + 4, nbits);
+}
+
+/*
+ * Encoder.
+ */
+
+static int scale_factor_of(float max)
+{
+	int sf = 0;
+
+	while (sf < SBC_MAX_SCALE_FACTOR && max >= (float)(2 << sf))
+		sf++;
+	return sf;
+}
+
+static void calc_scale_factors(const struct sbc_params *p,
+			       struct sbc_frame *frame)
+{
+	float max[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS] = {};
+	float mid, side, max_mid, max_side;
+	unsigned int blk, ch, sb;
+	int sf_mid, sf_side;
+
+	for (blk = 0; blk < p->blocks; blk++)
+		for (ch = 0; ch < p->channels; ch++)
+			for (sb = 0; sb < p->subbands; sb++)
+				max[ch][sb] = fmaxf(
+					max[ch][sb],
+					fabsf(frame->sb_sample[blk][ch][sb]));
+	for (ch = 0; ch < p->channels; ch++)
+		for (sb = 0; sb < p->subbands; sb++)
+			frame->scale_factor[ch][sb] =
+				scale_factor_of(max[ch][sb]);
+
+	frame->join = 0;
+	if (p->mode != SBC_CODE_JOINT_STEREO)
+		return;
+
+	/* Code a subband as mid and side when that takes smaller scale
+	 * factors. The last subband is never joined. */
+	for (sb = 0; sb < p->subbands - 1; sb++) {
+		max_mid = 0;
+		max_side = 0;
+		for (blk = 0; blk < p->blocks; blk++) {
+			mid = (frame->sb_sample[blk][0][sb] +
+			       frame->sb_sample[blk][1][sb]) /
+			      2;
+			side = (frame->sb_sample[blk][0][sb] -
+				frame->sb_sample[blk][1][sb]) /
+			       2;
+			max_mid = fmaxf(max_mid, fabsf(mid));
+			max_side = fmaxf(max_side, fabsf(side));
+		}
+		sf_mid = scale_factor_of(max_mid);
+		sf_side = scale_factor_of(max_side);
+		if (sf_mid + sf_side >= frame->scale_factor[0][sb] +
+						frame->scale_factor[1][sb])
+			continue;
+
+		frame->join |= 1 << sb;
+		frame->scale_factor[0][sb] = sf_mid;
+		frame->scale_factor[1][sb] = sf_side;
+		for (blk = 0; blk < p->blocks; blk++) {
+			mid = (frame->sb_sample[blk][0][sb] +
+			       frame->sb_sample[blk][1][sb]) /
+			      2;
+			side = (frame->sb_sample[blk][0][sb] -
+				frame->sb_sample[blk][1][sb]) /
+			       2;
+			frame->sb_sample[blk][0][sb] = mid;
+			frame->sb_sample[blk][1][sb] = side;
+		}
+	}
+}
+
+static void analyze(struct cras_sbc_native *sbc, const int16_t *pcm)
+{
+	const struct sbc_params *p = &sbc->params;
+	const unsigned int m = p->subbands;
+	unsigned int blk, ch, i;
+	float *x;
+
+	for (ch = 0; ch < p->channels; ch++) {
+		x = sbc->x[ch];
+		for (i = 0; i < p->blocks * m; i++)
+			x[ANALYSIS_HISTORY + i] = pcm[i * p->channels + ch];
+
+		/* Block blk is the newest m samples of the window starting
+		 * at x + blk * m. */
+		x += ANALYSIS_HISTORY - 9 * m;
+		for (blk = 0; blk < p->blocks; blk++)
+			sbc->ops->analyze(&sbc->filter, x + blk * m,
+					  sbc->frame.sb_sample[blk][ch]);
+		memmove(x, x + p->blocks * m, 9 * m * sizeof(*x));
+	}
+}
+
+static void pack_frame(const struct cras_sbc_native *sbc, uint8_t *out)
+{
+	const struct sbc_params *p = &sbc->params;
+	const struct sbc_frame *frame = &sbc->frame;
+	struct bit_writer w = { out, 0, 0 };
+	float scale[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	float levels[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	unsigned int blk, ch, sb;
+	int q, max_q;
+
+	if (sbc->msbc) {
+		put_bits(&w, MSBC_SYNCWORD, 8);
+		put_bits(&w, 0, 16);
+	} else {
+		put_bits(&w, SBC_SYNCWORD, 8);
+		put_bits(&w,
+			 p->freq << 6 | (p->blocks / 4 - 1) << 4 |
+				 p->mode << 2 | p->alloc << 1 |
+				 (p->subbands == 8),
+			 8);
+		put_bits(&w, p->bitpool, 8);
+	}
+	put_bits(&w, 0, 8);
+
+	if (p->mode == SBC_CODE_JOINT_STEREO)
+		for (sb = 0; sb < p->subbands; sb++)
+			put_bits(&w, (frame->join >> sb) & 1, 1);
+	for (ch = 0; ch < p->channels; ch++)
+		for (sb = 0; sb < p->subbands; sb++) {
+			put_bits(&w, frame->scale_factor[ch][sb], 4);
+			levels[ch][sb] = (1 << frame->bits[ch][sb]) - 1;
+			scale[ch][sb] = levels[ch][sb] / 2 /
+					(2 << frame->scale_factor[ch][sb]);
+		}
+
+	/* Samples are scaled from +-2^(sf + 1) to 0 to levels. */
+	for (blk = 0; blk < p->blocks; blk++)
+		for (ch = 0; ch < p->channels; ch++)
+			for (sb = 0; sb < p->subbands; sb++) {
+				if (!frame->bits[ch][sb])
+					continue;
+				max_q = levels[ch][sb] - 1;
+				q = (int)(frame->sb_sample[blk][ch][sb] *
+						  scale[ch][sb] +
+					  levels[ch][sb] / 2);
+				q = q < 0 ? 0 : q > max_q ? max_q : q;
+				put_bits(&w, q, frame->bits[ch][sb]);
+			}
+	flush_bits(&w);
+
+	out[3] = frame_crc(p, out);
+}
+
+ssize_t cras_sbc_native_encode(struct cras_sbc_native *sbc, const void *input,
+			       size_t input_len, void *output,
+			       size_t output_len, ssize_t *written)
+{
+	*written = 0;
+	if (input_len < sbc->codesize)
+		return 0;
+	if (!output || output_len < sbc->frame_length)
+		return -ENOSPC;
+
+	analyze(sbc, (const int16_t *)input);
+	calc_scale_factors(&sbc->params, &sbc->frame);
+	calc_bits(&sbc->params, &sbc->frame);
+	pack_frame(sbc, (uint8_t *)output);
+
+	*written = sbc->frame_length;
+	return sbc->codesize;
+}
+
+/*
+ * Decoder.
+ */
+
+static int unpack_frame(struct cras_sbc_native *sbc, const uint8_t *in,
+			size_t len)
+{
+	struct sbc_params p;
+	struct sbc_frame *frame = &sbc->frame;
+	struct bit_reader r;
+	float scale[SBC_MAX_CHANNELS][SBC_MAX_SUBBANDS];
+	float side;
+	unsigned int blk, ch, sb;
+	uint32_t q;
+
+	if (len < 4)
+		return -EINVAL;
+	if (sbc->msbc) {
+		if (in[0] != MSBC_SYNCWORD || in[1] || in[2])
+			return -EINVAL;
+		p = sbc->params;
+	} else {
+		if (in[0] != SBC_SYNCWORD)
+			return -EINVAL;
+		parse_config(in[1], in[2], &p);
+		if (!params_valid(&p))
+			return -EINVAL;
+	}
+	if (len < frame_length(&p))
+		return -EINVAL;
+	if (frame_crc(&p, in) != in[3])
+		return -EBADMSG;
+
+	/* Like libsbc, follow the configuration of the stream. */
+	set_params(sbc, &p);
+
+	r.p = in + 4;
+	r.acc = 0;
+	r.n = 0;
+	frame->join = 0;
+	if (p.mode == SBC_CODE_JOINT_STEREO)
+		for (sb = 0; sb < p.subbands; sb++)
+			frame->join |= get_bits(&r, 1) << sb;
+	for (ch = 0; ch < p.channels; ch++)
+		for (sb = 0; sb < p.subbands; sb++)
+			frame->scale_factor[ch][sb] = get_bits(&r, 4);
+	calc_bits(&p, frame);
+
+	/* Quantized samples q map back to the middle of their level,
+	 * 2^(sf + 1) * ((2q + 1) / levels - 1). */
+	for (ch = 0; ch < p.channels; ch++)
+		for (sb = 0; sb < p.subbands; sb++)
+			scale[ch][sb] = frame->bits[ch][sb] ?
+						(float)(2 << frame->scale_factor[ch][sb]) /
+							((1 << frame->bits[ch][sb]) - 1) :
+						0;
+	for (blk = 0; blk < p.blocks; blk++)
+		for (ch = 0; ch < p.channels; ch++)
+			for (sb = 0; sb < p.subbands; sb++) {
+				if (!frame->bits[ch][sb]) {
+					frame->sb_sample[blk][ch][sb] = 0;
+					continue;
+				}
+				q = get_bits(&r, frame->bits[ch][sb]);
+				frame->sb_sample[blk][ch][sb] =
+					scale[ch][sb] * (2 * q + 1) -
+					(float)(2 << frame->scale_factor[ch][sb]);
+			}
+
+	for (sb = 0; sb < p.subbands; sb++) {
+		if (!(frame->join & (1 << sb)))
+			continue;
+		for (blk = 0; blk < p.blocks; blk++) {
+			side = frame->sb_sample[blk][1][sb];
+			frame->sb_sample[blk][1][sb] =
+				frame->sb_sample[blk][0][sb] - side;
+			frame->sb_sample[blk][0][sb] += side;
+		}
+	}
+	return frame_length(&p);
+}
+
+static inline int16_t to_s16(float sample)
+{
+	long value = lrintf(sample);
+
+	return value > INT16_MAX ? INT16_MAX :
+				   value < INT16_MIN ? INT16_MIN : value;
+}
+
+static void synthesize(struct cras_sbc_native *sbc, int16_t *pcm)
+{
+	const struct sbc_params *p = &sbc->params;
+	const unsigned int m = p->subbands, n = 2 * p->subbands;
+	float out[SBC_MAX_SUBBANDS];
+	unsigned int blk, ch, j;
+	float *v;
+
+	for (ch = 0; ch < p->channels; ch++) {
+		v = sbc->v[ch] + SYNTHESIS_HISTORY - 9 * n;
+		for (blk = 0; blk < p->blocks; blk++) {
+			sbc->ops->synthesize(&sbc->filter,
+					     sbc->frame.sb_sample[blk][ch],
+					     v + (9 + blk) * n, out);
+			for (j = 0; j < m; j++)
+				pcm[(blk * m + j) * p->channels + ch] =
+					to_s16(out[j]);
+		}
+		memmove(v, v + p->blocks * n, 9 * n * sizeof(*v));
+	}
+}
+
+ssize_t cras_sbc_native_decode(struct cras_sbc_native *sbc, const void *input,
+			       size_t input_len, void *output,
+			       size_t output_len, size_t *written)
+{
+	int consumed;
+
+	*written = 0;
+	consumed = unpack_frame(sbc, (const uint8_t *)input, input_len);
+	if (consumed < 0)
+		return consumed;
+	if (!output || output_len < sbc->codesize)
+		return -ENOSPC;
+
+	synthesize(sbc, (int16_t *)output);
+	*written = sbc->codesize;
+	return consumed;
+}
@@ -0,0 +1,80 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef COMMON_CRAS_SBC_NATIVE_H_
+#define COMMON_CRAS_SBC_NATIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* An SBC encoder and decoder built into CRAS, which behaves like the libsbc
+ * calls of the same names. Configuration values are the SBC_* codes of
+ * libsbc, which are also the values in the SBC frame header. */
+struct cras_sbc_native;
+
+/* Creates an SBC codec.
+ * Args:
+ *    freq, mode, subbands, alloc, blocks, bitpool - The SBC_* codes of the
+ *        configuration, as given to libsbc.
+ *    cpu_flags - The CPU_X86_* flags from cpu_get_flags(), to pick the
+ *        filterbank kernels.
+ * Returns:
+ *    The codec or NULL if the configuration is invalid.
+ */
+struct cras_sbc_native *cras_sbc_native_create(uint8_t freq, uint8_t mode,
+					       uint8_t subbands, uint8_t alloc,
+					       uint8_t blocks, uint8_t bitpool,
+					       unsigned int cpu_flags);
+
+/* Creates an mSBC codec, with the fixed configuration of HFP wideband
+ * speech. */
+struct cras_sbc_native *cras_msbc_native_create(unsigned int cpu_flags);
+
+void cras_sbc_native_destroy(struct cras_sbc_native *sbc);
+
+/* Changes the bitpool of the frames encoded from now on, keeping the
+ * filterbank state.
+ * Returns:
+ *    0 on success, -EINVAL if the bitpool is out of range for the mode.
+ */
+int cras_sbc_native_set_bitpool(struct cras_sbc_native *sbc, uint8_t bitpool);
+
+/* Gets the size in bytes of the PCM in one frame. */
+size_t cras_sbc_native_get_codesize(const struct cras_sbc_native *sbc);
+
+/* Gets the size in bytes of one encoded frame. */
+size_t cras_sbc_native_get_frame_length(const struct cras_sbc_native *sbc);
+
+/* Encodes one frame.
+ * Args:
+ *    sbc - The codec.
+ *    input, input_len - Interleaved 16 bit PCM.
+ *    output, output_len - Where to write the frame.
+ *    written - Set to the number of bytes written to output.
+ * Returns:
+ *    The number of PCM bytes consumed, 0 if there is less than a frame of
+ *    input, or -ENOSPC if output can't hold the frame.
+ */
+ssize_t cras_sbc_native_encode(struct cras_sbc_native *sbc, const void *input,
+			       size_t input_len, void *output,
+			       size_t output_len, ssize_t *written);
+
+/* Decodes one frame.
+ * Args:
+ *    sbc - The codec.
+ *    input, input_len - The encoded frame.
+ *    output, output_len - Where to write interleaved 16 bit PCM.
+ *    written - Set to the number of bytes written to output.
+ * Returns:
+ *    The number of bytes of input consumed, -EINVAL if the input doesn't
+ *    start with a whole valid frame, -EBADMSG if the frame fails its CRC,
+ *    or -ENOSPC if output can't hold the decoded PCM.
+ */
+ssize_t cras_sbc_native_decode(struct cras_sbc_native *sbc, const void *input,
+			       size_t input_len, void *output,
+			       size_t output_len, size_t *written);
+
+#endif /* COMMON_CRAS_SBC_NATIVE_H_ */
@@ -216,6 +216,8 @@ static inline uint32_t node_index_of(cras_node_id_t id)
 #define MAX_DEBUG_STREAMS 8
 #define AUDIO_THREAD_EVENT_LOG_SIZE (1024 * 6)
 #define CRAS_BT_EVENT_LOG_SIZE 1024
+#define AUDIO_THREAD_LATENCY_SUB_BUCKET_BITS 3
+#define AUDIO_THREAD_LATENCY_NUM_BUCKETS 256
 
 /* There are 8 bits of space for events. */
 enum AUDIO_THREAD_LOG_EVENTS {
@@ -262,6 +264,7 @@ enum AUDIO_THREAD_LOG_EVENTS {
 	AUDIO_THREAD_SEVERE_UNDERRUN,
 	AUDIO_THREAD_CAPTURE_DROP_TIME,
 	AUDIO_THREAD_DEV_DROP_FRAMES,
+	AUDIO_THREAD_A2DP_HANDOFF,
 };
 
 /* There are 8 bits of space for events. */
@@ -306,6 +309,45 @@ struct __attribute__((__packed__)) audio_thread_event_log {
 	struct audio_thread_event log[AUDIO_THREAD_EVENT_LOG_SIZE];
 };
 
+/* Parts of an audio thread wake whose duration is tracked. */
+enum AUDIO_THREAD_LATENCY_PHASE {
+	AUDIO_THREAD_LATENCY_CAPTURE,
+	AUDIO_THREAD_LATENCY_FETCH,
+	AUDIO_THREAD_LATENCY_WRITE,
+	AUDIO_THREAD_LATENCY_DSP,
+	AUDIO_THREAD_LATENCY_CONVERSION,
+	AUDIO_THREAD_LATENCY_WAKE_JITTER,
+	AUDIO_THREAD_LATENCY_NUM_PHASES,
+};
+
+/*
+ * Histogram of durations in nanoseconds. Each power of two is split in
+ * 2^AUDIO_THREAD_LATENCY_SUB_BUCKET_BITS buckets, so a bucket spans at most
+ * 1/8 of its values. Durations past the last bucket are counted in it.
+ *    count - Number of durations recorded.
+ *    sum_ns - Sum of the durations.
+ *    max_ns - The longest duration.
+ *    buckets - Number of durations in each bucket.
+ */
+struct __attribute__((__packed__)) audio_thread_latency_hist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint32_t buckets[AUDIO_THREAD_LATENCY_NUM_BUCKETS];
+};
+
+/*
+ * Histograms of the time spent in each phase of an audio thread wake.
+ *    seq - Odd while the audio thread updates the histograms. Readers copy
+ *        the histograms again if it's odd or changed during the copy.
+ *    hists - One histogram for each AUDIO_THREAD_LATENCY_PHASE.
+ */
+struct __attribute__((__packed__)) audio_thread_latency_stats {
+	uint32_t seq;
+	struct audio_thread_latency_hist
+		hists[AUDIO_THREAD_LATENCY_NUM_PHASES];
+};
+
 struct __attribute__((__packed__)) audio_dev_debug_info {
 	char dev_name[CRAS_NODE_NAME_BUFFER_SIZE];
 	uint32_t buffer_size;
@@ -322,6 +364,8 @@ struct __attribute__((__packed__)) audio_dev_debug_info {
 	uint32_t runtime_sec;
 	uint32_t runtime_nsec;
 	double software_gain_scaler;
+	uint32_t capture_conversions;
+	uint32_t capture_conversions_saved;
 };
 
 struct __attribute__((__packed__)) audio_stream_debug_info {
@@ -453,8 +497,10 @@ struct __attribute__((__packed__)) cras_audio_thread_snapshot_buffer {
  *    snapshot_buffer - ring buffer for storing audio thread snapshots.
  *    bt_debug_info - ring buffer for storing bluetooth event logs.
  *    bt_wbs_enabled - Whether or not bluetooth wideband speech is enabled.
+ *    audio_thread_latency - Audio thread latency histograms, copied in
+ *        along with audio_debug_info.
  */
-#define CRAS_SERVER_STATE_VERSION 2
+#define CRAS_SERVER_STATE_VERSION 3
 struct __attribute__((packed, aligned(4))) cras_server_state {
 	uint32_t state_version;
 	uint32_t volume;
@@ -492,6 +538,7 @@ struct __attribute__((packed, aligned(4))) cras_server_state {
 	struct cras_audio_thread_snapshot_buffer snapshot_buffer;
 	struct cras_bt_debug_info bt_debug_info;
 	int32_t bt_wbs_enabled;
+	struct audio_thread_latency_stats audio_thread_latency;
 };
 
 /* Actions for card add/remove/change. */
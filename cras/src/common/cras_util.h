@@ -21,6 +21,12 @@ extern "C" {
 #define assert_on_compile_is_power_of_2(n)                                     \
 	assert_on_compile((n) != 0 && (((n) & ((n)-1)) == 0))
 
+/* SIMD optimisation flags */
+#define CPU_X86_SSE4_2 1
+#define CPU_X86_AVX 2
+#define CPU_X86_AVX2 4
+#define CPU_X86_FMA 8
+
 /* Enables real time scheduling. */
 int cras_set_rt_scheduling(int rt_lim);
 /* Sets the priority. */
@@ -11,6 +11,9 @@
 #include <math.h>
 #include "biquad.h"
 
+/* The largest magnitude of a Q31 biquad coefficient. */
+#define Q31_COEF_LIMIT (1 << 29)
+
 #ifndef max
 #define max(a, b)                                                              \
 	({                                                                     \
@@ -379,3 +382,36 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		break;
 	}
 }
+
+/* Converts a coefficient to fixed point with frac_bits fractional bits. */
+static int32_t to_fixed(float coef, int frac_bits)
+{
+	return (int32_t)lrint(ldexp(coef, frac_bits));
+}
+
+void biquad_set_q31(struct biquad_q31 *bq, const struct biquad *coefs)
+{
+	float m = max(fabsf(coefs->b0), fabsf(coefs->b1));
+	int frac_bits = 29;
+
+	m = max(m, fabsf(coefs->b2));
+	m = max(m, fabsf(coefs->a1));
+	m = max(m, fabsf(coefs->a2));
+
+	/* Use the most fractional bits that keep the coefficients in range.
+	 * The stable filters biquad_set() makes have |a1| < 2 and |a2| < 1,
+	 * so only large gains give up precision. */
+	while (frac_bits > 1 && ldexp(m, frac_bits) >= Q31_COEF_LIMIT)
+		frac_bits--;
+
+	bq->frac_bits = frac_bits;
+	bq->b0 = to_fixed(coefs->b0, frac_bits);
+	bq->b1 = to_fixed(coefs->b1, frac_bits);
+	bq->b2 = to_fixed(coefs->b2, frac_bits);
+	bq->a1 = to_fixed(coefs->a1, frac_bits);
+	bq->a2 = to_fixed(coefs->a2, frac_bits);
+	bq->x1 = 0;
+	bq->x2 = 0;
+	bq->y1 = 0;
+	bq->y2 = 0;
+}
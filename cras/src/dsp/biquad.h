@@ -10,6 +10,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 /* The biquad filter parameters. The transfer function H(z) is (b0 + b1 * z^(-1)
  * + b2 * z^(-2)) / (1 + a1 * z^(-1) + a2 * z^(-2)).  The previous two inputs
  * are stored in x1 and x2, and the previous two outputs are stored in y1 and
@@ -50,6 +52,54 @@ enum biquad_type {
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		double gain);
 
+/* A biquad filter for 32 bit fixed point samples, for cores without fast
+ * floating point. The filter doesn't depend on where full scale is, the
+ * dsp pipeline runs it on Q28 samples to leave headroom for gains. It runs in direct form I like struct biquad. The
+ * coefficients have frac_bits fractional bits, chosen so they stay below
+ * 2^29 in magnitude: the five products of a frame then add up in a 64 bit
+ * accumulator without overflow. The history values are samples.
+ */
+struct biquad_q31 {
+	int32_t b0, b1, b2;
+	int32_t a1, a2;
+	int frac_bits;
+	int32_t x1, x2;
+	int32_t y1, y2;
+};
+
+/* Sets the coefficients of a fixed point biquad filter to the ones of a float
+ * biquad filter, and clears its history values.
+ * Args:
+ *    bq - The fixed point biquad filter we want to set.
+ *    coefs - The biquad filter set by biquad_set().
+ */
+void biquad_set_q31(struct biquad_q31 *bq, const struct biquad *coefs);
+
+/* Runs a fixed point sample through a fixed point biquad filter and
+ * returns the filtered sample, saturated to the int32_t range. */
+static inline int32_t biquad_run_q31(struct biquad_q31 *bq, int32_t x)
+{
+	int64_t acc = (int64_t)bq->b0 * x + (int64_t)bq->b1 * bq->x1 +
+		      (int64_t)bq->b2 * bq->x2 - (int64_t)bq->a1 * bq->y1 -
+		      (int64_t)bq->a2 * bq->y2;
+	int32_t y;
+
+	/* Round to nearest. */
+	acc = (acc + ((int64_t)1 << (bq->frac_bits - 1))) >> bq->frac_bits;
+	if (acc > INT32_MAX)
+		y = INT32_MAX;
+	else if (acc < INT32_MIN)
+		y = INT32_MIN;
+	else
+		y = (int32_t)acc;
+
+	bq->x2 = bq->x1;
+	bq->x1 = x;
+	bq->y2 = bq->y1;
+	bq->y1 = y;
+	return y;
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,380 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cascade.h"
+#include "cras_util.h"
+
+/* Number of channels processed in the lanes of one vector. */
+#define CASCADE_LANES 4
+
+/* The AVX2 kernel is built for the target on its own, so one binary runs
+ * on CPUs with and without AVX2. It runs two groups of channels in the 8
+ * lanes of one vector. */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CASCADE_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#define CASCADE_GROUPS                                                         \
+	((CASCADE_MAX_CHANNELS + CASCADE_LANES - 1) / CASCADE_LANES)
+
+/* Number of frames gathered into lanes at once. */
+#define CASCADE_BLOCK 64
+
+typedef float floatv __attribute__((vector_size(4 * CASCADE_LANES)));
+
+enum { B0, B1, B2, A1, A2, NUM_COEFS };
+
+/* One biquad of CASCADE_LANES channels. */
+struct stage {
+	floatv coef[NUM_COEFS];
+	/* The coefficients being ramped to, and the change per frame. */
+	floatv target[NUM_COEFS];
+	floatv step[NUM_COEFS];
+	/* The transposed direct form II state. */
+	floatv z1;
+	floatv z2;
+};
+
+struct cascade {
+	struct stage stages[CASCADE_GROUPS][CASCADE_MAX_BIQUADS];
+	int num_channels;
+	int n[CASCADE_MAX_CHANNELS];
+	int ramp;
+	int ramp_left;
+	int started;
+	/* Whether to run the groups in pairs with the AVX2 kernel. */
+	int avx2;
+};
+
+/* The CPU_X86_* flags new cascades pick their kernel from. */
+static unsigned int cascade_cpu_flags;
+
+void cascade_init(unsigned int cpu_flags)
+{
+	cascade_cpu_flags = cpu_flags;
+}
+
+/* Sets the coefficients of one lane of a stage to the ones of bq, at once
+ * or as a target to ramp to. */
+static void set_lane(struct stage *stage, int lane, const struct biquad *bq,
+		     int now)
+{
+	int i;
+
+	stage->target[B0][lane] = bq->b0;
+	stage->target[B1][lane] = bq->b1;
+	stage->target[B2][lane] = bq->b2;
+	stage->target[A1][lane] = bq->a1;
+	stage->target[A2][lane] = bq->a2;
+	if (now)
+		for (i = 0; i < NUM_COEFS; i++)
+			stage->coef[i][lane] = stage->target[i][lane];
+}
+
+struct cascade *cascade_new(int num_channels)
+{
+	struct cascade *cascade;
+	struct biquad identity;
+	int g, i, l;
+
+	if (num_channels < 1 || num_channels > CASCADE_MAX_CHANNELS)
+		return NULL;
+
+	if (posix_memalign((void **)&cascade, __alignof__(struct cascade),
+			   sizeof(*cascade)))
+		return NULL;
+	memset(cascade, 0, sizeof(*cascade));
+	cascade->num_channels = num_channels;
+#if defined(HAVE_CASCADE_AVX2)
+	cascade->avx2 = !!(cascade_cpu_flags & CPU_X86_AVX2);
+#endif
+
+	/* Unused biquads pass the audio through, so the channels can have
+	 * different numbers of them. */
+	biquad_set(&identity, BQ_NONE, 0, 0, 0);
+	for (g = 0; g < CASCADE_GROUPS; g++)
+		for (i = 0; i < CASCADE_MAX_BIQUADS; i++)
+			for (l = 0; l < CASCADE_LANES; l++)
+				set_lane(&cascade->stages[g][i], l, &identity,
+					 1);
+
+	return cascade;
+}
+
+void cascade_free(struct cascade *cascade)
+{
+	free(cascade);
+}
+
+int cascade_append_biquad(struct cascade *cascade, int channel,
+			  enum biquad_type type, float freq, float Q,
+			  float gain)
+{
+	struct biquad bq;
+	int g = channel / CASCADE_LANES;
+	int l = channel % CASCADE_LANES;
+
+	if (channel < 0 || channel >= cascade->num_channels ||
+	    cascade->n[channel] >= CASCADE_MAX_BIQUADS)
+		return -1;
+	biquad_set(&bq, type, freq, Q, gain);
+	set_lane(&cascade->stages[g][cascade->n[channel]++], l, &bq, 1);
+	return 0;
+}
+
+int cascade_set_biquad(struct cascade *cascade, int channel, int index,
+		       enum biquad_type type, float freq, float Q, float gain)
+{
+	struct biquad bq;
+	struct stage *stage;
+	int now = !cascade->started || !cascade->ramp;
+	float scale;
+	int g, i, k;
+
+	if (channel < 0 || channel >= cascade->num_channels || index < 0 ||
+	    index >= cascade->n[channel])
+		return -1;
+	biquad_set(&bq, type, freq, Q, gain);
+	set_lane(&cascade->stages[channel / CASCADE_LANES][index],
+		 channel % CASCADE_LANES, &bq, now);
+	if (now)
+		return 0;
+
+	/* (Re)start the ramp of every stage from where it is now. */
+	scale = 1.0f / cascade->ramp;
+	for (g = 0; g < CASCADE_GROUPS; g++) {
+		for (i = 0; i < CASCADE_MAX_BIQUADS; i++) {
+			stage = &cascade->stages[g][i];
+			for (k = 0; k < NUM_COEFS; k++)
+				stage->step[k] = (stage->target[k] -
+						  stage->coef[k]) *
+						 scale;
+		}
+	}
+	cascade->ramp_left = cascade->ramp;
+	return 0;
+}
+
+void cascade_set_ramp(struct cascade *cascade, int frames)
+{
+	cascade->ramp = frames > 0 ? frames : 0;
+}
+
+/* Runs frames of buf through n stages, the first ramp of them moving the
+ * coefficients by a step each frame. */
+static inline void run_stages(struct stage *stages, int n, floatv *buf,
+			      int frames, int ramp)
+{
+	floatv z1[CASCADE_MAX_BIQUADS], z2[CASCADE_MAX_BIQUADS];
+	int i, j, k;
+
+	for (i = 0; i < n; i++) {
+		z1[i] = stages[i].z1;
+		z2[i] = stages[i].z2;
+	}
+
+	for (j = 0; j < frames; j++) {
+		floatv x = buf[j];
+		for (i = 0; i < n; i++) {
+			struct stage *s = &stages[i];
+			floatv y;
+
+			if (j < ramp)
+				for (k = 0; k < NUM_COEFS; k++)
+					s->coef[k] += s->step[k];
+
+			y = s->coef[B0] * x + z1[i];
+			z1[i] = s->coef[B1] * x - s->coef[A1] * y + z2[i];
+			z2[i] = s->coef[B2] * x - s->coef[A2] * y;
+			x = y;
+		}
+		buf[j] = x;
+	}
+
+	for (i = 0; i < n; i++) {
+		stages[i].z1 = z1[i];
+		stages[i].z2 = z2[i];
+	}
+}
+
+/* Processes frames of the channels in group g, starting at start. */
+static void process_group(struct cascade *cascade, int g,
+			  float *const *data, int start, int frames, int ramp)
+{
+	floatv buf[CASCADE_BLOCK];
+	int ch = g * CASCADE_LANES;
+	int lanes = cascade->num_channels - ch;
+	int j, l, n;
+
+	if (lanes > CASCADE_LANES)
+		lanes = CASCADE_LANES;
+	n = 0;
+	for (l = 0; l < lanes; l++)
+		if (cascade->n[ch + l] > n)
+			n = cascade->n[ch + l];
+
+	memset(buf, 0, sizeof(buf[0]) * frames);
+	for (l = 0; l < lanes; l++)
+		for (j = 0; j < frames; j++)
+			buf[j][l] = data[ch + l][start + j];
+
+	/* Two copies of the loop, so the common one has no ramp. */
+	if (ramp)
+		run_stages(cascade->stages[g], n, buf, frames, ramp);
+	else
+		run_stages(cascade->stages[g], n, buf, frames, 0);
+
+	for (l = 0; l < lanes; l++)
+		for (j = 0; j < frames; j++)
+			data[ch + l][start + j] = buf[j][l];
+}
+
+#if defined(HAVE_CASCADE_AVX2)
+typedef float floatv8 __attribute__((vector_size(8 * sizeof(float))));
+
+/* The stages of two groups, side by side in the lanes of one vector. */
+struct stage8 {
+	floatv8 coef[NUM_COEFS];
+	floatv8 step[NUM_COEFS];
+	floatv8 z1;
+	floatv8 z2;
+};
+
+/* Puts the lanes of lo and hi side by side, and splits them again. */
+AVX2_TARGET static inline floatv8 join(floatv lo, floatv hi)
+{
+	floatv8 v;
+
+	memcpy(&v, &lo, sizeof(lo));
+	memcpy((float *)&v + CASCADE_LANES, &hi, sizeof(hi));
+	return v;
+}
+
+AVX2_TARGET static inline void split(floatv8 v, floatv *lo, floatv *hi)
+{
+	memcpy(lo, &v, sizeof(*lo));
+	memcpy(hi, (float *)&v + CASCADE_LANES, sizeof(*hi));
+}
+
+/* Same as run_stages(), for the stages lo and hi of two groups. */
+AVX2_TARGET static inline void run_stages8(struct stage *lo,
+					   struct stage *hi, int n,
+					   floatv8 *buf, int frames, int ramp)
+{
+	struct stage8 stages[CASCADE_MAX_BIQUADS];
+	int i, j, k;
+
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < NUM_COEFS; k++) {
+			stages[i].coef[k] = join(lo[i].coef[k], hi[i].coef[k]);
+			stages[i].step[k] = join(lo[i].step[k], hi[i].step[k]);
+		}
+		stages[i].z1 = join(lo[i].z1, hi[i].z1);
+		stages[i].z2 = join(lo[i].z2, hi[i].z2);
+	}
+
+	for (j = 0; j < frames; j++) {
+		floatv8 x = buf[j];
+		for (i = 0; i < n; i++) {
+			struct stage8 *s = &stages[i];
+			floatv8 y;
+
+			if (j < ramp)
+				for (k = 0; k < NUM_COEFS; k++)
+					s->coef[k] += s->step[k];
+
+			y = s->coef[B0] * x + s->z1;
+			s->z1 = s->coef[B1] * x - s->coef[A1] * y + s->z2;
+			s->z2 = s->coef[B2] * x - s->coef[A2] * y;
+			x = y;
+		}
+		buf[j] = x;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (ramp)
+			for (k = 0; k < NUM_COEFS; k++)
+				split(stages[i].coef[k], &lo[i].coef[k],
+				      &hi[i].coef[k]);
+		split(stages[i].z1, &lo[i].z1, &hi[i].z1);
+		split(stages[i].z2, &lo[i].z2, &hi[i].z2);
+	}
+}
+
+/* Same as process_group(), for the groups g and g + 1. */
+AVX2_TARGET static void process_group8(struct cascade *cascade, int g,
+				       float *const *data, int start,
+				       int frames, int ramp)
+{
+	floatv8 buf[CASCADE_BLOCK];
+	int ch = g * CASCADE_LANES;
+	int lanes = cascade->num_channels - ch;
+	int j, l, n;
+
+	if (lanes > 2 * CASCADE_LANES)
+		lanes = 2 * CASCADE_LANES;
+	n = 0;
+	for (l = 0; l < lanes; l++)
+		if (cascade->n[ch + l] > n)
+			n = cascade->n[ch + l];
+
+	memset(buf, 0, sizeof(buf[0]) * frames);
+	for (l = 0; l < lanes; l++)
+		for (j = 0; j < frames; j++)
+			buf[j][l] = data[ch + l][start + j];
+
+	if (ramp)
+		run_stages8(cascade->stages[g], cascade->stages[g + 1], n, buf,
+			    frames, ramp);
+	else
+		run_stages8(cascade->stages[g], cascade->stages[g + 1], n, buf,
+			    frames, 0);
+
+	for (l = 0; l < lanes; l++)
+		for (j = 0; j < frames; j++)
+			data[ch + l][start + j] = buf[j][l];
+}
+#endif
+
+void cascade_process(struct cascade *cascade, float *const *data, int count)
+{
+	int groups = (cascade->num_channels + CASCADE_LANES - 1) /
+		     CASCADE_LANES;
+	int start, frames, ramp, g, i;
+
+	cascade->started = 1;
+	for (start = 0; start < count; start += frames) {
+		frames = count - start;
+		if (frames > CASCADE_BLOCK)
+			frames = CASCADE_BLOCK;
+		ramp = cascade->ramp_left < frames ? cascade->ramp_left :
+						     frames;
+
+		g = 0;
+#if defined(HAVE_CASCADE_AVX2)
+		if (cascade->avx2)
+			for (; g + 1 < groups; g += 2)
+				process_group8(cascade, g, data, start, frames,
+					       ramp);
+#endif
+		for (; g < groups; g++)
+			process_group(cascade, g, data, start, frames, ramp);
+
+		if (!ramp)
+			continue;
+		cascade->ramp_left -= ramp;
+		if (cascade->ramp_left)
+			continue;
+		/* Land exactly on the targets. */
+		for (g = 0; g < groups; g++)
+			for (i = 0; i < CASCADE_MAX_BIQUADS; i++)
+				memcpy(cascade->stages[g][i].coef,
+				       cascade->stages[g][i].target,
+				       sizeof(cascade->stages[g][i].coef));
+	}
+}
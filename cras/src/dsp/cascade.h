@@ -0,0 +1,83 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CASCADE_H_
+#define CASCADE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A cascade of biquad filters for up to CASCADE_MAX_CHANNELS channels. It
+ * does what "eq2" does, but runs each frame through all the biquads before
+ * moving on to the next one, so the intermediate results and the filter
+ * states stay in registers. The biquads are in transposed direct form II,
+ * and the channels are packed in the lanes of a vector: 4 of them, or 8
+ * with the AVX2 kernel when there are more than 4 channels.
+ *
+ * The biquads can be changed while the cascade runs, the coefficients are
+ * then interpolated over a number of frames to avoid clicks.
+ */
+
+#include "biquad.h"
+
+/* Maximum number of biquad filters a cascade can have per channel */
+#define CASCADE_MAX_BIQUADS 10
+
+/* Maximum number of channels a cascade can have */
+#define CASCADE_MAX_CHANNELS 8
+
+struct cascade;
+
+/* Sets the CPU_X86_* flags from cpu_get_flags() that cascades created
+ * afterwards pick their kernel from. */
+void cascade_init(unsigned int cpu_flags);
+
+/* Creates a cascade for num_channels channels, at most
+ * CASCADE_MAX_CHANNELS. Returns NULL if num_channels is out of range or
+ * there is no memory. */
+struct cascade *cascade_new(int num_channels);
+
+/* Frees a cascade. */
+void cascade_free(struct cascade *cascade);
+
+/* Appends a biquad filter to a channel of the cascade. See
+ * eq2_append_biquad() for the parameters.
+ * Returns:
+ *    0 if success. -1 if the channel has no room for more biquads.
+ */
+int cascade_append_biquad(struct cascade *cascade, int channel,
+			  enum biquad_type type, float freq, float Q,
+			  float gain);
+
+/* Replaces a biquad filter already appended to a channel. Once the cascade
+ * has processed audio, the coefficients move to the new ones over the
+ * frames set by cascade_set_ramp().
+ * Args:
+ *    index - The position of the biquad in the channel, from 0.
+ *    The other arguments are the same as for cascade_append_biquad().
+ * Returns:
+ *    0 if success. -1 if there is no such biquad.
+ */
+int cascade_set_biquad(struct cascade *cascade, int channel, int index,
+		       enum biquad_type type, float freq, float Q, float gain);
+
+/* Sets the number of frames over which cascade_set_biquad() changes the
+ * coefficients. 0, the default, changes them at once. */
+void cascade_set_ramp(struct cascade *cascade, int frames);
+
+/* Processes a buffer of audio data through the cascade.
+ * Args:
+ *    cascade - The cascade we want to use.
+ *    data - One array of audio samples per channel of the cascade.
+ *    count - The number of elements in each of the data array to process.
+ */
+void cascade_process(struct cascade *cascade, float *const *data, int count);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CASCADE_H_ */
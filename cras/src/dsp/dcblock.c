@@ -8,12 +8,24 @@
 
 #define RAMP_TIME_MS 20
 
+/* 1.0 in Q31, one more than the largest Q31 sample. */
+#define Q31_ONE ((int64_t)1 << 31)
+
 struct dcblock {
 	float R;
 	float x_prev;
 	float y_prev;
 	float ramp_factor;
 	float ramp_increment;
+
+	/* The same for dcblock_process_q31(), in Q31. y_prev is kept in 64
+	 * bits because the output of the filter can go beyond the int32_t
+	 * range before it is saturated. */
+	int32_t R_q31;
+	int32_t x_prev_q31;
+	int64_t y_prev_q31;
+	int64_t ramp_factor_q31;
+	int64_t ramp_increment_q31;
 };
 
 struct dcblock *dcblock_new(float R, unsigned long sample_rate)
@@ -21,6 +33,9 @@ struct dcblock *dcblock_new(float R, unsigned long sample_rate)
 	struct dcblock *dcblock = (struct dcblock *)calloc(1, sizeof(*dcblock));
 	dcblock->R = R;
 	dcblock->ramp_increment = 1000. / (float)(RAMP_TIME_MS * sample_rate);
+	dcblock->R_q31 = R >= 1 ? INT32_MAX : (int32_t)(R * Q31_ONE);
+	dcblock->ramp_increment_q31 =
+		Q31_ONE * 1000 / (RAMP_TIME_MS * sample_rate);
 	return dcblock;
 }
 
@@ -60,3 +75,34 @@ void dcblock_process(struct dcblock *dcblock, float *data, int count)
 	dcblock->x_prev = x_prev;
 	dcblock->y_prev = y_prev;
 }
+
+void dcblock_process_q31(struct dcblock *dcblock, int32_t *data, int count)
+{
+	int n;
+	int32_t x_prev = dcblock->x_prev_q31;
+	int64_t y_prev = dcblock->y_prev_q31;
+	int64_t R = dcblock->R_q31;
+
+	for (n = 0; n < count; n++) {
+		int32_t x = data[n];
+		int64_t d = (int64_t)x - x_prev + ((R * y_prev) >> 31);
+
+		y_prev = d;
+		x_prev = x;
+
+		/* The same mix-in ramp as dcblock_process(). */
+		if (dcblock->ramp_factor_q31 < Q31_ONE) {
+			d = (d * dcblock->ramp_factor_q31) >> 31;
+			dcblock->ramp_factor_q31 +=
+				dcblock->ramp_increment_q31;
+		}
+
+		if (d > INT32_MAX)
+			d = INT32_MAX;
+		else if (d < INT32_MIN)
+			d = INT32_MIN;
+		data[n] = (int32_t)d;
+	}
+	dcblock->x_prev_q31 = x_prev;
+	dcblock->y_prev_q31 = y_prev;
+}
@@ -12,6 +12,8 @@ extern "C" {
 
 /* A DC blocking filter. */
 
+#include <stdint.h>
+
 struct dcblock;
 
 /*
@@ -35,6 +37,16 @@ void dcblock_free(struct dcblock *dcblock);
  */
 void dcblock_process(struct dcblock *dcblock, float *data, int count);
 
+/* Same as dcblock_process(), on 32 bit fixed point samples such as the
+ * Q28 ones of the dsp pipeline. The output saturates to the int32_t range.
+ * A filter must only be used with one of the two functions.
+ * Args:
+ *    dcblock - The filter we want to use.
+ *    data - The array of fixed point audio samples.
+ *    count - The number of elements in the data array to process.
+ */
+void dcblock_process_q31(struct dcblock *dcblock, int32_t *data, int count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -27,6 +27,7 @@ struct drc *drc_new(float sample_rate)
 {
 	struct drc *drc = (struct drc *)calloc(1, sizeof(struct drc));
 	drc->sample_rate = sample_rate;
+	drc->num_channels = 2;
 	set_default_parameters(drc);
 	return drc;
 }
@@ -53,7 +54,7 @@ static void init_data_buffer(struct drc *drc)
 	int i;
 	size_t size = sizeof(float) * DRC_PROCESS_MAX_FRAMES;
 
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
+	for (i = 0; i < drc->num_channels; i++) {
 		drc->data1[i] = (float *)calloc(1, size);
 		drc->data2[i] = (float *)calloc(1, size);
 	}
@@ -64,7 +65,7 @@ static void free_data_buffer(struct drc *drc)
 {
 	int i;
 
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
+	for (i = 0; i < drc->num_channels; i++) {
 		free(drc->data1[i]);
 		free(drc->data2[i]);
 	}
@@ -178,13 +179,13 @@ static void init_emphasis_eq(struct drc *drc)
 	float stage_ratio = drc_get_param(drc, 0, PARAM_FILTER_STAGE_RATIO);
 	float anchor_freq = drc_get_param(drc, 0, PARAM_FILTER_ANCHOR);
 
-	drc->emphasis_eq = eq2_new();
-	drc->deemphasis_eq = eq2_new();
+	drc->emphasis_eq = eq2_new_channels(drc->num_channels);
+	drc->deemphasis_eq = eq2_new_channels(drc->num_channels);
 
 	for (i = 0; i < 2; i++) {
 		emphasis_stage_pair_biquads(stage_gain, anchor_freq,
 					    anchor_freq / stage_ratio, &e, &d);
-		for (j = 0; j < 2; j++) {
+		for (j = 0; j < drc->num_channels; j++) {
 			eq2_append_biquad_direct(drc->emphasis_eq, j, &e);
 			eq2_append_biquad_direct(drc->deemphasis_eq, j, &d);
 		}
@@ -204,8 +205,11 @@ static void init_crossover(struct drc *drc)
 {
 	float freq1 = drc->parameters[1][PARAM_CROSSOVER_LOWER_FREQ];
 	float freq2 = drc->parameters[2][PARAM_CROSSOVER_LOWER_FREQ];
+	int i;
 
-	crossover2_init(&drc->xo2, freq1, freq2);
+	for (i = 0; i < drc->num_channels / 2; i++)
+		crossover2_init(&drc->xo2[i], freq1, freq2);
+	crossover_init(&drc->xo, freq1, freq2);
 }
 
 /* Initializes the compressor kernels */
@@ -214,7 +218,7 @@ static void init_kernel(struct drc *drc)
 	int i;
 
 	for (i = 0; i < DRC_NUM_KERNELS; i++) {
-		dk_init(&drc->kernel[i], drc->sample_rate);
+		dk_init(&drc->kernel[i], drc->sample_rate, drc->num_channels);
 
 		float db_threshold = drc_get_param(drc, i, PARAM_THRESHOLD);
 		float db_knee = drc_get_param(drc, i, PARAM_KNEE);
@@ -373,11 +377,16 @@ void drc_process(struct drc *drc, float **data, int frames)
 
 	/* Apply pre-emphasis filter if it is not disabled. */
 	if (!drc->emphasis_disabled)
-		eq2_process(drc->emphasis_eq, data[0], data[1], frames);
+		eq2_process_channels(drc->emphasis_eq, data, frames);
 
 	/* Crossover */
-	crossover2_process(&drc->xo2, frames, data[0], data[1], data1[0],
-			   data1[1], data2[0], data2[1]);
+	for (i = 0; i + 1 < drc->num_channels; i += 2)
+		crossover2_process(&drc->xo2[i / 2], frames, data[i],
+				   data[i + 1], data1[i], data1[i + 1],
+				   data2[i], data2[i + 1]);
+	if (i < drc->num_channels)
+		crossover_process(&drc->xo, frames, data[i], data1[i],
+				  data2[i]);
 
 	/* Apply compression to each band of the signal. The processing is
 	 * performed in place.
@@ -387,10 +396,10 @@ void drc_process(struct drc *drc, float **data, int frames)
 	dk_process(&drc->kernel[2], data2, frames);
 
 	/* Sum the three bands of signal */
-	for (i = 0; i < DRC_NUM_CHANNELS; i++)
+	for (i = 0; i < drc->num_channels; i++)
 		sum3(data[i], data1[i], data2[i], frames);
 
 	/* Apply de-emphasis filter if emphasis is not disabled. */
 	if (!drc->emphasis_disabled)
-		eq2_process(drc->deemphasis_eq, data[0], data[1], frames);
+		eq2_process_channels(drc->deemphasis_eq, data, frames);
 }
@@ -15,6 +15,7 @@
 extern "C" {
 #endif
 
+#include "crossover.h"
 #include "crossover2.h"
 #include "drc_kernel.h"
 #include "eq2.h"
@@ -24,8 +25,8 @@ extern "C" {
  * the loudest parts of the signal and raises the volume of the softest parts,
  * making the sound richer, fuller, and more controlled.
  *
- * This is a three band stereo DRC. There are three compressor kernels, and each
- * can have its own parameters. If a kernel is disabled, it only delays the
+ * This is a three band DRC, stereo unless set otherwise. There are three
+ * compressor kernels, and each can have its own parameters. If a kernel is disabled, it only delays the
  * signal and does not compress it.
  *
  *                   INPUT
@@ -111,6 +112,10 @@ struct drc {
 	/* 1 to disable the emphasis and deemphasis, 0 to enable it. */
 	int emphasis_disabled;
 
+	/* The number of channels, 2 by default and at most DRC_MAX_CHANNELS.
+	 * Like emphasis_disabled it can be changed before drc_init(). */
+	int num_channels;
+
 	/* parameters holds the tweakable compressor parameters. */
 	float parameters[DRC_NUM_KERNELS][PARAM_LAST];
 
@@ -118,8 +123,10 @@ struct drc {
 	struct eq2 *emphasis_eq;
 	struct eq2 *deemphasis_eq;
 
-	/* The crossover filter */
-	struct crossover2 xo2;
+	/* The crossover filters, one for each pair of channels and one more
+	 * for the last channel if the number of channels is odd. */
+	struct crossover2 xo2[DRC_MAX_CHANNELS / 2];
+	struct crossover xo;
 
 	/* The compressor kernels */
 	struct drc_kernel kernel[DRC_NUM_KERNELS];
@@ -127,8 +134,8 @@ struct drc {
 	/* Temporary buffer used during drc_process(). The mid and high band
 	 * signal is stored in these buffers (the low band is stored in the
 	 * original input buffer). */
-	float *data1[DRC_NUM_CHANNELS];
-	float *data2[DRC_NUM_CHANNELS];
+	float *data1[DRC_MAX_CHANNELS];
+	float *data2[DRC_MAX_CHANNELS];
 };
 
 /* DRC needs the parameters to be set before initialization. So drc_new() should
@@ -160,9 +167,8 @@ void drc_free(struct drc *drc);
 /* Processes input data using a DRC.
  * Args:
  *    drc - The DRC we want to use.
- *    float **data - Pointers to input/output data. The input must be stereo
- *        and one channel is pointed by data[0], another pointed by data[1]. The
- *        output data is stored in the same place.
+ *    float **data - Pointers to input/output data, one for each of the
+ *        num_channels channels. The output data is stored in the same place.
  *    frames - The number of frames to process.
  */
 void drc_process(struct drc *drc, float **data, int frames);
@@ -28,7 +28,7 @@
 const float uninitialized_value = -1;
 static int drc_math_initialized;
 
-void dk_init(struct drc_kernel *dk, float sample_rate)
+void dk_init(struct drc_kernel *dk, float sample_rate, int num_channels)
 {
 	int i;
 
@@ -38,6 +38,7 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 	}
 
 	dk->sample_rate = sample_rate;
+	dk->num_channels = num_channels;
 	dk->detector_average = 0;
 	dk->compressor_gain = 1;
 	dk->enabled = 0;
@@ -59,7 +60,7 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 	assert_on_compile(DIVISION_FRAMES % 4 == 0);
 	/* Allocate predelay buffers */
 	assert_on_compile_is_power_of_2(MAX_PRE_DELAY_FRAMES);
-	for (i = 0; i < DRC_NUM_CHANNELS; i++) {
+	for (i = 0; i < dk->num_channels; i++) {
 		size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
 		dk->pre_delay_buffers[i] = (float *)calloc(1, size);
 	}
@@ -68,7 +69,7 @@ void dk_init(struct drc_kernel *dk, float sample_rate)
 void dk_free(struct drc_kernel *dk)
 {
 	int i;
-	for (i = 0; i < DRC_NUM_CHANNELS; ++i)
+	for (i = 0; i < dk->num_channels; ++i)
 		free(dk->pre_delay_buffers[i]);
 }
 
@@ -93,7 +94,7 @@ static void set_pre_delay_time(struct drc_kernel *dk, float pre_delay_time)
 
 	if (dk->last_pre_delay_frames != pre_delay_frames) {
 		dk->last_pre_delay_frames = pre_delay_frames;
-		for (i = 0; i < DRC_NUM_CHANNELS; ++i) {
+		for (i = 0; i < dk->num_channels; ++i) {
 			size_t size = sizeof(float) * MAX_PRE_DELAY_FRAMES;
 			memset(dk->pre_delay_buffers[i], 0, size);
 		}
@@ -398,7 +399,7 @@ static void dk_update_envelope(struct drc_kernel *dk)
 }
 
 /* For a division of frames, take the absolute values of left channel and right
- * channel, store the maximum of them in output. */
+ * channel, store the maximum of them in output. Output may be data0. */
 #if defined(__aarch64__)
 static inline void max_abs_division(float *output, const float *data0,
 				    const float *data1)
@@ -515,8 +516,18 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 	}
 
 	/* The max abs value across all channels for this frame */
-	max_abs_division(abs_input_array, &dk->pre_delay_buffers[0][div_start],
-			 &dk->pre_delay_buffers[1][div_start]);
+	if (dk->num_channels == 1) {
+		max_abs_division(abs_input_array,
+				 &dk->pre_delay_buffers[0][div_start],
+				 &dk->pre_delay_buffers[0][div_start]);
+	} else {
+		max_abs_division(abs_input_array,
+				 &dk->pre_delay_buffers[0][div_start],
+				 &dk->pre_delay_buffers[1][div_start]);
+		for (i = 2; i < dk->num_channels; i++)
+			max_abs_division(abs_input_array, abs_input_array,
+					 &dk->pre_delay_buffers[i][div_start]);
+	}
 
 	for (i = 0; i < DIVISION_FRAMES; i++) {
 		/* Compute compression amount from un-delayed signal */
@@ -559,20 +570,18 @@ static void dk_update_detector_average(struct drc_kernel *dk)
 	dk->detector_average = detector_average;
 }
 
-/* Calculate compress_gain from the envelope and apply total_gain to compress
- * the next output division. */
+/* Calculate compress_gain from the envelope and apply total_gain to a division
+ * of frames in ptr_left and ptr_right. */
 /* TODO(fbarchard): Port to aarch64 */
 #if defined(__ARM_NEON__)
 #include <arm_neon.h>
-static void dk_compress_output(struct drc_kernel *dk)
+static void dk_compress_division(struct drc_kernel *dk, float *ptr_left,
+				 float *ptr_right)
 {
 	const float master_linear_gain = dk->master_linear_gain;
 	const float envelope_rate = dk->envelope_rate;
 	const float scaled_desired_gain = dk->scaled_desired_gain;
 	const float compressor_gain = dk->compressor_gain;
-	const int div_start = dk->pre_delay_read_index;
-	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
-	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
 	int count = DIVISION_FRAMES / 4;
 
 	/* See warp_sinf() for the details for the constants. */
@@ -707,15 +716,13 @@ static void dk_compress_output(struct drc_kernel *dk)
 }
 #elif defined(__SSE3__) && defined(__x86_64__)
 #include <emmintrin.h>
-static void dk_compress_output(struct drc_kernel *dk)
+static void dk_compress_division(struct drc_kernel *dk, float *ptr_left,
+				 float *ptr_right)
 {
 	const float master_linear_gain = dk->master_linear_gain;
 	const float envelope_rate = dk->envelope_rate;
 	const float scaled_desired_gain = dk->scaled_desired_gain;
 	const float compressor_gain = dk->compressor_gain;
-	const int div_start = dk->pre_delay_read_index;
-	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
-	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
 	int count = DIVISION_FRAMES / 4;
 
 	/* See warp_sinf() for the details for the constants. */
@@ -870,15 +877,13 @@ static void dk_compress_output(struct drc_kernel *dk)
 	}
 }
 #else
-static void dk_compress_output(struct drc_kernel *dk)
+static void dk_compress_division(struct drc_kernel *dk, float *ptr_left,
+				 float *ptr_right)
 {
 	const float master_linear_gain = dk->master_linear_gain;
 	const float envelope_rate = dk->envelope_rate;
 	const float scaled_desired_gain = dk->scaled_desired_gain;
 	const float compressor_gain = dk->compressor_gain;
-	const int div_start = dk->pre_delay_read_index;
-	float *ptr_left = &dk->pre_delay_buffers[0][div_start];
-	float *ptr_right = &dk->pre_delay_buffers[1][div_start];
 	int count = DIVISION_FRAMES / 4;
 
 	int i, j;
@@ -957,6 +962,33 @@ static void dk_compress_output(struct drc_kernel *dk)
 }
 #endif
 
+/* Compresses the next output division. Other than stereo, the gain of each
+ * frame is taken by compressing a division of ones, then applied to every
+ * channel. */
+static void dk_compress_output(struct drc_kernel *dk)
+{
+	const int div_start = dk->pre_delay_read_index;
+	float gain[DIVISION_FRAMES];
+	float unused[DIVISION_FRAMES];
+	int i, j;
+
+	if (dk->num_channels == 2) {
+		dk_compress_division(dk, &dk->pre_delay_buffers[0][div_start],
+				     &dk->pre_delay_buffers[1][div_start]);
+		return;
+	}
+
+	for (i = 0; i < DIVISION_FRAMES; i++)
+		gain[i] = unused[i] = 1;
+	dk_compress_division(dk, gain, unused);
+
+	for (j = 0; j < dk->num_channels; j++) {
+		float *ptr = &dk->pre_delay_buffers[j][div_start];
+		for (i = 0; i < DIVISION_FRAMES; i++)
+			ptr[i] *= gain[i];
+	}
+}
+
 /* After one complete divison of samples have been received (and one divison of
  * samples have been output), we calculate shaped power average
  * (detector_average) from the input division, update envelope parameters from
@@ -979,7 +1011,7 @@ static void dk_copy_fragment(struct drc_kernel *dk, float *data_channels[],
 	int read_index = dk->pre_delay_read_index;
 	int j;
 
-	for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
+	for (j = 0; j < dk->num_channels; ++j) {
 		memcpy(&dk->pre_delay_buffers[j][write_index],
 		       &data_channels[j][frame_index],
 		       frames_to_process * sizeof(float));
@@ -1014,7 +1046,7 @@ static void dk_process_delay_only(struct drc_kernel *dk, float *data_channels[],
 		 * available input samples. */
 		int chunk = min(large - small, MAX_PRE_DELAY_FRAMES - large);
 		chunk = min(chunk, count - i);
-		for (j = 0; j < DRC_NUM_CHANNELS; ++j) {
+		for (j = 0; j < dk->num_channels; ++j) {
 			memcpy(&dk->pre_delay_buffers[j][write_index],
 			       &data_channels[j][i], chunk * sizeof(float));
 			memcpy(&data_channels[j][i],
@@ -15,10 +15,12 @@
 extern "C" {
 #endif
 
-#define DRC_NUM_CHANNELS 2
+/* The maximum number of channels a drc kernel can compress together. */
+#define DRC_MAX_CHANNELS 8
 
 struct drc_kernel {
 	float sample_rate;
+	int num_channels;
 
 	/* The detector_average is the target gain obtained by looking at the
 	 * future samples in the lookahead buffer and applying the compression
@@ -33,7 +35,7 @@ struct drc_kernel {
 
 	/* Lookahead section. */
 	unsigned last_pre_delay_frames;
-	float *pre_delay_buffers[DRC_NUM_CHANNELS];
+	float *pre_delay_buffers[DRC_MAX_CHANNELS];
 	int pre_delay_read_index;
 	int pre_delay_write_index;
 
@@ -78,8 +80,9 @@ struct drc_kernel {
 	float scaled_desired_gain;
 };
 
-/* Initializes a drc kernel */
-void dk_init(struct drc_kernel *dk, float sample_rate);
+/* Initializes a drc kernel for num_channels channels, at most
+ * DRC_MAX_CHANNELS. */
+void dk_init(struct drc_kernel *dk, float sample_rate, int num_channels);
 
 /* Frees a drc kernel */
 void dk_free(struct drc_kernel *dk);
@@ -94,7 +97,7 @@ void dk_set_parameters(struct drc_kernel *dk, float db_threshold, float db_knee,
 /* Enables or disables a drc kernel */
 void dk_set_enabled(struct drc_kernel *dk, int enabled);
 
-/* Performs stereo-linked compression.
+/* Performs compression linked across all channels.
  * Args:
  *    dk - The DRC kernel.
  *    data - The pointers to the audio sample buffer. One pointer per channel.
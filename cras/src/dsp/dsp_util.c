@@ -28,6 +28,8 @@
 
 #undef deinterleave_stereo
 #undef interleave_stereo
+#undef deinterleave_multi
+#undef interleave_multi
 
 /* Converts shorts in range of -32768 to 32767 to floats in range of
  * -1.0f to 1.0f.
@@ -388,6 +390,212 @@ static void interleave_stereo(float *input1, float *input2, int16_t *output,
 #define interleave_stereo interleave_stereo
 #endif
 
+/* Converts 4, 6 or 8 channels of shorts four frames at a time. A structure
+ * load splits the frames by channel, channel pairs are then separated by
+ * an unzip.
+ */
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+
+static inline void store_s16_as_float(float *output, int16x4_t v)
+{
+	vst1q_f32(output, vcvtq_n_f32_s32(vmovl_s16(v), 15));
+}
+
+static void deinterleave_multi(int16_t *input, float *const *output,
+			       int channels, int frames)
+{
+	int chunk = frames & ~3;
+	int i, j, k;
+
+	for (i = 0; i < chunk; i += 4) {
+		if (channels == 4) {
+			/* L0 R0 C0 S0 L1 ... -> L0 L1 L2 L3, R0 R1 R2 R3... */
+			int16x4x4_t v = vld4_s16(input);
+			for (k = 0; k < 4; k++)
+				store_s16_as_float(output[k] + i, v.val[k]);
+		} else if (channels == 6) {
+			/* val[k] holds channel k and k + 3 alternately. */
+			int16x8x3_t v = vld3q_s16(input);
+			for (k = 0; k < 3; k++) {
+				int16x8x2_t u = vuzpq_s16(v.val[k], v.val[k]);
+				store_s16_as_float(output[k] + i,
+						   vget_low_s16(u.val[0]));
+				store_s16_as_float(output[k + 3] + i,
+						   vget_low_s16(u.val[1]));
+			}
+		} else {
+			/* val[k] holds channel k and k + 4 alternately. */
+			int16x8x4_t v = vld4q_s16(input);
+			for (k = 0; k < 4; k++) {
+				int16x8x2_t u = vuzpq_s16(v.val[k], v.val[k]);
+				store_s16_as_float(output[k] + i,
+						   vget_low_s16(u.val[0]));
+				store_s16_as_float(output[k + 4] + i,
+						   vget_low_s16(u.val[1]));
+			}
+		}
+		input += 4 * channels;
+	}
+
+	for (; i < frames; i++)
+		for (j = 0; j < channels; j++)
+			output[j][i] = *input++ / 32768.0f;
+}
+#define deinterleave_multi deinterleave_multi
+
+/* Rounds to nearest with ties away from zero, like interleave_stereo, and
+ * saturates to the range of shorts. */
+static inline int16x4_t load_float_as_s16(const float *input)
+{
+	float32x4_t x = vld1q_f32(input);
+	float32x4_t half = vbslq_f32(vcgtq_f32(x, vdupq_n_f32(0)),
+				     vdupq_n_f32(0.5f / 32768.0f),
+				     vdupq_n_f32(-0.5f / 32768.0f));
+	return vqmovn_s32(vcvtq_n_s32_f32(vaddq_f32(x, half), 15));
+}
+
+static void interleave_multi(float *const *input, int16_t *output,
+			     int channels, int frames)
+{
+	int chunk = frames & ~3;
+	int i, j, k;
+
+	for (i = 0; i < chunk; i += 4) {
+		if (channels == 4) {
+			int16x4x4_t v;
+			for (k = 0; k < 4; k++)
+				v.val[k] = load_float_as_s16(input[k] + i);
+			vst4_s16(output, v);
+		} else if (channels == 6) {
+			int16x8x3_t v;
+			for (k = 0; k < 3; k++) {
+				int16x4x2_t z = vzip_s16(
+					load_float_as_s16(input[k] + i),
+					load_float_as_s16(input[k + 3] + i));
+				v.val[k] = vcombine_s16(z.val[0], z.val[1]);
+			}
+			vst3q_s16(output, v);
+		} else {
+			int16x8x4_t v;
+			for (k = 0; k < 4; k++) {
+				int16x4x2_t z = vzip_s16(
+					load_float_as_s16(input[k] + i),
+					load_float_as_s16(input[k + 4] + i));
+				v.val[k] = vcombine_s16(z.val[0], z.val[1]);
+			}
+			vst4q_s16(output, v);
+		}
+		output += 4 * channels;
+	}
+
+	for (; i < frames; i++)
+		for (j = 0; j < channels; j++) {
+			float f = input[j][i] * 32768.0f;
+			f += (f >= 0) ? 0.5f : -0.5f;
+			*output++ = max(-32768, min(32767, (int)(f)));
+		}
+}
+#define interleave_multi interleave_multi
+
+#elif defined(__SSE3__)
+
+/* Converts 4, 6 or 8 channels four frames at a time. The samples of four
+ * frames are converted to a buffer, then each group of four channels is
+ * moved to the outputs with a 4x4 transpose. With six channels the groups
+ * start at channel 0 and 2 and overlap.
+ */
+static void deinterleave_multi(int16_t *input, float *const *output,
+			       int channels, int frames)
+{
+	float buf[32] __attribute__((aligned(16)));
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	int chunk = frames & ~3;
+	int i, j, g;
+
+	for (i = 0; i < chunk; i += 4) {
+		/* 4 * channels shorts, always a multiple of 8. */
+		for (j = 0; j < 4 * channels; j += 8) {
+			__m128i v = _mm_loadu_si128((__m128i *)(input + j));
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v),
+						    16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v),
+						    16);
+			_mm_store_ps(buf + j,
+				     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_store_ps(buf + j + 4,
+				     _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+		for (g = 0; g < channels; g += 4) {
+			int c = min(g, channels - 4);
+			__m128 r0 = _mm_loadu_ps(buf + c);
+			__m128 r1 = _mm_loadu_ps(buf + channels + c);
+			__m128 r2 = _mm_loadu_ps(buf + 2 * channels + c);
+			__m128 r3 = _mm_loadu_ps(buf + 3 * channels + c);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(output[c] + i, r0);
+			_mm_storeu_ps(output[c + 1] + i, r1);
+			_mm_storeu_ps(output[c + 2] + i, r2);
+			_mm_storeu_ps(output[c + 3] + i, r3);
+		}
+		input += 4 * channels;
+	}
+
+	for (; i < frames; i++)
+		for (j = 0; j < channels; j++)
+			output[j][i] = *input++ / 32768.0f;
+}
+#define deinterleave_multi deinterleave_multi
+
+/* The inverse of deinterleave_multi(). Rounds to nearest with ties to even,
+ * like interleave_stereo, and clamps before converting so large values
+ * saturate on the correct side.
+ */
+static void interleave_multi(float *const *input, int16_t *output,
+			     int channels, int frames)
+{
+	float buf[32] __attribute__((aligned(16)));
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 hi_clamp = _mm_set1_ps(32767.0f);
+	const __m128 lo_clamp = _mm_set1_ps(-32768.0f);
+	int chunk = frames & ~3;
+	int i, j, g;
+
+	for (i = 0; i < chunk; i += 4) {
+		for (g = 0; g < channels; g += 4) {
+			int c = min(g, channels - 4);
+			__m128 r0 = _mm_loadu_ps(input[c] + i);
+			__m128 r1 = _mm_loadu_ps(input[c + 1] + i);
+			__m128 r2 = _mm_loadu_ps(input[c + 2] + i);
+			__m128 r3 = _mm_loadu_ps(input[c + 3] + i);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(buf + c, r0);
+			_mm_storeu_ps(buf + channels + c, r1);
+			_mm_storeu_ps(buf + 2 * channels + c, r2);
+			_mm_storeu_ps(buf + 3 * channels + c, r3);
+		}
+		for (j = 0; j < 4 * channels; j += 8) {
+			__m128 lo = _mm_mul_ps(_mm_load_ps(buf + j), scale);
+			__m128 hi = _mm_mul_ps(_mm_load_ps(buf + j + 4), scale);
+			lo = _mm_max_ps(_mm_min_ps(lo, hi_clamp), lo_clamp);
+			hi = _mm_max_ps(_mm_min_ps(hi, hi_clamp), lo_clamp);
+			_mm_storeu_si128((__m128i *)(output + j),
+					 _mm_packs_epi32(_mm_cvtps_epi32(lo),
+							 _mm_cvtps_epi32(hi)));
+		}
+		output += 4 * channels;
+	}
+
+	for (; i < frames; i++)
+		for (j = 0; j < channels; j++) {
+			float f = input[j][i] * 32768.0f;
+			f += (f >= 0) ? 0.5f : -0.5f;
+			*output++ = max(-32768, min(32767, (int)(f)));
+		}
+}
+#define interleave_multi interleave_multi
+#endif
+
 static void dsp_util_deinterleave_s16le(int16_t *input, float *const *output,
 					int channels, int frames)
 {
@@ -401,6 +609,13 @@ static void dsp_util_deinterleave_s16le(int16_t *input, float *const *output,
 	}
 #endif
 
+#ifdef deinterleave_multi
+	if (channels == 4 || channels == 6 || channels == 8) {
+		deinterleave_multi(input, output, channels, frames);
+		return;
+	}
+#endif
+
 	for (i = 0; i < channels; i++)
 		output_ptr[i] = output[i];
 
@@ -494,6 +709,13 @@ static void dsp_util_interleave_s16le(float *const *input, int16_t *output,
 	}
 #endif
 
+#ifdef interleave_multi
+	if (channels == 4 || channels == 6 || channels == 8) {
+		interleave_multi(input, output, channels, frames);
+		return;
+	}
+#endif
+
 	for (i = 0; i < channels; i++)
 		input_ptr[i] = input[i];
 
@@ -586,6 +808,131 @@ int dsp_util_interleave(float *const *input, uint8_t *output, int channels,
 	return 0;
 }
 
+int dsp_util_deinterleave_q28(uint8_t *input, int32_t *const *output,
+			      int channels, snd_pcm_format_t format,
+			      int frames)
+{
+	int16_t *s16 = (int16_t *)input;
+	int32_t *s32 = (int32_t *)input;
+	int32_t sample;
+	int i, j;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				output[j][i] = (int32_t)s16[i * channels + j]
+					       << (16 - DSP_Q28_HEADROOM_BITS);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		/* Shift up first to sign extend the 24 bits. */
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				output[j][i] = (s32[i * channels + j] << 8) >>
+					       DSP_Q28_HEADROOM_BITS;
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, input += 3) {
+				sample = 0;
+				memcpy((uint8_t *)&sample + 1, input, 3);
+				output[j][i] = sample >> DSP_Q28_HEADROOM_BITS;
+			}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				output[j][i] = s32[i * channels + j] >>
+					       DSP_Q28_HEADROOM_BITS;
+		break;
+	default:
+		syslog(LOG_ERR, "Invalid format to deinterleave");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Rounds a Q28 sample to a sample bits wide, saturated to its range. */
+static inline int32_t round_q28(int32_t x, int bits)
+{
+	int shift = 32 - DSP_Q28_HEADROOM_BITS - bits;
+	int64_t r = x;
+
+	if (shift > 0)
+		r = (r + (1 << (shift - 1))) >> shift;
+	else
+		r *= 1 << -shift;
+	r = min(r, (1LL << (bits - 1)) - 1);
+	return max(r, -(1LL << (bits - 1)));
+}
+
+int dsp_util_interleave_q28(int32_t *const *input, uint8_t *output,
+			    int channels, snd_pcm_format_t format, int frames)
+{
+	int16_t *s16 = (int16_t *)output;
+	int32_t *s32 = (int32_t *)output;
+	int32_t sample;
+	int i, j;
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				s16[i * channels + j] =
+					round_q28(input[j][i], 16);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				s32[i * channels + j] =
+					round_q28(input[j][i], 24) &
+					0x00ffffff;
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		for (i = 0; i < frames; i++)
+			for (j = 0; j < channels; j++, output += 3) {
+				sample = round_q28(input[j][i], 24);
+				memcpy(output, &sample, 3);
+			}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		for (j = 0; j < channels; j++)
+			for (i = 0; i < frames; i++)
+				s32[i * channels + j] =
+					round_q28(input[j][i], 32);
+		break;
+	default:
+		syslog(LOG_ERR, "Invalid format to interleave");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+void dsp_util_float_to_q28(const float *input, int32_t *output, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		float f = input[i] * 268435456.0f;
+		f += (f >= 0) ? 0.5f : -0.5f;
+		/* (float)INT_MAX rounds up to 2^31, which doesn't fit. */
+		if (f >= 2147483648.0f)
+			output[i] = INT_MAX;
+		else if (f <= -2147483648.0f)
+			output[i] = INT_MIN;
+		else
+			output[i] = (int32_t)f;
+	}
+}
+
+void dsp_util_q28_to_float(const int32_t *input, float *output, int samples)
+{
+	int i;
+
+	for (i = 0; i < samples; i++)
+		output[i] = input[i] / 268435456.0f;
+}
+
 void dsp_enable_flush_denormal_to_zero()
 {
 #if defined(__i386__) || defined(__x86_64__)
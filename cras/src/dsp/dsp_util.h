@@ -43,6 +43,50 @@ int dsp_util_deinterleave(uint8_t *input, float *const *output, int channels,
 int dsp_util_interleave(float *const *input, uint8_t *output, int channels,
 			snd_pcm_format_t format, int frames);
 
+/* The fixed point samples of the dsp pipeline are Q28: 32 bit integers
+ * whose range [-2^28, 2^28) stands for [-1.0, 1.0). The three bits above
+ * full scale leave 18dB of headroom, so boosting modules don't saturate
+ * where float wouldn't. Samples only saturate when they are interleaved
+ * back to the output format. */
+#define DSP_Q28_HEADROOM_BITS 3
+
+/* Converts from interleaved samples to non-interleaved Q28 fixed point
+ * samples. The samples are only shifted, so this is exact except for the
+ * three lowest bits of S32 samples.
+ * Args:
+ *    input - The interleaved input buffer. Every "channels" samples is a frame.
+ *    output - Pointers to output buffers. There are "channels" output buffers.
+ *    channels - The number of samples per frame.
+ *    format - The sample format of the input buffer.
+ *    frames - The number of frames to convert.
+ * Returns:
+ *    Negative error if format isn't supported, otherwise 0.
+ */
+int dsp_util_deinterleave_q28(uint8_t *input, int32_t *const *output,
+			      int channels, snd_pcm_format_t format,
+			      int frames);
+
+/* Converts from non-interleaved Q28 samples to interleaved samples,
+ * rounded to the nearest one and saturated to the range of the format.
+ * This is the inverse of dsp_util_deinterleave_q28().
+ * Args:
+ *    input - Pointers to input buffers. There are "channels" input buffers.
+ *    output - The interleaved output buffer. Every "channels" samples is a
+ *        frame.
+ *    channels - The number of samples per frame.
+ *    format - The sample format of the output buffer.
+ *    frames - The number of frames to convert.
+ * Returns:
+ *    Negative error if format isn't supported, otherwise 0.
+ */
+int dsp_util_interleave_q28(int32_t *const *input, uint8_t *output,
+			    int channels, snd_pcm_format_t format, int frames);
+
+/* Converts samples between float and Q28. Floats beyond the headroom of
+ * Q28 saturate. */
+void dsp_util_float_to_q28(const float *input, int32_t *output, int samples);
+void dsp_util_q28_to_float(const int32_t *input, float *output, int samples);
+
 /* Disables denormal numbers in floating point calculation. Denormal numbers
  * happens often in IIR filters, and it can be very slow.
  */
@@ -4,22 +4,43 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "eq2.h"
 
+/* Number of channels processed in the lanes of one vector. */
+#define EQ2_LANES 4
+
+/* Number of frames of EQ2_LANES channels gathered at once. */
+#define EQ2_LANE_FRAMES 128
+
+typedef float float4 __attribute__((vector_size(16)));
+
 struct eq2 {
-	int n[2];
-	struct biquad biquad[MAX_BIQUADS_PER_EQ2][2];
+	int num_channels;
+	int n[EQ2_MAX_CHANNELS];
+	struct biquad biquad[MAX_BIQUADS_PER_EQ2][EQ2_MAX_CHANNELS];
 };
 
 struct eq2 *eq2_new()
 {
-	struct eq2 *eq2 = (struct eq2 *)calloc(1, sizeof(*eq2));
+	return eq2_new_channels(2);
+}
+
+struct eq2 *eq2_new_channels(int num_channels)
+{
+	struct eq2 *eq2;
 	int i, j;
 
-	/* Initialize all biquads to identity filter, so if two channels have
+	if (num_channels < 1 || num_channels > EQ2_MAX_CHANNELS)
+		return NULL;
+
+	eq2 = (struct eq2 *)calloc(1, sizeof(*eq2));
+	eq2->num_channels = num_channels;
+
+	/* Initialize all biquads to identity filter, so if the channels have
 	 * different numbers of biquads, it still works. */
 	for (i = 0; i < MAX_BIQUADS_PER_EQ2; i++)
-		for (j = 0; j < 2; j++)
+		for (j = 0; j < EQ2_MAX_CHANNELS; j++)
 			biquad_set(&eq2->biquad[i][j], BQ_NONE, 0, 0, 0);
 
 	return eq2;
@@ -33,7 +54,8 @@ void eq2_free(struct eq2 *eq2)
 int eq2_append_biquad(struct eq2 *eq2, int channel, enum biquad_type type,
 		      float freq, float Q, float gain)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	if (channel < 0 || channel >= eq2->num_channels ||
+	    eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
 		return -1;
 	biquad_set(&eq2->biquad[eq2->n[channel]++][channel], type, freq, Q,
 		   gain);
@@ -43,14 +65,15 @@ int eq2_append_biquad(struct eq2 *eq2, int channel, enum biquad_type type,
 int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
 			     const struct biquad *biquad)
 {
-	if (eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+	if (channel < 0 || channel >= eq2->num_channels ||
+	    eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
 		return -1;
 	eq2->biquad[eq2->n[channel]++][channel] = *biquad;
 	return 0;
 }
 
-static inline void eq2_process_one(struct biquad (*bq)[2], float *data0,
-				   float *data1, int count)
+static inline void eq2_process_one(struct biquad (*bq)[EQ2_MAX_CHANNELS],
+				   float *data0, float *data1, int count)
 {
 	struct biquad *qL = &bq[0][0];
 	struct biquad *qR = &bq[0][1];
@@ -110,8 +133,9 @@ static inline void eq2_process_one(struct biquad (*bq)[2], float *data0,
 
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
-static inline void eq2_process_two_neon(struct biquad (*bq)[2], float *data0,
-					float *data1, int count)
+static inline void
+eq2_process_two_neon(struct biquad (*bq)[EQ2_MAX_CHANNELS], float *data0,
+		     float *data1, int count)
 {
 	struct biquad *qL = &bq[0][0];
 	struct biquad *rL = &bq[1][0];
@@ -204,8 +228,9 @@ static inline void eq2_process_two_neon(struct biquad (*bq)[2], float *data0,
 
 #if defined(__SSE3__) && defined(__x86_64__)
 #include <emmintrin.h>
-static inline void eq2_process_two_sse3(struct biquad (*bq)[2], float *data0,
-					float *data1, int count)
+static inline void
+eq2_process_two_sse3(struct biquad (*bq)[EQ2_MAX_CHANNELS], float *data0,
+		     float *data1, int count)
 {
 	struct biquad *qL = &bq[0][0];
 	struct biquad *rL = &bq[1][0];
@@ -314,30 +339,128 @@ static inline void eq2_process_two_sse3(struct biquad (*bq)[2], float *data0,
 }
 #endif
 
-void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
+/* Runs the biquads of channels ch and ch + 1 on data0 and data1. */
+static void eq2_process_pair(struct eq2 *eq2, int ch, float *data0,
+			     float *data1, int count)
 {
+	struct biquad (*bq)[EQ2_MAX_CHANNELS];
 	int i;
 	int n;
-	if (!count)
-		return;
-	n = eq2->n[0];
-	if (eq2->n[1] > n)
-		n = eq2->n[1];
+
+	n = eq2->n[ch];
+	if (eq2->n[ch + 1] > n)
+		n = eq2->n[ch + 1];
 	for (i = 0; i < n; i += 2) {
+		/* Rows of biquads starting at channel ch. */
+		bq = (struct biquad (*)[EQ2_MAX_CHANNELS])&eq2->biquad[i][ch];
 		if (i + 1 == n) {
-			eq2_process_one(&eq2->biquad[i], data0, data1, count);
+			eq2_process_one(bq, data0, data1, count);
 		} else {
 #if defined(__ARM_NEON__)
-			eq2_process_two_neon(&eq2->biquad[i], data0, data1,
-					     count);
+			eq2_process_two_neon(bq, data0, data1, count);
 #elif defined(__SSE3__) && defined(__x86_64__)
-			eq2_process_two_sse3(&eq2->biquad[i], data0, data1,
-					     count);
+			eq2_process_two_sse3(bq, data0, data1, count);
 #else
-			eq2_process_one(&eq2->biquad[i], data0, data1, count);
-			eq2_process_one(&eq2->biquad[i + 1], data0, data1,
-					count);
+			eq2_process_one(bq, data0, data1, count);
+			eq2_process_one(bq + 1, data0, data1, count);
 #endif
 		}
 	}
 }
+
+/* Runs the biquads of channels ch to ch + lanes - 1 with one channel in each
+ * lane of a vector, which the compiler maps to SSE or NEON registers. Up to
+ * EQ2_LANE_FRAMES frames are gathered into a buffer and go through all the
+ * biquads before they are written back. Unused lanes carry silence.
+ */
+static void eq2_process_lanes(struct eq2 *eq2, int ch, int lanes,
+			      float *const *data, int count)
+{
+	float4 buf[EQ2_LANE_FRAMES];
+	int start, frames, i, j, l, n;
+
+	n = 0;
+	for (l = 0; l < lanes; l++)
+		if (eq2->n[ch + l] > n)
+			n = eq2->n[ch + l];
+
+	for (start = 0; start < count; start += frames) {
+		frames = count - start;
+		if (frames > EQ2_LANE_FRAMES)
+			frames = EQ2_LANE_FRAMES;
+
+		memset(buf, 0, sizeof(buf[0]) * frames);
+		for (l = 0; l < lanes; l++)
+			for (j = 0; j < frames; j++)
+				buf[j][l] = data[ch + l][start + j];
+
+		for (i = 0; i < n; i++) {
+			float4 b0 = { 0 }, b1 = { 0 }, b2 = { 0 };
+			float4 a1 = { 0 }, a2 = { 0 };
+			float4 x1 = { 0 }, x2 = { 0 }, y1 = { 0 }, y2 = { 0 };
+
+			for (l = 0; l < lanes; l++) {
+				struct biquad *q = &eq2->biquad[i][ch + l];
+				b0[l] = q->b0;
+				b1[l] = q->b1;
+				b2[l] = q->b2;
+				a1[l] = q->a1;
+				a2[l] = q->a2;
+				x1[l] = q->x1;
+				x2[l] = q->x2;
+				y1[l] = q->y1;
+				y2[l] = q->y2;
+			}
+
+			for (j = 0; j < frames; j++) {
+				float4 x = buf[j];
+				float4 y = b0 * x + b1 * x1 + b2 * x2 -
+					   a1 * y1 - a2 * y2;
+				x2 = x1;
+				x1 = x;
+				y2 = y1;
+				y1 = y;
+				buf[j] = y;
+			}
+
+			for (l = 0; l < lanes; l++) {
+				struct biquad *q = &eq2->biquad[i][ch + l];
+				q->x1 = x1[l];
+				q->x2 = x2[l];
+				q->y1 = y1[l];
+				q->y2 = y2[l];
+			}
+		}
+
+		for (l = 0; l < lanes; l++)
+			for (j = 0; j < frames; j++)
+				data[ch + l][start + j] = buf[j][l];
+	}
+}
+
+void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count)
+{
+	if (!count)
+		return;
+	eq2_process_pair(eq2, 0, data0, data1, count);
+}
+
+void eq2_process_channels(struct eq2 *eq2, float *const *data, int count)
+{
+	int ch, lanes;
+
+	if (!count)
+		return;
+
+	for (ch = 0; ch < eq2->num_channels; ch += lanes) {
+		lanes = eq2->num_channels - ch;
+		if (lanes > EQ2_LANES)
+			lanes = EQ2_LANES;
+		/* A pair of channels has its own optimized loops. */
+		if (lanes == 2)
+			eq2_process_pair(eq2, ch, data[ch], data[ch + 1],
+					 count);
+		else
+			eq2_process_lanes(eq2, ch, lanes, data, count);
+	}
+}
@@ -10,19 +10,26 @@
 extern "C" {
 #endif
 
-/* "eq2" is a two channel version of the "eq" filter. It processes two channels
- * of data at once to increase performance. */
+/* "eq2" is a multi-channel version of the "eq" filter. It processes two
+ * channels, or up to four channels, of data at once to increase performance. */
 
 #include "biquad.h"
 
 /* Maximum number of biquad filters an EQ2 can have per channel */
 #define MAX_BIQUADS_PER_EQ2 10
 
+/* Maximum number of channels an EQ2 can have */
+#define EQ2_MAX_CHANNELS 8
+
 struct eq2;
 
-/* Create an EQ2. */
+/* Create a two channel EQ2. */
 struct eq2 *eq2_new();
 
+/* Create an EQ2 for num_channels channels, at most EQ2_MAX_CHANNELS.
+ * Returns NULL if num_channels is out of range. */
+struct eq2 *eq2_new_channels(int num_channels);
+
 /* Free an EQ2. */
 void eq2_free(struct eq2 *eq2);
 
@@ -30,7 +37,7 @@ void eq2_free(struct eq2 *eq2);
  * biquad filters per channel.
  * Args:
  *    eq2 - The EQ2 we want to use.
- *    channel - 0 or 1. The channel we want to append the filter to.
+ *    channel - The channel we want to append the filter to.
  *    type - The type of the biquad filter we want to append.
  *    frequency - The value should be in the range [0, 1]. It is relative to
  *        half of the sampling rate.
@@ -47,7 +54,7 @@ int eq2_append_biquad(struct eq2 *eq2, int channel, enum biquad_type type,
  * biquad coefficients directly.
  * Args:
  *    eq2 - The EQ2 we want to use.
- *    channel - 0 or 1. The channel we want to append the filter to.
+ *    channel - The channel we want to append the filter to.
  *    biquad - The parameters for the biquad filter.
  * Returns:
  *    0 if success. -1 if the eq has no room for more biquads.
@@ -64,6 +71,14 @@ int eq2_append_biquad_direct(struct eq2 *eq2, int channel,
  */
 void eq2_process(struct eq2 *eq2, float *data0, float *data1, int count);
 
+/* Process a buffer of audio data through an EQ2 of any channel count.
+ * Args:
+ *    eq2 - The EQ2 we want to use.
+ *    data - One array of audio samples per channel of the EQ2.
+ *    count - The number of elements in each of the data array to process.
+ */
+void eq2_process_channels(struct eq2 *eq2, float *const *data, int count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,89 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include "eq2_q31.h"
+
+struct eq2_q31 {
+	int num_channels;
+	int n[EQ2_MAX_CHANNELS];
+	struct biquad_q31 biquad[EQ2_MAX_CHANNELS][MAX_BIQUADS_PER_EQ2];
+};
+
+struct eq2_q31 *eq2_q31_new(int num_channels)
+{
+	struct eq2_q31 *eq2;
+
+	if (num_channels < 1 || num_channels > EQ2_MAX_CHANNELS)
+		return NULL;
+
+	eq2 = (struct eq2_q31 *)calloc(1, sizeof(*eq2));
+	if (eq2)
+		eq2->num_channels = num_channels;
+	return eq2;
+}
+
+void eq2_q31_free(struct eq2_q31 *eq2)
+{
+	free(eq2);
+}
+
+int eq2_q31_append_biquad(struct eq2_q31 *eq2, int channel,
+			  enum biquad_type type, float freq, float Q,
+			  float gain)
+{
+	struct biquad bq;
+
+	if (channel < 0 || channel >= eq2->num_channels ||
+	    eq2->n[channel] >= MAX_BIQUADS_PER_EQ2)
+		return -1;
+	biquad_set(&bq, type, freq, Q, gain);
+	biquad_set_q31(&eq2->biquad[channel][eq2->n[channel]++], &bq);
+	return 0;
+}
+
+int eq2_q31_set_biquad(struct eq2_q31 *eq2, int channel, int index,
+		       enum biquad_type type, float freq, float Q, float gain)
+{
+	struct biquad bq;
+	struct biquad_q31 *q;
+	int32_t x1, x2, y1, y2;
+
+	if (channel < 0 || channel >= eq2->num_channels || index < 0 ||
+	    index >= eq2->n[channel])
+		return -1;
+
+	/* Keep the history, so the audio goes on from where it is. */
+	q = &eq2->biquad[channel][index];
+	x1 = q->x1;
+	x2 = q->x2;
+	y1 = q->y1;
+	y2 = q->y2;
+	biquad_set(&bq, type, freq, Q, gain);
+	biquad_set_q31(q, &bq);
+	q->x1 = x1;
+	q->x2 = x2;
+	q->y1 = y1;
+	q->y2 = y2;
+	return 0;
+}
+
+void eq2_q31_process(struct eq2_q31 *eq2, int32_t *const *data, int count)
+{
+	int channel, i, j;
+
+	/* Unlike the float EQ2, the biquads of a channel run one after
+	 * another on the whole buffer: with integer arithmetic there is no
+	 * vector lane to fill, and the history stays in registers. */
+	for (channel = 0; channel < eq2->num_channels; channel++) {
+		int32_t *buf = data[channel];
+		for (i = 0; i < eq2->n[channel]; i++) {
+			struct biquad_q31 bq = eq2->biquad[channel][i];
+			for (j = 0; j < count; j++)
+				buf[j] = biquad_run_q31(&bq, buf[j]);
+			eq2->biquad[channel][i] = bq;
+		}
+	}
+}
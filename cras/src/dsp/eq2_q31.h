@@ -0,0 +1,63 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef EQ2_Q31_H_
+#define EQ2_Q31_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The "eq2" filter for 32 bit fixed point samples, Q28 in the dsp
+ * pipeline. It has the same biquads as an EQ2, but filters with 32 bit
+ * integer arithmetic and 64 bit accumulators, which is faster than float on
+ * cores with a weak FPU. With 29 bit coefficients and 64 bit sums it is
+ * also closer to the exact output than the float EQ2.
+ */
+
+#include <stdint.h>
+#include "eq2.h"
+
+struct eq2_q31;
+
+/* Creates a Q31 EQ2 for num_channels channels, at most EQ2_MAX_CHANNELS.
+ * Returns NULL if num_channels is out of range or there is no memory. */
+struct eq2_q31 *eq2_q31_new(int num_channels);
+
+/* Frees a Q31 EQ2. */
+void eq2_q31_free(struct eq2_q31 *eq2);
+
+/* Appends a biquad filter to a channel of a Q31 EQ2. See
+ * eq2_append_biquad() for the parameters.
+ * Returns:
+ *    0 if success. -1 if the channel has no room for more biquads.
+ */
+int eq2_q31_append_biquad(struct eq2_q31 *eq2, int channel,
+			  enum biquad_type type, float freq, float Q,
+			  float gain);
+
+/* Replaces a biquad filter already appended to a channel, at once.
+ * Args:
+ *    index - The position of the biquad in the channel, from 0.
+ *    The other arguments are the same as for eq2_q31_append_biquad().
+ * Returns:
+ *    0 if success. -1 if there is no such biquad.
+ */
+int eq2_q31_set_biquad(struct eq2_q31 *eq2, int channel, int index,
+		       enum biquad_type type, float freq, float Q, float gain);
+
+/* Processes a buffer of Q31 audio data through the EQ2.
+ * Args:
+ *    eq2 - The EQ2 we want to use.
+ *    data - One array of Q31 audio samples per channel of the EQ2.
+ *    count - The number of elements in each of the data array to process.
+ */
+void eq2_q31_process(struct eq2_q31 *eq2, int32_t *const *data, int count);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* EQ2_Q31_H_ */
@@ -0,0 +1,331 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "fft.h"
+
+/* The real FFT of size n is computed with a complex FFT of size m = n / 2:
+ * the even samples go to the real part, the odd ones to the imaginary part,
+ * and the two interleaved spectra are separated afterwards. The complex
+ * FFT is an iterative radix-2 one on split real/imaginary arrays. Running
+ * it with the two arrays swapped gives the inverse transform.
+ */
+struct fft {
+	int n;
+	int m;
+	/* Bit reversed indices of the m complex samples. */
+	int *rev;
+	/* The twiddle factors of each stage of the complex FFT. The stage
+	 * combining transforms of size h starts at index h - 1. */
+	float *tw_re;
+	float *tw_im;
+	/* exp(-2 pi i k / n) for k in [0, m), used to separate the even and
+	 * odd spectra. */
+	float *rtw_re;
+	float *rtw_im;
+	/* The complex samples being transformed. */
+	float *work_re;
+	float *work_im;
+};
+
+struct fft *fft_new(int n)
+{
+	struct fft *fft;
+	int m = n / 2;
+	int bits = 0;
+	int h, k, i;
+
+	if (n < 8 || (n & (n - 1)))
+		return NULL;
+
+	fft = (struct fft *)calloc(1, sizeof(*fft));
+	if (!fft)
+		return NULL;
+	fft->n = n;
+	fft->m = m;
+	fft->rev = (int *)calloc(m, sizeof(int));
+	fft->tw_re = (float *)calloc(m, sizeof(float));
+	fft->tw_im = (float *)calloc(m, sizeof(float));
+	fft->rtw_re = (float *)calloc(m, sizeof(float));
+	fft->rtw_im = (float *)calloc(m, sizeof(float));
+	fft->work_re = (float *)calloc(m, sizeof(float));
+	fft->work_im = (float *)calloc(m, sizeof(float));
+	if (!fft->rev || !fft->tw_re || !fft->tw_im || !fft->rtw_re ||
+	    !fft->rtw_im || !fft->work_re || !fft->work_im) {
+		fft_free(fft);
+		return NULL;
+	}
+
+	while ((1 << bits) < m)
+		bits++;
+	for (k = 0; k < m; k++) {
+		int r = 0;
+		for (i = 0; i < bits; i++)
+			if (k & (1 << i))
+				r |= 1 << (bits - 1 - i);
+		fft->rev[k] = r;
+	}
+
+	for (h = 1; h < m; h *= 2) {
+		for (k = 0; k < h; k++) {
+			double a = -M_PI * k / h;
+			fft->tw_re[h - 1 + k] = cos(a);
+			fft->tw_im[h - 1 + k] = sin(a);
+		}
+	}
+
+	for (k = 0; k < m; k++) {
+		double a = -2 * M_PI * k / n;
+		fft->rtw_re[k] = cos(a);
+		fft->rtw_im[k] = sin(a);
+	}
+
+	return fft;
+}
+
+void fft_free(struct fft *fft)
+{
+	free(fft->rev);
+	free(fft->tw_re);
+	free(fft->tw_im);
+	free(fft->rtw_re);
+	free(fft->rtw_im);
+	free(fft->work_re);
+	free(fft->work_im);
+	free(fft);
+}
+
+int fft_size(struct fft *fft)
+{
+	return fft->n;
+}
+
+/* Combines the transforms in (ar, ai) and (br, bi) of count samples each,
+ * with the twiddle factors in (wr, wi). */
+static void butterflies(float *ar, float *ai, float *br, float *bi,
+			const float *wr, const float *wi, int count)
+{
+	int k;
+
+	for (k = 0; k < count; k++) {
+		float tr = br[k] * wr[k] - bi[k] * wi[k];
+		float ti = br[k] * wi[k] + bi[k] * wr[k];
+		br[k] = ar[k] - tr;
+		bi[k] = ai[k] - ti;
+		ar[k] += tr;
+		ai[k] += ti;
+	}
+}
+
+static void multiply_add(int count, const float *a_re, const float *a_im,
+			 const float *b_re, const float *b_im, float *acc_re,
+			 float *acc_im)
+{
+	int k;
+
+	for (k = 0; k < count; k++) {
+		acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+		acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+	}
+}
+
+/* The same as butterflies() and multiply_add(), four samples at a time.
+ * The count must be a multiple of four. */
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+
+static void butterflies4(float *ar, float *ai, float *br, float *bi,
+			 const float *wr, const float *wi, int count)
+{
+	int k;
+
+	for (k = 0; k < count; k += 4) {
+		float32x4_t vbr = vld1q_f32(br + k);
+		float32x4_t vbi = vld1q_f32(bi + k);
+		float32x4_t vwr = vld1q_f32(wr + k);
+		float32x4_t vwi = vld1q_f32(wi + k);
+		float32x4_t var = vld1q_f32(ar + k);
+		float32x4_t vai = vld1q_f32(ai + k);
+		float32x4_t tr = vmlsq_f32(vmulq_f32(vbr, vwr), vbi, vwi);
+		float32x4_t ti = vmlaq_f32(vmulq_f32(vbr, vwi), vbi, vwr);
+		vst1q_f32(br + k, vsubq_f32(var, tr));
+		vst1q_f32(bi + k, vsubq_f32(vai, ti));
+		vst1q_f32(ar + k, vaddq_f32(var, tr));
+		vst1q_f32(ai + k, vaddq_f32(vai, ti));
+	}
+}
+
+static void multiply_add4(int count, const float *a_re, const float *a_im,
+			  const float *b_re, const float *b_im, float *acc_re,
+			  float *acc_im)
+{
+	int k;
+
+	for (k = 0; k < count; k += 4) {
+		float32x4_t ar = vld1q_f32(a_re + k);
+		float32x4_t ai = vld1q_f32(a_im + k);
+		float32x4_t br = vld1q_f32(b_re + k);
+		float32x4_t bi = vld1q_f32(b_im + k);
+		float32x4_t cr = vld1q_f32(acc_re + k);
+		float32x4_t ci = vld1q_f32(acc_im + k);
+		cr = vmlsq_f32(vmlaq_f32(cr, ar, br), ai, bi);
+		ci = vmlaq_f32(vmlaq_f32(ci, ar, bi), ai, br);
+		vst1q_f32(acc_re + k, cr);
+		vst1q_f32(acc_im + k, ci);
+	}
+}
+#define HAVE_SIMD4
+
+#elif defined(__SSE3__)
+#include <emmintrin.h>
+
+static void butterflies4(float *ar, float *ai, float *br, float *bi,
+			 const float *wr, const float *wi, int count)
+{
+	int k;
+
+	for (k = 0; k < count; k += 4) {
+		__m128 vbr = _mm_loadu_ps(br + k);
+		__m128 vbi = _mm_loadu_ps(bi + k);
+		__m128 vwr = _mm_loadu_ps(wr + k);
+		__m128 vwi = _mm_loadu_ps(wi + k);
+		__m128 var = _mm_loadu_ps(ar + k);
+		__m128 vai = _mm_loadu_ps(ai + k);
+		__m128 tr = _mm_sub_ps(_mm_mul_ps(vbr, vwr),
+				       _mm_mul_ps(vbi, vwi));
+		__m128 ti = _mm_add_ps(_mm_mul_ps(vbr, vwi),
+				       _mm_mul_ps(vbi, vwr));
+		_mm_storeu_ps(br + k, _mm_sub_ps(var, tr));
+		_mm_storeu_ps(bi + k, _mm_sub_ps(vai, ti));
+		_mm_storeu_ps(ar + k, _mm_add_ps(var, tr));
+		_mm_storeu_ps(ai + k, _mm_add_ps(vai, ti));
+	}
+}
+
+static void multiply_add4(int count, const float *a_re, const float *a_im,
+			  const float *b_re, const float *b_im, float *acc_re,
+			  float *acc_im)
+{
+	int k;
+
+	for (k = 0; k < count; k += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + k);
+		__m128 ai = _mm_loadu_ps(a_im + k);
+		__m128 br = _mm_loadu_ps(b_re + k);
+		__m128 bi = _mm_loadu_ps(b_im + k);
+		__m128 cr = _mm_loadu_ps(acc_re + k);
+		__m128 ci = _mm_loadu_ps(acc_im + k);
+		cr = _mm_add_ps(cr, _mm_sub_ps(_mm_mul_ps(ar, br),
+					       _mm_mul_ps(ai, bi)));
+		ci = _mm_add_ps(ci, _mm_add_ps(_mm_mul_ps(ar, bi),
+					       _mm_mul_ps(ai, br)));
+		_mm_storeu_ps(acc_re + k, cr);
+		_mm_storeu_ps(acc_im + k, ci);
+	}
+}
+#define HAVE_SIMD4
+#endif
+
+/* Transforms the m complex samples in (xr, xi), already in bit reversed
+ * order. Swapping xr and xi gives the inverse transform. */
+static void complex_fft(struct fft *fft, float *xr, float *xi)
+{
+	int m = fft->m;
+	int h, s;
+
+	for (h = 1; h < m; h *= 2) {
+		const float *wr = fft->tw_re + h - 1;
+		const float *wi = fft->tw_im + h - 1;
+
+		for (s = 0; s < m; s += 2 * h) {
+#ifdef HAVE_SIMD4
+			if (h >= 4) {
+				butterflies4(xr + s, xi + s, xr + s + h,
+					     xi + s + h, wr, wi, h);
+				continue;
+			}
+#endif
+			butterflies(xr + s, xi + s, xr + s + h, xi + s + h, wr,
+				    wi, h);
+		}
+	}
+}
+
+void fft_forward(struct fft *fft, const float *input, float *re, float *im)
+{
+	float *zr = fft->work_re;
+	float *zi = fft->work_im;
+	int m = fft->m;
+	int k;
+
+	for (k = 0; k < m; k++) {
+		zr[fft->rev[k]] = input[2 * k];
+		zi[fft->rev[k]] = input[2 * k + 1];
+	}
+	complex_fft(fft, zr, zi);
+
+	/* Z = E + iO, where E and O are the spectra of the even and odd
+	 * samples. X[k] = E[k] + exp(-2 pi i k / n) O[k]. */
+	re[0] = zr[0] + zi[0];
+	im[0] = 0;
+	re[m] = zr[0] - zi[0];
+	im[m] = 0;
+	for (k = 1; k < m; k++) {
+		int j = m - k;
+		float e_re = 0.5f * (zr[k] + zr[j]);
+		float e_im = 0.5f * (zi[k] - zi[j]);
+		float o_re = 0.5f * (zi[k] + zi[j]);
+		float o_im = 0.5f * (zr[j] - zr[k]);
+		float cr = fft->rtw_re[k];
+		float ci = fft->rtw_im[k];
+		re[k] = e_re + cr * o_re - ci * o_im;
+		im[k] = e_im + cr * o_im + ci * o_re;
+	}
+}
+
+void fft_inverse(struct fft *fft, const float *re, const float *im,
+		 float *output)
+{
+	float *zr = fft->work_re;
+	float *zi = fft->work_im;
+	int m = fft->m;
+	int k;
+
+	/* The reverse of fft_forward(), with E and O twice their value. */
+	for (k = 0; k < m; k++) {
+		int j = m - k;
+		float e_re = re[k] + re[j];
+		float e_im = im[k] - im[j];
+		float dr = re[k] - re[j];
+		float di = im[k] + im[j];
+		float cr = fft->rtw_re[k];
+		float ci = fft->rtw_im[k];
+		float o_re = dr * cr + di * ci;
+		float o_im = di * cr - dr * ci;
+		zr[fft->rev[k]] = e_re - o_im;
+		zi[fft->rev[k]] = e_im + o_re;
+	}
+	complex_fft(fft, zi, zr);
+
+	for (k = 0; k < m; k++) {
+		output[2 * k] = zr[k];
+		output[2 * k + 1] = zi[k];
+	}
+}
+
+void fft_multiply_add(int count, const float *a_re, const float *a_im,
+		      const float *b_re, const float *b_im, float *acc_re,
+		      float *acc_im)
+{
+	int k = 0;
+
+#ifdef HAVE_SIMD4
+	k = count & ~3;
+	multiply_add4(k, a_re, a_im, b_re, b_im, acc_re, acc_im);
+#endif
+	multiply_add(count - k, a_re + k, a_im + k, b_re + k, b_im + k,
+		     acc_re + k, acc_im + k);
+}
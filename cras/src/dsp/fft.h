@@ -0,0 +1,63 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef FFT_H_
+#define FFT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A real-valued FFT of a power of two size. The spectrum of an n point
+ * signal is kept as n / 2 + 1 bins, from DC to the Nyquist frequency, with
+ * the real and imaginary parts in separate arrays so they can be processed
+ * four bins at a time.
+ */
+
+struct fft;
+
+/* Creates an FFT of size n, which must be a power of two no less than 8.
+ * Returns NULL if n is not supported or there is no memory. */
+struct fft *fft_new(int n);
+
+/* Frees an FFT. */
+void fft_free(struct fft *fft);
+
+/* Returns the size the FFT was created with. */
+int fft_size(struct fft *fft);
+
+/* Computes the spectrum of a signal.
+ * Args:
+ *    fft - The FFT to use.
+ *    input - The n samples of the signal.
+ *    re, im - Filled with the n / 2 + 1 bins of the spectrum.
+ */
+void fft_forward(struct fft *fft, const float *input, float *re, float *im);
+
+/* Computes the signal of a spectrum, the inverse of fft_forward(). The
+ * result is not normalized, it is n times the original signal.
+ * Args:
+ *    fft - The FFT to use.
+ *    re, im - The n / 2 + 1 bins of the spectrum.
+ *    output - Filled with the n samples of the signal.
+ */
+void fft_inverse(struct fft *fft, const float *re, const float *im,
+		 float *output);
+
+/* Multiplies two spectra bin by bin and adds the product to a third one.
+ * Args:
+ *    count - The number of bins.
+ *    a_re, a_im, b_re, b_im - The spectra to multiply.
+ *    acc_re, acc_im - The spectrum the product is added to.
+ */
+void fft_multiply_add(int count, const float *a_re, const float *a_im,
+		      const float *b_re, const float *b_im, float *acc_re,
+		      float *acc_im);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* FFT_H_ */
@@ -0,0 +1,170 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+#include "fir.h"
+
+struct fir {
+	int block_size;
+	int num_partitions;
+	/* The number of bins in the spectrum of a block, block_size + 1. */
+	int num_bins;
+	struct fft *fft;
+	/* The spectra of the partitions of the impulse response, scaled to
+	 * undo the gain of fft_inverse(). */
+	float *ir_re;
+	float *ir_im;
+	/* The spectra of the last num_partitions input blocks, a ring
+	 * starting at fdl_pos with the newest one. */
+	float *fdl_re;
+	float *fdl_im;
+	int fdl_pos;
+	/* The sum of the products of the two sets of spectra. */
+	float *acc_re;
+	float *acc_im;
+	/* The previous input block followed by the current one. */
+	float *input;
+	/* The result of the inverse FFT. The second half is the output of
+	 * the previous block. */
+	float *output;
+	/* The number of frames in the current input block. */
+	int pos;
+};
+
+struct fir *fir_new(const float *taps, int num_taps, int block_size)
+{
+	struct fir *fir;
+	int n = 2 * block_size;
+	float scale = 1.0f / n;
+	float *block;
+	int p, i, count;
+
+	if (num_taps < 1 || block_size < FIR_MIN_BLOCK_SIZE ||
+	    block_size > FIR_MAX_BLOCK_SIZE || (block_size & (block_size - 1)))
+		return NULL;
+
+	fir = (struct fir *)calloc(1, sizeof(*fir));
+	if (!fir)
+		return NULL;
+	fir->block_size = block_size;
+	fir->num_partitions = (num_taps + block_size - 1) / block_size;
+	fir->num_bins = block_size + 1;
+	fir->fft = fft_new(n);
+
+	count = fir->num_partitions * fir->num_bins;
+	fir->ir_re = (float *)calloc(count, sizeof(float));
+	fir->ir_im = (float *)calloc(count, sizeof(float));
+	fir->fdl_re = (float *)calloc(count, sizeof(float));
+	fir->fdl_im = (float *)calloc(count, sizeof(float));
+	fir->acc_re = (float *)calloc(fir->num_bins, sizeof(float));
+	fir->acc_im = (float *)calloc(fir->num_bins, sizeof(float));
+	fir->input = (float *)calloc(n, sizeof(float));
+	fir->output = (float *)calloc(n, sizeof(float));
+	if (!fir->fft || !fir->ir_re || !fir->ir_im || !fir->fdl_re ||
+	    !fir->fdl_im || !fir->acc_re || !fir->acc_im || !fir->input ||
+	    !fir->output) {
+		fir_free(fir);
+		return NULL;
+	}
+
+	/* Each partition is zero padded to the FFT size. The output buffer
+	 * is free to use until the first block is processed. */
+	block = fir->output;
+	for (p = 0; p < fir->num_partitions; p++) {
+		count = num_taps - p * block_size;
+		if (count > block_size)
+			count = block_size;
+		memset(block, 0, n * sizeof(float));
+		for (i = 0; i < count; i++)
+			block[i] = taps[p * block_size + i] * scale;
+		fft_forward(fir->fft, block, fir->ir_re + p * fir->num_bins,
+			    fir->ir_im + p * fir->num_bins);
+	}
+	memset(block, 0, n * sizeof(float));
+
+	return fir;
+}
+
+void fir_free(struct fir *fir)
+{
+	if (fir->fft)
+		fft_free(fir->fft);
+	free(fir->ir_re);
+	free(fir->ir_im);
+	free(fir->fdl_re);
+	free(fir->fdl_im);
+	free(fir->acc_re);
+	free(fir->acc_im);
+	free(fir->input);
+	free(fir->output);
+	free(fir);
+}
+
+int fir_get_delay(struct fir *fir)
+{
+	return fir->block_size;
+}
+
+/* Convolves the input block that has just been filled. */
+static void process_block(struct fir *fir)
+{
+	int b = fir->block_size;
+	int bins = fir->num_bins;
+	int p, k;
+
+	fft_forward(fir->fft, fir->input, fir->fdl_re + fir->fdl_pos * bins,
+		    fir->fdl_im + fir->fdl_pos * bins);
+
+	/* Partition p of the response applies to the input p blocks ago. */
+	memset(fir->acc_re, 0, bins * sizeof(float));
+	memset(fir->acc_im, 0, bins * sizeof(float));
+	k = fir->fdl_pos;
+	for (p = 0; p < fir->num_partitions; p++) {
+		fft_multiply_add(bins, fir->fdl_re + k * bins,
+				 fir->fdl_im + k * bins, fir->ir_re + p * bins,
+				 fir->ir_im + p * bins, fir->acc_re,
+				 fir->acc_im);
+		if (--k < 0)
+			k = fir->num_partitions - 1;
+	}
+
+	/* The first half of the result wraps around, the second half is the
+	 * linear convolution of the current block. */
+	fft_inverse(fir->fft, fir->acc_re, fir->acc_im, fir->output);
+
+	memcpy(fir->input, fir->input + b, b * sizeof(float));
+	if (++fir->fdl_pos == fir->num_partitions)
+		fir->fdl_pos = 0;
+}
+
+void fir_process(struct fir *fir, float *data, int count)
+{
+	int b = fir->block_size;
+	float *input = fir->input + b;
+	float *output = fir->output + b;
+	int n, i;
+
+	while (count > 0) {
+		n = b - fir->pos;
+		if (n > count)
+			n = count;
+
+		/* Output the previous block while filling the current one. */
+		for (i = 0; i < n; i++) {
+			input[fir->pos + i] = data[i];
+			data[i] = output[fir->pos + i];
+		}
+
+		fir->pos += n;
+		if (fir->pos == b) {
+			process_block(fir);
+			fir->pos = 0;
+		}
+		data += n;
+		count -= n;
+	}
+}
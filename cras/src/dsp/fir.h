@@ -0,0 +1,58 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef FIR_H_
+#define FIR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A FIR filter for long impulse responses, like room or speaker correction.
+ *
+ * The impulse response is split into partitions of block_size taps, and
+ * each partition is convolved in the frequency domain with an FFT of
+ * 2 * block_size points (uniformly partitioned overlap-save). The filter
+ * delays its output by block_size frames, a smaller block size gives less
+ * delay but costs more CPU for the same response.
+ */
+
+/* The supported range of the block size. */
+#define FIR_MIN_BLOCK_SIZE 32
+#define FIR_MAX_BLOCK_SIZE 8192
+
+struct fir;
+
+/* Creates a FIR filter.
+ * Args:
+ *    taps - The impulse response.
+ *    num_taps - The length of the impulse response.
+ *    block_size - The partition size in frames, a power of two in
+ *        [FIR_MIN_BLOCK_SIZE, FIR_MAX_BLOCK_SIZE].
+ * Returns:
+ *    The filter, or NULL if an argument is out of range or there is no
+ *    memory.
+ */
+struct fir *fir_new(const float *taps, int num_taps, int block_size);
+
+/* Frees a FIR filter. */
+void fir_free(struct fir *fir);
+
+/* Returns the delay of the filter output in frames. */
+int fir_get_delay(struct fir *fir);
+
+/* Filters a buffer of audio samples in place.
+ * Args:
+ *    fir - The filter we want to use.
+ *    data - The array of audio samples.
+ *    count - The number of elements in the data array to process.
+ */
+void fir_process(struct fir *fir, float *data, int count);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* FIR_H_ */
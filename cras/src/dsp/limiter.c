@@ -0,0 +1,322 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "limiter.h"
+
+/* The signal is oversampled with a 47 tap windowed sinc split into four
+ * phases of 12 taps. The last phase falls on the input samples, delayed by
+ * OS_DELAY frames, and the other three in between. */
+#define OS_PHASES 4
+#define OS_TAPS 12
+#define OS_DELAY 5
+
+/* The number of frames processed at a time. */
+#define LIMITER_BLOCK 128
+
+/*
+ * The gain computed from each (oversampled) peak is the one that brings it
+ * down to the ceiling. The minimum of those over window + 2 frames is then
+ * smoothed by a moving average over window frames. This makes the gain
+ * ramp down over the window frames before a peak, and reach the needed
+ * value for the frames around the peak, once the audio is delayed by
+ * window + OS_DELAY frames. The gain goes back up with the release time.
+ */
+struct limiter {
+	int num_channels;
+	float sample_rate;
+	int window;
+	int min_window;
+	int delay;
+
+	float ceiling; /* linear */
+	float release_coef;
+	float gain;
+
+	float coef[OS_PHASES][OS_TAPS];
+
+	/* The last OS_TAPS - 1 input samples of each channel followed by
+	 * the current block. */
+	float input[LIMITER_MAX_CHANNELS][OS_TAPS - 1 + LIMITER_BLOCK];
+	float peak[LIMITER_BLOCK];
+
+	/* The sliding minimum, a queue of increasing gains with the frame
+	 * they were computed for. */
+	int64_t frame;
+	float *min_gain;
+	int64_t *min_frame;
+	int min_head;
+	int min_size;
+
+	/* The moving average. */
+	float *avg;
+	double avg_sum;
+	int avg_pos;
+
+	/* The delay line of each channel. */
+	float *delay_buf;
+	int delay_pos;
+};
+
+static void init_coefs(struct limiter *limiter)
+{
+	const int n = OS_PHASES * OS_TAPS - 1;
+	const int center = n / 2;
+	int p, k;
+
+	for (p = 0; p < OS_PHASES; p++) {
+		float sum = 0;
+		for (k = 0; k < OS_TAPS; k++) {
+			int i = k * OS_PHASES + p;
+			double x = (double)(i - center) / OS_PHASES;
+			double h = 0;
+			if (i < n) {
+				h = x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+				h *= 0.5 - 0.5 * cos(2 * M_PI * (i + 1) / (n + 1));
+			}
+			limiter->coef[p][k] = h;
+			sum += h;
+		}
+		/* Unity gain at DC for every phase. */
+		for (k = 0; k < OS_TAPS; k++)
+			limiter->coef[p][k] /= sum;
+	}
+}
+
+struct limiter *limiter_new(int num_channels, float sample_rate, float attack)
+{
+	struct limiter *limiter;
+	int i;
+
+	if (num_channels < 1 || num_channels > LIMITER_MAX_CHANNELS ||
+	    sample_rate <= 0 || attack < 0)
+		return NULL;
+
+	limiter = (struct limiter *)calloc(1, sizeof(*limiter));
+	if (!limiter)
+		return NULL;
+	limiter->num_channels = num_channels;
+	limiter->sample_rate = sample_rate;
+	limiter->window = (int)(attack * sample_rate + 0.5f);
+	if (limiter->window < 1)
+		limiter->window = 1;
+	limiter->min_window = limiter->window + 2;
+	limiter->delay = limiter->window + OS_DELAY;
+	limiter->gain = 1;
+
+	limiter->min_gain = (float *)calloc(limiter->min_window, sizeof(float));
+	limiter->min_frame =
+		(int64_t *)calloc(limiter->min_window, sizeof(int64_t));
+	limiter->avg = (float *)calloc(limiter->window, sizeof(float));
+	limiter->delay_buf =
+		(float *)calloc(num_channels * limiter->delay, sizeof(float));
+	if (!limiter->min_gain || !limiter->min_frame || !limiter->avg ||
+	    !limiter->delay_buf) {
+		limiter_free(limiter);
+		return NULL;
+	}
+
+	for (i = 0; i < limiter->window; i++)
+		limiter->avg[i] = 1;
+	limiter->avg_sum = limiter->window;
+
+	init_coefs(limiter);
+	limiter_set_params(limiter, -1, 0.05);
+	return limiter;
+}
+
+void limiter_free(struct limiter *limiter)
+{
+	free(limiter->min_gain);
+	free(limiter->min_frame);
+	free(limiter->avg);
+	free(limiter->delay_buf);
+	free(limiter);
+}
+
+void limiter_set_params(struct limiter *limiter, float ceiling, float release)
+{
+	limiter->ceiling = powf(10, ceiling / 20);
+	if (release > 0)
+		limiter->release_coef =
+			expf(-1 / (release * limiter->sample_rate));
+	else
+		limiter->release_coef = 0;
+}
+
+int limiter_get_delay(struct limiter *limiter)
+{
+	return limiter->delay;
+}
+
+/* Raises peak[i] to the absolute value of the oversampled signal around
+ * x[i - OS_DELAY]. x must have OS_TAPS - 1 samples of history before it. */
+static void detect_peaks(const float coef[OS_PHASES][OS_TAPS], const float *x,
+			 float *peak, int count)
+{
+	int i, p, k;
+
+	for (i = 0; i < count; i++) {
+		float m = peak[i];
+		for (p = 0; p < OS_PHASES; p++) {
+			float acc = 0;
+			for (k = 0; k < OS_TAPS; k++)
+				acc += coef[p][k] * x[i - k];
+			m = fmaxf(m, fabsf(acc));
+		}
+		peak[i] = m;
+	}
+}
+
+/* The same as detect_peaks(), four frames at a time. The count must be a
+ * multiple of four. */
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+
+static void detect_peaks4(const float coef[OS_PHASES][OS_TAPS], const float *x,
+			  float *peak, int count)
+{
+	int i, p, k;
+
+	for (i = 0; i < count; i += 4) {
+		float32x4_t m = vld1q_f32(peak + i);
+		for (p = 0; p < OS_PHASES; p++) {
+			float32x4_t acc = vdupq_n_f32(0);
+			for (k = 0; k < OS_TAPS; k++)
+				acc = vmlaq_n_f32(acc, vld1q_f32(x + i - k),
+						  coef[p][k]);
+			m = vmaxq_f32(m, vabsq_f32(acc));
+		}
+		vst1q_f32(peak + i, m);
+	}
+}
+#define HAVE_DETECT_PEAKS4
+
+#elif defined(__SSE3__)
+#include <emmintrin.h>
+
+static void detect_peaks4(const float coef[OS_PHASES][OS_TAPS], const float *x,
+			  float *peak, int count)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	int i, p, k;
+
+	for (i = 0; i < count; i += 4) {
+		__m128 m = _mm_loadu_ps(peak + i);
+		for (p = 0; p < OS_PHASES; p++) {
+			__m128 acc = _mm_setzero_ps();
+			for (k = 0; k < OS_TAPS; k++)
+				acc = _mm_add_ps(
+					acc,
+					_mm_mul_ps(_mm_loadu_ps(x + i - k),
+						   _mm_set1_ps(coef[p][k])));
+			m = _mm_max_ps(m, _mm_and_ps(acc, abs_mask));
+		}
+		_mm_storeu_ps(peak + i, m);
+	}
+}
+#define HAVE_DETECT_PEAKS4
+#endif
+
+/* Returns the minimum of the gains pushed over the last min_window
+ * frames, including gain. */
+static float sliding_min(struct limiter *limiter, float gain)
+{
+	int cap = limiter->min_window;
+	int back;
+
+	/* Drop the expired gain first, the queue then has room for the new
+	 * one even when every gain in the window is still queued. */
+	if (limiter->min_size &&
+	    limiter->min_frame[limiter->min_head] <=
+		    limiter->frame - limiter->min_window) {
+		limiter->min_head = (limiter->min_head + 1) % cap;
+		limiter->min_size--;
+	}
+
+	while (limiter->min_size) {
+		back = (limiter->min_head + limiter->min_size - 1) % cap;
+		if (limiter->min_gain[back] < gain)
+			break;
+		limiter->min_size--;
+	}
+	back = (limiter->min_head + limiter->min_size) % cap;
+	limiter->min_gain[back] = gain;
+	limiter->min_frame[back] = limiter->frame;
+	limiter->min_size++;
+
+	limiter->frame++;
+	return limiter->min_gain[limiter->min_head];
+}
+
+static void process_block(struct limiter *limiter, float **data, int count)
+{
+	const int history = OS_TAPS - 1;
+	float ceiling = limiter->ceiling;
+	float gain = limiter->gain;
+	float target, y;
+	int i = 0, c;
+
+	memset(limiter->peak, 0, count * sizeof(float));
+	for (c = 0; c < limiter->num_channels; c++) {
+		float *input = limiter->input[c];
+		memcpy(input + history, data[c], count * sizeof(float));
+#ifdef HAVE_DETECT_PEAKS4
+		i = count & ~3;
+		detect_peaks4(limiter->coef, input + history, limiter->peak, i);
+#endif
+		detect_peaks(limiter->coef, input + history + i,
+			     limiter->peak + i, count - i);
+		memmove(input, input + count, history * sizeof(float));
+	}
+
+	for (i = 0; i < count; i++) {
+		float peak = limiter->peak[i];
+
+		target = sliding_min(limiter,
+				     peak > ceiling ? ceiling / peak : 1.0f);
+
+		limiter->avg_sum += target - limiter->avg[limiter->avg_pos];
+		limiter->avg[limiter->avg_pos] = target;
+		if (++limiter->avg_pos == limiter->window)
+			limiter->avg_pos = 0;
+		target = limiter->avg_sum / limiter->window;
+
+		if (target < gain)
+			gain = target;
+		else
+			gain = target + (gain - target) * limiter->release_coef;
+
+		for (c = 0; c < limiter->num_channels; c++) {
+			float *line = limiter->delay_buf + c * limiter->delay;
+			y = line[limiter->delay_pos] * gain;
+			line[limiter->delay_pos] = data[c][i];
+			/* Only rounding errors get here. */
+			data[c][i] = fminf(fmaxf(y, -ceiling), ceiling);
+		}
+		if (++limiter->delay_pos == limiter->delay)
+			limiter->delay_pos = 0;
+	}
+
+	limiter->gain = gain;
+}
+
+void limiter_process(struct limiter *limiter, float **data, int count)
+{
+	float *block[LIMITER_MAX_CHANNELS];
+	int start, n, c;
+
+	for (start = 0; start < count; start += n) {
+		n = count - start;
+		if (n > LIMITER_BLOCK)
+			n = LIMITER_BLOCK;
+		for (c = 0; c < limiter->num_channels; c++)
+			block[c] = data[c] + start;
+		process_block(limiter, block, n);
+	}
+}
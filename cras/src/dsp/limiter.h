@@ -0,0 +1,63 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef LIMITER_H_
+#define LIMITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A lookahead brickwall limiter. The peaks are detected on the signal
+ * oversampled four times, so peaks between samples (which show up after
+ * the D/A conversion) are caught too. The audio is delayed so the gain is
+ * already down when a peak comes out, and the gain is the same for all
+ * channels.
+ */
+
+/* Maximum number of channels a limiter can have */
+#define LIMITER_MAX_CHANNELS 8
+
+struct limiter;
+
+/* Creates a limiter.
+ * Args:
+ *    num_channels - The number of channels, at most LIMITER_MAX_CHANNELS.
+ *    sample_rate - The sample rate, in Hz.
+ *    attack - The lookahead in seconds, how long the gain takes to go down
+ *        before a peak. The delay of the limiter grows with it.
+ * Returns:
+ *    The limiter, or NULL if an argument is out of range or there is no
+ *    memory.
+ */
+struct limiter *limiter_new(int num_channels, float sample_rate, float attack);
+
+/* Frees a limiter. */
+void limiter_free(struct limiter *limiter);
+
+/* Sets the parameters that can change while the limiter runs.
+ * Args:
+ *    ceiling - The highest output level, in dBFS.
+ *    release - The time in seconds the gain takes to recover by 63%
+ *        after a peak.
+ */
+void limiter_set_params(struct limiter *limiter, float ceiling, float release);
+
+/* Returns the delay of the limiter output in frames. */
+int limiter_get_delay(struct limiter *limiter);
+
+/* Processes a buffer of audio samples in place.
+ * Args:
+ *    limiter - The limiter we want to use.
+ *    data - The pointers to the samples of each channel.
+ *    count - The number of frames to process.
+ */
+void limiter_process(struct limiter *limiter, float **data, int count);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LIMITER_H_ */
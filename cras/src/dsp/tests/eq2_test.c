@@ -3,10 +3,13 @@
  * found in the LICENSE file.
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "cascade.h"
 #include "dsp_test_util.h"
 #include "dsp_util.h"
 #include "eq2.h"
@@ -36,7 +39,36 @@ static void process(struct eq2 *eq2, float *data0, float *data1, int count)
 			    min(2048, count - start));
 }
 
-/* Runs the filters on an input file */
+/* Processes a buffer of data chunk by chunk using a cascade */
+static void process_cascade(struct cascade *cascade, float *data0,
+			    float *data1, int count)
+{
+	float *data[2];
+	int start;
+	for (start = 0; start < count; start += 2048) {
+		data[0] = data0 + start;
+		data[1] = data1 + start;
+		cascade_process(cascade, data, min(2048, count - start));
+	}
+}
+
+static const struct {
+	int channel;
+	enum biquad_type type;
+	double freq;
+	double Q;
+	double gain;
+} biquads[] = {
+	{ 0, BQ_PEAKING, 380, 3, -10 },	    { 0, BQ_PEAKING, 720, 3, -12 },
+	{ 0, BQ_PEAKING, 1705, 3, -8 },	    { 0, BQ_HIGHPASS, 218, 0.7, -10.2 },
+	{ 0, BQ_PEAKING, 580, 6, -8 },	    { 0, BQ_HIGHSHELF, 8000, 3, 2 },
+	{ 1, BQ_PEAKING, 450, 3, -12 },	    { 1, BQ_PEAKING, 721, 3, -12 },
+	{ 1, BQ_PEAKING, 1800, 8, -10.2 },  { 1, BQ_PEAKING, 580, 6, -8 },
+	{ 1, BQ_HIGHPASS, 250, 0.6578, 0 }, { 1, BQ_HIGHSHELF, 8000, 0, 2 },
+};
+
+/* Runs the filters on an input file, with eq2 and with a cascade of the
+ * same biquads to compare the two. */
 static void test_file(const char *input_filename, const char *output_filename)
 {
 	size_t frames;
@@ -44,6 +76,8 @@ static void test_file(const char *input_filename, const char *output_filename)
 	double NQ = 44100 / 2; /* nyquist frequency */
 	struct timespec tp1, tp2;
 	struct eq2 *eq2;
+	struct cascade *cascade;
+	float *copy, diff = 0;
 
 	float *data = read_raw(input_filename, &frames);
 
@@ -51,20 +85,21 @@ static void test_file(const char *input_filename, const char *output_filename)
 	for (i = frames / 10; i < frames; i++)
 		data[i] = 0.0;
 
+	copy = (float *)malloc(frames * 2 * sizeof(float));
+	memcpy(copy, data, frames * 2 * sizeof(float));
+
 	/* eq chain */
 	eq2 = eq2_new();
-	eq2_append_biquad(eq2, 0, BQ_PEAKING, 380 / NQ, 3, -10);
-	eq2_append_biquad(eq2, 0, BQ_PEAKING, 720 / NQ, 3, -12);
-	eq2_append_biquad(eq2, 0, BQ_PEAKING, 1705 / NQ, 3, -8);
-	eq2_append_biquad(eq2, 0, BQ_HIGHPASS, 218 / NQ, 0.7, -10.2);
-	eq2_append_biquad(eq2, 0, BQ_PEAKING, 580 / NQ, 6, -8);
-	eq2_append_biquad(eq2, 0, BQ_HIGHSHELF, 8000 / NQ, 3, 2);
-	eq2_append_biquad(eq2, 1, BQ_PEAKING, 450 / NQ, 3, -12);
-	eq2_append_biquad(eq2, 1, BQ_PEAKING, 721 / NQ, 3, -12);
-	eq2_append_biquad(eq2, 1, BQ_PEAKING, 1800 / NQ, 8, -10.2);
-	eq2_append_biquad(eq2, 1, BQ_PEAKING, 580 / NQ, 6, -8);
-	eq2_append_biquad(eq2, 1, BQ_HIGHPASS, 250 / NQ, 0.6578, 0);
-	eq2_append_biquad(eq2, 1, BQ_HIGHSHELF, 8000 / NQ, 0, 2);
+	cascade = cascade_new(2);
+	for (i = 0; i < sizeof(biquads) / sizeof(biquads[0]); i++) {
+		eq2_append_biquad(eq2, biquads[i].channel, biquads[i].type,
+				  biquads[i].freq / NQ, biquads[i].Q,
+				  biquads[i].gain);
+		cascade_append_biquad(cascade, biquads[i].channel,
+				      biquads[i].type, biquads[i].freq / NQ,
+				      biquads[i].Q, biquads[i].gain);
+	}
+
 	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
 	process(eq2, data, data + frames, frames);
 	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
@@ -72,6 +107,18 @@ static void test_file(const char *input_filename, const char *output_filename)
 	       tp_diff(&tp2, &tp1), frames * 2);
 	eq2_free(eq2);
 
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	process_cascade(cascade, copy, copy + frames, frames);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	printf("cascade takes %g seconds for %zu samples\n",
+	       tp_diff(&tp2, &tp1), frames * 2);
+	cascade_free(cascade);
+
+	for (i = 0; i < frames * 2; i++)
+		diff = fmaxf(diff, fabsf(copy[i] - data[i]));
+	printf("max difference %g\n", diff);
+	free(copy);
+
 	write_raw(output_filename, data, frames);
 	free(data);
 }
@@ -0,0 +1,87 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "dsp_util.h"
+#include "fir.h"
+
+#define RATE 48000
+#define CHUNK 256
+#define MIN_SECONDS 0.5
+
+static const int num_taps[] = { 1024, 4096, 16384 };
+static const int block_sizes[] = { 64, 128, 256, 512, 1024 };
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* Returns the CPU time in nanoseconds the filter takes per frame of one
+ * channel. */
+static double bench(struct fir *fir, float *data)
+{
+	struct timespec tp1, tp2;
+	double elapsed;
+	long frames = 0;
+	int i;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	do {
+		for (i = 0; i < 100; i++)
+			fir_process(fir, data, CHUNK);
+		frames += 100 * CHUNK;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+		elapsed = tp_diff(&tp2, &tp1);
+	} while (elapsed < MIN_SECONDS);
+
+	return elapsed * 1e9 / frames;
+}
+
+/* Measures the CPU cost of one channel of the filter at 48kHz, for a range
+ * of response lengths and block sizes. */
+int main(int argc, char **argv)
+{
+	float *taps, data[CHUNK];
+	struct fir *fir;
+	unsigned int t, b;
+	double ns;
+	int i;
+
+	dsp_enable_flush_denormal_to_zero();
+
+	for (i = 0; i < CHUNK; i++)
+		data[i] = (float)(rand() % 2000 - 1000) / 1000;
+
+	printf("%8s %8s %8s %10s %8s\n", "taps", "block", "delay", "ns/frame",
+	       "cpu%");
+	for (t = 0; t < sizeof(num_taps) / sizeof(num_taps[0]); t++) {
+		taps = (float *)malloc(num_taps[t] * sizeof(float));
+		for (i = 0; i < num_taps[t]; i++)
+			taps[i] = (float)(rand() % 2000 - 1000) / 1000 /
+				  num_taps[t];
+
+		for (b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]);
+		     b++) {
+			fir = fir_new(taps, num_taps[t], block_sizes[b]);
+			if (!fir) {
+				fprintf(stderr, "Failed to create the filter\n");
+				return 1;
+			}
+			ns = bench(fir, data);
+			printf("%8d %8d %8d %10.2f %8.3f\n", num_taps[t],
+			       block_sizes[b], fir_get_delay(fir), ns,
+			       ns * RATE * 1e-7);
+			fir_free(fir);
+		}
+		free(taps);
+	}
+
+	return 0;
+}
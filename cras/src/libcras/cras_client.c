@@ -2651,6 +2651,21 @@ cras_client_get_audio_debug_info(const struct cras_client *client)
 	return debug_info;
 }
 
+const struct audio_thread_latency_stats *
+cras_client_get_audio_thread_latency(const struct cras_client *client)
+{
+	const struct audio_thread_latency_stats *latency;
+	int lock_rc;
+
+	lock_rc = server_state_rdlock(client);
+	if (lock_rc)
+		return 0;
+
+	latency = &client->server_state->audio_thread_latency;
+	server_state_unlock(client, lock_rc);
+	return latency;
+}
+
 const struct cras_bt_debug_info *
 cras_client_get_bt_debug_info(const struct cras_client *client)
 {
@@ -898,6 +898,20 @@ long cras_client_get_system_max_capture_gain(const struct cras_client *client);
 const struct audio_debug_info *
 cras_client_get_audio_debug_info(const struct cras_client *client);
 
+/* Gets the audio thread latency histograms.
+ *
+ * Requires that the connection to the server has been established.
+ * Access to the resulting pointer is not thread-safe.
+ *
+ * Args:
+ *    client - The client from cras_client_create.
+ * Returns:
+ *    A pointer to the histograms. They are only updated along with the
+ *    audio debug info, by calling cras_client_update_audio_debug_info.
+ */
+const struct audio_thread_latency_stats *
+cras_client_get_audio_thread_latency(const struct cras_client *client);
+
 /* Gets bluetooth debug info.
  *
  * Requires that the connection to the server has been established.
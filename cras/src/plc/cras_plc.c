@@ -11,6 +11,12 @@
 
 #include "cras_plc.h"
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #define MSBC_SAMPLE_SIZE 2 /* 2 bytes*/
 #define MSBC_PKT_LEN 57 /* Packet length without the header */
 #define MSBC_FS 120 /* Frame Size */
@@ -21,6 +27,7 @@
 #define PLC_HL (PLC_WL + MSBC_FS - 1) /* Length of History buffer required */
 #define PLC_SBCRL 36 /* SBC Reconvergence sample Length */
 #define PLC_OLAL 16 /* OverLap-Add Length */
+#define PLC_DOT_LANES 4 /* Partial sums kept by dot_product() */
 
 /* The pre-computed zero input bit stream of mSBC codec, per HFP 1.7 spec.
  * This mSBC frame will be decoded into all-zero input PCM. */
@@ -132,29 +139,70 @@ int cras_msbc_plc_handle_good_frames(struct cras_msbc_plc *state,
 	return MSBC_CODE_SIZE;
 }
 
-float cross_correlation(int16_t *x, int16_t *y)
+/* Computes the dot product of two templates. Sample i goes to partial sum
+ * i % PLC_DOT_LANES, and the partial sums are added in the same order in every
+ * variant so that all builds find the same best match. */
+#if defined(__ARM_NEON)
+static float dot_product(const float *x, const float *y)
 {
-	float sum = 0, x2 = 0, y2 = 0;
+	float32x4_t sum = vdupq_n_f32(0);
 
-	for (int i = 0; i < PLC_TL; i++) {
-		sum += ((float)x[i]) * y[i];
-		x2 += ((float)x[i]) * x[i];
-		y2 += ((float)y[i]) * y[i];
-	}
-	return sum / sqrt(x2 * y2);
+	for (int i = 0; i < PLC_TL; i += PLC_DOT_LANES)
+		sum = vaddq_f32(sum,
+				vmulq_f32(vld1q_f32(x + i), vld1q_f32(y + i)));
+	return (vgetq_lane_f32(sum, 0) + vgetq_lane_f32(sum, 1)) +
+	       (vgetq_lane_f32(sum, 2) + vgetq_lane_f32(sum, 3));
+}
+#elif defined(__SSE__)
+static float dot_product(const float *x, const float *y)
+{
+	__m128 sum = _mm_setzero_ps();
+	float s[PLC_DOT_LANES];
+
+	for (int i = 0; i < PLC_TL; i += PLC_DOT_LANES)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(x + i),
+						 _mm_loadu_ps(y + i)));
+	_mm_storeu_ps(s, sum);
+	return (s[0] + s[1]) + (s[2] + s[3]);
 }
+#else
+static float dot_product(const float *x, const float *y)
+{
+	float s[PLC_DOT_LANES] = { 0 };
+
+	for (int i = 0; i < PLC_TL; i += PLC_DOT_LANES)
+		for (int j = 0; j < PLC_DOT_LANES; j++)
+			s[j] += x[i + j] * y[i + j];
+	return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
 
+/* Finds the offset in the history whose following PLC_TL samples correlate
+ * best with the last PLC_TL samples of the history. The template's energy is
+ * computed once and the energy of each candidate is slid along with it in
+ * exact integer sums, so only the dot product is computed per offset. */
 int pattern_match(int16_t *hist)
 {
+	float histf[PLC_HL];
+	const float *x = &histf[PLC_HL - PLC_TL];
+	int64_t x2 = 0, y2 = 0;
 	int best = 0;
 	float cn, max_cn = FLT_MIN;
 
+	for (int i = 0; i < PLC_HL; i++)
+		histf[i] = hist[i];
+	for (int i = 0; i < PLC_TL; i++) {
+		x2 += hist[PLC_HL - PLC_TL + i] * hist[PLC_HL - PLC_TL + i];
+		y2 += hist[i] * hist[i];
+	}
+
 	for (int i = 0; i < PLC_WL; i++) {
-		cn = cross_correlation(&hist[PLC_HL - PLC_TL], &hist[i]);
+		cn = dot_product(x, &histf[i]) / sqrtf((float)x2 * y2);
 		if (cn > max_cn) {
 			best = i;
 			max_cn = cn;
 		}
+		y2 += hist[i + PLC_TL] * hist[i + PLC_TL] - hist[i] * hist[i];
 	}
 	return best;
 }
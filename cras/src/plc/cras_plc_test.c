@@ -4,6 +4,7 @@
  */
 
 #include <errno.h>
+#include <float.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -12,6 +13,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cras_sbc_codec.h"
@@ -21,6 +23,21 @@
 #define MSBC_PKT_FRAME_LEN 57
 #define RND_SEED 7
 
+/* Must match the lengths in cras_plc.c. */
+#define PLC_WL 256
+#define PLC_TL 64
+#define PLC_HL (PLC_WL + MSBC_CODE_SIZE / 2 - 1)
+
+#define BENCH_RATE 16000
+#define BENCH_SECONDS 60
+#define BENCH_HISTORIES 2000
+/* Largest relative drop of the correlation at the chosen offset, compared to
+ * the best one the reference search finds. */
+#define BENCH_TOLERANCE 1e-4
+
+/* Defined in cras_plc.c. */
+int pattern_match(int16_t *hist);
+
 static const uint8_t msbc_zero_frame[] = {
 	0xad, 0x00, 0x00, 0xc5, 0x00, 0x00, 0x00, 0x00, 0x77, 0x6d, 0xb6, 0xdd,
 	0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77, 0x6d, 0xb6,
@@ -117,10 +134,201 @@ void plc_experiment(char *input_filename, float pl_percent, bool with_plc)
 	}
 }
 
+/* The scalar search pattern_match() used to do, kept as the reference. */
+static float reference_cross_correlation(int16_t *x, int16_t *y)
+{
+	float sum = 0, x2 = 0, y2 = 0;
+
+	for (int i = 0; i < PLC_TL; i++) {
+		sum += ((float)x[i]) * y[i];
+		x2 += ((float)x[i]) * x[i];
+		y2 += ((float)y[i]) * y[i];
+	}
+	return sum / sqrt(x2 * y2);
+}
+
+static int reference_pattern_match(int16_t *hist)
+{
+	int best = 0;
+	float cn, max_cn = FLT_MIN;
+
+	for (int i = 0; i < PLC_WL; i++) {
+		cn = reference_cross_correlation(&hist[PLC_HL - PLC_TL],
+						 &hist[i]);
+		if (cn > max_cn) {
+			best = i;
+			max_cn = cn;
+		}
+	}
+	return best;
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Fills samples with a voice-like signal: a few harmonics of a slowly
+ * gliding pitch, plus noise. */
+static void synthesize(int16_t *samples, unsigned int count)
+{
+	double phase = 0, pitch, s;
+
+	srand(RND_SEED);
+	for (unsigned int i = 0; i < count; i++) {
+		pitch = 150 + 60 * sin(2 * M_PI * i / BENCH_RATE);
+		phase += 2 * M_PI * pitch / BENCH_RATE;
+		s = 6000 * sin(phase) + 3000 * sin(2 * phase) +
+		    1500 * sin(3 * phase) + (rand() % 2001 - 1000);
+		samples[i] = (int16_t)s;
+	}
+}
+
+/* Marks lost packets in bursts of burst_len, starting with probability p at
+ * each packet that is received. */
+static bool *generate_burst_seq(unsigned pk_count, float p, unsigned burst_len)
+{
+	bool *seq = (bool *)calloc(pk_count, sizeof(*seq));
+
+	srand(RND_SEED);
+	for (unsigned i = 0; i < pk_count; i++) {
+		if ((float)rand() / RAND_MAX >= p)
+			continue;
+		for (unsigned j = 0; j < burst_len && i < pk_count; j++)
+			seq[i++] = true;
+	}
+	return seq;
+}
+
+/* Checks pattern_match() finds an offset that correlates as well as the one
+ * the reference search finds, and compares their speed.
+ * Returns:
+ *    The number of histories the match is off by more than the tolerance.
+ */
+static int bench_pattern_match(int16_t *samples, unsigned int count)
+{
+	int16_t *hist;
+	int best, ref_best, failed = 0, differed = 0;
+	uint64_t start, ns, ref_ns = 0, new_ns = 0;
+	float cn, ref_cn;
+
+	for (unsigned int n = 0; n < BENCH_HISTORIES; n++) {
+		hist = &samples[(rand() % (count - PLC_HL))];
+
+		start = now_ns();
+		ref_best = reference_pattern_match(hist);
+		ns = now_ns();
+		ref_ns += ns - start;
+		best = pattern_match(hist);
+		new_ns += now_ns() - ns;
+
+		if (best == ref_best)
+			continue;
+		differed++;
+		ref_cn = reference_cross_correlation(&hist[PLC_HL - PLC_TL],
+						     &hist[ref_best]);
+		cn = reference_cross_correlation(&hist[PLC_HL - PLC_TL],
+						 &hist[best]);
+		if (ref_cn - cn > BENCH_TOLERANCE * fabs(ref_cn)) {
+			fprintf(stderr, "Offset %d correlates %f, expected %d"
+					" with %f\n",
+				best, cn, ref_best, ref_cn);
+			failed++;
+		}
+	}
+
+	printf("pattern_match: %d of %d offsets differ, %d beyond tolerance\n",
+	       differed, BENCH_HISTORIES, failed);
+	printf("%-12s %10.0f ns per search\n", "reference",
+	       (double)ref_ns / BENCH_HISTORIES);
+	printf("%-12s %10.0f ns per search\n", "current",
+	       (double)new_ns / BENCH_HISTORIES);
+	return failed;
+}
+
+/* Runs the PLC over the samples, losing packets as marked in pl_seq, and
+ * reports the time spent on the lost ones. */
+static void bench_loss_pattern(const char *name, int16_t *samples,
+			       unsigned pk_count, bool *pl_seq)
+{
+	struct cras_audio_codec *msbc_input = cras_msbc_codec_create();
+	struct cras_audio_codec *msbc_output = cras_msbc_codec_create();
+	struct cras_msbc_plc *plc = cras_msbc_plc_create();
+	uint8_t buffer[MSBC_CODE_SIZE], packet_buffer[MSBC_PKT_FRAME_LEN];
+	size_t encoded, decoded;
+	unsigned lost = 0;
+	uint64_t start, ns, total_ns = 0, max_ns = 0;
+
+	for (unsigned i = 0; i < pk_count; i++) {
+		msbc_input->encode(msbc_input,
+				   (uint8_t *)&samples[i * MSBC_CODE_SIZE / 2],
+				   MSBC_CODE_SIZE, packet_buffer,
+				   MSBC_PKT_FRAME_LEN, &encoded);
+		if (pl_seq[i]) {
+			start = now_ns();
+			cras_msbc_plc_handle_bad_frames(plc, msbc_output,
+							buffer);
+			ns = now_ns() - start;
+			total_ns += ns;
+			if (ns > max_ns)
+				max_ns = ns;
+			lost++;
+		} else {
+			msbc_output->decode(msbc_output, packet_buffer,
+					    MSBC_PKT_FRAME_LEN, buffer,
+					    MSBC_CODE_SIZE, &decoded);
+			cras_msbc_plc_handle_good_frames(plc, buffer, buffer);
+		}
+	}
+
+	printf("%-12s %6u lost, %10.0f ns mean, %10lu ns max per lost frame\n",
+	       name, lost, lost ? (double)total_ns / lost : 0.0,
+	       (unsigned long)max_ns);
+
+	cras_msbc_plc_destroy(plc);
+	cras_sbc_codec_destroy(msbc_input);
+	cras_sbc_codec_destroy(msbc_output);
+}
+
+/* Benchmarks the PLC on a synthetic signal, so it runs without input files. */
+int plc_bench()
+{
+	unsigned int count = BENCH_RATE * BENCH_SECONDS;
+	unsigned pk_count = count / (MSBC_CODE_SIZE / 2);
+	int16_t *samples = (int16_t *)malloc(count * sizeof(*samples));
+	bool *pl_seq;
+	int failed;
+
+	synthesize(samples, count);
+	failed = bench_pattern_match(samples, count);
+
+	pl_seq = generate_pl_seq(pk_count, pk_count / 10);
+	bench_loss_pattern("random 10%", samples, pk_count, pl_seq);
+	free(pl_seq);
+
+	pl_seq = generate_burst_seq(pk_count, 0.02f, 5);
+	bench_loss_pattern("bursts of 5", samples, pk_count, pl_seq);
+	free(pl_seq);
+
+	pl_seq = generate_burst_seq(pk_count, 0.2f, 1);
+	bench_loss_pattern("single 20%", samples, pk_count, pl_seq);
+	free(pl_seq);
+
+	free(samples);
+	return failed ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
+	if (argc == 2 && strcmp(argv[1], "--bench") == 0)
+		return plc_bench();
+
 	if (argc != 3) {
 		printf("Usage: cras_plc_test input.raw pl_percentage\n"
+		       "       cras_plc_test --bench\n"
 		       "This test only supports reading/writing files with "
 		       "format:\n"
 		       "- raw pcm\n"
@@ -11,11 +11,15 @@
 #include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/param.h>
+#include <sys/timerfd.h>
 #include <syslog.h>
 
+#include "audio_thread_latency.h"
 #include "audio_thread_log.h"
 #include "cras_audio_thread_monitor.h"
+#include "cras_cmd_ring.h"
 #include "cras_config.h"
 #include "cras_device_monitor.h"
 #include "cras_fmt_conv.h"
@@ -35,6 +39,8 @@
  * # to check whether a busyloop event happens
  */
 #define MAX_CONTINUOUS_ZERO_SLEEP_COUNT 2
+/* Max number of events handled per epoll_wait call. */
+#define MAX_EPOLL_EVENTS 32
 
 /* Messages that can be sent from the main context to the audio thread. */
 enum AUDIO_THREAD_COMMAND {
@@ -108,38 +114,132 @@ struct audio_thread_event_log *atlog;
 char *atlog_name;
 int atlog_rw_shm_fd;
 int atlog_ro_shm_fd;
+static char *atlat_name;
+/* Number of threads sharing the event log and latency histograms. */
+static unsigned int num_threads;
+
+/* The audio thread running the calling code, NULL on other threads. */
+static __thread struct audio_thread *running_thread;
+/* The thread calls made outside of the audio threads act on. */
+static struct audio_thread *selected_thread;
+
+/* Types of fds registered with the epoll backend. */
+enum EPOLL_FD_TYPE {
+	EPOLL_FD_MSG,
+	EPOLL_FD_TIMER,
+	EPOLL_FD_CALLBACK,
+	EPOLL_FD_STREAM,
+};
 
-static struct iodev_callback_list *iodev_callbacks;
-static struct timespec longest_wake;
+/* Leading member of everything registered with the epoll backend, its address
+ * is what epoll hands back in epoll_event.data.ptr. */
+struct epoll_fd_tag {
+	enum EPOLL_FD_TYPE type;
+};
 
 struct iodev_callback_list {
+	struct epoll_fd_tag tag;
 	int fd;
 	int is_write;
 	int enabled;
 	thread_callback cb;
 	void *cb_data;
 	struct pollfd *pollfd;
+	uint32_t revents;
 	struct iodev_callback_list *prev, *next;
 };
 
+/* A client stream fd registered with the epoll backend.
+ *    tag - Identifies the entry in epoll events.
+ *    stream - The stream whose fd is watched.
+ *    refcount - Number of devices the stream is attached to.
+ *    muted - Non-zero when the fd has been taken out of the epoll set because
+ *        it turned readable while the stream wasn't expecting a message.
+ */
+struct stream_poll_fd {
+	struct epoll_fd_tag tag;
+	struct cras_rstream *stream;
+	unsigned int refcount;
+	int muted;
+	struct stream_poll_fd *prev, *next;
+};
+
+static struct epoll_fd_tag epoll_msg_tag = { EPOLL_FD_MSG };
+static struct epoll_fd_tag epoll_timer_tag = { EPOLL_FD_TIMER };
+
+/* Returns the thread that calls without a thread argument act on. */
+static struct audio_thread *current_thread()
+{
+	return running_thread ? running_thread : selected_thread;
+}
+
+static int epoll_add_fd(struct audio_thread *thread, int fd, uint32_t events,
+			struct epoll_fd_tag *tag)
+{
+	struct epoll_event ev;
+	int rc;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = tag;
+	rc = epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	if (rc < 0) {
+		syslog(LOG_ERR, "Failed to add fd %d to epoll: %d", fd, errno);
+		return -errno;
+	}
+	return 0;
+}
+
+static void epoll_rm_fd(struct audio_thread *thread, int fd)
+{
+	/* The event argument is ignored but must be non-NULL on old kernels. */
+	struct epoll_event ev;
+
+	epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+/* Adds or removes the callback's fd in the epoll set to match its enabled
+ * state. Disabled callbacks are removed rather than set to an empty event mask
+ * so that hang ups on them don't wake the thread. */
+static void epoll_update_callback(struct audio_thread *thread,
+				  struct iodev_callback_list *iodev_cb,
+				  int was_enabled)
+{
+	if (thread->epoll_fd < 0 || was_enabled == iodev_cb->enabled)
+		return;
+
+	if (iodev_cb->enabled)
+		epoll_add_fd(thread, iodev_cb->fd,
+			     iodev_cb->is_write ? EPOLLOUT : EPOLLIN,
+			     &iodev_cb->tag);
+	else
+		epoll_rm_fd(thread, iodev_cb->fd);
+}
+
 static void _audio_thread_add_callback(int fd, thread_callback cb, void *data,
 				       int is_write)
 {
+	struct audio_thread *thread = current_thread();
 	struct iodev_callback_list *iodev_cb;
 
+	if (!thread)
+		return;
+
 	/* Don't add iodev_cb twice */
-	DL_FOREACH (iodev_callbacks, iodev_cb)
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb)
 		if (iodev_cb->fd == fd && iodev_cb->cb_data == data)
 			return;
 
 	iodev_cb = (struct iodev_callback_list *)calloc(1, sizeof(*iodev_cb));
+	iodev_cb->tag.type = EPOLL_FD_CALLBACK;
 	iodev_cb->fd = fd;
 	iodev_cb->cb = cb;
 	iodev_cb->cb_data = data;
 	iodev_cb->enabled = 1;
 	iodev_cb->is_write = is_write;
 
-	DL_APPEND(iodev_callbacks, iodev_cb);
+	DL_APPEND(thread->iodev_callbacks, iodev_cb);
+	epoll_update_callback(thread, iodev_cb, 0);
 }
 
 void audio_thread_add_callback(int fd, thread_callback cb, void *data)
@@ -154,11 +254,17 @@ void audio_thread_add_write_callback(int fd, thread_callback cb, void *data)
 
 void audio_thread_rm_callback(int fd)
 {
+	struct audio_thread *thread = current_thread();
 	struct iodev_callback_list *iodev_cb;
 
-	DL_FOREACH (iodev_callbacks, iodev_cb) {
+	if (!thread)
+		return;
+
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb) {
 		if (iodev_cb->fd == fd) {
-			DL_DELETE(iodev_callbacks, iodev_cb);
+			DL_DELETE(thread->iodev_callbacks, iodev_cb);
+			if (thread->epoll_fd >= 0 && iodev_cb->enabled)
+				epoll_rm_fd(thread, fd);
 			free(iodev_cb);
 			return;
 		}
@@ -167,91 +273,66 @@ void audio_thread_rm_callback(int fd)
 
 void audio_thread_enable_callback(int fd, int enabled)
 {
+	struct audio_thread *thread = current_thread();
 	struct iodev_callback_list *iodev_cb;
+	int was_enabled;
+
+	if (!thread)
+		return;
 
-	DL_FOREACH (iodev_callbacks, iodev_cb) {
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb) {
 		if (iodev_cb->fd == fd) {
+			was_enabled = iodev_cb->enabled;
 			iodev_cb->enabled = !!enabled;
+			epoll_update_callback(thread, iodev_cb, was_enabled);
 			return;
 		}
 	}
 }
 
-/* Sends a response (error code) from the audio thread to the main thread.
- * Indicates that the last message sent to the audio thread has been handled
- * with an error code of rc.
- * Args:
- *    thread - thread responding to command.
- *    rc - Result code to send back to the main thread.
- * Returns:
- *    The number of bytes written to the main thread.
- */
-static int audio_thread_send_response(struct audio_thread *thread, int rc)
+void audio_thread_poll_stream(struct cras_rstream *stream)
 {
-	return write(thread->to_main_fds[1], &rc, sizeof(rc));
-}
+	struct audio_thread *thread = current_thread();
+	struct stream_poll_fd *entry;
 
-/* Reads from a file descriptor until all bytes are read.
- *
- * Args:
- *    fd - file descriptor to read
- *    buf - the buffer to be written.
- *    count - the number of bytes to read from fd
- * Returns:
- *    |count| on success, negative error code on failure.
- */
-static int read_until_finished(int fd, void *buf, size_t count)
-{
-	int nread, count_left = count;
+	if (!thread || thread->epoll_fd < 0)
+		return;
 
-	while (count_left > 0) {
-		nread = read(fd, (uint8_t *)buf + count - count_left,
-			     count_left);
-		if (nread < 0) {
-			if (errno == EINTR)
-				continue;
-			else
-				return nread;
-		} else if (nread == 0) {
-			syslog(LOG_ERR, "Pipe has been closed.");
-			return -EPIPE;
-		}
-		count_left -= nread;
+	DL_SEARCH_SCALAR(thread->stream_poll_fds, entry, stream, stream);
+	if (entry) {
+		entry->refcount++;
+		return;
 	}
-	return count;
+
+	entry = (struct stream_poll_fd *)calloc(1, sizeof(*entry));
+	entry->tag.type = EPOLL_FD_STREAM;
+	entry->stream = stream;
+	entry->refcount = 1;
+	if (epoll_add_fd(thread, stream->fd, EPOLLIN, &entry->tag)) {
+		entry->muted = 1;
+		thread->num_muted_stream_fds++;
+	}
+	DL_APPEND(thread->stream_poll_fds, entry);
 }
 
-/* Reads a command from the main thread.  Called from the playback/capture
- * thread.  This will read the next available command from the main thread and
- * put it in buf.
- * Args:
- *    thread - thread reading the command.
- *    buf - Message is stored here on return.
- *    max_len - maximum length of message to put into buf.
- * Returns:
- *    0 on success, negative error code on failure.
- */
-static int audio_thread_read_command(struct audio_thread *thread, uint8_t *buf,
-				     size_t max_len)
+void audio_thread_unpoll_stream(struct cras_rstream *stream)
 {
-	int to_read, nread, rc;
-	struct audio_thread_msg *msg = (struct audio_thread_msg *)buf;
+	struct audio_thread *thread = current_thread();
+	struct stream_poll_fd *entry;
 
-	/* Get the length of the message first */
-	nread = read_until_finished(thread->to_thread_fds[0], buf,
-				    sizeof(msg->length));
-	if (nread < 0)
-		return nread;
+	if (!thread)
+		return;
 
-	if (msg->length > max_len)
-		return -ENOMEM;
+	DL_SEARCH_SCALAR(thread->stream_poll_fds, entry, stream, stream);
+	if (!entry || --entry->refcount)
+		return;
 
-	to_read = msg->length - sizeof(msg->length);
-	rc = read_until_finished(thread->to_thread_fds[0],
-				 &buf[0] + sizeof(msg->length), to_read);
-	if (rc < 0)
-		return rc;
-	return 0;
+	if (entry->muted)
+		thread->num_muted_stream_fds--;
+	else
+		epoll_rm_fd(thread, stream->fd);
+	DL_DELETE(thread->stream_poll_fds, entry);
+	free(entry);
 }
 
 /* Builds an initial buffer to avoid an underrun. Adds min_level of latency. */
@@ -499,6 +580,8 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 	di->software_gain_scaler = (adev->dev->direction == CRAS_STREAM_INPUT) ?
 					   adev->dev->software_gain_scaler :
 					   0.0f;
+	di->capture_conversions = adev->conv_cache.num_conversions;
+	di->capture_conversions_saved = adev->conv_cache.num_saved;
 
 	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 	subtract_timespecs(&now, &adev->dev->open_ts, &time_since);
@@ -517,7 +600,8 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 }
 
 /* Put stream info for the given stream into the info struct. */
-static void append_stream_dump_info(struct audio_debug_info *info,
+static void append_stream_dump_info(struct audio_thread *thread,
+				    struct audio_debug_info *info,
 				    struct dev_stream *stream,
 				    unsigned int dev_idx, int index)
 {
@@ -551,21 +635,15 @@ static void append_stream_dump_info(struct audio_debug_info *info,
 	si->runtime_sec = time_since.tv_sec;
 	si->runtime_nsec = time_since.tv_nsec;
 
-	longest_wake.tv_sec = 0;
-	longest_wake.tv_nsec = 0;
+	thread->longest_wake.tv_sec = 0;
+	thread->longest_wake.tv_nsec = 0;
 }
 
 /* Handle a message sent to the playback thread */
-static int handle_playback_thread_message(struct audio_thread *thread)
+static int handle_playback_thread_message(struct audio_thread *thread,
+					  struct audio_thread_msg *msg)
 {
-	uint8_t buf[256];
-	struct audio_thread_msg *msg = (struct audio_thread_msg *)buf;
 	int ret = 0;
-	int err;
-
-	err = audio_thread_read_command(thread, buf, 256);
-	if (err < 0)
-		return err;
 
 	ATLOG(atlog, AUDIO_THREAD_PB_MSG, msg->id, 0, 0);
 
@@ -610,10 +688,7 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		break;
 	}
 	case AUDIO_THREAD_STOP:
-		ret = 0;
-		err = audio_thread_send_response(thread, ret);
-		if (err < 0)
-			return err;
+		cras_cmd_ring_complete(thread->cmd_ring, 0);
 		terminate_pb_thread();
 		break;
 	case AUDIO_THREAD_DUMP_THREAD_INFO: {
@@ -621,22 +696,28 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		struct open_dev *adev;
 		struct audio_thread_dump_debug_info_msg *dmsg;
 		struct audio_debug_info *info;
-		unsigned int num_streams = 0;
-		unsigned int num_devs = 0;
+		unsigned int num_streams;
+		unsigned int num_devs;
 
 		ret = 0;
 		dmsg = (struct audio_thread_dump_debug_info_msg *)msg;
 		info = dmsg->info;
 
+		/* Other threads may have filled the first entries. */
+		num_devs = MIN(info->num_devs, MAX_DEBUG_DEVS);
+		num_streams = MIN(info->num_streams, MAX_DEBUG_STREAMS);
+
 		/* Go through all open devices. */
 		DL_FOREACH (thread->open_devs[CRAS_STREAM_OUTPUT], adev) {
+			if (num_devs == MAX_DEBUG_DEVS)
+				break;
 			append_dev_dump_info(&info->devs[num_devs], adev);
 			if (++num_devs == MAX_DEBUG_DEVS)
 				break;
 			DL_FOREACH (adev->dev->streams, curr) {
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
-				append_stream_dump_info(info, curr,
+				append_stream_dump_info(thread, info, curr,
 							adev->dev->info.idx,
 							num_streams++);
 			}
@@ -648,7 +729,7 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 			DL_FOREACH (adev->dev->streams, curr) {
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
-				append_stream_dump_info(info, curr,
+				append_stream_dump_info(thread, info, curr,
 							adev->dev->info.idx,
 							num_streams++);
 			}
@@ -677,16 +758,15 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 	}
 	case AUDIO_THREAD_CONFIG_GLOBAL_REMIX: {
 		struct audio_thread_config_global_remix *rmsg;
-		void *rsp;
-
-		/* Respond the pointer to the old remix converter, so it can be
-		 * freed later in main thread. */
-		rsp = (void *)thread->remix_converter;
+		struct cras_fmt_conv *old_conv;
 
+		/* Hand the old remix converter back in the message, so it can
+		 * be freed later in main thread. */
 		rmsg = (struct audio_thread_config_global_remix *)msg;
+		old_conv = thread->remix_converter;
 		thread->remix_converter = rmsg->fmt_conv;
-
-		return write(thread->to_main_fds[1], &rsp, sizeof(rsp));
+		rmsg->fmt_conv = old_conv;
+		break;
 	}
 	case AUDIO_THREAD_DEV_START_RAMP: {
 		struct audio_thread_dev_start_ramp_msg *rmsg;
@@ -708,12 +788,25 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		break;
 	}
 
-	err = audio_thread_send_response(thread, ret);
-	if (err < 0)
-		return err;
 	return ret;
 }
 
+/* Handles all messages queued by the main thread since the last wake. */
+static void handle_playback_thread_messages(struct audio_thread *thread)
+{
+	struct audio_thread_msg *msg;
+	int rc;
+
+	cras_cmd_ring_ack_doorbell(thread->cmd_ring);
+	while ((msg = (struct audio_thread_msg *)cras_cmd_ring_next(
+			thread->cmd_ring))) {
+		rc = handle_playback_thread_message(thread, msg);
+		cras_cmd_ring_complete(thread->cmd_ring, rc);
+		if (rc < 0)
+			syslog(LOG_INFO, "handle message %d", rc);
+	}
+}
+
 /* Returns the number of active streams plus the number of active devices. */
 static int fill_next_sleep_interval(struct audio_thread *thread,
 				    struct timespec *ts)
@@ -759,16 +852,239 @@ static struct pollfd *add_pollfd(struct audio_thread *thread, int fd,
 	return &thread->pollfds[thread->num_pollfds - 1];
 }
 
-static int continuous_zero_sleep_count = 0;
-static void check_busyloop(struct timespec *wait_ts)
+/* Releases the epoll backend, the thread falls back to ppoll. */
+static void epoll_teardown(struct audio_thread *thread)
+{
+	struct stream_poll_fd *entry;
+
+	DL_FOREACH (thread->stream_poll_fds, entry) {
+		DL_DELETE(thread->stream_poll_fds, entry);
+		free(entry);
+	}
+	thread->num_muted_stream_fds = 0;
+	if (thread->epoll_timer_fd >= 0)
+		close(thread->epoll_timer_fd);
+	thread->epoll_timer_fd = -1;
+	if (thread->epoll_fd >= 0)
+		close(thread->epoll_fd);
+	thread->epoll_fd = -1;
+}
+
+/* Rebuilds the array of fds to ppoll on from the registered callbacks and the
+ * streams attached to open devices. */
+static void fill_pollfds(struct audio_thread *thread)
+{
+	struct iodev_callback_list *iodev_cb;
+	struct open_dev *adev;
+	struct dev_stream *curr;
+
+restart_poll_loop:
+	thread->num_pollfds = 1;
+
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb) {
+		if (!iodev_cb->enabled)
+			continue;
+		iodev_cb->pollfd = add_pollfd(thread, iodev_cb->fd,
+					      iodev_cb->is_write);
+		if (!iodev_cb->pollfd)
+			goto restart_poll_loop;
+	}
+
+	/* TODO(dgreid) - once per rstream not per dev_stream */
+	DL_FOREACH (thread->open_devs[CRAS_STREAM_OUTPUT], adev) {
+		DL_FOREACH (adev->dev->streams, curr) {
+			int fd = dev_stream_poll_stream_fd(curr);
+			if (fd < 0)
+				continue;
+			if (!add_pollfd(thread, fd, 0))
+				goto restart_poll_loop;
+		}
+	}
+	DL_FOREACH (thread->open_devs[CRAS_STREAM_INPUT], adev) {
+		DL_FOREACH (adev->dev->streams, curr) {
+			int fd = dev_stream_poll_stream_fd(curr);
+			if (fd < 0)
+				continue;
+			if (!add_pollfd(thread, fd, 0))
+				goto restart_poll_loop;
+		}
+	}
+}
+
+/* Waits with ppoll and runs the callbacks whose fds became ready.
+ * timed_out is set if the wait ended because wait_ts passed.
+ * Returns:
+ *    The return value of ppoll.
+ */
+static int thread_wait_ppoll(struct audio_thread *thread,
+			     struct timespec *wait_ts, int *msg_ready,
+			     int *timed_out)
+{
+	struct iodev_callback_list *iodev_cb;
+	int rc;
+
+	rc = ppoll(thread->pollfds, thread->num_pollfds, wait_ts, NULL);
+	*timed_out = rc == 0;
+	if (rc <= 0)
+		return rc;
+
+	*msg_ready = thread->pollfds[0].revents & POLLIN;
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb) {
+		iodev_cb->revents =
+			iodev_cb->pollfd ? iodev_cb->pollfd->revents : 0;
+	}
+	return rc;
+}
+
+/* Puts back stream fds that were muted on a spurious wake once their streams
+ * expect a message from the client again. */
+static void epoll_rearm_stream_fds(struct audio_thread *thread)
+{
+	struct stream_poll_fd *entry;
+
+	if (!thread->num_muted_stream_fds)
+		return;
+
+	DL_FOREACH (thread->stream_poll_fds, entry) {
+		if (!entry->muted || cras_rstream_poll_fd(entry->stream) < 0)
+			continue;
+		if (epoll_add_fd(thread, entry->stream->fd, EPOLLIN,
+				 &entry->tag))
+			continue;
+		entry->muted = 0;
+		thread->num_muted_stream_fds--;
+	}
+}
+
+/* Arms the timer fd to fire after wait_ts, or disarms it if wait_ts is NULL.
+ * Returns:
+ *    The timeout in milliseconds to pass to epoll_wait.
+ */
+static int epoll_set_timer(struct audio_thread *thread,
+			   const struct timespec *wait_ts)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (wait_ts) {
+		if (timespec_is_zero(wait_ts))
+			return 0;
+		its.it_value = *wait_ts;
+	} else if (!thread->epoll_timer_armed) {
+		return -1;
+	}
+
+	/* Setting the timer also clears any expiration not read yet, so a
+	 * fired timer doesn't need to be read. */
+	if (timerfd_settime(thread->epoll_timer_fd, 0, &its, NULL) < 0) {
+		syslog(LOG_ERR, "Failed to set audio thread timer: %d", errno);
+		return wait_ts ? timespec_to_ms(wait_ts) : -1;
+	}
+	thread->epoll_timer_armed = !!wait_ts;
+	return -1;
+}
+
+/* Waits on the persistent epoll set. Stream fds that woke the thread while
+ * their stream isn't expecting a message are muted until it does.
+ * timed_out is set if the wait ended because wait_ts passed, which is the
+ * timer fd firing unless epoll_wait had to time out itself.
+ * Returns:
+ *    The return value of epoll_wait.
+ */
+static int thread_wait_epoll(struct audio_thread *thread,
+			     struct timespec *wait_ts, int *msg_ready,
+			     int *timed_out)
+{
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	struct epoll_fd_tag *tag;
+	struct stream_poll_fd *entry;
+	int timeout_ms;
+	int i, rc;
+
+	epoll_rearm_stream_fds(thread);
+	timeout_ms = epoll_set_timer(thread, wait_ts);
+
+	rc = epoll_wait(thread->epoll_fd, events, MAX_EPOLL_EVENTS, timeout_ms);
+	*timed_out = rc == 0;
+	if (rc <= 0)
+		return rc;
+
+	for (i = 0; i < rc; i++) {
+		tag = (struct epoll_fd_tag *)events[i].data.ptr;
+		switch (tag->type) {
+		case EPOLL_FD_MSG:
+			*msg_ready = events[i].events & EPOLLIN;
+			break;
+		case EPOLL_FD_TIMER:
+			*timed_out = 1;
+			break;
+		case EPOLL_FD_CALLBACK:
+			((struct iodev_callback_list *)tag)->revents =
+				events[i].events;
+			break;
+		case EPOLL_FD_STREAM:
+			entry = (struct stream_poll_fd *)tag;
+			if (cras_rstream_poll_fd(entry->stream) >= 0)
+				break;
+			epoll_rm_fd(thread, entry->stream->fd);
+			entry->muted = 1;
+			thread->num_muted_stream_fds++;
+			break;
+		}
+	}
+	return rc;
+}
+
+/* Waits for the next wake up with epoll or ppoll, whichever the thread uses.
+ * A wake up by the timer adds how late it came to the wake jitter histogram.
+ * Args:
+ *    thread - The thread waiting.
+ *    wait_ts - How long to wait, NULL to wait for an fd only.
+ *    msg_ready - Set if a message is pending.
+ *    wake - Set to the time the thread woke up.
+ * Returns:
+ *    The return value of epoll_wait or ppoll.
+ */
+static int thread_wait(struct audio_thread *thread, struct timespec *wait_ts,
+		       int *msg_ready, struct timespec *wake)
+{
+	struct timespec wake_target = { 0, 0 };
+	struct timespec late = { 0, 0 };
+	int timed_out;
+	int rc;
+
+	if (wait_ts) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &wake_target);
+		add_timespecs(&wake_target, wait_ts);
+	}
+
+	if (thread->epoll_fd >= 0)
+		rc = thread_wait_epoll(thread, wait_ts, msg_ready, &timed_out);
+	else
+		rc = thread_wait_ppoll(thread, wait_ts, msg_ready, &timed_out);
+	clock_gettime(CLOCK_MONOTONIC_RAW, wake);
+
+	/* Only a wake up by the timer says how late it was. */
+	if (wait_ts && timed_out) {
+		if (timespec_after(wake, &wake_target))
+			subtract_timespecs(wake, &wake_target, &late);
+		audio_thread_latency_add_ns(AUDIO_THREAD_LATENCY_WAKE_JITTER,
+					    late.tv_sec * 1000000000ULL +
+						    late.tv_nsec);
+	}
+	return rc;
+}
+
+static void check_busyloop(struct audio_thread *thread,
+			   struct timespec *wait_ts)
 {
 	if (wait_ts->tv_sec == 0 && wait_ts->tv_nsec == 0) {
-		continuous_zero_sleep_count++;
-		if (continuous_zero_sleep_count ==
+		thread->continuous_zero_sleep_count++;
+		if (thread->continuous_zero_sleep_count ==
 		    MAX_CONTINUOUS_ZERO_SLEEP_COUNT)
 			cras_audio_thread_busyloop();
 	} else {
-		continuous_zero_sleep_count = 0;
+		thread->continuous_zero_sleep_count = 0;
 	}
 }
 
@@ -782,21 +1098,31 @@ static void check_busyloop(struct timespec *wait_ts)
 static void *audio_io_thread(void *arg)
 {
 	struct audio_thread *thread = (struct audio_thread *)arg;
-	struct open_dev *adev;
-	struct dev_stream *curr;
 	struct timespec ts, now, last_wake;
 	int msg_fd;
+	int msg_ready;
 	int rc;
 
-	msg_fd = thread->to_thread_fds[0];
+	msg_fd = cras_cmd_ring_doorbell_fd(thread->cmd_ring);
+	running_thread = thread;
+
+	if (thread->cpu >= 0) {
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(thread->cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+			syslog(LOG_WARNING, "Failed to pin audio thread to %d",
+			       thread->cpu);
+	}
 
 	/* Attempt to get realtime scheduling */
 	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
 		cras_set_thread_priority(CRAS_SERVER_RT_THREAD_PRIORITY);
 
 	last_wake.tv_sec = 0;
-	longest_wake.tv_sec = 0;
-	longest_wake.tv_nsec = 0;
+	thread->longest_wake.tv_sec = 0;
+	thread->longest_wake.tv_nsec = 0;
 
 	thread->pollfds[0].fd = msg_fd;
 	thread->pollfds[0].events = POLLIN;
@@ -806,6 +1132,7 @@ static void *audio_io_thread(void *arg)
 		struct iodev_callback_list *iodev_cb;
 
 		wait_ts = NULL;
+		msg_ready = 0;
 		thread->num_pollfds = 1;
 
 		/* device opened */
@@ -816,70 +1143,40 @@ static void *audio_io_thread(void *arg)
 		if (fill_next_sleep_interval(thread, &ts))
 			wait_ts = &ts;
 
-	restart_poll_loop:
-		thread->num_pollfds = 1;
-
-		DL_FOREACH (iodev_callbacks, iodev_cb) {
-			if (!iodev_cb->enabled)
-				continue;
-			iodev_cb->pollfd = add_pollfd(thread, iodev_cb->fd,
-						      iodev_cb->is_write);
-			if (!iodev_cb->pollfd)
-				goto restart_poll_loop;
-		}
-
-		/* TODO(dgreid) - once per rstream not per dev_stream */
-		DL_FOREACH (thread->open_devs[CRAS_STREAM_OUTPUT], adev) {
-			DL_FOREACH (adev->dev->streams, curr) {
-				int fd = dev_stream_poll_stream_fd(curr);
-				if (fd < 0)
-					continue;
-				if (!add_pollfd(thread, fd, 0))
-					goto restart_poll_loop;
-			}
-		}
-		DL_FOREACH (thread->open_devs[CRAS_STREAM_INPUT], adev) {
-			DL_FOREACH (adev->dev->streams, curr) {
-				int fd = dev_stream_poll_stream_fd(curr);
-				if (fd < 0)
-					continue;
-				if (!add_pollfd(thread, fd, 0))
-					goto restart_poll_loop;
-			}
-		}
+		/* The epoll set is kept up to date on attach and detach. */
+		if (thread->epoll_fd < 0)
+			fill_pollfds(thread);
 
 		if (last_wake.tv_sec) {
 			struct timespec this_wake;
 			clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 			subtract_timespecs(&now, &last_wake, &this_wake);
-			if (timespec_after(&this_wake, &longest_wake))
-				longest_wake = this_wake;
+			if (timespec_after(&this_wake, &thread->longest_wake))
+				thread->longest_wake = this_wake;
 		}
 
 		ATLOG(atlog, AUDIO_THREAD_SLEEP, wait_ts ? wait_ts->tv_sec : 0,
-		      wait_ts ? wait_ts->tv_nsec : 0, longest_wake.tv_nsec);
+		      wait_ts ? wait_ts->tv_nsec : 0,
+		      thread->longest_wake.tv_nsec);
 		if (wait_ts)
-			check_busyloop(wait_ts);
+			check_busyloop(thread, wait_ts);
 
 		/* Sync atlog with shared memory. */
 		__sync_synchronize();
 		atlog->sync_write_pos = atlog->write_pos;
+		audio_thread_latency_commit();
 
-		rc = ppoll(thread->pollfds, thread->num_pollfds, wait_ts, NULL);
-		clock_gettime(CLOCK_MONOTONIC_RAW, &last_wake);
+		rc = thread_wait(thread, wait_ts, &msg_ready, &last_wake);
 		ATLOG(atlog, AUDIO_THREAD_WAKE, rc, 0, 0);
 		if (rc <= 0)
 			continue;
 
-		if (thread->pollfds[0].revents & POLLIN) {
-			rc = handle_playback_thread_message(thread);
-			if (rc < 0)
-				syslog(LOG_INFO, "handle message %d", rc);
-		}
+		if (msg_ready)
+			handle_playback_thread_messages(thread);
 
-		DL_FOREACH (iodev_callbacks, iodev_cb) {
-			if (iodev_cb->pollfd &&
-			    iodev_cb->pollfd->revents & (POLLIN | POLLOUT)) {
+		DL_FOREACH (thread->iodev_callbacks, iodev_cb) {
+			if (iodev_cb->revents & (POLLIN | POLLOUT)) {
+				iodev_cb->revents = 0;
 				ATLOG(atlog, AUDIO_THREAD_IODEV_CB,
 				      iodev_cb->is_write, 0, 0);
 				iodev_cb->cb(iodev_cb->cb_data);
@@ -904,21 +1201,30 @@ static void *audio_io_thread(void *arg)
 static int audio_thread_post_message(struct audio_thread *thread,
 				     struct audio_thread_msg *msg)
 {
-	int err, rsp;
+	return cras_cmd_ring_call(thread->cmd_ring, msg, msg->length);
+}
 
-	err = write(thread->to_thread_fds[1], msg, msg->length);
-	if (err < 0) {
-		syslog(LOG_ERR, "Failed to post message to thread.");
-		return err;
-	}
-	/* Synchronous action, wait for response. */
-	err = read_until_finished(thread->to_main_fds[0], &rsp, sizeof(rsp));
-	if (err < 0) {
-		syslog(LOG_ERR, "Failed to read reply from thread.");
-		return err;
-	}
+/* Queues a message to the playback thread without waiting for it to be
+ * handled. Messages posted back to back are handled in one wake of the audio
+ * thread, so this suits commands the main thread doesn't need a result from.
+ * Args:
+ *    thread - thread to receive message.
+ *    msg - The message to send, copied so it can live on the stack.
+ *    done - Called in the main thread once the message is handled, from a
+ *        later post. May be NULL.
+ * Returns:
+ *    0 if the message was queued, negative error code otherwise.
+ */
+static int audio_thread_post_message_async(struct audio_thread *thread,
+					   struct audio_thread_msg *msg,
+					   cras_cmd_ring_done_cb done)
+{
+	int rc;
 
-	return rsp;
+	rc = cras_cmd_ring_post(thread->cmd_ring, msg, msg->length, done);
+	if (rc < 0)
+		syslog(LOG_ERR, "Failed to post message to thread.");
+	return rc;
 }
 
 static void init_open_device_msg(struct audio_thread_open_device_msg *msg,
@@ -993,6 +1299,11 @@ int audio_thread_event_log_shm_fd()
 	return atlog_ro_shm_fd;
 }
 
+int audio_thread_latency_shm_fd()
+{
+	return atlat_ro_shm_fd;
+}
+
 int audio_thread_add_stream(struct audio_thread *thread,
 			    struct cras_rstream *stream,
 			    struct cras_iodev **devs, unsigned int num_devs)
@@ -1070,6 +1381,16 @@ int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd)
 	return audio_thread_post_message(thread, &msg.header);
 }
 
+/* Frees the remix converter replaced by a CONFIG_GLOBAL_REMIX message. */
+static void config_global_remix_done(void *msg, int rc)
+{
+	struct audio_thread_config_global_remix *rmsg;
+
+	rmsg = (struct audio_thread_config_global_remix *)msg;
+	if (rmsg->fmt_conv)
+		cras_fmt_conv_destroy(&rmsg->fmt_conv);
+}
+
 int audio_thread_config_global_remix(struct audio_thread *thread,
 				     unsigned int num_channels,
 				     const float *coefficient)
@@ -1078,7 +1399,6 @@ int audio_thread_config_global_remix(struct audio_thread *thread,
 	int identity_remix = 1;
 	unsigned int i, j;
 	struct audio_thread_config_global_remix msg;
-	void *rsp;
 
 	init_config_global_remix_msg(&msg);
 
@@ -1106,58 +1426,53 @@ int audio_thread_config_global_remix(struct audio_thread *thread,
 			return -ENOMEM;
 	}
 
-	err = write(thread->to_thread_fds[1], &msg, msg.header.length);
-	if (err < 0) {
-		syslog(LOG_ERR, "Failed to post message to thread.");
-		return err;
-	}
-	/* Synchronous action, wait for response. */
-	err = read_until_finished(thread->to_main_fds[0], &rsp, sizeof(rsp));
-	if (err < 0) {
-		syslog(LOG_ERR, "Failed to read reply from thread.");
-		return err;
-	}
-
-	if (rsp)
-		cras_fmt_conv_destroy((struct cras_fmt_conv **)&rsp);
-	return 0;
+	/* The old converter is freed once the audio thread has swapped it
+	 * out, there is no need to wait for that here. */
+	err = audio_thread_post_message_async(thread, &msg.header,
+					      config_global_remix_done);
+	if (err < 0 && msg.fmt_conv)
+		cras_fmt_conv_destroy(&msg.fmt_conv);
+	return err;
 }
 
 struct audio_thread *audio_thread_create()
 {
-	int rc;
 	struct audio_thread *thread;
 
 	thread = (struct audio_thread *)calloc(1, sizeof(*thread));
 	if (!thread)
 		return NULL;
 
-	thread->to_thread_fds[0] = -1;
-	thread->to_thread_fds[1] = -1;
-	thread->to_main_fds[0] = -1;
-	thread->to_main_fds[1] = -1;
-
-	/* Two way pipes for communication with the device's audio thread. */
-	rc = pipe(thread->to_thread_fds);
-	if (rc < 0) {
-		syslog(LOG_ERR, "Failed to pipe");
-		free(thread);
-		return NULL;
-	}
-	rc = pipe(thread->to_main_fds);
-	if (rc < 0) {
-		syslog(LOG_ERR, "Failed to pipe");
+	/* Commands and their results for the device's audio thread. */
+	thread->cmd_ring = cras_cmd_ring_create();
+	if (!thread->cmd_ring) {
 		free(thread);
 		return NULL;
 	}
 
-	if (asprintf(&atlog_name, "/ATlog-%d", getpid()) < 0) {
-		syslog(LOG_ERR, "Failed to generate ATlog name.");
-		exit(-1);
+	/* All threads log to the same event log and histograms. */
+	if (num_threads++ == 0) {
+		if (asprintf(&atlog_name, "/ATlog-%d", getpid()) < 0) {
+			syslog(LOG_ERR, "Failed to generate ATlog name.");
+			exit(-1);
+		}
+
+		atlog = audio_thread_event_log_init(atlog_name);
+
+		if (asprintf(&atlat_name, "/ATlat-%d", getpid()) < 0) {
+			syslog(LOG_ERR, "Failed to generate ATlat name.");
+			exit(-1);
+		}
+
+		audio_thread_latency_init(atlat_name);
 	}
 
-	atlog = audio_thread_event_log_init(atlog_name);
+	if (!selected_thread)
+		selected_thread = thread;
 
+	thread->cpu = -1;
+	thread->epoll_fd = -1;
+	thread->epoll_timer_fd = -1;
 	thread->pollfds_size = 32;
 	thread->pollfds = (struct pollfd *)malloc(sizeof(*thread->pollfds) *
 						  thread->pollfds_size);
@@ -1218,7 +1533,67 @@ int audio_thread_dev_start_ramp(struct audio_thread *thread,
 
 	init_device_start_ramp_msg(&msg, AUDIO_THREAD_DEV_START_RAMP, dev_idx,
 				   request);
-	return audio_thread_post_message(thread, &msg.header);
+	return audio_thread_post_message_async(thread, &msg.header, NULL);
+}
+
+int audio_thread_use_epoll(struct audio_thread *thread, int enable)
+{
+	struct iodev_callback_list *iodev_cb;
+	int rc;
+
+	if (thread->started)
+		return -EBUSY;
+	if (!enable || thread->epoll_fd >= 0)
+		return 0;
+
+	thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (thread->epoll_fd < 0) {
+		syslog(LOG_ERR, "Failed to create audio thread epoll set");
+		return -errno;
+	}
+	thread->epoll_timer_fd =
+		timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (thread->epoll_timer_fd < 0) {
+		rc = -errno;
+		syslog(LOG_ERR, "Failed to create audio thread timer");
+		goto fallback;
+	}
+	thread->epoll_timer_armed = 0;
+
+	rc = epoll_add_fd(thread, cras_cmd_ring_doorbell_fd(thread->cmd_ring),
+			  EPOLLIN, &epoll_msg_tag);
+	if (rc)
+		goto fallback;
+	rc = epoll_add_fd(thread, thread->epoll_timer_fd, EPOLLIN,
+			  &epoll_timer_tag);
+	if (rc)
+		goto fallback;
+
+	/* Callbacks can be registered before the thread starts. */
+	DL_FOREACH (thread->iodev_callbacks, iodev_cb)
+		epoll_update_callback(thread, iodev_cb, 0);
+
+	return 0;
+
+fallback:
+	epoll_teardown(thread);
+	return rc;
+}
+
+int audio_thread_set_cpu(struct audio_thread *thread, int cpu)
+{
+	if (thread->started)
+		return -EBUSY;
+	if (cpu >= CPU_SETSIZE)
+		return -EINVAL;
+
+	thread->cpu = cpu;
+	return 0;
+}
+
+void audio_thread_select(struct audio_thread *thread)
+{
+	selected_thread = thread;
 }
 
 int audio_thread_start(struct audio_thread *thread)
@@ -1248,19 +1623,20 @@ void audio_thread_destroy(struct audio_thread *thread)
 	}
 
 	free(thread->pollfds);
+	epoll_teardown(thread);
 
-	audio_thread_event_log_deinit(atlog, atlog_name);
-	free(atlog_name);
+	if (selected_thread == thread)
+		selected_thread = NULL;
 
-	if (thread->to_thread_fds[0] != -1) {
-		close(thread->to_thread_fds[0]);
-		close(thread->to_thread_fds[1]);
-	}
-	if (thread->to_main_fds[0] != -1) {
-		close(thread->to_main_fds[0]);
-		close(thread->to_main_fds[1]);
+	if (--num_threads == 0) {
+		audio_thread_event_log_deinit(atlog, atlog_name);
+		free(atlog_name);
+		audio_thread_latency_deinit(atlat_name);
+		free(atlat_name);
 	}
 
+	cras_cmd_ring_destroy(thread->cmd_ring);
+
 	if (thread->remix_converter)
 		cras_fmt_conv_destroy(&thread->remix_converter);
 
@@ -14,15 +14,18 @@
 #include "dev_io.h"
 
 struct buffer_share;
+struct cras_cmd_ring;
 struct cras_fmt_conv;
 struct cras_iodev;
 struct cras_rstream;
 struct dev_stream;
+struct iodev_callback_list;
+struct stream_poll_fd;
 
-/* Hold communication pipes and pthread info for the thread used to play or
+/* Hold the command ring and pthread info for the thread used to play or
  * record audio.
- *    to_thread_fds - Send a message from main to running thread.
- *    to_main_fds - Send a synchronous response to main from running thread.
+ *    cmd_ring - Carries messages from main to the running thread and their
+ *        responses back.
  *    tid - Thread ID of the running playback/capture thread.
  *    started - Non-zero if the thread has started successfully.
  *    suspended - Non-zero if the thread is suspended.
@@ -31,10 +34,19 @@ struct dev_stream;
  *    pollfds_size - Number of available poll fds.
  *    num_pollfds - Number of currently registered poll fds.
  *    remix_converter - Format converter used to remix output channels.
+ *    iodev_callbacks - Callbacks on fds registered by the thread's devices.
+ *    longest_wake - Longest time between two wakes since the last dump.
+ *    continuous_zero_sleep_count - Number of wakes in a row that didn't sleep.
+ *    cpu - The CPU the thread is pinned to, -1 to let it run on any.
+ *    epoll_fd - The epoll set the thread waits on, -1 when it waits with
+ *        ppoll, in which case the fd set is rebuilt on every wake instead.
+ *    epoll_timer_fd - Timer fd that ends the sleep of an epoll wait.
+ *    epoll_timer_armed - Non-zero if epoll_timer_fd is set to fire.
+ *    stream_poll_fds - Stream fds registered with the epoll set.
+ *    num_muted_stream_fds - Number of stream_poll_fds taken out of the set.
  */
 struct audio_thread {
-	int to_thread_fds[2];
-	int to_main_fds[2];
+	struct cras_cmd_ring *cmd_ring;
 	pthread_t tid;
 	int started;
 	int suspended;
@@ -43,6 +55,15 @@ struct audio_thread {
 	size_t pollfds_size;
 	size_t num_pollfds;
 	struct cras_fmt_conv *remix_converter;
+	struct iodev_callback_list *iodev_callbacks;
+	struct timespec longest_wake;
+	int continuous_zero_sleep_count;
+	int cpu;
+	int epoll_fd;
+	int epoll_timer_fd;
+	int epoll_timer_armed;
+	struct stream_poll_fd *stream_poll_fds;
+	unsigned int num_muted_stream_fds;
 };
 
 /* Callback function to be handled in main loop in audio thread.
@@ -83,6 +104,15 @@ int audio_thread_rm_open_dev(struct audio_thread *thread,
 int audio_thread_is_dev_open(struct audio_thread *thread,
 			     struct cras_iodev *dev);
 
+/* Selects the thread audio_thread_add_callback() and the other calls without
+ * a thread argument act on when they are made outside of an audio thread, for
+ * example while a device is opened or closed in the main thread. Calls made in
+ * an audio thread act on that thread. Defaults to the first thread created.
+ * Args:
+ *    thread - The thread to act on.
+ */
+void audio_thread_select(struct audio_thread *thread);
+
 /* Adds an thread_callback to audio thread.
  * Args:
  *    fd - The file descriptor to be polled for the callback.
@@ -117,6 +147,44 @@ int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd);
 /* Enables or Disabled the callback associated with fd. */
 void audio_thread_enable_callback(int fd, int enabled);
 
+/* Registers the fd of a stream attached to a device with the epoll backend.
+ * Called on the audio thread each time the stream is attached to a device, the
+ * fd stays registered until the last matching audio_thread_unpoll_stream().
+ * Does nothing when the thread waits with ppoll.
+ * Args:
+ *    stream - The stream being attached.
+ */
+void audio_thread_poll_stream(struct cras_rstream *stream);
+
+/* Drops one reference to a stream fd added by audio_thread_poll_stream().
+ * Args:
+ *    stream - The stream being detached from a device.
+ */
+void audio_thread_unpoll_stream(struct cras_rstream *stream);
+
+/* Selects how the audio thread waits for events. By default it uses ppoll and
+ * rebuilds the set of fds on every wake. With epoll enabled, callback and
+ * stream fds are registered once when they are added and the sleep interval is
+ * driven by a timerfd. Must be called before audio_thread_start().
+ * Args:
+ *    thread - The thread to configure.
+ *    enable - Non-zero to use the epoll backend.
+ * Returns:
+ *    0 on success, negative error code on failure in which case the thread
+ *    keeps using ppoll.
+ */
+int audio_thread_use_epoll(struct audio_thread *thread, int enable);
+
+/* Pins the thread to a CPU. Must be called before audio_thread_start().
+ * Args:
+ *    thread - The thread to configure.
+ *    cpu - The CPU to run on, -1 to run on any.
+ * Returns:
+ *    0 on success, -EBUSY if the thread has started, -EINVAL if cpu is out of
+ *    range.
+ */
+int audio_thread_set_cpu(struct audio_thread *thread, int cpu);
+
 /* Starts a thread created with audio_thread_create.
  * Args:
  *    thread - The thread to start.
@@ -131,6 +199,9 @@ void audio_thread_destroy(struct audio_thread *thread);
 /* Returns the shm fd for the ATlog. */
 int audio_thread_event_log_shm_fd();
 
+/* Returns the shm fd for the audio thread latency histograms. */
+int audio_thread_latency_shm_fd();
+
 /* Add a stream to the thread. After this call, the ownership of the stream will
  * be passed to the audio thread. Audio thread is responsible to release the
  * stream's resources.
@@ -171,7 +242,9 @@ int audio_thread_disconnect_stream(struct audio_thread *thread,
 				   struct cras_rstream *stream,
 				   struct cras_iodev *iodev);
 
-/* Dumps information about all active streams to syslog. */
+/* Appends information about the devices and streams of the thread to info.
+ * Several threads can be dumped to the same info, the caller clears
+ * info->num_devs and info->num_streams before the first. */
 int audio_thread_dump_thread_info(struct audio_thread *thread,
 				  struct audio_debug_info *info);
 
@@ -187,7 +260,8 @@ int audio_thread_set_aec_dump(struct audio_thread *thread,
 			      int fd);
 
 /* Configures the global converter for output remixing. Called by main
- * thread. */
+ * thread. Doesn't wait for the audio thread to switch converters, the old one
+ * is freed in main thread after it has. */
 int audio_thread_config_global_remix(struct audio_thread *thread,
 				     unsigned int num_channels,
 				     const float *coefficient);
@@ -195,14 +269,15 @@ int audio_thread_config_global_remix(struct audio_thread *thread,
 /* Start ramping on a device.
  *
  * Ramping is started/updated in audio thread. This function lets the main
- * thread request that the audio thread start ramping.
+ * thread request that the audio thread start ramping, without waiting for it
+ * to be started.
  *
  * Args:
  *   thread - a pointer to the audio thread.
  *   dev_idx - Index of the the device to start ramping.
  *   request - Check the docstrings of CRAS_IODEV_RAMP_REQUEST.
  * Returns:
- *    0 on success, negative if error.
+ *    0 if the request was queued, negative if error.
  */
 int audio_thread_dev_start_ramp(struct audio_thread *thread,
 				unsigned int dev_idx,
@@ -0,0 +1,121 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "audio_thread_latency.h"
+#include "cras_latency_hist.h"
+#include "cras_shm.h"
+
+/* Times a reader copies the histograms before giving up. */
+#define MAX_READ_TRIES 16
+
+struct audio_thread_latency_stats *atlat;
+int atlat_rw_shm_fd = -1;
+int atlat_ro_shm_fd = -1;
+
+/* Time added to each phase in the current wake of the calling thread. */
+static __thread uint64_t pending_ns[AUDIO_THREAD_LATENCY_NUM_PHASES];
+/* Bit for each phase that was entered in the current wake. */
+static __thread uint32_t pending_phases;
+
+void audio_thread_latency_init(const char *name)
+{
+	atlat_rw_shm_fd = -1;
+	atlat_ro_shm_fd = -1;
+
+	atlat = (struct audio_thread_latency_stats *)cras_shm_setup(
+		name, sizeof(*atlat), &atlat_rw_shm_fd, &atlat_ro_shm_fd);
+	if (!atlat)
+		syslog(LOG_ERR, "Failed to set up latency histograms.");
+}
+
+void audio_thread_latency_deinit(const char *name)
+{
+	if (!atlat)
+		return;
+	munmap(atlat, sizeof(*atlat));
+	atlat = NULL;
+	if (atlat_rw_shm_fd >= 0)
+		cras_shm_close_unlink(name, atlat_rw_shm_fd);
+	if (atlat_ro_shm_fd >= 0)
+		close(atlat_ro_shm_fd);
+	atlat_rw_shm_fd = -1;
+	atlat_ro_shm_fd = -1;
+}
+
+void audio_thread_latency_add_ns(enum AUDIO_THREAD_LATENCY_PHASE phase,
+				 uint64_t ns)
+{
+	pending_ns[phase] += ns;
+	pending_phases |= 1 << phase;
+}
+
+void audio_thread_latency_add(enum AUDIO_THREAD_LATENCY_PHASE phase,
+			      const struct timespec *start)
+{
+	struct timespec now;
+	int64_t ns;
+
+	if (!atlat)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000LL +
+	     (now.tv_nsec - start->tv_nsec);
+	audio_thread_latency_add_ns(phase, ns > 0 ? ns : 0);
+}
+
+void audio_thread_latency_commit()
+{
+	uint32_t seq;
+	unsigned int i;
+
+	if (!pending_phases)
+		return;
+
+	if (atlat) {
+		/* Audio threads take turns to make seq odd, which also keeps
+		 * readers out while the histograms change. */
+		do {
+			seq = atlat->seq & ~1u;
+		} while (!__sync_bool_compare_and_swap(&atlat->seq, seq,
+						       seq + 1));
+		for (i = 0; i < AUDIO_THREAD_LATENCY_NUM_PHASES; i++)
+			if (pending_phases & (1 << i))
+				latency_hist_add(&atlat->hists[i],
+						 pending_ns[i]);
+		__sync_synchronize();
+		atlat->seq = seq + 2;
+	}
+
+	memset(pending_ns, 0, sizeof(pending_ns));
+	pending_phases = 0;
+}
+
+int audio_thread_latency_read(struct audio_thread_latency_stats *stats)
+{
+	uint32_t seq;
+	unsigned int i;
+
+	if (!atlat)
+		return -ENODEV;
+
+	for (i = 0; i < MAX_READ_TRIES; i++) {
+		seq = atlat->seq;
+		__sync_synchronize();
+		if (seq & 1)
+			continue;
+		memcpy(stats, atlat, sizeof(*stats));
+		__sync_synchronize();
+		if (atlat->seq == seq)
+			return 0;
+	}
+	return -EBUSY;
+}
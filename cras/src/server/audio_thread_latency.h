@@ -0,0 +1,56 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Histograms of the time the audio thread spends in each phase of a wake,
+ * kept in shared memory so they can be read without stopping the thread.
+ * Durations are added from the audio threads only.
+ */
+
+#ifndef AUDIO_THREAD_LATENCY_H_
+#define AUDIO_THREAD_LATENCY_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "cras_types.h"
+
+extern struct audio_thread_latency_stats *atlat;
+extern int atlat_rw_shm_fd;
+extern int atlat_ro_shm_fd;
+
+/* Creates the shared memory region named name for the histograms. */
+void audio_thread_latency_init(const char *name);
+
+/* Unmaps and unlinks the region created by audio_thread_latency_init. */
+void audio_thread_latency_deinit(const char *name);
+
+/*
+ * Adds the time elapsed since start to phase. The durations added during a
+ * wake are counted together by audio_thread_latency_commit.
+ * Args:
+ *    phase - The phase the time was spent in.
+ *    start - When the phase started, from CLOCK_MONOTONIC_RAW.
+ */
+void audio_thread_latency_add(enum AUDIO_THREAD_LATENCY_PHASE phase,
+			      const struct timespec *start);
+
+/* Adds ns nanoseconds to phase, like audio_thread_latency_add. */
+void audio_thread_latency_add_ns(enum AUDIO_THREAD_LATENCY_PHASE phase,
+				 uint64_t ns);
+
+/* Counts the time added to each phase since the last commit in the
+ * histograms. Called once per wake, phases not entered aren't counted. */
+void audio_thread_latency_commit();
+
+/*
+ * Copies the histograms while the audio thread may be updating them.
+ * Args:
+ *    stats - Filled with the histograms.
+ * Returns:
+ *    0 on success, -ENODEV if there are no histograms, or -EBUSY if the
+ *    audio thread kept updating them.
+ */
+int audio_thread_latency_read(struct audio_thread_latency_stats *stats);
+
+#endif /* AUDIO_THREAD_LATENCY_H_ */
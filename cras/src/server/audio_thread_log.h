@@ -57,7 +57,8 @@ audio_thread_event_log_deinit(struct audio_thread_event_log *log, char *name)
 }
 
 /* Log a tag and the current time, Uses two words, the first is split
- * 8 bits for tag and 24 for seconds, second word is micro seconds.
+ * 8 bits for tag and 24 for seconds, second word is micro seconds. Every audio
+ * thread logs to the same log, each event claims its entry atomically.
  */
 static inline void
 audio_thread_event_log_data(struct audio_thread_event_log *log,
@@ -65,7 +66,8 @@ audio_thread_event_log_data(struct audio_thread_event_log *log,
 			    uint32_t data2, uint32_t data3)
 {
 	struct timespec now;
-	uint64_t pos_mod_len = log->write_pos % AUDIO_THREAD_EVENT_LOG_SIZE;
+	uint64_t pos_mod_len = __sync_fetch_and_add(&log->write_pos, 1) %
+			       AUDIO_THREAD_EVENT_LOG_SIZE;
 	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 
 	log->log[pos_mod_len].tag_sec =
@@ -74,8 +76,6 @@ audio_thread_event_log_data(struct audio_thread_event_log *log,
 	log->log[pos_mod_len].data1 = data1;
 	log->log[pos_mod_len].data2 = data2;
 	log->log[pos_mod_len].data3 = data3;
-
-	log->write_pos++;
 }
 
 #endif /* AUDIO_THREAD_LOG_H_ */
@@ -14,11 +14,35 @@ static const unsigned int MAX_KEY_LEN = 63;
 static const int32_t DEFAULT_OUTPUT_BUFFER_SIZE = 512;
 static const int32_t AEC_SUPPORTED_DEFAULT = 0;
 static const int32_t AEC_GROUP_ID_DEFAULT = -1;
+static const int32_t AUDIO_THREAD_USE_EPOLL_DEFAULT = 0;
+static const int32_t FLOAT_MIX_BUS_DEFAULT = 0;
+static const int32_t FLOAT_MIX_BUS_DITHER_DEFAULT = 0;
+static const int32_t SHARED_PLAYBACK_CONVERSION_DEFAULT = 0;
+static const int32_t NUM_AUDIO_THREADS_DEFAULT = 1;
+static const int32_t AUDIO_THREAD_DEVICE_POLICY_DEFAULT = 0;
+static const int32_t AUDIO_THREAD_CPU_MASK_DEFAULT = 0;
+static const int32_t A2DP_ENCODER_OFFLOAD_DEFAULT = 0;
+static const int32_t HFP_BATCHED_SCO_IO_DEFAULT = 0;
+static const int32_t NATIVE_SBC_CODEC_DEFAULT = 0;
+static const int32_t A2DP_ADAPTIVE_BITPOOL_DEFAULT = 0;
+static const int32_t DSP_CROSSFADE_MS_DEFAULT = 10;
 
 #define CONFIG_NAME "board.ini"
 #define DEFAULT_OUTPUT_BUF_SIZE_INI_KEY "output:default_output_buffer_size"
 #define AEC_SUPPORTED_INI_KEY "processing:aec_supported"
 #define AEC_GROUP_ID_INI_KEY "processing:group_id"
+#define AUDIO_THREAD_USE_EPOLL_INI_KEY "audio_thread:use_epoll"
+#define FLOAT_MIX_BUS_INI_KEY "output:float_mix_bus"
+#define FLOAT_MIX_BUS_DITHER_INI_KEY "output:float_mix_bus_dither"
+#define SHARED_PLAYBACK_CONVERSION_INI_KEY "output:shared_playback_conversion"
+#define NUM_AUDIO_THREADS_INI_KEY "audio_thread:num_threads"
+#define AUDIO_THREAD_DEVICE_POLICY_INI_KEY "audio_thread:device_policy"
+#define AUDIO_THREAD_CPU_MASK_INI_KEY "audio_thread:cpu_mask"
+#define A2DP_ENCODER_OFFLOAD_INI_KEY "bluetooth:a2dp_encoder_offload"
+#define HFP_BATCHED_SCO_IO_INI_KEY "bluetooth:hfp_batched_sco_io"
+#define NATIVE_SBC_CODEC_INI_KEY "bluetooth:native_sbc_codec"
+#define A2DP_ADAPTIVE_BITPOOL_INI_KEY "bluetooth:a2dp_adaptive_bitpool"
+#define DSP_CROSSFADE_MS_INI_KEY "processing:dsp_crossfade_ms"
 
 void cras_board_config_get(const char *config_path,
 			   struct cras_board_config *board_config)
@@ -30,6 +54,20 @@ void cras_board_config_get(const char *config_path,
 	board_config->default_output_buffer_size = DEFAULT_OUTPUT_BUFFER_SIZE;
 	board_config->aec_supported = AEC_SUPPORTED_DEFAULT;
 	board_config->aec_group_id = AEC_GROUP_ID_DEFAULT;
+	board_config->audio_thread_use_epoll = AUDIO_THREAD_USE_EPOLL_DEFAULT;
+	board_config->float_mix_bus = FLOAT_MIX_BUS_DEFAULT;
+	board_config->float_mix_bus_dither = FLOAT_MIX_BUS_DITHER_DEFAULT;
+	board_config->shared_playback_conversion =
+		SHARED_PLAYBACK_CONVERSION_DEFAULT;
+	board_config->num_audio_threads = NUM_AUDIO_THREADS_DEFAULT;
+	board_config->audio_thread_device_policy =
+		AUDIO_THREAD_DEVICE_POLICY_DEFAULT;
+	board_config->audio_thread_cpu_mask = AUDIO_THREAD_CPU_MASK_DEFAULT;
+	board_config->a2dp_encoder_offload = A2DP_ENCODER_OFFLOAD_DEFAULT;
+	board_config->hfp_batched_sco_io = HFP_BATCHED_SCO_IO_DEFAULT;
+	board_config->native_sbc_codec = NATIVE_SBC_CODEC_DEFAULT;
+	board_config->a2dp_adaptive_bitpool = A2DP_ADAPTIVE_BITPOOL_DEFAULT;
+	board_config->dsp_crossfade_ms = DSP_CROSSFADE_MS_DEFAULT;
 	if (config_path == NULL)
 		return;
 
@@ -56,6 +94,66 @@ void cras_board_config_get(const char *config_path,
 	board_config->aec_group_id =
 		iniparser_getint(ini, ini_key, AEC_GROUP_ID_DEFAULT);
 
+	snprintf(ini_key, MAX_KEY_LEN, AUDIO_THREAD_USE_EPOLL_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->audio_thread_use_epoll =
+		iniparser_getint(ini, ini_key, AUDIO_THREAD_USE_EPOLL_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, FLOAT_MIX_BUS_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->float_mix_bus =
+		iniparser_getint(ini, ini_key, FLOAT_MIX_BUS_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, FLOAT_MIX_BUS_DITHER_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->float_mix_bus_dither =
+		iniparser_getint(ini, ini_key, FLOAT_MIX_BUS_DITHER_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, SHARED_PLAYBACK_CONVERSION_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->shared_playback_conversion = iniparser_getint(
+		ini, ini_key, SHARED_PLAYBACK_CONVERSION_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, NUM_AUDIO_THREADS_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->num_audio_threads =
+		iniparser_getint(ini, ini_key, NUM_AUDIO_THREADS_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, AUDIO_THREAD_DEVICE_POLICY_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->audio_thread_device_policy = iniparser_getint(
+		ini, ini_key, AUDIO_THREAD_DEVICE_POLICY_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, AUDIO_THREAD_CPU_MASK_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->audio_thread_cpu_mask =
+		iniparser_getint(ini, ini_key, AUDIO_THREAD_CPU_MASK_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, A2DP_ENCODER_OFFLOAD_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->a2dp_encoder_offload =
+		iniparser_getint(ini, ini_key, A2DP_ENCODER_OFFLOAD_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, HFP_BATCHED_SCO_IO_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->hfp_batched_sco_io =
+		iniparser_getint(ini, ini_key, HFP_BATCHED_SCO_IO_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, NATIVE_SBC_CODEC_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->native_sbc_codec =
+		iniparser_getint(ini, ini_key, NATIVE_SBC_CODEC_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, A2DP_ADAPTIVE_BITPOOL_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->a2dp_adaptive_bitpool =
+		iniparser_getint(ini, ini_key, A2DP_ADAPTIVE_BITPOOL_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, DSP_CROSSFADE_MS_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->dsp_crossfade_ms =
+		iniparser_getint(ini, ini_key, DSP_CROSSFADE_MS_DEFAULT);
+
 	iniparser_freedict(ini);
 	syslog(LOG_DEBUG, "Loaded ini file %s", ini_name);
 }
@@ -12,6 +12,18 @@ struct cras_board_config {
 	int32_t default_output_buffer_size;
 	int32_t aec_supported;
 	int32_t aec_group_id;
+	int32_t audio_thread_use_epoll;
+	int32_t float_mix_bus;
+	int32_t float_mix_bus_dither;
+	int32_t shared_playback_conversion;
+	int32_t num_audio_threads;
+	int32_t audio_thread_device_policy;
+	int32_t audio_thread_cpu_mask;
+	int32_t a2dp_encoder_offload;
+	int32_t hfp_batched_sco_io;
+	int32_t native_sbc_codec;
+	int32_t a2dp_adaptive_bitpool;
+	int32_t dsp_crossfade_ms;
 };
 
 /* Gets a configuration based on the config file specified.
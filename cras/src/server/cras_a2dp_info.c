@@ -3,8 +3,12 @@
  * found in the LICENSE file.
  */
 
+#include <errno.h>
 #include <netinet/in.h>
 #include <sbc/sbc.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
 #include <syslog.h>
 
 #include "cras_a2dp_info.h"
@@ -12,6 +16,81 @@
 #include "cras_types.h"
 #include "rtp.h"
 
+/* Number of packets the socket is judged over before stepping the bitpool. */
+#define BITPOOL_WINDOW_PACKETS 10
+/* Windows in a row with no packet backed up before raising the bitpool. */
+#define BITPOOL_CLEAN_WINDOWS 5
+/* How much the bitpool moves in one step. */
+#define BITPOOL_STEP 5
+
+static void bitpool_reset_window(struct a2dp_bitpool *bp)
+{
+	bp->packets = 0;
+	bp->backed_up = 0;
+}
+
+/* Moves the bitpool one step towards the end the last window calls for. */
+static void bitpool_end_window(struct a2dp_bitpool *bp)
+{
+	if (bp->backed_up * 4 >= bp->packets) {
+		bp->clean_windows = 0;
+		if (bp->target > bp->min) {
+			bp->target = MAX(bp->target - BITPOOL_STEP, bp->min);
+			bp->num_decreases++;
+			bp->lowest = MIN(bp->lowest, bp->target);
+		}
+	} else if (bp->backed_up == 0) {
+		if (++bp->clean_windows >= BITPOOL_CLEAN_WINDOWS) {
+			bp->clean_windows = 0;
+			bp->target = MIN(bp->target + BITPOOL_STEP, bp->max);
+		}
+	} else {
+		bp->clean_windows = 0;
+	}
+	bitpool_reset_window(bp);
+}
+
+/* Records how the socket took a packet. How full the socket is says
+ * nothing, it is filled up on purpose at start and then only topped up as
+ * fast as the link drains it. Only a send finding no room at all counts.
+ * Args:
+ *    bp - The bitpool state.
+ *    err - The send result, negative errno on failure.
+ */
+static void bitpool_sent(struct a2dp_bitpool *bp, int err)
+{
+	if (!bp->enabled)
+		return;
+
+	bp->packets++;
+	if (err == -EAGAIN)
+		bp->backed_up++;
+
+	if (bp->packets >= BITPOOL_WINDOW_PACKETS)
+		bitpool_end_window(bp);
+}
+
+/* Switches to the target bitpool. Only called when no frame is waiting in
+ * a2dp_buf, so a packet never mixes frames of different lengths. */
+static void bitpool_apply(struct a2dp_info *a2dp)
+{
+	struct a2dp_bitpool *bp = &a2dp->bitpool;
+	int rc;
+
+	if (!bp->enabled || bp->cur == bp->target)
+		return;
+
+	rc = cras_sbc_codec_set_bitpool(a2dp->codec, bp->target);
+	if (rc) {
+		syslog(LOG_ERR, "Failed to set a2dp bitpool %u: %d",
+		       bp->target, rc);
+		bp->target = bp->cur;
+		return;
+	}
+	bp->cur = bp->target;
+	a2dp->frame_length = cras_sbc_get_frame_length(a2dp->codec);
+}
+
 int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
 {
 	uint8_t frequency = 0, mode = 0, subbands = 0, allocation, blocks = 0,
@@ -81,9 +160,29 @@ int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
 	a2dp->seq_num = 0;
 	a2dp->samples = 0;
 
+	memset(&a2dp->bitpool, 0, sizeof(a2dp->bitpool));
+	a2dp->bitpool.min = MIN(MAX(sbc->min_bitpool, MIN_BITPOOL), bitpool);
+	a2dp->bitpool.max = bitpool;
+	a2dp->bitpool.cur = bitpool;
+	a2dp->bitpool.target = bitpool;
+	a2dp->bitpool.lowest = bitpool;
+
 	return 0;
 }
 
+void a2dp_enable_adaptive_bitpool(struct a2dp_info *a2dp)
+{
+	struct a2dp_bitpool *bp = &a2dp->bitpool;
+
+	bp->enabled = 1;
+	bp->target = bp->max;
+	bp->lowest = bp->max;
+	bp->num_decreases = 0;
+	bp->clean_windows = 0;
+	bitpool_reset_window(bp);
+	bitpool_apply(a2dp);
+}
+
 void destroy_a2dp(struct a2dp_info *a2dp)
 {
 	cras_sbc_codec_destroy(a2dp->codec);
@@ -111,6 +210,11 @@ void a2dp_drain(struct a2dp_info *a2dp)
 	a2dp->samples = 0;
 	a2dp->seq_num = 0;
 	a2dp->frame_count = 0;
+
+	/* Sends are expected to back up while the socket is filled up, don't
+	 * count them against the link. */
+	bitpool_reset_window(&a2dp->bitpool);
+	bitpool_apply(a2dp);
 }
 
 static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
@@ -132,8 +236,12 @@ static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
 
 	err = send(stream_fd, a2dp->a2dp_buf, a2dp->a2dp_buf_used,
 		   MSG_DONTWAIT);
-	if (err < 0)
-		return -errno;
+	if (err < 0) {
+		err = -errno;
+		bitpool_sent(&a2dp->bitpool, err);
+		return err;
+	}
+	bitpool_sent(&a2dp->bitpool, err);
 
 	/* Returns the number of samples in frame. */
 	samples = a2dp->samples;
@@ -143,6 +251,7 @@ static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
 	a2dp->frame_count = 0;
 	a2dp->samples = 0;
 	a2dp->seq_num++;
+	bitpool_apply(a2dp);
 
 	return samples;
 }
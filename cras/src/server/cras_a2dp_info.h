@@ -10,6 +10,36 @@
 
 #define A2DP_BUF_SIZE_BYTES 1024
 
+/* Steps the bitpool within the negotiated range by how well the socket keeps
+ * up, so a congested link gets smaller frames rather than a backed up socket.
+ * Packets are judged in windows, a packet is backed up when its send got
+ * EAGAIN. The bitpool is lowered after a window with a quarter of its packets
+ * backed up, and raised again after a few windows with none.
+ * Members:
+ *    enabled - Non-zero once a2dp_enable_adaptive_bitpool() is called.
+ *    min - The lowest negotiated bitpool.
+ *    max - The highest negotiated bitpool, which encoding starts at.
+ *    cur - The bitpool frames are encoded at.
+ *    target - The bitpool to switch to at the start of the next packet.
+ *    packets - Packets sent or tried in the current window.
+ *    backed_up - Packets backed up in the current window.
+ *    clean_windows - Windows in a row with no packet backed up.
+ *    num_decreases - Times the bitpool was lowered since enabled.
+ *    lowest - The lowest bitpool used since enabled.
+ */
+struct a2dp_bitpool {
+	int enabled;
+	uint8_t min;
+	uint8_t max;
+	uint8_t cur;
+	uint8_t target;
+	unsigned int packets;
+	unsigned int backed_up;
+	unsigned int clean_windows;
+	unsigned int num_decreases;
+	uint8_t lowest;
+};
+
 /* Represents the codec and encoded state of a2dp iodev.
  * Members:
  *    codec - The codec used to encode PCM buffer to a2dp buffer.
@@ -21,6 +51,7 @@
  *    samples - Queued PCM frame count currently in a2dp buffer.
  *    nsamples - Cumulative number of encoded PCM frames.
  *    a2dp_buf_used - Used a2dp buffer counter in bytes.
+ *    bitpool - Adapts the bitpool of the encoded frames to the link.
  */
 struct a2dp_info {
 	struct cras_audio_codec *codec;
@@ -32,6 +63,7 @@ struct a2dp_info {
 	int samples;
 	int nsamples;
 	size_t a2dp_buf_used;
+	struct a2dp_bitpool bitpool;
 };
 
 /*
@@ -39,6 +71,14 @@ struct a2dp_info {
  */
 int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc);
 
+/*
+ * Starts adapting the bitpool to how fast the stream socket drains, from the
+ * highest negotiated one.
+ * Args:
+ *    a2dp: The a2dp info object.
+ */
+void a2dp_enable_adaptive_bitpool(struct a2dp_info *a2dp);
+
 /*
  * Destroys an a2dp_info.
  */
@@ -15,13 +15,15 @@
 #include "audio_thread.h"
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
-#include "cras_iodev_list.h"
 #include "cras_a2dp_endpoint.h"
 #include "cras_a2dp_info.h"
 #include "cras_a2dp_iodev.h"
+#include "cras_a2dp_worker.h"
 #include "cras_audio_area.h"
 #include "cras_bt_device.h"
 #include "cras_iodev.h"
+#include "cras_server_metrics.h"
+#include "cras_system_state.h"
 #include "cras_util.h"
 #include "sfh.h"
 #include "rtp.h"
@@ -52,6 +54,12 @@ static const struct timespec no_stream_target_frames_ts = {
  *        in no stream state.
  *    filled_zeros_bytes - Number of zero data in bytes that have been filled
  *        in no stream state.
+ *    worker - Encodes and writes to the a2dp socket off the audio thread,
+ *        NULL when the audio thread does it in flush_data(). The PCM is then
+ *        queued in the worker instead of pcm_buf.
+ *    worker_status - The last worker write status acted on.
+ *    thread - The audio thread flush_data() is added to as the callback of
+ *        the transport fd.
  */
 struct a2dp_io {
 	struct cras_iodev base;
@@ -65,10 +73,42 @@ struct a2dp_io {
 	struct timespec dev_open_time;
 	bool drain_complete;
 	int filled_zeros_bytes;
+	struct a2dp_worker *worker;
+	int worker_status;
+	struct audio_thread *thread;
 };
 
 static int flush_data(void *arg);
 
+/* Gets the space to write PCM to, in the worker's ring when encoding is
+ * offloaded. */
+static uint8_t *pcm_write_pointer(struct a2dp_io *a2dpio, unsigned int *avail)
+{
+	if (a2dpio->worker)
+		return a2dp_worker_pcm_write_pointer(a2dpio->worker, avail);
+	return buf_write_pointer_size(a2dpio->pcm_buf, avail);
+}
+
+static void pcm_increment_write(struct a2dp_io *a2dpio, unsigned int bytes)
+{
+	if (a2dpio->worker)
+		a2dp_worker_pcm_commit(a2dpio->worker, bytes);
+	else
+		buf_increment_write(a2dpio->pcm_buf, bytes);
+}
+
+/* Gets the number of frames waiting to be sent, as PCM or encoded. */
+static unsigned int local_queued_frames(const struct a2dp_io *a2dpio)
+{
+	unsigned int format_bytes = cras_get_format_bytes(a2dpio->base.format);
+
+	if (a2dpio->worker)
+		return a2dp_worker_encoded_frames(a2dpio->worker) +
+		       a2dp_worker_pcm_queued(a2dpio->worker) / format_bytes;
+	return a2dp_queued_frames(&a2dpio->a2dp) +
+	       buf_queued(a2dpio->pcm_buf) / format_bytes;
+}
+
 static int update_supported_formats(struct cras_iodev *iodev)
 {
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
@@ -136,12 +176,10 @@ static int frames_queued(const struct cras_iodev *iodev,
 {
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 	int estimate_queued_frames = bt_queued_frames(iodev, 0);
-	int local_queued_frames = a2dp_queued_frames(&a2dpio->a2dp) +
-				  buf_queued(a2dpio->pcm_buf) /
-					  cras_get_format_bytes(iodev->format);
+	int local_frames = local_queued_frames(a2dpio);
 	clock_gettime(CLOCK_MONOTONIC_RAW, tstamp);
 	return MIN(iodev->buffer_size,
-		   MAX(estimate_queued_frames, local_queued_frames));
+		   MAX(estimate_queued_frames, local_frames));
 }
 
 static int no_stream(struct cras_iodev *iodev, int enable)
@@ -173,13 +211,12 @@ static int no_stream(struct cras_iodev *iodev, int enable)
 
 		/* Loop twice to make sure target_total_bytes are filled. */
 		for (i = 0; i < 2; i++) {
-			buf = buf_write_pointer_size(a2dpio->pcm_buf,
-						     &buf_avail);
+			buf = pcm_write_pointer(a2dpio, &buf_avail);
 			if (buf_avail == 0 || target_total_bytes == 0)
 				break;
 			target_bytes = MIN(buf_avail, target_total_bytes);
 			memset(buf, 0, target_bytes);
-			buf_increment_write(a2dpio->pcm_buf, target_bytes);
+			pcm_increment_write(a2dpio, target_bytes);
 			bt_queued_frames(iodev, target_bytes / format_bytes);
 			target_total_bytes -= target_bytes;
 		}
@@ -213,10 +250,6 @@ static int configure_dev(struct cras_iodev *iodev)
 	iodev->format->format = SND_PCM_FORMAT_S16_LE;
 	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
 
-	a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
-	if (!a2dpio->pcm_buf)
-		return -ENOMEM;
-
 	iodev->buffer_size = PCM_BUF_MAX_SIZE_FRAMES;
 
 	/* Set up the socket to hold two MTUs full of data before returning
@@ -226,6 +259,11 @@ static int configure_dev(struct cras_iodev *iodev)
 	setsockopt(cras_bt_transport_fd(a2dpio->transport), SOL_SOCKET,
 		   SO_SNDBUF, &sock_depth, sizeof(sock_depth));
 
+	/* Before the socket depth is converted to frames, as it starts from
+	 * the highest bitpool again. */
+	if (cras_system_get_a2dp_adaptive_bitpool())
+		a2dp_enable_adaptive_bitpool(&a2dpio->a2dp);
+
 	optlen = sizeof(sock_depth);
 	getsockopt(cras_bt_transport_fd(a2dpio->transport), SOL_SOCKET,
 		   SO_SNDBUF, &sock_depth, &optlen);
@@ -242,6 +280,26 @@ static int configure_dev(struct cras_iodev *iodev)
 	a2dpio->bt_written_frames = 0;
 	clock_gettime(CLOCK_MONOTONIC_RAW, &a2dpio->dev_open_time);
 
+	/* The worker polls the socket itself, the audio thread only hands
+	 * PCM to it. */
+	a2dpio->worker_status = 0;
+	if (cras_system_get_a2dp_encoder_offload()) {
+		a2dpio->worker = a2dp_worker_create(
+			&a2dpio->a2dp, cras_bt_transport_fd(a2dpio->transport),
+			cras_bt_transport_write_mtu(a2dpio->transport),
+			cras_get_format_bytes(iodev->format),
+			PCM_BUF_MAX_SIZE_BYTES, iodev->min_buffer_level);
+		if (a2dpio->worker)
+			return 0;
+		syslog(LOG_WARNING, "Failed to offload a2dp encoding");
+	}
+
+	a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
+	if (!a2dpio->pcm_buf)
+		return -ENOMEM;
+
+	/* The callback goes to the thread the device is opened on. */
+	a2dpio->thread = iodev->thread;
 	audio_thread_add_write_callback(cras_bt_transport_fd(a2dpio->transport),
 					flush_data, iodev);
 	audio_thread_enable_callback(cras_bt_transport_fd(a2dpio->transport),
@@ -258,10 +316,15 @@ static int close_dev(struct cras_iodev *iodev)
 	if (!a2dpio->transport)
 		return 0;
 
-	/* Remove audio thread callback and sync before releasing
-	 * the transport. */
-	audio_thread_rm_callback_sync(cras_iodev_list_get_audio_thread(),
-				      cras_bt_transport_fd(a2dpio->transport));
+	/* Stop the worker, or remove audio thread callback and sync before
+	 * releasing the transport. */
+	if (a2dpio->worker) {
+		a2dp_worker_destroy(a2dpio->worker);
+		a2dpio->worker = NULL;
+	} else {
+		audio_thread_rm_callback_sync(
+			a2dpio->thread, cras_bt_transport_fd(a2dpio->transport));
+	}
 
 	err = cras_bt_transport_release(a2dpio->transport, !a2dpio->destroyed);
 	if (err < 0)
@@ -270,6 +333,14 @@ static int close_dev(struct cras_iodev *iodev)
 	device = cras_bt_transport_device(a2dpio->transport);
 	if (device)
 		cras_bt_device_cancel_suspend(device);
+
+	if (a2dpio->a2dp.bitpool.enabled) {
+		cras_server_metrics_a2dp_bitpool_decreases(
+			a2dpio->a2dp.bitpool.num_decreases);
+		cras_server_metrics_a2dp_lowest_bitpool(
+			a2dpio->a2dp.bitpool.lowest * 100 /
+			a2dpio->a2dp.bitpool.max);
+	}
 	a2dp_drain(&a2dpio->a2dp);
 	byte_buffer_destroy(&a2dpio->pcm_buf);
 	cras_iodev_free_format(iodev);
@@ -309,7 +380,33 @@ static int pre_fill_socket(struct a2dp_io *a2dpio)
 	return 0;
 }
 
-/* Flushes queued buffer, including pcm and a2dp buffer.
+/* Handles the result of the worker's writes to the a2dp socket the way
+ * flush_data() handles its own. Only changes of the status are passed on to
+ * the bt device.
+ * Returns:
+ *    0 unless the worker failed to write with an error other than EAGAIN.
+ */
+static int check_worker_status(struct a2dp_io *a2dpio,
+			       struct cras_bt_device *device)
+{
+	int status = a2dp_worker_write_status(a2dpio->worker);
+
+	if (status == a2dpio->worker_status)
+		return status == -EAGAIN ? 0 : status;
+	a2dpio->worker_status = status;
+
+	if (status == -EAGAIN) {
+		cras_bt_device_schedule_suspend(device, 5000);
+		return 0;
+	}
+	cras_bt_device_cancel_suspend(device);
+	if (status < 0)
+		cras_bt_device_schedule_suspend(device, 0);
+	return status;
+}
+
+/* Flushes queued buffer, including pcm and a2dp buffer. When encoding is
+ * offloaded the worker does that, only its status is checked here.
  * Returns:
  *    0 when the flush succeeded, -1 when error occurred.
  */
@@ -332,6 +429,9 @@ static int flush_data(void *arg)
 	if (device == NULL)
 		return -EINVAL;
 
+	if (a2dpio->worker)
+		return check_worker_status(a2dpio, device);
+
 encode_more:
 	while (buf_queued(a2dpio->pcm_buf)) {
 		processed = a2dp_encode(
@@ -402,6 +502,8 @@ static int get_buffer(struct cras_iodev *iodev, struct cras_audio_area **area,
 {
 	size_t format_bytes;
 	struct a2dp_io *a2dpio;
+	unsigned int avail;
+	uint8_t *buf;
 
 	a2dpio = (struct a2dp_io *)iodev;
 
@@ -410,10 +512,10 @@ static int get_buffer(struct cras_iodev *iodev, struct cras_audio_area **area,
 	if (iodev->direction != CRAS_STREAM_OUTPUT)
 		return 0;
 
-	*frames = MIN(*frames, buf_writable(a2dpio->pcm_buf) / format_bytes);
+	buf = pcm_write_pointer(a2dpio, &avail);
+	*frames = MIN(*frames, avail / format_bytes);
 	iodev->area->frames = *frames;
-	cras_audio_area_config_buf_pointers(iodev->area, iodev->format,
-					    buf_write_pointer(a2dpio->pcm_buf));
+	cras_audio_area_config_buf_pointers(iodev->area, iodev->format, buf);
 	*area = iodev->area;
 	return 0;
 }
@@ -422,22 +524,34 @@ static int put_buffer(struct cras_iodev *iodev, unsigned nwritten)
 {
 	size_t written_bytes;
 	size_t format_bytes;
+	unsigned int avail;
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 
 	format_bytes = cras_get_format_bytes(iodev->format);
 	written_bytes = nwritten * format_bytes;
 
-	if (written_bytes > buf_writable(a2dpio->pcm_buf))
+	pcm_write_pointer(a2dpio, &avail);
+	if (written_bytes > avail)
 		return -EINVAL;
 
-	buf_increment_write(a2dpio->pcm_buf, written_bytes);
+	/* The worker fills the socket before it encodes the first PCM. */
+	if (a2dpio->worker && !a2dpio->pre_fill_complete)
+		a2dp_worker_pre_fill(a2dpio->worker);
+
+	pcm_increment_write(a2dpio, written_bytes);
 
 	bt_queued_frames(iodev, nwritten);
 
+	if (a2dpio->worker)
+		ATLOG(atlog, AUDIO_THREAD_A2DP_HANDOFF, nwritten,
+		      a2dp_worker_pcm_queued(a2dpio->worker) / format_bytes,
+		      a2dp_worker_encoded_frames(a2dpio->worker));
+
 	/* Until the minimum number of frames have been queued, don't send
 	 * anything. */
 	if (!a2dpio->pre_fill_complete) {
-		pre_fill_socket(a2dpio);
+		if (!a2dpio->worker)
+			pre_fill_socket(a2dpio);
 		a2dpio->pre_fill_complete = 1;
 		/* Start measuring frames_consumed from now. */
 		clock_gettime(CLOCK_MONOTONIC_RAW, &a2dpio->dev_open_time);
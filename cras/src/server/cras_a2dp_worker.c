@@ -0,0 +1,347 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/param.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "cras_a2dp_info.h"
+#include "cras_a2dp_worker.h"
+#include "cras_config.h"
+#include "cras_util.h"
+
+/* The worker runs below the audio thread so it never delays a wake. */
+#define A2DP_WORKER_THREAD_PRIORITY (CRAS_SERVER_RT_THREAD_PRIORITY - 1)
+
+/* The positions below count bytes since the worker was created and wrap
+ * around, a byte's offset in the ring is its position modulo pcm_buf_bytes.
+ *    write_pos - Bytes committed, written by the producer.
+ *    read_pos - Bytes encoded, written by the worker.
+ *    flushed_pos - write_pos when the worker last flushed, only used by the
+ *        worker.
+ *    encoded_frames - a2dp_queued_frames() as of the worker's last encode or
+ *        write.
+ *    write_status - Result of the worker's last write to the socket.
+ *    doorbell_armed - Set by the worker when it found nothing to do, the
+ *        next commit clears it and rings the doorbell.
+ *    pre_fill - Set by the producer to have the socket filled with silence.
+ *    stopping - Set to make the worker thread exit.
+ *    doorbell_fd - Eventfd written to wake the worker.
+ *    bounce - Holds one codesize of PCM that wraps around the end of the ring.
+ * write_pos and read_pos are kept on separate cache lines as each is written
+ * by a different thread.
+ */
+struct a2dp_worker {
+	unsigned int write_pos __attribute__((aligned(64)));
+	unsigned int read_pos __attribute__((aligned(64)));
+	unsigned int flushed_pos;
+	unsigned int encoded_frames;
+	int write_status;
+	int doorbell_armed __attribute__((aligned(64)));
+	int pre_fill;
+	int stopping;
+	int doorbell_fd;
+	struct a2dp_info *a2dp;
+	int stream_fd;
+	size_t link_mtu;
+	unsigned int format_bytes;
+	unsigned int pcm_buf_bytes;
+	unsigned int min_queued_frames;
+	uint8_t *pcm_buf;
+	uint8_t *bounce;
+	unsigned int bounce_bytes;
+	pthread_t tid;
+	int started;
+};
+
+static unsigned int pcm_queued(const struct a2dp_worker *worker)
+{
+	return __atomic_load_n(&worker->write_pos, __ATOMIC_ACQUIRE) -
+	       worker->read_pos;
+}
+
+/* Gets the PCM to encode next. Returns the contiguous part of the ring
+ * unless that is less than a codesize, in which case the PCM wrapping around
+ * the end of the ring is copied to the bounce buffer. */
+static const uint8_t *pcm_read_pointer(struct a2dp_worker *worker,
+				       unsigned int queued, unsigned int *len)
+{
+	unsigned int offset = worker->read_pos & (worker->pcm_buf_bytes - 1);
+	unsigned int contiguous = worker->pcm_buf_bytes - offset;
+	unsigned int head;
+
+	if (queued <= contiguous || contiguous >= worker->bounce_bytes) {
+		*len = MIN(queued, contiguous);
+		return worker->pcm_buf + offset;
+	}
+
+	*len = MIN(queued, worker->bounce_bytes);
+	head = MIN(*len, contiguous);
+	memcpy(worker->bounce, worker->pcm_buf + offset, head);
+	memcpy(worker->bounce + head, worker->pcm_buf, *len - head);
+	return worker->bounce;
+}
+
+static void publish_state(struct a2dp_worker *worker, int write_status)
+{
+	__atomic_store_n(&worker->encoded_frames,
+			 a2dp_queued_frames(worker->a2dp), __ATOMIC_RELAXED);
+	__atomic_store_n(&worker->write_status, write_status, __ATOMIC_RELAXED);
+}
+
+/* Fills the socket with encoded silence, see pre_fill_socket() in
+ * cras_a2dp_iodev.c. */
+static void worker_pre_fill(struct a2dp_worker *worker)
+{
+	static const uint16_t zero_buffer[1024 * 2];
+	int processed;
+	int written;
+
+	while (1) {
+		processed = a2dp_encode(worker->a2dp, zero_buffer,
+					sizeof(zero_buffer),
+					worker->format_bytes, worker->link_mtu);
+		if (processed <= 0)
+			break;
+
+		written = a2dp_write(worker->a2dp, worker->stream_fd,
+				     worker->link_mtu);
+		if (written <= 0)
+			break;
+	}
+
+	a2dp_drain(worker->a2dp);
+}
+
+/* Encodes the committed PCM and sends it, the same way flush_data() in
+ * cras_a2dp_iodev.c does on the audio thread.
+ * Returns:
+ *    0 on success, -EAGAIN when the socket is full, or another negative
+ *    error code if the write failed.
+ */
+static int worker_flush(struct a2dp_worker *worker)
+{
+	const uint8_t *buf;
+	unsigned int queued;
+	unsigned int len;
+	int processed;
+	int written;
+
+	worker->flushed_pos = __atomic_load_n(&worker->write_pos,
+					      __ATOMIC_ACQUIRE);
+
+encode_more:
+	while ((queued = pcm_queued(worker))) {
+		buf = pcm_read_pointer(worker, queued, &len);
+		processed = a2dp_encode(worker->a2dp, buf, len,
+					worker->format_bytes, worker->link_mtu);
+		if (processed == -ENOSPC || processed == 0)
+			break;
+		if (processed < 0)
+			return 0;
+
+		/* Count the frames as encoded before giving their PCM back,
+		 * so the queued frames never appear to drop. */
+		publish_state(worker, worker->write_status);
+		__atomic_store_n(&worker->read_pos, worker->read_pos + processed,
+				 __ATOMIC_RELEASE);
+	}
+
+	written = a2dp_write(worker->a2dp, worker->stream_fd, worker->link_mtu);
+	publish_state(worker, MIN(written, 0));
+	if (written < 0)
+		return written;
+
+	queued = pcm_queued(worker) / worker->format_bytes;
+	if (written && (worker->min_queued_frames + written < queued))
+		goto encode_more;
+
+	return 0;
+}
+
+static int has_work(struct a2dp_worker *worker)
+{
+	return __atomic_load_n(&worker->pre_fill, __ATOMIC_SEQ_CST) ||
+	       __atomic_load_n(&worker->write_pos, __ATOMIC_SEQ_CST) !=
+		       worker->flushed_pos;
+}
+
+static void ack_doorbell(struct a2dp_worker *worker)
+{
+	uint64_t count;
+
+	__atomic_store_n(&worker->doorbell_armed, 0, __ATOMIC_RELAXED);
+	if (read(worker->doorbell_fd, &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN)
+		syslog(LOG_ERR, "Failed to read a2dp doorbell: %d", errno);
+}
+
+static void *a2dp_worker_thread(void *arg)
+{
+	struct a2dp_worker *worker = (struct a2dp_worker *)arg;
+	struct pollfd pollfds[2];
+	int socket_full = 0;
+	int writable = 0;
+	int rc;
+
+	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
+		cras_set_thread_priority(A2DP_WORKER_THREAD_PRIORITY);
+
+	pollfds[0].fd = worker->doorbell_fd;
+	pollfds[0].events = POLLIN;
+	pollfds[1].fd = worker->stream_fd;
+	pollfds[1].events = POLLOUT;
+
+	while (!__atomic_load_n(&worker->stopping, __ATOMIC_ACQUIRE)) {
+		if (!socket_full && (writable || has_work(worker))) {
+			writable = 0;
+			if (__atomic_exchange_n(&worker->pre_fill, 0,
+						__ATOMIC_SEQ_CST))
+				worker_pre_fill(worker);
+			rc = worker_flush(worker);
+			socket_full = (rc == -EAGAIN);
+			continue;
+		}
+
+		/* Arm the doorbell, then check once more for commits that
+		 * raced with it. Pairs with a2dp_worker_pcm_commit(). */
+		__atomic_store_n(&worker->doorbell_armed, 1, __ATOMIC_SEQ_CST);
+		if (!socket_full && has_work(worker))
+			continue;
+
+		rc = poll(pollfds, socket_full ? 2 : 1, -1);
+		if (rc < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "a2dp worker poll failed: %d", errno);
+			break;
+		}
+		if (pollfds[0].revents & POLLIN)
+			ack_doorbell(worker);
+		/* Send what is left once the socket has room again. */
+		if (socket_full && pollfds[1].revents) {
+			socket_full = 0;
+			writable = 1;
+		}
+	}
+	return NULL;
+}
+
+static void ring_doorbell(struct a2dp_worker *worker)
+{
+	uint64_t count = 1;
+
+	if (write(worker->doorbell_fd, &count, sizeof(count)) < 0)
+		syslog(LOG_ERR, "Failed to ring a2dp doorbell: %d", errno);
+}
+
+/* Exported Interface */
+
+struct a2dp_worker *a2dp_worker_create(struct a2dp_info *a2dp, int stream_fd,
+				       size_t link_mtu,
+				       unsigned int format_bytes,
+				       unsigned int pcm_buf_bytes,
+				       unsigned int min_queued_frames)
+{
+	struct a2dp_worker *worker;
+	int rc;
+
+	if (pcm_buf_bytes & (pcm_buf_bytes - 1))
+		return NULL;
+
+	/* Aligned so the positions really sit on separate cache lines. */
+	if (posix_memalign((void **)&worker, 64, sizeof(*worker)))
+		return NULL;
+	memset(worker, 0, sizeof(*worker));
+
+	worker->a2dp = a2dp;
+	worker->stream_fd = stream_fd;
+	worker->link_mtu = link_mtu;
+	worker->format_bytes = format_bytes;
+	worker->pcm_buf_bytes = pcm_buf_bytes;
+	worker->min_queued_frames = min_queued_frames;
+	worker->bounce_bytes = a2dp_codesize(a2dp);
+	worker->doorbell_armed = 1;
+	worker->doorbell_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	worker->pcm_buf = (uint8_t *)malloc(pcm_buf_bytes);
+	worker->bounce = (uint8_t *)malloc(worker->bounce_bytes);
+	if (worker->doorbell_fd < 0 || !worker->pcm_buf || !worker->bounce) {
+		syslog(LOG_ERR, "Failed to allocate a2dp worker");
+		a2dp_worker_destroy(worker);
+		return NULL;
+	}
+
+	rc = pthread_create(&worker->tid, NULL, a2dp_worker_thread, worker);
+	if (rc) {
+		syslog(LOG_ERR, "Failed to create a2dp worker thread: %d", rc);
+		a2dp_worker_destroy(worker);
+		return NULL;
+	}
+	worker->started = 1;
+
+	return worker;
+}
+
+void a2dp_worker_destroy(struct a2dp_worker *worker)
+{
+	if (worker->started) {
+		__atomic_store_n(&worker->stopping, 1, __ATOMIC_RELEASE);
+		ring_doorbell(worker);
+		pthread_join(worker->tid, NULL);
+	}
+	if (worker->doorbell_fd >= 0)
+		close(worker->doorbell_fd);
+	free(worker->pcm_buf);
+	free(worker->bounce);
+	free(worker);
+}
+
+void a2dp_worker_pre_fill(struct a2dp_worker *worker)
+{
+	__atomic_store_n(&worker->pre_fill, 1, __ATOMIC_SEQ_CST);
+}
+
+uint8_t *a2dp_worker_pcm_write_pointer(struct a2dp_worker *worker,
+				       unsigned int *avail)
+{
+	unsigned int offset = worker->write_pos & (worker->pcm_buf_bytes - 1);
+	unsigned int used = worker->write_pos -
+			    __atomic_load_n(&worker->read_pos,
+					    __ATOMIC_ACQUIRE);
+
+	*avail = MIN(worker->pcm_buf_bytes - used,
+		     worker->pcm_buf_bytes - offset);
+	return worker->pcm_buf + offset;
+}
+
+void a2dp_worker_pcm_commit(struct a2dp_worker *worker, unsigned int bytes)
+{
+	/* Publish the PCM, then check whether the worker went idle. */
+	__atomic_store_n(&worker->write_pos, worker->write_pos + bytes,
+			 __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&worker->doorbell_armed, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&worker->doorbell_armed, 0, __ATOMIC_SEQ_CST))
+		ring_doorbell(worker);
+}
+
+unsigned int a2dp_worker_pcm_queued(const struct a2dp_worker *worker)
+{
+	return worker->write_pos -
+	       __atomic_load_n(&worker->read_pos, __ATOMIC_ACQUIRE);
+}
+
+unsigned int a2dp_worker_encoded_frames(const struct a2dp_worker *worker)
+{
+	return __atomic_load_n(&worker->encoded_frames, __ATOMIC_RELAXED);
+}
+
+int a2dp_worker_write_status(const struct a2dp_worker *worker)
+{
+	return __atomic_load_n(&worker->write_status, __ATOMIC_RELAXED);
+}
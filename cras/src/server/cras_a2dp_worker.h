@@ -0,0 +1,81 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_A2DP_WORKER_H_
+#define CRAS_A2DP_WORKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct a2dp_info;
+
+/* Encodes and sends A2DP audio on a thread of its own, so that the SBC
+ * encoder doesn't run inside the audio thread's wake.
+ *
+ * The audio thread is the only producer. It writes PCM straight into a single
+ * producer, single consumer ring and commits it. The worker is the only
+ * consumer, it encodes the ring into the a2dp_info and sends the packets to
+ * the stream socket, polling it for POLLOUT when the socket is full. Like the
+ * command ring, the worker is woken through an eventfd doorbell that is only
+ * rung when it has gone idle.
+ *
+ * All producer functions must be called from the same thread.
+ */
+struct a2dp_worker;
+
+/* Creates a worker and starts its thread. The a2dp_info is owned by the
+ * worker until it is destroyed.
+ * Args:
+ *    a2dp - The codec and encoded state to encode with.
+ *    stream_fd - The socket to send encoded packets to.
+ *    link_mtu - The maximum transmit unit of stream_fd.
+ *    format_bytes - Number of bytes per PCM frame.
+ *    pcm_buf_bytes - Size of the PCM ring, a power of two.
+ *    min_queued_frames - PCM frames to keep in the ring when the audio
+ *        thread's buffer level would otherwise drop too low after sending
+ *        another packet.
+ * Returns:
+ *    A pointer to the worker, or NULL on error.
+ */
+struct a2dp_worker *a2dp_worker_create(struct a2dp_info *a2dp, int stream_fd,
+				       size_t link_mtu,
+				       unsigned int format_bytes,
+				       unsigned int pcm_buf_bytes,
+				       unsigned int min_queued_frames);
+
+/* Stops the worker thread and frees the worker. PCM that is not sent yet is
+ * dropped, the a2dp_info is left as the worker last used it. */
+void a2dp_worker_destroy(struct a2dp_worker *worker);
+
+/* Asks the worker to fill the socket with encoded silence before it sends the
+ * first committed PCM. */
+void a2dp_worker_pre_fill(struct a2dp_worker *worker);
+
+/* Gets the free space in the PCM ring.
+ * Args:
+ *    worker - The worker to write PCM to.
+ *    avail - Filled with the number of contiguous bytes that can be written.
+ * Returns:
+ *    A pointer to write the PCM to.
+ */
+uint8_t *a2dp_worker_pcm_write_pointer(struct a2dp_worker *worker,
+				       unsigned int *avail);
+
+/* Hands bytes written at a2dp_worker_pcm_write_pointer() to the worker and
+ * wakes it if it is idle. */
+void a2dp_worker_pcm_commit(struct a2dp_worker *worker, unsigned int bytes);
+
+/* Gets the number of PCM bytes in the ring that are not encoded yet. */
+unsigned int a2dp_worker_pcm_queued(const struct a2dp_worker *worker);
+
+/* Gets the number of frames encoded but not sent yet. */
+unsigned int a2dp_worker_encoded_frames(const struct a2dp_worker *worker);
+
+/* Gets the result of the worker's last attempt to send to the socket. 0 if it
+ * was sent or there was nothing to send, -EAGAIN while the socket is full,
+ * or another negative error code. */
+int a2dp_worker_write_status(const struct a2dp_worker *worker);
+
+#endif /* CRAS_A2DP_WORKER_H_ */
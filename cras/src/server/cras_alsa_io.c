@@ -127,6 +127,7 @@ struct alsa_input_node {
  * dsp_name_default - the default dsp name for the device. It can be overridden
  *     by the jack specific dsp name.
  * poll_fd - Descriptor used to block until data is ready.
+ * poll_thread - The audio thread the callback of poll_fd is added to.
  * dma_period_set_microsecs - If non-zero, the value to apply to the dma_period.
  * free_running - true if device is playing zeros in the buffer without
  *                user filling meaningful data. The device buffer is filled
@@ -160,6 +161,7 @@ struct alsa_io {
 	snd_pcm_uframes_t mmap_offset;
 	const char *dsp_name_default;
 	int poll_fd;
+	struct audio_thread *poll_thread;
 	unsigned int dma_period_set_microsecs;
 	int free_running;
 	unsigned int filled_zeros_for_draining;
@@ -342,8 +344,7 @@ static int close_dev(struct cras_iodev *iodev)
 
 	/* Removes audio thread callback from main thread. */
 	if (aio->poll_fd >= 0)
-		audio_thread_rm_callback_sync(
-			cras_iodev_list_get_audio_thread(), aio->poll_fd);
+		audio_thread_rm_callback_sync(aio->poll_thread, aio->poll_fd);
 	if (!aio->handle)
 		return 0;
 	cras_alsa_pcm_close(aio->handle);
@@ -456,6 +457,8 @@ static int configure_dev(struct cras_iodev *iodev)
 		}
 		free(ufds);
 
+		/* The callback goes to the thread the device is opened on. */
+		aio->poll_thread = iodev->thread;
 		if (aio->poll_fd >= 0)
 			audio_thread_add_callback(aio->poll_fd,
 						  dummy_hotword_cb, aio);
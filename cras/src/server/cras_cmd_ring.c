@@ -0,0 +1,241 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "cras_cmd_ring.h"
+
+/* A command and the result it was completed with.
+ *    msg - The command as posted, the consumer may write results into it.
+ *    rc - Return code set when the command is completed.
+ *    cb - Callback to run on the producer once completed, NULL for none.
+ */
+struct cmd_slot {
+	uint8_t msg[CRAS_CMD_RING_MSG_SIZE] __attribute__((aligned(8)));
+	int rc;
+	cras_cmd_ring_done_cb cb;
+};
+
+/* The indices below count commands since the ring was created and wrap
+ * around, a command's slot is its index modulo CRAS_CMD_RING_NUM_SLOTS.
+ *    posted - Number of commands posted, written by the producer.
+ *    done - Number of commands completed, written by the consumer.
+ *    reaped - Number of completed commands whose slots the producer has
+ *        released, only used by the producer.
+ *    doorbell_armed - Set by the consumer when it found the ring empty, the
+ *        next post clears it and rings the doorbell.
+ *    producer_waiting - Set by the producer before sleeping on done_fd.
+ *    doorbell_fd - Eventfd written to wake the consumer.
+ *    done_fd - Eventfd written to wake the producer.
+ * posted and done are kept on separate cache lines as each is written by a
+ * different thread.
+ */
+struct cras_cmd_ring {
+	unsigned int posted __attribute__((aligned(64)));
+	unsigned int reaped;
+	unsigned int done __attribute__((aligned(64)));
+	int doorbell_armed __attribute__((aligned(64)));
+	int producer_waiting;
+	int doorbell_fd;
+	int done_fd;
+	struct cmd_slot slots[CRAS_CMD_RING_NUM_SLOTS];
+};
+
+static inline struct cmd_slot *ring_slot(struct cras_cmd_ring *ring,
+					 unsigned int idx)
+{
+	return &ring->slots[idx % CRAS_CMD_RING_NUM_SLOTS];
+}
+
+static inline int is_done(struct cras_cmd_ring *ring, unsigned int target,
+			  int memorder)
+{
+	return (int)(__atomic_load_n(&ring->done, memorder) - target) >= 0;
+}
+
+/* Blocks the producer until at least target commands are completed. The
+ * producer flags itself as waiting before checking one last time, and the
+ * consumer checks the flag after publishing each completion, so one of them
+ * sees the other. */
+static int wait_done(struct cras_cmd_ring *ring, unsigned int target)
+{
+	uint64_t count;
+
+	while (!is_done(ring, target, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_SEQ_CST);
+		if (is_done(ring, target, __ATOMIC_SEQ_CST))
+			break;
+		if (read(ring->done_fd, &count, sizeof(count)) < 0 &&
+		    errno != EINTR) {
+			syslog(LOG_ERR, "Failed to wait for command: %d", errno);
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+/* Reserves a slot, copies the command in and rings the doorbell if needed.
+ * The index of the command is returned in idx. */
+static int post_msg(struct cras_cmd_ring *ring, const void *msg, size_t len,
+		    cras_cmd_ring_done_cb cb, unsigned int *idx)
+{
+	struct cmd_slot *slot;
+	uint64_t count;
+	int rc;
+
+	if (len > CRAS_CMD_RING_MSG_SIZE)
+		return -EINVAL;
+
+	cras_cmd_ring_reap(ring);
+	if (ring->posted - ring->reaped == CRAS_CMD_RING_NUM_SLOTS) {
+		rc = wait_done(ring, ring->reaped + 1);
+		if (rc < 0)
+			return rc;
+		cras_cmd_ring_reap(ring);
+	}
+
+	*idx = ring->posted;
+	slot = ring_slot(ring, *idx);
+	memcpy(slot->msg, msg, len);
+	slot->cb = cb;
+	slot->rc = 0;
+
+	/* Publish the slot, then check whether the consumer went idle. Pairs
+	 * with the empty ring check in cras_cmd_ring_next(). */
+	__atomic_store_n(&ring->posted, *idx + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->doorbell_armed, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&ring->doorbell_armed, 0, __ATOMIC_SEQ_CST)) {
+		count = 1;
+		if (write(ring->doorbell_fd, &count, sizeof(count)) < 0)
+			syslog(LOG_ERR, "Failed to ring doorbell: %d", errno);
+	}
+	return 0;
+}
+
+/* Exported Interface */
+
+struct cras_cmd_ring *cras_cmd_ring_create()
+{
+	struct cras_cmd_ring *ring;
+
+	/* Aligned so the indices really sit on separate cache lines. */
+	if (posix_memalign((void **)&ring, 64, sizeof(*ring)))
+		return NULL;
+	memset(ring, 0, sizeof(*ring));
+
+	ring->doorbell_armed = 1;
+	ring->doorbell_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	ring->done_fd = eventfd(0, EFD_CLOEXEC);
+	if (ring->doorbell_fd < 0 || ring->done_fd < 0) {
+		syslog(LOG_ERR, "Failed to create command ring eventfd");
+		cras_cmd_ring_destroy(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+void cras_cmd_ring_destroy(struct cras_cmd_ring *ring)
+{
+	/* Commands completed since the last reap may own resources their
+	 * callbacks release. */
+	cras_cmd_ring_reap(ring);
+	if (ring->doorbell_fd >= 0)
+		close(ring->doorbell_fd);
+	if (ring->done_fd >= 0)
+		close(ring->done_fd);
+	free(ring);
+}
+
+int cras_cmd_ring_doorbell_fd(const struct cras_cmd_ring *ring)
+{
+	return ring->doorbell_fd;
+}
+
+int cras_cmd_ring_post(struct cras_cmd_ring *ring, const void *msg, size_t len,
+		       cras_cmd_ring_done_cb cb)
+{
+	unsigned int idx;
+
+	return post_msg(ring, msg, len, cb, &idx);
+}
+
+int cras_cmd_ring_call(struct cras_cmd_ring *ring, void *msg, size_t len)
+{
+	struct cmd_slot *slot;
+	unsigned int idx;
+	int rc;
+
+	rc = post_msg(ring, msg, len, NULL, &idx);
+	if (rc < 0)
+		return rc;
+
+	rc = wait_done(ring, idx + 1);
+	if (rc < 0)
+		return rc;
+
+	slot = ring_slot(ring, idx);
+	memcpy(msg, slot->msg, len);
+	rc = slot->rc;
+	cras_cmd_ring_reap(ring);
+	return rc;
+}
+
+void cras_cmd_ring_reap(struct cras_cmd_ring *ring)
+{
+	unsigned int done = __atomic_load_n(&ring->done, __ATOMIC_ACQUIRE);
+	struct cmd_slot *slot;
+
+	while (ring->reaped != done) {
+		slot = ring_slot(ring, ring->reaped);
+		if (slot->cb)
+			slot->cb(slot->msg, slot->rc);
+		ring->reaped++;
+	}
+}
+
+void cras_cmd_ring_ack_doorbell(struct cras_cmd_ring *ring)
+{
+	uint64_t count;
+
+	/* Commands posted while draining don't need to ring again, the
+	 * consumer re-arms and checks once more before it finds the ring
+	 * empty. */
+	__atomic_store_n(&ring->doorbell_armed, 0, __ATOMIC_RELAXED);
+	if (read(ring->doorbell_fd, &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN)
+		syslog(LOG_ERR, "Failed to read doorbell: %d", errno);
+}
+
+void *cras_cmd_ring_next(struct cras_cmd_ring *ring)
+{
+	unsigned int idx = ring->done;
+
+	if (idx == __atomic_load_n(&ring->posted, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&ring->doorbell_armed, 1, __ATOMIC_SEQ_CST);
+		if (idx == __atomic_load_n(&ring->posted, __ATOMIC_SEQ_CST))
+			return NULL;
+	}
+	return ring_slot(ring, idx)->msg;
+}
+
+void cras_cmd_ring_complete(struct cras_cmd_ring *ring, int rc)
+{
+	uint64_t count = 1;
+
+	ring_slot(ring, ring->done)->rc = rc;
+	__atomic_store_n(&ring->done, ring->done + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->producer_waiting, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&ring->producer_waiting, 0, __ATOMIC_SEQ_CST)) {
+		if (write(ring->done_fd, &count, sizeof(count)) < 0)
+			syslog(LOG_ERR, "Failed to signal command done: %d",
+			       errno);
+	}
+}
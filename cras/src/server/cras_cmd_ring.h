@@ -0,0 +1,101 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_CMD_RING_H_
+#define CRAS_CMD_RING_H_
+
+#include <stddef.h>
+
+/* Max size in bytes of a command posted to the ring. */
+#define CRAS_CMD_RING_MSG_SIZE 64
+/* Number of commands that can be in flight at once. */
+#define CRAS_CMD_RING_NUM_SLOTS 64
+
+/* A single producer, single consumer ring of commands, used by the main thread
+ * to send commands to the audio thread without a pipe round trip per command.
+ * The consumer is woken through an eventfd doorbell, which is only written
+ * when the consumer has drained the ring and may be about to sleep, so a burst
+ * of commands costs one wake. Each command is completed with a return code
+ * the producer can either wait for or have handed to a callback later.
+ *
+ * All producer functions must be called from the same thread, as must all
+ * consumer functions.
+ */
+struct cras_cmd_ring;
+
+/* Called on the producer thread once a command posted with
+ * cras_cmd_ring_post() has been completed.
+ * Args:
+ *    msg - The command, including any changes the consumer made to it.
+ *    rc - The return code the consumer completed the command with.
+ */
+typedef void (*cras_cmd_ring_done_cb)(void *msg, int rc);
+
+/* Creates a command ring.
+ * Returns:
+ *    A pointer to the ring, to be freed with cras_cmd_ring_destroy(), or NULL
+ *    on error.
+ */
+struct cras_cmd_ring *cras_cmd_ring_create();
+
+/* Destroys a command ring. The callbacks of completed commands are run
+ * first, commands that were never completed are dropped without running
+ * their callbacks. */
+void cras_cmd_ring_destroy(struct cras_cmd_ring *ring);
+
+/* Gets the fd the consumer polls on, it is readable when commands have been
+ * posted since the consumer last called cras_cmd_ring_next() with an empty
+ * ring. */
+int cras_cmd_ring_doorbell_fd(const struct cras_cmd_ring *ring);
+
+/* Posts a command without waiting for it. Blocks only if the ring is full.
+ * Args:
+ *    ring - The ring to post to.
+ *    msg - The command, copied into the ring.
+ *    len - Size of msg, at most CRAS_CMD_RING_MSG_SIZE.
+ *    cb - Called from a later producer call once the command is completed,
+ *        may be NULL.
+ * Returns:
+ *    0 on success, negative error code on failure.
+ */
+int cras_cmd_ring_post(struct cras_cmd_ring *ring, const void *msg, size_t len,
+		       cras_cmd_ring_done_cb cb);
+
+/* Posts a command and waits for the consumer to complete it.
+ * Args:
+ *    ring - The ring to post to.
+ *    msg - The command. Overwritten with the completed command on return.
+ *    len - Size of msg, at most CRAS_CMD_RING_MSG_SIZE.
+ * Returns:
+ *    The return code the command was completed with, or a negative error code
+ *    if it couldn't be posted or waited for.
+ */
+int cras_cmd_ring_call(struct cras_cmd_ring *ring, void *msg, size_t len);
+
+/* Runs the callbacks of completed commands. Posting does this as well, call
+ * it to get results without posting again. */
+void cras_cmd_ring_reap(struct cras_cmd_ring *ring);
+
+/* Clears the doorbell. Called by the consumer when the doorbell fd is
+ * readable, before taking commands with cras_cmd_ring_next(). */
+void cras_cmd_ring_ack_doorbell(struct cras_cmd_ring *ring);
+
+/* Gets the oldest command not taken by the consumer yet. It must be completed
+ * with cras_cmd_ring_complete() before getting the next one.
+ * Returns:
+ *    A pointer to the command, which stays valid until it is completed, or
+ *    NULL if the ring is empty.
+ */
+void *cras_cmd_ring_next(struct cras_cmd_ring *ring);
+
+/* Completes the command returned by the last cras_cmd_ring_next() call and
+ * wakes the producer if it is waiting on it.
+ * Args:
+ *    ring - The ring the command came from.
+ *    rc - Return code handed to the producer.
+ */
+void cras_cmd_ring_complete(struct cras_cmd_ring *ring, int rc);
+
+#endif /* CRAS_CMD_RING_H_ */
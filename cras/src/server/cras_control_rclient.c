@@ -4,9 +4,11 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
 #include "audio_thread.h"
+#include "audio_thread_latency.h"
 #include "audio_thread_log.h"
 #include "cras_apm_list.h"
 #include "cras_bt_log.h"
@@ -124,8 +126,10 @@ static void dump_audio_thread_info(struct cras_rclient *client)
 
 	cras_fill_client_audio_debug_info_ready(&msg);
 	state = cras_system_state_get_no_lock();
-	audio_thread_dump_thread_info(cras_iodev_list_get_audio_thread(),
-				      &state->audio_debug_info);
+	cras_iodev_list_dump_audio_thread_info(&state->audio_debug_info);
+	if (audio_thread_latency_read(&state->audio_thread_latency))
+		memset(&state->audio_thread_latency, 0,
+		       sizeof(state->audio_thread_latency));
 	client->ops->send_message_to_client(client, &msg.header, NULL, 0);
 }
 
@@ -577,9 +581,8 @@ static int ccr_handle_message_from_client(struct cras_rclient *client,
 					     sizeof(m->coefficient[0]);
 		if (size_with_coefficients != msg->length)
 			return -EINVAL;
-		audio_thread_config_global_remix(
-			cras_iodev_list_get_audio_thread(), m->num_channels,
-			m->coefficient);
+		cras_iodev_list_config_global_remix(m->num_channels,
+						    m->coefficient);
 		break;
 	}
 	case CRAS_SERVER_GET_HOTWORD_MODELS: {
@@ -613,8 +616,7 @@ static int ccr_handle_message_from_client(struct cras_rclient *client,
 			(const struct cras_set_aec_dump *)msg;
 		if (!MSG_LEN_VALID(msg, struct cras_set_aec_dump))
 			return -EINVAL;
-		audio_thread_set_aec_dump(cras_iodev_list_get_audio_thread(),
-					  m->stream_id, m->start, fd);
+		cras_iodev_list_set_aec_dump(m->stream_id, m->start, fd);
 		break;
 	}
 	case CRAS_SERVER_RELOAD_AEC_CONFIG:
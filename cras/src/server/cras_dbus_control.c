@@ -11,10 +11,13 @@
 #include <syslog.h>
 
 #include "audio_thread.h"
+#include "audio_thread_latency.h"
 #include "cras_dbus.h"
 #include "cras_dbus_control.h"
 #include "cras_dbus_util.h"
+#include "cras_dsp.h"
 #include "cras_iodev_list.h"
+#include "cras_latency_hist.h"
 #include "cras_observer.h"
 #include "cras_system_state.h"
 #include "cras_util.h"
@@ -113,6 +116,12 @@
 	"    <method name=\"IsAudioOutputActive\">\n"                           \
 	"      <arg name=\"active\" type=\"b\" direction=\"out\"/>\n"           \
 	"    </method>\n"                                                       \
+	"    <method name=\"GetAudioThreadLatency\">\n"                         \
+	"      <arg name=\"phases\" type=\"a{sv}\" direction=\"out\"/>\n"       \
+	"    </method>\n"                                                       \
+	"    <method name=\"GetDspPluginStats\">\n"                             \
+	"      <arg name=\"plugins\" type=\"a{sv}\" direction=\"out\"/>\n"      \
+	"    </method>\n"                                                       \
 	"    <method name=\"SetWbsEnabled\">\n"                                 \
 	"      <arg name=\"enabled\" type=\"b\" direction=\"in\"/>\n"           \
 	"    </method>\n"                                                       \
@@ -553,6 +562,138 @@ static DBusHandlerResult handle_get_nodes(DBusConnection *conn,
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* Appends the durations counted in the histogram of a phase of the audio
+ * thread. Returns false if not enough memory. */
+static dbus_bool_t
+append_latency_dict(DBusMessageIter *iter,
+		    enum AUDIO_THREAD_LATENCY_PHASE phase,
+		    const struct audio_thread_latency_hist *hist)
+{
+	DBusMessageIter dict;
+	const char *name = audio_thread_latency_phase_name(phase);
+	dbus_uint64_t count = hist->count;
+	dbus_uint64_t p50 = latency_hist_quantile(hist, 0.5) / 1000;
+	dbus_uint64_t p90 = latency_hist_quantile(hist, 0.9) / 1000;
+	dbus_uint64_t p99 = latency_hist_quantile(hist, 0.99) / 1000;
+	dbus_uint64_t max = hist->max_ns / 1000;
+
+	if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}",
+					      &dict))
+		return FALSE;
+	if (!append_key_value(&dict, "Phase", DBUS_TYPE_STRING,
+			      DBUS_TYPE_STRING_AS_STRING, &name))
+		return FALSE;
+	if (!append_key_value(&dict, "Count", DBUS_TYPE_UINT64,
+			      DBUS_TYPE_UINT64_AS_STRING, &count))
+		return FALSE;
+	if (!append_key_value(&dict, "P50Usec", DBUS_TYPE_UINT64,
+			      DBUS_TYPE_UINT64_AS_STRING, &p50))
+		return FALSE;
+	if (!append_key_value(&dict, "P90Usec", DBUS_TYPE_UINT64,
+			      DBUS_TYPE_UINT64_AS_STRING, &p90))
+		return FALSE;
+	if (!append_key_value(&dict, "P99Usec", DBUS_TYPE_UINT64,
+			      DBUS_TYPE_UINT64_AS_STRING, &p99))
+		return FALSE;
+	if (!append_key_value(&dict, "MaxUsec", DBUS_TYPE_UINT64,
+			      DBUS_TYPE_UINT64_AS_STRING, &max))
+		return FALSE;
+	if (!dbus_message_iter_close_container(iter, &dict))
+		return FALSE;
+
+	return TRUE;
+}
+
+static DBusHandlerResult handle_get_audio_thread_latency(DBusConnection *conn,
+							 DBusMessage *message,
+							 void *arg)
+{
+	struct audio_thread_latency_stats stats;
+	DBusMessage *reply;
+	DBusMessageIter array;
+	dbus_uint32_t serial = 0;
+	unsigned int i;
+
+	if (audio_thread_latency_read(&stats))
+		memset(&stats, 0, sizeof(stats));
+
+	reply = dbus_message_new_method_return(message);
+	dbus_message_iter_init_append(reply, &array);
+	for (i = 0; i < AUDIO_THREAD_LATENCY_NUM_PHASES; i++) {
+		if (!append_latency_dict(&array, i, &stats.hists[i]))
+			return DBUS_HANDLER_RESULT_NEED_MEMORY;
+	}
+	dbus_connection_send(conn, reply, &serial);
+	dbus_message_unref(reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Appends the time counted for an instance of a dsp pipeline, called by
+ * cras_dsp_foreach_instance_statistic(). Returns non-zero if not enough
+ * memory. */
+static int append_dsp_plugin_dict(const char *purpose, int sample_rate,
+				  const struct dsp_instance_statistic *stat,
+				  void *arg)
+{
+	DBusMessageIter *iter = (DBusMessageIter *)arg;
+	DBusMessageIter dict;
+	const char *title = stat->title;
+	double ns_per_frame = 0;
+	double cpu_load;
+	dbus_bool_t optional = stat->optional;
+	dbus_bool_t bypassed = stat->bypassed;
+
+	if (stat->total_frames)
+		ns_per_frame = (double)stat->total_time / stat->total_frames;
+	cpu_load = ns_per_frame * sample_rate / 1e9 * 100;
+
+	if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}",
+					      &dict))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "Purpose", DBUS_TYPE_STRING,
+			      DBUS_TYPE_STRING_AS_STRING, &purpose))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "Plugin", DBUS_TYPE_STRING,
+			      DBUS_TYPE_STRING_AS_STRING, &title))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "NsecPerFrame", DBUS_TYPE_DOUBLE,
+			      DBUS_TYPE_DOUBLE_AS_STRING, &ns_per_frame))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "CpuLoad", DBUS_TYPE_DOUBLE,
+			      DBUS_TYPE_DOUBLE_AS_STRING, &cpu_load))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "Optional", DBUS_TYPE_BOOLEAN,
+			      DBUS_TYPE_BOOLEAN_AS_STRING, &optional))
+		return -ENOMEM;
+	if (!append_key_value(&dict, "Bypassed", DBUS_TYPE_BOOLEAN,
+			      DBUS_TYPE_BOOLEAN_AS_STRING, &bypassed))
+		return -ENOMEM;
+	if (!dbus_message_iter_close_container(iter, &dict))
+		return -ENOMEM;
+
+	return 0;
+}
+
+static DBusHandlerResult handle_get_dsp_plugin_stats(DBusConnection *conn,
+						     DBusMessage *message,
+						     void *arg)
+{
+	DBusMessage *reply;
+	DBusMessageIter array;
+	dbus_uint32_t serial = 0;
+
+	reply = dbus_message_new_method_return(message);
+	dbus_message_iter_init_append(reply, &array);
+	if (cras_dsp_foreach_instance_statistic(append_dsp_plugin_dict,
+						&array))
+		return DBUS_HANDLER_RESULT_NEED_MEMORY;
+	dbus_connection_send(conn, reply, &serial);
+	dbus_message_unref(reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 static DBusHandlerResult handle_get_system_aec_supported(DBusConnection *conn,
 							 DBusMessage *message,
 							 void *arg)
@@ -721,8 +862,7 @@ handle_set_global_output_channel_remix(DBusConnection *conn,
 	for (i = 0; i < count; i++)
 		coefficient[i] = coeff_array[i];
 
-	audio_thread_config_global_remix(cras_iodev_list_get_audio_thread(),
-					 num_channels, coefficient);
+	cras_iodev_list_config_global_remix(num_channels, coefficient);
 
 	send_empty_reply(conn, message);
 	free(coefficient);
@@ -897,6 +1037,12 @@ static DBusHandlerResult handle_control_message(DBusConnection *conn,
 	} else if (dbus_message_is_method_call(message, CRAS_CONTROL_INTERFACE,
 					       "IsAudioOutputActive")) {
 		return handle_is_audio_active(conn, message, arg);
+	} else if (dbus_message_is_method_call(message, CRAS_CONTROL_INTERFACE,
+					       "GetAudioThreadLatency")) {
+		return handle_get_audio_thread_latency(conn, message, arg);
+	} else if (dbus_message_is_method_call(message, CRAS_CONTROL_INTERFACE,
+					       "GetDspPluginStats")) {
+		return handle_get_dsp_plugin_stats(conn, message, arg);
 	} else if (dbus_message_is_method_call(message, CRAS_CONTROL_INTERFACE,
 					       "SetWbsEnabled")) {
 		return handle_set_wbs_enabled(conn, message, arg);
@@ -3,15 +3,26 @@
  * found in the LICENSE file.
  */
 
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/param.h>
 #include <syslog.h>
+#include "array.h"
 #include "dumper.h"
+#include "cras_dsp.h"
 #include "cras_expr.h"
 #include "cras_dsp_ini.h"
 #include "cras_dsp_pipeline.h"
+#include "cras_main_message.h"
 #include "dsp_util.h"
 #include "utlist.h"
 
+/* The number of frames crossfaded at a time. */
+#define DSP_FADE_BLOCK 256
+
+DECLARE_ARRAY_TYPE(struct pipeline *, pipeline_array);
+
 /* We have a dsp_context for each pipeline. The context records the
  * parameters used to create a pipeline, so the pipeline can be
  * (re-)loaded later. The pipeline is (re-)loaded in the following
@@ -20,13 +31,49 @@
  * (1) The client asks to (re-)load it with cras_load_pipeline().
  * (2) The client asks to reload the ini with cras_reload_ini().
  *
- * The pipeline is (re-)loaded asynchronously in an internal thread,
- * so the client needs to use cras_dsp_get_pipeline() and
- * cras_dsp_put_pipeline() to safely access the pipeline.
+ * A new pipeline is prepared on the main thread and then published by
+ * swapping the pipeline pointer, so the audio thread never waits for a
+ * (re-)load. The client uses cras_dsp_get_pipeline() and
+ * cras_dsp_put_pipeline() around each access, which only count the
+ * readers. A replaced pipeline is kept on the retired list until no
+ * reader can hold it anymore, then freed on the main thread.
+ *
+ * A reader increments readers and then loads pipeline, the main thread
+ * stores pipeline and then loads readers. All four are sequentially
+ * consistent, so at least one side sees the other: either the main thread
+ * sees the reader and keeps what it retired, or the reader loads the new
+ * pipeline. A release or acquire alone would let each side miss the other
+ * and a retired pipeline be freed while the reader runs it. Readers
+ * decrement readers in the same order once done, after storing what they
+ * still use in active and fading.
+ *
+ * When the audio thread sees a new pipeline in cras_dsp_apply() or
+ * cras_dsp_apply_float(), it keeps running the old one for fade_frames
+ * and crossfades their outputs, so a reload doesn't click.
  */
 struct cras_dsp_context {
+	/* Serializes the main thread's changes to the context. */
 	pthread_mutex_t mutex;
+	/* The latest pipeline, swapped atomically by the main thread. */
 	struct pipeline *pipeline;
+	/* Replaced pipelines not freed yet. Main thread only. */
+	pipeline_array retired;
+	/* The number of callers between cras_dsp_get_pipeline() and
+	 * cras_dsp_put_pipeline(). */
+	int readers;
+	/* Set while the main thread changes the pipeline in place. */
+	int blocked;
+	/* The pipeline the audio thread ran last, and the one it is fading
+	 * out. Written by the audio thread, read by the main thread. */
+	struct pipeline *active;
+	struct pipeline *fading;
+	/* The length of a crossfade, and how far the current one is. */
+	unsigned int fade_frames;
+	unsigned int fade_pos;
+	/* The samples run through the old pipeline during a fade, and the
+	 * samples of the new one when they need converting to float. */
+	float fade_old[CRAS_CH_MAX * DSP_FADE_BLOCK];
+	float fade_cur[CRAS_CH_MAX * DSP_FADE_BLOCK];
 
 	struct cras_expr_env env;
 	int sample_rate;
@@ -96,6 +143,7 @@ static struct pipeline *prepare_pipeline(struct cras_dsp_context *ctx,
 		goto bail;
 	}
 
+	cras_dsp_pipeline_set_tile_frames(pipeline, DSP_TILE_FRAMES);
 	return pipeline;
 
 bail:
@@ -104,6 +152,32 @@ bail:
 	return NULL;
 }
 
+/* Frees the retired pipelines of ctx the audio thread can't be using.
+ * Called on the main thread with ctx->mutex held. */
+static void reclaim_pipelines(struct cras_dsp_context *ctx)
+{
+	struct pipeline *active, *fading, *pipeline;
+	int i;
+
+	/* A reader may have loaded any pipeline published so far. Once
+	 * there is none, the audio thread only refers to the pipelines it
+	 * stored in active and fading. */
+	if (__atomic_load_n(&ctx->readers, __ATOMIC_SEQ_CST))
+		return;
+	active = __atomic_load_n(&ctx->active, __ATOMIC_ACQUIRE);
+	fading = __atomic_load_n(&ctx->fading, __ATOMIC_ACQUIRE);
+
+	for (i = ARRAY_COUNT(&ctx->retired) - 1; i >= 0; i--) {
+		pipeline = *ARRAY_ELEMENT(&ctx->retired, i);
+		if (pipeline == active || pipeline == fading)
+			continue;
+		destroy_pipeline(pipeline);
+		*ARRAY_ELEMENT(&ctx->retired, i) = *ARRAY_ELEMENT(
+			&ctx->retired, ARRAY_COUNT(&ctx->retired) - 1);
+		ctx->retired.count--;
+	}
+}
+
 static void cmd_load_pipeline(struct cras_dsp_context *ctx,
 			      struct ini *target_ini)
 {
@@ -111,14 +185,41 @@ static void cmd_load_pipeline(struct cras_dsp_context *ctx,
 
 	pipeline = target_ini ? prepare_pipeline(ctx, target_ini) : NULL;
 
-	/* This locking is short to avoild blocking audio thread. */
+	/* The audio thread doesn't take the lock, it picks up the new
+	 * pipeline on its next access. */
 	pthread_mutex_lock(&ctx->mutex);
 	old_pipeline = ctx->pipeline;
-	ctx->pipeline = pipeline;
+	__atomic_store_n(&ctx->pipeline, pipeline, __ATOMIC_SEQ_CST);
+	if (old_pipeline)
+		ARRAY_APPEND(&ctx->retired, old_pipeline);
+	reclaim_pipelines(ctx);
 	pthread_mutex_unlock(&ctx->mutex);
+}
 
-	if (old_pipeline)
-		destroy_pipeline(old_pipeline);
+/* Called on the main thread when the audio thread stops using a pipeline. */
+static void handle_dsp_message(struct cras_main_message *msg, void *arg)
+{
+	struct cras_dsp_context *ctx;
+
+	DL_FOREACH (context_list, ctx) {
+		pthread_mutex_lock(&ctx->mutex);
+		reclaim_pipelines(ctx);
+		pthread_mutex_unlock(&ctx->mutex);
+	}
+}
+
+/* Tells the main thread a pipeline may be freed. Called on the audio
+ * thread. */
+static void send_retired_msg()
+{
+	struct cras_main_message msg;
+	int rc;
+
+	msg.type = CRAS_MAIN_DSP;
+	msg.length = sizeof(msg);
+	rc = cras_main_message_send(&msg);
+	if (rc < 0)
+		syslog(LOG_ERR, "Failed to send dsp message");
 }
 
 static void cmd_reload_ini()
@@ -147,6 +248,7 @@ void cras_dsp_init(const char *filename)
 	dsp_enable_flush_denormal_to_zero();
 	ini_filename = strdup(filename);
 	syslog_dumper = syslog_dumper_create(LOG_ERR);
+	cras_main_message_add_handler(CRAS_MAIN_DSP, handle_dsp_message, NULL);
 	cmd_reload_ini();
 }
 
@@ -169,6 +271,7 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 	initialize_environment(&ctx->env);
 	ctx->sample_rate = sample_rate;
 	ctx->purpose = strdup(purpose);
+	ctx->fade_frames = sample_rate / 100;
 
 	DL_APPEND(context_list, ctx);
 	return ctx;
@@ -176,9 +279,15 @@ struct cras_dsp_context *cras_dsp_context_new(int sample_rate,
 
 void cras_dsp_context_free(struct cras_dsp_context *ctx)
 {
+	struct pipeline **pipeline;
+	int i;
+
 	DL_DELETE(context_list, ctx);
 
 	pthread_mutex_destroy(&ctx->mutex);
+	ARRAY_ELEMENT_FOREACH (&ctx->retired, i, pipeline)
+		destroy_pipeline(*pipeline);
+	ARRAY_FREE(&ctx->retired);
 	if (ctx->pipeline) {
 		destroy_pipeline(ctx->pipeline);
 		ctx->pipeline = NULL;
@@ -202,6 +311,11 @@ void cras_dsp_set_variable_boolean(struct cras_dsp_context *ctx,
 
 void cras_dsp_load_pipeline(struct cras_dsp_context *ctx)
 {
+	/* The variables change on every node switch, but the pipeline only
+	 * needs creating again if the plugins read the ones that changed. */
+	if (ctx->pipeline && cras_dsp_pipeline_get_ini(ctx->pipeline) == ini &&
+	    !cras_dsp_pipeline_is_stale(ctx->pipeline, &ctx->env))
+		return;
 	cmd_load_pipeline(ctx, ini);
 }
 
@@ -216,21 +330,230 @@ void cras_dsp_load_dummy_pipeline(struct cras_dsp_context *ctx,
 		cmd_load_pipeline(ctx, dummy_ini);
 }
 
+void cras_dsp_set_fade_frames(struct cras_dsp_context *ctx,
+			      unsigned int frames)
+{
+	__atomic_store_n(&ctx->fade_frames, frames, __ATOMIC_RELAXED);
+}
+
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx)
+{
+	struct pipeline *pipeline;
+
+	__atomic_add_fetch(&ctx->readers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ctx->blocked, __ATOMIC_SEQ_CST)) {
+		/* The main thread is changing the pipeline. Skip the DSP
+		 * rather than have the audio thread wait for it. */
+		__atomic_sub_fetch(&ctx->readers, 1, __ATOMIC_SEQ_CST);
+		return NULL;
+	}
+
+	pipeline = __atomic_load_n(&ctx->pipeline, __ATOMIC_SEQ_CST);
+	if (!pipeline)
+		cras_dsp_put_pipeline(ctx);
+	return pipeline;
+}
+
+void cras_dsp_put_pipeline(struct cras_dsp_context *ctx)
+{
+	__atomic_sub_fetch(&ctx->readers, 1, __ATOMIC_SEQ_CST);
+}
+
+struct pipeline *cras_dsp_lock_pipeline(struct cras_dsp_context *ctx)
 {
 	pthread_mutex_lock(&ctx->mutex);
+	__atomic_store_n(&ctx->blocked, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&ctx->readers, __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	/* Cut a fade short, the old pipeline mustn't run what is about to
+	 * change. */
+	__atomic_store_n(&ctx->fading, NULL, __ATOMIC_RELEASE);
+
 	if (!ctx->pipeline) {
-		pthread_mutex_unlock(&ctx->mutex);
+		cras_dsp_unlock_pipeline(ctx);
 		return NULL;
 	}
 	return ctx->pipeline;
 }
 
-void cras_dsp_put_pipeline(struct cras_dsp_context *ctx)
+void cras_dsp_unlock_pipeline(struct cras_dsp_context *ctx)
 {
+	reclaim_pipelines(ctx);
+	__atomic_store_n(&ctx->blocked, 0, __ATOMIC_RELEASE);
 	pthread_mutex_unlock(&ctx->mutex);
 }
 
+/* Returns non-zero if the output of pipeline a can be crossfaded into the
+ * output of pipeline b. */
+static int can_fade(struct pipeline *a, struct pipeline *b)
+{
+	int channels = cras_dsp_pipeline_get_num_input_channels(a);
+
+	return channels <= CRAS_CH_MAX &&
+	       cras_dsp_pipeline_get_num_output_channels(a) == channels &&
+	       cras_dsp_pipeline_get_num_input_channels(b) == channels &&
+	       cras_dsp_pipeline_get_num_output_channels(b) == channels;
+}
+
+/* Picks up a newly loaded pipeline, and starts fading out the one run
+ * before it. Called on the audio thread between cras_dsp_get_pipeline()
+ * and cras_dsp_put_pipeline(). */
+static struct pipeline *switch_pipeline(struct cras_dsp_context *ctx)
+{
+	struct pipeline *pipeline, *old;
+	int dropped = 0;
+
+	pipeline = __atomic_load_n(&ctx->pipeline, __ATOMIC_SEQ_CST);
+	old = ctx->active;
+	if (pipeline == old)
+		return pipeline;
+
+	/* A fade still going on is cut short by another reload. */
+	if (ctx->fading)
+		dropped = 1;
+	if (old && pipeline &&
+	    __atomic_load_n(&ctx->fade_frames, __ATOMIC_RELAXED) &&
+	    can_fade(old, pipeline)) {
+		ctx->fading = old;
+		ctx->fade_pos = 0;
+	} else {
+		ctx->fading = NULL;
+		dropped |= !!old;
+	}
+	__atomic_store_n(&ctx->active, pipeline, __ATOMIC_RELEASE);
+
+	if (dropped)
+		send_retired_msg();
+	return pipeline;
+}
+
+/* Mixes n frames of the old pipeline's output in old into the new one's in
+ * cur, with a linear ramp across the fade. */
+static void crossfade(struct cras_dsp_context *ctx, float *const *old,
+		      float *const *cur, int channels, unsigned int n)
+{
+	unsigned int frames = __atomic_load_n(&ctx->fade_frames,
+					     __ATOMIC_RELAXED);
+	unsigned int len = 0;
+	float gain;
+	unsigned int i;
+	int c;
+
+	if (ctx->fade_pos < frames)
+		len = MIN(n, frames - ctx->fade_pos);
+	for (c = 0; c < channels; c++) {
+		for (i = 0; i < len; i++) {
+			gain = (float)(ctx->fade_pos + i) / frames;
+			cur[c][i] = old[c][i] + (cur[c][i] - old[c][i]) * gain;
+		}
+	}
+
+	ctx->fade_pos += n;
+	if (ctx->fade_pos >= frames) {
+		__atomic_store_n(&ctx->fading, NULL, __ATOMIC_RELEASE);
+		send_retired_msg();
+	}
+}
+
+/* Points planes at the channels of a fade buffer. */
+static void fade_planes(float *buf, float **planes)
+{
+	int c;
+
+	for (c = 0; c < CRAS_CH_MAX; c++)
+		planes[c] = buf + c * DSP_FADE_BLOCK;
+}
+
+int cras_dsp_apply(struct cras_dsp_context *ctx, uint8_t *buf,
+		   snd_pcm_format_t format, unsigned int frames)
+{
+	struct pipeline *pipeline = switch_pipeline(ctx);
+	float *old[CRAS_CH_MAX], *cur[CRAS_CH_MAX];
+	int channels;
+	size_t frame_bytes;
+	unsigned int n;
+	int rc;
+
+	if (!pipeline)
+		return 0;
+
+	channels = cras_dsp_pipeline_get_num_input_channels(pipeline);
+	frame_bytes = channels * PCM_FORMAT_WIDTH(format) / 8;
+	fade_planes(ctx->fade_old, old);
+	fade_planes(ctx->fade_cur, cur);
+
+	while (frames && ctx->fading) {
+		n = MIN(frames, DSP_FADE_BLOCK);
+
+		rc = dsp_util_deinterleave(buf, old, channels, format, n);
+		if (rc)
+			return rc;
+		rc = cras_dsp_pipeline_apply_float(ctx->fading, old, channels,
+						   n);
+		if (rc)
+			return rc;
+		rc = cras_dsp_pipeline_apply(pipeline, buf, format, n);
+		if (rc)
+			return rc;
+		rc = dsp_util_deinterleave(buf, cur, channels, format, n);
+		if (rc)
+			return rc;
+		crossfade(ctx, old, cur, channels, n);
+		rc = dsp_util_interleave(cur, buf, channels, format, n);
+		if (rc)
+			return rc;
+
+		buf += n * frame_bytes;
+		frames -= n;
+	}
+
+	return cras_dsp_pipeline_apply(pipeline, buf, format, frames);
+}
+
+int cras_dsp_apply_float(struct cras_dsp_context *ctx, float *const *bufs,
+			 unsigned int num_channels, unsigned int frames)
+{
+	struct pipeline *pipeline = switch_pipeline(ctx);
+	float *old[CRAS_CH_MAX];
+	float *cur[num_channels];
+	unsigned int done = 0;
+	unsigned int n, c;
+	int channels;
+	int rc;
+
+	if (!pipeline)
+		return 0;
+
+	channels = cras_dsp_pipeline_get_num_input_channels(pipeline);
+	if (ctx->fading && channels > num_channels)
+		return -EINVAL;
+	fade_planes(ctx->fade_old, old);
+
+	while (done < frames && ctx->fading) {
+		n = MIN(frames - done, DSP_FADE_BLOCK);
+
+		for (c = 0; c < channels; c++) {
+			cur[c] = bufs[c] + done;
+			memcpy(old[c], cur[c], n * sizeof(float));
+		}
+		rc = cras_dsp_pipeline_apply_float(ctx->fading, old, channels,
+						   n);
+		if (rc)
+			return rc;
+		rc = cras_dsp_pipeline_apply_float(pipeline, cur, channels, n);
+		if (rc)
+			return rc;
+		crossfade(ctx, old, cur, channels, n);
+		done += n;
+	}
+
+	for (c = 0; c < num_channels; c++)
+		cur[c] = bufs[c] + done;
+	return cras_dsp_pipeline_apply_float(pipeline, cur, num_channels,
+					     frames - done);
+}
+
 void cras_dsp_reload_ini()
 {
 	cmd_reload_ini();
@@ -245,12 +568,40 @@ void cras_dsp_dump_info()
 		cras_dsp_ini_dump(syslog_dumper, ini);
 	DL_FOREACH (context_list, ctx) {
 		cras_expr_env_dump(syslog_dumper, &ctx->env);
-		pipeline = ctx->pipeline;
+		pipeline = __atomic_load_n(&ctx->pipeline, __ATOMIC_ACQUIRE);
 		if (pipeline)
 			cras_dsp_pipeline_dump(syslog_dumper, pipeline);
 	}
 }
 
+int cras_dsp_foreach_instance_statistic(cras_dsp_instance_statistic_cb cb,
+					void *arg)
+{
+	struct dsp_instance_statistic stat;
+	struct pipeline *pipeline;
+	struct cras_dsp_context *ctx;
+	int i, n, rc;
+
+	/* Pipelines are only freed on the main thread, so the current one
+	 * of each context stays valid while we read it. */
+	DL_FOREACH (context_list, ctx) {
+		pipeline = __atomic_load_n(&ctx->pipeline, __ATOMIC_ACQUIRE);
+		if (!pipeline)
+			continue;
+		n = cras_dsp_pipeline_get_num_instances(pipeline);
+		for (i = 0; i < n; i++) {
+			cras_dsp_pipeline_get_instance_statistic(pipeline, i,
+								 &stat);
+			rc = cb(ctx->purpose,
+				cras_dsp_pipeline_get_sample_rate(pipeline),
+				&stat, arg);
+			if (rc)
+				return rc;
+		}
+	}
+	return 0;
+}
+
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx)
 {
 	return cras_dsp_pipeline_get_num_output_channels(ctx->pipeline);
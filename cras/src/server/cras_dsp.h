@@ -51,7 +51,8 @@ void cras_dsp_set_variable_boolean(struct cras_dsp_context *ctx,
 /* Loads the pipeline to the context. This should be called again when
  * new values of configuration variables may change the plugin
  * graph. The actual loading happens in another thread to avoid
- * blocking the audio thread. */
+ * blocking the audio thread. The loaded pipeline is kept if none of the
+ * variables the disable expressions read has changed. */
 void cras_dsp_load_pipeline(struct cras_dsp_context *ctx);
 
 /* Loads a dummy pipeline of source directly connects to sink, of given
@@ -60,22 +61,77 @@ void cras_dsp_load_pipeline(struct cras_dsp_context *ctx);
 void cras_dsp_load_dummy_pipeline(struct cras_dsp_context *ctx,
 				  unsigned int num_channels);
 
-/* Locks the pipeline in the context for access. Returns NULL if the
- * pipeline is still being loaded or cannot be loaded. */
+/* Sets the number of frames over which the output of a replaced pipeline
+ * is crossfaded into the output of the new one. 0 switches at once. The
+ * default is 10ms worth of frames. */
+void cras_dsp_set_fade_frames(struct cras_dsp_context *ctx,
+			      unsigned int frames);
+
+/* Gets the pipeline in the context for access. Returns NULL if the
+ * pipeline is still being loaded, cannot be loaded, or is locked by
+ * cras_dsp_lock_pipeline(), the caller then skips the DSP. This never
+ * blocks, a (re-)load swaps in the new pipeline while the old one is kept
+ * alive until every reader has put it back. */
 struct pipeline *cras_dsp_get_pipeline(struct cras_dsp_context *ctx);
 
 /* Releases the pipeline in the context. This must be called in pair
  * with cras_dsp_get_pipeline() once the client finishes using the
- * pipeline. This should be called in the same thread as
- * cras_dsp_get_pipeline() was called. */
+ * pipeline, if it returned non-NULL. */
 void cras_dsp_put_pipeline(struct cras_dsp_context *ctx);
 
+/* Gets exclusive access to the pipeline in the context, to change it in
+ * place. Waits for all readers to put the pipeline back, and makes
+ * cras_dsp_get_pipeline() return NULL until cras_dsp_unlock_pipeline().
+ * Called on the main thread only. Returns NULL, without holding the lock,
+ * if there is no pipeline. */
+struct pipeline *cras_dsp_lock_pipeline(struct cras_dsp_context *ctx);
+
+/* Releases the pipeline locked by cras_dsp_lock_pipeline(). */
+void cras_dsp_unlock_pipeline(struct cras_dsp_context *ctx);
+
+/* Runs the pipeline across the given interleaved buffer in place, see
+ * cras_dsp_pipeline_apply(). Called on the audio thread between
+ * cras_dsp_get_pipeline() and cras_dsp_put_pipeline(). If the pipeline
+ * has been reloaded since the last call, the old pipeline keeps running
+ * and its output is crossfaded into the new one.
+ * Returns:
+ *    Negative code if error, otherwise 0.
+ */
+int cras_dsp_apply(struct cras_dsp_context *ctx, uint8_t *buf,
+		   snd_pcm_format_t format, unsigned int frames);
+
+/* Same as cras_dsp_apply(), on planar float buffers, see
+ * cras_dsp_pipeline_apply_float(). */
+int cras_dsp_apply_float(struct cras_dsp_context *ctx, float *const *bufs,
+			 unsigned int num_channels, unsigned int frames);
+
 /* Re-reads the ini file and reloads all pipelines in the system. */
 void cras_dsp_reload_ini();
 
 /* Dump current dsp information to syslog. */
 void cras_dsp_dump_info();
 
+/* Called for each instance of the pipelines in the system.
+ * Args:
+ *    purpose - The purpose of the pipeline, "playback" or "capture".
+ *    sample_rate - The sampling rate the pipeline runs at.
+ *    stat - The time counted for the instance.
+ *    arg - The argument passed to cras_dsp_foreach_instance_statistic().
+ * Returns:
+ *    0 to go on to the next instance, non-zero to stop.
+ */
+typedef int (*cras_dsp_instance_statistic_cb)(
+	const char *purpose, int sample_rate,
+	const struct dsp_instance_statistic *stat, void *arg);
+
+/* Calls cb for each instance of the pipelines in the system. Called on
+ * the main thread only.
+ * Returns:
+ *    The last value returned by cb, or 0 if there is no instance.
+ */
+int cras_dsp_foreach_instance_statistic(cras_dsp_instance_statistic_cb cb,
+					void *arg);
+
 /* Number of channels output. */
 unsigned int cras_dsp_num_output_channels(const struct cras_dsp_context *ctx);
 
@@ -32,6 +32,25 @@
 - Each plugin can have an optional "disable expression", which defines
   under which conditions the plugin is disabled.
 
+- Each plugin can have an optional "file" attribute, the path of a data
+  file the plugin needs, like the impulse response of the built-in "fir"
+  plugin.
+
+- The built-in source plugin can have a "cpu_budget" attribute, the
+  share of the CPU time the pipeline may use, in percent of the duration
+  of the audio it processes. When a block of audio takes longer than
+  that, the plugins with the "optional=1" attribute are bypassed until
+  the pipeline is expected to fit again. Only plugins with as many audio
+  outputs as inputs and no delay can be bypassed; their inputs are then
+  copied to their outputs.
+
+- The built-in source plugin can have a "fixed_point=1" attribute, to run
+  the pipeline on Q28 fixed point samples instead of floats, for cores
+  with slow floating point. Q28 leaves 18dB of headroom above full scale
+  between the plugins, the samples only saturate at the output. It is only used if every plugin in the
+  pipeline supports it: the built-in "eq2", "dcblock", "swap_lr",
+  "invert_lr", "mix_stereo", source and sink plugins do.
+
 - Each plugin have some ports which specify the parameters for the
   plugin or to specify connections to other plugins. The ports in each
   plugin are numbered from 0. Each port is either an input port or an
@@ -68,6 +87,19 @@ static const char *getstring(struct ini *ini, const char *sec_name,
 	return iniparser_getstring(ini->dict, full_key, NULL);
 }
 
+static int getboolean(struct ini *ini, const char *sec_name, const char *key)
+{
+	char full_key[MAX_INI_KEY_LENGTH];
+	snprintf(full_key, sizeof(full_key), "%s:%s", sec_name, key);
+	return iniparser_getboolean(ini->dict, full_key, 0);
+}
+
+static float getfloat(struct ini *ini, const char *sec_name, const char *key)
+{
+	const char *str = getstring(ini, sec_name, key);
+	return str ? strtof(str, NULL) : 0;
+}
+
 static int lookup_flow(struct ini *ini, const char *name)
 {
 	int i;
@@ -149,8 +181,13 @@ static int parse_plugin_section(struct ini *ini, const char *sec_name,
 	p->library = getstring(ini, sec_name, "library");
 	p->label = getstring(ini, sec_name, "label");
 	p->purpose = getstring(ini, sec_name, "purpose");
+	p->file = getstring(ini, sec_name, "file");
 	p->disable_expr =
 		cras_expr_expression_parse(getstring(ini, sec_name, "disable"));
+	p->disable_prog = cras_expr_program_compile(p->disable_expr);
+	p->optional = getboolean(ini, sec_name, "optional");
+	p->cpu_budget = getfloat(ini, sec_name, "cpu_budget");
+	p->fixed_point = getboolean(ini, sec_name, "fixed_point");
 
 	if (p->library == NULL || p->label == NULL) {
 		syslog(LOG_ERR, "A plugin must have library and label: %s",
@@ -217,6 +254,7 @@ static void fill_swap_lr_plugin(struct ini *ini, struct plugin *plugin,
 	plugin->label = "swap_lr";
 	plugin->purpose = "playback";
 	plugin->disable_expr = cras_expr_expression_parse("swap_lr_disabled");
+	plugin->disable_prog = cras_expr_program_compile(plugin->disable_expr);
 
 	add_audio_port(ini, plugin, input_flowid_0, PORT_INPUT);
 	add_audio_port(ini, plugin, input_flowid_1, PORT_INPUT);
@@ -410,6 +448,7 @@ void cras_dsp_ini_free(struct ini *ini)
 	/* free plugins */
 	ARRAY_ELEMENT_FOREACH (&ini->plugins, i, p) {
 		cras_expr_expression_free(p->disable_expr);
+		cras_expr_program_free(p->disable_prog);
 		ARRAY_FREE(&p->ports);
 	}
 	ARRAY_FREE(&ini->plugins);
@@ -470,7 +509,15 @@ void cras_dsp_ini_dump(struct dumper *d, struct ini *ini)
 		dumpf(d, "library=%s\n", plugin->library);
 		dumpf(d, "label=%s\n", plugin->label);
 		dumpf(d, "purpose=%s\n", plugin->purpose);
+		if (plugin->file)
+			dumpf(d, "file=%s\n", plugin->file);
 		dumpf(d, "disable=%p\n", plugin->disable_expr);
+		if (plugin->optional)
+			dumpf(d, "optional=1\n");
+		if (plugin->cpu_budget)
+			dumpf(d, "cpu_budget=%g\n", plugin->cpu_budget);
+		if (plugin->fixed_point)
+			dumpf(d, "fixed_point=1\n");
 		ARRAY_ELEMENT_FOREACH (&plugin->ports, j, port) {
 			dumpf(d,
 			      "  [%s port %d] type=%s, flow_id=%d, value=%g\n",
@@ -47,8 +47,17 @@ struct plugin {
 	const char *library; /* file name like "plugin.so" */
 	const char *label; /* label like "Eq" */
 	const char *purpose; /* like "playback" or "capture" */
+	const char *file; /* a data file the plugin reads, like the impulse
+			     response of "fir", or NULL */
 	struct cras_expr_expression *disable_expr; /* the disable expression of
 					     this plugin */
+	struct cras_expr_program *disable_prog; /* disable_expr compiled */
+	int optional; /* whether the plugin can be bypassed to keep the
+			 pipeline within its cpu budget */
+	float cpu_budget; /* for a source, the cpu budget of the pipeline in
+			     percent of realtime, or 0 for none */
+	int fixed_point; /* for a source, whether the pipeline processes Q28
+			    fixed point samples instead of floats */
 	port_array ports;
 };
 
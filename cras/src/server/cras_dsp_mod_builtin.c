@@ -3,13 +3,21 @@
  * found in the LICENSE file.
  */
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <syslog.h>
 #include "cras_dsp_module.h"
+#include "cras_util.h"
+#include "cascade.h"
 #include "drc.h"
 #include "dsp_util.h"
 #include "dcblock.h"
 #include "eq.h"
 #include "eq2.h"
+#include "eq2_q31.h"
+#include "fir.h"
+#include "limiter.h"
 
 /*
  *  empty module functions (for source and sink)
@@ -53,6 +61,11 @@ static void empty_dump(struct dsp_module *module, struct dumper *d)
 	dumpf(d, "built-in module\n");
 }
 
+static int empty_set_fixed_point(struct dsp_module *module)
+{
+	return 0;
+}
+
 static void empty_init_module(struct dsp_module *module)
 {
 	module->instantiate = &empty_instantiate;
@@ -63,6 +76,7 @@ static void empty_init_module(struct dsp_module *module)
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
+	module->set_fixed_point = &empty_set_fixed_point;
 }
 
 /*
@@ -98,6 +112,25 @@ static void swap_lr_run(struct dsp_module *module, unsigned long sample_count)
 	}
 }
 
+static void swap_lr_run_q31(struct dsp_module *module,
+			    unsigned long sample_count)
+{
+	size_t i;
+	int32_t **ports = (int32_t **)module->data;
+
+	for (i = 0; i < sample_count; i++) {
+		int32_t temp = ports[0][i];
+		ports[2][i] = ports[1][i];
+		ports[3][i] = temp;
+	}
+}
+
+static int swap_lr_set_fixed_point(struct dsp_module *module)
+{
+	module->run = &swap_lr_run_q31;
+	return 0;
+}
+
 static void swap_lr_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -112,6 +145,7 @@ static void swap_lr_init_module(struct dsp_module *module)
 	module->deinstantiate = &swap_lr_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->set_fixed_point = &swap_lr_set_fixed_point;
 }
 
 /*
@@ -143,6 +177,26 @@ static void invert_lr_run(struct dsp_module *module, unsigned long sample_count)
 	}
 }
 
+static void invert_lr_run_q31(struct dsp_module *module,
+			      unsigned long sample_count)
+{
+	size_t i;
+	int32_t **ports = (int32_t **)module->data;
+
+	/* -INT32_MIN doesn't fit, saturate it. */
+	for (i = 0; i < sample_count; i++) {
+		ports[2][i] = ports[0][i] == INT32_MIN ? INT32_MAX :
+							 -ports[0][i];
+		ports[3][i] = ports[1][i];
+	}
+}
+
+static int invert_lr_set_fixed_point(struct dsp_module *module)
+{
+	module->run = &invert_lr_run_q31;
+	return 0;
+}
+
 static void invert_lr_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -157,6 +211,7 @@ static void invert_lr_init_module(struct dsp_module *module)
 	module->deinstantiate = &invert_lr_deinstantiate;
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
+	module->set_fixed_point = &invert_lr_set_fixed_point;
 }
 
 /*
@@ -191,6 +246,30 @@ static void mix_stereo_run(struct dsp_module *module,
 	}
 }
 
+static void mix_stereo_run_q31(struct dsp_module *module,
+			       unsigned long sample_count)
+{
+	size_t i;
+	int64_t tmp;
+	int32_t **ports = (int32_t **)module->data;
+
+	for (i = 0; i < sample_count; i++) {
+		tmp = (int64_t)ports[0][i] + ports[1][i];
+		if (tmp > INT32_MAX)
+			tmp = INT32_MAX;
+		else if (tmp < INT32_MIN)
+			tmp = INT32_MIN;
+		ports[2][i] = tmp;
+		ports[3][i] = tmp;
+	}
+}
+
+static int mix_stereo_set_fixed_point(struct dsp_module *module)
+{
+	module->run = &mix_stereo_run_q31;
+	return 0;
+}
+
 static void mix_stereo_deinstantiate(struct dsp_module *module)
 {
 	free(module->data);
@@ -206,6 +285,7 @@ static void mix_stereo_init_module(struct dsp_module *module)
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
+	module->set_fixed_point = &mix_stereo_set_fixed_point;
 }
 
 /*
@@ -239,9 +319,12 @@ static void dcblock_connect_port(struct dsp_module *module, unsigned long port,
 	data->ports[port] = data_location;
 }
 
-static void dcblock_run(struct dsp_module *module, unsigned long sample_count)
+/* Creates the filters on the first run, and copies the input to the
+ * output, which the filters then process in place. Q28 and float samples
+ * have the same size. */
+static void dcblock_prepare(struct dcblock_data *data,
+			    unsigned long sample_count)
 {
-	struct dcblock_data *data = (struct dcblock_data *)module->data;
 	if (!data->dcblockl)
 		data->dcblockl =
 			dcblock_new(*data->ports[4], data->sample_rate);
@@ -254,11 +337,35 @@ static void dcblock_run(struct dsp_module *module, unsigned long sample_count)
 	if (data->ports[1] != data->ports[3])
 		memcpy(data->ports[3], data->ports[1],
 		       sizeof(float) * sample_count);
+}
+
+static void dcblock_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct dcblock_data *data = (struct dcblock_data *)module->data;
 
+	dcblock_prepare(data, sample_count);
 	dcblock_process(data->dcblockl, data->ports[2], (int)sample_count);
 	dcblock_process(data->dcblockr, data->ports[3], (int)sample_count);
 }
 
+static void dcblock_run_q31(struct dsp_module *module,
+			    unsigned long sample_count)
+{
+	struct dcblock_data *data = (struct dcblock_data *)module->data;
+
+	dcblock_prepare(data, sample_count);
+	dcblock_process_q31(data->dcblockl, (int32_t *)data->ports[2],
+			    (int)sample_count);
+	dcblock_process_q31(data->dcblockr, (int32_t *)data->ports[3],
+			    (int)sample_count);
+}
+
+static int dcblock_set_fixed_point(struct dsp_module *module)
+{
+	module->run = &dcblock_run_q31;
+	return 0;
+}
+
 static void dcblock_deinstantiate(struct dsp_module *module)
 {
 	struct dcblock_data *data = (struct dcblock_data *)module->data;
@@ -279,6 +386,7 @@ static void dcblock_init_module(struct dsp_module *module)
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
+	module->set_fixed_point = &dcblock_set_fixed_point;
 }
 
 /*
@@ -354,23 +462,50 @@ static void eq_init_module(struct dsp_module *module)
 	module->dump = &empty_dump;
 }
 
+/*
+ *  Counts the audio input ports of plugin, which is the number of channels
+ *  the eq2 and drc modules process.
+ */
+static int count_audio_inputs(const struct plugin *plugin)
+{
+	const struct port *port;
+	int i, n = 0;
+
+	ARRAY_ELEMENT_FOREACH (&plugin->ports, i, port) {
+		if (port->direction == PORT_INPUT && port->type == PORT_AUDIO)
+			n++;
+	}
+	return n;
+}
+
 /*
  *  eq2 module functions
  */
 struct eq2_data {
 	int sample_rate;
-	struct eq2 *eq2; /* Initialized in the first call of eq2_run() */
-
-	/* Two ports for input, two for output, and 8 parameters per eq pair */
-	float *ports[4 + MAX_BIQUADS_PER_EQ2 * 8];
+	int num_channels;
+	/* Whether the audio is in Q28, run through eq2_q31 instead of
+	 * cascade. */
+	int fixed_point;
+	/* Initialized in the first call of eq2_run() */
+	struct cascade *cascade;
+	struct eq2_q31 *eq2_q31;
+	int num_biquads;
+
+	/* One port for input and one for output per channel, then 4
+	 * parameters per channel for each eq stage */
+	float *ports[2 * EQ2_MAX_CHANNELS +
+		     MAX_BIQUADS_PER_EQ2 * 4 * EQ2_MAX_CHANNELS];
+	/* The parameters the biquads were last set to. */
+	float params[MAX_BIQUADS_PER_EQ2 * 4 * EQ2_MAX_CHANNELS];
 };
 
 static int eq2_instantiate(struct dsp_module *module, unsigned long sample_rate)
 {
-	struct eq2_data *data;
+	struct eq2_data *data = (struct eq2_data *)module->data;
 
-	module->data = calloc(1, sizeof(struct eq2_data));
-	data = (struct eq2_data *)module->data;
+	if (!data)
+		return -ENOMEM;
 	data->sample_rate = (int)sample_rate;
 	return 0;
 }
@@ -379,61 +514,158 @@ static void eq2_connect_port(struct dsp_module *module, unsigned long port,
 			     float *data_location)
 {
 	struct eq2_data *data = (struct eq2_data *)module->data;
-	data->ports[port] = data_location;
+	if (port < ARRAY_SIZE(data->ports))
+		data->ports[port] = data_location;
 }
 
-static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+/* Creates the cascade, or the Q31 EQ2, from the biquads on the ports. */
+static void eq2_create(struct eq2_data *data)
 {
-	struct eq2_data *data = (struct eq2_data *)module->data;
-	if (!data->eq2) {
-		float nyquist = data->sample_rate / 2;
-		int i, channel;
+	float nyquist = data->sample_rate / 2;
+	int n = data->num_channels;
+	float *p;
+	int i, channel;
+
+	if (data->fixed_point) {
+		data->eq2_q31 = eq2_q31_new(n);
+		if (!data->eq2_q31)
+			return;
+	} else {
+		data->cascade = cascade_new(n);
+		if (!data->cascade)
+			return;
+		/* Changes of the parameters are spread over 10ms. */
+		cascade_set_ramp(data->cascade, data->sample_rate / 100);
+	}
 
-		data->eq2 = eq2_new();
-		for (i = 4; i < 4 + MAX_BIQUADS_PER_EQ2 * 8; i += 8) {
-			if (!data->ports[i])
-				break;
-			for (channel = 0; channel < 2; channel++) {
-				int k = i + channel * 4;
-				int type = (int)*data->ports[k];
-				float freq = *data->ports[k + 1];
-				float Q = *data->ports[k + 2];
-				float gain = *data->ports[k + 3];
-				eq2_append_biquad(data->eq2, channel, type,
-						  freq / nyquist, Q, gain);
-			}
+	for (i = 0; i < MAX_BIQUADS_PER_EQ2; i++) {
+		if (!data->ports[2 * n + i * 4 * n])
+			break;
+		for (channel = 0; channel < n; channel++) {
+			int k = 2 * n + (i * n + channel) * 4;
+			p = &data->params[(i * n + channel) * 4];
+			p[0] = *data->ports[k];
+			p[1] = *data->ports[k + 1];
+			p[2] = *data->ports[k + 2];
+			p[3] = *data->ports[k + 3];
+			if (data->eq2_q31)
+				eq2_q31_append_biquad(data->eq2_q31, channel,
+						      (int)p[0], p[1] / nyquist,
+						      p[2], p[3]);
+			else
+				cascade_append_biquad(data->cascade, channel,
+						      (int)p[0], p[1] / nyquist,
+						      p[2], p[3]);
 		}
 	}
+	data->num_biquads = i;
+}
 
-	if (data->ports[0] != data->ports[2])
-		memcpy(data->ports[2], data->ports[0],
-		       sizeof(float) * sample_count);
-	if (data->ports[3] != data->ports[1])
-		memcpy(data->ports[3], data->ports[1],
-		       sizeof(float) * sample_count);
+/* Moves the biquads whose parameters changed to the new ones. The Q28
+ * EQ2 has no ramp, its biquads change at once. */
+static void eq2_update(struct eq2_data *data)
+{
+	float nyquist = data->sample_rate / 2;
+	int n = data->num_channels;
+	int i, j, k;
+	float *p;
+
+	for (i = 0; i < data->num_biquads * n; i++) {
+		k = 2 * n + i * 4;
+		p = &data->params[i * 4];
+		for (j = 0; j < 4; j++)
+			if (p[j] != *data->ports[k + j])
+				break;
+		if (j == 4)
+			continue;
+		for (j = 0; j < 4; j++)
+			p[j] = *data->ports[k + j];
+		if (data->eq2_q31)
+			eq2_q31_set_biquad(data->eq2_q31, i % n, i / n,
+					   (int)p[0], p[1] / nyquist, p[2],
+					   p[3]);
+		else
+			cascade_set_biquad(data->cascade, i % n, i / n,
+					   (int)p[0], p[1] / nyquist, p[2],
+					   p[3]);
+	}
+}
 
-	eq2_process(data->eq2, data->ports[2], data->ports[3],
-		    (int)sample_count);
+static void eq2_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct eq2_data *data = (struct eq2_data *)module->data;
+	int n = data->num_channels;
+	int channel;
+
+	if (!data->cascade && !data->eq2_q31)
+		eq2_create(data);
+	else
+		eq2_update(data);
+
+	/* Q28 and float samples have the same size. */
+	for (channel = 0; channel < n; channel++)
+		if (data->ports[channel] != data->ports[n + channel])
+			memcpy(data->ports[n + channel], data->ports[channel],
+			       sizeof(float) * sample_count);
+
+	if (data->cascade)
+		cascade_process(data->cascade, &data->ports[n],
+				(int)sample_count);
+	else if (data->eq2_q31)
+		eq2_q31_process(data->eq2_q31, (int32_t **)&data->ports[n],
+				(int)sample_count);
+}
+
+static int eq2_set_fixed_point(struct dsp_module *module)
+{
+	struct eq2_data *data = (struct eq2_data *)module->data;
+
+	if (!data)
+		return -1;
+	data->fixed_point = 1;
+	return 0;
 }
 
 static void eq2_deinstantiate(struct dsp_module *module)
 {
 	struct eq2_data *data = (struct eq2_data *)module->data;
-	if (data->eq2)
-		eq2_free(data->eq2);
-	free(data);
+	if (data->cascade)
+		cascade_free(data->cascade);
+	data->cascade = NULL;
+	if (data->eq2_q31)
+		eq2_q31_free(data->eq2_q31);
+	data->eq2_q31 = NULL;
 }
 
-static void eq2_init_module(struct dsp_module *module)
+static void eq2_free_module(struct dsp_module *module)
 {
+	free(module->data);
+	free(module);
+}
+
+static void eq2_init_module(struct dsp_module *module,
+			    const struct plugin *plugin)
+{
+	int n = count_audio_inputs(plugin);
+	struct eq2_data *data;
+
+	/* Fall back to stereo if the plugin doesn't say otherwise. */
+	if (n < 1 || n > EQ2_MAX_CHANNELS)
+		n = 2;
+	data = (struct eq2_data *)calloc(1, sizeof(struct eq2_data));
+	if (data)
+		data->num_channels = n;
+	module->data = data;
+
 	module->instantiate = &eq2_instantiate;
 	module->connect_port = &eq2_connect_port;
 	module->get_delay = &empty_get_delay;
 	module->run = &eq2_run;
 	module->deinstantiate = &eq2_deinstantiate;
-	module->free_module = &empty_free_module;
+	module->free_module = &eq2_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
+	module->set_fixed_point = &eq2_set_fixed_point;
 }
 
 /*
@@ -441,19 +673,20 @@ static void eq2_init_module(struct dsp_module *module)
  */
 struct drc_data {
 	int sample_rate;
+	int num_channels;
 	struct drc *drc; /* Initialized in the first call of drc_run() */
 
-	/* Two ports for input, two for output, one for disable_emphasis,
-	 * and 8 parameters each band */
-	float *ports[4 + 1 + 8 * 3];
+	/* One port for input and one for output per channel, one for
+	 * disable_emphasis, and 8 parameters each band */
+	float *ports[2 * DRC_MAX_CHANNELS + 1 + 8 * 3];
 };
 
 static int drc_instantiate(struct dsp_module *module, unsigned long sample_rate)
 {
-	struct drc_data *data;
+	struct drc_data *data = (struct drc_data *)module->data;
 
-	module->data = calloc(1, sizeof(struct drc_data));
-	data = (struct drc_data *)module->data;
+	if (!data)
+		return -ENOMEM;
 	data->sample_rate = (int)sample_rate;
 	return 0;
 }
@@ -462,7 +695,8 @@ static void drc_connect_port(struct dsp_module *module, unsigned long port,
 			     float *data_location)
 {
 	struct drc_data *data = (struct drc_data *)module->data;
-	data->ports[port] = data_location;
+	if (port < ARRAY_SIZE(data->ports))
+		data->ports[port] = data_location;
 }
 
 static int drc_get_delay(struct dsp_module *module)
@@ -474,15 +708,19 @@ static int drc_get_delay(struct dsp_module *module)
 static void drc_run(struct dsp_module *module, unsigned long sample_count)
 {
 	struct drc_data *data = (struct drc_data *)module->data;
+	int n = data->num_channels;
+	int channel;
+
 	if (!data->drc) {
 		int i;
 		float nyquist = data->sample_rate / 2;
 		struct drc *drc = drc_new(data->sample_rate);
 
 		data->drc = drc;
-		drc->emphasis_disabled = (int)*data->ports[4];
+		drc->num_channels = n;
+		drc->emphasis_disabled = (int)*data->ports[2 * n];
 		for (i = 0; i < 3; i++) {
-			int k = 5 + i * 8;
+			int k = 2 * n + 1 + i * 8;
 			float f = *data->ports[k];
 			float enable = *data->ports[k + 1];
 			float threshold = *data->ports[k + 2];
@@ -503,14 +741,12 @@ static void drc_run(struct dsp_module *module, unsigned long sample_count)
 		}
 		drc_init(drc);
 	}
-	if (data->ports[0] != data->ports[2])
-		memcpy(data->ports[2], data->ports[0],
-		       sizeof(float) * sample_count);
-	if (data->ports[1] != data->ports[3])
-		memcpy(data->ports[3], data->ports[1],
-		       sizeof(float) * sample_count);
+	for (channel = 0; channel < n; channel++)
+		if (data->ports[channel] != data->ports[n + channel])
+			memcpy(data->ports[n + channel], data->ports[channel],
+			       sizeof(float) * sample_count);
 
-	drc_process(data->drc, &data->ports[2], (int)sample_count);
+	drc_process(data->drc, &data->ports[n], (int)sample_count);
 }
 
 static void drc_deinstantiate(struct dsp_module *module)
@@ -518,17 +754,357 @@ static void drc_deinstantiate(struct dsp_module *module)
 	struct drc_data *data = (struct drc_data *)module->data;
 	if (data->drc)
 		drc_free(data->drc);
-	free(data);
+	data->drc = NULL;
 }
 
-static void drc_init_module(struct dsp_module *module)
+static void drc_free_module(struct dsp_module *module)
 {
+	free(module->data);
+	free(module);
+}
+
+static void drc_init_module(struct dsp_module *module,
+			    const struct plugin *plugin)
+{
+	int n = count_audio_inputs(plugin);
+	struct drc_data *data;
+
+	/* Fall back to stereo if the plugin doesn't say otherwise. */
+	if (n < 1 || n > DRC_MAX_CHANNELS)
+		n = 2;
+	data = (struct drc_data *)calloc(1, sizeof(struct drc_data));
+	if (data)
+		data->num_channels = n;
+	module->data = data;
+
 	module->instantiate = &drc_instantiate;
 	module->connect_port = &drc_connect_port;
 	module->get_delay = &drc_get_delay;
 	module->run = &drc_run;
 	module->deinstantiate = &drc_deinstantiate;
-	module->free_module = &empty_free_module;
+	module->free_module = &drc_free_module;
+	module->get_properties = &empty_get_properties;
+	module->dump = &empty_dump;
+}
+
+/*
+ *  fir module functions
+ */
+#define FIR_MAX_CHANNELS 8
+#define FIR_DEFAULT_BLOCK_SIZE 256
+
+struct fir_data {
+	int num_channels;
+	/* The partition size, and the number of channels in the impulse
+	 * response file: one response shared by all channels, or one per
+	 * channel. */
+	int block_size;
+	int file_channels;
+	const char *file;
+	struct fir *fir[FIR_MAX_CHANNELS]; /* Created in fir_instantiate() */
+
+	/* One port for input and one for output per channel, then the block
+	 * size and the number of channels in the file */
+	float *ports[2 * FIR_MAX_CHANNELS + 2];
+};
+
+/* Reads the impulse responses from a file of interleaved 32-bit floats.
+ * Returns the number of frames read, or a negative error code. */
+static int read_impulse_response(const char *path, int channels,
+				 float **taps)
+{
+	FILE *f;
+	long size;
+	int frames;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return -errno;
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return -EIO;
+	}
+
+	frames = size / (sizeof(float) * channels);
+	if (frames < 1) {
+		fclose(f);
+		return -EINVAL;
+	}
+	*taps = (float *)malloc(frames * channels * sizeof(float));
+	if (!*taps) {
+		fclose(f);
+		return -ENOMEM;
+	}
+	if (fread(*taps, sizeof(float) * channels, frames, f) != frames) {
+		free(*taps);
+		fclose(f);
+		return -EIO;
+	}
+	fclose(f);
+	return frames;
+}
+
+static void fir_deinstantiate(struct dsp_module *module)
+{
+	struct fir_data *data = (struct fir_data *)module->data;
+	int i;
+
+	for (i = 0; i < data->num_channels; i++) {
+		if (data->fir[i])
+			fir_free(data->fir[i]);
+		data->fir[i] = NULL;
+	}
+}
+
+static int fir_instantiate(struct dsp_module *module, unsigned long sample_rate)
+{
+	struct fir_data *data = (struct fir_data *)module->data;
+	float *taps = NULL, *response;
+	int frames, i, k;
+
+	if (!data)
+		return -ENOMEM;
+	if (!data->file) {
+		syslog(LOG_ERR, "fir: no impulse response file");
+		return -EINVAL;
+	}
+	/* Only a mono response may be shared, guessing which channels of
+	 * any other file go where would silently filter the wrong ones. */
+	if (data->file_channels != 1 &&
+	    data->file_channels != data->num_channels) {
+		syslog(LOG_ERR, "fir: %s has %d channels, the module has %d",
+		       data->file, data->file_channels, data->num_channels);
+		return -EINVAL;
+	}
+
+	frames = read_impulse_response(data->file, data->file_channels, &taps);
+	if (frames < 0) {
+		syslog(LOG_ERR, "fir: failed to read %s: %d", data->file,
+		       frames);
+		return frames;
+	}
+
+	response = (float *)malloc(frames * sizeof(float));
+	for (i = 0; response && i < data->num_channels; i++) {
+		int c = data->file_channels == 1 ? 0 : i;
+		for (k = 0; k < frames; k++)
+			response[k] = taps[k * data->file_channels + c];
+		data->fir[i] = fir_new(response, frames, data->block_size);
+		if (!data->fir[i])
+			break;
+	}
+	free(response);
+	free(taps);
+
+	if (i < data->num_channels) {
+		syslog(LOG_ERR, "fir: failed to create the filters");
+		fir_deinstantiate(module);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void fir_connect_port(struct dsp_module *module, unsigned long port,
+			     float *data_location)
+{
+	struct fir_data *data = (struct fir_data *)module->data;
+	if (port < ARRAY_SIZE(data->ports))
+		data->ports[port] = data_location;
+}
+
+static int fir_get_delay_frames(struct dsp_module *module)
+{
+	struct fir_data *data = (struct fir_data *)module->data;
+	return data->block_size;
+}
+
+static void fir_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct fir_data *data = (struct fir_data *)module->data;
+	int n = data->num_channels;
+	int channel;
+
+	for (channel = 0; channel < n; channel++) {
+		if (data->ports[channel] != data->ports[n + channel])
+			memcpy(data->ports[n + channel], data->ports[channel],
+			       sizeof(float) * sample_count);
+		fir_process(data->fir[channel], data->ports[n + channel],
+			    (int)sample_count);
+	}
+}
+
+static void fir_free_module(struct dsp_module *module)
+{
+	free(module->data);
+	free(module);
+}
+
+/* Returns the value of a control port given as a constant in the ini
+ * file, or def if there is none. */
+static float constant_port_value(const struct plugin *plugin, int index,
+				 float def)
+{
+	const struct port *port;
+
+	if (index >= ARRAY_COUNT(&plugin->ports))
+		return def;
+	port = ARRAY_ELEMENT(&plugin->ports, index);
+	if (port->type != PORT_CONTROL || port->flow_id != INVALID_FLOW_ID)
+		return def;
+	return port->init_value;
+}
+
+static void fir_init_module(struct dsp_module *module,
+			    const struct plugin *plugin)
+{
+	int n = count_audio_inputs(plugin);
+	struct fir_data *data;
+
+	/* Fall back to stereo if the plugin doesn't say otherwise. */
+	if (n < 1 || n > FIR_MAX_CHANNELS)
+		n = 2;
+	data = (struct fir_data *)calloc(1, sizeof(struct fir_data));
+	if (data) {
+		/* The filters are sized at instantiation, before the ports
+		 * are connected, so these must be constants. */
+		data->num_channels = n;
+		data->block_size = (int)constant_port_value(
+			plugin, 2 * n, FIR_DEFAULT_BLOCK_SIZE);
+		data->file_channels =
+			(int)constant_port_value(plugin, 2 * n + 1, 1);
+		data->file = plugin->file;
+	}
+	module->data = data;
+
+	module->instantiate = &fir_instantiate;
+	module->connect_port = &fir_connect_port;
+	module->get_delay = &fir_get_delay_frames;
+	module->run = &fir_run;
+	module->deinstantiate = &fir_deinstantiate;
+	module->free_module = &fir_free_module;
+	module->get_properties = &empty_get_properties;
+	module->dump = &empty_dump;
+}
+
+/*
+ *  limiter module functions
+ */
+#define LIMITER_DEFAULT_CEILING -1.0f
+#define LIMITER_DEFAULT_ATTACK 0.005f
+#define LIMITER_DEFAULT_RELEASE 0.05f
+
+struct limiter_data {
+	int sample_rate;
+	int num_channels;
+	struct limiter *limiter; /* Initialized in the first call of
+				    limiter_get_delay_frames() */
+
+	/* One port for input and one for output per channel, then the
+	 * ceiling in dBFS, the attack (lookahead) and release in seconds */
+	float *ports[2 * LIMITER_MAX_CHANNELS + 3];
+};
+
+static float limiter_port_value(struct limiter_data *data, int offset,
+				float def)
+{
+	float *port = data->ports[2 * data->num_channels + offset];
+	return port ? *port : def;
+}
+
+static struct limiter *get_limiter(struct limiter_data *data)
+{
+	if (!data->limiter)
+		data->limiter = limiter_new(
+			data->num_channels, data->sample_rate,
+			limiter_port_value(data, 1, LIMITER_DEFAULT_ATTACK));
+	return data->limiter;
+}
+
+static int limiter_instantiate(struct dsp_module *module,
+			       unsigned long sample_rate)
+{
+	struct limiter_data *data = (struct limiter_data *)module->data;
+
+	if (!data)
+		return -ENOMEM;
+	data->sample_rate = (int)sample_rate;
+	return 0;
+}
+
+static void limiter_connect_port(struct dsp_module *module, unsigned long port,
+				 float *data_location)
+{
+	struct limiter_data *data = (struct limiter_data *)module->data;
+	if (port < ARRAY_SIZE(data->ports))
+		data->ports[port] = data_location;
+}
+
+/* The lookahead is only known once the ports are connected, and the
+ * pipeline asks for the delay right after that, on the main thread. */
+static int limiter_get_delay_frames(struct dsp_module *module)
+{
+	struct limiter_data *data = (struct limiter_data *)module->data;
+	struct limiter *limiter = get_limiter(data);
+
+	return limiter ? limiter_get_delay(limiter) : 0;
+}
+
+static void limiter_run(struct dsp_module *module, unsigned long sample_count)
+{
+	struct limiter_data *data = (struct limiter_data *)module->data;
+	struct limiter *limiter = get_limiter(data);
+	int n = data->num_channels;
+	int channel;
+
+	for (channel = 0; channel < n; channel++)
+		if (data->ports[channel] != data->ports[n + channel])
+			memcpy(data->ports[n + channel], data->ports[channel],
+			       sizeof(float) * sample_count);
+	if (!limiter)
+		return;
+
+	limiter_set_params(
+		limiter,
+		limiter_port_value(data, 0, LIMITER_DEFAULT_CEILING),
+		limiter_port_value(data, 2, LIMITER_DEFAULT_RELEASE));
+	limiter_process(limiter, &data->ports[n], (int)sample_count);
+}
+
+static void limiter_deinstantiate(struct dsp_module *module)
+{
+	struct limiter_data *data = (struct limiter_data *)module->data;
+	if (data->limiter)
+		limiter_free(data->limiter);
+	data->limiter = NULL;
+}
+
+static void limiter_free_module(struct dsp_module *module)
+{
+	free(module->data);
+	free(module);
+}
+
+static void limiter_init_module(struct dsp_module *module,
+				const struct plugin *plugin)
+{
+	int n = count_audio_inputs(plugin);
+	struct limiter_data *data;
+
+	/* Fall back to stereo if the plugin doesn't say otherwise. */
+	if (n < 1 || n > LIMITER_MAX_CHANNELS)
+		n = 2;
+	data = (struct limiter_data *)calloc(1, sizeof(struct limiter_data));
+	if (data)
+		data->num_channels = n;
+	module->data = data;
+
+	module->instantiate = &limiter_instantiate;
+	module->connect_port = &limiter_connect_port;
+	module->get_delay = &limiter_get_delay_frames;
+	module->run = &limiter_run;
+	module->deinstantiate = &limiter_deinstantiate;
+	module->free_module = &limiter_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
 }
@@ -570,6 +1146,44 @@ static void sink_run(struct dsp_module *module, unsigned long sample_count)
 	data->ext_module->run(data->ext_module, sample_count);
 }
 
+/* Converts the samples of the ports between Q28 and float in place. */
+static void sink_convert_ports(struct sink_data *data,
+			       unsigned long sample_count, int to_float)
+{
+	int i;
+
+	for (i = 0; i < MAX_EXT_DSP_PORTS; i++) {
+		if (!data->ports[i])
+			continue;
+		if (to_float)
+			dsp_util_q28_to_float((int32_t *)data->ports[i],
+					      data->ports[i], sample_count);
+		else
+			dsp_util_float_to_q28(data->ports[i],
+					      (int32_t *)data->ports[i],
+					      sample_count);
+	}
+}
+
+static void sink_run_q31(struct dsp_module *module, unsigned long sample_count)
+{
+	struct sink_data *data = (struct sink_data *)module->data;
+
+	if (!data->ext_module)
+		return;
+	/* The external module takes floats. Convert the samples for it, and
+	 * back for the rest of the pipeline. */
+	sink_convert_ports(data, sample_count, 1);
+	data->ext_module->run(data->ext_module, sample_count);
+	sink_convert_ports(data, sample_count, 0);
+}
+
+static int sink_set_fixed_point(struct dsp_module *module)
+{
+	module->run = &sink_run_q31;
+	return 0;
+}
+
 static void sink_init_module(struct dsp_module *module)
 {
 	module->instantiate = &sink_instantiate;
@@ -580,6 +1194,7 @@ static void sink_init_module(struct dsp_module *module)
 	module->free_module = &empty_free_module;
 	module->get_properties = &empty_get_properties;
 	module->dump = &empty_dump;
+	module->set_fixed_point = &sink_set_fixed_point;
 }
 
 void cras_dsp_module_set_sink_ext_module(struct dsp_module *module,
@@ -616,9 +1231,13 @@ struct dsp_module *cras_dsp_module_load_builtin(struct plugin *plugin)
 	} else if (strcmp(plugin->label, "eq") == 0) {
 		eq_init_module(module);
 	} else if (strcmp(plugin->label, "eq2") == 0) {
-		eq2_init_module(module);
+		eq2_init_module(module, plugin);
 	} else if (strcmp(plugin->label, "drc") == 0) {
-		drc_init_module(module);
+		drc_init_module(module, plugin);
+	} else if (strcmp(plugin->label, "fir") == 0) {
+		fir_init_module(module, plugin);
+	} else if (strcmp(plugin->label, "limiter") == 0) {
+		limiter_init_module(module, plugin);
 	} else if (strcmp(plugin->label, "swap_lr") == 0) {
 		swap_lr_init_module(module);
 	} else if (strcmp(plugin->label, "sink") == 0) {
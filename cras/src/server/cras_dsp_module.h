@@ -70,6 +70,15 @@ struct dsp_module {
 
 	/* Dumps the information about current state of this module */
 	void (*dump)(struct dsp_module *mod, struct dumper *d);
+
+	/* Makes run() process the audio ports as Q28 fixed point samples,
+	 * int32_t in the buffers given to connect_port(), instead of floats.
+	 * The control ports stay floats. Called before instantiate(), and
+	 * NULL if the module only processes floats.
+	 * Returns:
+	 *    0 if successful. -1 otherwise.
+	 */
+	int (*set_fixed_point)(struct dsp_module *mod);
 };
 
 /* An external module interface working with existing dsp pipeline.
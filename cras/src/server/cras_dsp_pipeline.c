@@ -3,7 +3,9 @@
  * found in the LICENSE file.
  */
 
+#include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 #include <sys/param.h>
 #include <syslog.h>
 
@@ -12,6 +14,14 @@
 #include "cras_dsp_pipeline.h"
 #include "dsp_util.h"
 
+/* The time each instance takes is counted for one in this many runs of the
+ * pipeline, so the clock reads cost little. */
+#define DSP_PROFILE_INTERVAL 8
+
+/* Once over budget, the optional instances are bypassed until the pipeline
+ * would take less than this share of its budget with them. */
+#define DSP_BUDGET_RESUME_RATIO 0.8
+
 /* We have a static representation of the dsp graph in a "struct ini",
  * and here we will construct a dynamic representation of it in a
  * "struct pipeline". The difference between the static one and the
@@ -92,6 +102,17 @@ struct instance {
 	/* This is the total buffering delay from source to this instance. It is
 	 * in number of frames. */
 	int total_delay;
+
+	/* The total time spent in the run() function of the module, in
+	 * nanoseconds, and the number of frames it was counted for. It is
+	 * counted for one run in DSP_PROFILE_INTERVAL, or every run when
+	 * profiling is enabled. */
+	int64_t total_time;
+	int64_t total_frames;
+
+	/* Whether the instance can be bypassed when the pipeline is over its
+	 * cpu budget. */
+	int optional;
 };
 
 DECLARE_ARRAY_TYPE(struct instance, instance_array)
@@ -130,6 +151,11 @@ struct pipeline {
 	 * cras_dsp_pipeline_instantiate() has not been called. */
 	int sample_rate;
 
+	/* The number of frames cras_dsp_pipeline_apply() and
+	 * cras_dsp_pipeline_apply_float() run through all instances before
+	 * moving on to the next frames. */
+	int tile_frames;
+
 	/* The total time it takes to run the pipeline, in nanoseconds. */
 	int64_t total_time;
 
@@ -142,6 +168,27 @@ struct pipeline {
 
 	/* The total number of sample frames the pipeline processed */
 	int64_t total_samples;
+
+	/* Whether the time spent in each instance is counted on every run. */
+	int profile;
+
+	/* The number of times cras_dsp_pipeline_run() was called. */
+	int64_t runs;
+
+	/* The cpu budget of the pipeline in percent of realtime, or 0 for
+	 * none. */
+	float cpu_budget;
+
+	/* Whether the optional instances are bypassed, and the number of
+	 * blocks that went over the budget. */
+	int bypass;
+	int64_t over_budget_blocks;
+
+	/* The serial of the environment the pipeline was created from. */
+	unsigned int env_serial;
+
+	/* Whether the audio buffers hold Q28 samples instead of floats. */
+	int fixed_point;
 };
 
 static struct instance *find_instance_by_plugin(instance_array *instances,
@@ -269,9 +316,9 @@ static struct control_port *find_output_control_port(instance_array *instances,
 static char is_disabled(struct plugin *plugin, struct cras_expr_env *env)
 {
 	char disabled;
-	return (plugin->disable_expr &&
-		cras_expr_expression_eval_boolean(plugin->disable_expr, env,
-						  &disabled) == 0 &&
+	return (plugin->disable_prog &&
+		cras_expr_program_eval_boolean(plugin->disable_prog, env,
+					       &disabled) == 0 &&
 		disabled == 1);
 }
 
@@ -427,6 +474,9 @@ struct pipeline *cras_dsp_pipeline_create(struct ini *ini,
 
 	pipeline->ini = ini;
 	pipeline->purpose = purpose;
+	pipeline->tile_frames = DSP_BUFFER_SIZE;
+	pipeline->env_serial = cras_expr_env_get_serial(env);
+	pipeline->cpu_budget = source->cpu_budget;
 	/* create instances for needed plugins, in the order of dependency */
 	n = ARRAY_COUNT(&ini->plugins);
 	visited = calloc(1, n);
@@ -500,6 +550,29 @@ static void unuse_buffers(char *busy, audio_port_array *audio_ports)
 	}
 }
 
+/* Hands the buffer of the k-th input port over to the k-th output port, so
+ * a module which works in place reads and writes the same buffer and the
+ * data stays in cache from one instance to the next. Output ports without
+ * a matching input port get a free buffer. */
+static void pass_buffers(char *busy, struct instance *instance)
+{
+	audio_port_array *in = &instance->input_audio_ports;
+	int i, k = 0;
+	struct audio_port *audio_port;
+
+	unuse_buffers(busy, in);
+	ARRAY_ELEMENT_FOREACH (&instance->output_audio_ports, i, audio_port) {
+		if (i < ARRAY_COUNT(in)) {
+			audio_port->buf_index = ARRAY_ELEMENT(in, i)->buf_index;
+		} else {
+			while (busy[k])
+				k++;
+			audio_port->buf_index = k;
+		}
+		busy[audio_port->buf_index] = 1;
+	}
+}
+
 /* assign which buffer each audio port on each instance should use */
 static int allocate_buffers(struct pipeline *pipeline)
 {
@@ -586,8 +659,7 @@ static int allocate_buffers(struct pipeline *pipeline)
 			use_buffers(busy, &instance->output_audio_ports);
 			unuse_buffers(busy, &instance->input_audio_ports);
 		} else {
-			unuse_buffers(busy, &instance->input_audio_ports);
-			use_buffers(busy, &instance->output_audio_ports);
+			pass_buffers(busy, instance);
 		}
 	}
 	free(busy);
@@ -595,6 +667,34 @@ static int allocate_buffers(struct pipeline *pipeline)
 	return 0;
 }
 
+/* Switches the modules to Q28 if the source plugin asks for it and all of
+ * them support it. Returns -1 if a module failed to switch. */
+static int set_fixed_point(struct pipeline *pipeline)
+{
+	int i;
+	struct instance *instance;
+
+	if (!pipeline->source_instance->plugin->fixed_point)
+		return 0;
+
+	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
+		if (!instance->module->set_fixed_point) {
+			syslog(LOG_WARNING,
+			       "%s can't run in fixed point, using float",
+			       instance->plugin->title);
+			return 0;
+		}
+	}
+
+	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
+		struct dsp_module *module = instance->module;
+		if (module->set_fixed_point(module) != 0)
+			return -1;
+	}
+	pipeline->fixed_point = 1;
+	return 0;
+}
+
 int cras_dsp_pipeline_load(struct pipeline *pipeline)
 {
 	int i;
@@ -606,6 +706,9 @@ int cras_dsp_pipeline_load(struct pipeline *pipeline)
 			return -1;
 	}
 
+	if (set_fixed_point(pipeline) != 0)
+		return -1;
+
 	if (allocate_buffers(pipeline) != 0)
 		return -1;
 
@@ -623,6 +726,7 @@ static void calculate_audio_delay(struct pipeline *pipeline)
 		audio_port_array *audio_in = &instance->input_audio_ports;
 		struct audio_port *audio_port;
 		int delay = 0;
+		int module_delay;
 		int j;
 
 		/* Finds the max delay of all modules that provide input to this
@@ -633,7 +737,21 @@ static void calculate_audio_delay(struct pipeline *pipeline)
 			delay = MAX(upstream->total_delay, delay);
 		}
 
-		instance->total_delay = delay + module->get_delay(module);
+		module_delay = module->get_delay(module);
+		instance->total_delay = delay + module_delay;
+
+		/* Bypassing copies the inputs to the outputs, which only
+		 * keeps the audio in sync without the module if the counts
+		 * match and the module has no delay. */
+		if (!instance->plugin->optional)
+			continue;
+		instance->optional =
+			ARRAY_COUNT(audio_in) ==
+				ARRAY_COUNT(&instance->output_audio_ports) &&
+			module_delay == 0;
+		if (!instance->optional)
+			syslog(LOG_WARNING, "%s can't be bypassed",
+			       instance->plugin->title);
 	}
 }
 
@@ -731,6 +849,11 @@ int cras_dsp_pipeline_get_delay(struct pipeline *pipeline)
 	return pipeline->sink_instance->total_delay;
 }
 
+int cras_dsp_pipeline_is_fixed_point(struct pipeline *pipeline)
+{
+	return pipeline->fixed_point;
+}
+
 int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline)
 {
 	return pipeline->sample_rate;
@@ -751,6 +874,16 @@ int cras_dsp_pipeline_get_peak_audio_buffers(struct pipeline *pipeline)
 	return pipeline->peak_buf;
 }
 
+void cras_dsp_pipeline_set_tile_frames(struct pipeline *pipeline, int frames)
+{
+	pipeline->tile_frames = MAX(1, MIN(frames, DSP_BUFFER_SIZE));
+}
+
+int cras_dsp_pipeline_get_tile_frames(struct pipeline *pipeline)
+{
+	return pipeline->tile_frames;
+}
+
 static float *find_buffer(struct pipeline *pipeline,
 			  audio_port_array *audio_ports, int index)
 {
@@ -789,14 +922,168 @@ struct ini *cras_dsp_pipeline_get_ini(struct pipeline *pipeline)
 	return pipeline->ini;
 }
 
-void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+int cras_dsp_pipeline_is_stale(struct pipeline *pipeline,
+			       const struct cras_expr_env *env)
 {
 	int i;
+	struct plugin *plugin;
+
+	/* Any plugin of the ini may be enabled or disabled now, not only
+	 * the ones in the pipeline. */
+	ARRAY_ELEMENT_FOREACH (&pipeline->ini->plugins, i, plugin) {
+		if (plugin->disable_prog &&
+		    cras_expr_program_changed_since(plugin->disable_prog, env,
+						    pipeline->env_serial))
+			return 1;
+	}
+	return 0;
+}
+
+void cras_dsp_pipeline_set_profile(struct pipeline *pipeline, int enabled)
+{
+	pipeline->profile = enabled;
+}
+
+int cras_dsp_pipeline_get_num_instances(struct pipeline *pipeline)
+{
+	return ARRAY_COUNT(&pipeline->instances);
+}
+
+int cras_dsp_pipeline_get_instance_statistic(
+	struct pipeline *pipeline, int index,
+	struct dsp_instance_statistic *stat)
+{
 	struct instance *instance;
 
+	if (index < 0 || index >= ARRAY_COUNT(&pipeline->instances))
+		return -EINVAL;
+	instance = ARRAY_ELEMENT(&pipeline->instances, index);
+	stat->title = instance->plugin->title;
+	stat->total_time = instance->total_time;
+	stat->total_frames = instance->total_frames;
+	stat->optional = instance->optional;
+	stat->bypassed = instance->optional && pipeline->bypass;
+	return 0;
+}
+
+void cras_dsp_pipeline_set_cpu_budget(struct pipeline *pipeline,
+				      float percent)
+{
+	pipeline->cpu_budget = percent > 0 ? percent : 0;
+	if (!pipeline->cpu_budget)
+		pipeline->bypass = 0;
+}
+
+/* Passes the audio of an instance from its inputs to its outputs. Only
+ * instances with as many outputs as inputs are marked optional, the bound
+ * keeps this in range regardless. */
+static void bypass_instance(struct pipeline *pipeline,
+			    struct instance *instance, int sample_count)
+{
+	int i, n;
+	struct audio_port *in, *out;
+
+	n = MIN(ARRAY_COUNT(&instance->input_audio_ports),
+		ARRAY_COUNT(&instance->output_audio_ports));
+	for (i = 0; i < n; i++) {
+		in = ARRAY_ELEMENT(&instance->input_audio_ports, i);
+		out = ARRAY_ELEMENT(&instance->output_audio_ports, i);
+		if (in->buf_index == out->buf_index)
+			continue;
+		memcpy(pipeline->buffers[out->buf_index],
+		       pipeline->buffers[in->buf_index],
+		       sample_count * sizeof(float));
+	}
+}
+
+/* Runs the instances, adding the time each one takes to its total. */
+static void run_with_profile(struct pipeline *pipeline, int sample_count)
+{
+	int i;
+	struct instance *instance;
+	struct timespec begin, end, delta;
+
 	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
+		if (instance->optional && pipeline->bypass) {
+			bypass_instance(pipeline, instance, sample_count);
+			continue;
+		}
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
 		module->run(module, sample_count);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+		subtract_timespecs(&end, &begin, &delta);
+		instance->total_time +=
+			delta.tv_sec * 1000000000LL + delta.tv_nsec;
+		instance->total_frames += sample_count;
+	}
+}
+
+void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count)
+{
+	int i;
+	struct instance *instance;
+
+	if (pipeline->profile ||
+	    pipeline->runs++ % DSP_PROFILE_INTERVAL == 0) {
+		run_with_profile(pipeline, sample_count);
+		return;
+	}
+
+	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
+		struct dsp_module *module = instance->module;
+		if (instance->optional && pipeline->bypass)
+			bypass_instance(pipeline, instance, sample_count);
+		else
+			module->run(module, sample_count);
+	}
+}
+
+/* Starts bypassing the optional instances when a block of samples took
+ * longer than the budget allows, and stops when the block would have fit
+ * with them again. */
+static void check_cpu_budget(struct pipeline *pipeline, int64_t t,
+			     int samples)
+{
+	int i;
+	struct instance *instance;
+	double limit, estimate;
+
+	if (!pipeline->cpu_budget || !pipeline->sample_rate)
+		return;
+
+	limit = pipeline->cpu_budget / 100 * samples * 1e9 /
+		pipeline->sample_rate;
+	if (t > limit)
+		pipeline->over_budget_blocks++;
+
+	if (!pipeline->bypass) {
+		if (t <= limit)
+			return;
+		ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
+			if (instance->optional)
+				break;
+		}
+		if (i == ARRAY_COUNT(&pipeline->instances))
+			return;
+		pipeline->bypass = 1;
+		syslog(LOG_WARNING,
+		       "dsp %s pipeline over %g%% cpu budget, bypassing "
+		       "optional plugins",
+		       pipeline->purpose, pipeline->cpu_budget);
+		return;
+	}
+
+	estimate = t;
+	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
+		if (instance->optional && instance->total_frames)
+			estimate += (double)instance->total_time /
+				    instance->total_frames * samples;
+	}
+	if (estimate < limit * DSP_BUDGET_RESUME_RATIO) {
+		pipeline->bypass = 0;
+		syslog(LOG_INFO, "dsp %s pipeline back within cpu budget",
+		       pipeline->purpose);
 	}
 }
 
@@ -821,6 +1108,16 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 	pipeline->total_blocks++;
 	pipeline->total_samples += samples;
 	pipeline->total_time += t;
+
+	check_cpu_budget(pipeline, t, samples);
+}
+
+void cras_dsp_pipeline_get_statistic(struct pipeline *pipeline,
+				     int64_t *total_time,
+				     int64_t *total_samples)
+{
+	*total_time = pipeline->total_time;
+	*total_samples = pipeline->total_samples;
 }
 
 int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
@@ -849,22 +1146,33 @@ int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 
 	remaining = frames;
 
-	/* process at most DSP_BUFFER_SIZE frames each loop */
+	/* process at most tile_frames frames each loop */
 	while (remaining > 0) {
-		chunk = MIN(remaining, (size_t)DSP_BUFFER_SIZE);
-
-		/* deinterleave and convert to float */
-		rc = dsp_util_deinterleave(buf, source, input_channels, format,
-					   chunk);
+		chunk = MIN(remaining, (size_t)pipeline->tile_frames);
+
+		/* deinterleave and convert to float, or Q28 */
+		if (pipeline->fixed_point)
+			rc = dsp_util_deinterleave_q28(buf,
+						       (int32_t **)source,
+						       input_channels, format,
+						       chunk);
+		else
+			rc = dsp_util_deinterleave(buf, source, input_channels,
+						   format, chunk);
 		if (rc)
 			return rc;
 
 		/* Run the pipeline */
 		cras_dsp_pipeline_run(pipeline, chunk);
 
-		/* interleave and convert back to int16_t */
-		rc = dsp_util_interleave(sink, buf, output_channels, format,
-					 chunk);
+		/* interleave and convert back to the format */
+		if (pipeline->fixed_point)
+			rc = dsp_util_interleave_q28((int32_t **)sink, buf,
+						     output_channels, format,
+						     chunk);
+		else
+			rc = dsp_util_interleave(sink, buf, output_channels,
+						 format, chunk);
 		if (rc)
 			return rc;
 
@@ -878,6 +1186,73 @@ int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 	return 0;
 }
 
+/* Runs frames of bufs through the pipeline, which has no more input or
+ * output channels than bufs. */
+static void apply_float(struct pipeline *pipeline, float *const *bufs,
+			unsigned int frames)
+{
+	size_t done;
+	size_t chunk;
+	size_t i;
+	unsigned int input_channels = pipeline->input_channels;
+	unsigned int output_channels = pipeline->output_channels;
+	float *source[input_channels];
+	float *sink[output_channels];
+	struct timespec begin, end, delta;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+
+	for (i = 0; i < input_channels; i++)
+		source[i] = cras_dsp_pipeline_get_source_buffer(pipeline, i);
+	for (i = 0; i < output_channels; i++)
+		sink[i] = cras_dsp_pipeline_get_sink_buffer(pipeline, i);
+
+	/* process at most tile_frames frames each loop */
+	for (done = 0; done < frames; done += chunk) {
+		chunk = MIN(frames - done, (size_t)pipeline->tile_frames);
+
+		for (i = 0; i < input_channels; i++) {
+			if (pipeline->fixed_point)
+				dsp_util_float_to_q28(bufs[i] + done,
+						      (int32_t *)source[i],
+						      chunk);
+			else
+				memcpy(source[i], bufs[i] + done,
+				       chunk * sizeof(float));
+		}
+
+		cras_dsp_pipeline_run(pipeline, chunk);
+
+		for (i = 0; i < output_channels; i++) {
+			if (pipeline->fixed_point)
+				dsp_util_q28_to_float((int32_t *)sink[i],
+						      bufs[i] + done, chunk);
+			else
+				memcpy(bufs[i] + done, sink[i],
+				       chunk * sizeof(float));
+		}
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	subtract_timespecs(&end, &begin, &delta);
+	cras_dsp_pipeline_add_statistic(pipeline, &delta, frames);
+}
+
+int cras_dsp_pipeline_apply_float(struct pipeline *pipeline,
+				  float *const *bufs, unsigned int num_channels,
+				  unsigned int frames)
+{
+	if (!pipeline || frames == 0)
+		return 0;
+
+	if ((unsigned int)pipeline->input_channels > num_channels ||
+	    (unsigned int)pipeline->output_channels > num_channels)
+		return -EINVAL;
+
+	apply_float(pipeline, bufs, frames);
+	return 0;
+}
+
 void cras_dsp_pipeline_free(struct pipeline *pipeline)
 {
 	int i;
@@ -956,6 +1331,8 @@ void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline)
 	dumpf(d, " input channels: %d\n", pipeline->input_channels);
 	dumpf(d, " output channels: %d\n", pipeline->output_channels);
 	dumpf(d, " sample_rate: %d\n", pipeline->sample_rate);
+	dumpf(d, " tile frames: %d\n", pipeline->tile_frames);
+	dumpf(d, " fixed point: %d\n", pipeline->fixed_point);
 	dumpf(d, " processed samples: %" PRId64 "\n", pipeline->total_samples);
 	dumpf(d, " processed blocks: %" PRId64 "\n", pipeline->total_blocks);
 	dumpf(d, " total processing time: %" PRId64 "ns\n",
@@ -965,6 +1342,8 @@ void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline)
 		      pipeline->total_samples / pipeline->total_blocks);
 		dumpf(d, " avg processing time per block: %" PRId64 "ns\n",
 		      pipeline->total_time / pipeline->total_blocks);
+		dumpf(d, " avg processing time per frame: %gns\n",
+		      (double)pipeline->total_time / pipeline->total_samples);
 	}
 	dumpf(d, " min processing time per block: %" PRId64 "ns\n",
 	      pipeline->min_time);
@@ -973,11 +1352,22 @@ void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline)
 	dumpf(d, " cpu load: %g%%\n",
 	      pipeline->total_time * 1e-9 / pipeline->total_samples *
 		      pipeline->sample_rate * 100);
+	dumpf(d, " cpu budget: %g%%\n", pipeline->cpu_budget);
+	dumpf(d, " bypassing optional plugins: %d\n", pipeline->bypass);
+	dumpf(d, " blocks over budget: %" PRId64 "\n",
+	      pipeline->over_budget_blocks);
 	dumpf(d, " instances (%d):\n", ARRAY_COUNT(&pipeline->instances));
 	ARRAY_ELEMENT_FOREACH (&pipeline->instances, i, instance) {
 		struct dsp_module *module = instance->module;
 		dumpf(d, "  [%d]%s mod=%p, total delay=%d\n", i,
 		      instance->plugin->title, module, instance->total_delay);
+		if (instance->total_frames)
+			dumpf(d, "   time per frame: %gns\n",
+			      (double)instance->total_time /
+				      instance->total_frames);
+		if (instance->optional)
+			dumpf(d, "   optional, bypassed=%d\n",
+			      pipeline->bypass);
 		if (module)
 			module->dump(module, d);
 		dump_audio_ports(d, "input_audio_ports",
@@ -32,6 +32,11 @@ extern "C" {
  */
 #define DSP_BUFFER_SIZE 2048
 
+/* The number of frames the server runs through the whole pipeline at a
+ * time. Small enough for the buffers of a typical pipeline to stay in L1
+ * cache between instances. */
+#define DSP_TILE_FRAMES 64
+
 struct pipeline;
 
 /* Creates a pipeline from the given ini file.
@@ -51,7 +56,9 @@ void cras_dsp_pipeline_free(struct pipeline *pipeline);
 
 /* Loads the implementation of the plugins in the pipeline (from
  * shared libraries). Must be called before
- * cras_dsp_pipeline_instantiate().
+ * cras_dsp_pipeline_instantiate(). If the source plugin has
+ * "fixed_point=1" and all the plugins can run on Q28 samples, the
+ * pipeline runs in fixed point from then on.
  * Returns:
  *    0 if successful. -1 otherwise.
  */
@@ -84,7 +91,8 @@ int cras_dsp_pipeline_get_num_output_channels(struct pipeline *pipeline);
 /* Returns the pointer to the input buffer for a channel of this
  * pipeline. The size of the buffer is DSP_BUFFER_SIZE samples, and
  * the number of samples acually used should be passed to
- * cras_dsp_pipeline_run().
+ * cras_dsp_pipeline_run(). The samples are int32_t Q28 instead of floats
+ * if cras_dsp_pipeline_is_fixed_point().
  *
  * Args:
  *    index - The channel index. The valid value is 0 to
@@ -94,7 +102,8 @@ float *cras_dsp_pipeline_get_source_buffer(struct pipeline *pipeline,
 					   int index);
 
 /* Returns the pointer to the output buffer for a channel of this
- * pipeline. The size of the buffer is DSP_BUFFER_SIZE samples.
+ * pipeline. The size of the buffer is DSP_BUFFER_SIZE samples, Q28 or
+ * floats like the input buffers.
  *
  * Args:
  *    index - The channel index. The valid value is 0 to
@@ -115,6 +124,21 @@ void cras_dsp_pipeline_set_sink_ext_module(struct pipeline *pipeline,
  * pipeline. This is used by the unit test only */
 int cras_dsp_pipeline_get_peak_audio_buffers(struct pipeline *pipeline);
 
+/* Sets how many frames cras_dsp_pipeline_apply() and
+ * cras_dsp_pipeline_apply_float() run through every instance of the
+ * pipeline before moving on to the next frames. The value is clamped to
+ * [1, DSP_BUFFER_SIZE], which is also the default.
+ */
+void cras_dsp_pipeline_set_tile_frames(struct pipeline *pipeline, int frames);
+
+/* Returns the value set by cras_dsp_pipeline_set_tile_frames(). */
+int cras_dsp_pipeline_get_tile_frames(struct pipeline *pipeline);
+
+/* Returns 1 if the pipeline processes Q28 fixed point samples, 0 if it
+ * processes floats. cras_dsp_pipeline_apply() and
+ * cras_dsp_pipeline_apply_float() convert the samples either way. */
+int cras_dsp_pipeline_is_fixed_point(struct pipeline *pipeline);
+
 /* Returns the sampling rate passed by cras_dsp_pipeline_instantiate(),
  * or 0 if is has not been called */
 int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline);
@@ -122,10 +146,67 @@ int cras_dsp_pipeline_get_sample_rate(struct pipeline *pipeline);
 /* Gets the dsp ini that corresponds to the pipeline. */
 struct ini *cras_dsp_pipeline_get_ini(struct pipeline *pipeline);
 
+/* Returns 1 if a variable read by the disable expression of a plugin in
+ * the ini of the pipeline changed since the pipeline was created, so
+ * creating it again might give a different pipeline. 0 otherwise.
+ * Args:
+ *    env - The environment the pipeline was created with.
+ */
+int cras_dsp_pipeline_is_stale(struct pipeline *pipeline,
+			       const struct cras_expr_env *env);
+
 /* Processes a block of audio samples. sample_count should be no more
  * than DSP_BUFFER_SIZE */
 void cras_dsp_pipeline_run(struct pipeline *pipeline, int sample_count);
 
+/* The time counted for an instance of a pipeline.
+ * Members:
+ *    title - The title of the plugin of the instance.
+ *    total_time - The running time counted, in nanoseconds.
+ *    total_frames - The number of frames total_time was counted for.
+ *    optional - Whether the instance can be bypassed to stay within the
+ *        cpu budget of the pipeline.
+ *    bypassed - Whether the instance is bypassed now.
+ */
+struct dsp_instance_statistic {
+	const char *title;
+	int64_t total_time;
+	int64_t total_frames;
+	int optional;
+	int bypassed;
+};
+
+/* Enables or disables counting the time each instance of the pipeline
+ * takes on every cras_dsp_pipeline_run(). Otherwise it is only counted on
+ * one run in a few, as it costs two clock reads per instance. */
+void cras_dsp_pipeline_set_profile(struct pipeline *pipeline, int enabled);
+
+/* Returns the number of instances in the pipeline, in the order they
+ * run. */
+int cras_dsp_pipeline_get_num_instances(struct pipeline *pipeline);
+
+/* Gets the time counted for an instance.
+ *
+ * Args:
+ *    index - The instance index, from 0 to
+ *            cras_dsp_pipeline_get_num_instances() - 1.
+ *    stat - Filled with the statistic of the instance.
+ * Returns:
+ *    0 if successful. -EINVAL if there is no such instance.
+ */
+int cras_dsp_pipeline_get_instance_statistic(
+	struct pipeline *pipeline, int index,
+	struct dsp_instance_statistic *stat);
+
+/* Sets the cpu budget of the pipeline, in percent of realtime. When a
+ * block passed to cras_dsp_pipeline_add_statistic() took longer than
+ * that, the instances of the plugins marked optional are bypassed until
+ * the pipeline would fit in the budget with them again. 0 disables it.
+ * The default comes from the "cpu_budget" of the source plugin.
+ */
+void cras_dsp_pipeline_set_cpu_budget(struct pipeline *pipeline,
+				      float percent);
+
 /* Add a statistic of running time for the pipeline.
  *
  * Args:
@@ -137,6 +218,16 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 				     const struct timespec *time_delta,
 				     int samples);
 
+/* Gets the statistic added by cras_dsp_pipeline_add_statistic().
+ *
+ * Args:
+ *    total_time - Filled with the total running time in nanoseconds.
+ *    total_samples - Filled with the total number of frames processed.
+ */
+void cras_dsp_pipeline_get_statistic(struct pipeline *pipeline,
+				     int64_t *total_time,
+				     int64_t *total_samples);
+
 /* Runs the specified pipeline across the given interleaved buffer in place.
  * Args:
  *    pipeline - The pipeline to run.
@@ -149,6 +240,20 @@ void cras_dsp_pipeline_add_statistic(struct pipeline *pipeline,
 int cras_dsp_pipeline_apply(struct pipeline *pipeline, uint8_t *buf,
 			    snd_pcm_format_t format, unsigned int frames);
 
+/* Runs the specified pipeline across the given planar float buffers in place.
+ * Args:
+ *    pipeline - The pipeline to run.
+ *    bufs - Pointers to the samples of each channel.
+ *    num_channels - The number of channels in bufs, needs to be at least the
+ *        number of input and output channels of the pipeline.
+ *    frames - the number of samples in each channel.
+ * Returns:
+ *    Negative code if error, otherwise 0.
+ */
+int cras_dsp_pipeline_apply_float(struct pipeline *pipeline,
+				  float *const *bufs, unsigned int num_channels,
+				  unsigned int frames);
+
 /* Dumps the current state of the pipeline. For debugging only */
 void cras_dsp_pipeline_dump(struct dumper *d, struct pipeline *pipeline);
 
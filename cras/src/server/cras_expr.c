@@ -113,36 +113,40 @@ void cras_expr_value_dump(struct dumper *d, const struct cras_expr_value *value)
 	}
 }
 
-static struct cras_expr_value *find_value(struct cras_expr_env *env,
-					  const char *name)
+/* Returns the position of the variable name in env, or -1. */
+static int find_slot(const struct cras_expr_env *env, const char *name)
 {
 	int i;
 	const char **key;
 
 	ARRAY_ELEMENT_FOREACH (&env->keys, i, key) {
 		if (strcmp(*key, name) == 0)
-			return ARRAY_ELEMENT(&env->values, i);
+			return i;
 	}
-	return NULL;
+	return -1;
 }
 
-/* Insert a (key, value) pair to the environment. The value is
- * initialized to zero. Return the pointer to value so it can be set
- * to the proper value. */
-static struct cras_expr_value *insert_value(struct cras_expr_env *env,
-					    const char *key)
+static struct cras_expr_value *find_value(struct cras_expr_env *env,
+					  const char *name)
 {
-	*ARRAY_APPEND_ZERO(&env->keys) = strdup(key);
-	return ARRAY_APPEND_ZERO(&env->values);
+	int slot = find_slot(env, name);
+
+	return slot < 0 ? NULL : ARRAY_ELEMENT(&env->values, slot);
 }
 
-static struct cras_expr_value *find_or_insert_value(struct cras_expr_env *env,
-						    const char *key)
+/* Insert a (key, value) pair to the environment. The value is
+ * initialized to zero. Return the position of the value so it can be set
+ * to the proper value. */
+static int insert_value(struct cras_expr_env *env, const char *key)
 {
-	struct cras_expr_value *value = find_value(env, key);
-	if (!value)
-		value = insert_value(env, key);
-	return value;
+	static unsigned int last_env_id;
+
+	if (!env->id)
+		env->id = ++last_env_id;
+	*ARRAY_APPEND_ZERO(&env->keys) = strdup(key);
+	ARRAY_APPEND_ZERO(&env->values);
+	ARRAY_APPEND_ZERO(&env->changed);
+	return ARRAY_COUNT(&env->values) - 1;
 }
 
 static void function_not(cras_expr_value_array *operands,
@@ -210,6 +214,27 @@ static void function_or(cras_expr_value_array *operands,
 	value_set_boolean(result, 0);
 }
 
+static int values_equal(const struct cras_expr_value *a,
+			const struct cras_expr_value *b)
+{
+	if (a->type != b->type)
+		return 0;
+
+	switch (a->type) {
+	case CRAS_EXPR_VALUE_TYPE_NONE:
+		break;
+	case CRAS_EXPR_VALUE_TYPE_BOOLEAN:
+		return a->u.boolean == b->u.boolean;
+	case CRAS_EXPR_VALUE_TYPE_INT:
+		return a->u.integer == b->u.integer;
+	case CRAS_EXPR_VALUE_TYPE_STRING:
+		return strcmp(a->u.string, b->u.string) == 0;
+	case CRAS_EXPR_VALUE_TYPE_FUNCTION:
+		return a->u.function == b->u.function;
+	}
+	return 1;
+}
+
 static char function_equal_real(cras_expr_value_array *operands)
 {
 	int i;
@@ -221,30 +246,8 @@ static char function_equal_real(cras_expr_value_array *operands)
 		/* compare with the previous operand */
 
 		prev = ARRAY_ELEMENT(operands, i - 1);
-
-		if (prev->type != value->type)
+		if (!values_equal(prev, value))
 			return 0;
-
-		switch (prev->type) {
-		case CRAS_EXPR_VALUE_TYPE_NONE:
-			break;
-		case CRAS_EXPR_VALUE_TYPE_BOOLEAN:
-			if (prev->u.boolean != value->u.boolean)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_INT:
-			if (prev->u.integer != value->u.integer)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_STRING:
-			if (strcmp(prev->u.string, value->u.string) != 0)
-				return 0;
-			break;
-		case CRAS_EXPR_VALUE_TYPE_FUNCTION:
-			if (prev->u.function != value->u.function)
-				return 0;
-			break;
-		}
 	}
 
 	return 1;
@@ -256,11 +259,18 @@ static void function_equal(cras_expr_value_array *operands,
 	value_set_boolean(result, function_equal_real(operands));
 }
 
+/* Sets a variable, counting a change if the value is different. */
 static void env_set_variable(struct cras_expr_env *env, const char *name,
 			     struct cras_expr_value *new_value)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	copy_value(value, new_value);
+	int slot = find_slot(env, name);
+
+	if (slot < 0)
+		slot = insert_value(env, name);
+	else if (values_equal(ARRAY_ELEMENT(&env->values, slot), new_value))
+		return;
+	copy_value(ARRAY_ELEMENT(&env->values, slot), new_value);
+	*ARRAY_ELEMENT(&env->changed, slot) = ++env->serial;
 }
 
 void cras_expr_env_install_builtins(struct cras_expr_env *env)
@@ -286,22 +296,34 @@ void cras_expr_env_install_builtins(struct cras_expr_env *env)
 void cras_expr_env_set_variable_boolean(struct cras_expr_env *env,
 					const char *name, char boolean)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_boolean(value, boolean);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_boolean(&value, boolean);
+	env_set_variable(env, name, &value);
 }
 
 void cras_expr_env_set_variable_integer(struct cras_expr_env *env,
 					const char *name, int integer)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_integer(value, integer);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_integer(&value, integer);
+	env_set_variable(env, name, &value);
 }
 
 void cras_expr_env_set_variable_string(struct cras_expr_env *env,
 				       const char *name, const char *str)
 {
-	struct cras_expr_value *value = find_or_insert_value(env, name);
-	value_set_string(value, str);
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	value_set_string(&value, str);
+	env_set_variable(env, name, &value);
+	cras_expr_value_free(&value);
+}
+
+unsigned int cras_expr_env_get_serial(const struct cras_expr_env *env)
+{
+	return env->serial;
 }
 
 void cras_expr_env_free(struct cras_expr_env *env)
@@ -320,6 +342,9 @@ void cras_expr_env_free(struct cras_expr_env *env)
 
 	ARRAY_FREE(&env->keys);
 	ARRAY_FREE(&env->values);
+	ARRAY_FREE(&env->changed);
+	env->serial = 0;
+	env->id = 0;
 }
 
 void cras_expr_env_dump(struct dumper *d, const struct cras_expr_env *env)
@@ -651,3 +676,235 @@ int cras_expr_expression_eval_boolean(struct cras_expr_expression *expr,
 	cras_expr_value_free(&value);
 	return rc;
 }
+
+/* Compiled expression */
+
+enum op_type {
+	OP_LITERAL, /* pushes a copy of literal */
+	OP_VARIABLE, /* pushes a copy of the variable names[arg] */
+	OP_CALL, /* calls the function under the top arg values */
+};
+
+struct op {
+	enum op_type type;
+	int arg;
+	struct cras_expr_value literal;
+};
+
+DECLARE_ARRAY_TYPE(struct op, op_array);
+DECLARE_ARRAY_TYPE(int, int_array);
+
+struct cras_expr_program {
+	op_array ops;
+	/* The variables the program reads. */
+	string_array names;
+	/* Where the variables are in the environment of the last
+	 * evaluation, -1 for the missing ones. Valid while the environment
+	 * has the same id and number of keys. */
+	int_array slots;
+	unsigned int env_id;
+	int env_keys;
+	/* Kept between evaluations to save allocations. */
+	cras_expr_value_array stack;
+};
+
+static int add_name(struct cras_expr_program *prog, const char *name)
+{
+	int i;
+	const char **p;
+
+	ARRAY_ELEMENT_FOREACH (&prog->names, i, p) {
+		if (strcmp(*p, name) == 0)
+			return i;
+	}
+	ARRAY_APPEND(&prog->names, strdup(name));
+	ARRAY_APPEND(&prog->slots, -1);
+	return ARRAY_COUNT(&prog->names) - 1;
+}
+
+static void compile_one_expression(struct cras_expr_program *prog,
+				   const struct cras_expr_expression *expr)
+{
+	struct cras_expr_expression **sub;
+	struct op *op;
+	int i;
+
+	switch (expr->type) {
+	case EXPR_TYPE_NONE:
+		break;
+	case EXPR_TYPE_LITERAL:
+		op = ARRAY_APPEND_ZERO(&prog->ops);
+		op->type = OP_LITERAL;
+		copy_value(&op->literal,
+			   (struct cras_expr_value *)&expr->u.literal);
+		break;
+	case EXPR_TYPE_VARIABLE:
+		i = add_name(prog, expr->u.variable);
+		op = ARRAY_APPEND_ZERO(&prog->ops);
+		op->type = OP_VARIABLE;
+		op->arg = i;
+		break;
+	case EXPR_TYPE_COMPOUND:
+		ARRAY_ELEMENT_FOREACH (&expr->u.children, i, sub) {
+			compile_one_expression(prog, *sub);
+		}
+		op = ARRAY_APPEND_ZERO(&prog->ops);
+		op->type = OP_CALL;
+		op->arg = ARRAY_COUNT(&expr->u.children);
+		break;
+	}
+}
+
+struct cras_expr_program *
+cras_expr_program_compile(const struct cras_expr_expression *expr)
+{
+	struct cras_expr_program *prog;
+
+	if (!expr)
+		return NULL;
+	prog = calloc(1, sizeof(*prog));
+	compile_one_expression(prog, expr);
+	return prog;
+}
+
+void cras_expr_program_free(struct cras_expr_program *prog)
+{
+	int i;
+	struct op *op;
+	const char **name;
+
+	if (!prog)
+		return;
+	ARRAY_ELEMENT_FOREACH (&prog->ops, i, op) {
+		cras_expr_value_free(&op->literal);
+	}
+	ARRAY_ELEMENT_FOREACH (&prog->names, i, name) {
+		free((char *)*name);
+	}
+	ARRAY_FREE(&prog->ops);
+	ARRAY_FREE(&prog->names);
+	ARRAY_FREE(&prog->slots);
+	ARRAY_FREE(&prog->stack);
+	free(prog);
+}
+
+/* Finds the variables of the program in env, unless it is the same
+ * environment as last time and no variable was added since. */
+static void resolve_slots(struct cras_expr_program *prog,
+			  const struct cras_expr_env *env)
+{
+	int i;
+	const char **name;
+
+	if (prog->env_id == env->id &&
+	    prog->env_keys == ARRAY_COUNT(&env->keys))
+		return;
+	ARRAY_ELEMENT_FOREACH (&prog->names, i, name) {
+		*ARRAY_ELEMENT(&prog->slots, i) = find_slot(env, *name);
+	}
+	prog->env_id = env->id;
+	prog->env_keys = ARRAY_COUNT(&env->keys);
+}
+
+/* Replaces the top n values of the stack with the result of calling the
+ * function in the first of them. */
+static void call_function(cras_expr_value_array *stack, int n)
+{
+	struct cras_expr_value result = CRAS_EXPR_VALUE_INIT;
+	cras_expr_value_array operands;
+	struct cras_expr_value *value;
+	int i;
+
+	/* The operands are the top of the stack, in place. */
+	operands.count = n;
+	operands.size = n;
+	operands.element = ARRAY_ELEMENT(stack, ARRAY_COUNT(stack) - n);
+
+	if (n > 0) {
+		value = ARRAY_ELEMENT(&operands, 0);
+		if (value->type == CRAS_EXPR_VALUE_TYPE_FUNCTION)
+			value->u.function(&operands, &result);
+		else
+			syslog(LOG_ERR, "first element is not a function");
+	} else {
+		syslog(LOG_ERR, "empty compound expression?");
+	}
+
+	ARRAY_ELEMENT_FOREACH (&operands, i, value) {
+		cras_expr_value_free(value);
+	}
+	stack->count -= n;
+	*ARRAY_APPEND_ZERO(stack) = result;
+}
+
+void cras_expr_program_eval(struct cras_expr_program *prog,
+			    struct cras_expr_env *env,
+			    struct cras_expr_value *result)
+{
+	cras_expr_value_array *stack = &prog->stack;
+	struct cras_expr_value *value;
+	struct op *op;
+	int i, slot;
+
+	cras_expr_value_free(result);
+	resolve_slots(prog, env);
+
+	ARRAY_ELEMENT_FOREACH (&prog->ops, i, op) {
+		switch (op->type) {
+		case OP_LITERAL:
+			copy_value(ARRAY_APPEND_ZERO(stack), &op->literal);
+			break;
+		case OP_VARIABLE:
+			value = ARRAY_APPEND_ZERO(stack);
+			slot = *ARRAY_ELEMENT(&prog->slots, op->arg);
+			if (slot < 0)
+				syslog(LOG_ERR, "cannot find value for %s",
+				       *ARRAY_ELEMENT(&prog->names, op->arg));
+			else
+				copy_value(value,
+					   ARRAY_ELEMENT(&env->values, slot));
+			break;
+		case OP_CALL:
+			call_function(stack, op->arg);
+			break;
+		}
+	}
+
+	/* The value of a whole expression is left on the stack. */
+	if (ARRAY_COUNT(stack)) {
+		*result = *ARRAY_ELEMENT(stack, 0);
+		stack->count = 0;
+	}
+}
+
+int cras_expr_program_eval_boolean(struct cras_expr_program *prog,
+				   struct cras_expr_env *env, char *boolean)
+{
+	int rc = 0;
+	struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+
+	cras_expr_program_eval(prog, env, &value);
+	if (value.type == CRAS_EXPR_VALUE_TYPE_BOOLEAN) {
+		*boolean = value.u.boolean;
+	} else {
+		syslog(LOG_ERR, "value type is not boolean (%d)", value.type);
+		rc = -1;
+	}
+	cras_expr_value_free(&value);
+	return rc;
+}
+
+int cras_expr_program_changed_since(struct cras_expr_program *prog,
+				    const struct cras_expr_env *env,
+				    unsigned int serial)
+{
+	int i;
+	int *slot;
+
+	resolve_slots(prog, env);
+	ARRAY_ELEMENT_FOREACH (&prog->slots, i, slot) {
+		if (*slot >= 0 && *ARRAY_ELEMENT(&env->changed, *slot) > serial)
+			return 1;
+	}
+	return 0;
+}
@@ -65,10 +65,18 @@ struct cras_expr_expression {
 /* Environment */
 
 DECLARE_ARRAY_TYPE(const char *, string_array);
+DECLARE_ARRAY_TYPE(unsigned int, serial_array);
 
 struct cras_expr_env {
 	string_array keys;
 	cras_expr_value_array values;
+	/* The serial of the last change of each value */
+	serial_array changed;
+	/* Counts the changes of the values */
+	unsigned int serial;
+	/* Tells environments apart, for the programs which cache where the
+	 * variables are. Assigned when the first key is added. */
+	unsigned int id;
 };
 
 /* initial value for the environment type is zero */
@@ -101,6 +109,39 @@ void cras_expr_value_free(struct cras_expr_value *value);
 void cras_expr_value_dump(struct dumper *d,
 			  const struct cras_expr_value *value);
 
+/* Returns the serial of the latest change of the variables in env. Used
+ * with cras_expr_program_changed_since(). */
+unsigned int cras_expr_env_get_serial(const struct cras_expr_env *env);
+
+/* Compiled expression
+ *
+ * An expression compiled to a sequence of operations on a stack. The
+ * variables are looked up by name once per environment and then read by
+ * their position in it, so evaluating a program doesn't walk the tree or
+ * compare strings. It also knows the variables it reads, which tells when
+ * its value may have changed.
+ */
+
+struct cras_expr_program;
+
+/* Compiles expr. The program doesn't refer to expr once compiled.
+ * Returns NULL if expr is NULL. */
+struct cras_expr_program *
+cras_expr_program_compile(const struct cras_expr_expression *expr);
+void cras_expr_program_free(struct cras_expr_program *prog);
+/* The same as cras_expr_expression_eval() and
+ * cras_expr_expression_eval_boolean() for a compiled expression. */
+void cras_expr_program_eval(struct cras_expr_program *prog,
+			    struct cras_expr_env *env,
+			    struct cras_expr_value *value);
+int cras_expr_program_eval_boolean(struct cras_expr_program *prog,
+				   struct cras_expr_env *env, char *boolean);
+/* Returns 1 if a variable the program reads was set to a different value
+ * in env after cras_expr_env_get_serial() returned serial, 0 otherwise. */
+int cras_expr_program_changed_since(struct cras_expr_program *prog,
+				    const struct cras_expr_env *env,
+				    unsigned int serial);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -9,6 +9,7 @@
 #include <syslog.h>
 #include <endian.h>
 #include <limits.h>
+#include <string.h>
 
 #include "cras_fmt_conv.h"
 #include "cras_fmt_conv_ops.h"
@@ -24,6 +25,13 @@
 /* Channel index for stereo. */
 #define STEREO_L 0
 #define STEREO_R 1
+/* Frames converted at a time when the stages run without SRC, small enough
+ * for the intermediate buffers to stay in cache. */
+#define FMT_CONV_BLOCK_FRAMES 256
+/* Scale between S32_LE samples and the float samples given to speex, float
+ * samples are kept in S16 range so they also work with fixed point builds of
+ * speex. */
+#define SPEEX_FLOAT_SCALE 65536.0f
 
 typedef void (*sample_format_converter_t)(const uint8_t *in, size_t in_samples,
 					  uint8_t *out);
@@ -31,17 +39,29 @@ typedef size_t (*channel_converter_t)(struct cras_fmt_conv *conv,
 				      const uint8_t *in, size_t in_frames,
 				      uint8_t *out);
 
-/* Member data for the resampler. */
+/* Member data for the resampler.
+ *    mid_format - Format channel conversion and SRC work in, S16_LE unless
+ *        the input or output has more bits, then S32_LE so none are lost.
+ *    fused_converter - Converts input to output format and channels in one
+ *        pass, set for common conversions when nothing else is needed.
+ *    block_bufs - Intermediate buffers of FMT_CONV_BLOCK_FRAMES frames used
+ *        when no SRC is needed.
+ *    speex_bufs - Float buffers in and out of speex for S32_LE mid_format.
+ */
 struct cras_fmt_conv {
 	SpeexResamplerState *speex_state;
 	channel_converter_t channel_converter;
+	channel_converter_t fused_converter;
 	float **ch_conv_mtx; /* Coefficient matrix for mixing channels. */
 	sample_format_converter_t in_format_converter;
 	sample_format_converter_t out_format_converter;
 	struct linear_resampler *resampler;
 	struct cras_audio_format in_fmt;
 	struct cras_audio_format out_fmt;
+	snd_pcm_format_t mid_format;
 	uint8_t *tmp_bufs[MAX_NUM_CONVERTERS - 1];
+	uint8_t *block_bufs[2];
+	float *speex_bufs[2];
 	size_t tmp_buf_frames;
 	size_t pre_linear_resample;
 	size_t num_converters; /* Incremented once for SRC, channel, format. */
@@ -124,15 +144,88 @@ static int is_supported_format(const struct cras_audio_format *fmt)
 	}
 }
 
+static int is_wide_format(snd_pcm_format_t format)
+{
+	return PCM_FORMAT_WIDTH(format) > 16;
+}
+
+static sample_format_converter_t to_s16le_converter(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return convert_u8_to_s16le;
+	case SND_PCM_FORMAT_S24_LE:
+		return convert_s24le_to_s16le;
+	case SND_PCM_FORMAT_S32_LE:
+		return convert_s32le_to_s16le;
+	case SND_PCM_FORMAT_S24_3LE:
+		return convert_s243le_to_s16le;
+	default:
+		return NULL;
+	}
+}
+
+static sample_format_converter_t from_s16le_converter(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return convert_s16le_to_u8;
+	case SND_PCM_FORMAT_S24_LE:
+		return convert_s16le_to_s24le;
+	case SND_PCM_FORMAT_S32_LE:
+		return convert_s16le_to_s32le;
+	case SND_PCM_FORMAT_S24_3LE:
+		return convert_s16le_to_s243le;
+	default:
+		return NULL;
+	}
+}
+
+static sample_format_converter_t to_s32le_converter(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return convert_u8_to_s32le;
+	case SND_PCM_FORMAT_S16_LE:
+		return convert_s16le_to_s32le;
+	case SND_PCM_FORMAT_S24_LE:
+		return convert_s24le_to_s32le;
+	case SND_PCM_FORMAT_S24_3LE:
+		return convert_s243le_to_s32le;
+	default:
+		return NULL;
+	}
+}
+
+static sample_format_converter_t from_s32le_converter(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return convert_s32le_to_u8;
+	case SND_PCM_FORMAT_S16_LE:
+		return convert_s32le_to_s16le;
+	case SND_PCM_FORMAT_S24_LE:
+		return convert_s32le_to_s24le;
+	case SND_PCM_FORMAT_S24_3LE:
+		return convert_s32le_to_s243le;
+	default:
+		return NULL;
+	}
+}
+
 static size_t mono_to_stereo(struct cras_fmt_conv *conv, const uint8_t *in,
 			     size_t in_frames, uint8_t *out)
 {
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_mono_to_stereo(in, in_frames, out);
 	return s16_mono_to_stereo(in, in_frames, out);
 }
 
 static size_t stereo_to_mono(struct cras_fmt_conv *conv, const uint8_t *in,
 			     size_t in_frames, uint8_t *out)
 {
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_stereo_to_mono(in, in_frames, out);
 	return s16_stereo_to_mono(in, in_frames, out);
 }
 
@@ -145,6 +238,8 @@ static size_t mono_to_51(struct cras_fmt_conv *conv, const uint8_t *in,
 	right = conv->out_fmt.channel_layout[CRAS_CH_FR];
 	center = conv->out_fmt.channel_layout[CRAS_CH_FC];
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_mono_to_51(left, right, center, in, in_frames, out);
 	return s16_mono_to_51(left, right, center, in, in_frames, out);
 }
 
@@ -157,12 +252,17 @@ static size_t stereo_to_51(struct cras_fmt_conv *conv, const uint8_t *in,
 	right = conv->out_fmt.channel_layout[CRAS_CH_FR];
 	center = conv->out_fmt.channel_layout[CRAS_CH_FC];
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_stereo_to_51(left, right, center, in, in_frames,
+					out);
 	return s16_stereo_to_51(left, right, center, in, in_frames, out);
 }
 
 static size_t _51_to_stereo(struct cras_fmt_conv *conv, const uint8_t *in,
 			    size_t in_frames, uint8_t *out)
 {
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_51_to_stereo(in, in_frames, out);
 	return s16_51_to_stereo(in, in_frames, out);
 }
 
@@ -176,6 +276,9 @@ static size_t stereo_to_quad(struct cras_fmt_conv *conv, const uint8_t *in,
 	rear_left = conv->out_fmt.channel_layout[CRAS_CH_RL];
 	rear_right = conv->out_fmt.channel_layout[CRAS_CH_RR];
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_stereo_to_quad(front_left, front_right, rear_left,
+					  rear_right, in, in_frames, out);
 	return s16_stereo_to_quad(front_left, front_right, rear_left,
 				  rear_right, in, in_frames, out);
 }
@@ -190,6 +293,9 @@ static size_t quad_to_stereo(struct cras_fmt_conv *conv, const uint8_t *in,
 	rear_left = conv->in_fmt.channel_layout[CRAS_CH_RL];
 	rear_right = conv->in_fmt.channel_layout[CRAS_CH_RR];
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_quad_to_stereo(front_left, front_right, rear_left,
+					  rear_right, in, in_frames, out);
 	return s16_quad_to_stereo(front_left, front_right, rear_left,
 				  rear_right, in, in_frames, out);
 }
@@ -202,6 +308,9 @@ static size_t default_all_to_all(struct cras_fmt_conv *conv, const uint8_t *in,
 	num_in_ch = conv->in_fmt.num_channels;
 	num_out_ch = conv->out_fmt.num_channels;
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_default_all_to_all(&conv->out_fmt, num_in_ch,
+					      num_out_ch, in, in_frames, out);
 	return s16_default_all_to_all(&conv->out_fmt, num_in_ch, num_out_ch, in,
 				      in_frames, out);
 }
@@ -216,10 +325,157 @@ static size_t convert_channels(struct cras_fmt_conv *conv, const uint8_t *in,
 	num_in_ch = conv->in_fmt.num_channels;
 	num_out_ch = conv->out_fmt.num_channels;
 
+	if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+		return s32_convert_channels(ch_conv_mtx, num_in_ch, num_out_ch,
+					    in, in_frames, out);
 	return s16_convert_channels(ch_conv_mtx, num_in_ch, num_out_ch, in,
 				    in_frames, out);
 }
 
+static size_t s16le_mono_to_s32le_stereo_fused(struct cras_fmt_conv *conv,
+					       const uint8_t *in,
+					       size_t in_frames, uint8_t *out)
+{
+	return s16le_mono_to_s32le_stereo(in, in_frames, out, 16);
+}
+
+static size_t s16le_mono_to_s24le_stereo_fused(struct cras_fmt_conv *conv,
+					       const uint8_t *in,
+					       size_t in_frames, uint8_t *out)
+{
+	return s16le_mono_to_s32le_stereo(in, in_frames, out, 8);
+}
+
+static size_t s32le_stereo_to_s16le_mono_fused(struct cras_fmt_conv *conv,
+					       const uint8_t *in,
+					       size_t in_frames, uint8_t *out)
+{
+	return s32le_stereo_to_s16le_mono(in, in_frames, out);
+}
+
+static size_t s32le_51_to_s16le_stereo_fused(struct cras_fmt_conv *conv,
+					     const uint8_t *in,
+					     size_t in_frames, uint8_t *out)
+{
+	return s32le_51_to_s16le_stereo(in, in_frames, out);
+}
+
+/* Conversions done in a single pass, each gives the same output as the chain
+ * of format and channel converters it replaces. */
+static const struct {
+	snd_pcm_format_t in_format;
+	snd_pcm_format_t out_format;
+	channel_converter_t channel_converter;
+	channel_converter_t fused_converter;
+} fused_converters[] = {
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S32_LE, mono_to_stereo,
+	  s16le_mono_to_s32le_stereo_fused },
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_LE, mono_to_stereo,
+	  s16le_mono_to_s24le_stereo_fused },
+	{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE, stereo_to_mono,
+	  s32le_stereo_to_s16le_mono_fused },
+	{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE, _51_to_stereo,
+	  s32le_51_to_s16le_stereo_fused },
+};
+
+static channel_converter_t find_fused_converter(struct cras_fmt_conv *conv)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(fused_converters); i++) {
+		if (fused_converters[i].in_format == conv->in_fmt.format &&
+		    fused_converters[i].out_format == conv->out_fmt.format &&
+		    fused_converters[i].channel_converter ==
+			    conv->channel_converter)
+			return fused_converters[i].fused_converter;
+	}
+	return NULL;
+}
+
+/* Converts frames without SRC. Runs the fused converter if there is one,
+ * otherwise the format and channel converters over blocks of frames so the
+ * intermediate samples stay in cache. */
+static void convert_frames_no_src(struct cras_fmt_conv *conv,
+				  const uint8_t *in_buf, uint8_t *out_buf,
+				  size_t frames)
+{
+	size_t in_frame_bytes = cras_get_format_bytes(&conv->in_fmt);
+	size_t out_frame_bytes = cras_get_format_bytes(&conv->out_fmt);
+	size_t mid_in_samples, mid_out_samples;
+	size_t done, block;
+	const uint8_t *src;
+	uint8_t *dst;
+	unsigned int buf_idx;
+
+	if (conv->fused_converter) {
+		conv->fused_converter(conv, in_buf, frames, out_buf);
+		return;
+	}
+
+	if (!conv->in_format_converter && !conv->channel_converter &&
+	    !conv->out_format_converter) {
+		memcpy(out_buf, in_buf, frames * in_frame_bytes);
+		return;
+	}
+
+	for (done = 0; done < frames; done += block) {
+		block = MIN(frames - done, FMT_CONV_BLOCK_FRAMES);
+		mid_in_samples = block * conv->in_fmt.num_channels;
+		mid_out_samples = block * conv->out_fmt.num_channels;
+		src = in_buf + done * in_frame_bytes;
+		buf_idx = 0;
+
+		if (conv->in_format_converter) {
+			dst = (conv->channel_converter ||
+			       conv->out_format_converter) ?
+				      conv->block_bufs[buf_idx++] :
+				      out_buf + done * out_frame_bytes;
+			conv->in_format_converter(src, mid_in_samples, dst);
+			src = dst;
+		}
+		if (conv->channel_converter) {
+			dst = conv->out_format_converter ?
+				      conv->block_bufs[buf_idx++] :
+				      out_buf + done * out_frame_bytes;
+			conv->channel_converter(conv, src, block, dst);
+			src = dst;
+		}
+		if (conv->out_format_converter)
+			conv->out_format_converter(src, mid_out_samples,
+						   out_buf + done *
+								     out_frame_bytes);
+	}
+}
+
+/* Resamples S32_LE samples with speex through its float interface. */
+static void speex_process_s32le(struct cras_fmt_conv *conv, const uint8_t *in,
+				uint32_t *in_frames, uint8_t *out,
+				uint32_t *out_frames)
+{
+	const int32_t *in32 = (const int32_t *)in;
+	int32_t *out32 = (int32_t *)out;
+	size_t num_channels = conv->out_fmt.num_channels;
+	size_t i;
+	float f;
+
+	for (i = 0; i < *in_frames * num_channels; i++)
+		conv->speex_bufs[0][i] = in32[i] / SPEEX_FLOAT_SCALE;
+
+	speex_resampler_process_interleaved_float(
+		conv->speex_state, conv->speex_bufs[0], in_frames,
+		conv->speex_bufs[1], out_frames);
+
+	for (i = 0; i < *out_frames * num_channels; i++) {
+		f = conv->speex_bufs[1][i] * SPEEX_FLOAT_SCALE;
+		if (f >= (float)INT_MAX)
+			out32[i] = INT_MAX;
+		else if (f <= (float)INT_MIN)
+			out32[i] = INT_MIN;
+		else
+			out32[i] = (int32_t)f;
+	}
+}
+
 /*
  * Exported interface
  */
@@ -253,52 +509,35 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 		return NULL;
 	}
 
-	/* Set up sample format conversion. */
-	/* TODO(dgreid) - modify channel and sample rate conversion so
-	 * converting to s16 isnt necessary. */
-	if (in->format != SND_PCM_FORMAT_S16_LE) {
+	/* Set up sample format conversion. Channel conversion and SRC run on
+	 * S16_LE samples, or on S32_LE when either end has more than 16 bits
+	 * so those aren't truncated on the way through. */
+	if (is_wide_format(in->format) || is_wide_format(out->format))
+		conv->mid_format = SND_PCM_FORMAT_S32_LE;
+	else
+		conv->mid_format = SND_PCM_FORMAT_S16_LE;
+
+	if (in->format != conv->mid_format) {
 		conv->num_converters++;
 		syslog(LOG_DEBUG, "Convert from format %d to %d.", in->format,
-		       out->format);
-		switch (in->format) {
-		case SND_PCM_FORMAT_U8:
-			conv->in_format_converter = convert_u8_to_s16le;
-			break;
-		case SND_PCM_FORMAT_S24_LE:
-			conv->in_format_converter = convert_s24le_to_s16le;
-			break;
-		case SND_PCM_FORMAT_S32_LE:
-			conv->in_format_converter = convert_s32le_to_s16le;
-			break;
-		case SND_PCM_FORMAT_S24_3LE:
-			conv->in_format_converter = convert_s243le_to_s16le;
-			break;
-		default:
-			syslog(LOG_ERR, "Should never reachable");
-			break;
-		}
+		       conv->mid_format);
+		if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+			conv->in_format_converter =
+				to_s32le_converter(in->format);
+		else
+			conv->in_format_converter =
+				to_s16le_converter(in->format);
 	}
-	if (out->format != SND_PCM_FORMAT_S16_LE) {
+	if (out->format != conv->mid_format) {
 		conv->num_converters++;
-		syslog(LOG_DEBUG, "Convert from format %d to %d.", in->format,
-		       out->format);
-		switch (out->format) {
-		case SND_PCM_FORMAT_U8:
-			conv->out_format_converter = convert_s16le_to_u8;
-			break;
-		case SND_PCM_FORMAT_S24_LE:
-			conv->out_format_converter = convert_s16le_to_s24le;
-			break;
-		case SND_PCM_FORMAT_S32_LE:
-			conv->out_format_converter = convert_s16le_to_s32le;
-			break;
-		case SND_PCM_FORMAT_S24_3LE:
-			conv->out_format_converter = convert_s16le_to_s243le;
-			break;
-		default:
-			syslog(LOG_ERR, "Should never reachable");
-			break;
-		}
+		syslog(LOG_DEBUG, "Convert from format %d to %d.",
+		       conv->mid_format, out->format);
+		if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+			conv->out_format_converter =
+				from_s32le_converter(out->format);
+		else
+			conv->out_format_converter =
+				from_s16le_converter(out->format);
 	}
 
 	/* Set up channel number conversion. */
@@ -381,6 +620,18 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 			cras_fmt_conv_destroy(&conv);
 			return NULL;
 		}
+		if (conv->mid_format == SND_PCM_FORMAT_S32_LE) {
+			for (i = 0; i < ARRAY_SIZE(conv->speex_bufs); i++) {
+				conv->speex_bufs[i] = (float *)malloc(
+					max_frames * sizeof(float) *
+					MAX(in->num_channels,
+					    out->num_channels));
+				if (conv->speex_bufs[i] == NULL) {
+					cras_fmt_conv_destroy(&conv);
+					return NULL;
+				}
+			}
+		}
 	}
 
 	/*
@@ -390,12 +641,23 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 	 * (i.e. out->frame_rate).  They will be updated in runtime in
 	 * update_estimated_rate() when the audio thread wants to adjust the
 	 * rate for inaccurate device consumption rate.
+	 *
+	 * Pre linear resampling works on the input samples as they are, post
+	 * linear resampling on the mid_format samples before the output format
+	 * conversion. Input formats the linear resampler can't handle are
+	 * resampled after the conversion to S16_LE instead.
 	 */
 	conv->num_converters++;
-	conv->resampler =
-		linear_resampler_create(out->num_channels,
-					cras_get_format_bytes(out),
-					out->frame_rate, out->frame_rate);
+	if (pre_linear_resample)
+		conv->resampler = linear_resampler_create(
+			in->num_channels, in->format, out->frame_rate,
+			out->frame_rate);
+	if (conv->resampler == NULL) {
+		conv->pre_linear_resample = 0;
+		conv->resampler = linear_resampler_create(
+			out->num_channels, conv->mid_format, out->frame_rate,
+			out->frame_rate);
+	}
 	if (conv->resampler == NULL) {
 		syslog(LOG_ERR, "Fail to create linear resampler");
 		cras_fmt_conv_destroy(&conv);
@@ -414,6 +676,19 @@ struct cras_fmt_conv *cras_fmt_conv_create(const struct cras_audio_format *in,
 		}
 	}
 
+	if (!conv->speex_state) {
+		conv->fused_converter = find_fused_converter(conv);
+		for (i = 0; i < ARRAY_SIZE(conv->block_bufs); i++) {
+			conv->block_bufs[i] = malloc(
+				FMT_CONV_BLOCK_FRAMES * 4 *
+				MAX(in->num_channels, out->num_channels));
+			if (conv->block_bufs[i] == NULL) {
+				cras_fmt_conv_destroy(&conv);
+				return NULL;
+			}
+		}
+	}
+
 	assert(conv->num_converters <= MAX_NUM_CONVERTERS);
 
 	return conv;
@@ -433,6 +708,10 @@ void cras_fmt_conv_destroy(struct cras_fmt_conv **convp)
 		linear_resampler_destroy(conv->resampler);
 	for (i = 0; i < MAX_NUM_CONVERTERS - 1; i++)
 		free(conv->tmp_bufs[i]);
+	for (i = 0; i < ARRAY_SIZE(conv->block_bufs); i++)
+		free(conv->block_bufs[i]);
+	for (i = 0; i < ARRAY_SIZE(conv->speex_bufs); i++)
+		free(conv->speex_bufs[i]);
 	free(conv);
 	*convp = NULL;
 }
@@ -578,6 +857,13 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 	}
 	fr_out = fr_in;
 
+	if (conv->speex_state == NULL &&
+	    !linear_resampler_needed(conv->resampler)) {
+		convert_frames_no_src(conv, in_buf, out_buf, fr_in);
+		*in_frames = fr_in;
+		return fr_out;
+	}
+
 	/* Set up a chain of buffers.  The output buffer of the first conversion
 	 * is used as input to the second and so forth, ending in the output
 	 * buffer. */
@@ -620,8 +906,8 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		buf_idx++;
 	}
 
-	/* If the input format isn't S16_LE convert to it. */
-	if (conv->in_fmt.format != SND_PCM_FORMAT_S16_LE) {
+	/* If the input format isn't mid_format convert to it. */
+	if (conv->in_format_converter) {
 		conv->in_format_converter(buffers[buf_idx],
 					  fr_in * conv->in_fmt.num_channels,
 					  (uint8_t *)buffers[buf_idx + 1]);
@@ -652,9 +938,14 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		}
 		/* limit frames to the output size. */
 		fr_out = MIN(fr_out, out_limit);
-		speex_resampler_process_interleaved_int(
-			conv->speex_state, (int16_t *)buffers[buf_idx], &fr_in,
-			(int16_t *)buffers[buf_idx + 1], &fr_out);
+		if (conv->mid_format == SND_PCM_FORMAT_S32_LE)
+			speex_process_s32le(conv, buffers[buf_idx], &fr_in,
+					    buffers[buf_idx + 1], &fr_out);
+		else
+			speex_resampler_process_interleaved_int(
+				conv->speex_state, (int16_t *)buffers[buf_idx],
+				&fr_in, (int16_t *)buffers[buf_idx + 1],
+				&fr_out);
 		buf_idx++;
 	}
 
@@ -667,8 +958,8 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
 		buf_idx++;
 	}
 
-	/* If the output format isn't S16_LE convert to it. */
-	if (conv->out_fmt.format != SND_PCM_FORMAT_S16_LE) {
+	/* If the output format isn't mid_format convert to it. */
+	if (conv->out_format_converter) {
 		conv->out_format_converter(buffers[buf_idx],
 					   fr_out * conv->out_fmt.num_channels,
 					   (uint8_t *)buffers[buf_idx + 1]);
@@ -701,6 +992,11 @@ int cras_fmt_conversion_needed(const struct cras_fmt_conv *conv)
 	       (conv->num_converters > 1);
 }
 
+int cras_fmt_conv_has_state(const struct cras_fmt_conv *conv)
+{
+	return conv->speex_state || linear_resampler_needed(conv->resampler);
+}
+
 /* If the server cannot provide the requested format, configures an audio format
  * converter that handles transforming the input format to the format used by
  * the server. */
@@ -86,6 +86,16 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv *conv,
  */
 int cras_fmt_conversion_needed(const struct cras_fmt_conv *conv);
 
+/* Checks if a fmt converter keeps state from one conversion to the next,
+ * which it does when it converts the sample rate. Without state, each output
+ * frame depends only on the input frame at the same position.
+ * Args:
+ *    conv - The format convert to check.
+ *  Returns:
+ *    Non-zero if the converter has state.
+ */
+int cras_fmt_conv_has_state(const struct cras_fmt_conv *conv);
+
 /* If the server cannot provide the requested format, configures an audio format
  * converter that handles transforming the input format to the format used by
  * the server.
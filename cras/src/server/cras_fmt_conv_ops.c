@@ -36,6 +36,21 @@ static int16_t s16_add_and_clip(int16_t a, int16_t b)
 	return (int16_t)le16toh(sum);
 }
 
+/*
+ * Add and clip, 32 bit.
+ */
+static int32_t s32_add_and_clip(int32_t a, int32_t b)
+{
+	int64_t sum;
+
+	a = htole32(a);
+	b = htole32(b);
+	sum = (int64_t)a + (int64_t)b;
+	sum = MAX(sum, INT_MIN);
+	sum = MIN(sum, INT_MAX);
+	return (int32_t)le32toh(sum);
+}
+
 /*
  * Format converter.
  */
@@ -122,6 +137,63 @@ void convert_s16le_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out)
 		*_out = ((uint32_t)(int32_t)*_in << 16);
 }
 
+void convert_u8_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+	uint32_t *_out = (uint32_t *)out;
+
+	for (i = 0; i < in_samples; i++, in++, _out++)
+		*_out = (uint32_t)((int32_t)*in - 0x80) << 24;
+}
+
+void convert_s243le_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+	uint8_t *_out = (uint8_t *)out;
+
+	for (i = 0; i < in_samples; i++, in += 3, _out += 4) {
+		*_out = 0;
+		memcpy(_out + 1, in, 3);
+	}
+}
+
+void convert_s24le_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+	uint32_t *_in = (uint32_t *)in;
+	uint32_t *_out = (uint32_t *)out;
+
+	for (i = 0; i < in_samples; i++, _in++, _out++)
+		*_out = *_in << 8;
+}
+
+void convert_s32le_to_u8(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+	int32_t *_in = (int32_t *)in;
+
+	for (i = 0; i < in_samples; i++, _in++, out++)
+		*out = (uint8_t)(*_in >> 24) + 128;
+}
+
+void convert_s32le_to_s243le(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+
+	for (i = 0; i < in_samples; i++, in += 4, out += 3)
+		memcpy(out, in + 1, 3);
+}
+
+void convert_s32le_to_s24le(const uint8_t *in, size_t in_samples, uint8_t *out)
+{
+	size_t i;
+	int32_t *_in = (int32_t *)in;
+	int32_t *_out = (int32_t *)out;
+
+	for (i = 0; i < in_samples; i++, _in++, _out++)
+		*_out = *_in >> 8;
+}
+
 /*
  * Channel converter: mono to stereo.
  */
@@ -384,3 +456,278 @@ size_t s16_convert_channels(float **ch_conv_mtx, size_t num_in_ch,
 
 	return in_frames;
 }
+
+/*
+ * Channel converter: mono to stereo, 32 bit.
+ */
+size_t s32_mono_to_stereo(const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	for (i = 0; i < in_frames; i++) {
+		out[2 * i] = in[i];
+		out[2 * i + 1] = in[i];
+	}
+	return in_frames;
+}
+
+/*
+ * Channel converter: stereo to mono, 32 bit.
+ */
+size_t s32_stereo_to_mono(const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	for (i = 0; i < in_frames; i++)
+		out[i] = s32_add_and_clip(in[2 * i], in[2 * i + 1]);
+	return in_frames;
+}
+
+/*
+ * Channel converter: mono to 5.1 surround, 32 bit.
+ */
+size_t s32_mono_to_51(size_t left, size_t right, size_t center,
+		      const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	memset(out, 0, sizeof(*out) * 6 * in_frames);
+
+	if (center != -1)
+		for (i = 0; i < in_frames; i++)
+			out[6 * i + center] = in[i];
+	else if (left != -1 && right != -1)
+		for (i = 0; i < in_frames; i++) {
+			out[6 * i + right] = in[i] / 2;
+			out[6 * i + left] = in[i] / 2;
+		}
+	else
+		for (i = 0; i < in_frames; i++)
+			out[6 * i] = in[i];
+
+	return in_frames;
+}
+
+/*
+ * Channel converter: stereo to 5.1 surround, 32 bit.
+ */
+size_t s32_stereo_to_51(size_t left, size_t right, size_t center,
+			const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	memset(out, 0, sizeof(*out) * 6 * in_frames);
+
+	if (left != -1 && right != -1)
+		for (i = 0; i < in_frames; i++) {
+			out[6 * i + left] = in[2 * i];
+			out[6 * i + right] = in[2 * i + 1];
+		}
+	else if (center != -1)
+		for (i = 0; i < in_frames; i++)
+			out[6 * i + center] =
+				s32_add_and_clip(in[2 * i], in[2 * i + 1]);
+	else
+		for (i = 0; i < in_frames; i++) {
+			out[6 * i] = in[2 * i];
+			out[6 * i + 1] = in[2 * i + 1];
+		}
+
+	return in_frames;
+}
+
+/*
+ * Channel converter: 5.1 surround to stereo, 32 bit.
+ */
+size_t s32_51_to_stereo(const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+	size_t i;
+
+	for (i = 0; i < in_frames; i++) {
+		int32_t half_center = in[6 * i + 4] / 2;
+
+		out[2 * i] = s32_add_and_clip(in[6 * i], half_center);
+		out[2 * i + 1] = s32_add_and_clip(in[6 * i + 1], half_center);
+	}
+	return in_frames;
+}
+
+/*
+ * Channel converter: stereo to quad (front L/R, rear L/R), 32 bit.
+ */
+size_t s32_stereo_to_quad(size_t front_left, size_t front_right,
+			  size_t rear_left, size_t rear_right,
+			  const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	if (front_left == -1 || front_right == -1 || rear_left == -1 ||
+	    rear_right == -1) {
+		front_left = 0;
+		front_right = 1;
+		rear_left = 2;
+		rear_right = 3;
+	}
+
+	for (i = 0; i < in_frames; i++) {
+		out[4 * i + front_left] = in[2 * i];
+		out[4 * i + front_right] = in[2 * i + 1];
+		out[4 * i + rear_left] = in[2 * i];
+		out[4 * i + rear_right] = in[2 * i + 1];
+	}
+	return in_frames;
+}
+
+/*
+ * Channel converter: quad (front L/R, rear L/R) to stereo, 32 bit.
+ */
+size_t s32_quad_to_stereo(size_t front_left, size_t front_right,
+			  size_t rear_left, size_t rear_right,
+			  const uint8_t *_in, size_t in_frames, uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	if (front_left == -1 || front_right == -1 || rear_left == -1 ||
+	    rear_right == -1) {
+		front_left = 0;
+		front_right = 1;
+		rear_left = 2;
+		rear_right = 3;
+	}
+
+	for (i = 0; i < in_frames; i++) {
+		out[2 * i] = s32_add_and_clip(in[4 * i + front_left],
+					      in[4 * i + rear_left] / 4);
+		out[2 * i + 1] = s32_add_and_clip(in[4 * i + front_right],
+						  in[4 * i + rear_right] / 4);
+	}
+	return in_frames;
+}
+
+/*
+ * Channel converter: N channels to M channels, 32 bit.
+ */
+size_t s32_default_all_to_all(struct cras_audio_format *out_fmt,
+			      size_t num_in_ch, size_t num_out_ch,
+			      const uint8_t *_in, size_t in_frames,
+			      uint8_t *_out)
+{
+	unsigned int in_ch, out_ch, i;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	memset(out, 0, in_frames * num_out_ch * sizeof(*out));
+	for (out_ch = 0; out_ch < num_out_ch; out_ch++) {
+		for (in_ch = 0; in_ch < num_in_ch; in_ch++) {
+			for (i = 0; i < in_frames; i++) {
+				out[out_ch + i * num_out_ch] +=
+					in[in_ch + i * num_in_ch] / num_in_ch;
+			}
+		}
+	}
+	return in_frames;
+}
+
+/*
+ * Multiplies buffer vector with coefficient vector, 32 bit.
+ */
+int32_t s32_multiply_buf_with_coef(float *coef, const int32_t *buf,
+				   size_t size)
+{
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < size; i++)
+		sum += coef[i] * (double)buf[i];
+	sum = MAX(sum, (double)INT_MIN);
+	sum = MIN(sum, (double)INT_MAX);
+	return (int32_t)sum;
+}
+
+/*
+ * Channel layout converter, 32 bit.
+ */
+size_t s32_convert_channels(float **ch_conv_mtx, size_t num_in_ch,
+			    size_t num_out_ch, const uint8_t *_in,
+			    size_t in_frames, uint8_t *_out)
+{
+	unsigned i, fr;
+	const int32_t *in = (const int32_t *)_in;
+	int32_t *out = (int32_t *)_out;
+
+	for (fr = 0; fr < in_frames; fr++) {
+		for (i = 0; i < num_out_ch; i++)
+			out[i] = s32_multiply_buf_with_coef(ch_conv_mtx[i], in,
+							    num_in_ch);
+		in += num_in_ch;
+		out += num_out_ch;
+	}
+
+	return in_frames;
+}
+
+/*
+ * Fused converter: S16_LE mono to S24_LE or S32_LE stereo.
+ */
+size_t s16le_mono_to_s32le_stereo(const uint8_t *_in, size_t in_frames,
+				  uint8_t *_out, unsigned int shift)
+{
+	size_t i;
+	const int16_t *in = (const int16_t *)_in;
+	uint32_t *out = (uint32_t *)_out;
+
+	for (i = 0; i < in_frames; i++) {
+		out[2 * i] = (uint32_t)(int32_t)in[i] << shift;
+		out[2 * i + 1] = out[2 * i];
+	}
+	return in_frames;
+}
+
+/*
+ * Fused converter: S32_LE stereo to S16_LE mono.
+ */
+size_t s32le_stereo_to_s16le_mono(const uint8_t *_in, size_t in_frames,
+				  uint8_t *_out)
+{
+	size_t i;
+	const int32_t *in = (const int32_t *)_in;
+	int16_t *out = (int16_t *)_out;
+
+	for (i = 0; i < in_frames; i++)
+		out[i] = s32_add_and_clip(in[2 * i], in[2 * i + 1]) >> 16;
+	return in_frames;
+}
+
+/*
+ * Fused converter: S32_LE 5.1 surround to S16_LE stereo.
+ */
+size_t s32le_51_to_s16le_stereo(const uint8_t *_in, size_t in_frames,
+				uint8_t *_out)
+{
+	const int32_t *in = (const int32_t *)_in;
+	int16_t *out = (int16_t *)_out;
+	size_t i;
+
+	for (i = 0; i < in_frames; i++) {
+		int32_t half_center = in[6 * i + 4] / 2;
+
+		out[2 * i] = s32_add_and_clip(in[6 * i], half_center) >> 16;
+		out[2 * i + 1] =
+			s32_add_and_clip(in[6 * i + 1], half_center) >> 16;
+	}
+	return in_frames;
+}
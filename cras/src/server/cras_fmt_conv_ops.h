@@ -22,6 +22,14 @@ void convert_s16le_to_s243le(const uint8_t *in, size_t in_samples,
 			     uint8_t *out);
 void convert_s16le_to_s24le(const uint8_t *in, size_t in_samples, uint8_t *out);
 void convert_s16le_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out);
+void convert_u8_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out);
+void convert_s243le_to_s32le(const uint8_t *in, size_t in_samples,
+			     uint8_t *out);
+void convert_s24le_to_s32le(const uint8_t *in, size_t in_samples, uint8_t *out);
+void convert_s32le_to_u8(const uint8_t *in, size_t in_samples, uint8_t *out);
+void convert_s32le_to_s243le(const uint8_t *in, size_t in_samples,
+			     uint8_t *out);
+void convert_s32le_to_s24le(const uint8_t *in, size_t in_samples, uint8_t *out);
 
 /*
  * Channel converter: mono to stereo.
@@ -85,4 +93,44 @@ size_t s16_convert_channels(float **ch_conv_mtx, size_t num_in_ch,
 			    size_t num_out_ch, const uint8_t *in,
 			    size_t in_frames, uint8_t *out);
 
+/*
+ * 32 bit versions of the channel converters above, used when the input or
+ * output has more than 16 bits per sample.
+ */
+size_t s32_mono_to_stereo(const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_stereo_to_mono(const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_mono_to_51(size_t left, size_t right, size_t center,
+		      const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_stereo_to_51(size_t left, size_t right, size_t center,
+			const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_51_to_stereo(const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_stereo_to_quad(size_t front_left, size_t front_right,
+			  size_t rear_left, size_t rear_right,
+			  const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_quad_to_stereo(size_t front_left, size_t front_right,
+			  size_t rear_left, size_t rear_right,
+			  const uint8_t *in, size_t in_frames, uint8_t *out);
+size_t s32_default_all_to_all(struct cras_audio_format *out_fmt,
+			      size_t num_in_ch, size_t num_out_ch,
+			      const uint8_t *in, size_t in_frames,
+			      uint8_t *out);
+int32_t s32_multiply_buf_with_coef(float *coef, const int32_t *buf,
+				   size_t size);
+size_t s32_convert_channels(float **ch_conv_mtx, size_t num_in_ch,
+			    size_t num_out_ch, const uint8_t *in,
+			    size_t in_frames, uint8_t *out);
+
+/*
+ * Fused converters, doing a sample format and a channel conversion in one
+ * pass with the same results as running the two converters in turn.
+ */
+
+/* S16_LE mono to stereo S32_LE with shift 16, or S24_LE with shift 8. */
+size_t s16le_mono_to_s32le_stereo(const uint8_t *in, size_t in_frames,
+				  uint8_t *out, unsigned int shift);
+size_t s32le_stereo_to_s16le_mono(const uint8_t *in, size_t in_frames,
+				  uint8_t *out);
+size_t s32le_51_to_s16le_stereo(const uint8_t *in, size_t in_frames,
+				uint8_t *out);
+
 #endif /* CRAS_FMT_CONV_OPS_H_ */
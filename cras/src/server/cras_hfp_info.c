@@ -3,6 +3,11 @@
  * found in the LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for recvmmsg and sendmmsg */
+#endif
+
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,10 +18,10 @@
 #include "byte_buffer.h"
 #include "cras_hfp_info.h"
 #include "cras_hfp_slc.h"
-#include "cras_iodev_list.h"
 #include "cras_plc.h"
 #include "cras_sbc_codec.h"
 #include "cras_server_metrics.h"
+#include "cras_system_state.h"
 #include "utlist.h"
 
 /* The max buffer size. Note that the actual used size must set to multiple
@@ -45,6 +50,9 @@
 
 #define H2_HEADER_0 0x01
 
+/* Max number of SCO packets read or written in one wake in batched mode. */
+#define MAX_BATCH_PACKETS 8
+
 /* Second octet of H2 header is composed by 4 bits fixed 0x8 and 4 bits
  * sequence number 0000, 0011, 1100, 1111. */
 static const uint8_t h2_header_frames_count[] = { 0x08, 0x38, 0xc8, 0xf8 };
@@ -54,6 +62,7 @@ static const uint8_t h2_header_frames_count[] = { 0x08, 0x38, 0xc8, 0xf8 };
  * represent two directions of the same HFP headset
  * Members:
  *     fd - The file descriptor for SCO socket.
+ *     thread - The audio thread the callback of fd is added to.
  *     started - If the hfp_info has started to read/write SCO data.
  *     mtu - The max transmit unit reported from BT adapter.
  *     packet_size - The size of SCO packet to read/write preferred by
@@ -70,12 +79,22 @@ static const uint8_t h2_header_frames_count[] = { 0x08, 0x38, 0xc8, 0xf8 };
  *     read_cb - Callback to call when SCO socket can read. It returns the
  *         number of PCM bytes read.
  *     write_cb - Callback to call when SCO socket can write.
- *     hci_sco_buf - Buffer to read one HCI SCO packet.
+ *     batched - Non-zero to read and write all pending SCO packets in one
+ *         wake with recvmmsg and sendmmsg.
+ *     batch_packets - Number of SCO packets read in the last wake, the same
+ *         number of packets are written back. Always 1 when not batched.
+ *     msgs - Message headers for recvmmsg and sendmmsg.
+ *     iovs - The buffer of each message in msgs.
+ *     wrap_iovs - The two pieces of the playback packet which straddles the
+ *         end of playback_buf.
+ *     write_buf - Buffers to write mSBC packets from.
+ *     hci_sco_buf - Buffers to read HCI SCO packets to.
  *     idev - The input iodev using this hfp_info.
  *     odev - The output iodev using this hfp_info.
  */
 struct hfp_info {
 	int fd;
+	struct audio_thread *thread;
 	int started;
 	unsigned int mtu;
 	unsigned int packet_size;
@@ -89,8 +108,13 @@ struct hfp_info {
 	unsigned int msbc_num_lost_frames;
 	int (*read_cb)(struct hfp_info *info);
 	int (*write_cb)(struct hfp_info *info);
-	uint8_t write_buf[WRITE_BUF_SIZE_BYTES];
-	uint8_t hci_sco_buf[HCI_SCO_PKT_SIZE];
+	int batched;
+	unsigned int batch_packets;
+	struct mmsghdr msgs[MAX_BATCH_PACKETS];
+	struct iovec iovs[MAX_BATCH_PACKETS];
+	struct iovec wrap_iovs[2];
+	uint8_t write_buf[MAX_BATCH_PACKETS][WRITE_BUF_SIZE_BYTES];
+	uint8_t hci_sco_buf[MAX_BATCH_PACKETS][HCI_SCO_PKT_SIZE];
 	struct cras_iodev *idev;
 	struct cras_iodev *odev;
 };
@@ -222,21 +246,26 @@ int hfp_force_output_level(struct hfp_info *info, struct cras_iodev *dev,
 	return 0;
 }
 
-int hfp_write_msbc(struct hfp_info *info)
+/* Fills one mSBC packet with the next codesize of playback samples, or with
+ * zeros if there aren't enough.
+ * Args:
+ *    info - The hfp_info holding the playback buffer and mSBC encoder.
+ *    wp - The packet to fill, of MSBC_PKT_SIZE bytes.
+ *    frame_count - The number of the mSBC frame, for the H2 header.
+ */
+static int msbc_fill_packet(struct hfp_info *info, uint8_t *wp,
+			    unsigned int frame_count)
 {
 	size_t encoded;
-	int err;
 	int pcm_encoded;
 	unsigned int pcm_avail;
 	uint8_t *samples;
-	uint8_t *wp;
 
 	samples = buf_read_pointer_size(info->playback_buf, &pcm_avail);
-	wp = info->write_buf;
 	if (pcm_avail >= MSBC_CODE_SIZE) {
 		/* Encode more */
 		wp[0] = H2_HEADER_0;
-		wp[1] = h2_header_frames_count[info->msbc_num_out_frames % 4];
+		wp[1] = h2_header_frames_count[frame_count % 4];
 		pcm_encoded = info->msbc_write->encode(
 			info->msbc_write, samples, pcm_avail,
 			wp + MSBC_H2_HEADER_LEN,
@@ -247,13 +276,23 @@ int hfp_write_msbc(struct hfp_info *info)
 			return pcm_encoded;
 		}
 		buf_increment_read(info->playback_buf, pcm_encoded);
-		pcm_avail -= pcm_encoded;
 	} else {
 		memset(wp, 0, WRITE_BUF_SIZE_BYTES);
 	}
+	return 0;
+}
+
+int hfp_write_msbc(struct hfp_info *info)
+{
+	int err;
+
+	err = msbc_fill_packet(info, info->write_buf[0],
+			       info->msbc_num_out_frames);
+	if (err < 0)
+		return err;
 
 msbc_send_again:
-	err = send(info->fd, info->write_buf, MSBC_PKT_SIZE, 0);
+	err = send(info->fd, info->write_buf[0], MSBC_PKT_SIZE, 0);
 	if (err < 0) {
 		if (errno == EINTR)
 			goto msbc_send_again;
@@ -374,7 +413,17 @@ static int handle_packet_loss(struct hfp_info *info)
 	return decoded;
 }
 
-int hfp_read_msbc(struct hfp_info *info)
+/*
+ * Decodes one HCI SCO packet read in wideband speech mode to the capture
+ * buffer, or conceals it if the mSBC frame in it is lost.
+ * Args:
+ *    info - The hfp_info holding the capture buffer, mSBC codec and PLC.
+ *    hci_sco_buf - The HCI SCO packet, of HCI_SCO_PKT_SIZE bytes.
+ * Returns:
+ *    The number of PCM bytes added to the capture buffer, or negative error
+ *    code.
+ */
+static int msbc_decode_packet(struct hfp_info *info, const uint8_t *hci_sco_buf)
 {
 	int err = 0;
 	unsigned int pcm_avail = 0;
@@ -385,23 +434,6 @@ int hfp_read_msbc(struct hfp_info *info)
 	const uint8_t *frame_head = NULL;
 	unsigned int seq;
 
-recv_msbc_bytes:
-	err = recv(info->fd, info->hci_sco_buf, HCI_SCO_PKT_SIZE, 0);
-	if (err < 0) {
-		syslog(LOG_ERR, "HCI SCO packet read err %s", strerror(errno));
-		if (errno == EINTR)
-			goto recv_msbc_bytes;
-		return err;
-	}
-	/*
-	 * Treat return code 0 (socket shutdown) as error here. BT stack
-	 * shall send signal to main thread for device disconnection.
-	 */
-	if (err != HCI_SCO_PKT_SIZE) {
-		syslog(LOG_ERR, "Partially read %d bytes for mSBC packet", err);
-		return -1;
-	}
-
 	/*
 	 * HCI SCO packet status flag:
 	 * 0x00 - correctly received data.
@@ -409,7 +441,7 @@ recv_msbc_bytes:
 	 * 0x10 - No data received.
 	 * 0x11 - Data partially lost.
 	 */
-	err = (info->hci_sco_buf[1] >> 4);
+	err = (hci_sco_buf[1] >> 4);
 	if (err) {
 		syslog(LOG_ERR, "HCI SCO status flag %u", err);
 		return handle_packet_loss(info);
@@ -419,7 +451,7 @@ recv_msbc_bytes:
 	 * If mSBC frame extraction fails, we shall handle it as packet loss.
 	 */
 	frame_head =
-		extract_msbc_frame(info->hci_sco_buf + HCI_SCO_HDR_SIZE_BYTES,
+		extract_msbc_frame(hci_sco_buf + HCI_SCO_HDR_SIZE_BYTES,
 				   MSBC_PKT_SIZE, &seq);
 	if (!frame_head) {
 		syslog(LOG_ERR, "Failed to extract msbc frame");
@@ -467,6 +499,30 @@ recv_msbc_bytes:
 	return pcm_read;
 }
 
+int hfp_read_msbc(struct hfp_info *info)
+{
+	int err = 0;
+
+recv_msbc_bytes:
+	err = recv(info->fd, info->hci_sco_buf[0], HCI_SCO_PKT_SIZE, 0);
+	if (err < 0) {
+		syslog(LOG_ERR, "HCI SCO packet read err %s", strerror(errno));
+		if (errno == EINTR)
+			goto recv_msbc_bytes;
+		return err;
+	}
+	/*
+	 * Treat return code 0 (socket shutdown) as error here. BT stack
+	 * shall send signal to main thread for device disconnection.
+	 */
+	if (err != HCI_SCO_PKT_SIZE) {
+		syslog(LOG_ERR, "Partially read %d bytes for mSBC packet", err);
+		return -1;
+	}
+
+	return msbc_decode_packet(info, info->hci_sco_buf[0]);
+}
+
 int hfp_read(struct hfp_info *info)
 {
 	int err = 0;
@@ -510,6 +566,213 @@ recv_sample:
 	return err;
 }
 
+/* Reads up to num SCO packets to the buffers in info->iovs. Blocks only for
+ * the first packet, which the socket being readable guarantees.
+ * Returns:
+ *    The number of packets read, or negative error code.
+ */
+static int recv_packets(struct hfp_info *info, unsigned int num)
+{
+	int err;
+
+recv_again:
+	err = recvmmsg(info->fd, info->msgs, num, MSG_WAITFORONE, NULL);
+	if (err < 0) {
+		syslog(LOG_ERR, "SCO packets read err %s", strerror(errno));
+		if (errno == EINTR)
+			goto recv_again;
+		return err;
+	}
+	return err;
+}
+
+/* Writes num SCO packets of pkt_size bytes from the buffers in info->iovs.
+ * Returns:
+ *    0 if all packets are written, or negative error code.
+ */
+static int send_packets(struct hfp_info *info, unsigned int num,
+			unsigned int pkt_size)
+{
+	unsigned int i;
+	int err;
+
+send_again:
+	err = sendmmsg(info->fd, info->msgs, num, 0);
+	if (err < 0) {
+		if (errno == EINTR)
+			goto send_again;
+		return err;
+	}
+
+	if (err != (int)num) {
+		syslog(LOG_ERR, "Partially write %d of %u SCO packets", err,
+		       num);
+		return -1;
+	}
+	for (i = 0; i < num; i++) {
+		if (info->msgs[i].msg_len != pkt_size) {
+			syslog(LOG_ERR,
+			       "Partially write %u bytes for SCO packet size %u",
+			       info->msgs[i].msg_len, pkt_size);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int hfp_write_msbc_batched(struct hfp_info *info)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < info->batch_packets; i++) {
+		err = msbc_fill_packet(info, info->write_buf[i],
+				       info->msbc_num_out_frames + i);
+		if (err < 0)
+			return err;
+		info->iovs[i].iov_base = info->write_buf[i];
+		info->iovs[i].iov_len = MSBC_PKT_SIZE;
+	}
+
+	err = send_packets(info, info->batch_packets, MSBC_PKT_SIZE);
+	if (err < 0)
+		return err;
+	info->msbc_num_out_frames += info->batch_packets;
+
+	return info->batch_packets * MSBC_PKT_SIZE;
+}
+
+int hfp_write_batched(struct hfp_info *info)
+{
+	unsigned int i, num, to_send, offset, pkt_size = info->packet_size;
+	int wrap_msg = -1;
+	uint8_t *samples;
+	int err;
+
+	/* Send as many packets as were read, even when they run past the
+	 * end of playback_buf, or the buffer level creeps up. */
+	num = MIN(info->batch_packets,
+		  buf_queued(info->playback_buf) / pkt_size);
+	if (num == 0)
+		return 0;
+
+	samples = buf_read_pointer_size(info->playback_buf, &to_send);
+	for (i = 0; i < num; i++) {
+		offset = i * pkt_size;
+		if (offset + pkt_size <= to_send) {
+			info->iovs[i].iov_base = samples + offset;
+			info->iovs[i].iov_len = pkt_size;
+		} else if (offset >= to_send) {
+			info->iovs[i].iov_base = info->playback_buf->bytes +
+						 offset - to_send;
+			info->iovs[i].iov_len = pkt_size;
+		} else {
+			/* The packet straddles the wrap, gather both ends. */
+			info->wrap_iovs[0].iov_base = samples + offset;
+			info->wrap_iovs[0].iov_len = to_send - offset;
+			info->wrap_iovs[1].iov_base = info->playback_buf->bytes;
+			info->wrap_iovs[1].iov_len = pkt_size - (to_send - offset);
+			info->msgs[i].msg_hdr.msg_iov = info->wrap_iovs;
+			info->msgs[i].msg_hdr.msg_iovlen = 2;
+			wrap_msg = i;
+		}
+	}
+
+	err = send_packets(info, num, pkt_size);
+	if (wrap_msg >= 0) {
+		info->msgs[wrap_msg].msg_hdr.msg_iov = &info->iovs[wrap_msg];
+		info->msgs[wrap_msg].msg_hdr.msg_iovlen = 1;
+	}
+	if (err < 0)
+		return err;
+	buf_increment_read(info->playback_buf, num * pkt_size);
+
+	return num * pkt_size;
+}
+
+int hfp_read_msbc_batched(struct hfp_info *info)
+{
+	unsigned int i;
+	int num, err;
+	int pcm_read = 0;
+
+	for (i = 0; i < MAX_BATCH_PACKETS; i++) {
+		info->iovs[i].iov_base = info->hci_sco_buf[i];
+		info->iovs[i].iov_len = HCI_SCO_PKT_SIZE;
+	}
+
+	num = recv_packets(info, MAX_BATCH_PACKETS);
+	if (num < 0)
+		return num;
+	info->batch_packets = num;
+
+	for (i = 0; i < (unsigned int)num; i++) {
+		/* Like hfp_read_msbc, a socket shutdown is an error. */
+		if (info->msgs[i].msg_len != HCI_SCO_PKT_SIZE) {
+			syslog(LOG_ERR, "Partially read %u bytes for mSBC packet",
+			       info->msgs[i].msg_len);
+			return -1;
+		}
+		err = msbc_decode_packet(info, info->hci_sco_buf[i]);
+		if (err < 0)
+			return err;
+		pcm_read += err;
+	}
+	return pcm_read;
+}
+
+int hfp_read_batched(struct hfp_info *info)
+{
+	unsigned int i, num, len, to_read;
+	unsigned int nread = 0;
+	uint8_t *capture_buf;
+	int err;
+
+	capture_buf = buf_write_pointer_size(info->capture_buf, &to_read);
+	num = MIN(MAX_BATCH_PACKETS, to_read / info->packet_size);
+	if (num == 0) {
+		/* Still write one packet for this wake, like hfp_read. */
+		info->batch_packets = 1;
+		return 0;
+	}
+
+	/* Read straight to the capture buffer, one packet size apart. */
+	for (i = 0; i < num; i++) {
+		info->iovs[i].iov_base = capture_buf + i * info->packet_size;
+		info->iovs[i].iov_len = info->packet_size;
+	}
+
+	err = recv_packets(info, num);
+	if (err < 0)
+		return err;
+	info->batch_packets = err;
+
+	for (i = 0; i < info->batch_packets; i++) {
+		len = info->msgs[i].msg_len;
+		if (len != info->packet_size) {
+			/* Adopt the adapter's SCO packet size, see hfp_read. */
+			if (len && (info->packet_size == info->mtu)) {
+				info->packet_size = len;
+			} else {
+				syslog(LOG_ERR,
+				       "Partially read %u bytes for %u size SCO "
+				       "packet",
+				       len, info->packet_size);
+				return -1;
+			}
+		}
+		/* Close the gap left by a packet shorter than its buffer. */
+		if (info->iovs[i].iov_base != capture_buf + nread)
+			memmove(capture_buf + nread, info->iovs[i].iov_base,
+				len);
+		nread += len;
+	}
+
+	buf_increment_write(info->capture_buf, nread);
+
+	return nread;
+}
+
 /* Callback function to handle sample read and write.
  * Note that we poll the SCO socket for read sample, since it reflects
  * there is actual some sample to read while the socket always reports
@@ -518,6 +781,8 @@ recv_sample:
  * 1. Read one chunk of MTU bytes of data.
  * 2. When input device not attached, ignore the data just read.
  * 3. When output device attached, write one chunk of MTU bytes of data.
+ * In batched mode every chunk pending in the socket is read at once, and the
+ * same number of chunks is written.
  */
 static int hfp_info_callback(void *arg)
 {
@@ -543,7 +808,10 @@ static int hfp_info_callback(void *arg)
 	 */
 	if (!info->odev)
 		buf_increment_write(info->playback_buf,
-				    info->msbc_write ? err : info->packet_size);
+				    info->msbc_write ?
+					    err :
+					    info->packet_size *
+						    info->batch_packets);
 
 	err = info->write_cb(info);
 	if (err < 0) {
@@ -561,6 +829,7 @@ read_write_error:
 	audio_thread_rm_callback(info->fd);
 	close(info->fd);
 	info->fd = 0;
+	info->thread = NULL;
 	info->started = 0;
 
 	return 0;
@@ -569,6 +838,7 @@ read_write_error:
 struct hfp_info *hfp_info_create(int codec)
 {
 	struct hfp_info *info;
+	unsigned int i;
 	info = (struct hfp_info *)calloc(1, sizeof(*info));
 	if (!info)
 		goto error;
@@ -581,15 +851,23 @@ struct hfp_info *hfp_info_create(int codec)
 	if (!info->playback_buf)
 		goto error;
 
+	info->batched = cras_system_get_hfp_batched_sco_io();
+	for (i = 0; i < MAX_BATCH_PACKETS; i++) {
+		info->msgs[i].msg_hdr.msg_iov = &info->iovs[i];
+		info->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
 	if (codec == HFP_CODEC_ID_MSBC) {
-		info->write_cb = hfp_write_msbc;
-		info->read_cb = hfp_read_msbc;
+		info->write_cb = info->batched ? hfp_write_msbc_batched :
+						 hfp_write_msbc;
+		info->read_cb = info->batched ? hfp_read_msbc_batched :
+						hfp_read_msbc;
 		info->msbc_read = cras_msbc_codec_create();
 		info->msbc_write = cras_msbc_codec_create();
 		info->msbc_plc = cras_msbc_plc_create();
 	} else {
-		info->write_cb = hfp_write;
-		info->read_cb = hfp_read;
+		info->write_cb = info->batched ? hfp_write_batched : hfp_write;
+		info->read_cb = info->batched ? hfp_read_batched : hfp_read;
 	}
 
 	return info;
@@ -610,13 +888,16 @@ int hfp_info_running(struct hfp_info *info)
 	return info->started;
 }
 
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info)
+int hfp_info_start(int fd, unsigned int mtu, struct audio_thread *thread,
+		   struct hfp_info *info)
 {
 	info->fd = fd;
+	info->thread = thread;
 	info->mtu = mtu;
 
 	/* Initialize to MTU, it may change when actually read the socket. */
 	info->packet_size = mtu;
+	info->batch_packets = 1;
 	buf_reset(info->playback_buf);
 	buf_reset(info->capture_buf);
 
@@ -635,8 +916,9 @@ int hfp_info_stop(struct hfp_info *info)
 	if (!info->started)
 		return 0;
 
-	audio_thread_rm_callback_sync(cras_iodev_list_get_audio_thread(),
-				      info->fd);
+	/* The idev and odev may be closed on another thread than the one
+	 * the callback runs on. */
+	audio_thread_rm_callback_sync(info->thread, info->fd);
 
 	close(info->fd);
 	info->fd = 0;
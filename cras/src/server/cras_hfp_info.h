@@ -36,9 +36,17 @@ void hfp_info_destroy(struct hfp_info *info);
 int hfp_info_running(struct hfp_info *info);
 
 /* Starts the hfp_info to transmit and reveice samples to and from the file
- * descriptor of a SCO socket. This should be called from main thread.
+ * descriptor of a SCO socket. This should be called from main thread while
+ * the iodev starting it is opened on thread.
+ * Args:
+ *    fd - The file descriptor of the SCO socket.
+ *    mtu - The max transmit unit reported from BT adapter.
+ *    thread - The audio thread the iodev is opened on, the callback of fd
+ *        is added to it.
+ *    info - The hfp_info to start.
  */
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info);
+int hfp_info_start(int fd, unsigned int mtu, struct audio_thread *thread,
+		   struct hfp_info *info);
 
 /* Stops given hfp_info. This implies sample transmission will
  * stop and socket be closed. This should be called from main thread.
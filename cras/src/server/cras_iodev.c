@@ -12,6 +12,7 @@
 #include <time.h>
 
 #include "audio_thread.h"
+#include "audio_thread_latency.h"
 #include "audio_thread_log.h"
 #include "buffer_share.h"
 #include "cras_audio_area.h"
@@ -23,6 +24,7 @@
 #include "cras_iodev.h"
 #include "cras_iodev_list.h"
 #include "cras_mix.h"
+#include "cras_mix_bus.h"
 #include "cras_ramp.h"
 #include "cras_rstream.h"
 #include "cras_server_metrics.h"
@@ -369,6 +371,7 @@ static int apply_dsp(struct cras_iodev *iodev, uint8_t *buf, size_t frames)
 {
 	struct cras_dsp_context *ctx;
 	struct pipeline *pipeline;
+	struct timespec start;
 	int rc;
 
 	ctx = iodev->dsp_context;
@@ -379,13 +382,70 @@ static int apply_dsp(struct cras_iodev *iodev, uint8_t *buf, size_t frames)
 	if (!pipeline)
 		return 0;
 
-	rc = cras_dsp_pipeline_apply(pipeline, buf, iodev->format->format,
-				     frames);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	rc = cras_dsp_apply(ctx, buf, iodev->format->format, frames);
+	audio_thread_latency_add(AUDIO_THREAD_LATENCY_DSP, &start);
 
 	cras_dsp_put_pipeline(ctx);
 	return rc;
 }
 
+/* Runs the loopbacks and DSP of an output iodev on its mix bus, the DSP on
+ * the float samples. Loopbacks are given the samples quantized into buf. */
+static int apply_dsp_mix_bus(struct cras_iodev *iodev, uint8_t *buf,
+			     size_t frames)
+{
+	struct cras_mix_bus *bus = iodev->mix_bus;
+	snd_pcm_format_t format = iodev->format->format;
+	struct cras_dsp_context *ctx;
+	struct pipeline *pipeline;
+	struct cras_loopback *loopback;
+	struct timespec start;
+	int quantized = 0;
+	int rc;
+
+	DL_FOREACH (iodev->loopbacks, loopback) {
+		if (loopback->type != LOOPBACK_POST_MIX_PRE_DSP)
+			continue;
+		if (!quantized) {
+			rc = cras_mix_bus_quantize(bus, format, buf, frames, 0);
+			if (rc)
+				return rc;
+			quantized = 1;
+		}
+		loopback->hook_data(buf, frames, iodev->format,
+				    loopback->cb_data);
+	}
+
+	ctx = iodev->dsp_context;
+	pipeline = ctx ? cras_dsp_get_pipeline(ctx) : NULL;
+	if (pipeline) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		rc = cras_dsp_apply_float(ctx, cras_mix_bus_channels(bus),
+					  cras_mix_bus_num_channels(bus),
+					  frames);
+		audio_thread_latency_add(AUDIO_THREAD_LATENCY_DSP, &start);
+		cras_dsp_put_pipeline(ctx);
+		if (rc)
+			return rc;
+		quantized = 0;
+	}
+
+	DL_FOREACH (iodev->loopbacks, loopback) {
+		if (loopback->type != LOOPBACK_POST_DSP)
+			continue;
+		if (!quantized) {
+			rc = cras_mix_bus_quantize(bus, format, buf, frames, 0);
+			if (rc)
+				return rc;
+			quantized = 1;
+		}
+		loopback->hook_data(buf, frames, iodev->format,
+				    loopback->cb_data);
+	}
+	return 0;
+}
+
 static void cras_iodev_free_dsp(struct cras_iodev *iodev)
 {
 	if (iodev->dsp_context) {
@@ -517,17 +577,17 @@ static void add_ext_dsp_module_to_pipeline(struct cras_iodev *iodev)
 	struct pipeline *pipeline;
 
 	pipeline = iodev->dsp_context ?
-			   cras_dsp_get_pipeline(iodev->dsp_context) :
+			   cras_dsp_lock_pipeline(iodev->dsp_context) :
 			   NULL;
 
 	if (!pipeline) {
 		cras_iodev_alloc_dsp(iodev);
 		cras_dsp_load_dummy_pipeline(iodev->dsp_context,
 					     iodev->format->num_channels);
-		pipeline = cras_dsp_get_pipeline(iodev->dsp_context);
+		pipeline = cras_dsp_lock_pipeline(iodev->dsp_context);
 	}
-	/* dsp_context mutex locked. Now it's safe to modify dsp
-	 * pipeline resources. */
+	/* dsp_context locked, the audio thread is kept out. Now it's safe
+	 * to modify dsp pipeline resources. */
 
 	if (iodev->ext_dsp_module)
 		iodev->ext_dsp_module->configure(iodev->ext_dsp_module,
@@ -537,8 +597,7 @@ static void add_ext_dsp_module_to_pipeline(struct cras_iodev *iodev)
 
 	cras_dsp_pipeline_set_sink_ext_module(pipeline, iodev->ext_dsp_module);
 
-	/* Unlock dsp_context mutex. */
-	cras_dsp_put_pipeline(iodev->dsp_context);
+	cras_dsp_unlock_pipeline(iodev->dsp_context);
 }
 
 /*
@@ -551,15 +610,13 @@ static void release_ext_dsp_module_from_pipeline(struct cras_iodev *iodev)
 	if (iodev->dsp_context == NULL)
 		return;
 
-	pipeline = cras_dsp_get_pipeline(iodev->dsp_context);
+	pipeline = cras_dsp_lock_pipeline(iodev->dsp_context);
 	if (pipeline == NULL)
 		return;
-	/* dsp_context mutex locked. */
 
 	cras_dsp_pipeline_set_sink_ext_module(pipeline, NULL);
 
-	/* Unlock dsp_context mutex. */
-	cras_dsp_put_pipeline(iodev->dsp_context);
+	cras_dsp_unlock_pipeline(iodev->dsp_context);
 }
 
 void cras_iodev_set_ext_dsp_module(struct cras_iodev *iodev,
@@ -657,6 +714,12 @@ static void cras_iodev_alloc_dsp(struct cras_iodev *iodev)
 	cras_iodev_free_dsp(iodev);
 	iodev->dsp_context =
 		cras_dsp_context_new(iodev->format->frame_rate, purpose);
+	if (iodev->dsp_context)
+		cras_dsp_set_fade_frames(
+			iodev->dsp_context,
+			(uint64_t)iodev->format->frame_rate *
+				MAX(cras_system_get_dsp_crossfade_ms(), 0) /
+				1000);
 }
 
 void cras_iodev_fill_time_from_frames(size_t frames, size_t frame_rate,
@@ -926,6 +989,18 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 	iodev->max_cb_level = 0;
 	iodev->largest_cb_level = 0;
 
+	if (iodev->direction == CRAS_STREAM_OUTPUT &&
+	    cras_system_get_float_mix_bus() && !iodev->mix_bus) {
+		iodev->mix_bus = cras_mix_bus_create(
+			iodev->format->num_channels, iodev->buffer_size,
+			cras_system_get_float_mix_bus_dither());
+		if (!iodev->mix_bus)
+			syslog(LOG_ERR, "Failed to create float mix bus");
+	}
+	iodev->share_playback_conv =
+		iodev->direction == CRAS_STREAM_OUTPUT &&
+		cras_system_get_shared_playback_conversion();
+
 	iodev->reset_request_pending = 0;
 	iodev->state = CRAS_IODEV_STATE_OPEN;
 	iodev->highest_hw_level = 0;
@@ -994,6 +1069,10 @@ int cras_iodev_close(struct cras_iodev *iodev)
 	if (rc)
 		return rc;
 	iodev->state = CRAS_IODEV_STATE_CLOSE;
+	if (iodev->mix_bus) {
+		cras_mix_bus_destroy(iodev->mix_bus);
+		iodev->mix_bus = NULL;
+	}
 	if (iodev->ramp)
 		cras_ramp_reset(iodev->ramp);
 
@@ -1032,11 +1111,15 @@ int cras_iodev_put_input_buffer(struct cras_iodev *iodev)
 	return min_frames;
 }
 
-int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
-				 unsigned int nframes, int *is_non_empty,
-				 struct cras_fmt_conv *remix_converter)
+/* Processes and writes nframes to the device, the samples come from frames
+ * or from the mix bus of iodev if from_mix_bus is set. */
+static int put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
+			     unsigned int nframes, int *is_non_empty,
+			     struct cras_fmt_conv *remix_converter,
+			     int from_mix_bus)
 {
 	const struct cras_audio_format *fmt = iodev->format;
+	struct cras_mix_bus *bus = from_mix_bus ? iodev->mix_bus : NULL;
 	struct cras_ramp_action ramp_action = {
 		.type = CRAS_RAMP_ACTION_NONE,
 		.scaler = 0.0f,
@@ -1048,20 +1131,30 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 	int rc;
 	struct cras_loopback *loopback;
 
-	DL_FOREACH (iodev->loopbacks, loopback) {
-		if (loopback->type == LOOPBACK_POST_MIX_PRE_DSP)
-			loopback->hook_data(frames, nframes, iodev->format,
-					    loopback->cb_data);
-	}
+	if (bus) {
+		rc = apply_dsp_mix_bus(iodev, frames, nframes);
+		if (rc) {
+			cras_mix_bus_consume(bus, nframes);
+			return rc;
+		}
+	} else {
+		DL_FOREACH (iodev->loopbacks, loopback) {
+			if (loopback->type == LOOPBACK_POST_MIX_PRE_DSP)
+				loopback->hook_data(frames, nframes,
+						    iodev->format,
+						    loopback->cb_data);
+		}
 
-	rc = apply_dsp(iodev, frames, nframes);
-	if (rc)
-		return rc;
+		rc = apply_dsp(iodev, frames, nframes);
+		if (rc)
+			return rc;
 
-	DL_FOREACH (iodev->loopbacks, loopback) {
-		if (loopback->type == LOOPBACK_POST_DSP)
-			loopback->hook_data(frames, nframes, iodev->format,
-					    loopback->cb_data);
+		DL_FOREACH (iodev->loopbacks, loopback) {
+			if (loopback->type == LOOPBACK_POST_DSP)
+				loopback->hook_data(frames, nframes,
+						    iodev->format,
+						    loopback->cb_data);
+		}
 	}
 
 	if (iodev->ramp) {
@@ -1073,7 +1166,10 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 	if (output_should_mute(iodev) &&
 	    ramp_action.type != CRAS_RAMP_ACTION_PARTIAL) {
 		const unsigned int frame_bytes = cras_get_format_bytes(fmt);
-		cras_mix_mute_buffer(frames, frame_bytes, nframes);
+		if (bus)
+			cras_mix_bus_zero(bus, 0, nframes);
+		else
+			cras_mix_mute_buffer(frames, frame_bytes, nframes);
 
 		// Skip non-empty check, since we know it's empty.
 		is_non_empty = NULL;
@@ -1098,16 +1194,35 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 			target *= software_volume_scaler;
 		}
 
-		cras_scale_buffer_increment(fmt->format, frames, nframes,
-					    starting_scaler, increment, target,
-					    fmt->num_channels);
+		if (bus)
+			cras_mix_bus_scale(bus, nframes, starting_scaler,
+					   increment, target);
+		else
+			cras_scale_buffer_increment(fmt->format, frames,
+						    nframes, starting_scaler,
+						    increment, target,
+						    fmt->num_channels);
 		cras_ramp_update_ramped_frames(iodev->ramp, nframes);
 	} else if (!output_should_mute(iodev) && software_volume_needed) {
 		/* Just scale for software volume using
 		 * cras_scale_buffer. */
 		unsigned int nsamples = nframes * fmt->num_channels;
-		cras_scale_buffer(fmt->format, frames, nsamples,
-				  software_volume_scaler);
+		if (bus)
+			cras_mix_bus_scale(bus, nframes,
+					   software_volume_scaler, 0.0f,
+					   software_volume_scaler);
+		else
+			cras_scale_buffer(fmt->format, frames, nsamples,
+					  software_volume_scaler);
+	}
+
+	/* The only conversion of the mix bus to the device format. */
+	if (bus) {
+		rc = cras_mix_bus_quantize(bus, fmt->format, frames, nframes,
+					   1);
+		cras_mix_bus_consume(bus, nframes);
+		if (rc)
+			return rc;
 	}
 
 	if (remix_converter)
@@ -1130,6 +1245,24 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 	return iodev->put_buffer(iodev, nframes);
 }
 
+int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
+				 unsigned int nframes, int *is_non_empty,
+				 struct cras_fmt_conv *remix_converter)
+{
+	return put_output_buffer(iodev, frames, nframes, is_non_empty,
+				 remix_converter, 0);
+}
+
+int cras_iodev_put_output_mix_bus(struct cras_iodev *iodev, uint8_t *frames,
+				  unsigned int nframes, int *is_non_empty,
+				  struct cras_fmt_conv *remix_converter)
+{
+	if (!iodev->mix_bus)
+		return -EINVAL;
+	return put_output_buffer(iodev, frames, nframes, is_non_empty,
+				 remix_converter, 1);
+}
+
 int cras_iodev_get_input_buffer(struct cras_iodev *iodev, unsigned int *frames)
 {
 	const unsigned int frame_bytes = cras_get_format_bytes(iodev->format);
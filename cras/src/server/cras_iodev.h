@@ -22,6 +22,7 @@
 
 struct buffer_share;
 struct cras_fmt_conv;
+struct cras_mix_bus;
 struct cras_ramp;
 struct cras_rstream;
 struct cras_audio_area;
@@ -217,6 +218,12 @@ struct cras_ionode {
  *                    streams into account even if they have been removed.
  * buf_state - If multiple streams are writing to this device, then this
  *     keeps track of how much each stream has written.
+ * mix_bus - For playback only, float bus streams are mixed into when enabled
+ *     in board config. NULL to mix into the device buffer.
+ * share_playback_conv - For playback only, non-zero if streams with the same
+ *     format are mixed before they are converted, sharing one converter.
+ * thread - The audio thread the device is open on, NULL when it is closed.
+ *     Picked by the iodev list when the device is opened.
  * idle_timeout - The timestamp when to close the dev after being idle.
  * open_ts - The time when the device opened.
  * loopbacks - List of registered cras_loopback objects representing the
@@ -293,6 +300,9 @@ struct cras_iodev {
 	unsigned int highest_hw_level;
 	unsigned int largest_cb_level;
 	struct buffer_share *buf_state;
+	struct cras_mix_bus *mix_bus;
+	int share_playback_conv;
+	struct audio_thread *thread;
 	struct timespec idle_timeout;
 	struct timespec open_ts;
 	struct cras_loopback *loopbacks;
@@ -584,6 +594,13 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 				 unsigned int nframes, int *is_non_empty,
 				 struct cras_fmt_conv *remix_converter);
 
+/* Processes the first nframes of the mix bus of iodev, quantizes them into
+ * frames, a buffer from get_buffer, and marks it as written. The arguments
+ * are the same as for cras_iodev_put_output_buffer(). */
+int cras_iodev_put_output_mix_bus(struct cras_iodev *iodev, uint8_t *frames,
+				  unsigned int nframes, int *is_non_empty,
+				  struct cras_fmt_conv *remix_converter);
+
 /* Returns a buffer to read from.
  * Args:
  *    iodev - The device.
@@ -75,7 +75,11 @@ static uint32_t next_iodev_idx = MAX_SPECIAL_DEVICE_IDX;
 /* Call when a device is enabled or disabled. */
 struct device_enabled_cb *device_enable_cbs;
 
-/* Thread that handles audio input and output. */
+/* Threads that handle audio input and output, each device is open on one. */
+static struct audio_thread *audio_threads[CRAS_MAX_AUDIO_THREADS];
+static unsigned int num_audio_threads;
+/* The thread of the device being opened or closed, the first thread
+ * otherwise. Devices add and remove their callbacks on this thread. */
 static struct audio_thread *audio_thread;
 /* List of all streams. */
 static struct stream_list *stream_list;
@@ -90,6 +94,114 @@ static int hotword_suspended = 0;
 
 static void idle_dev_check(struct cras_timer *timer, void *data);
 
+/* Returns the thread dev is open on. Closed devices have no streams, the first
+ * thread will answer for them. */
+static struct audio_thread *dev_thread(const struct cras_iodev *dev)
+{
+	return dev->thread ? dev->thread : audio_threads[0];
+}
+
+/* Makes device open and close act on thread. */
+static void select_audio_thread(struct audio_thread *thread)
+{
+	audio_thread = thread;
+	audio_thread_select(thread);
+}
+
+static int is_loopback_dev(const struct cras_iodev *dev)
+{
+	return dev == loopdev_post_mix || dev == loopdev_post_dsp;
+}
+
+/* Returns the thread of an open enabled device in direction dir other than
+ * dev, or NULL if there is none. */
+static struct audio_thread *
+enabled_dev_thread(enum CRAS_STREAM_DIRECTION dir, const struct cras_iodev *dev)
+{
+	struct enabled_dev *edev;
+
+	DL_FOREACH (enabled_devs[dir], edev)
+		if (edev->dev != dev && edev->dev->thread)
+			return edev->dev->thread;
+	return NULL;
+}
+
+/* Returns a hash of the card name at the start of the device name. */
+static unsigned int card_hash(const struct cras_iodev *dev)
+{
+	const char *c;
+	unsigned int hash = 0;
+
+	for (c = dev->info.name; *c && *c != ':'; c++)
+		hash = hash * 31 + (unsigned char)*c;
+	return hash;
+}
+
+/* Returns the thread the configured policy places dev on. */
+static struct audio_thread *policy_thread(const struct cras_iodev *dev)
+{
+	unsigned int key;
+
+	/* Silent and loopback devices stay with the first thread. */
+	if (dev->info.idx < MAX_SPECIAL_DEVICE_IDX || !dev->active_node)
+		return audio_threads[0];
+
+	switch (cras_system_get_audio_thread_device_policy()) {
+	case AUDIO_THREAD_DEVICE_POLICY_PER_BUS:
+		if (dev->active_node->type == CRAS_NODE_TYPE_USB)
+			key = 1;
+		else if (dev->active_node->type == CRAS_NODE_TYPE_BLUETOOTH)
+			key = 2;
+		else
+			key = 0;
+		break;
+	case AUDIO_THREAD_DEVICE_POLICY_PER_CARD:
+	default:
+		key = card_hash(dev);
+		break;
+	}
+	return audio_threads[key % num_audio_threads];
+}
+
+/*
+ * Picks the thread to open dev on. Devices that exchange audio without going
+ * through a stream's shm must run on the same thread, so the policy only
+ * decides where a group of such devices goes:
+ *  - A stream that isn't pinned is attached to every enabled device of its
+ *    direction, which mix from its shm on one thread.
+ *  - Loopback devices are fed from the put_buffer of the enabled output.
+ */
+static struct audio_thread *pick_audio_thread(struct cras_iodev *dev)
+{
+	struct audio_thread *thread;
+	struct enabled_dev *edev;
+
+	if (num_audio_threads == 1)
+		return audio_threads[0];
+
+	if (is_loopback_dev(dev)) {
+		thread = enabled_dev_thread(CRAS_STREAM_OUTPUT, NULL);
+		if (thread)
+			return thread;
+		edev = enabled_devs[CRAS_STREAM_OUTPUT];
+		return edev ? policy_thread(edev->dev) : audio_threads[0];
+	}
+
+	if (cras_iodev_list_dev_is_enabled(dev)) {
+		thread = enabled_dev_thread(dev->direction, dev);
+		if (thread)
+			return thread;
+		if (dev->direction == CRAS_STREAM_OUTPUT) {
+			if (loopdev_post_mix && loopdev_post_mix->thread)
+				return loopdev_post_mix->thread;
+			if (loopdev_post_dsp && loopdev_post_dsp->thread)
+				return loopdev_post_dsp->thread;
+		}
+	}
+
+	return policy_thread(dev);
+}
+
 static struct cras_iodev *find_dev(size_t dev_index)
 {
 	struct cras_iodev *dev;
@@ -315,7 +427,7 @@ static void sys_mute_change(void *context, int muted, int user_muted,
 			cras_iodev_set_mute(dev);
 		} else {
 			audio_thread_dev_start_ramp(
-				audio_thread, dev->info.idx,
+				dev_thread(dev), dev->info.idx,
 				(should_mute ?
 					 CRAS_IODEV_RAMP_REQUEST_DOWN_MUTE :
 					 CRAS_IODEV_RAMP_REQUEST_UP_UNMUTE));
@@ -327,7 +439,8 @@ static void remove_all_streams_from_dev(struct cras_iodev *dev)
 {
 	struct cras_rstream *rstream;
 
-	audio_thread_rm_open_dev(audio_thread, dev->direction, dev->info.idx);
+	audio_thread_rm_open_dev(dev_thread(dev), dev->direction,
+				 dev->info.idx);
 
 	DL_FOREACH (stream_list_get(stream_list), rstream) {
 		if (rstream->apm_list == NULL)
@@ -378,7 +491,10 @@ static int close_dev_without_idle_check(struct cras_iodev *dev)
 
 	remove_all_streams_from_dev(dev);
 	dev->idle_timeout.tv_sec = 0;
+	select_audio_thread(dev_thread(dev));
 	cras_iodev_close(dev);
+	select_audio_thread(audio_threads[0]);
+	dev->thread = NULL;
 	possibly_disable_echo_reference(dev);
 	return 0;
 }
@@ -465,13 +581,22 @@ static int init_device(struct cras_iodev *dev, struct cras_rstream *rstream)
 		return 0;
 	cancel_pending_init_retries(dev->info.idx);
 
+	/* Callbacks the device adds while it opens go to its thread. */
+	dev->thread = pick_audio_thread(dev);
+	select_audio_thread(dev->thread);
 	rc = cras_iodev_open(dev, rstream->cb_threshold, &rstream->format);
-	if (rc)
+	if (rc) {
+		select_audio_thread(audio_threads[0]);
+		dev->thread = NULL;
 		return rc;
+	}
 
-	rc = audio_thread_add_open_dev(audio_thread, dev);
-	if (rc)
+	rc = audio_thread_add_open_dev(dev->thread, dev);
+	if (rc) {
 		cras_iodev_close(dev);
+		dev->thread = NULL;
+	}
+	select_audio_thread(audio_threads[0]);
 
 	possibly_enable_echo_reference(dev);
 
@@ -482,6 +607,7 @@ static void suspend_devs()
 {
 	struct enabled_dev *edev;
 	struct cras_rstream *rstream;
+	unsigned int i;
 
 	DL_FOREACH (stream_list_get(stream_list), rstream) {
 		if (rstream->is_pinned) {
@@ -492,14 +618,15 @@ static void suspend_devs()
 
 			dev = find_dev(rstream->pinned_dev_idx);
 			if (dev) {
-				audio_thread_disconnect_stream(audio_thread,
+				audio_thread_disconnect_stream(dev_thread(dev),
 							       rstream, dev);
 				if (!cras_iodev_list_dev_is_enabled(dev))
 					close_dev(dev);
 			}
 		} else {
-			audio_thread_disconnect_stream(audio_thread, rstream,
-						       NULL);
+			for (i = 0; i < num_audio_threads; i++)
+				audio_thread_disconnect_stream(
+					audio_threads[i], rstream, NULL);
 		}
 	}
 	stream_list_suspended = 1;
@@ -589,14 +716,29 @@ static int add_stream_to_open_devs(struct cras_rstream *stream,
 				   struct cras_iodev **iodevs,
 				   unsigned int num_iodevs)
 {
+	struct audio_thread *thread = dev_thread(iodevs[0]);
 	int i;
+
+	/* A stream is run by one thread, pick_audio_thread keeps the devices
+	 * it's attached to together. Devices opened apart for pinned streams
+	 * can still be on different threads, fail rather than play the stream
+	 * on only some of them. */
+	for (i = 1; i < num_iodevs; i++) {
+		if (dev_thread(iodevs[i]) != thread) {
+			syslog(LOG_ERR,
+			       "Stream %x devices %s and %s on different threads",
+			       stream->stream_id, iodevs[0]->info.name,
+			       iodevs[i]->info.name);
+			return -EINVAL;
+		}
+	}
+
 	if (stream->apm_list) {
 		for (i = 0; i < num_iodevs; i++)
 			cras_apm_list_add(stream->apm_list, iodevs[i],
 					  iodevs[i]->format);
 	}
-	return audio_thread_add_stream(audio_thread, stream, iodevs,
-				       num_iodevs);
+	return audio_thread_add_stream(thread, stream, iodevs, num_iodevs);
 }
 
 static int init_and_attach_streams(struct cras_iodev *dev)
@@ -685,7 +827,7 @@ static int init_pinned_device(struct cras_iodev *dev,
 
 	cras_iodev_exit_idle(dev);
 
-	if (audio_thread_is_dev_open(audio_thread, dev))
+	if (audio_thread_is_dev_open(dev_thread(dev), dev))
 		return 0;
 
 	/* Make sure the active node is configured properly, it could be
@@ -850,9 +992,12 @@ static void pinned_stream_removed(struct cras_rstream *rstream)
 static int stream_removed_cb(struct cras_rstream *rstream)
 {
 	enum CRAS_STREAM_DIRECTION direction = rstream->direction;
-	int rc;
+	unsigned int i;
+	int rc = 0;
 
-	rc = audio_thread_drain_stream(audio_thread, rstream);
+	/* Only the thread running the stream has anything to drain. */
+	for (i = 0; i < num_audio_threads && !rc; i++)
+		rc = audio_thread_drain_stream(audio_threads[i], rstream);
 	if (rc)
 		return rc;
 
@@ -921,7 +1066,7 @@ static int disable_device(struct enabled_dev *edev, bool force)
 			continue;
 		if (stream->is_pinned && !force)
 			continue;
-		audio_thread_disconnect_stream(audio_thread, stream, dev);
+		audio_thread_disconnect_stream(dev_thread(dev), stream, dev);
 	}
 	/* If this is a force disable call, that guarantees pinned streams have
 	 * all been detached. Otherwise check with stream_list to see if
@@ -959,7 +1104,7 @@ static int force_close_pinned_only_device(struct cras_iodev *dev)
 			continue;
 		if (dev->info.idx != rstream->pinned_dev_idx)
 			continue;
-		audio_thread_disconnect_stream(audio_thread, rstream, dev);
+		audio_thread_disconnect_stream(dev_thread(dev), rstream, dev);
 	}
 
 	close_dev(dev);
@@ -967,6 +1112,35 @@ static int force_close_pinned_only_device(struct cras_iodev *dev)
 	return 0;
 }
 
+/* Creates and starts the audio threads, pinning each to the next CPU in the
+ * configured mask. */
+static void create_audio_threads()
+{
+	unsigned int cpu_mask = cras_system_get_audio_thread_cpu_mask();
+	int num = cras_system_get_num_audio_threads();
+	int cpu = -1;
+	unsigned int i;
+
+	num_audio_threads = MAX(1, MIN(num, CRAS_MAX_AUDIO_THREADS));
+	for (i = 0; i < num_audio_threads; i++) {
+		audio_threads[i] = audio_thread_create();
+		if (!audio_threads[i]) {
+			syslog(LOG_ERR, "Fatal: audio thread init");
+			exit(-ENOMEM);
+		}
+		audio_thread_use_epoll(audio_threads[i],
+				       cras_system_get_audio_thread_use_epoll());
+		if (cpu_mask) {
+			do {
+				cpu = (cpu + 1) % 32;
+			} while (!(cpu_mask & (1u << cpu)));
+			audio_thread_set_cpu(audio_threads[i], cpu);
+		}
+		audio_thread_start(audio_threads[i]);
+	}
+	select_audio_thread(audio_threads[0]);
+}
+
 /*
  * Exported Interface.
  */
@@ -1006,19 +1180,19 @@ void cras_iodev_list_init()
 	loopdev_post_mix = loopback_iodev_create(LOOPBACK_POST_MIX_PRE_DSP);
 	loopdev_post_dsp = loopback_iodev_create(LOOPBACK_POST_DSP);
 
-	audio_thread = audio_thread_create();
-	if (!audio_thread) {
-		syslog(LOG_ERR, "Fatal: audio thread init");
-		exit(-ENOMEM);
-	}
-	audio_thread_start(audio_thread);
+	create_audio_threads();
 
 	cras_iodev_list_update_device_list();
 }
 
 void cras_iodev_list_deinit()
 {
-	audio_thread_destroy(audio_thread);
+	unsigned int i;
+
+	for (i = 0; i < num_audio_threads; i++)
+		audio_thread_destroy(audio_threads[i]);
+	num_audio_threads = 0;
+	audio_thread = NULL;
 	loopback_iodev_destroy(loopdev_post_dsp);
 	loopback_iodev_destroy(loopdev_post_mix);
 	empty_iodev_destroy(empty_hotword_dev);
@@ -1130,7 +1304,7 @@ void cras_iodev_list_suspend_dev(unsigned int dev_idx)
 		if ((dev->is_enabled && !rstream->is_pinned) ||
 		    (rstream->is_pinned &&
 		     (dev->info.idx != rstream->pinned_dev_idx)))
-			audio_thread_disconnect_stream(audio_thread, rstream,
+			audio_thread_disconnect_stream(dev_thread(dev), rstream,
 						       dev);
 	}
 	close_dev(dev);
@@ -1349,9 +1523,9 @@ int cras_iodev_list_suspend_hotword_streams()
 			continue;
 		}
 
-		audio_thread_disconnect_stream(audio_thread, stream,
+		audio_thread_disconnect_stream(dev_thread(hotword_dev), stream,
 					       hotword_dev);
-		audio_thread_add_stream(audio_thread, stream,
+		audio_thread_add_stream(dev_thread(empty_hotword_dev), stream,
 					&empty_hotword_dev, 1);
 	}
 	close_pinned_device(hotword_dev);
@@ -1385,9 +1559,10 @@ int cras_iodev_list_resume_hotword_stream()
 			continue;
 		}
 
-		audio_thread_disconnect_stream(audio_thread, stream,
-					       empty_hotword_dev);
-		audio_thread_add_stream(audio_thread, stream, &hotword_dev, 1);
+		audio_thread_disconnect_stream(dev_thread(empty_hotword_dev),
+					       stream, empty_hotword_dev);
+		audio_thread_add_stream(dev_thread(hotword_dev), stream,
+					&hotword_dev, 1);
 	}
 	close_pinned_device(empty_hotword_dev);
 	hotword_suspended = 0;
@@ -1646,6 +1821,51 @@ struct audio_thread *cras_iodev_list_get_audio_thread()
 	return audio_thread;
 }
 
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info)
+{
+	unsigned int i;
+	int rc;
+
+	info->num_devs = 0;
+	info->num_streams = 0;
+	for (i = 0; i < num_audio_threads; i++) {
+		rc = audio_thread_dump_thread_info(audio_threads[i], info);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+					const float *coefficient)
+{
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < num_audio_threads; i++) {
+		rc = audio_thread_config_global_remix(audio_threads[i],
+						      num_channels, coefficient);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+int cras_iodev_list_set_aec_dump(cras_stream_id_t stream_id,
+				 unsigned int start, int fd)
+{
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < num_audio_threads; i++) {
+		rc = audio_thread_set_aec_dump(audio_threads[i], stream_id,
+					       start, fd);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
 struct stream_list *cras_iodev_list_get_stream_list()
 {
 	return stream_list;
@@ -15,9 +15,23 @@
 #include "cras_iodev.h"
 #include "cras_types.h"
 
+struct audio_debug_info;
 struct cras_rclient;
 struct stream_list;
 
+/* Most audio threads the devices are spread over. */
+#define CRAS_MAX_AUDIO_THREADS 4
+
+/* How devices that don't have to share a thread are placed on the audio
+ * threads.
+ *    PER_CARD - Devices of the same sound card share a thread.
+ *    PER_BUS - Internal, USB and Bluetooth devices each get a thread.
+ */
+enum CRAS_AUDIO_THREAD_DEVICE_POLICY {
+	AUDIO_THREAD_DEVICE_POLICY_PER_CARD = 0,
+	AUDIO_THREAD_DEVICE_POLICY_PER_BUS,
+};
+
 /* Device enabled/disabled callback. */
 typedef void (*device_enabled_callback_t)(struct cras_iodev *dev,
 					  void *cb_data);
@@ -230,9 +244,21 @@ void cras_iodev_list_test_dev_command(unsigned int iodev_idx,
 				      unsigned int data_len,
 				      const uint8_t *data);
 
-/* Gets the audio thread used by the devices. */
+/* Gets the audio thread of the device being opened or closed, the first
+ * audio thread otherwise. */
 struct audio_thread *cras_iodev_list_get_audio_thread();
 
+/* Dumps the devices and streams of all audio threads to info. */
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info);
+
+/* Configures the global remix converter of all audio threads. */
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+					const float *coefficient);
+
+/* Starts or stops the AEC dump of a stream on the audio threads. */
+int cras_iodev_list_set_aec_dump(cras_stream_id_t stream_id,
+				 unsigned int start, int fd);
+
 /* Gets the list of all active audio streams attached to devices. */
 struct stream_list *cras_iodev_list_get_stream_list();
 
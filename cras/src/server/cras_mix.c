@@ -14,7 +14,8 @@ static const struct cras_mix_ops *ops = &mixer_ops;
 static const struct cras_mix_ops *get_mixer_ops(unsigned int cpu_flags)
 {
 #if defined HAVE_FMA
-	if (cpu_flags & CPU_X86_FMA)
+	/* Built with -mavx2 as well, some CPUs have FMA but not AVX2. */
+	if ((cpu_flags & CPU_X86_FMA) && (cpu_flags & CPU_X86_AVX2))
 		return &mixer_ops_fma;
 #endif
 #if defined HAVE_AVX2
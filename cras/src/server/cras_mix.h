@@ -7,15 +7,10 @@
 #define _CRAS_MIX_H
 
 #include "cras_types.h"
+#include "cras_util.h"
 
 struct cras_audio_shm;
 
-/* SIMD optimisation flags */
-#define CPU_X86_SSE4_2 1
-#define CPU_X86_AVX 2
-#define CPU_X86_AVX2 4
-#define CPU_X86_FMA 8
-
 void cras_mix_init(unsigned int flags);
 
 /* Scale the given buffer with the provided scaler and increment.
@@ -0,0 +1,326 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+
+#include "cras_mix_bus.h"
+#include "dsp_util.h"
+
+/* Same limits as the integer scale ops in cras_mix_ops.c. */
+#define MAX_VOLUME_TO_SCALE 0.9999999
+#define MIN_VOLUME_TO_SCALE 0.0000001
+
+/*
+ * Members:
+ *    num_channels - Number of channels.
+ *    max_frames - Number of frames each channel holds.
+ *    filled - Number of frames from the start that have been mixed into or
+ *        cleared, the frames after are stale.
+ *    dither - Non-zero if dither should be added when quantizing.
+ *    dither_seed - State of the dither noise generator.
+ *    channels - Pointers to the samples of each channel.
+ *    samples - Storage for all channels.
+ */
+struct cras_mix_bus {
+	unsigned int num_channels;
+	unsigned int max_frames;
+	unsigned int filled;
+	int dither;
+	uint32_t dither_seed;
+	float **channels;
+	float *samples;
+};
+
+/* Clears the frames between the filled ones and end. */
+static void fill_to(struct cras_mix_bus *bus, unsigned int end)
+{
+	unsigned int ch;
+
+	if (end <= bus->filled)
+		return;
+	for (ch = 0; ch < bus->num_channels; ch++)
+		memset(bus->channels[ch] + bus->filled, 0,
+		       (end - bus->filled) * sizeof(float));
+	bus->filled = end;
+}
+
+static void add_s16le(struct cras_mix_bus *bus, const int16_t *src,
+		      unsigned int offset, unsigned int frames, float scaler)
+{
+	unsigned int num_channels = bus->num_channels;
+	unsigned int ch, i;
+	float *dst;
+
+	scaler /= 32768.0f;
+	for (ch = 0; ch < num_channels; ch++) {
+		dst = bus->channels[ch] + offset;
+		for (i = 0; i < frames; i++)
+			dst[i] += src[i * num_channels + ch] * scaler;
+	}
+}
+
+static void add_s24le(struct cras_mix_bus *bus, const int32_t *src,
+		      unsigned int offset, unsigned int frames, float scaler)
+{
+	unsigned int num_channels = bus->num_channels;
+	unsigned int ch, i;
+	float *dst;
+
+	scaler /= 2147483648.0f;
+	for (ch = 0; ch < num_channels; ch++) {
+		dst = bus->channels[ch] + offset;
+		for (i = 0; i < frames; i++)
+			dst[i] += (int32_t)((uint32_t)src[i * num_channels + ch]
+					    << 8) *
+				  scaler;
+	}
+}
+
+static void add_s243le(struct cras_mix_bus *bus, const uint8_t *src,
+		       unsigned int offset, unsigned int frames, float scaler)
+{
+	unsigned int num_channels = bus->num_channels;
+	unsigned int ch, i;
+	const uint8_t *s;
+	int32_t sample;
+	float *dst;
+
+	scaler /= 2147483648.0f;
+	for (ch = 0; ch < num_channels; ch++) {
+		dst = bus->channels[ch] + offset;
+		s = src + ch * 3;
+		for (i = 0; i < frames; i++, s += num_channels * 3) {
+			sample = (int32_t)((uint32_t)s[0] << 8 |
+					   (uint32_t)s[1] << 16 |
+					   (uint32_t)s[2] << 24);
+			dst[i] += sample * scaler;
+		}
+	}
+}
+
+static void add_s32le(struct cras_mix_bus *bus, const int32_t *src,
+		      unsigned int offset, unsigned int frames, float scaler)
+{
+	unsigned int num_channels = bus->num_channels;
+	unsigned int ch, i;
+	float *dst;
+
+	scaler /= 2147483648.0f;
+	for (ch = 0; ch < num_channels; ch++) {
+		dst = bus->channels[ch] + offset;
+		for (i = 0; i < frames; i++)
+			dst[i] += src[i * num_channels + ch] * scaler;
+	}
+}
+
+/* Returns a uniformly distributed value in [0, 1). */
+static inline float dither_rand(struct cras_mix_bus *bus)
+{
+	uint32_t x = bus->dither_seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	bus->dither_seed = x;
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Adds triangular dither of +/- one step of the output format. Channels that
+ * are silent are left alone, so silence stays digital silence. */
+static void add_dither(struct cras_mix_bus *bus, snd_pcm_format_t fmt,
+		       unsigned int frames)
+{
+	unsigned int ch, i;
+	float lsb;
+	float *buf;
+
+	switch (fmt) {
+	case SND_PCM_FORMAT_S16_LE:
+		lsb = 1.0f / 32768.0f;
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+		lsb = 1.0f / 8388608.0f;
+		break;
+	default:
+		/* Float samples don't have the precision left to dither 32
+		 * bit output. */
+		return;
+	}
+
+	for (ch = 0; ch < bus->num_channels; ch++) {
+		buf = bus->channels[ch];
+		for (i = 0; i < frames; i++)
+			if (buf[i] != 0.0f)
+				break;
+		if (i == frames)
+			continue;
+		for (i = 0; i < frames; i++)
+			buf[i] += (dither_rand(bus) - dither_rand(bus)) * lsb;
+	}
+}
+
+/*
+ * Exported interface
+ */
+
+struct cras_mix_bus *cras_mix_bus_create(unsigned int num_channels,
+					 unsigned int max_frames, int dither)
+{
+	struct cras_mix_bus *bus;
+	unsigned int ch;
+
+	bus = (struct cras_mix_bus *)calloc(1, sizeof(*bus));
+	if (!bus)
+		return NULL;
+
+	bus->num_channels = num_channels;
+	bus->max_frames = max_frames;
+	bus->dither = dither;
+	bus->dither_seed = 0x12345678;
+	bus->channels = (float **)calloc(num_channels, sizeof(float *));
+	bus->samples = (float *)calloc((size_t)num_channels * max_frames,
+				       sizeof(float));
+	if (!bus->channels || !bus->samples) {
+		cras_mix_bus_destroy(bus);
+		return NULL;
+	}
+	for (ch = 0; ch < num_channels; ch++)
+		bus->channels[ch] = bus->samples + (size_t)ch * max_frames;
+
+	return bus;
+}
+
+void cras_mix_bus_destroy(struct cras_mix_bus *bus)
+{
+	free(bus->channels);
+	free(bus->samples);
+	free(bus);
+}
+
+unsigned int cras_mix_bus_num_channels(const struct cras_mix_bus *bus)
+{
+	return bus->num_channels;
+}
+
+float *const *cras_mix_bus_channels(struct cras_mix_bus *bus)
+{
+	return bus->channels;
+}
+
+void cras_mix_bus_zero(struct cras_mix_bus *bus, unsigned int offset,
+		       unsigned int frames)
+{
+	unsigned int ch;
+
+	if (offset >= bus->max_frames)
+		return;
+	frames = MIN(frames, bus->max_frames - offset);
+
+	fill_to(bus, offset);
+	for (ch = 0; ch < bus->num_channels; ch++)
+		memset(bus->channels[ch] + offset, 0, frames * sizeof(float));
+	bus->filled = MAX(bus->filled, offset + frames);
+}
+
+int cras_mix_bus_add(struct cras_mix_bus *bus, snd_pcm_format_t fmt,
+		     const uint8_t *src, unsigned int offset,
+		     unsigned int frames, int mute, float scaler)
+{
+	if (offset + frames > bus->max_frames)
+		return -EINVAL;
+
+	fill_to(bus, offset + frames);
+	if (mute)
+		return 0;
+
+	switch (fmt) {
+	case SND_PCM_FORMAT_S16_LE:
+		add_s16le(bus, (const int16_t *)src, offset, frames, scaler);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		add_s24le(bus, (const int32_t *)src, offset, frames, scaler);
+		break;
+	case SND_PCM_FORMAT_S24_3LE:
+		add_s243le(bus, src, offset, frames, scaler);
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		add_s32le(bus, (const int32_t *)src, offset, frames, scaler);
+		break;
+	default:
+		syslog(LOG_ERR, "Invalid format to mix into bus");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+void cras_mix_bus_scale(struct cras_mix_bus *bus, unsigned int frames,
+			float scaler, float increment, float target)
+{
+	unsigned int ch, i;
+	float applied_scaler, step_scaler;
+	float *buf;
+
+	frames = MIN(frames, bus->max_frames);
+	fill_to(bus, frames);
+
+	if (increment == 0.0f && scaler > MAX_VOLUME_TO_SCALE)
+		return;
+	if (scaler < MIN_VOLUME_TO_SCALE && increment <= 0.0f) {
+		cras_mix_bus_zero(bus, 0, frames);
+		return;
+	}
+
+	for (ch = 0; ch < bus->num_channels; ch++) {
+		buf = bus->channels[ch];
+		step_scaler = scaler;
+		for (i = 0; i < frames; i++) {
+			applied_scaler = step_scaler;
+			if ((applied_scaler > target && increment > 0) ||
+			    (applied_scaler < target && increment < 0))
+				applied_scaler = target;
+
+			if (applied_scaler > MAX_VOLUME_TO_SCALE)
+				;
+			else if (applied_scaler < MIN_VOLUME_TO_SCALE)
+				buf[i] = 0.0f;
+			else
+				buf[i] *= applied_scaler;
+			step_scaler += increment;
+		}
+	}
+}
+
+int cras_mix_bus_quantize(struct cras_mix_bus *bus, snd_pcm_format_t fmt,
+			  uint8_t *dst, unsigned int frames, int dither)
+{
+	frames = MIN(frames, bus->max_frames);
+	fill_to(bus, frames);
+
+	if (dither && bus->dither)
+		add_dither(bus, fmt, frames);
+
+	return dsp_util_interleave(bus->channels, dst, bus->num_channels, fmt,
+				   frames);
+}
+
+void cras_mix_bus_consume(struct cras_mix_bus *bus, unsigned int frames)
+{
+	unsigned int ch;
+
+	if (frames >= bus->filled) {
+		bus->filled = 0;
+		return;
+	}
+
+	for (ch = 0; ch < bus->num_channels; ch++)
+		memmove(bus->channels[ch], bus->channels[ch] + frames,
+			(bus->filled - frames) * sizeof(float));
+	bus->filled -= frames;
+}
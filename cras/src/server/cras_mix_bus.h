@@ -0,0 +1,97 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_MIX_BUS_H_
+#define CRAS_MIX_BUS_H_
+
+#include <stdint.h>
+
+#include "cras_audio_format.h"
+
+/*
+ * A float planar buffer output streams are mixed into, so that the mix can
+ * go through DSP and volume in float and be quantized to the device format
+ * once. Frame 0 of the bus is the next frame to be written to the device,
+ * the same as offset 0 of the streams' buffer_share offsets.
+ */
+struct cras_mix_bus;
+
+/* Creates a mix bus.
+ * Args:
+ *    num_channels - Number of channels in the bus.
+ *    max_frames - Maximum number of frames the bus holds.
+ *    dither - Non-zero to add TPDF dither when quantizing to 16 or 24 bits.
+ * Returns:
+ *    A pointer to the bus, or NULL on failure.
+ */
+struct cras_mix_bus *cras_mix_bus_create(unsigned int num_channels,
+					 unsigned int max_frames, int dither);
+
+/* Destroys a bus returned from cras_mix_bus_create. */
+void cras_mix_bus_destroy(struct cras_mix_bus *bus);
+
+/* Returns the number of channels in the bus. */
+unsigned int cras_mix_bus_num_channels(const struct cras_mix_bus *bus);
+
+/* Returns the array of pointers to the start of each channel. */
+float *const *cras_mix_bus_channels(struct cras_mix_bus *bus);
+
+/* Sets frames of the bus to zero.
+ * Args:
+ *    bus - The bus to clear.
+ *    offset - First frame to clear.
+ *    frames - Number of frames to clear.
+ */
+void cras_mix_bus_zero(struct cras_mix_bus *bus, unsigned int offset,
+		       unsigned int frames);
+
+/* Returns non-zero if samples in fmt can be added to a bus. */
+static inline int cras_mix_bus_format_supported(snd_pcm_format_t fmt)
+{
+	return fmt == SND_PCM_FORMAT_S16_LE || fmt == SND_PCM_FORMAT_S24_LE ||
+	       fmt == SND_PCM_FORMAT_S24_3LE || fmt == SND_PCM_FORMAT_S32_LE;
+}
+
+/* Converts interleaved samples to float, scales and adds them to the bus.
+ * Args:
+ *    bus - The bus to mix into.
+ *    fmt - Format of the samples in src.
+ *    src - Interleaved samples, with as many channels as the bus.
+ *    offset - Frame of the bus to mix the first frame of src into.
+ *    frames - Number of frames to mix.
+ *    mute - Non-zero if src is muted, nothing is mixed.
+ *    scaler - Volume scaler applied to src.
+ * Returns:
+ *    0 on success, -EINVAL if the format isn't supported or the frames don't
+ *    fit in the bus.
+ */
+int cras_mix_bus_add(struct cras_mix_bus *bus, snd_pcm_format_t fmt,
+		     const uint8_t *src, unsigned int offset,
+		     unsigned int frames, int mute, float scaler);
+
+/* Scales the first frames of the bus, the scaler changing by increment after
+ * each frame until it reaches target. The same as cras_scale_buffer_increment
+ * on the quantized samples, or cras_scale_buffer when increment is 0. */
+void cras_mix_bus_scale(struct cras_mix_bus *bus, unsigned int frames,
+			float scaler, float increment, float target);
+
+/* Converts the first frames of the bus to interleaved samples.
+ * Args:
+ *    bus - The bus to quantize.
+ *    fmt - Format of the samples to write.
+ *    dst - Buffer for the interleaved samples.
+ *    frames - Number of frames to quantize.
+ *    dither - Non-zero to add dither if the bus was created with it.
+ * Returns:
+ *    0 on success, -EINVAL if the format isn't supported.
+ */
+int cras_mix_bus_quantize(struct cras_mix_bus *bus, snd_pcm_format_t fmt,
+			  uint8_t *dst, unsigned int frames, int dither);
+
+/* Removes frames written to the device from the start of the bus, moving the
+ * frames streams have mixed beyond them to the start. */
+void cras_mix_bus_consume(struct cras_mix_bus *bus, unsigned int frames);
+
+#endif /* CRAS_MIX_BUS_H_ */
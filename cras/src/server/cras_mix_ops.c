@@ -33,6 +33,528 @@ static inline int need_to_scale(float scaler)
 	return (scaler < 0.99 || scaler > 1.01);
 }
 
+/*
+ * SIMD kernels.
+ *
+ * Built when the compiler targets AVX2, SSE4.1 or NEON, which is the case for
+ * the SIMD variants of this file and for ARM builds with NEON. Samples are
+ * widened to 32 bit lanes and go through the same float operations in the same
+ * order as the scalar code, so results are bit exact with it. The SIMD variants
+ * are built without -ffast-math, which would let the compiler reorder them.
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SIMD_LANES 8
+typedef __m256i simd_int;
+typedef __m256 simd_float;
+
+static inline simd_int simd_load_s16(const int16_t *p)
+{
+	return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+/* Stores with saturation to the S16 range. */
+static inline void simd_store_s16(int16_t *p, simd_int v)
+{
+	__m128i lo = _mm256_castsi256_si128(v);
+	__m128i hi = _mm256_extracti128_si256(v, 1);
+
+	_mm_storeu_si128((__m128i *)p, _mm_packs_epi32(lo, hi));
+}
+
+static inline simd_int simd_load_s32(const int32_t *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline void simd_store_s32(int32_t *p, simd_int v)
+{
+	_mm256_storeu_si256((__m256i *)p, v);
+}
+
+static inline simd_float simd_set_f(float f)
+{
+	return _mm256_set1_ps(f);
+}
+
+static inline simd_int simd_set_i(int32_t i)
+{
+	return _mm256_set1_epi32(i);
+}
+
+static inline simd_float simd_to_float(simd_int v)
+{
+	return _mm256_cvtepi32_ps(v);
+}
+
+/* Converts rounding toward zero, like a C cast. */
+static inline simd_int simd_trunc(simd_float v)
+{
+	return _mm256_cvttps_epi32(v);
+}
+
+static inline simd_float simd_mul(simd_float a, simd_float b)
+{
+	return _mm256_mul_ps(a, b);
+}
+
+/* Computes a * b + c rounding after each step like the scalar code does. The
+ * empty asm keeps the compiler from fusing them into an FMA. */
+static inline simd_float simd_mul_add(simd_float a, simd_float b, simd_float c)
+{
+	simd_float p = _mm256_mul_ps(a, b);
+
+	__asm__("" : "+x"(p));
+	return _mm256_add_ps(p, c);
+}
+
+static inline simd_int simd_add(simd_int a, simd_int b)
+{
+	return _mm256_add_epi32(a, b);
+}
+
+static inline simd_int simd_and(simd_int a, simd_int b)
+{
+	return _mm256_and_si256(a, b);
+}
+
+static inline simd_int simd_clamp(simd_int v, simd_int lo, simd_int hi)
+{
+	return _mm256_min_epi32(_mm256_max_epi32(v, lo), hi);
+}
+
+static inline simd_int simd_shl8(simd_int v)
+{
+	return _mm256_slli_epi32(v, 8);
+}
+
+static inline simd_int simd_sra8(simd_int v)
+{
+	return _mm256_srai_epi32(v, 8);
+}
+
+/* Adds with saturation to the S32 range. */
+static inline simd_int simd_add_sat(simd_int a, simd_int b)
+{
+	simd_int sum = _mm256_add_epi32(a, b);
+	simd_int ovf = _mm256_and_si256(_mm256_xor_si256(a, sum),
+					_mm256_xor_si256(b, sum));
+	simd_int sat = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+					_mm256_set1_epi32(INT32_MAX));
+
+	return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sum),
+						     _mm256_castsi256_ps(sat),
+						     _mm256_castsi256_ps(ovf)));
+}
+
+/* Like simd_trunc but clips values at or above 2^31 to INT32_MAX. Values
+ * below -2^31 already convert to INT32_MIN. */
+static inline simd_int simd_trunc_sat(simd_float v)
+{
+	simd_float big = _mm256_cmp_ps(v, _mm256_set1_ps(2147483648.0f),
+				       _CMP_GE_OQ);
+	simd_int r = _mm256_cvttps_epi32(v);
+	simd_int max = _mm256_set1_epi32(INT32_MAX);
+
+	return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(r),
+						    _mm256_castsi256_ps(max),
+						    big));
+}
+
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+
+#define SIMD_LANES 4
+typedef __m128i simd_int;
+typedef __m128 simd_float;
+
+static inline simd_int simd_load_s16(const int16_t *p)
+{
+	return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+/* Stores with saturation to the S16 range. */
+static inline void simd_store_s16(int16_t *p, simd_int v)
+{
+	_mm_storel_epi64((__m128i *)p, _mm_packs_epi32(v, v));
+}
+
+static inline simd_int simd_load_s32(const int32_t *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline void simd_store_s32(int32_t *p, simd_int v)
+{
+	_mm_storeu_si128((__m128i *)p, v);
+}
+
+static inline simd_float simd_set_f(float f)
+{
+	return _mm_set1_ps(f);
+}
+
+static inline simd_int simd_set_i(int32_t i)
+{
+	return _mm_set1_epi32(i);
+}
+
+static inline simd_float simd_to_float(simd_int v)
+{
+	return _mm_cvtepi32_ps(v);
+}
+
+/* Converts rounding toward zero, like a C cast. */
+static inline simd_int simd_trunc(simd_float v)
+{
+	return _mm_cvttps_epi32(v);
+}
+
+static inline simd_float simd_mul(simd_float a, simd_float b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+/* Computes a * b + c rounding after each step like the scalar code does. The
+ * empty asm keeps the compiler from fusing them into an FMA. */
+static inline simd_float simd_mul_add(simd_float a, simd_float b, simd_float c)
+{
+	simd_float p = _mm_mul_ps(a, b);
+
+	__asm__("" : "+x"(p));
+	return _mm_add_ps(p, c);
+}
+
+static inline simd_int simd_add(simd_int a, simd_int b)
+{
+	return _mm_add_epi32(a, b);
+}
+
+static inline simd_int simd_and(simd_int a, simd_int b)
+{
+	return _mm_and_si128(a, b);
+}
+
+static inline simd_int simd_clamp(simd_int v, simd_int lo, simd_int hi)
+{
+	return _mm_min_epi32(_mm_max_epi32(v, lo), hi);
+}
+
+static inline simd_int simd_shl8(simd_int v)
+{
+	return _mm_slli_epi32(v, 8);
+}
+
+static inline simd_int simd_sra8(simd_int v)
+{
+	return _mm_srai_epi32(v, 8);
+}
+
+/* Adds with saturation to the S32 range. */
+static inline simd_int simd_add_sat(simd_int a, simd_int b)
+{
+	simd_int sum = _mm_add_epi32(a, b);
+	simd_int ovf = _mm_and_si128(_mm_xor_si128(a, sum),
+				     _mm_xor_si128(b, sum));
+	simd_int sat = _mm_xor_si128(_mm_srai_epi32(a, 31),
+				     _mm_set1_epi32(INT32_MAX));
+
+	return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(sum),
+					      _mm_castsi128_ps(sat),
+					      _mm_castsi128_ps(ovf)));
+}
+
+/* Like simd_trunc but clips values at or above 2^31 to INT32_MAX. Values
+ * below -2^31 already convert to INT32_MIN. */
+static inline simd_int simd_trunc_sat(simd_float v)
+{
+	simd_float big = _mm_cmpge_ps(v, _mm_set1_ps(2147483648.0f));
+	simd_int r = _mm_cvttps_epi32(v);
+	simd_int max = _mm_set1_epi32(INT32_MAX);
+
+	return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(r),
+					      _mm_castsi128_ps(max), big));
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+#define SIMD_LANES 4
+typedef int32x4_t simd_int;
+typedef float32x4_t simd_float;
+
+static inline simd_int simd_load_s16(const int16_t *p)
+{
+	return vmovl_s16(vld1_s16(p));
+}
+
+/* Stores with saturation to the S16 range. */
+static inline void simd_store_s16(int16_t *p, simd_int v)
+{
+	vst1_s16(p, vqmovn_s32(v));
+}
+
+static inline simd_int simd_load_s32(const int32_t *p)
+{
+	return vld1q_s32(p);
+}
+
+static inline void simd_store_s32(int32_t *p, simd_int v)
+{
+	vst1q_s32(p, v);
+}
+
+static inline simd_float simd_set_f(float f)
+{
+	return vdupq_n_f32(f);
+}
+
+static inline simd_int simd_set_i(int32_t i)
+{
+	return vdupq_n_s32(i);
+}
+
+static inline simd_float simd_to_float(simd_int v)
+{
+	return vcvtq_f32_s32(v);
+}
+
+/* Converts rounding toward zero, saturating like a C cast does on ARM. */
+static inline simd_int simd_trunc(simd_float v)
+{
+	return vcvtq_s32_f32(v);
+}
+
+static inline simd_float simd_mul(simd_float a, simd_float b)
+{
+	return vmulq_f32(a, b);
+}
+
+/* Computes a * b + c rounding after each step like the scalar code does. The
+ * empty asm keeps the compiler from fusing them into an FMA. */
+static inline simd_float simd_mul_add(simd_float a, simd_float b, simd_float c)
+{
+	simd_float p = vmulq_f32(a, b);
+
+	__asm__("" : "+w"(p));
+	return vaddq_f32(p, c);
+}
+
+static inline simd_int simd_add(simd_int a, simd_int b)
+{
+	return vaddq_s32(a, b);
+}
+
+static inline simd_int simd_and(simd_int a, simd_int b)
+{
+	return vandq_s32(a, b);
+}
+
+static inline simd_int simd_clamp(simd_int v, simd_int lo, simd_int hi)
+{
+	return vminq_s32(vmaxq_s32(v, lo), hi);
+}
+
+static inline simd_int simd_shl8(simd_int v)
+{
+	return vshlq_n_s32(v, 8);
+}
+
+static inline simd_int simd_sra8(simd_int v)
+{
+	return vshrq_n_s32(v, 8);
+}
+
+/* Adds with saturation to the S32 range. */
+static inline simd_int simd_add_sat(simd_int a, simd_int b)
+{
+	return vqaddq_s32(a, b);
+}
+
+/* The conversion already saturates on ARM. */
+static inline simd_int simd_trunc_sat(simd_float v)
+{
+	return vcvtq_s32_f32(v);
+}
+
+#endif
+
+#ifdef SIMD_LANES
+
+#define S24_LE_MAX 0x007fffff
+#define S24_LE_MIN ((int32_t)0xff800000)
+
+typedef void (*simd_op_s16)(int16_t *dst, const int16_t *src, simd_float k);
+typedef void (*simd_op_s32)(int32_t *dst, const int32_t *src, simd_float k);
+
+/* Runs op over count samples, SIMD_LANES at a time. The samples left over at
+ * the end go through a zero padded copy, so they take the same path. dst and
+ * src may be the same buffer. */
+static inline void simd_run_s16(simd_op_s16 op, int16_t *dst,
+				const int16_t *src, size_t count, float k)
+{
+	int16_t dst_tail[SIMD_LANES] = { 0 };
+	int16_t src_tail[SIMD_LANES] = { 0 };
+	simd_float vk = simd_set_f(k);
+	size_t i, left;
+
+	for (i = 0; i + SIMD_LANES <= count; i += SIMD_LANES)
+		op(dst + i, src + i, vk);
+
+	left = count - i;
+	if (left) {
+		memcpy(dst_tail, dst + i, left * sizeof(*dst));
+		memcpy(src_tail, src + i, left * sizeof(*src));
+		op(dst_tail, src_tail, vk);
+		memcpy(dst + i, dst_tail, left * sizeof(*dst));
+	}
+}
+
+static inline void simd_run_s32(simd_op_s32 op, int32_t *dst,
+				const int32_t *src, size_t count, float k)
+{
+	int32_t dst_tail[SIMD_LANES] = { 0 };
+	int32_t src_tail[SIMD_LANES] = { 0 };
+	simd_float vk = simd_set_f(k);
+	size_t i, left;
+
+	for (i = 0; i + SIMD_LANES <= count; i += SIMD_LANES)
+		op(dst + i, src + i, vk);
+
+	left = count - i;
+	if (left) {
+		memcpy(dst_tail, dst + i, left * sizeof(*dst));
+		memcpy(src_tail, src + i, left * sizeof(*src));
+		op(dst_tail, src_tail, vk);
+		memcpy(dst + i, dst_tail, left * sizeof(*dst));
+	}
+}
+
+/* dst = clip(dst + src) */
+static inline void simd_add_clip_s16(int16_t *dst, const int16_t *src,
+				     simd_float k)
+{
+	simd_store_s16(dst, simd_add(simd_load_s16(dst), simd_load_s16(src)));
+}
+
+/* dst = clip(dst + (int16_t)(src * k)) */
+static inline void simd_scale_add_clip_s16(int16_t *dst, const int16_t *src,
+					   simd_float k)
+{
+	simd_int scaled =
+		simd_trunc(simd_mul(simd_to_float(simd_load_s16(src)), k));
+
+	simd_store_s16(dst, simd_add(simd_load_s16(dst), scaled));
+}
+
+/* dst = src * k */
+static inline void simd_scale_s16(int16_t *dst, const int16_t *src,
+				  simd_float k)
+{
+	simd_float scaled = simd_mul(simd_to_float(simd_load_s16(src)), k);
+
+	simd_store_s16(dst, simd_trunc(scaled));
+}
+
+/* dst = clip(dst + src * k), with the sum done in float. */
+static inline void simd_add_scale_s16(int16_t *dst, const int16_t *src,
+				      simd_float k)
+{
+	simd_float sum = simd_mul_add(simd_to_float(simd_load_s16(src)), k,
+				      simd_to_float(simd_load_s16(dst)));
+
+	simd_store_s16(dst, simd_trunc(sum));
+}
+
+/* dst = clip(dst + src) */
+static inline void simd_add_clip_s32(int32_t *dst, const int32_t *src,
+				     simd_float k)
+{
+	simd_store_s32(dst,
+		       simd_add_sat(simd_load_s32(dst), simd_load_s32(src)));
+}
+
+/* dst = clip(dst + (int32_t)(src * k)) */
+static inline void simd_scale_add_clip_s32(int32_t *dst, const int32_t *src,
+					   simd_float k)
+{
+	simd_int scaled =
+		simd_trunc(simd_mul(simd_to_float(simd_load_s32(src)), k));
+
+	simd_store_s32(dst, simd_add_sat(simd_load_s32(dst), scaled));
+}
+
+/* dst = src * k */
+static inline void simd_scale_s32(int32_t *dst, const int32_t *src,
+				  simd_float k)
+{
+	simd_float scaled = simd_mul(simd_to_float(simd_load_s32(src)), k);
+
+	simd_store_s32(dst, simd_trunc(scaled));
+}
+
+/* dst = clip(dst + src * k), with the sum done in float. */
+static inline void simd_add_scale_s32(int32_t *dst, const int32_t *src,
+				      simd_float k)
+{
+	simd_float sum = simd_mul_add(simd_to_float(simd_load_s32(src)), k,
+				      simd_to_float(simd_load_s32(dst)));
+
+	simd_store_s32(dst, simd_trunc_sat(sum));
+}
+
+/* Vector version of scale_s24_le(). */
+static inline simd_int simd_scale_s24_le(simd_int v, simd_float k)
+{
+	v = simd_trunc(simd_mul(simd_to_float(simd_shl8(v)), k));
+	return simd_and(simd_sra8(v), simd_set_i(0x00ffffff));
+}
+
+static inline simd_int simd_clip_s24(simd_int v)
+{
+	return simd_clamp(v, simd_set_i(S24_LE_MIN), simd_set_i(S24_LE_MAX));
+}
+
+/* dst = clip(dst + src) */
+static inline void simd_add_clip_s24(int32_t *dst, const int32_t *src,
+				     simd_float k)
+{
+	simd_store_s32(dst, simd_clip_s24(simd_add(simd_load_s32(dst),
+						   simd_load_s32(src))));
+}
+
+/* dst = clip(dst + (int32_t)(src * k)) */
+static inline void simd_scale_add_clip_s24(int32_t *dst, const int32_t *src,
+					   simd_float k)
+{
+	simd_int scaled =
+		simd_trunc(simd_mul(simd_to_float(simd_load_s32(src)), k));
+	simd_int sum = simd_add(simd_load_s32(dst), scaled);
+
+	simd_store_s32(dst, simd_clip_s24(sum));
+}
+
+/* dst = scale_s24_le(src, k) */
+static inline void simd_scale_s24(int32_t *dst, const int32_t *src,
+				  simd_float k)
+{
+	simd_store_s32(dst, simd_scale_s24_le(simd_load_s32(src), k));
+}
+
+/* dst = clip(dst + scale_s24_le(src, k)) */
+static inline void simd_add_scale_s24(int32_t *dst, const int32_t *src,
+				      simd_float k)
+{
+	simd_int scaled = simd_scale_s24_le(simd_load_s32(src), k);
+	simd_int sum = simd_add(simd_load_s32(dst), scaled);
+
+	simd_store_s32(dst, simd_clip_s24(sum));
+}
+
+#endif /* SIMD_LANES */
+
 /*
  * Signed 16 bit little endian functions.
  */
@@ -40,10 +562,11 @@ static inline int need_to_scale(float scaler)
 static void cras_mix_add_clip_s16_le(int16_t *dst, const int16_t *src,
 				     size_t count)
 {
-	int32_t sum;
-	size_t i;
-
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s16(simd_add_clip_s16, dst, src, count, 0);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int32_t sum;
 		sum = dst[i] + src[i];
 		if (sum > INT16_MAX)
 			sum = INT16_MAX;
@@ -51,6 +574,7 @@ static void cras_mix_add_clip_s16_le(int16_t *dst, const int16_t *src,
 			sum = INT16_MIN;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds src into dst, after scaling by vol.
@@ -58,13 +582,14 @@ static void cras_mix_add_clip_s16_le(int16_t *dst, const int16_t *src,
 static void scale_add_clip_s16_le(int16_t *dst, const int16_t *src,
 				  size_t count, float vol)
 {
-	int32_t sum;
-	size_t i;
-
 	if (vol > MAX_VOLUME_TO_SCALE)
 		return cras_mix_add_clip_s16_le(dst, src, count);
 
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s16(simd_scale_add_clip_s16, dst, src, count, vol);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int32_t sum;
 		sum = dst[i] + (int16_t)(src[i] * vol);
 		if (sum > INT16_MAX)
 			sum = INT16_MAX;
@@ -72,6 +597,7 @@ static void scale_add_clip_s16_le(int16_t *dst, const int16_t *src,
 			sum = INT16_MIN;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds the first stream to the mix.  Don't need to mix, just setup to the new
@@ -79,15 +605,17 @@ static void scale_add_clip_s16_le(int16_t *dst, const int16_t *src,
 static void copy_scaled_s16_le(int16_t *dst, const int16_t *src, size_t count,
 			       float volume_scaler)
 {
-	int i;
-
 	if (volume_scaler > MAX_VOLUME_TO_SCALE) {
 		memcpy(dst, src, count * sizeof(*src));
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s16(simd_scale_s16, dst, src, count, volume_scaler);
+#else
+	for (int i = 0; i < count; i++)
 		dst[i] = src[i] * volume_scaler;
+#endif
 }
 
 static void cras_scale_buffer_inc_s16_le(uint8_t *buffer, unsigned int count,
@@ -125,7 +653,6 @@ static void cras_scale_buffer_inc_s16_le(uint8_t *buffer, unsigned int count,
 static void cras_scale_buffer_s16_le(uint8_t *buffer, unsigned int count,
 				     float scaler)
 {
-	int i;
 	int16_t *out = (int16_t *)buffer;
 
 	if (scaler > MAX_VOLUME_TO_SCALE)
@@ -136,8 +663,12 @@ static void cras_scale_buffer_s16_le(uint8_t *buffer, unsigned int count,
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s16(simd_scale_s16, out, out, count, scaler);
+#else
+	for (int i = 0; i < count; i++)
 		out[i] *= scaler;
+#endif
 }
 
 static void cras_mix_add_s16_le(uint8_t *dst, uint8_t *src, unsigned int count,
@@ -167,6 +698,14 @@ static void cras_mix_add_scale_stride_s16_le(uint8_t *dst, uint8_t *src,
 
 	/* optimise the loops for vectorization */
 	if (dst_stride == src_stride && dst_stride == 2) {
+#ifdef SIMD_LANES
+		if (need_to_scale(scaler))
+			return simd_run_s16(simd_add_scale_s16,
+					    (int16_t *)dst, (int16_t *)src,
+					    count, scaler);
+		return simd_run_s16(simd_add_clip_s16, (int16_t *)dst,
+				    (int16_t *)src, count, 0);
+#else
 		for (i = 0; i < count; i++) {
 			int32_t sum;
 			if (need_to_scale(scaler))
@@ -182,6 +721,7 @@ static void cras_mix_add_scale_stride_s16_le(uint8_t *dst, uint8_t *src,
 			dst += 2;
 			src += 2;
 		}
+#endif
 	} else if (dst_stride == src_stride && dst_stride == 4) {
 		for (i = 0; i < count; i++) {
 			int32_t sum;
@@ -231,10 +771,11 @@ static int32_t scale_s24_le(int32_t value, float scaler)
 static void cras_mix_add_clip_s24_le(int32_t *dst, const int32_t *src,
 				     size_t count)
 {
-	int32_t sum;
-	size_t i;
-
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s32(simd_add_clip_s24, dst, src, count, 0);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int32_t sum;
 		sum = dst[i] + src[i];
 		if (sum > 0x007fffff)
 			sum = 0x007fffff;
@@ -242,6 +783,7 @@ static void cras_mix_add_clip_s24_le(int32_t *dst, const int32_t *src,
 			sum = (int32_t)0xff800000;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds src into dst, after scaling by vol.
@@ -249,13 +791,14 @@ static void cras_mix_add_clip_s24_le(int32_t *dst, const int32_t *src,
 static void scale_add_clip_s24_le(int32_t *dst, const int32_t *src,
 				  size_t count, float vol)
 {
-	int32_t sum;
-	size_t i;
-
 	if (vol > MAX_VOLUME_TO_SCALE)
 		return cras_mix_add_clip_s24_le(dst, src, count);
 
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_add_clip_s24, dst, src, count, vol);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int32_t sum;
 		sum = dst[i] + (int32_t)(src[i] * vol);
 		if (sum > 0x007fffff)
 			sum = 0x007fffff;
@@ -263,6 +806,7 @@ static void scale_add_clip_s24_le(int32_t *dst, const int32_t *src,
 			sum = (int32_t)0xff800000;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds the first stream to the mix.  Don't need to mix, just setup to the new
@@ -270,15 +814,17 @@ static void scale_add_clip_s24_le(int32_t *dst, const int32_t *src,
 static void copy_scaled_s24_le(int32_t *dst, const int32_t *src, size_t count,
 			       float volume_scaler)
 {
-	int i;
-
 	if (volume_scaler > MAX_VOLUME_TO_SCALE) {
 		memcpy(dst, src, count * sizeof(*src));
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_s24, dst, src, count, volume_scaler);
+#else
+	for (int i = 0; i < count; i++)
 		dst[i] = scale_s24_le(src[i], volume_scaler);
+#endif
 }
 
 static void cras_scale_buffer_inc_s24_le(uint8_t *buffer, unsigned int count,
@@ -316,7 +862,6 @@ static void cras_scale_buffer_inc_s24_le(uint8_t *buffer, unsigned int count,
 static void cras_scale_buffer_s24_le(uint8_t *buffer, unsigned int count,
 				     float scaler)
 {
-	int i;
 	int32_t *out = (int32_t *)buffer;
 
 	if (scaler > MAX_VOLUME_TO_SCALE)
@@ -327,8 +872,12 @@ static void cras_scale_buffer_s24_le(uint8_t *buffer, unsigned int count,
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_s24, out, out, count, scaler);
+#else
+	for (int i = 0; i < count; i++)
 		out[i] = scale_s24_le(out[i], scaler);
+#endif
 }
 
 static void cras_mix_add_s24_le(uint8_t *dst, uint8_t *src, unsigned int count,
@@ -358,6 +907,14 @@ static void cras_mix_add_scale_stride_s24_le(uint8_t *dst, uint8_t *src,
 
 	/* optimise the loops for vectorization */
 	if (dst_stride == src_stride && dst_stride == 4) {
+#ifdef SIMD_LANES
+		if (need_to_scale(scaler))
+			return simd_run_s32(simd_add_scale_s24,
+					    (int32_t *)dst, (int32_t *)src,
+					    count, scaler);
+		return simd_run_s32(simd_add_clip_s24, (int32_t *)dst,
+				    (int32_t *)src, count, 0);
+#else
 		for (i = 0; i < count; i++) {
 			int32_t sum;
 			if (need_to_scale(scaler))
@@ -373,6 +930,7 @@ static void cras_mix_add_scale_stride_s24_le(uint8_t *dst, uint8_t *src,
 			dst += 4;
 			src += 4;
 		}
+#endif
 	} else {
 		for (i = 0; i < count; i++) {
 			int32_t sum;
@@ -399,10 +957,11 @@ static void cras_mix_add_scale_stride_s24_le(uint8_t *dst, uint8_t *src,
 static void cras_mix_add_clip_s32_le(int32_t *dst, const int32_t *src,
 				     size_t count)
 {
-	int64_t sum;
-	size_t i;
-
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s32(simd_add_clip_s32, dst, src, count, 0);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int64_t sum;
 		sum = (int64_t)dst[i] + (int64_t)src[i];
 		if (sum > INT32_MAX)
 			sum = INT32_MAX;
@@ -410,6 +969,7 @@ static void cras_mix_add_clip_s32_le(int32_t *dst, const int32_t *src,
 			sum = INT32_MIN;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds src into dst, after scaling by vol.
@@ -417,13 +977,14 @@ static void cras_mix_add_clip_s32_le(int32_t *dst, const int32_t *src,
 static void scale_add_clip_s32_le(int32_t *dst, const int32_t *src,
 				  size_t count, float vol)
 {
-	int64_t sum;
-	size_t i;
-
 	if (vol > MAX_VOLUME_TO_SCALE)
 		return cras_mix_add_clip_s32_le(dst, src, count);
 
-	for (i = 0; i < count; i++) {
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_add_clip_s32, dst, src, count, vol);
+#else
+	for (size_t i = 0; i < count; i++) {
+		int64_t sum;
 		sum = (int64_t)dst[i] + (int64_t)(src[i] * vol);
 		if (sum > INT32_MAX)
 			sum = INT32_MAX;
@@ -431,6 +992,7 @@ static void scale_add_clip_s32_le(int32_t *dst, const int32_t *src,
 			sum = INT32_MIN;
 		dst[i] = sum;
 	}
+#endif
 }
 
 /* Adds the first stream to the mix.  Don't need to mix, just setup to the new
@@ -438,15 +1000,17 @@ static void scale_add_clip_s32_le(int32_t *dst, const int32_t *src,
 static void copy_scaled_s32_le(int32_t *dst, const int32_t *src, size_t count,
 			       float volume_scaler)
 {
-	int i;
-
 	if (volume_scaler > MAX_VOLUME_TO_SCALE) {
 		memcpy(dst, src, count * sizeof(*src));
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_s32, dst, src, count, volume_scaler);
+#else
+	for (int i = 0; i < count; i++)
 		dst[i] = src[i] * volume_scaler;
+#endif
 }
 
 static void cras_scale_buffer_inc_s32_le(uint8_t *buffer, unsigned int count,
@@ -484,7 +1048,6 @@ static void cras_scale_buffer_inc_s32_le(uint8_t *buffer, unsigned int count,
 static void cras_scale_buffer_s32_le(uint8_t *buffer, unsigned int count,
 				     float scaler)
 {
-	int i;
 	int32_t *out = (int32_t *)buffer;
 
 	if (scaler > MAX_VOLUME_TO_SCALE)
@@ -495,8 +1058,12 @@ static void cras_scale_buffer_s32_le(uint8_t *buffer, unsigned int count,
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+#ifdef SIMD_LANES
+	simd_run_s32(simd_scale_s32, out, out, count, scaler);
+#else
+	for (int i = 0; i < count; i++)
 		out[i] *= scaler;
+#endif
 }
 
 static void cras_mix_add_s32_le(uint8_t *dst, uint8_t *src, unsigned int count,
@@ -526,13 +1093,22 @@ static void cras_mix_add_scale_stride_s32_le(uint8_t *dst, uint8_t *src,
 
 	/* optimise the loops for vectorization */
 	if (dst_stride == src_stride && dst_stride == 4) {
+#ifdef SIMD_LANES
+		if (need_to_scale(scaler))
+			return simd_run_s32(simd_add_scale_s32,
+					    (int32_t *)dst, (int32_t *)src,
+					    count, scaler);
+		return simd_run_s32(simd_add_clip_s32, (int32_t *)dst,
+				    (int32_t *)src, count, 0);
+#else
 		for (i = 0; i < count; i++) {
 			int64_t sum;
 			if (need_to_scale(scaler))
 				sum = *(int32_t *)dst +
 				      *(int32_t *)src * scaler;
 			else
-				sum = *(int32_t *)dst + *(int32_t *)src;
+				sum = (int64_t)(*(int32_t *)dst) +
+				      *(int32_t *)src;
 			if (sum > INT32_MAX)
 				sum = INT32_MAX;
 			else if (sum < INT32_MIN)
@@ -541,6 +1117,7 @@ static void cras_mix_add_scale_stride_s32_le(uint8_t *dst, uint8_t *src,
 			dst += 4;
 			src += 4;
 		}
+#endif
 	} else {
 		for (i = 0; i < count; i++) {
 			int64_t sum;
@@ -548,7 +1125,8 @@ static void cras_mix_add_scale_stride_s32_le(uint8_t *dst, uint8_t *src,
 				sum = *(int32_t *)dst +
 				      *(int32_t *)src * scaler;
 			else
-				sum = *(int32_t *)dst + *(int32_t *)src;
+				sum = (int64_t)(*(int32_t *)dst) +
+				      *(int32_t *)src;
 			if (sum > INT32_MAX)
 				sum = INT32_MAX;
 			else if (sum < INT32_MIN)
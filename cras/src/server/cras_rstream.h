@@ -336,6 +336,26 @@ int cras_rstream_get_mute(const struct cras_rstream *rstream);
  */
 int cras_rstream_is_pending_reply(const struct cras_rstream *stream);
 
+/*
+ * Returns a non-negative fd if the stream is expecting a message from its
+ * client and the fd should be polled by the audio thread, otherwise -1.
+ */
+static inline int cras_rstream_poll_fd(const struct cras_rstream *stream)
+{
+	/* For streams which rely on dev level timing, we should
+	 * let client response wake audio thread up. */
+	if (stream_uses_input(stream) && (stream->flags & USE_DEV_TIMING) &&
+	    cras_rstream_is_pending_reply(stream))
+		return stream->fd;
+
+	if (!stream_uses_output(stream) ||
+	    !cras_rstream_is_pending_reply(stream) ||
+	    cras_rstream_get_is_draining(stream))
+		return -1;
+
+	return stream->fd;
+}
+
 /*
  * Reads any pending audio message from the socket.
  */
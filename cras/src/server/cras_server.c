@@ -31,6 +31,7 @@
 #include "cras_dbus.h"
 #include "cras_dbus_control.h"
 #include "cras_hfp_ag_profile.h"
+#include "cras_sbc_codec.h"
 #include "cras_telephony.h"
 #endif
 #include "cras_alert.h"
@@ -54,6 +55,7 @@
 #include "cras_udev.h"
 #include "cras_util.h"
 #include "cras_mix.h"
+#include "cascade.h"
 #include "utlist.h"
 
 /* Store a list of clients that are attached to the server.
@@ -445,8 +447,9 @@ int cras_server_init()
 	/* Initialize global observer. */
 	cras_observer_server_init();
 
-	/* init mixer with CPU capabilities */
+	/* init mixer and DSP cascades with CPU capabilities */
 	cras_mix_init(cpu_get_flags());
+	cascade_init(cpu_get_flags());
 
 	/* Allow clients to register callbacks for file descriptors.
 	 * add_select_fd and rm_select_fd will add and remove file descriptors
@@ -556,6 +559,10 @@ int cras_server_run(unsigned int profile_disable_mask)
 
 	cras_udev_start_sound_subsystem_monitor();
 #ifdef CRAS_DBUS
+	/* Bluetooth codecs are created from here on, the board config is
+	 * loaded by now. */
+	cras_sbc_codec_init(cras_system_get_native_sbc_codec(),
+			    cpu_get_flags());
 	cras_bt_device_start_monitor();
 #endif
 
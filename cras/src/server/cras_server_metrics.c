@@ -51,6 +51,8 @@ const char kStreamSamplingRate[] = "Cras.StreamSamplingRate";
 const char kUnderrunsPerDevice[] = "Cras.UnderrunsPerDevice";
 const char kHfpWidebandSpeechSupported[] = "Cras.HfpWidebandSpeechSupported";
 const char kHfpWidebandSpeechPacketLoss[] = "Cras.HfpWidebandSpeechPacketLoss";
+const char kA2dpBitpoolDecreases[] = "Cras.A2dpBitpoolDecreases";
+const char kA2dpLowestBitpoolPercent[] = "Cras.A2dpLowestBitpoolPercent";
 
 /*
  * Records missed callback frequency only when the runtime of stream is larger
@@ -60,6 +62,8 @@ const double MISSED_CB_FREQUENCY_SECONDS_MIN = 10.0;
 
 /* Type of metrics to log. */
 enum CRAS_SERVER_METRICS_TYPE {
+	A2DP_BITPOOL_DECREASES,
+	A2DP_LOWEST_BITPOOL,
 	BT_WIDEBAND_PACKET_LOSS,
 	BT_WIDEBAND_SUPPORTED,
 	DEVICE_RUNTIME,
@@ -192,6 +196,44 @@ static const char *get_metrics_device_type_str(struct cras_iodev *iodev)
 	}
 }
 
+int cras_server_metrics_a2dp_bitpool_decreases(unsigned num_decreases)
+{
+	struct cras_server_metrics_message msg;
+	union cras_server_metrics_data data;
+	int err;
+
+	data.value = num_decreases;
+	init_server_metrics_msg(&msg, A2DP_BITPOOL_DECREASES, data);
+
+	err = cras_server_metrics_message_send(
+		(struct cras_main_message *)&msg);
+	if (err < 0) {
+		syslog(LOG_ERR,
+		       "Failed to send metrics message: A2DP_BITPOOL_DECREASES");
+		return err;
+	}
+	return 0;
+}
+
+int cras_server_metrics_a2dp_lowest_bitpool(unsigned percent)
+{
+	struct cras_server_metrics_message msg;
+	union cras_server_metrics_data data;
+	int err;
+
+	data.value = percent;
+	init_server_metrics_msg(&msg, A2DP_LOWEST_BITPOOL, data);
+
+	err = cras_server_metrics_message_send(
+		(struct cras_main_message *)&msg);
+	if (err < 0) {
+		syslog(LOG_ERR,
+		       "Failed to send metrics message: A2DP_LOWEST_BITPOOL");
+		return err;
+	}
+	return 0;
+}
+
 int cras_server_metrics_hfp_packet_loss(float packet_loss_ratio)
 {
 	struct cras_server_metrics_message msg;
@@ -594,6 +636,16 @@ static void handle_metrics_message(struct cras_main_message *msg, void *arg)
 	struct cras_server_metrics_message *metrics_msg =
 		(struct cras_server_metrics_message *)msg;
 	switch (metrics_msg->metrics_type) {
+	case A2DP_BITPOOL_DECREASES:
+		cras_metrics_log_histogram(kA2dpBitpoolDecreases,
+					   metrics_msg->data.value, 0, 1000,
+					   20);
+		break;
+	case A2DP_LOWEST_BITPOOL:
+		cras_metrics_log_histogram(kA2dpLowestBitpoolPercent,
+					   metrics_msg->data.value, 0, 100,
+					   20);
+		break;
 	case BT_WIDEBAND_PACKET_LOSS:
 		cras_metrics_log_histogram(kHfpWidebandSpeechPacketLoss,
 					   metrics_msg->data.value, 0, 1000,
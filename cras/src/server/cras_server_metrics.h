@@ -19,6 +19,13 @@ int cras_server_metrics_hfp_wideband_support(bool supported);
 /* Logs the number of packet loss per 1000 packets under HFP capture. */
 int cras_server_metrics_hfp_packet_loss(float packet_loss_ratio);
 
+/* Logs how many times an A2DP device lowered its bitpool while open. */
+int cras_server_metrics_a2dp_bitpool_decreases(unsigned num_decreases);
+
+/* Logs the lowest bitpool an A2DP device used while open, in percent of the
+ * highest negotiated one. */
+int cras_server_metrics_a2dp_lowest_bitpool(unsigned percent);
+
 /* Logs runtime of a device. */
 int cras_server_metrics_device_runtime(struct cras_iodev *iodev);
 
@@ -48,6 +48,27 @@ struct card_list {
  *    add_task - Function to handle adding a task for main thread to execute.
  *    task_data - Data to be passed to add_task handler function.
  *    main_thread_tid - The thread id of the main thread.
+ *    audio_thread_use_epoll - Non-zero if the audio thread should wait on
+ *      epoll instead of ppoll.
+ *    float_mix_bus - Non-zero if output devices should mix streams on a
+ *      float bus.
+ *    float_mix_bus_dither - Non-zero if the float bus should be dithered
+ *      when quantized to the device format.
+ *    shared_playback_conversion - Non-zero if playback streams with the same
+ *      format should share a format converter.
+ *    num_audio_threads - Number of audio threads devices are spread over.
+ *    audio_thread_device_policy - How devices are assigned to audio threads.
+ *    audio_thread_cpu_mask - CPUs the audio threads are pinned to, 0 to let
+ *      them run on any.
+ *    a2dp_encoder_offload - Non-zero if A2DP devices encode on a worker
+ *      thread instead of the audio thread.
+ *    hfp_batched_sco_io - Non-zero if HFP devices read and write all pending
+ *      SCO packets in one wake with recvmmsg and sendmmsg.
+ *    native_sbc_codec - Non-zero if SBC and mSBC are coded by the codec
+ *      built into CRAS instead of libsbc.
+ *    a2dp_adaptive_bitpool - Non-zero if A2DP devices lower the SBC bitpool
+ *      while the link can't keep up.
+ *    dsp_crossfade_ms - How long a reloaded DSP pipeline is crossfaded in.
  */
 static struct {
 	struct cras_server_state *exp_state;
@@ -71,6 +92,18 @@ static struct {
 	void *task_data;
 	struct cras_audio_thread_snapshot_buffer snapshot_buffer;
 	pthread_t main_thread_tid;
+	int audio_thread_use_epoll;
+	int float_mix_bus;
+	int float_mix_bus_dither;
+	int shared_playback_conversion;
+	int num_audio_threads;
+	int audio_thread_device_policy;
+	int audio_thread_cpu_mask;
+	int a2dp_encoder_offload;
+	int hfp_batched_sco_io;
+	int native_sbc_codec;
+	int a2dp_adaptive_bitpool;
+	int dsp_crossfade_ms;
 } state;
 
 /*
@@ -117,6 +150,20 @@ void cras_system_state_init(const char *device_config_dir, const char *shm_name,
 	exp_state->aec_supported = board_config.aec_supported;
 	exp_state->aec_group_id = board_config.aec_group_id;
 	exp_state->bt_wbs_enabled = 0;
+	state.audio_thread_use_epoll = board_config.audio_thread_use_epoll;
+	state.float_mix_bus = board_config.float_mix_bus;
+	state.float_mix_bus_dither = board_config.float_mix_bus_dither;
+	state.shared_playback_conversion =
+		board_config.shared_playback_conversion;
+	state.num_audio_threads = board_config.num_audio_threads;
+	state.audio_thread_device_policy =
+		board_config.audio_thread_device_policy;
+	state.audio_thread_cpu_mask = board_config.audio_thread_cpu_mask;
+	state.a2dp_encoder_offload = board_config.a2dp_encoder_offload;
+	state.hfp_batched_sco_io = board_config.hfp_batched_sco_io;
+	state.native_sbc_codec = board_config.native_sbc_codec;
+	state.a2dp_adaptive_bitpool = board_config.a2dp_adaptive_bitpool;
+	state.dsp_crossfade_ms = board_config.dsp_crossfade_ms;
 
 	if ((rc = pthread_mutex_init(&state.update_lock, 0) != 0)) {
 		syslog(LOG_ERR, "Fatal: system state mutex init");
@@ -361,6 +408,66 @@ int cras_system_get_aec_group_id()
 	return state.exp_state->aec_group_id;
 }
 
+int cras_system_get_audio_thread_use_epoll()
+{
+	return state.audio_thread_use_epoll;
+}
+
+int cras_system_get_float_mix_bus()
+{
+	return state.float_mix_bus;
+}
+
+int cras_system_get_float_mix_bus_dither()
+{
+	return state.float_mix_bus_dither;
+}
+
+int cras_system_get_shared_playback_conversion()
+{
+	return state.shared_playback_conversion;
+}
+
+int cras_system_get_num_audio_threads()
+{
+	return state.num_audio_threads;
+}
+
+int cras_system_get_audio_thread_device_policy()
+{
+	return state.audio_thread_device_policy;
+}
+
+int cras_system_get_audio_thread_cpu_mask()
+{
+	return state.audio_thread_cpu_mask;
+}
+
+int cras_system_get_a2dp_encoder_offload()
+{
+	return state.a2dp_encoder_offload;
+}
+
+int cras_system_get_hfp_batched_sco_io()
+{
+	return state.hfp_batched_sco_io;
+}
+
+int cras_system_get_native_sbc_codec()
+{
+	return state.native_sbc_codec;
+}
+
+int cras_system_get_a2dp_adaptive_bitpool()
+{
+	return state.a2dp_adaptive_bitpool;
+}
+
+int cras_system_get_dsp_crossfade_ms()
+{
+	return state.dsp_crossfade_ms;
+}
+
 void cras_system_set_bt_wbs_enabled(bool enabled)
 {
 	state.exp_state->bt_wbs_enabled = enabled;
@@ -125,6 +125,49 @@ int cras_system_get_aec_supported();
 /* Returns the system aec group id is available. */
 int cras_system_get_aec_group_id();
 
+/* Returns non-zero if the audio thread should wait on epoll. */
+int cras_system_get_audio_thread_use_epoll();
+
+/* Returns non-zero if output devices should mix streams on a float bus. */
+int cras_system_get_float_mix_bus();
+
+/* Returns non-zero if the float mix bus should be dithered. */
+int cras_system_get_float_mix_bus_dither();
+
+/* Returns non-zero if playback streams with the same format should be mixed
+ * before a shared format conversion. */
+int cras_system_get_shared_playback_conversion();
+
+/* Returns the number of audio threads devices are spread over. */
+int cras_system_get_num_audio_threads();
+
+/* Returns how devices are assigned to audio threads, one of
+ * CRAS_AUDIO_THREAD_DEVICE_POLICY in cras_iodev_list.h. */
+int cras_system_get_audio_thread_device_policy();
+
+/* Returns the mask of CPUs to pin audio threads to, 0 to not pin them. */
+int cras_system_get_audio_thread_cpu_mask();
+
+/* Returns non-zero if A2DP devices should encode and write to the socket
+ * on a worker thread instead of the audio thread. */
+int cras_system_get_a2dp_encoder_offload();
+
+/* Returns non-zero if HFP devices should read and write all pending SCO
+ * packets in one wake instead of one packet per wake. */
+int cras_system_get_hfp_batched_sco_io();
+
+/* Returns non-zero if SBC and mSBC should be coded by the codec built into
+ * CRAS instead of libsbc. */
+int cras_system_get_native_sbc_codec();
+
+/* Returns non-zero if A2DP devices should lower the SBC bitpool while the
+ * socket backs up, and raise it again once it drains. */
+int cras_system_get_a2dp_adaptive_bitpool();
+
+/* Returns how many milliseconds a reloaded DSP pipeline is crossfaded in
+ * over, 0 to switch at once. */
+int cras_system_get_dsp_crossfade_ms();
+
 /* Sets the flag to enable or disable bluetooth wideband speech feature. */
 void cras_system_set_bt_wbs_enabled(bool enabled);
 
@@ -7,9 +7,12 @@
 #include <stdbool.h>
 #include <syslog.h>
 
+#include "audio_thread.h"
+#include "audio_thread_latency.h"
 #include "audio_thread_log.h"
 #include "cras_audio_area.h"
 #include "cras_iodev.h"
+#include "cras_mix_bus.h"
 #include "cras_non_empty_audio_handler.h"
 #include "cras_rstream.h"
 #include "cras_server_metrics.h"
@@ -43,8 +46,11 @@ static const int MIN_EMPTY_PERIOD_SEC = 30;
  */
 static const int DROP_FRAMES_THRESHOLD_MS = 50;
 
-/* The number of devices playing/capturing non-empty stream(s). */
-static int non_empty_device_count = 0;
+/* The number of devices playing/capturing non-empty stream(s), counted by
+ * each audio thread for its own devices. */
+static __thread int non_empty_device_count = 0;
+/* The number of audio threads with non_empty_device_count above zero. */
+static int non_empty_thread_count = 0;
 
 /* Gets the master device which the stream is attached to. */
 static inline struct cras_iodev *get_master_dev(const struct dev_stream *stream)
@@ -94,12 +100,18 @@ static inline int count_non_empty_dev(struct open_dev *adevs)
 static void check_non_empty_state_transition(struct open_dev *adevs)
 {
 	int new_non_empty_dev_count = count_non_empty_dev(adevs);
-
-	// If we have transitioned to or from a state with 0 non-empty devices,
-	// notify the main thread to update system state.
-	if ((non_empty_device_count == 0) != (new_non_empty_dev_count == 0))
-		cras_non_empty_audio_send_msg(new_non_empty_dev_count > 0 ? 1 :
-									    0);
+	int num_threads;
+
+	// If we have transitioned to or from a state with 0 non-empty devices
+	// on all audio threads, notify the main thread to update system state.
+	if ((non_empty_device_count == 0) != (new_non_empty_dev_count == 0)) {
+		num_threads = __sync_add_and_fetch(
+			&non_empty_thread_count,
+			new_non_empty_dev_count > 0 ? 1 : -1);
+		if (num_threads == (new_non_empty_dev_count > 0 ? 1 : 0))
+			cras_non_empty_audio_send_msg(
+				new_non_empty_dev_count > 0 ? 1 : 0);
+	}
 
 	non_empty_device_count = new_non_empty_dev_count;
 }
@@ -492,6 +504,11 @@ static int capture_to_streams(struct open_dev *adev)
 		if (rc < 0 || nread == 0)
 			return rc;
 
+		/* Streams converting the same samples the same way can share
+		 * the conversion. */
+		capture_conv_cache_reset(&adev->conv_cache,
+					 idev->streams && idev->streams->next);
+
 		DL_FOREACH (adev->dev->streams, stream) {
 			unsigned int this_read;
 			unsigned int area_offset;
@@ -524,9 +541,10 @@ static int capture_to_streams(struct open_dev *adev)
 						cras_rstream_get_volume_scaler(
 							stream->stream);
 
-			this_read =
-				dev_stream_capture(stream, area, area_offset,
-						   software_gain_scaler);
+			this_read = dev_stream_capture(stream, area,
+						       area_offset,
+						       software_gain_scaler,
+						       &adev->conv_cache);
 
 			input_data_put_for_stream(idev->input_data,
 						  stream->stream,
@@ -562,10 +580,83 @@ static int capture_to_streams(struct open_dev *adev)
  *    This number of frames is the minimum of the amount of frames each stream
  *    could provide which is the maximum that can currently be rendered.
  */
+/*
+ * Puts the running streams of adev that need the same format conversion, and
+ * have the same offset, in a group so they are converted together. Groups
+ * left without streams are destroyed.
+ */
+static void update_conv_groups(struct open_dev *adev)
+{
+	struct cras_iodev *odev = adev->dev;
+	struct playback_conv_group *group;
+	struct dev_stream *curr;
+	unsigned int offset;
+
+	DL_FOREACH (adev->conv_groups, group)
+		group->num_streams = 0;
+
+	DL_FOREACH (odev->streams, curr) {
+		curr->conv_group = NULL;
+		if (!odev->share_playback_conv ||
+		    !dev_stream_is_running(curr) ||
+		    !dev_stream_can_share_conv(curr))
+			continue;
+
+		DL_FOREACH (adev->conv_groups, group) {
+			if (playback_conv_group_matches(group, curr))
+				break;
+		}
+		if (!group) {
+			group = playback_conv_group_create(curr,
+							   odev->buffer_size);
+			if (!group)
+				continue;
+			DL_APPEND(adev->conv_groups, group);
+		}
+
+		/* Streams mixed at another offset convert on their own. */
+		offset = cras_iodev_stream_offset(odev, curr);
+		if (group->num_streams == 0) {
+			group->offset = offset;
+			group->written = -1;
+		} else if (group->offset != offset) {
+			continue;
+		}
+		group->num_streams++;
+		curr->conv_group = group;
+	}
+
+	DL_FOREACH (adev->conv_groups, group) {
+		if (group->num_streams)
+			continue;
+		DL_DELETE(adev->conv_groups, group);
+		playback_conv_group_destroy(group);
+	}
+}
+
+/* Returns the format stream is converted to before it's mixed into dev.
+ * Streams mixed into a float bus keep their own sample format, so the bus
+ * converts and scales their samples straight to float instead of after a
+ * round through the device format. fmt holds the format if it isn't the
+ * device's. */
+static const struct cras_audio_format *
+stream_mix_format(const struct cras_iodev *dev,
+		  const struct cras_rstream *stream,
+		  struct cras_audio_format *fmt)
+{
+	if (!dev->mix_bus || stream->direction != CRAS_STREAM_OUTPUT ||
+	    !cras_mix_bus_format_supported(stream->format.format))
+		return dev->format;
+	*fmt = *dev->format;
+	fmt->format = stream->format.format;
+	return fmt;
+}
+
 static int write_streams(struct open_dev **odevs, struct open_dev *adev,
 			 uint8_t *dst, size_t write_limit)
 {
 	struct cras_iodev *odev = adev->dev;
+	struct cras_mix_bus *bus = odev->mix_bus;
 	struct dev_stream *curr;
 	unsigned int max_offset = 0;
 	unsigned int frame_bytes = cras_get_format_bytes(odev->format);
@@ -609,14 +700,22 @@ static int write_streams(struct open_dev **odevs, struct open_dev *adev,
 	if (!num_playing)
 		write_limit = drain_limit;
 
-	if (write_limit > max_offset)
-		memset(dst + max_offset * frame_bytes, 0,
-		       (write_limit - max_offset) * frame_bytes);
+	if (write_limit > max_offset) {
+		if (bus)
+			cras_mix_bus_zero(bus, max_offset,
+					  write_limit - max_offset);
+		else
+			memset(dst + max_offset * frame_bytes, 0,
+			       (write_limit - max_offset) * frame_bytes);
+	}
 
 	ATLOG(atlog, AUDIO_THREAD_WRITE_STREAMS_MIX, write_limit, max_offset,
 	      0);
 
+	update_conv_groups(adev);
+
 	DL_FOREACH (adev->dev->streams, curr) {
+		struct playback_conv_group *group = curr->conv_group;
 		unsigned int offset;
 		int nwritten;
 
@@ -626,9 +725,23 @@ static int write_streams(struct open_dev **odevs, struct open_dev *adev,
 		offset = cras_iodev_stream_offset(odev, curr);
 		if (offset >= write_limit)
 			continue;
-		nwritten = dev_stream_mix(curr, odev->format,
-					  dst + frame_bytes * offset,
-					  write_limit - offset);
+		if (group) {
+			/* Mixed with the first stream of the group. */
+			if (group->written < 0)
+				group->written = dev_stream_mix_group(
+					adev->dev->streams, group,
+					odev->format,
+					dst + frame_bytes * offset, bus,
+					offset, write_limit - offset);
+			nwritten = group->written;
+		} else if (bus)
+			nwritten = dev_stream_mix_bus(curr, odev->format, bus,
+						      offset,
+						      write_limit - offset);
+		else
+			nwritten = dev_stream_mix(curr, odev->format,
+						  dst + frame_bytes * offset,
+						  write_limit - offset);
 
 		if (nwritten < 0) {
 			dev_io_remove_stream(odevs, curr->stream, NULL);
@@ -770,8 +883,14 @@ int write_output_samples(struct open_dev **odevs, struct open_dev *adev,
 			pic_interval_reset(adev->non_empty_check_pi);
 		}
 
-		rc = cras_iodev_put_output_buffer(
-			odev, dst, written, non_empty_ptr, output_converter);
+		if (odev->mix_bus)
+			rc = cras_iodev_put_output_mix_bus(odev, dst, written,
+							   non_empty_ptr,
+							   output_converter);
+		else
+			rc = cras_iodev_put_output_buffer(odev, dst, written,
+							  non_empty_ptr,
+							  output_converter);
 
 		if (rc < 0)
 			return rc;
@@ -1040,12 +1159,22 @@ int dev_io_playback_write(struct open_dev **odevs,
 void dev_io_run(struct open_dev **odevs, struct open_dev **idevs,
 		struct cras_fmt_conv *output_converter)
 {
+	struct timespec start;
+
 	pic_update_current_time();
 
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 	dev_io_playback_fetch(*odevs);
+	audio_thread_latency_add(AUDIO_THREAD_LATENCY_FETCH, &start);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 	dev_io_capture(idevs);
 	dev_io_send_captured_samples(*idevs);
+	audio_thread_latency_add(AUDIO_THREAD_LATENCY_CAPTURE, &start);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 	dev_io_playback_write(odevs, output_converter);
+	audio_thread_latency_add(AUDIO_THREAD_LATENCY_WRITE, &start);
 
 	check_non_empty_state_transition(*odevs);
 }
@@ -1150,6 +1279,7 @@ void dev_io_rm_open_dev(struct open_dev **odev_list, struct open_dev *dev_to_rm)
 {
 	struct open_dev *odev;
 	struct dev_stream *dev_stream;
+	struct playback_conv_group *group;
 
 	/* Do nothing if dev_to_rm wasn't already in the active dev list. */
 	DL_FOREACH (*odev_list, odev) {
@@ -1180,9 +1310,15 @@ void dev_io_rm_open_dev(struct open_dev **odev_list, struct open_dev *dev_to_rm)
 
 	DL_FOREACH (dev_to_rm->dev->streams, dev_stream) {
 		cras_iodev_rm_stream(dev_to_rm->dev, dev_stream->stream);
+		audio_thread_unpoll_stream(dev_stream->stream);
 		dev_stream_destroy(dev_stream);
 	}
 
+	capture_conv_cache_release(&dev_to_rm->conv_cache);
+	DL_FOREACH (dev_to_rm->conv_groups, group) {
+		DL_DELETE(dev_to_rm->conv_groups, group);
+		playback_conv_group_destroy(group);
+	}
 	if (dev_to_rm->empty_pi)
 		pic_polled_interval_destroy(&dev_to_rm->empty_pi);
 	if (dev_to_rm->non_empty_check_pi)
@@ -1196,8 +1332,10 @@ static void delete_stream_from_dev(struct cras_iodev *dev,
 	struct dev_stream *out;
 
 	out = cras_iodev_rm_stream(dev, stream);
-	if (out)
+	if (out) {
+		audio_thread_unpoll_stream(stream);
 		dev_stream_destroy(out);
+	}
 }
 
 int dev_io_append_stream(struct open_dev **dev_list,
@@ -1207,6 +1345,7 @@ int dev_io_append_stream(struct open_dev **dev_list,
 	struct open_dev *open_dev;
 	struct cras_iodev *dev;
 	struct dev_stream *out;
+	struct cras_audio_format mix_fmt;
 	struct timespec init_cb_ts;
 	struct timespec extra_sleep;
 	const struct timespec *stream_ts;
@@ -1294,14 +1433,16 @@ int dev_io_append_stream(struct open_dev **dev_list,
 			init_cb_ts.tv_nsec = 0;
 		}
 
-		out = dev_stream_create(stream, dev->info.idx, dev->format, dev,
-					&init_cb_ts);
+		out = dev_stream_create(stream, dev->info.idx,
+					stream_mix_format(dev, stream, &mix_fmt),
+					dev, &init_cb_ts);
 		if (!out) {
 			rc = -EINVAL;
 			break;
 		}
 
 		cras_iodev_add_stream(dev, out);
+		audio_thread_poll_stream(stream);
 
 		/*
 		 * For multiple inputs case, if the new stream is not the first
@@ -1337,6 +1478,7 @@ int dev_io_append_stream(struct open_dev **dev_list,
 				continue;
 
 			cras_iodev_rm_stream(dev, stream);
+			audio_thread_unpoll_stream(stream);
 			dev_stream_destroy(out);
 		}
 	}
@@ -11,6 +11,7 @@
 
 #include "cras_iodev.h"
 #include "cras_types.h"
+#include "dev_stream.h"
 #include "polled_interval_checker.h"
 
 /*
@@ -20,6 +21,8 @@
  *    last_non_empty_ts - The last time we know the device played/captured
  *        non-empty (zero) audio.
  *    coarse_rate_adjust - Hack for when the sample rate needs heavy correction.
+ *    conv_cache - Format conversions shared by the capture streams.
+ *    conv_groups - Format conversions shared by the playback streams.
  */
 struct open_dev {
 	struct cras_iodev *dev;
@@ -27,6 +30,8 @@ struct open_dev {
 	struct polled_interval *non_empty_check_pi;
 	struct polled_interval *empty_pi;
 	int coarse_rate_adjust;
+	struct capture_conv_cache conv_cache;
+	struct playback_conv_group *conv_groups;
 	struct open_dev *prev, *next;
 };
 
@@ -3,16 +3,21 @@
  * found in the LICENSE file.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
+#include "audio_thread_latency.h"
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
 #include "cras_fmt_conv.h"
 #include "dev_stream.h"
 #include "cras_audio_area.h"
 #include "cras_mix.h"
+#include "cras_mix_bus.h"
 #include "cras_server_metrics.h"
 #include "cras_shm.h"
+#include "utlist.h"
 
 /* Adjust device's sample rate by this step faster or slower. Used
  * to make sure multiple active device has stable buffer level.
@@ -60,6 +65,22 @@ unsigned int max_frames_for_conversion(unsigned int stream_frames,
 	       + 1;
 }
 
+/* Converts frames with conv, adding the time taken to the conversion phase of
+ * the latency histograms. */
+static size_t convert_frames(struct cras_fmt_conv *conv, const uint8_t *in_buf,
+			     uint8_t *out_buf, unsigned int *in_frames,
+			     size_t out_frames)
+{
+	struct timespec start;
+	size_t frames;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	frames = cras_fmt_conv_convert_frames(conv, in_buf, out_buf, in_frames,
+					      out_frames);
+	audio_thread_latency_add(AUDIO_THREAD_LATENCY_CONVERSION, &start);
+	return frames;
+}
+
 struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 				     unsigned int dev_id,
 				     const struct cras_audio_format *dev_fmt,
@@ -159,9 +180,11 @@ void dev_stream_set_dev_rate(struct dev_stream *dev_stream,
 	}
 }
 
-int dev_stream_mix(struct dev_stream *dev_stream,
-		   const struct cras_audio_format *fmt, uint8_t *dst,
-		   unsigned int num_to_write)
+/* Mixes the stream into dst, or into bus at offset if bus is given. */
+static int mix_stream(struct dev_stream *dev_stream,
+		      const struct cras_audio_format *fmt, uint8_t *dst,
+		      struct cras_mix_bus *bus, unsigned int offset,
+		      unsigned int num_to_write)
 {
 	struct cras_rstream *rstream = dev_stream->stream;
 	uint8_t *src;
@@ -172,6 +195,7 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 	unsigned int num_samples;
 	size_t frames = 0;
 	unsigned int dev_frames;
+	snd_pcm_format_t bus_fmt = fmt->format;
 	float mix_vol;
 
 	fr_in_buf = dev_stream_playback_frames(dev_stream);
@@ -185,6 +209,11 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 	/* Stream volume scaler. */
 	mix_vol = cras_rstream_get_volume_scaler(dev_stream->stream);
 
+	/* Streams on a bus are only converted to their own sample format,
+	 * see dev_io_append_stream(). */
+	if (bus)
+		bus_fmt = cras_fmt_conv_out_format(dev_stream->conv)->format;
+
 	fr_written = 0;
 	fr_read = 0;
 	while (fr_written < num_to_write) {
@@ -195,7 +224,7 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 			break;
 		if (cras_fmt_conversion_needed(dev_stream->conv)) {
 			read_frames = frames;
-			dev_frames = cras_fmt_conv_convert_frames(
+			dev_frames = convert_frames(
 				dev_stream->conv, src,
 				dev_stream->conv_buffer->bytes, &read_frames,
 				num_to_write - fr_written);
@@ -204,10 +233,18 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 			dev_frames = MIN(frames, num_to_write - fr_written);
 			read_frames = dev_frames;
 		}
-		num_samples = dev_frames * fmt->num_channels;
-		cras_mix_add(fmt->format, target, src, num_samples, 1,
-			     cras_rstream_get_mute(rstream), mix_vol);
-		target += dev_frames * cras_get_format_bytes(fmt);
+		if (bus) {
+			if (cras_mix_bus_add(bus, bus_fmt, src,
+					     offset + fr_written, dev_frames,
+					     cras_rstream_get_mute(rstream),
+					     mix_vol))
+				break;
+		} else {
+			num_samples = dev_frames * fmt->num_channels;
+			cras_mix_add(fmt->format, target, src, num_samples, 1,
+				     cras_rstream_get_mute(rstream), mix_vol);
+			target += dev_frames * cras_get_format_bytes(fmt);
+		}
 		fr_written += dev_frames;
 		fr_read += read_frames;
 	}
@@ -218,6 +255,198 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 	return fr_written;
 }
 
+int dev_stream_mix(struct dev_stream *dev_stream,
+		   const struct cras_audio_format *fmt, uint8_t *dst,
+		   unsigned int num_to_write)
+{
+	return mix_stream(dev_stream, fmt, dst, NULL, 0, num_to_write);
+}
+
+int dev_stream_mix_bus(struct dev_stream *dev_stream,
+		       const struct cras_audio_format *fmt,
+		       struct cras_mix_bus *bus, unsigned int offset,
+		       unsigned int num_to_write)
+{
+	return mix_stream(dev_stream, fmt, NULL, bus, offset, num_to_write);
+}
+
+static int same_format(const struct cras_audio_format *a,
+		       const struct cras_audio_format *b)
+{
+	return a->format == b->format && a->frame_rate == b->frame_rate &&
+	       a->num_channels == b->num_channels &&
+	       !memcmp(a->channel_layout, b->channel_layout,
+		       sizeof(a->channel_layout));
+}
+
+static int can_mix_format(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+	case SND_PCM_FORMAT_S32_LE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+struct playback_conv_group *
+playback_conv_group_create(const struct dev_stream *dev_stream,
+			   unsigned int dev_frames)
+{
+	struct playback_conv_group *group;
+	const struct cras_audio_format *in_fmt, *out_fmt;
+	int rc;
+
+	in_fmt = cras_fmt_conv_in_format(dev_stream->conv);
+	out_fmt = cras_fmt_conv_out_format(dev_stream->conv);
+
+	group = calloc(1, sizeof(*group));
+	if (!group)
+		return NULL;
+
+	group->max_frames = max_frames_for_conversion(
+		dev_frames, in_fmt->frame_rate, out_fmt->frame_rate);
+	rc = config_format_converter(&group->conv, CRAS_STREAM_OUTPUT, in_fmt,
+				     out_fmt, group->max_frames);
+	if (rc) {
+		free(group);
+		return NULL;
+	}
+	group->mix_buffer = malloc((size_t)group->max_frames *
+				   cras_get_format_bytes(in_fmt));
+	group->conv_buffer = malloc((size_t)group->max_frames *
+				    cras_get_format_bytes(out_fmt));
+	if (!group->mix_buffer || !group->conv_buffer) {
+		playback_conv_group_destroy(group);
+		return NULL;
+	}
+	group->written = -1;
+
+	return group;
+}
+
+void playback_conv_group_destroy(struct playback_conv_group *group)
+{
+	cras_fmt_conv_destroy(&group->conv);
+	free(group->mix_buffer);
+	free(group->conv_buffer);
+	free(group);
+}
+
+int playback_conv_group_matches(const struct playback_conv_group *group,
+				const struct dev_stream *dev_stream)
+{
+	return same_format(cras_fmt_conv_in_format(group->conv),
+			   cras_fmt_conv_in_format(dev_stream->conv)) &&
+	       same_format(cras_fmt_conv_out_format(group->conv),
+			   cras_fmt_conv_out_format(dev_stream->conv));
+}
+
+int dev_stream_can_share_conv(const struct dev_stream *dev_stream)
+{
+	const struct cras_rstream *rstream = dev_stream->stream;
+
+	return rstream->direction == CRAS_STREAM_OUTPUT && dev_stream->conv &&
+	       cras_fmt_conversion_needed(dev_stream->conv) &&
+	       can_mix_format(rstream->format.format) &&
+	       dev_stream->dev_id == rstream->master_dev.dev_id;
+}
+
+int dev_stream_mix_group(struct dev_stream *streams,
+			 struct playback_conv_group *group,
+			 const struct cras_audio_format *fmt, uint8_t *dst,
+			 struct cras_mix_bus *bus, unsigned int offset,
+			 unsigned int num_to_write)
+{
+	const struct cras_audio_format *in_fmt, *out_fmt;
+	struct dev_stream *curr;
+	struct cras_rstream *rstream;
+	unsigned int in_frame_bytes;
+	unsigned int src_frames, fr_read, read_frames, index;
+	unsigned int buffer_offset;
+	unsigned int dev_frames;
+	size_t frames;
+	uint8_t *src;
+
+	in_fmt = cras_fmt_conv_in_format(group->conv);
+	out_fmt = cras_fmt_conv_out_format(group->conv);
+	in_frame_bytes = cras_get_format_bytes(in_fmt);
+
+	/* Mix only what the converter needs, and what every stream has. */
+	num_to_write = MIN(num_to_write, group->max_frames);
+	src_frames = cras_fmt_conv_out_frames_to_in(group->conv, num_to_write) +
+		     1;
+	src_frames = MIN(src_frames, group->max_frames);
+	DL_FOREACH (streams, curr) {
+		if (curr->conv_group != group)
+			continue;
+		src_frames = MIN(src_frames,
+				 cras_rstream_playable_frames(curr->stream,
+							      curr->dev_id));
+	}
+	if (src_frames == 0)
+		return 0;
+
+	index = 0;
+	DL_FOREACH (streams, curr) {
+		if (curr->conv_group != group)
+			continue;
+		rstream = curr->stream;
+		buffer_offset = cras_rstream_dev_offset(rstream, curr->dev_id);
+
+		/* The first stream is copied, clearing the mix buffer. */
+		fr_read = 0;
+		while (fr_read < src_frames) {
+			src = cras_rstream_get_readable_frames(
+				rstream, buffer_offset + fr_read, &frames);
+			if (frames == 0)
+				break;
+			frames = MIN(frames, src_frames - fr_read);
+			cras_mix_add(in_fmt->format,
+				     group->mix_buffer +
+					     fr_read * in_frame_bytes,
+				     src, frames * in_fmt->num_channels, index,
+				     cras_rstream_get_mute(rstream),
+				     cras_rstream_get_volume_scaler(rstream));
+			fr_read += frames;
+		}
+		if (index == 0 && fr_read < src_frames)
+			memset(group->mix_buffer + fr_read * in_frame_bytes, 0,
+			       (src_frames - fr_read) * in_frame_bytes);
+		index++;
+	}
+
+	read_frames = src_frames;
+	dev_frames = convert_frames(group->conv,
+						  group->mix_buffer,
+						  group->conv_buffer,
+						  &read_frames, num_to_write);
+
+	if (bus) {
+		if (cras_mix_bus_add(bus, out_fmt->format, group->conv_buffer,
+				     offset, dev_frames, 0, 1.0))
+			return 0;
+	} else {
+		cras_mix_add(fmt->format, dst, group->conv_buffer,
+			     dev_frames * fmt->num_channels, 1, 0, 1.0);
+	}
+
+	/* The streams' samples past read_frames are mixed again next time. */
+	DL_FOREACH (streams, curr) {
+		if (curr->conv_group != group)
+			continue;
+		cras_rstream_dev_offset_update(curr->stream, read_frames,
+					       curr->dev_id);
+	}
+	ATLOG(atlog, AUDIO_THREAD_DEV_STREAM_MIX, dev_frames, read_frames,
+	      index);
+
+	return dev_frames;
+}
+
 /* Copy from the captured buffer to the temporary format converted buffer. */
 static unsigned int capture_with_fmt_conv(struct dev_stream *dev_stream,
 					  const uint8_t *source_samples,
@@ -247,7 +476,7 @@ static unsigned int capture_with_fmt_conv(struct dev_stream *dev_stream,
 			break;
 
 		read_frames = num_frames - total_read;
-		write_frames = cras_fmt_conv_convert_frames(
+		write_frames = convert_frames(
 			dev_stream->conv, source_samples, buffer, &read_frames,
 			write_frames);
 		total_read += read_frames;
@@ -259,6 +488,105 @@ static unsigned int capture_with_fmt_conv(struct dev_stream *dev_stream,
 	return total_read;
 }
 
+/* Finds the cache entry for src converted like conv does, or adds one.
+ * Returns NULL if the cache is full. */
+static struct capture_conv_cache_entry *
+find_conv_cache_entry(struct capture_conv_cache *cache,
+		      const struct cras_fmt_conv *conv, const uint8_t *src)
+{
+	struct capture_conv_cache_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < cache->num_entries; i++) {
+		entry = &cache->entries[i];
+		if (entry->src == src &&
+		    same_format(cras_fmt_conv_in_format(entry->conv),
+				cras_fmt_conv_in_format(conv)) &&
+		    same_format(cras_fmt_conv_out_format(entry->conv),
+				cras_fmt_conv_out_format(conv)))
+			return entry;
+	}
+
+	if (cache->num_entries == CAPTURE_CONV_CACHE_SIZE)
+		return NULL;
+	entry = &cache->entries[cache->num_entries++];
+	entry->conv = conv;
+	entry->src = src;
+	entry->frames = 0;
+	return entry;
+}
+
+/* Like capture_with_fmt_conv(), but converts into the cache, and only the
+ * frames no other stream has converted yet. The converter must not have
+ * state. */
+static unsigned int capture_with_conv_cache(struct dev_stream *dev_stream,
+					    struct capture_conv_cache *cache,
+					    const uint8_t *source_samples,
+					    unsigned int num_frames)
+{
+	struct capture_conv_cache_entry *entry;
+	unsigned int source_frame_bytes;
+	unsigned int dst_frame_bytes;
+	unsigned int total_written = 0;
+	unsigned int write_frames;
+	unsigned int read_frames;
+	uint8_t *buffer;
+
+	source_frame_bytes = cras_get_format_bytes(
+		cras_fmt_conv_in_format(dev_stream->conv));
+	dst_frame_bytes = cras_get_format_bytes(
+		cras_fmt_conv_out_format(dev_stream->conv));
+
+	entry = find_conv_cache_entry(cache, dev_stream->conv, source_samples);
+	if (!entry)
+		goto convert_uncached;
+
+	if (entry->frames >= num_frames) {
+		cache->num_saved++;
+	} else {
+		if (num_frames > entry->buf_frames) {
+			buffer = realloc(entry->buf,
+					 (size_t)num_frames * dst_frame_bytes);
+			if (!buffer)
+				goto convert_uncached;
+			entry->buf = buffer;
+			entry->buf_frames = num_frames;
+		}
+		read_frames = num_frames - entry->frames;
+		entry->frames += convert_frames(
+			dev_stream->conv,
+			source_samples + entry->frames * source_frame_bytes,
+			entry->buf + entry->frames * dst_frame_bytes,
+			&read_frames, num_frames - entry->frames);
+		cache->num_conversions++;
+		num_frames = MIN(num_frames, entry->frames);
+	}
+
+	dev_stream->conv_area->num_channels =
+		cras_fmt_conv_out_format(dev_stream->conv)->num_channels;
+
+	while (total_written < num_frames) {
+		buffer = buf_write_pointer_size(dev_stream->conv_buffer,
+						&write_frames);
+		write_frames /= dst_frame_bytes;
+		if (write_frames == 0)
+			break;
+
+		write_frames = MIN(write_frames, num_frames - total_written);
+		memcpy(buffer, entry->buf + total_written * dst_frame_bytes,
+		       write_frames * dst_frame_bytes);
+		total_written += write_frames;
+		buf_increment_write(dev_stream->conv_buffer,
+				    write_frames * dst_frame_bytes);
+	}
+
+	return total_written;
+
+convert_uncached:
+	cache->num_conversions++;
+	return capture_with_fmt_conv(dev_stream, source_samples, num_frames);
+}
+
 /* Copy from the converted buffer to the stream shm.  These have the same format
  * at this point. */
 static unsigned int
@@ -326,7 +654,8 @@ capture_copy_converted_to_stream(struct dev_stream *dev_stream,
 unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 				const struct cras_audio_area *area,
 				unsigned int area_offset,
-				float software_gain_scaler)
+				float software_gain_scaler,
+				struct capture_conv_cache *cache)
 {
 	struct cras_rstream *rstream = dev_stream->stream;
 	struct cras_audio_shm *shm;
@@ -336,16 +665,24 @@ unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 	/* Check if format conversion is needed. */
 	if (cras_fmt_conversion_needed(dev_stream->conv)) {
 		unsigned int format_bytes, fr_to_capture;
+		const uint8_t *src;
 
 		fr_to_capture = dev_stream_capture_avail(dev_stream);
 		fr_to_capture = MIN(fr_to_capture, area->frames - area_offset);
 
 		format_bytes = cras_get_format_bytes(
 			cras_fmt_conv_in_format(dev_stream->conv));
-		nread = capture_with_fmt_conv(
-			dev_stream,
-			area->channels[0].buf + area_offset * format_bytes,
-			fr_to_capture);
+		src = area->channels[0].buf + area_offset * format_bytes;
+		if (cache && cache->share &&
+		    !cras_fmt_conv_has_state(dev_stream->conv)) {
+			nread = capture_with_conv_cache(dev_stream, cache, src,
+							fr_to_capture);
+		} else {
+			if (cache)
+				cache->num_conversions++;
+			nread = capture_with_fmt_conv(dev_stream, src,
+						      fr_to_capture);
+		}
 
 		capture_copy_converted_to_stream(dev_stream, rstream,
 						 software_gain_scaler);
@@ -374,6 +711,24 @@ unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 	return nread;
 }
 
+void capture_conv_cache_reset(struct capture_conv_cache *cache, int share)
+{
+	cache->num_entries = 0;
+	cache->share = share;
+}
+
+void capture_conv_cache_release(struct capture_conv_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < CAPTURE_CONV_CACHE_SIZE; i++) {
+		free(cache->entries[i].buf);
+		cache->entries[i].buf = NULL;
+		cache->entries[i].buf_frames = 0;
+	}
+	cache->num_entries = 0;
+}
+
 int dev_stream_attached_devs(const struct dev_stream *dev_stream)
 {
 	return dev_stream->stream->num_attached_devs;
@@ -627,20 +982,7 @@ int dev_stream_request_playback_samples(struct dev_stream *dev_stream,
 
 int dev_stream_poll_stream_fd(const struct dev_stream *dev_stream)
 {
-	const struct cras_rstream *stream = dev_stream->stream;
-
-	/* For streams which rely on dev level timing, we should
-	 * let client response wake audio thread up. */
-	if (stream_uses_input(stream) && (stream->flags & USE_DEV_TIMING) &&
-	    cras_rstream_is_pending_reply(stream))
-		return stream->fd;
-
-	if (!stream_uses_output(stream) ||
-	    !cras_rstream_is_pending_reply(stream) ||
-	    cras_rstream_get_is_draining(stream))
-		return -1;
-
-	return stream->fd;
+	return cras_rstream_poll_fd(dev_stream->stream);
 }
 
 /*
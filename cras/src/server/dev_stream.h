@@ -18,6 +18,8 @@
 struct cras_audio_area;
 struct cras_fmt_conv;
 struct cras_iodev;
+struct cras_mix_bus;
+struct playback_conv_group;
 
 /*
  * Linked list of streams of audio from/to a client.
@@ -33,6 +35,8 @@ struct cras_iodev;
  *                 into device. For output stream, it should be set to true
  *                 just before its first fetch to avoid affecting other existing
  *                 streams.
+ *    conv_group - For output stream, the group it is converted with in the
+ *                 current period, or NULL if it uses its own converter.
  */
 struct dev_stream {
 	unsigned int dev_id;
@@ -44,8 +48,117 @@ struct dev_stream {
 	size_t dev_rate;
 	struct dev_stream *prev, *next;
 	int is_running;
+	struct playback_conv_group *conv_group;
 };
 
+/*
+ * A converter shared by the playback streams on a device that have the same
+ * format. The streams are mixed in their own format, applying the volume of
+ * each, and the mix is converted to the device format once. The group
+ * outlives the streams in it so the resampler state carries over when
+ * streams come and go.
+ * Args:
+ *    conv - Converter from the streams' format to the device format.
+ *    mix_buffer - The streams mixed in their format.
+ *    conv_buffer - The converted mix.
+ *    max_frames - The number of frames each buffer holds.
+ *    offset - The buffer_share offset of the streams in the group for the
+ *        current period, all streams in the group have the same offset.
+ *    num_streams - The number of streams in the group in the current period.
+ *    written - Device frames the group wrote in the current period, or -1 if
+ *        it hasn't been mixed yet.
+ */
+struct playback_conv_group {
+	struct cras_fmt_conv *conv;
+	uint8_t *mix_buffer;
+	uint8_t *conv_buffer;
+	unsigned int max_frames;
+	unsigned int offset;
+	unsigned int num_streams;
+	int written;
+	struct playback_conv_group *prev, *next;
+};
+
+/*
+ * Creates a conversion group for streams converted like dev_stream.
+ * Args:
+ *    dev_stream - A stream to be converted by the group.
+ *    dev_frames - The most device frames converted at once.
+ * Returns:
+ *    The group, or NULL on failure.
+ */
+struct playback_conv_group *
+playback_conv_group_create(const struct dev_stream *dev_stream,
+			   unsigned int dev_frames);
+
+/* Destroys a group returned from playback_conv_group_create. */
+void playback_conv_group_destroy(struct playback_conv_group *group);
+
+/* Returns non-zero if dev_stream can be converted by group. */
+int playback_conv_group_matches(const struct playback_conv_group *group,
+				const struct dev_stream *dev_stream);
+
+/*
+ * Returns non-zero if dev_stream can be converted in a group. It must need
+ * conversion in a format that can be mixed, and the device must be the
+ * stream's master device so that no rate adjustment is done per stream.
+ */
+int dev_stream_can_share_conv(const struct dev_stream *dev_stream);
+
+/* Number of distinct conversions a capture_conv_cache holds. */
+#define CAPTURE_CONV_CACHE_SIZE 4
+
+/*
+ * Samples converted from the device buffer for one stream, valid until the
+ * cache is reset.
+ * Args:
+ *    conv - The converter used, the converters of other streams with the
+ *        same input and output formats give the same samples.
+ *    src - The device samples converted.
+ *    frames - The number of frames converted.
+ *    buf - The converted samples.
+ *    buf_frames - The number of frames buf can hold.
+ */
+struct capture_conv_cache_entry {
+	const struct cras_fmt_conv *conv;
+	const uint8_t *src;
+	unsigned int frames;
+	uint8_t *buf;
+	unsigned int buf_frames;
+};
+
+/*
+ * Keeps the samples converted for capture streams on a device while they
+ * are read from the device buffer, so that each conversion is done once for
+ * all the streams that need it. Only converters without state are shared.
+ * Args:
+ *    entries - The conversions done since the last reset.
+ *    num_entries - The number of valid entries.
+ *    share - Non-zero if conversions are kept to be shared.
+ *    num_conversions - The number of conversions done.
+ *    num_saved - The number of conversions copied from another stream
+ *        instead.
+ */
+struct capture_conv_cache {
+	struct capture_conv_cache_entry entries[CAPTURE_CONV_CACHE_SIZE];
+	unsigned int num_entries;
+	int share;
+	uint32_t num_conversions;
+	uint32_t num_saved;
+};
+
+/*
+ * Forgets the cached conversions, used when the device samples change.
+ * Args:
+ *    cache - The cache to reset.
+ *    share - Non-zero to keep the conversions done until the next reset,
+ *        when more than one stream reads the device samples.
+ */
+void capture_conv_cache_reset(struct capture_conv_cache *cache, int share);
+
+/* Frees the buffers of the cache entries. */
+void capture_conv_cache_release(struct capture_conv_cache *cache);
+
 struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 				     unsigned int dev_id,
 				     const struct cras_audio_format *dev_fmt,
@@ -84,6 +197,44 @@ int dev_stream_mix(struct dev_stream *dev_stream,
 		   const struct cras_audio_format *fmt, uint8_t *dst,
 		   unsigned int num_to_write);
 
+/*
+ * Like dev_stream_mix() but mixes into a float mix bus. The samples are
+ * mixed in the output format of the stream's converter, which keeps the
+ * stream's sample format.
+ * Args:
+ *    dev_stream - The struct holding the stream to mix.
+ *    format - The format of the audio device.
+ *    bus - The bus to mix into.
+ *    offset - The frame of the bus to start mixing at.
+ *    num_to_write - The number of frames written.
+ */
+int dev_stream_mix_bus(struct dev_stream *dev_stream,
+		       const struct cras_audio_format *fmt,
+		       struct cras_mix_bus *bus, unsigned int offset,
+		       unsigned int num_to_write);
+
+/*
+ * Mixes the streams converted by group, converts the mix and adds it to dst,
+ * or to bus at offset if bus isn't NULL. The read offset of each stream is
+ * updated, the caller marks the frames written for each of them.
+ * Args:
+ *    streams - The streams on the device, those with conv_group set to group
+ *        are mixed.
+ *    group - The group to mix.
+ *    fmt - The format of the audio device.
+ *    dst - The destination buffer for mixing.
+ *    bus - The bus to mix into, or NULL.
+ *    offset - The frame of the bus to start mixing at.
+ *    num_to_write - The number of frames to write.
+ * Returns:
+ *    The number of device frames written.
+ */
+int dev_stream_mix_group(struct dev_stream *streams,
+			 struct playback_conv_group *group,
+			 const struct cras_audio_format *fmt, uint8_t *dst,
+			 struct cras_mix_bus *bus, unsigned int offset,
+			 unsigned int num_to_write);
+
 /*
  * Reads froms from the source into the dev_stream.
  * Args:
@@ -91,11 +242,14 @@ int dev_stream_mix(struct dev_stream *dev_stream,
  *    area - The area to copy audio from.
  *    area_offset - The offset at which to start reading from area.
  *    software_gain_scaler - The software gain scaler.
+ *    cache - Conversions shared with the other streams reading the same
+ *        area, or NULL to always convert.
  */
 unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 				const struct cras_audio_area *area,
 				unsigned int area_offset,
-				float software_gain_scaler);
+				float software_gain_scaler,
+				struct capture_conv_cache *cache);
 
 /* Returns the number of iodevs this stream has attached to. */
 int dev_stream_attached_devs(const struct dev_stream *dev_stream);
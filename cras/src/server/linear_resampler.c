@@ -3,41 +3,93 @@
  * found in the LICENSE file.
  */
 
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "cras_audio_area.h"
 #include "cras_util.h"
 #include "linear_resampler.h"
 
+/* Number of output frames whose source positions are computed in one go
+ * before interpolating them. */
+#define LR_BLOCK_FRAMES 64
+/* Interpolation weights are kept with this many fractional bits. */
+#define LR_WEIGHT_BITS 30
+/* Fractional bits of the weights used for S16 samples, chosen so that both
+ * weights of a pair fit in an int16_t. */
+#define LR_S16_WEIGHT_BITS 14
+
 /* A linear resampler.
  * Members:
  *    num_channels - The number of channles in once frames.
+ *    format - The sample format of the frames.
  *    format_bytes - The size of one frame in bytes.
  *    src_offset - The accumulated offset for resampled src data.
  *    dst_offset - The accumulated offset for resampled dst data.
  *    to_times_100 - The numerator of the rate factor used for SRC.
  *    from_times_100 - The denominator of the rate factor used for SRC.
- *    f - The rate factor used for linear resample.
+ *    step_int - Integer part of the source frames advanced per output frame.
+ *    step_rem - Remainder of the step, in units of 1/to_times_100 frames.
+ *    weight_mul - Converts a remainder to a weight with LR_WEIGHT_BITS
+ *        fractional bits, (2^62 / to_times_100), used after a 32 bit shift.
+ *    history - The last frame consumed by the previous resample call, so
+ *        that output frames between two buffers can be interpolated.
  */
 struct linear_resampler {
 	unsigned int num_channels;
+	snd_pcm_format_t format;
 	unsigned int format_bytes;
 	unsigned int src_offset;
 	unsigned int dst_offset;
 	unsigned int to_times_100;
 	unsigned int from_times_100;
-	float f;
+	unsigned int step_int;
+	unsigned int step_rem;
+	uint64_t weight_mul;
+	uint8_t *history;
 };
 
+static unsigned int sample_bytes(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		return 2;
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_FLOAT_LE:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
 struct linear_resampler *linear_resampler_create(unsigned int num_channels,
-						 unsigned int format_bytes,
+						 snd_pcm_format_t format,
 						 float src_rate, float dst_rate)
 {
 	struct linear_resampler *lr;
 
+	if (sample_bytes(format) == 0)
+		return NULL;
+
 	lr = (struct linear_resampler *)calloc(1, sizeof(*lr));
 	if (!lr)
 		return NULL;
 	lr->num_channels = num_channels;
-	lr->format_bytes = format_bytes;
+	lr->format = format;
+	lr->format_bytes = num_channels * sample_bytes(format);
+	lr->history = (uint8_t *)calloc(1, lr->format_bytes);
+	if (!lr->history) {
+		free(lr);
+		return NULL;
+	}
 
 	linear_resampler_set_rates(lr, src_rate, dst_rate);
 
@@ -46,16 +98,20 @@ struct linear_resampler *linear_resampler_create(unsigned int num_channels,
 
 void linear_resampler_destroy(struct linear_resampler *lr)
 {
-	if (lr)
+	if (lr) {
+		free(lr->history);
 		free(lr);
+	}
 }
 
 void linear_resampler_set_rates(struct linear_resampler *lr, float from,
 				float to)
 {
-	lr->f = (float)to / from;
 	lr->to_times_100 = to * 100;
 	lr->from_times_100 = from * 100;
+	lr->step_int = lr->from_times_100 / lr->to_times_100;
+	lr->step_rem = lr->from_times_100 % lr->to_times_100;
+	lr->weight_mul = (UINT64_C(1) << 62) / lr->to_times_100;
 	lr->src_offset = 0;
 	lr->dst_offset = 0;
 }
@@ -72,17 +128,22 @@ void linear_resampler_set_rates(struct linear_resampler *lr, float from,
  * when the resampled frames number isn't sufficient to consume the first
  * buffer at input or output offset(index 0), always count as one buffer
  * used so the intput/output offset can always increment.
+ *
+ * Both are computed exactly on the integer rates, as the resampler itself
+ * tracks positions.
  */
 unsigned int linear_resampler_out_frames_to_in(struct linear_resampler *lr,
 					       unsigned int frames)
 {
-	float in_frames;
+	uint64_t in_frames;
+
 	if (frames == 0)
 		return 0;
 
-	in_frames = (float)(lr->dst_offset + frames) / lr->f;
-	if ((in_frames > lr->src_offset))
-		return 1 + (unsigned int)(in_frames - lr->src_offset);
+	/* Scaled by to_times_100. */
+	in_frames = (uint64_t)(lr->dst_offset + frames) * lr->from_times_100;
+	if (in_frames > (uint64_t)lr->src_offset * lr->to_times_100)
+		return 1 + in_frames / lr->to_times_100 - lr->src_offset;
 	else
 		return 1;
 }
@@ -90,13 +151,15 @@ unsigned int linear_resampler_out_frames_to_in(struct linear_resampler *lr,
 unsigned int linear_resampler_in_frames_to_out(struct linear_resampler *lr,
 					       unsigned int frames)
 {
-	float out_frames;
+	uint64_t out_frames;
+
 	if (frames == 0)
 		return 0;
 
-	out_frames = lr->f * (lr->src_offset + frames - 1);
-	if (out_frames > lr->dst_offset)
-		return 1 + (unsigned int)(out_frames - lr->dst_offset);
+	/* Scaled by from_times_100. */
+	out_frames = (uint64_t)(lr->src_offset + frames - 1) * lr->to_times_100;
+	if (out_frames > (uint64_t)lr->dst_offset * lr->from_times_100)
+		return 1 + out_frames / lr->from_times_100 - lr->dst_offset;
 	else
 		return 1;
 }
@@ -106,58 +169,282 @@ int linear_resampler_needed(struct linear_resampler *lr)
 	return lr->from_times_100 != lr->to_times_100;
 }
 
+/* Interpolates one frame at weight w between frames a and b. */
+static void interpolate_frame(const struct linear_resampler *lr,
+			      const uint8_t *a, const uint8_t *b, uint32_t w,
+			      uint8_t *out)
+{
+	unsigned int ch;
+
+	switch (lr->format) {
+	case SND_PCM_FORMAT_S16_LE: {
+		const int16_t *a16 = (const int16_t *)a;
+		const int16_t *b16 = (const int16_t *)b;
+		int32_t w16 = w >> (LR_WEIGHT_BITS - LR_S16_WEIGHT_BITS);
+
+		for (ch = 0; ch < lr->num_channels; ch++)
+			((int16_t *)out)[ch] =
+				(a16[ch] * ((1 << LR_S16_WEIGHT_BITS) - w16) +
+				 b16[ch] * w16 +
+				 (1 << (LR_S16_WEIGHT_BITS - 1))) >>
+				LR_S16_WEIGHT_BITS;
+		break;
+	}
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S32_LE: {
+		const int32_t *a32 = (const int32_t *)a;
+		const int32_t *b32 = (const int32_t *)b;
+
+		for (ch = 0; ch < lr->num_channels; ch++)
+			((int32_t *)out)[ch] =
+				a32[ch] +
+				((((int64_t)b32[ch] - a32[ch]) * w +
+				  (1 << (LR_WEIGHT_BITS - 1))) >>
+				 LR_WEIGHT_BITS);
+		break;
+	}
+	case SND_PCM_FORMAT_FLOAT_LE: {
+		const float *af = (const float *)a;
+		const float *bf = (const float *)b;
+		float wf = w * (1.0f / (1 << LR_WEIGHT_BITS));
+
+		for (ch = 0; ch < lr->num_channels; ch++)
+			((float *)out)[ch] = af[ch] + wf * (bf[ch] - af[ch]);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+#if defined(__ARM_NEON) || defined(__SSE2__)
+static inline uint32_t load_u32(const int16_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+#endif
+
+/* Interpolates count S16 frames, output frame i between source frames off[i]
+ * and off[i] + 1 at weight w[i]. The SIMD paths give the same results as
+ * interpolate_frame(). */
+static void interpolate_s16(const struct linear_resampler *lr,
+			    const int16_t *src, const unsigned int *off,
+			    const uint32_t *w, unsigned int count, int16_t *dst)
+{
+	unsigned int i = 0;
+#if defined(__ARM_NEON) || defined(__SSE2__)
+	const unsigned int shift = LR_WEIGHT_BITS - LR_S16_WEIGHT_BITS;
+#endif
+
+#if defined(__ARM_NEON)
+	if (lr->num_channels == 2) {
+		for (; i + 2 <= count; i += 2) {
+			int16_t w0 = w[i] >> shift, w1 = w[i + 1] >> shift;
+			int16_t wb[4] = { w0, w0, w1, w1 };
+			int16x4_t a, b, vwb, vwa;
+			int32x4_t acc;
+
+			a = vreinterpret_s16_u32(vset_lane_u32(
+				load_u32(src + 2 * off[i + 1]),
+				vdup_n_u32(load_u32(src + 2 * off[i])), 1));
+			b = vreinterpret_s16_u32(vset_lane_u32(
+				load_u32(src + 2 * off[i + 1] + 2),
+				vdup_n_u32(load_u32(src + 2 * off[i] + 2)), 1));
+			vwb = vld1_s16(wb);
+			vwa = vsub_s16(vdup_n_s16(1 << LR_S16_WEIGHT_BITS), vwb);
+			acc = vmull_s16(a, vwa);
+			acc = vmlal_s16(acc, b, vwb);
+			vst1_s16(dst + 2 * i,
+				 vrshrn_n_s32(acc, LR_S16_WEIGHT_BITS));
+		}
+	} else if (lr->num_channels == 1) {
+		for (; i + 4 <= count; i += 4) {
+			int16_t ta[4], tb[4], wb[4];
+			int16x4_t vwb, vwa;
+			int32x4_t acc;
+			unsigned int j;
+
+			for (j = 0; j < 4; j++) {
+				ta[j] = src[off[i + j]];
+				tb[j] = src[off[i + j] + 1];
+				wb[j] = w[i + j] >> shift;
+			}
+			vwb = vld1_s16(wb);
+			vwa = vsub_s16(vdup_n_s16(1 << LR_S16_WEIGHT_BITS), vwb);
+			acc = vmull_s16(vld1_s16(ta), vwa);
+			acc = vmlal_s16(acc, vld1_s16(tb), vwb);
+			vst1_s16(dst + i, vrshrn_n_s32(acc, LR_S16_WEIGHT_BITS));
+		}
+	}
+#elif defined(__SSE2__)
+	/* Samples of a and b are interleaved so that one multiply-add of
+	 * 16 bit pairs weighs both, with (1 - w, w) packed in each 32 bit
+	 * weight lane. */
+	const __m128i round = _mm_set1_epi32(1 << (LR_S16_WEIGHT_BITS - 1));
+	uint32_t wp[4];
+	unsigned int j;
+	__m128i a, b, vw, lo, hi;
+
+	if (lr->num_channels == 2) {
+		for (; i + 4 <= count; i += 4) {
+			for (j = 0; j < 4; j++) {
+				uint32_t wb = w[i + j] >> shift;
+
+				wp[j] = (wb << 16) |
+					((1 << LR_S16_WEIGHT_BITS) - wb);
+			}
+			a = _mm_set_epi32(load_u32(src + 2 * off[i + 3]),
+					  load_u32(src + 2 * off[i + 2]),
+					  load_u32(src + 2 * off[i + 1]),
+					  load_u32(src + 2 * off[i]));
+			b = _mm_set_epi32(load_u32(src + 2 * off[i + 3] + 2),
+					  load_u32(src + 2 * off[i + 2] + 2),
+					  load_u32(src + 2 * off[i + 1] + 2),
+					  load_u32(src + 2 * off[i] + 2));
+			vw = _mm_loadu_si128((const __m128i *)wp);
+			lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b),
+					    _mm_unpacklo_epi32(vw, vw));
+			hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b),
+					    _mm_unpackhi_epi32(vw, vw));
+			lo = _mm_srai_epi32(_mm_add_epi32(lo, round),
+					    LR_S16_WEIGHT_BITS);
+			hi = _mm_srai_epi32(_mm_add_epi32(hi, round),
+					    LR_S16_WEIGHT_BITS);
+			_mm_storeu_si128((__m128i *)(dst + 2 * i),
+					 _mm_packs_epi32(lo, hi));
+		}
+	} else if (lr->num_channels == 1) {
+		for (; i + 4 <= count; i += 4) {
+			for (j = 0; j < 4; j++) {
+				uint32_t wb = w[i + j] >> shift;
+
+				wp[j] = (wb << 16) |
+					((1 << LR_S16_WEIGHT_BITS) - wb);
+			}
+			a = _mm_set_epi32(load_u32(src + off[i + 3]),
+					  load_u32(src + off[i + 2]),
+					  load_u32(src + off[i + 1]),
+					  load_u32(src + off[i]));
+			vw = _mm_loadu_si128((const __m128i *)wp);
+			lo = _mm_madd_epi16(a, vw);
+			lo = _mm_srai_epi32(_mm_add_epi32(lo, round),
+					    LR_S16_WEIGHT_BITS);
+			_mm_storel_epi64((__m128i *)(dst + i),
+					 _mm_packs_epi32(lo, lo));
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+		interpolate_frame(lr, (const uint8_t *)(src + off[i] *
+							     lr->num_channels),
+				  (const uint8_t *)(src + (off[i] + 1) *
+							      lr->num_channels),
+				  w[i], (uint8_t *)(dst + i * lr->num_channels));
+}
+
+static void interpolate_frames(const struct linear_resampler *lr,
+			       const uint8_t *src, const unsigned int *off,
+			       const uint32_t *w, unsigned int count,
+			       uint8_t *dst)
+{
+	unsigned int i;
+
+	if (lr->format == SND_PCM_FORMAT_S16_LE) {
+		interpolate_s16(lr, (const int16_t *)src, off, w, count,
+				(int16_t *)dst);
+		return;
+	}
+	for (i = 0; i < count; i++)
+		interpolate_frame(lr, src + off[i] * lr->format_bytes,
+				  src + (off[i] + 1) * lr->format_bytes, w[i],
+				  dst + i * lr->format_bytes);
+}
+
+/* The position of the next output frame is tracked as a whole number of
+ * frames after the history frame, idx, where index 1 is the first frame of
+ * src, plus a remainder rem in units of 1/to_times_100 frames. Stepping it
+ * is exact, so it never drifts from the frame counts reported by
+ * linear_resampler_{in,out}_frames_to_{out,in}(). */
 unsigned int linear_resampler_resample(struct linear_resampler *lr,
 				       uint8_t *src, unsigned int *src_frames,
 				       uint8_t *dst, unsigned dst_frames)
 {
-	int ch;
-	unsigned int src_idx = 0;
+	unsigned int off[LR_BLOCK_FRAMES];
+	uint32_t w[LR_BLOCK_FRAMES];
 	unsigned int dst_idx = 0;
-	float src_pos;
-	int16_t *in, *out;
+	unsigned int frames = *src_frames;
+	unsigned int idx, rem, n, consumed;
+	uint64_t pos;
 
-	/* Check for corner cases so that we can assume both src_idx and
-	 * dst_idx are valid with value 0 in the loop below. */
+	/* Check for corner cases so that we can assume there is at least one
+	 * frame of both src and dst in the loop below. */
 	if (dst_frames == 0 || *src_frames == 0) {
 		*src_frames = 0;
 		return 0;
 	}
 
-	for (dst_idx = 0; dst_idx <= dst_frames; dst_idx++) {
-		src_pos = (float)(lr->dst_offset + dst_idx) / lr->f;
-		if (src_pos > lr->src_offset)
-			src_pos -= lr->src_offset;
-		else
-			src_pos = 0;
-		src_idx = (unsigned int)src_pos;
-
-		if (src_pos > *src_frames - 1 || dst_idx >= dst_frames) {
-			if (src_pos > *src_frames - 1)
-				src_idx = *src_frames - 1;
-			/* When this loop stops, dst_idx is always at the last
-			 * used index incremented by 1. */
-			break;
-		}
+	pos = (uint64_t)lr->dst_offset * lr->from_times_100;
+	idx = pos / lr->to_times_100;
+	rem = pos % lr->to_times_100;
+	if (idx + 1 >= lr->src_offset) {
+		idx = idx + 1 - lr->src_offset;
+	} else {
+		/* Behind the consumed frames, start from the first one. */
+		idx = 1;
+		rem = 0;
+	}
 
-		in = (int16_t *)(src + src_idx * lr->format_bytes);
-		out = (int16_t *)(dst + dst_idx * lr->format_bytes);
+#define LR_STEP()                                                              \
+	do {                                                                   \
+		idx += lr->step_int;                                           \
+		rem += lr->step_rem;                                           \
+		if (rem >= lr->to_times_100) {                                 \
+			rem -= lr->to_times_100;                               \
+			idx++;                                                 \
+		}                                                              \
+	} while (0)
 
-		/* Don't do linear interpolcation if src_pos falls on the
-		 * last index. */
-		if (src_idx == *src_frames - 1) {
-			for (ch = 0; ch < lr->num_channels; ch++)
-				out[ch] = in[ch];
-		} else {
-			for (ch = 0; ch < lr->num_channels; ch++) {
-				out[ch] = in[ch] +
-					  (src_pos - src_idx) *
-						  (in[lr->num_channels + ch] -
-						   in[ch]);
+	while (dst_idx < dst_frames) {
+		uint8_t *out = dst + dst_idx * lr->format_bytes;
+		uint32_t weight = (rem * lr->weight_mul) >> 32;
+
+		if (idx == 0) {
+			/* Between the previous buffer and this one. */
+			interpolate_frame(lr, lr->history, src, weight, out);
+		} else if (idx == frames && rem == 0) {
+			/* Don't interpolate if the position falls on the
+			 * last frame. */
+			memcpy(out, src + (frames - 1) * lr->format_bytes,
+			       lr->format_bytes);
+		} else if (idx < frames) {
+			for (n = 0; n < LR_BLOCK_FRAMES && idx < frames &&
+				    dst_idx + n < dst_frames;
+			     n++) {
+				off[n] = idx - 1;
+				w[n] = (rem * lr->weight_mul) >> 32;
+				LR_STEP();
 			}
+			interpolate_frames(lr, src, off, w, n, out);
+			dst_idx += n;
+			continue;
+		} else {
+			break;
 		}
+		LR_STEP();
+		dst_idx++;
 	}
+#undef LR_STEP
 
-	*src_frames = src_idx + 1;
+	/* Frames up to the one just before the next output frame are
+	 * consumed, and always at least one. */
+	consumed = MIN(MAX(idx, 1), frames);
+	memcpy(lr->history, src + (consumed - 1) * lr->format_bytes,
+	       lr->format_bytes);
+	*src_frames = consumed;
 
 	lr->src_offset += *src_frames;
 	lr->dst_offset += dst_idx;
@@ -6,17 +6,22 @@
 #ifndef LINEAR_RESAMPLER_H_
 #define LINEAR_RESAMPLER_H_
 
+#include "cras_audio_format.h"
+
 struct linear_resampler;
 
 /* Creates a linear resampler.
  * Args:
  *    num_channels - The number of channels in each frames.
- *    format_bytes - The length of one frame in bytes.
+ *    format - The sample format, one of S16_LE, S24_LE, S32_LE or FLOAT_LE.
  *    src_rate - The source rate to resample from.
  *    dst_rate - The destination rate to resample to.
+ * Returns:
+ *    A pointer to the resampler, or NULL if the format isn't supported or
+ *    out of memory.
  */
 struct linear_resampler *linear_resampler_create(unsigned int num_channels,
-						 unsigned int format_bytes,
+						 snd_pcm_format_t format,
 						 float src_rate,
 						 float dst_rate);
 
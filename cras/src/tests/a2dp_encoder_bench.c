@@ -0,0 +1,200 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Compares the time the audio thread spends in one A2DP put_buffer when it
+ * encodes SBC and writes the socket itself, as flush_data() does, against
+ * handing the PCM to the encoder worker. Each wake writes 10ms of 48kHz stereo
+ * audio, and a reader thread drains the socket like a headset would.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "byte_buffer.h"
+#include "cras_a2dp_info.h"
+#include "cras_a2dp_worker.h"
+
+#define NUM_WAKES 1000
+#define WAKE_FRAMES 480
+#define FORMAT_BYTES 4
+#define LINK_MTU 895
+#define PCM_BUF_BYTES (4096 * 4 * FORMAT_BYTES)
+
+static int16_t pcm[WAKE_FRAMES * 2];
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void *reader_thread(void *arg)
+{
+	int fd = *(int *)arg;
+	uint8_t buf[LINK_MTU];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	return NULL;
+}
+
+static void init_sbc(struct a2dp_info *a2dp)
+{
+	a2dp_sbc_t sbc;
+
+	memset(&sbc, 0, sizeof(sbc));
+	sbc.frequency = SBC_SAMPLING_FREQ_48000;
+	sbc.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+	sbc.allocation_method = SBC_ALLOCATION_LOUDNESS;
+	sbc.subbands = SBC_SUBBANDS_8;
+	sbc.block_length = SBC_BLOCK_LENGTH_16;
+	sbc.min_bitpool = 2;
+	sbc.max_bitpool = 53;
+	if (init_a2dp(a2dp, &sbc)) {
+		fprintf(stderr, "Failed to init the SBC codec\n");
+		exit(1);
+	}
+}
+
+/* The encode and write loop of flush_data(), run on the calling thread. */
+static void put_buffer_sync(struct a2dp_info *a2dp, struct byte_buffer *buf,
+			    int fd)
+{
+	unsigned int copied = 0;
+	unsigned int avail;
+	uint8_t *dst;
+	int processed;
+	int written;
+
+	while (copied < sizeof(pcm)) {
+		dst = buf_write_pointer_size(buf, &avail);
+		if (avail == 0)
+			break;
+		avail = MIN(avail, sizeof(pcm) - copied);
+		memcpy(dst, (uint8_t *)pcm + copied, avail);
+		buf_increment_write(buf, avail);
+		copied += avail;
+	}
+
+encode_more:
+	while (buf_queued(buf)) {
+		processed = a2dp_encode(a2dp, buf_read_pointer(buf),
+					buf_readable(buf), FORMAT_BYTES,
+					LINK_MTU);
+		if (processed <= 0)
+			break;
+		buf_increment_read(buf, processed);
+	}
+	written = a2dp_write(a2dp, fd, LINK_MTU);
+	if (written > 0 && written < buf_queued(buf) / FORMAT_BYTES)
+		goto encode_more;
+}
+
+static void put_buffer_offload(struct a2dp_worker *worker)
+{
+	unsigned int copied = 0;
+	unsigned int avail;
+	uint8_t *dst;
+
+	while (copied < sizeof(pcm)) {
+		dst = a2dp_worker_pcm_write_pointer(worker, &avail);
+		if (avail == 0)
+			break;
+		avail = MIN(avail, sizeof(pcm) - copied);
+		memcpy(dst, (uint8_t *)pcm + copied, avail);
+		a2dp_worker_pcm_commit(worker, avail);
+		copied += avail;
+	}
+}
+
+static void report(const char *name, uint64_t *wake_ns)
+{
+	uint64_t sum = 0;
+	unsigned int i;
+
+	qsort(wake_ns, NUM_WAKES, sizeof(*wake_ns), cmp_u64);
+	for (i = 0; i < NUM_WAKES; i++)
+		sum += wake_ns[i];
+	printf("%-10s %12.0f %12lu %12lu\n", name, (double)sum / NUM_WAKES,
+	       (unsigned long)wake_ns[NUM_WAKES * 99 / 100],
+	       (unsigned long)wake_ns[NUM_WAKES - 1]);
+}
+
+static void bench(int offload, uint64_t *wake_ns)
+{
+	struct timespec period = { 0, 2 * 1000 * 1000 };
+	struct a2dp_info a2dp;
+	struct a2dp_worker *worker = NULL;
+	struct byte_buffer *buf = NULL;
+	pthread_t reader;
+	int fds[2];
+	uint64_t start;
+	unsigned int i;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+		perror("socketpair");
+		exit(1);
+	}
+	pthread_create(&reader, NULL, reader_thread, &fds[1]);
+
+	memset(&a2dp, 0, sizeof(a2dp));
+	init_sbc(&a2dp);
+	if (offload)
+		worker = a2dp_worker_create(&a2dp, fds[0], LINK_MTU,
+					    FORMAT_BYTES, PCM_BUF_BYTES, 0);
+	else
+		buf = byte_buffer_create(PCM_BUF_BYTES);
+
+	for (i = 0; i < NUM_WAKES; i++) {
+		start = now_ns();
+		if (offload)
+			put_buffer_offload(worker);
+		else
+			put_buffer_sync(&a2dp, buf, fds[0]);
+		wake_ns[i] = now_ns() - start;
+		/* Let the reader and the worker catch up, like the audio
+		 * thread sleeping until its next wake. */
+		nanosleep(&period, NULL);
+	}
+
+	if (worker)
+		a2dp_worker_destroy(worker);
+	byte_buffer_destroy(&buf);
+	shutdown(fds[0], SHUT_RDWR);
+	pthread_join(reader, NULL);
+	close(fds[0]);
+	close(fds[1]);
+	destroy_a2dp(&a2dp);
+}
+
+int main(int argc, char **argv)
+{
+	static uint64_t wake_ns[NUM_WAKES];
+	unsigned int i;
+
+	for (i = 0; i < WAKE_FRAMES * 2; i++)
+		pcm[i] = (int16_t)(rand() - RAND_MAX / 2);
+
+	printf("%-10s %12s %12s %12s\n", "", "mean ns", "p99 ns", "max ns");
+	bench(0, wake_ns);
+	report("sync", wake_ns);
+	bench(1, wake_ns);
+	report("offload", wake_ns);
+	return 0;
+}
@@ -30,6 +30,7 @@ void ResetStubData() {
   sbc.allocation_method = SBC_ALLOCATION_LOUDNESS;
   sbc.subbands = SBC_SUBBANDS_8;
   sbc.block_length = SBC_BLOCK_LENGTH_16;
+  sbc.min_bitpool = 20;
   sbc.max_bitpool = 50;
 
   a2dp.a2dp_buf_used = 0;
@@ -125,6 +126,135 @@ TEST(A2dpEncode, WriteA2dp) {
   ASSERT_EQ(0, a2dp.seq_num);
 }
 
+// Encodes a packet unless one is waiting, and tries to send it.
+static int EncodeAndWrite(int fd) {
+  if (!a2dp_queued_frames(&a2dp))
+    a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  return a2dp_write(&a2dp, fd, 40);
+}
+
+static void ReadAll(int fd) {
+  uint8_t buf[64];
+  while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+    ;
+}
+
+TEST(A2dpBitpool, FollowsSocketCongestion) {
+  int sock[2];
+  int sndbuf = 4096;
+  int i;
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+  ASSERT_EQ(0, setsockopt(sock[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                          sizeof(sndbuf)));
+  init_a2dp(&a2dp, &sbc);
+  set_sbc_codec_encoded_out(15);
+
+  // Not adapted until enabled, however backed up the socket gets.
+  for (i = 0; i < 50; i++)
+    EncodeAndWrite(sock[0]);
+  EXPECT_EQ(0, get_sbc_codec_set_bitpool_called());
+  ReadAll(sock[1]);
+  a2dp_drain(&a2dp);
+
+  a2dp_enable_adaptive_bitpool(&a2dp);
+  EXPECT_EQ(20, a2dp.bitpool.min);
+  EXPECT_EQ(50, a2dp.bitpool.max);
+
+  // Nothing reads the socket, so it fills up and the bitpool steps down to
+  // the lowest allowed.
+  for (i = 0; i < 200; i++)
+    EncodeAndWrite(sock[0]);
+  EXPECT_EQ(20, a2dp.bitpool.target);
+  EXPECT_EQ(6, a2dp.bitpool.num_decreases);
+  EXPECT_EQ(20, a2dp.bitpool.lowest);
+
+  // The packet stuck in a2dp_buf goes out at the old bitpool once the
+  // socket has room, the ones after it at the new one.
+  ReadAll(sock[1]);
+  EncodeAndWrite(sock[0]);
+  EXPECT_EQ(20, get_sbc_codec_set_bitpool_val());
+  EXPECT_EQ(20, a2dp.bitpool.cur);
+
+  // A reader that keeps up lets it climb back to the highest.
+  ReadAll(sock[1]);
+  for (i = 0; i < 400; i++) {
+    EncodeAndWrite(sock[0]);
+    ReadAll(sock[1]);
+  }
+  EXPECT_EQ(50, get_sbc_codec_set_bitpool_val());
+  EXPECT_EQ(50, a2dp.bitpool.cur);
+  EXPECT_EQ(6, a2dp.bitpool.num_decreases);
+  EXPECT_EQ(20, a2dp.bitpool.lowest);
+
+  destroy_a2dp(&a2dp);
+  close(sock[0]);
+  close(sock[1]);
+}
+
+TEST(A2dpBitpool, OccasionalBackupKeepsBitpool) {
+  int sock[2];
+  int i;
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+  init_a2dp(&a2dp, &sbc);
+  set_sbc_codec_encoded_out(15);
+  a2dp_enable_adaptive_bitpool(&a2dp);
+
+  // One packet in ten finding the socket busy is not enough to step down,
+  // but also stops the bitpool from stepping up.
+  a2dp.bitpool.target = 30;
+  a2dp_drain(&a2dp);
+  for (i = 0; i < 100; i++) {
+    a2dp.bitpool.backed_up += (i % 10 == 0);
+    EncodeAndWrite(sock[0]);
+    ReadAll(sock[1]);
+  }
+  EXPECT_EQ(30, a2dp.bitpool.cur);
+  EXPECT_EQ(0, a2dp.bitpool.num_decreases);
+
+  destroy_a2dp(&a2dp);
+  close(sock[0]);
+  close(sock[1]);
+}
+
+TEST(A2dpBitpool, PreFilledSocketKeepsBitpool) {
+  int sock[2];
+  int sndbuf = 4096;
+  uint8_t buf[64];
+  int i;
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+  ASSERT_EQ(0, setsockopt(sock[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                          sizeof(sndbuf)));
+  init_a2dp(&a2dp, &sbc);
+  set_sbc_codec_encoded_out(15);
+  a2dp_enable_adaptive_bitpool(&a2dp);
+
+  // Fill the socket up like pre_fill_socket() does.
+  for (i = 0; i < 1000 && EncodeAndWrite(sock[0]) != -EAGAIN; i++)
+    ;
+  ASSERT_LT(i, 1000);
+  a2dp_drain(&a2dp);
+
+  // The link takes one packet for each one sent, the socket stays full but
+  // is never congested.
+  for (i = 0; i < 200; i++) {
+    ASSERT_GT(recv(sock[1], buf, sizeof(buf), MSG_DONTWAIT), 0);
+    ASSERT_GT(EncodeAndWrite(sock[0]), 0);
+  }
+  EXPECT_EQ(50, a2dp.bitpool.target);
+  EXPECT_EQ(50, a2dp.bitpool.cur);
+  EXPECT_EQ(0, a2dp.bitpool.num_decreases);
+
+  destroy_a2dp(&a2dp);
+  close(sock[0]);
+  close(sock[1]);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -8,10 +8,11 @@
 
 extern "C" {
 
-#include "a2dp-codecs.h"
 #include "audio_thread.h"
 #include "audio_thread_log.h"
+#include "cras_a2dp_info.h"
 #include "cras_a2dp_iodev.h"
+#include "cras_a2dp_worker.h"
 #include "cras_audio_area.h"
 #include "cras_bt_transport.h"
 #include "cras_iodev.h"
@@ -52,6 +53,25 @@ static void* write_callback_data;
 static const char* fake_device_name = "fake device name";
 static const char* cras_bt_device_name_ret;
 static unsigned int cras_bt_transport_write_mtu_ret;
+static int a2dp_encoder_offload_val;
+static int a2dp_adaptive_bitpool_val;
+static size_t a2dp_enable_adaptive_bitpool_called;
+static struct a2dp_info* a2dp_enable_adaptive_bitpool_a2dp;
+static unsigned int a2dp_bitpool_decreases_val;
+static unsigned int a2dp_lowest_bitpool_val;
+static size_t a2dp_bitpool_metrics_called;
+static size_t a2dp_worker_create_called;
+static size_t a2dp_worker_destroy_called;
+static size_t a2dp_worker_pre_fill_called;
+static unsigned int a2dp_worker_min_queued_frames_val;
+static uint8_t a2dp_worker_pcm[4096];
+static unsigned int a2dp_worker_committed;
+static unsigned int a2dp_worker_pcm_queued_val;
+static unsigned int a2dp_worker_encoded_frames_val;
+static int a2dp_worker_write_status_val;
+static size_t cras_bt_device_cancel_suspend_called;
+static size_t cras_bt_device_schedule_suspend_called;
+static unsigned int cras_bt_device_schedule_suspend_msec;
 
 void ResetStubData() {
   cras_bt_device_append_iodev_called = 0;
@@ -76,6 +96,22 @@ void ResetStubData() {
   a2dp_encode_index = 0;
   a2dp_write_index = 0;
   cras_bt_transport_write_mtu_ret = 800;
+  a2dp_encoder_offload_val = 0;
+  a2dp_adaptive_bitpool_val = 0;
+  a2dp_enable_adaptive_bitpool_called = 0;
+  a2dp_enable_adaptive_bitpool_a2dp = NULL;
+  a2dp_bitpool_decreases_val = 0;
+  a2dp_lowest_bitpool_val = 0;
+  a2dp_bitpool_metrics_called = 0;
+  a2dp_worker_create_called = 0;
+  a2dp_worker_destroy_called = 0;
+  a2dp_worker_pre_fill_called = 0;
+  a2dp_worker_committed = 0;
+  a2dp_worker_pcm_queued_val = 0;
+  a2dp_worker_encoded_frames_val = 0;
+  a2dp_worker_write_status_val = 0;
+  cras_bt_device_cancel_suspend_called = 0;
+  cras_bt_device_schedule_suspend_called = 0;
 
   fake_transport = reinterpret_cast<struct cras_bt_transport*>(0x123);
 
@@ -241,6 +277,92 @@ TEST_F(A2dpIodev, GetPutBuffer) {
   a2dp_iodev_destroy(iodev);
 }
 
+TEST_F(A2dpIodev, AdaptiveBitpool) {
+  struct cras_iodev* iodev;
+
+  iodev = a2dp_iodev_create(fake_transport);
+  iodev_set_format(iodev, &format);
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(0, a2dp_enable_adaptive_bitpool_called);
+  iodev->close_dev(iodev);
+  EXPECT_EQ(0, a2dp_bitpool_metrics_called);
+
+  a2dp_adaptive_bitpool_val = 1;
+  iodev_set_format(iodev, &format);
+  iodev->configure_dev(iodev);
+  ASSERT_EQ(1, a2dp_enable_adaptive_bitpool_called);
+
+  /* How far the bitpool went down is logged when the device closes. */
+  a2dp_enable_adaptive_bitpool_a2dp->bitpool.num_decreases = 3;
+  a2dp_enable_adaptive_bitpool_a2dp->bitpool.lowest = 30;
+  iodev->close_dev(iodev);
+  EXPECT_EQ(2, a2dp_bitpool_metrics_called);
+  EXPECT_EQ(3, a2dp_bitpool_decreases_val);
+  EXPECT_EQ(60, a2dp_lowest_bitpool_val);
+
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, EncoderOffload) {
+  struct cras_iodev* iodev;
+  struct cras_audio_area* area;
+  struct timespec tstamp;
+  unsigned frames;
+
+  a2dp_encoder_offload_val = 1;
+  iodev = a2dp_iodev_create(fake_transport);
+
+  iodev_set_format(iodev, &format);
+  time_now.tv_sec = 0;
+  time_now.tv_nsec = 0;
+  iodev->configure_dev(iodev);
+  ASSERT_EQ(1, a2dp_worker_create_called);
+  EXPECT_EQ(iodev->min_buffer_level, a2dp_worker_min_queued_frames_val);
+  /* The worker polls the socket, not the audio thread. */
+  EXPECT_EQ(NULL, write_callback);
+
+  /* PCM is written straight into the worker's ring. */
+  frames = 2048;
+  iodev->get_buffer(iodev, &area, &frames);
+  EXPECT_EQ(1024, frames);
+  EXPECT_EQ(a2dp_worker_pcm, area->channels[0].buf);
+
+  /* The audio thread only hands the PCM off, it doesn't encode. */
+  iodev->put_buffer(iodev, 100);
+  EXPECT_EQ(1, a2dp_worker_pre_fill_called);
+  EXPECT_EQ(400, a2dp_worker_committed);
+  EXPECT_EQ(0, a2dp_encode_index);
+  EXPECT_EQ(0, a2dp_write_index);
+
+  /* Frames in the worker's ring and encoded frames count as queued. */
+  a2dp_worker_pcm_queued_val = 400;
+  a2dp_worker_encoded_frames_val = 200;
+  EXPECT_EQ(300, iodev->frames_queued(iodev, &tstamp));
+  EXPECT_EQ(300 + iodev->min_buffer_level, iodev->delay_frames(iodev));
+
+  /* A full socket schedules a suspend once, until the worker writes
+   * again. */
+  a2dp_worker_write_status_val = -EAGAIN;
+  EXPECT_EQ(0, iodev->put_buffer(iodev, 100));
+  EXPECT_EQ(0, iodev->put_buffer(iodev, 100));
+  EXPECT_EQ(1, a2dp_worker_pre_fill_called);
+  EXPECT_EQ(1, cras_bt_device_schedule_suspend_called);
+  EXPECT_EQ(5000, cras_bt_device_schedule_suspend_msec);
+  a2dp_worker_write_status_val = 0;
+  EXPECT_EQ(0, iodev->put_buffer(iodev, 100));
+  EXPECT_EQ(1, cras_bt_device_cancel_suspend_called);
+
+  /* Other errors suspend immediately and fail the write. */
+  a2dp_worker_write_status_val = -EPIPE;
+  EXPECT_EQ(-EPIPE, iodev->put_buffer(iodev, 100));
+  EXPECT_EQ(2, cras_bt_device_schedule_suspend_called);
+  EXPECT_EQ(0, cras_bt_device_schedule_suspend_msec);
+
+  iodev->close_dev(iodev);
+  EXPECT_EQ(1, a2dp_worker_destroy_called);
+  a2dp_iodev_destroy(iodev);
+}
+
 TEST_F(A2dpIodev, FramesQueued) {
   struct cras_iodev* iodev;
   struct cras_audio_area* area;
@@ -503,11 +625,14 @@ int cras_bt_device_get_use_hardware_volume(struct cras_bt_device* device) {
 }
 
 int cras_bt_device_cancel_suspend(struct cras_bt_device* device) {
+  cras_bt_device_cancel_suspend_called++;
   return 0;
 }
 
 int cras_bt_device_schedule_suspend(struct cras_bt_device* device,
                                     unsigned int msec) {
+  cras_bt_device_schedule_suspend_called++;
+  cras_bt_device_schedule_suspend_msec = msec;
   return 0;
 }
 
@@ -531,7 +656,7 @@ int a2dp_block_size(struct a2dp_info* a2dp, int encoded_bytes) {
   return encoded_bytes;
 }
 
-int a2dp_queued_frames(struct a2dp_info* a2dp) {
+int a2dp_queued_frames(const struct a2dp_info* a2dp) {
   return a2dp_queued_frames_val;
 }
 
@@ -590,9 +715,6 @@ void cras_audio_area_config_buf_pointers(struct cras_audio_area* area,
   dummy_audio_area->channels[0].buf = base_buffer;
 }
 
-struct audio_thread* cras_iodev_list_get_audio_thread() {
-  return NULL;
-}
 // From audio_thread
 struct audio_thread_event_log* atlog;
 
@@ -606,4 +728,72 @@ int audio_thread_rm_callback_sync(struct audio_thread* thread, int fd) {
 }
 
 void audio_thread_enable_callback(int fd, int enabled) {}
+
+int cras_system_get_a2dp_encoder_offload() {
+  return a2dp_encoder_offload_val;
+}
+
+int cras_system_get_a2dp_adaptive_bitpool() {
+  return a2dp_adaptive_bitpool_val;
+}
+
+void a2dp_enable_adaptive_bitpool(struct a2dp_info* a2dp) {
+  a2dp_enable_adaptive_bitpool_called++;
+  a2dp_enable_adaptive_bitpool_a2dp = a2dp;
+  a2dp->bitpool.enabled = 1;
+  a2dp->bitpool.max = 50;
+}
+
+int cras_server_metrics_a2dp_bitpool_decreases(unsigned num_decreases) {
+  a2dp_bitpool_metrics_called++;
+  a2dp_bitpool_decreases_val = num_decreases;
+  return 0;
+}
+
+int cras_server_metrics_a2dp_lowest_bitpool(unsigned percent) {
+  a2dp_bitpool_metrics_called++;
+  a2dp_lowest_bitpool_val = percent;
+  return 0;
+}
+
+struct a2dp_worker* a2dp_worker_create(struct a2dp_info* a2dp,
+                                       int stream_fd,
+                                       size_t link_mtu,
+                                       unsigned int format_bytes,
+                                       unsigned int pcm_buf_bytes,
+                                       unsigned int min_queued_frames) {
+  a2dp_worker_create_called++;
+  a2dp_worker_min_queued_frames_val = min_queued_frames;
+  return reinterpret_cast<struct a2dp_worker*>(0x456);
+}
+
+void a2dp_worker_destroy(struct a2dp_worker* worker) {
+  a2dp_worker_destroy_called++;
+}
+
+void a2dp_worker_pre_fill(struct a2dp_worker* worker) {
+  a2dp_worker_pre_fill_called++;
+}
+
+uint8_t* a2dp_worker_pcm_write_pointer(struct a2dp_worker* worker,
+                                       unsigned int* avail) {
+  *avail = sizeof(a2dp_worker_pcm);
+  return a2dp_worker_pcm;
+}
+
+void a2dp_worker_pcm_commit(struct a2dp_worker* worker, unsigned int bytes) {
+  a2dp_worker_committed += bytes;
+}
+
+unsigned int a2dp_worker_pcm_queued(const struct a2dp_worker* worker) {
+  return a2dp_worker_pcm_queued_val;
+}
+
+unsigned int a2dp_worker_encoded_frames(const struct a2dp_worker* worker) {
+  return a2dp_worker_encoded_frames_val;
+}
+
+int a2dp_worker_write_status(const struct a2dp_worker* worker) {
+  return a2dp_worker_write_status_val;
+}
 }
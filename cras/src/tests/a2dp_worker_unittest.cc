@@ -0,0 +1,289 @@
+// Copyright 2020 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+extern "C" {
+#include "cras_a2dp_info.h"
+#include "cras_a2dp_worker.h"
+}
+
+// A codesize that doesn't divide the ring size, so codesizes wrap around.
+#define FAKE_CODESIZE 384
+#define FAKE_PACKET_BYTES (2 * FAKE_CODESIZE)
+#define FORMAT_BYTES 4
+#define RING_BYTES 4096
+
+// The fake codec "encodes" by copying whole codesizes of PCM into a packet of
+// two codesizes, which a2dp_write sends to the socket once full. Everything it
+// encodes is kept in order to check the PCM made it through the ring intact.
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<uint8_t> encoded;
+static uint8_t packet[FAKE_PACKET_BYTES];
+static unsigned int pending_bytes;
+static unsigned int sent_bytes;
+static size_t drain_called;
+
+namespace {
+
+class A2dpWorkerTestSuite : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    encoded.clear();
+    pending_bytes = 0;
+    sent_bytes = 0;
+    drain_called = 0;
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+    fcntl(sock[1], F_SETFL, O_NONBLOCK);
+    next_byte = 0;
+  }
+
+  virtual void TearDown() {
+    close(sock[0]);
+    close(sock[1]);
+  }
+
+  // Writes the next bytes of a counting pattern to the ring.
+  void Commit(struct a2dp_worker* worker, unsigned int bytes) {
+    unsigned int avail;
+    uint8_t* buf;
+
+    while (bytes) {
+      buf = a2dp_worker_pcm_write_pointer(worker, &avail);
+      avail = std::min(avail, bytes);
+      ASSERT_GT(avail, 0);
+      for (unsigned int i = 0; i < avail; i++)
+        buf[i] = next_byte++;
+      a2dp_worker_pcm_commit(worker, avail);
+      bytes -= avail;
+    }
+  }
+
+  // Waits up to a second for the worker to leave |bytes| of PCM queued.
+  bool WaitForQueued(struct a2dp_worker* worker, unsigned int bytes) {
+    for (int i = 0; i < 1000; i++) {
+      if (a2dp_worker_pcm_queued(worker) == bytes)
+        return true;
+      usleep(1000);
+    }
+    return false;
+  }
+
+  bool WaitForStatus(struct a2dp_worker* worker, int status) {
+    for (int i = 0; i < 1000; i++) {
+      if (a2dp_worker_write_status(worker) == status)
+        return true;
+      usleep(1000);
+    }
+    return false;
+  }
+
+  // Fills the socket until a send would block.
+  void FillSocket() {
+    uint8_t buf[256] = {};
+
+    while (send(sock[0], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+      ;
+  }
+
+  // Reads from the socket until the worker has sent everything.
+  bool DrainSocket(struct a2dp_worker* worker) {
+    uint8_t buf[4096];
+
+    for (int i = 0; i < 1000; i++) {
+      while (read(sock[1], buf, sizeof(buf)) > 0)
+        ;
+      if (a2dp_worker_write_status(worker) == 0 &&
+          a2dp_worker_encoded_frames(worker) == 0)
+        return true;
+      usleep(1000);
+    }
+    return false;
+  }
+
+  void ExpectPattern(unsigned int bytes) {
+    pthread_mutex_lock(&fake_lock);
+    ASSERT_EQ(bytes, encoded.size());
+    for (unsigned int i = 0; i < bytes; i++)
+      ASSERT_EQ((uint8_t)i, encoded[i]) << "at " << i;
+    pthread_mutex_unlock(&fake_lock);
+  }
+
+  int sock[2];
+  struct a2dp_info a2dp;
+  uint8_t next_byte;
+};
+
+TEST_F(A2dpWorkerTestSuite, EncodesCommittedPcm) {
+  struct a2dp_worker* worker;
+
+  worker = a2dp_worker_create(&a2dp, sock[0], 800, FORMAT_BYTES, RING_BYTES,
+                              0);
+  ASSERT_TRUE(worker);
+
+  // Packets are sent while more PCM than a packet's worth would be left.
+  Commit(worker, 2100);
+  ASSERT_TRUE(WaitForQueued(worker, 564));
+  ExpectPattern(1536);
+  EXPECT_EQ(0, a2dp_worker_write_status(worker));
+  EXPECT_EQ(0, a2dp_worker_encoded_frames(worker));
+
+  a2dp_worker_destroy(worker);
+  EXPECT_EQ(1536, sent_bytes);
+}
+
+TEST_F(A2dpWorkerTestSuite, WrapAroundRing) {
+  struct a2dp_worker* worker;
+  unsigned int avail;
+
+  worker = a2dp_worker_create(&a2dp, sock[0], 800, FORMAT_BYTES, RING_BYTES,
+                              0);
+  ASSERT_TRUE(worker);
+
+  Commit(worker, 3800);
+  ASSERT_TRUE(WaitForQueued(worker, 728));
+  a2dp_worker_pcm_write_pointer(worker, &avail);
+  EXPECT_EQ(296, avail);
+
+  // One codesize starts 256 bytes before the end of the ring, it has to be
+  // put back together before it is encoded.
+  Commit(worker, 2000);
+  ASSERT_TRUE(WaitForQueued(worker, 424));
+  ExpectPattern(5376);
+
+  a2dp_worker_destroy(worker);
+}
+
+TEST_F(A2dpWorkerTestSuite, KeepsMinQueuedFrames) {
+  struct a2dp_worker* worker;
+
+  // After a packet is sent, another is only encoded while 300 frames more
+  // than a packet's worth are left in the ring.
+  worker = a2dp_worker_create(&a2dp, sock[0], 800, FORMAT_BYTES, RING_BYTES,
+                              300);
+  ASSERT_TRUE(worker);
+
+  Commit(worker, 3072);
+  ASSERT_TRUE(WaitForQueued(worker, 1536));
+  ExpectPattern(1536);
+
+  a2dp_worker_destroy(worker);
+}
+
+TEST_F(A2dpWorkerTestSuite, SocketFull) {
+  struct a2dp_worker* worker;
+
+  worker = a2dp_worker_create(&a2dp, sock[0], 800, FORMAT_BYTES, RING_BYTES,
+                              0);
+  ASSERT_TRUE(worker);
+
+  // The encoded packet waits for the socket to have room.
+  FillSocket();
+  Commit(worker, FAKE_PACKET_BYTES);
+  ASSERT_TRUE(WaitForStatus(worker, -EAGAIN));
+  EXPECT_EQ(FAKE_PACKET_BYTES / FORMAT_BYTES,
+            a2dp_worker_encoded_frames(worker));
+  EXPECT_EQ(0, a2dp_worker_pcm_queued(worker));
+
+  // It is sent without another commit once the socket drains.
+  ASSERT_TRUE(DrainSocket(worker));
+  a2dp_worker_destroy(worker);
+  EXPECT_EQ(FAKE_PACKET_BYTES, sent_bytes);
+}
+
+TEST_F(A2dpWorkerTestSuite, PreFill) {
+  struct a2dp_worker* worker;
+
+  worker = a2dp_worker_create(&a2dp, sock[0], 800, FORMAT_BYTES, RING_BYTES,
+                              0);
+  ASSERT_TRUE(worker);
+
+  // Silence is sent until the socket fills, then the committed PCM follows
+  // once it drains.
+  a2dp_worker_pre_fill(worker);
+  Commit(worker, FAKE_PACKET_BYTES);
+  ASSERT_TRUE(WaitForQueued(worker, 0));
+  ASSERT_TRUE(DrainSocket(worker));
+  a2dp_worker_destroy(worker);
+
+  EXPECT_EQ(1, drain_called);
+  pthread_mutex_lock(&fake_lock);
+  ASSERT_GT(encoded.size(), FAKE_PACKET_BYTES);
+  for (unsigned int i = 0; i < encoded.size() - FAKE_PACKET_BYTES; i++)
+    ASSERT_EQ(0, encoded[i]);
+  encoded.erase(encoded.begin(), encoded.end() - FAKE_PACKET_BYTES);
+  pthread_mutex_unlock(&fake_lock);
+  ExpectPattern(FAKE_PACKET_BYTES);
+}
+
+}  // namespace
+
+extern "C" {
+
+int a2dp_codesize(struct a2dp_info* a2dp) {
+  return FAKE_CODESIZE;
+}
+
+int a2dp_queued_frames(const struct a2dp_info* a2dp) {
+  return pending_bytes / FORMAT_BYTES;
+}
+
+void a2dp_drain(struct a2dp_info* a2dp) {
+  pending_bytes = 0;
+  drain_called++;
+}
+
+int a2dp_encode(struct a2dp_info* a2dp,
+                const void* pcm_buf,
+                int pcm_buf_size,
+                int format_bytes,
+                size_t link_mtu) {
+  const uint8_t* pcm = (const uint8_t*)pcm_buf;
+  int processed;
+
+  processed = std::min(pcm_buf_size / FAKE_CODESIZE * FAKE_CODESIZE,
+                       (int)(FAKE_PACKET_BYTES - pending_bytes));
+  pthread_mutex_lock(&fake_lock);
+  encoded.insert(encoded.end(), pcm, pcm + processed);
+  pthread_mutex_unlock(&fake_lock);
+  pending_bytes += processed;
+  return processed;
+}
+
+int a2dp_write(struct a2dp_info* a2dp, int stream_fd, size_t link_mtu) {
+  int frames;
+
+  if (pending_bytes < FAKE_PACKET_BYTES)
+    return 0;
+  if (send(stream_fd, packet, pending_bytes, MSG_DONTWAIT) < 0)
+    return -errno;
+
+  frames = pending_bytes / FORMAT_BYTES;
+  sent_bytes += pending_bytes;
+  pending_bytes = 0;
+  return frames;
+}
+
+int cras_set_rt_scheduling(int rt_lim) {
+  return -1;
+}
+
+int cras_set_thread_priority(int priority) {
+  return 0;
+}
+
+}  // extern "C"
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -2333,10 +2333,6 @@ int cras_iodev_list_resume_hotword_stream() {
   return 0;
 }
 
-struct audio_thread* cras_iodev_list_get_audio_thread() {
-  return NULL;
-}
-
 //  From alsa helper.
 int cras_alsa_set_channel_map(snd_pcm_t* handle,
                               struct cras_audio_format* fmt) {
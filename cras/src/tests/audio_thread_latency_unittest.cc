@@ -0,0 +1,122 @@
+// Copyright 2020 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+
+extern "C" {
+#include "audio_thread_latency.h"
+#include "cras_latency_hist.h"
+}
+
+namespace {
+
+TEST(LatencyHist, BucketBounds) {
+  static const uint64_t durations[] = {0,       1,        7,         8,
+                                       9,       15,       16,        17,
+                                       1000,    123456,   20000000,  999999999};
+
+  for (size_t i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+    unsigned int idx = latency_hist_bucket(durations[i]);
+    EXPECT_LE(latency_hist_bucket_lower(idx), durations[i]) << durations[i];
+    EXPECT_GE(latency_hist_bucket_upper(idx), durations[i]) << durations[i];
+  }
+  for (unsigned int idx = 0; idx + 1 < AUDIO_THREAD_LATENCY_NUM_BUCKETS;
+       idx++) {
+    EXPECT_EQ(idx, latency_hist_bucket(latency_hist_bucket_lower(idx)));
+    EXPECT_EQ(idx, latency_hist_bucket(latency_hist_bucket_upper(idx)));
+  }
+  EXPECT_EQ(AUDIO_THREAD_LATENCY_NUM_BUCKETS - 1,
+            latency_hist_bucket(UINT64_MAX));
+}
+
+TEST(LatencyHist, Quantile) {
+  struct audio_thread_latency_hist hist;
+
+  memset(&hist, 0, sizeof(hist));
+  EXPECT_EQ(0, latency_hist_quantile(&hist, 0.5));
+
+  // 90 short durations and 10 long ones.
+  for (int i = 0; i < 90; i++)
+    latency_hist_add(&hist, 1000);
+  for (int i = 0; i < 10; i++)
+    latency_hist_add(&hist, 50000);
+
+  EXPECT_EQ(100, hist.count);
+  EXPECT_EQ(90 * 1000 + 10 * 50000, hist.sum_ns);
+  EXPECT_EQ(50000, hist.max_ns);
+  EXPECT_GE(latency_hist_quantile(&hist, 0.5), 1000);
+  // Within one bucket, 1/8 of the duration.
+  EXPECT_LT(latency_hist_quantile(&hist, 0.5), 1125);
+  EXPECT_EQ(50000, latency_hist_quantile(&hist, 0.95));
+  EXPECT_EQ(50000, latency_hist_quantile(&hist, 1.0));
+}
+
+class AudioThreadLatencySuite : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    snprintf(name_, sizeof(name_), "/ATlat-test-%d", getpid());
+    audio_thread_latency_init(name_);
+    ASSERT_NE((void*)NULL, atlat);
+  }
+
+  virtual void TearDown() {
+    audio_thread_latency_deinit(name_);
+    EXPECT_EQ((void*)NULL, atlat);
+  }
+
+  char name_[64];
+};
+
+TEST_F(AudioThreadLatencySuite, CommitCountsEachWakeOnce) {
+  struct audio_thread_latency_stats stats;
+
+  audio_thread_latency_add_ns(AUDIO_THREAD_LATENCY_CONVERSION, 300);
+  audio_thread_latency_add_ns(AUDIO_THREAD_LATENCY_CONVERSION, 200);
+  audio_thread_latency_add_ns(AUDIO_THREAD_LATENCY_WRITE, 2000);
+  audio_thread_latency_commit();
+  audio_thread_latency_add_ns(AUDIO_THREAD_LATENCY_WRITE, 4000);
+  audio_thread_latency_commit();
+  // Nothing pending, nothing counted.
+  audio_thread_latency_commit();
+
+  ASSERT_EQ(0, audio_thread_latency_read(&stats));
+  EXPECT_EQ(0, stats.seq & 1);
+  EXPECT_EQ(1, stats.hists[AUDIO_THREAD_LATENCY_CONVERSION].count);
+  EXPECT_EQ(500, stats.hists[AUDIO_THREAD_LATENCY_CONVERSION].sum_ns);
+  EXPECT_EQ(2, stats.hists[AUDIO_THREAD_LATENCY_WRITE].count);
+  EXPECT_EQ(6000, stats.hists[AUDIO_THREAD_LATENCY_WRITE].sum_ns);
+  EXPECT_EQ(4000, stats.hists[AUDIO_THREAD_LATENCY_WRITE].max_ns);
+  EXPECT_EQ(0, stats.hists[AUDIO_THREAD_LATENCY_CAPTURE].count);
+  EXPECT_EQ(0, stats.hists[AUDIO_THREAD_LATENCY_WAKE_JITTER].count);
+}
+
+TEST_F(AudioThreadLatencySuite, AddMeasuresFromStart) {
+  struct audio_thread_latency_stats stats;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  usleep(1000);
+  audio_thread_latency_add(AUDIO_THREAD_LATENCY_FETCH, &start);
+  audio_thread_latency_commit();
+
+  ASSERT_EQ(0, audio_thread_latency_read(&stats));
+  EXPECT_EQ(1, stats.hists[AUDIO_THREAD_LATENCY_FETCH].count);
+  EXPECT_GE(stats.hists[AUDIO_THREAD_LATENCY_FETCH].max_ns, 1000000);
+}
+
+TEST(AudioThreadLatency, ReadWithoutHistograms) {
+  struct audio_thread_latency_stats stats;
+
+  EXPECT_EQ(-ENODEV, audio_thread_latency_read(&stats));
+}
+
+}  //  namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Compares the cost of one audio thread wake with the ppoll backend, which
+ * rebuilds its fd array from the attached streams before every wait, against
+ * the epoll backend where stream fds stay registered and the sleep is driven by
+ * a timerfd. Each wake is triggered by one stream's client writing a message.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for ppoll */
+#endif
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utlist.h"
+
+#define NUM_WAKES 20000
+#define MAX_STREAMS 64
+
+/* Stands in for a dev_stream attached to an open device. */
+struct fake_stream {
+	int fds[2]; /* [0] polled by the audio thread, [1] the client end. */
+	struct fake_stream *prev, *next;
+};
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+static void client_reply(struct fake_stream *stream)
+{
+	char c = 0;
+
+	if (write(stream->fds[1], &c, 1) != 1)
+		perror("write");
+}
+
+static void server_read(int fd)
+{
+	char c;
+
+	if (read(fd, &c, 1) != 1)
+		perror("read");
+}
+
+/* Returns the stream the i-th wake comes from. */
+static struct fake_stream *pick_stream(struct fake_stream *streams,
+				       unsigned int num_streams, unsigned int i)
+{
+	struct fake_stream *s;
+	unsigned int n = i % num_streams;
+
+	DL_FOREACH (streams, s)
+		if (n-- == 0)
+			return s;
+	return streams;
+}
+
+static double bench_ppoll(struct fake_stream *streams, unsigned int num_streams)
+{
+	struct pollfd pollfds[MAX_STREAMS];
+	struct timespec wait_ts = { 0, 10 * 1000 * 1000 };
+	struct timespec tp1, tp2;
+	struct fake_stream *s;
+	unsigned int i, n, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	for (i = 0; i < NUM_WAKES; i++) {
+		client_reply(pick_stream(streams, num_streams, i));
+
+		n = 0;
+		DL_FOREACH (streams, s) {
+			pollfds[n].fd = s->fds[0];
+			pollfds[n].events = POLLIN;
+			pollfds[n].revents = 0;
+			n++;
+		}
+		if (ppoll(pollfds, n, &wait_ts, NULL) <= 0)
+			continue;
+		for (j = 0; j < n; j++)
+			if (pollfds[j].revents & POLLIN)
+				server_read(pollfds[j].fd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tp2);
+
+	return tp_diff(&tp2, &tp1) * 1e9 / NUM_WAKES;
+}
+
+static double bench_epoll(struct fake_stream *streams, unsigned int num_streams)
+{
+	struct epoll_event ev, events[MAX_STREAMS + 1];
+	struct itimerspec its;
+	struct timespec tp1, tp2;
+	struct fake_stream *s;
+	int epoll_fd, timer_fd;
+	unsigned int i;
+	int j, rc;
+
+	epoll_fd = epoll_create1(0);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (epoll_fd < 0 || timer_fd < 0) {
+		perror("epoll setup");
+		exit(1);
+	}
+
+	/* Registered once, like stream attach in dev_io. */
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+	DL_FOREACH (streams, s) {
+		ev.data.ptr = s;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s->fds[0], &ev);
+	}
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_nsec = 10 * 1000 * 1000;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	for (i = 0; i < NUM_WAKES; i++) {
+		client_reply(pick_stream(streams, num_streams, i));
+
+		timerfd_settime(timer_fd, 0, &its, NULL);
+		rc = epoll_wait(epoll_fd, events, MAX_STREAMS + 1, -1);
+		for (j = 0; j < rc; j++) {
+			s = (struct fake_stream *)events[j].data.ptr;
+			if (s)
+				server_read(s->fds[0]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tp2);
+
+	close(timer_fd);
+	close(epoll_fd);
+	return tp_diff(&tp2, &tp1) * 1e9 / NUM_WAKES;
+}
+
+int main(int argc, char **argv)
+{
+	struct fake_stream *streams = NULL;
+	struct fake_stream *s;
+	unsigned int num_streams = 0;
+	unsigned int target;
+
+	printf("%8s %14s %14s\n", "streams", "ppoll ns/wake", "epoll ns/wake");
+	for (target = 1; target <= MAX_STREAMS; target *= 2) {
+		while (num_streams < target) {
+			s = (struct fake_stream *)calloc(1, sizeof(*s));
+			if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, s->fds)) {
+				perror("socketpair");
+				return 1;
+			}
+			DL_APPEND(streams, s);
+			num_streams++;
+		}
+		printf("%8u %14.0f %14.0f\n", num_streams,
+		       bench_ppoll(streams, num_streams),
+		       bench_epoll(streams, num_streams));
+	}
+
+	DL_FOREACH (streams, s) {
+		DL_DELETE(streams, s);
+		close(s->fds[0]);
+		close(s->fds[1]);
+		free(s);
+	}
+	return 0;
+}
@@ -36,6 +36,10 @@ static unsigned int cras_iodev_put_output_buffer_nframes;
 static unsigned int cras_iodev_fill_odev_zeros_frames;
 static int dev_stream_playback_frames_ret;
 static int dev_stream_mix_called;
+static int dev_stream_mix_group_called;
+static int dev_stream_can_share_conv_ret;
+static int playback_conv_group_create_called;
+static int playback_conv_group_destroy_called;
 static unsigned int dev_stream_update_next_wake_time_called;
 static unsigned int dev_stream_request_playback_samples_called;
 static unsigned int cras_iodev_prepare_output_before_write_samples_called;
@@ -84,6 +88,10 @@ void ResetGlobalStubData() {
   cras_iodev_frames_to_play_in_sleep_called = 0;
   dev_stream_playback_frames_ret = 0;
   dev_stream_mix_called = 0;
+  dev_stream_mix_group_called = 0;
+  dev_stream_can_share_conv_ret = 0;
+  playback_conv_group_create_called = 0;
+  playback_conv_group_destroy_called = 0;
   dev_stream_request_playback_samples_called = 0;
   dev_stream_update_next_wake_time_called = 0;
   cras_iodev_prepare_output_before_write_samples_called = 0;
@@ -321,6 +329,36 @@ TEST_F(StreamDeviceSuite, StartRamp) {
   thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, iodev.info.idx);
 }
 
+TEST_F(StreamDeviceSuite, StartRampMessagesHandledInOneWake) {
+  struct cras_iodev iodev;
+  struct pollfd pfd;
+
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  thread_add_open_dev(thread_, &iodev);
+  iodev.ramp = reinterpret_cast<cras_ramp*>(0x123);
+
+  // Ramp requests are queued without waiting on the audio thread.
+  thread_->started = 1;
+  EXPECT_EQ(0, audio_thread_dev_start_ramp(
+                   thread_, iodev.info.idx, CRAS_IODEV_RAMP_REQUEST_UP_UNMUTE));
+  EXPECT_EQ(0, audio_thread_dev_start_ramp(
+                   thread_, iodev.info.idx, CRAS_IODEV_RAMP_REQUEST_DOWN_MUTE));
+  thread_->started = 0;
+  EXPECT_EQ(NULL, cras_iodev_start_ramp_odev);
+
+  pfd.fd = cras_cmd_ring_doorbell_fd(thread_->cmd_ring);
+  pfd.events = POLLIN;
+  ASSERT_EQ(1, poll(&pfd, 1, 0));
+
+  handle_playback_thread_messages(thread_);
+  EXPECT_EQ(&iodev, cras_iodev_start_ramp_odev);
+  EXPECT_EQ(CRAS_IODEV_RAMP_REQUEST_DOWN_MUTE, cras_iodev_start_ramp_request);
+  EXPECT_EQ(0, poll(&pfd, 1, 0));
+  EXPECT_EQ(NULL, cras_cmd_ring_next(thread_->cmd_ring));
+
+  thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, iodev.info.idx);
+}
+
 TEST_F(StreamDeviceSuite, AddRemoveOpenInputDevice) {
   struct cras_iodev iodev;
   struct open_dev* adev;
@@ -654,6 +692,147 @@ TEST_F(StreamDeviceSuite, AddRemoveMultipleStreamsOnMultipleDevices) {
   TearDownRstream(&rstream3);
 }
 
+TEST_F(StreamDeviceSuite, EpollStreamFdRegisteredOnAttach) {
+  struct cras_iodev iodev, *piodev = &iodev;
+  struct cras_iodev iodev2, *piodev2 = &iodev2;
+  struct cras_iodev* iodevs[] = {&iodev, &iodev2};
+  struct cras_rstream rstream;
+  int fds[2];
+
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(0, audio_thread_use_epoll(thread_, 1));
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  SetupDevice(&iodev2, CRAS_STREAM_OUTPUT);
+  SetupRstream(&rstream, CRAS_STREAM_OUTPUT);
+  rstream.fd = fds[0];
+
+  thread_add_open_dev(thread_, &iodev);
+  thread_add_open_dev(thread_, &iodev2);
+  thread_add_stream(thread_, &rstream, iodevs, 2);
+
+  // One registration shared by both devices.
+  ASSERT_NE((void*)NULL, thread_->stream_poll_fds);
+  EXPECT_EQ(&rstream, thread_->stream_poll_fds->stream);
+  EXPECT_EQ(2, thread_->stream_poll_fds->refcount);
+  EXPECT_EQ(NULL, thread_->stream_poll_fds->next);
+
+  dev_io_remove_stream(&thread_->open_devs[CRAS_STREAM_OUTPUT], &rstream,
+                       piodev);
+  ASSERT_NE((void*)NULL, thread_->stream_poll_fds);
+  EXPECT_EQ(1, thread_->stream_poll_fds->refcount);
+
+  // Closing the device detaches the stream and drops the registration.
+  thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, piodev2->info.idx);
+  EXPECT_EQ(NULL, thread_->stream_poll_fds);
+
+  thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, iodev.info.idx);
+  TearDownRstream(&rstream);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(StreamDeviceSuite, EpollMutesStreamNotPendingReply) {
+  struct cras_iodev iodev, *piodev = &iodev;
+  struct cras_rstream rstream;
+  struct timespec ts = {0, 0};
+  int msg_ready = 0;
+  int timed_out;
+  int fds[2];
+  char c = 0;
+
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(0, audio_thread_use_epoll(thread_, 1));
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  SetupRstream(&rstream, CRAS_STREAM_OUTPUT);
+  rstream.fd = fds[0];
+
+  thread_add_open_dev(thread_, &iodev);
+  thread_add_stream(thread_, &rstream, &piodev, 1);
+  ASSERT_NE((void*)NULL, thread_->stream_poll_fds);
+
+  // Readable while no reply is expected, the fd is taken out of the set.
+  ASSERT_EQ(1, write(fds[1], &c, 1));
+  cras_rstream_is_pending_reply_ret = 0;
+  EXPECT_EQ(1, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+  EXPECT_EQ(1, thread_->stream_poll_fds->muted);
+  EXPECT_EQ(1, thread_->num_muted_stream_fds);
+  EXPECT_EQ(0, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+
+  // Put back once the stream waits for the client again.
+  cras_rstream_is_pending_reply_ret = 1;
+  EXPECT_EQ(1, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+  EXPECT_EQ(0, thread_->stream_poll_fds->muted);
+  EXPECT_EQ(0, thread_->num_muted_stream_fds);
+  EXPECT_EQ(0, msg_ready);
+
+  thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, iodev.info.idx);
+  EXPECT_EQ(NULL, thread_->stream_poll_fds);
+  TearDownRstream(&rstream);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(StreamDeviceSuite, EpollCallbackFollowsEnabledState) {
+  struct timespec ts = {0, 0};
+  int msg_ready = 0;
+  int timed_out;
+  int fds[2];
+  char c = 0;
+
+  ASSERT_EQ(0, pipe(fds));
+  audio_thread_add_callback(fds[0], NULL, NULL);
+  ASSERT_EQ(0, audio_thread_use_epoll(thread_, 1));
+  ASSERT_EQ(1, write(fds[1], &c, 1));
+
+  EXPECT_EQ(1, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+  EXPECT_EQ(EPOLLIN, thread_->iodev_callbacks->revents);
+  thread_->iodev_callbacks->revents = 0;
+
+  audio_thread_enable_callback(fds[0], 0);
+  EXPECT_EQ(0, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+  audio_thread_enable_callback(fds[0], 1);
+  EXPECT_EQ(1, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+
+  audio_thread_rm_callback(fds[0]);
+  EXPECT_EQ(0, thread_wait_epoll(thread_, &ts, &msg_ready, &timed_out));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// A wake up by the timer is counted in the wake jitter histogram, with ppoll
+// and with epoll, where the timer fd firing makes epoll_wait return 1.
+TEST_F(StreamDeviceSuite, WakeJitterCountedOnTimer) {
+  struct audio_thread_latency_stats stats;
+  char name[64];
+
+  snprintf(name, sizeof(name), "/ATlat-thread-test-%d", getpid());
+  audio_thread_latency_init(name);
+  ASSERT_NE((void*)NULL, atlat);
+
+  for (int use_epoll = 0; use_epoll < 2; use_epoll++) {
+    struct audio_thread* thread = audio_thread_create();
+    struct timespec ts = {0, 1000000};
+    struct timespec wake;
+    int msg_ready = 0;
+
+    ASSERT_EQ(0, audio_thread_use_epoll(thread, use_epoll));
+    ASSERT_EQ(use_epoll, thread->epoll_fd >= 0);
+    thread->pollfds[0].fd = cras_cmd_ring_doorbell_fd(thread->cmd_ring);
+    thread->pollfds[0].events = POLLIN;
+    thread->num_pollfds = 1;
+
+    EXPECT_EQ(use_epoll, thread_wait(thread, &ts, &msg_ready, &wake));
+    EXPECT_EQ(0, msg_ready);
+    audio_thread_latency_commit();
+    ASSERT_EQ(0, audio_thread_latency_read(&stats));
+    EXPECT_EQ(use_epoll + 1,
+              stats.hists[AUDIO_THREAD_LATENCY_WAKE_JITTER].count);
+    audio_thread_destroy(thread);
+  }
+
+  audio_thread_latency_deinit(name);
+}
+
 TEST_F(StreamDeviceSuite, FetchStreams) {
   struct cras_iodev iodev, *piodev = &iodev;
   struct open_dev* adev;
@@ -877,6 +1056,55 @@ TEST_F(StreamDeviceSuite, MixOutputSamples) {
   TearDownRstream(&rstream2);
 }
 
+TEST_F(StreamDeviceSuite, MixOutputSamplesSharedConversion) {
+  struct cras_iodev iodev, *piodev = &iodev;
+  struct cras_rstream rstream1;
+  struct cras_rstream rstream2;
+  struct open_dev* adev;
+
+  ResetGlobalStubData();
+
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  SetupRstream(&rstream1, CRAS_STREAM_OUTPUT);
+  SetupRstream(&rstream2, CRAS_STREAM_OUTPUT);
+  iodev.share_playback_conv = 1;
+  dev_stream_can_share_conv_ret = 1;
+
+  cras_iodev_get_output_buffer_area = cras_audio_area_create(2);
+
+  thread_add_open_dev(thread_, &iodev);
+  thread_add_stream(thread_, &rstream1, &piodev, 1);
+  thread_add_stream(thread_, &rstream2, &piodev, 1);
+  adev = thread_->open_devs[CRAS_STREAM_OUTPUT];
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  cras_iodev_prepare_output_before_write_samples_state =
+      CRAS_IODEV_STATE_NORMAL_RUN;
+  frames_queued_ = 0;
+  dev_stream_playback_frames_ret = 100;
+  dev_stream_set_running(iodev.streams);
+  dev_stream_set_running(iodev.streams->next);
+
+  // Both streams are mixed by their group, which is kept between periods.
+  write_output_samples(&thread_->open_devs[CRAS_STREAM_OUTPUT], adev, nullptr);
+  EXPECT_EQ(1, dev_stream_mix_group_called);
+  EXPECT_EQ(0, dev_stream_mix_called);
+  write_output_samples(&thread_->open_devs[CRAS_STREAM_OUTPUT], adev, nullptr);
+  EXPECT_EQ(2, dev_stream_mix_group_called);
+  EXPECT_EQ(1, playback_conv_group_create_called);
+
+  // A stream that can't share the converter is mixed on its own and the
+  // group without streams is released.
+  dev_stream_can_share_conv_ret = 0;
+  write_output_samples(&thread_->open_devs[CRAS_STREAM_OUTPUT], adev, nullptr);
+  EXPECT_EQ(2, dev_stream_mix_group_called);
+  EXPECT_EQ(2, dev_stream_mix_called);
+  EXPECT_EQ(1, playback_conv_group_destroy_called);
+
+  thread_rm_open_dev(thread_, CRAS_STREAM_OUTPUT, iodev.info.idx);
+  TearDownRstream(&rstream1);
+  TearDownRstream(&rstream2);
+}
+
 TEST_F(StreamDeviceSuite, DoPlaybackNoStream) {
   struct cras_iodev iodev;
 
@@ -1003,26 +1231,57 @@ TEST(AudioThreadStreams, DrainStream) {
   TearDownRstream(&rstream);
 }
 
+TEST(AudioThreadMultiple, CallbacksGoToSelectedThread) {
+  struct audio_thread* first = audio_thread_create();
+  struct audio_thread* second = audio_thread_create();
+  int fds[2];
+
+  // Both threads log to the event log set up by the first.
+  ASSERT_NE((void*)NULL, atlog);
+  ASSERT_EQ(0, pipe(fds));
+
+  audio_thread_select(second);
+  audio_thread_add_callback(fds[0], NULL, NULL);
+  EXPECT_EQ((void*)NULL, first->iodev_callbacks);
+  ASSERT_NE((void*)NULL, second->iodev_callbacks);
+  EXPECT_EQ(fds[0], second->iodev_callbacks->fd);
+  audio_thread_rm_callback(fds[0]);
+  EXPECT_EQ((void*)NULL, second->iodev_callbacks);
+
+  // The first thread stays selected after the second is destroyed.
+  audio_thread_select(first);
+  audio_thread_destroy(second);
+  ASSERT_NE((void*)NULL, atlog);
+  audio_thread_add_callback(fds[0], NULL, NULL);
+  ASSERT_NE((void*)NULL, first->iodev_callbacks);
+  audio_thread_rm_callback(fds[0]);
+  audio_thread_destroy(first);
+  close(fds[0]);
+  close(fds[1]);
+}
+
 TEST(BusyloopDetectSuite, CheckerTest) {
-  continuous_zero_sleep_count = 0;
+  struct audio_thread thread;
+
+  memset(&thread, 0, sizeof(thread));
   cras_audio_thread_busyloop_called = 0;
   timespec wait_ts;
   wait_ts.tv_sec = 0;
   wait_ts.tv_nsec = 0;
 
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 1);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 1);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 0);
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 2);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 2);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 3);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 3);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
 
   wait_ts.tv_sec = 1;
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 0);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 0);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
 }
 
@@ -1123,6 +1382,14 @@ int cras_iodev_put_output_buffer(struct cras_iodev* iodev,
   return 0;
 }
 
+int cras_iodev_put_output_mix_bus(struct cras_iodev* iodev,
+                                  uint8_t* frames,
+                                  unsigned int nframes,
+                                  int* non_empty,
+                                  struct cras_fmt_conv* output_converter) {
+  return 0;
+}
+
 int cras_iodev_get_input_buffer(struct cras_iodev* iodev, unsigned* frames) {
   return 0;
 }
@@ -1200,10 +1467,14 @@ int cras_set_thread_priority(int priority) {
 
 void cras_system_rm_select_fd(int fd) {}
 
+void capture_conv_cache_reset(struct capture_conv_cache* cache, int share) {}
+void capture_conv_cache_release(struct capture_conv_cache* cache) {}
+
 unsigned int dev_stream_capture(struct dev_stream* dev_stream,
                                 const struct cras_audio_area* area,
                                 unsigned int area_offset,
-                                float software_gain_scaler) {
+                                float software_gain_scaler,
+                                struct capture_conv_cache* cache) {
   return 0;
 }
 
@@ -1241,6 +1512,51 @@ int dev_stream_mix(struct dev_stream* dev_stream,
   return num_to_write;
 }
 
+int dev_stream_mix_bus(struct dev_stream* dev_stream,
+                       const struct cras_audio_format* fmt,
+                       struct cras_mix_bus* bus,
+                       unsigned int offset,
+                       unsigned int num_to_write) {
+  return 0;
+}
+
+void cras_mix_bus_zero(struct cras_mix_bus* bus,
+                       unsigned int offset,
+                       unsigned int frames) {}
+
+struct playback_conv_group* playback_conv_group_create(
+    const struct dev_stream* dev_stream,
+    unsigned int dev_frames) {
+  playback_conv_group_create_called++;
+  return static_cast<playback_conv_group*>(
+      calloc(1, sizeof(struct playback_conv_group)));
+}
+
+void playback_conv_group_destroy(struct playback_conv_group* group) {
+  playback_conv_group_destroy_called++;
+  free(group);
+}
+
+int playback_conv_group_matches(const struct playback_conv_group* group,
+                                const struct dev_stream* dev_stream) {
+  return 1;
+}
+
+int dev_stream_can_share_conv(const struct dev_stream* dev_stream) {
+  return dev_stream_can_share_conv_ret;
+}
+
+int dev_stream_mix_group(struct dev_stream* streams,
+                         struct playback_conv_group* group,
+                         const struct cras_audio_format* fmt,
+                         uint8_t* dst,
+                         struct cras_mix_bus* bus,
+                         unsigned int offset,
+                         unsigned int num_to_write) {
+  dev_stream_mix_group_called++;
+  return num_to_write;
+}
+
 int dev_stream_playback_frames(const struct dev_stream* dev_stream) {
   return dev_stream_playback_frames_ret;
 }
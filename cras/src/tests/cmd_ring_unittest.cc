@@ -0,0 +1,199 @@
+// Copyright 2020 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+
+extern "C" {
+#include "cras_cmd_ring.h"
+}
+
+namespace {
+
+struct TestMsg {
+  unsigned int seq;
+  int value;
+};
+
+static unsigned int done_count;
+static unsigned int last_done_seq;
+static int last_done_rc;
+
+static void TestDone(void* msg, int rc) {
+  struct TestMsg* tmsg = (struct TestMsg*)msg;
+
+  done_count++;
+  last_done_seq = tmsg->seq;
+  last_done_rc = rc;
+}
+
+static int DoorbellPending(struct cras_cmd_ring* ring) {
+  struct pollfd pfd;
+
+  pfd.fd = cras_cmd_ring_doorbell_fd(ring);
+  pfd.events = POLLIN;
+  return poll(&pfd, 1, 0);
+}
+
+// Handles commands until one with a negative value, completing each with
+// its value and doubling the value in place.
+static void* ConsumerThread(void* arg) {
+  struct cras_cmd_ring* ring = (struct cras_cmd_ring*)arg;
+  struct TestMsg* msg;
+  struct pollfd pfd;
+  int rc;
+
+  pfd.fd = cras_cmd_ring_doorbell_fd(ring);
+  pfd.events = POLLIN;
+  while (1) {
+    if (poll(&pfd, 1, -1) <= 0)
+      continue;
+    cras_cmd_ring_ack_doorbell(ring);
+    while ((msg = (struct TestMsg*)cras_cmd_ring_next(ring))) {
+      rc = msg->value;
+      msg->value *= 2;
+      cras_cmd_ring_complete(ring, rc);
+      if (rc < 0)
+        return NULL;
+    }
+  }
+}
+
+class CmdRingTestSuite : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    ring_ = cras_cmd_ring_create();
+    ASSERT_NE((void*)NULL, ring_);
+    done_count = 0;
+    last_done_seq = 0;
+    last_done_rc = 0;
+  }
+
+  virtual void TearDown() { cras_cmd_ring_destroy(ring_); }
+
+  struct cras_cmd_ring* ring_;
+};
+
+TEST_F(CmdRingTestSuite, EmptyRing) {
+  EXPECT_EQ(0, DoorbellPending(ring_));
+  EXPECT_EQ((void*)NULL, cras_cmd_ring_next(ring_));
+}
+
+TEST_F(CmdRingTestSuite, MsgTooLarge) {
+  uint8_t buf[CRAS_CMD_RING_MSG_SIZE + 1] = {0};
+
+  EXPECT_EQ(-EINVAL, cras_cmd_ring_post(ring_, buf, sizeof(buf), NULL));
+  EXPECT_EQ(0, DoorbellPending(ring_));
+}
+
+TEST_F(CmdRingTestSuite, BatchRingsDoorbellOnce) {
+  struct TestMsg msg;
+  struct TestMsg* rmsg;
+  unsigned int i;
+
+  for (i = 0; i < 4; i++) {
+    msg.seq = i;
+    msg.value = 10 + i;
+    EXPECT_EQ(0, cras_cmd_ring_post(ring_, &msg, sizeof(msg), TestDone));
+  }
+
+  ASSERT_EQ(1, DoorbellPending(ring_));
+  cras_cmd_ring_ack_doorbell(ring_);
+  EXPECT_EQ(0, DoorbellPending(ring_));
+
+  // All commands are handled in one wake, in order.
+  for (i = 0; i < 4; i++) {
+    rmsg = (struct TestMsg*)cras_cmd_ring_next(ring_);
+    ASSERT_NE((void*)NULL, rmsg);
+    EXPECT_EQ(i, rmsg->seq);
+    cras_cmd_ring_complete(ring_, rmsg->value);
+  }
+  EXPECT_EQ((void*)NULL, cras_cmd_ring_next(ring_));
+  EXPECT_EQ(0, done_count);
+
+  cras_cmd_ring_reap(ring_);
+  EXPECT_EQ(4, done_count);
+  EXPECT_EQ(3, last_done_seq);
+  EXPECT_EQ(13, last_done_rc);
+
+  // The consumer found the ring empty, so the next post rings again.
+  EXPECT_EQ(0, cras_cmd_ring_post(ring_, &msg, sizeof(msg), NULL));
+  EXPECT_EQ(1, DoorbellPending(ring_));
+}
+
+TEST_F(CmdRingTestSuite, DestroyReapsCompleted) {
+  struct cras_cmd_ring* ring = cras_cmd_ring_create();
+  struct TestMsg msg = {0, 5};
+
+  ASSERT_NE((void*)NULL, ring);
+  EXPECT_EQ(0, cras_cmd_ring_post(ring, &msg, sizeof(msg), TestDone));
+  msg.seq = 1;
+  EXPECT_EQ(0, cras_cmd_ring_post(ring, &msg, sizeof(msg), TestDone));
+  ASSERT_NE((void*)NULL, cras_cmd_ring_next(ring));
+  cras_cmd_ring_complete(ring, 7);
+
+  // The completed command gets its callback, the other one is dropped.
+  cras_cmd_ring_destroy(ring);
+  EXPECT_EQ(1, done_count);
+  EXPECT_EQ(0, last_done_seq);
+  EXPECT_EQ(7, last_done_rc);
+}
+
+TEST_F(CmdRingTestSuite, PostWhileDrainingSkipsDoorbell) {
+  struct TestMsg msg = {0, 1};
+
+  EXPECT_EQ(0, cras_cmd_ring_post(ring_, &msg, sizeof(msg), NULL));
+  cras_cmd_ring_ack_doorbell(ring_);
+  ASSERT_NE((void*)NULL, cras_cmd_ring_next(ring_));
+  cras_cmd_ring_complete(ring_, 0);
+
+  // Posted before the consumer came back to an empty ring.
+  msg.seq = 1;
+  EXPECT_EQ(0, cras_cmd_ring_post(ring_, &msg, sizeof(msg), NULL));
+  EXPECT_EQ(0, DoorbellPending(ring_));
+  ASSERT_NE((void*)NULL, cras_cmd_ring_next(ring_));
+  cras_cmd_ring_complete(ring_, 0);
+  EXPECT_EQ((void*)NULL, cras_cmd_ring_next(ring_));
+}
+
+TEST_F(CmdRingTestSuite, CallAndPostFromOtherThread) {
+  struct TestMsg msg;
+  pthread_t tid;
+  unsigned int i;
+  int rc;
+
+  ASSERT_EQ(0, pthread_create(&tid, NULL, ConsumerThread, ring_));
+
+  for (i = 0; i < 20000; i++) {
+    msg.seq = i;
+    msg.value = i;
+    if (i % 100) {
+      // More than a ring's worth of async posts between calls.
+      ASSERT_EQ(0, cras_cmd_ring_post(ring_, &msg, sizeof(msg), TestDone));
+      continue;
+    }
+    rc = cras_cmd_ring_call(ring_, &msg, sizeof(msg));
+    ASSERT_EQ((int)i, rc);
+    EXPECT_EQ((int)i * 2, msg.value);
+  }
+
+  msg.seq = i;
+  msg.value = -1;
+  EXPECT_EQ(-1, cras_cmd_ring_call(ring_, &msg, sizeof(msg)));
+  pthread_join(tid, NULL);
+
+  // Every async post before the last call has been reaped.
+  EXPECT_EQ(i - i / 100, done_count);
+  EXPECT_EQ(i - 1, last_done_seq);
+  EXPECT_EQ((int)i - 1, last_done_rc);
+}
+
+}  //  namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -700,11 +700,14 @@ int audio_thread_rm_stream(audio_thread* thread, cras_rstream* stream) {
 void audio_thread_add_output_dev(struct audio_thread* thread,
                                  struct cras_iodev* odev) {}
 
-int audio_thread_dump_thread_info(struct audio_thread* thread,
-                                  struct audio_debug_info* info) {
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info* info) {
   return 0;
 }
 
+int audio_thread_latency_read(struct audio_thread_latency_stats* stats) {
+  return -ENODEV;
+}
+
 int audio_thread_suspend(struct audio_thread* thread) {
   return 0;
 }
@@ -713,16 +716,14 @@ int audio_thread_resume(struct audio_thread* thread) {
   return 0;
 }
 
-int audio_thread_config_global_remix(struct audio_thread* thread,
-                                     unsigned int num_channels,
-                                     const float* coefficient) {
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+                                        const float* coefficient) {
   return 0;
 }
 
-int audio_thread_set_aec_dump(struct audio_thread* thread,
-                              cras_stream_id_t stream_id,
-                              unsigned int start,
-                              int fd) {
+int cras_iodev_list_set_aec_dump(cras_stream_id_t stream_id,
+                                 unsigned int start,
+                                 int fd) {
   return 0;
 }
 
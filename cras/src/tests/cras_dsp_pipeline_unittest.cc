@@ -4,6 +4,7 @@
 
 #include "cras_dsp_pipeline.h"
 
+#include <errno.h>
 #include <gtest/gtest.h>
 
 #include "cras_config.h"
@@ -60,8 +61,13 @@ struct data {
   int deinstantiate_called;
   int free_module_called;
   int get_properties_called;
+  int fixed_point;
 };
 
+/* Whether the mock modules can run in fixed point, except the ones with
+ * the "float_only" label. */
+static int mock_fixed_point;
+
 static int instantiate(struct dsp_module* module, unsigned long sample_rate) {
   struct data* data = (struct data*)module->data;
   data->instantiate_called++;
@@ -109,11 +115,24 @@ static void run(struct dsp_module* module, unsigned long sample_count) {
   for (int i = 0; i < std::min(data->nr_in_audio, data->nr_out_audio); i++) {
     int from = data->in_audio[i];
     int to = data->out_audio[i];
+    if (data->fixed_point) {
+      int32_t* in = (int32_t*)data->data_location[from];
+      int32_t* out = (int32_t*)data->data_location[to];
+      for (unsigned int j = 0; j < sample_count; j++)
+        out[j] = in[j] * 2;
+      continue;
+    }
     for (unsigned int j = 0; j < sample_count; j++)
       data->data_location[to][j] = data->data_location[from][j] * 2;
   }
 }
 
+static int set_fixed_point(struct dsp_module* module) {
+  struct data* data = (struct data*)module->data;
+  data->fixed_point = 1;
+  return 0;
+}
+
 static void deinstantiate(struct dsp_module* module) {
   struct data* data = (struct data*)module->data;
   data->deinstantiate_called++;
@@ -176,6 +195,8 @@ static struct dsp_module* create_mock_module(struct plugin* plugin) {
   module->free_module = &free_module;
   module->get_properties = &get_properties;
   module->dump = &dump;
+  if (mock_fixed_point && strcmp(plugin->label, "float_only") != 0)
+    module->set_fixed_point = &set_fixed_point;
   return module;
 }
 
@@ -212,6 +233,7 @@ class DspPipelineTestSuite : public testing::Test {
  protected:
   virtual void SetUp() {
     num_modules = 0;
+    mock_fixed_point = 0;
     strcpy(filename, FILENAME_TEMPLATE);
     int fd = mkstemp(filename);
     fp = fdopen(fd, "w");
@@ -477,6 +499,22 @@ TEST_F(DspPipelineTestSuite, Complex) {
   ASSERT_EQ(1, d5->run_called);
   ASSERT_EQ(100, d5->sample_count);
 
+  /* The same data flow on planar float samples. */
+  float left[100], right[100];
+  float* bufs[2] = {left, right};
+  for (int i = 0; i < 100; i++) {
+    left[i] = i;
+    right[i] = -i;
+  }
+  ASSERT_EQ(0, cras_dsp_pipeline_apply_float(p, bufs, 2, 100));
+  for (int i = 0; i < 100; i++) {
+    EXPECT_FLOAT_EQ(4 * i, left[i]);
+    EXPECT_FLOAT_EQ(-4 * i, right[i]);
+  }
+  ASSERT_EQ(2, d5->run_called);
+  ASSERT_EQ(-EINVAL, cras_dsp_pipeline_apply_float(p, bufs, 1, 100));
+  ASSERT_EQ(0, cras_dsp_pipeline_apply_float(NULL, bufs, 2, 100));
+
   /* Expect the sink module "m5" is set. */
   cras_dsp_pipeline_set_sink_ext_module(p, &ext_mod);
   struct data* d = (struct data*)cras_dsp_module_set_sink_ext_module_val->data;
@@ -510,6 +548,345 @@ TEST_F(DspPipelineTestSuite, Complex) {
   really_free_module(m5);
 }
 
+TEST_F(DspPipelineTestSuite, InPlaceTiles) {
+  /*
+   *   0 ==(a0, a1)== 1 ==(b0, b1)== 2 ==(c0, c1)== 3
+   */
+  const char* content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "output_0={a0}\n"
+      "output_1={a1}\n"
+      "[M1]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "input_0={a1}\n"
+      "input_1={a0}\n"
+      "output_2={b0}\n"
+      "output_3={b1}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "input_0={b0}\n"
+      "input_1={b1}\n"
+      "output_2={c0}\n"
+      "output_3={c1}\n"
+      "[M3]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={c0}\n"
+      "input_1={c1}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+  struct ini* ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+  struct pipeline* p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  ASSERT_EQ(4, num_modules);
+
+  struct data* d0 = (struct data*)find_module("m0")->data;
+  struct data* d1 = (struct data*)find_module("m1")->data;
+  struct data* d2 = (struct data*)find_module("m2")->data;
+
+  /* Each output takes over the buffer of the input at the same position,
+   * even when the inputs come in a different order. */
+  ASSERT_EQ(2, cras_dsp_pipeline_get_peak_audio_buffers(p));
+  EXPECT_EQ(d0->data_location[1], d1->data_location[2]);
+  EXPECT_EQ(d0->data_location[0], d1->data_location[3]);
+  EXPECT_EQ(d2->data_location[0], d2->data_location[2]);
+  EXPECT_EQ(d2->data_location[1], d2->data_location[3]);
+
+  EXPECT_EQ(DSP_BUFFER_SIZE, cras_dsp_pipeline_get_tile_frames(p));
+  cras_dsp_pipeline_set_tile_frames(p, 0);
+  EXPECT_EQ(1, cras_dsp_pipeline_get_tile_frames(p));
+  cras_dsp_pipeline_set_tile_frames(p, 64);
+  EXPECT_EQ(64, cras_dsp_pipeline_get_tile_frames(p));
+
+  cras_dsp_pipeline_set_profile(p, 1);
+
+  /* 100 frames run through the whole pipeline in two tiles. */
+  int16_t samples[200];
+  fill_test_data(samples, 200);
+  ASSERT_EQ(0, cras_dsp_pipeline_apply(p, (uint8_t*)samples,
+                                       SND_PCM_FORMAT_S16_LE, 100));
+  /* The channels are swapped by M1, so the data from the right channel of
+   * frame n ends up in the left one. */
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ((2 * i + 1) * 4, samples[2 * i]);
+    EXPECT_EQ(2 * i * 4, samples[2 * i + 1]);
+  }
+  EXPECT_EQ(2, d1->run_called);
+  EXPECT_EQ(2, d2->run_called);
+  EXPECT_EQ(36, d2->sample_count);
+
+  int64_t total_time, total_samples;
+  cras_dsp_pipeline_get_statistic(p, &total_time, &total_samples);
+  EXPECT_EQ(100, total_samples);
+  EXPECT_LE(0, total_time);
+
+  /* Each instance has its own time. */
+  struct dsp_instance_statistic stat;
+  ASSERT_EQ(4, cras_dsp_pipeline_get_num_instances(p));
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, i, &stat));
+    EXPECT_EQ(i, stat.title[1] - '0');
+    EXPECT_LE(0, stat.total_time);
+    EXPECT_GE(total_time, stat.total_time);
+    EXPECT_EQ(100, stat.total_frames);
+    EXPECT_EQ(0, stat.optional);
+  }
+  EXPECT_EQ(-EINVAL, cras_dsp_pipeline_get_instance_statistic(p, 4, &stat));
+
+  cras_dsp_pipeline_free(p);
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
+TEST_F(DspPipelineTestSuite, CpuBudget) {
+  /*
+   *   0 ==(a0, a1)== eq ==(b0, b1)== 2 ==(c0, c1)== 3
+   *
+   * Both eq and 2 are optional, but 2 has a delay so it can't be bypassed.
+   */
+  const char* content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "cpu_budget=100\n"
+      "output_0={a0}\n"
+      "output_1={a1}\n"
+      "[EQ]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "optional=1\n"
+      "input_0={a0}\n"
+      "input_1={a1}\n"
+      "output_2={b0}\n"
+      "output_3={b1}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "optional=1\n"
+      "input_0={b0}\n"
+      "input_1={b1}\n"
+      "output_2={c0}\n"
+      "output_3={c1}\n"
+      "[M3]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={c0}\n"
+      "input_1={c1}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+  struct ini* ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+  struct pipeline* p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  ASSERT_EQ(4, num_modules);
+
+  struct data* deq = (struct data*)find_module("eq")->data;
+  struct data* d2 = (struct data*)find_module("m2")->data;
+  struct dsp_instance_statistic stat;
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_STREQ("eq", stat.title);
+  EXPECT_EQ(1, stat.optional);
+  EXPECT_EQ(0, stat.bypassed);
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 2, &stat));
+  EXPECT_EQ(0, stat.optional);
+
+  int16_t samples[200];
+  fill_test_data(samples, 200);
+  ASSERT_EQ(0, cras_dsp_pipeline_apply(p, (uint8_t*)samples,
+                                       SND_PCM_FORMAT_S16_LE, 100));
+  verify_processed_data(samples, 200, 2);
+  EXPECT_EQ(1, deq->run_called);
+
+  /* A block over the budget bypasses eq on the next one. */
+  struct timespec over = {1, 0};
+  cras_dsp_pipeline_add_statistic(p, &over, 100);
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_EQ(1, stat.bypassed);
+
+  fill_test_data(samples, 200);
+  ASSERT_EQ(0, cras_dsp_pipeline_apply(p, (uint8_t*)samples,
+                                       SND_PCM_FORMAT_S16_LE, 100));
+  verify_processed_data(samples, 200, 1);
+  EXPECT_EQ(1, deq->run_called);
+  EXPECT_EQ(2, d2->run_called);
+
+  /* That block was fast enough to have eq back. */
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_EQ(0, stat.bypassed);
+
+  /* No budget, nothing is bypassed. */
+  cras_dsp_pipeline_set_cpu_budget(p, 0);
+  cras_dsp_pipeline_add_statistic(p, &over, 100);
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_EQ(0, stat.bypassed);
+
+  cras_dsp_pipeline_free(p);
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
+TEST_F(DspPipelineTestSuite, CpuBudgetUnequalPorts) {
+  /*
+   *   0 ==(a0, a1)== eq ==(b0)== 3
+   *
+   * eq is optional, but it has fewer outputs than inputs so it is never
+   * bypassed.
+   */
+  const char* content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "cpu_budget=100\n"
+      "output_0={a0}\n"
+      "output_1={a1}\n"
+      "[EQ]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "optional=1\n"
+      "input_0={a0}\n"
+      "input_1={a1}\n"
+      "output_2={b0}\n"
+      "[M3]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={b0}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+  struct ini* ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+  struct pipeline* p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  ASSERT_EQ(3, num_modules);
+
+  struct data* deq = (struct data*)find_module("eq")->data;
+  struct dsp_instance_statistic stat;
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_STREQ("eq", stat.title);
+  EXPECT_EQ(0, stat.optional);
+
+  /* Over the budget, eq still runs. */
+  struct timespec over = {1, 0};
+  cras_dsp_pipeline_add_statistic(p, &over, 100);
+  cras_dsp_pipeline_run(p, 100);
+  EXPECT_EQ(1, deq->run_called);
+  ASSERT_EQ(0, cras_dsp_pipeline_get_instance_statistic(p, 1, &stat));
+  EXPECT_EQ(0, stat.bypassed);
+
+  cras_dsp_pipeline_free(p);
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
+TEST_F(DspPipelineTestSuite, FixedPoint) {
+  const char* content =
+      "[M0]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=playback\n"
+      "fixed_point=1\n"
+      "output_0={a0}\n"
+      "output_1={a1}\n"
+      "[M1]\n"
+      "library=builtin\n"
+      "label=foo\n"
+      "input_0={a0}\n"
+      "input_1={a1}\n"
+      "output_2={b0}\n"
+      "output_3={b1}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=playback\n"
+      "input_0={b0}\n"
+      "input_1={b1}\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+  cras_expr_env_install_builtins(&env);
+  cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+  struct ini* ini = cras_dsp_ini_create(filename);
+  ASSERT_TRUE(ini);
+
+  /* The mock modules can't run in fixed point by default, so the
+   * pipeline stays in float. */
+  struct pipeline* p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  EXPECT_EQ(0, cras_dsp_pipeline_is_fixed_point(p));
+  cras_dsp_pipeline_free(p);
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+  num_modules = 0;
+
+  mock_fixed_point = 1;
+  p = cras_dsp_pipeline_create(ini, &env, "playback");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(0, cras_dsp_pipeline_load(p));
+  ASSERT_EQ(0, cras_dsp_pipeline_instantiate(p, 48000));
+  EXPECT_EQ(1, cras_dsp_pipeline_is_fixed_point(p));
+  struct data* d1 = (struct data*)find_module("m1")->data;
+  EXPECT_EQ(1, d1->fixed_point);
+
+  /* The S16 samples go through the pipeline as Q28 and come back exact. */
+  int16_t samples[200];
+  fill_test_data(samples, 200);
+  ASSERT_EQ(0, cras_dsp_pipeline_apply(p, (uint8_t*)samples,
+                                       SND_PCM_FORMAT_S16_LE, 100));
+  verify_processed_data(samples, 200, 1);
+
+  /* Floats are converted to and from Q28. */
+  float left[4] = {0.25f, -0.25f, 0, 0.125f};
+  float right[4] = {0.5f, 0.75f, -0.5f, 0};
+  float* bufs[2] = {left, right};
+  ASSERT_EQ(0, cras_dsp_pipeline_apply_float(p, bufs, 2, 4));
+  EXPECT_FLOAT_EQ(0.5f, left[0]);
+  EXPECT_FLOAT_EQ(-0.5f, left[1]);
+  EXPECT_FLOAT_EQ(0.25f, left[3]);
+  EXPECT_FLOAT_EQ(-1.0f, right[2]);
+  cras_dsp_pipeline_free(p);
+
+  cras_dsp_ini_free(ini);
+  cras_expr_env_free(&env);
+  for (int i = 0; i < num_modules; i++)
+    really_free_module(modules[i]);
+}
+
 }  //  namespace
 
 int main(int argc, char** argv) {
@@ -219,6 +219,38 @@ int dev_stream_mix(struct dev_stream* dev_stream,
                    unsigned int num_to_write) {
   return 0;
 }
+int dev_stream_mix_bus(struct dev_stream* dev_stream,
+                       const struct cras_audio_format* fmt,
+                       struct cras_mix_bus* bus,
+                       unsigned int offset,
+                       unsigned int num_to_write) {
+  return 0;
+}
+void cras_mix_bus_zero(struct cras_mix_bus* bus,
+                       unsigned int offset,
+                       unsigned int frames) {}
+struct playback_conv_group* playback_conv_group_create(
+    const struct dev_stream* dev_stream,
+    unsigned int dev_frames) {
+  return NULL;
+}
+void playback_conv_group_destroy(struct playback_conv_group* group) {}
+int playback_conv_group_matches(const struct playback_conv_group* group,
+                                const struct dev_stream* dev_stream) {
+  return 0;
+}
+int dev_stream_can_share_conv(const struct dev_stream* dev_stream) {
+  return 0;
+}
+int dev_stream_mix_group(struct dev_stream* streams,
+                         struct playback_conv_group* group,
+                         const struct cras_audio_format* fmt,
+                         uint8_t* dst,
+                         struct cras_mix_bus* bus,
+                         unsigned int offset,
+                         unsigned int num_to_write) {
+  return 0;
+}
 void dev_stream_set_dev_rate(struct dev_stream* dev_stream,
                              unsigned int dev_rate,
                              double dev_rate_ratio,
@@ -240,10 +272,13 @@ int dev_stream_flush_old_audio_messages(struct dev_stream* dev_stream) {
 }
 void dev_stream_set_delay(const struct dev_stream* dev_stream,
                           unsigned int delay_frames) {}
+void capture_conv_cache_reset(struct capture_conv_cache* cache, int share) {}
+void capture_conv_cache_release(struct capture_conv_cache* cache) {}
 unsigned int dev_stream_capture(struct dev_stream* dev_stream,
                                 const struct cras_audio_area* area,
                                 unsigned int area_offset,
-                                float software_gain_scaler) {
+                                float software_gain_scaler,
+                                struct capture_conv_cache* cache) {
   dev_stream_capture_software_gain_scaler_val = software_gain_scaler;
   return 0;
 }
@@ -266,6 +301,8 @@ struct dev_stream* dev_stream_create(struct cras_rstream* stream,
                                      struct timespec* cb_ts) {
   return 0;
 }
+void audio_thread_poll_stream(struct cras_rstream* stream) {}
+void audio_thread_unpoll_stream(struct cras_rstream* stream) {}
 }  // extern "C"
 
 }  //  namespace
@@ -13,6 +13,7 @@ extern "C" {
 #include "cras_shm.h"
 #include "cras_types.h"
 #include "dev_stream.h"
+#include "utlist.h"
 }
 
 namespace {
@@ -78,6 +79,14 @@ struct mix_add_call {
   float mix_vol;
 };
 
+struct mix_bus_add_call {
+  snd_pcm_format_t fmt;
+  const uint8_t* src;
+  unsigned int offset;
+  unsigned int frames;
+  unsigned int num_called;
+};
+
 struct rstream_get_readable_call {
   struct cras_rstream* rstream;
   unsigned int offset;
@@ -94,12 +103,14 @@ static struct cras_audio_area_copy_call copy_area_call;
 static struct fmt_conv_call conv_frames_call;
 static int cras_audio_area_create_num_channels_val;
 static int cras_fmt_conversion_needed_val;
+static int cras_fmt_conv_convert_frames_called;
 static int cras_fmt_conv_set_linear_resample_rates_called;
 static float cras_fmt_conv_set_linear_resample_rates_from;
 static float cras_fmt_conv_set_linear_resample_rates_to;
 
 static unsigned int rstream_playable_frames_ret;
 static struct mix_add_call mix_add_call;
+static struct mix_bus_add_call mix_bus_add_call;
 static struct rstream_get_readable_call rstream_get_readable_call;
 static unsigned int rstream_get_readable_num;
 static uint8_t* rstream_get_readable_ptr;
@@ -138,6 +149,7 @@ class CreateSuite : public testing::Test {
     config_format_converter_from_fmt = NULL;
     config_format_converter_called = 0;
     cras_fmt_conversion_needed_val = 0;
+    cras_fmt_conv_convert_frames_called = 0;
     cras_fmt_conv_set_linear_resample_rates_called = 0;
 
     cras_rstream_audio_ready_called = 0;
@@ -250,7 +262,7 @@ class CreateSuite : public testing::Test {
 TEST_F(CreateSuite, CaptureNoSRC) {
   float software_gain_scaler = 10;
 
-  dev_stream_capture(&devstr, area, 0, software_gain_scaler);
+  dev_stream_capture(&devstr, area, 0, software_gain_scaler, NULL);
 
   EXPECT_EQ(stream_area, copy_area_call.dst);
   EXPECT_EQ(0, copy_area_call.dst_offset);
@@ -265,7 +277,7 @@ TEST_F(CreateSuite, CaptureSRCSmallConverterBuffer) {
   int nread;
 
   SetUpFmtConv(44100, 32000, kBufferFrames / 4);
-  nread = dev_stream_capture(&devstr, area, 0, software_gain_scaler);
+  nread = dev_stream_capture(&devstr, area, 0, software_gain_scaler, NULL);
 
   // |nread| is bound by small converter buffer size (kBufferFrames / 4)
   conv_buf_avail_at_input_rate = cras_frames_at_rate(
@@ -291,13 +303,42 @@ TEST_F(CreateSuite, CaptureSRCSmallConverterBuffer) {
   byte_buffer_destroy(&devstr.conv_buffer);
 }
 
+TEST_F(CreateSuite, CaptureSharesConversion) {
+  struct capture_conv_cache cache;
+  unsigned int nread;
+
+  memset(&cache, 0, sizeof(cache));
+  SetUpFmtConv(48000, 48000, kBufferFrames * 2);
+
+  // Not shared with a single stream.
+  capture_conv_cache_reset(&cache, 0);
+  nread = dev_stream_capture(&devstr, area, 0, 10, &cache);
+  EXPECT_EQ(1, cras_fmt_conv_convert_frames_called);
+  EXPECT_EQ(devstr.conv_buffer->bytes, conv_frames_call.out_buf);
+  EXPECT_EQ(1, cache.num_conversions);
+  EXPECT_EQ(0, cache.num_saved);
+
+  // The second read of the same samples copies the first conversion.
+  capture_conv_cache_reset(&cache, 1);
+  EXPECT_EQ(nread, dev_stream_capture(&devstr, area, 0, 10, &cache));
+  EXPECT_EQ(2, cras_fmt_conv_convert_frames_called);
+  EXPECT_EQ(nread, dev_stream_capture(&devstr, area, 0, 10, &cache));
+  EXPECT_EQ(2, cras_fmt_conv_convert_frames_called);
+  EXPECT_EQ(2, cache.num_conversions);
+  EXPECT_EQ(1, cache.num_saved);
+
+  capture_conv_cache_release(&cache);
+  free(devstr.conv_area);
+  byte_buffer_destroy(&devstr.conv_buffer);
+}
+
 TEST_F(CreateSuite, CaptureSRCLargeConverterBuffer) {
   float software_gain_scaler = 10;
   unsigned int stream_avail_at_input_rate;
   int nread;
 
   SetUpFmtConv(44100, 32000, kBufferFrames * 2);
-  nread = dev_stream_capture(&devstr, area, 0, software_gain_scaler);
+  nread = dev_stream_capture(&devstr, area, 0, software_gain_scaler, NULL);
 
   // Available frames at stream side is bound by cb_threshold, which
   // equals to kBufferFrames / 2.
@@ -656,6 +697,97 @@ TEST_F(CreateSuite, StreamMixNoConvTwoPass) {
   EXPECT_EQ(2, rstream_get_readable_call.num_called);
 }
 
+TEST_F(CreateSuite, StreamMixBusNoConvTwoPass) {
+  struct dev_stream dev_stream;
+  const unsigned int nfr = 100;
+  struct cras_audio_format fmt;
+
+  dev_stream.conv = NULL;
+  dev_stream.stream = reinterpret_cast<cras_rstream*>(0x5446);
+  rstream_playable_frames_ret = nfr;
+  rstream_get_readable_num = nfr / 2;
+  rstream_get_readable_ptr = reinterpret_cast<uint8_t*>(0x4000);
+  rstream_get_readable_call.num_called = 0;
+  mix_bus_add_call.num_called = 0;
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  EXPECT_EQ(nfr, dev_stream_mix_bus(&dev_stream, &fmt,
+                                    (struct cras_mix_bus*)0x6000, 10, nfr));
+  EXPECT_EQ(2, mix_bus_add_call.num_called);
+  EXPECT_EQ((uint8_t*)0x4000, mix_bus_add_call.src);
+  EXPECT_EQ(10 + nfr / 2, mix_bus_add_call.offset);
+  EXPECT_EQ(nfr / 2, mix_bus_add_call.frames);
+  EXPECT_EQ(nfr / 2, rstream_get_readable_call.offset);
+}
+
+TEST_F(CreateSuite, StreamMixBusKeepsStreamFormat) {
+  struct dev_stream dev_stream;
+  const unsigned int nfr = 100;
+  struct cras_audio_format fmt;
+
+  // The converter only changes channels and rate, the S32 samples go to the
+  // bus as they are rather than through the S16 device format.
+  out_fmt.format = SND_PCM_FORMAT_S32_LE;
+  dev_stream.conv = NULL;
+  dev_stream.stream = reinterpret_cast<cras_rstream*>(0x5446);
+  rstream_playable_frames_ret = nfr;
+  rstream_get_readable_num = nfr;
+  rstream_get_readable_ptr = reinterpret_cast<uint8_t*>(0x4000);
+  mix_bus_add_call.num_called = 0;
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  EXPECT_EQ(nfr, dev_stream_mix_bus(&dev_stream, &fmt,
+                                    (struct cras_mix_bus*)0x6000, 0, nfr));
+  EXPECT_EQ(1, mix_bus_add_call.num_called);
+  EXPECT_EQ(SND_PCM_FORMAT_S32_LE, mix_bus_add_call.fmt);
+}
+
+TEST_F(CreateSuite, StreamMixGroupConvertsOnce) {
+  struct dev_stream streams[2];
+  struct dev_stream* list = NULL;
+  struct playback_conv_group* group;
+  struct cras_audio_format fmt;
+
+  in_fmt.frame_rate = 44100;
+  out_fmt.frame_rate = 48000;
+  config_format_converter_conv = reinterpret_cast<cras_fmt_conv*>(0x33);
+  memset(streams, 0, sizeof(streams));
+  streams[0].stream = &rstream_;
+  streams[1].stream = &rstream_;
+  streams[0].conv = config_format_converter_conv;
+  streams[1].conv = config_format_converter_conv;
+
+  group = playback_conv_group_create(&streams[0], 480);
+  ASSERT_NE(group, (void*)NULL);
+  EXPECT_EQ(1, config_format_converter_called);
+  EXPECT_EQ(1, playback_conv_group_matches(group, &streams[1]));
+
+  for (int i = 0; i < 2; i++) {
+    streams[i].conv_group = group;
+    DL_APPEND(list, &streams[i]);
+  }
+  rstream_playable_frames_ret = 441;
+  rstream_get_readable_num = 441;
+  rstream_get_readable_ptr = reinterpret_cast<uint8_t*>(0x4000);
+  rstream_get_readable_call.num_called = 0;
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+
+  // Both streams are read, then mixed and converted once.
+  EXPECT_EQ(480, dev_stream_mix_group(list, group, &fmt, (uint8_t*)0x5000,
+                                      NULL, 0, 480));
+  EXPECT_EQ(2, rstream_get_readable_call.num_called);
+  EXPECT_EQ(1, cras_fmt_conv_convert_frames_called);
+  EXPECT_EQ(group->mix_buffer, conv_frames_call.in_buf);
+  EXPECT_EQ(441, conv_frames_call.in_frames);
+  EXPECT_EQ((int16_t*)0x5000, mix_add_call.dst);
+  EXPECT_EQ((int16_t*)group->conv_buffer, mix_add_call.src);
+  EXPECT_EQ(480 * 2, mix_add_call.count);
+  EXPECT_EQ(1, mix_add_call.index);
+
+  playback_conv_group_destroy(group);
+}
+
 TEST_F(CreateSuite, DevStreamFlushAudioMessages) {
   struct dev_stream* dev_stream;
   unsigned int dev_id = 9;
@@ -1191,6 +1323,7 @@ size_t cras_fmt_conv_convert_frames(struct cras_fmt_conv* conv,
                                     unsigned int* in_frames,
                                     unsigned int out_frames) {
   unsigned int ret;
+  cras_fmt_conv_convert_frames_called++;
   conv_frames_call.conv = conv;
   conv_frames_call.in_buf = in_buf;
   conv_frames_call.out_buf = out_buf;
@@ -1221,6 +1354,21 @@ void cras_mix_add(snd_pcm_format_t fmt,
   mix_add_call.mix_vol = mix_vol;
 }
 
+int cras_mix_bus_add(struct cras_mix_bus* bus,
+                     snd_pcm_format_t fmt,
+                     const uint8_t* src,
+                     unsigned int offset,
+                     unsigned int frames,
+                     int mute,
+                     float scaler) {
+  mix_bus_add_call.fmt = fmt;
+  mix_bus_add_call.src = src;
+  mix_bus_add_call.offset = offset;
+  mix_bus_add_call.frames = frames;
+  mix_bus_add_call.num_called++;
+  return 0;
+}
+
 struct cras_audio_area* cras_audio_area_create(int num_channels) {
   cras_audio_area_create_num_channels_val = num_channels;
   return NULL;
@@ -1274,6 +1422,10 @@ int cras_fmt_conversion_needed(const struct cras_fmt_conv* conv) {
   return cras_fmt_conversion_needed_val;
 }
 
+int cras_fmt_conv_has_state(const struct cras_fmt_conv* conv) {
+  return in_fmt.frame_rate != out_fmt.frame_rate;
+}
+
 void cras_fmt_conv_set_linear_resample_rates(struct cras_fmt_conv* conv,
                                              float from,
                                              float to) {
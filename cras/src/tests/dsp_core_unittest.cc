@@ -5,12 +5,21 @@
 #include <gtest/gtest.h>
 #include <math.h>
 
+#include <vector>
+
+#include "cascade.h"
+#include "cras_util.h"
 #include "crossover.h"
 #include "crossover2.h"
+#include "dcblock.h"
 #include "drc.h"
 #include "dsp_util.h"
 #include "eq.h"
 #include "eq2.h"
+#include "eq2_q31.h"
+#include "fft.h"
+#include "fir.h"
+#include "limiter.h"
 
 namespace {
 
@@ -95,6 +104,118 @@ TEST(InterleaveTest, All) {
   }
 }
 
+TEST(InterleaveTest, MultiChannel) {
+  /* Enough frames for the optimized functions and a remainder. */
+  const int FRAMES = 13;
+  const int channel_counts[] = {3, 4, 6, 8};
+
+  for (int channels : channel_counts) {
+    std::vector<int16_t> input(FRAMES * channels);
+    std::vector<float> output(FRAMES * channels);
+    std::vector<int16_t> output2(FRAMES * channels);
+    std::vector<float*> out_ptr(channels);
+
+    for (size_t i = 0; i < input.size(); i++)
+      input[i] = (int16_t)(i * 2749 - 32768);
+    input[0] = -32768;
+    input[1] = 32767;
+    for (int c = 0; c < channels; c++)
+      out_ptr[c] = &output[c * FRAMES];
+
+    dsp_util_deinterleave((uint8_t*)input.data(), out_ptr.data(), channels,
+                          SND_PCM_FORMAT_S16_LE, FRAMES);
+    for (int f = 0; f < FRAMES; f++)
+      for (int c = 0; c < channels; c++)
+        EXPECT_EQ(input[f * channels + c] / 32768.0f, out_ptr[c][f])
+            << channels << " channels, frame " << f << " channel " << c;
+
+    /* Round to nearest, and saturate out of range samples. */
+    for (int f = 0; f < FRAMES; f++)
+      for (int c = 0; c < channels; c++)
+        out_ptr[c][f] += ((f + c) % 2 ? 0.499 : -0.499) / 32768.0f;
+    out_ptr[0][0] = -2.0f;
+    out_ptr[1][0] = 2.0f;
+    dsp_util_interleave(out_ptr.data(), (uint8_t*)output2.data(), channels,
+                        SND_PCM_FORMAT_S16_LE, FRAMES);
+    for (size_t i = 0; i < input.size(); i++)
+      EXPECT_EQ(input[i], output2[i]) << channels << " channels, sample " << i;
+  }
+}
+
+TEST(InterleaveTest, Q28) {
+  const int frames = 4;
+  int16_t s16[2 * frames] = {0, 1, -1, 32767, -32768, 1000, -1000, 2};
+  int16_t s16_out[2 * frames];
+  int32_t s32[2 * frames] = {0, 1, -1, INT32_MAX, INT32_MIN, 1 << 20, 7, -7};
+  int32_t s32_out[2 * frames];
+  int32_t q28[2][frames];
+  int32_t* q28_ptr[2] = {q28[0], q28[1]};
+
+  /* S16 samples leave three bits of headroom in Q28, and come back
+   * exactly. */
+  ASSERT_EQ(0, dsp_util_deinterleave_q28((uint8_t*)s16, q28_ptr, 2,
+                                         SND_PCM_FORMAT_S16_LE, frames));
+  for (int i = 0; i < frames; i++) {
+    EXPECT_EQ(s16[2 * i] * 8192, q28[0][i]);
+    EXPECT_EQ(s16[2 * i + 1] * 8192, q28[1][i]);
+  }
+  ASSERT_EQ(0, dsp_util_interleave_q28(q28_ptr, (uint8_t*)s16_out, 2,
+                                       SND_PCM_FORMAT_S16_LE, frames));
+  EXPECT_EQ(0, memcmp(s16, s16_out, sizeof(s16)));
+
+  /* Rounds to the nearest S16 sample, and saturates what went over full
+   * scale in the headroom. */
+  q28[0][0] = 0x1000;
+  q28[1][0] = 0xfff;
+  q28[0][1] = 1 << 28;
+  q28[1][1] = -(1 << 28) - 1;
+  q28[0][2] = INT32_MAX;
+  q28[1][2] = INT32_MIN;
+  dsp_util_interleave_q28(q28_ptr, (uint8_t*)s16_out, 2,
+                          SND_PCM_FORMAT_S16_LE, 3);
+  EXPECT_EQ(1, s16_out[0]);
+  EXPECT_EQ(0, s16_out[1]);
+  EXPECT_EQ(32767, s16_out[2]);
+  EXPECT_EQ(-32768, s16_out[3]);
+  EXPECT_EQ(32767, s16_out[4]);
+  EXPECT_EQ(-32768, s16_out[5]);
+
+  /* S32 samples lose their three lowest bits. */
+  ASSERT_EQ(0, dsp_util_deinterleave_q28((uint8_t*)s32, q28_ptr, 2,
+                                         SND_PCM_FORMAT_S32_LE, frames));
+  ASSERT_EQ(0, dsp_util_interleave_q28(q28_ptr, (uint8_t*)s32_out, 2,
+                                       SND_PCM_FORMAT_S32_LE, frames));
+  for (int i = 0; i < 2 * frames; i++)
+    EXPECT_EQ(s32[i] & ~7, s32_out[i]) << i;
+
+  /* S24_LE keeps the 24 low bits, sign extended by the shift. */
+  for (int i = 0; i < 2 * frames; i++)
+    s32[i] &= 0x00ffffff;
+  ASSERT_EQ(0, dsp_util_deinterleave_q28((uint8_t*)s32, q28_ptr, 2,
+                                         SND_PCM_FORMAT_S24_LE, frames));
+  EXPECT_EQ(-32, q28[0][1]);
+  ASSERT_EQ(0, dsp_util_interleave_q28(q28_ptr, (uint8_t*)s32_out, 2,
+                                       SND_PCM_FORMAT_S24_LE, frames));
+  EXPECT_EQ(0, memcmp(s32, s32_out, sizeof(s32)));
+
+  EXPECT_EQ(-EINVAL, dsp_util_deinterleave_q28((uint8_t*)s32, q28_ptr, 2,
+                                               SND_PCM_FORMAT_U8, frames));
+
+  /* Floats over full scale fit in the headroom, and only saturate beyond
+   * it. */
+  float f[5] = {1.0f, -1.0f, 0.5f, 2.0f, 16.0f};
+  int32_t q[5];
+  dsp_util_float_to_q28(f, q, 5);
+  EXPECT_EQ(1 << 28, q[0]);
+  EXPECT_EQ(-(1 << 28), q[1]);
+  EXPECT_EQ(1 << 27, q[2]);
+  EXPECT_EQ(1 << 29, q[3]);
+  EXPECT_EQ(INT32_MAX, q[4]);
+  dsp_util_q28_to_float(q, f, 5);
+  EXPECT_FLOAT_EQ(0.5f, f[2]);
+  EXPECT_FLOAT_EQ(2.0f, f[3]);
+}
+
 TEST(EqTest, All) {
   struct eq* eq;
   size_t len = 44100;
@@ -229,6 +350,232 @@ TEST(Eq2Test, All) {
   eq2_free(eq2);
 }
 
+TEST(Eq2Test, MultiChannel) {
+  const int kChannels = 6;
+  const int len = 1000;
+  float NQ = len / 2;
+  float f_low = 10 / NQ;
+  float f_mid = 100 / NQ;
+  float f_high = 150 / NQ;
+  std::vector<std::vector<float>> multi(kChannels, std::vector<float>(len));
+  std::vector<std::vector<float>> pairs(kChannels, std::vector<float>(len));
+  float* data[kChannels];
+  struct eq2* eq2;
+
+  EXPECT_EQ((void*)NULL, eq2_new_channels(0));
+  EXPECT_EQ((void*)NULL, eq2_new_channels(EQ2_MAX_CHANNELS + 1));
+
+  for (int ch = 0; ch < kChannels; ch++) {
+    add_sine(multi[ch].data(), len, f_low, 0, 1);
+    add_sine(multi[ch].data(), len, f_high, 0, 1);
+    pairs[ch] = multi[ch];
+    data[ch] = multi[ch].data();
+  }
+
+  // Give every channel its own filters, and compare against running the
+  // same filters through stereo EQs one pair at a time.
+  eq2 = eq2_new_channels(kChannels);
+  ASSERT_NE((void*)NULL, eq2);
+  for (int ch = 0; ch < kChannels; ch++) {
+    EXPECT_EQ(0, eq2_append_biquad(eq2, ch, ch % 2 ? BQ_HIGHPASS : BQ_LOWPASS,
+                                   f_mid, 0, 0));
+    EXPECT_EQ(0, eq2_append_biquad(eq2, ch, BQ_PEAKING, f_high, 5, ch));
+  }
+  EXPECT_EQ(-1, eq2_append_biquad(eq2, kChannels, BQ_PEAKING, f_high, 5, 6));
+  eq2_process_channels(eq2, data, len);
+  eq2_free(eq2);
+
+  for (int ch = 0; ch < kChannels; ch += 2) {
+    eq2 = eq2_new();
+    for (int i = 0; i < 2; i++) {
+      eq2_append_biquad(eq2, i, i ? BQ_HIGHPASS : BQ_LOWPASS, f_mid, 0, 0);
+      eq2_append_biquad(eq2, i, BQ_PEAKING, f_high, 5, ch + i);
+    }
+    eq2_process(eq2, pairs[ch].data(), pairs[ch + 1].data(), len);
+    eq2_free(eq2);
+  }
+
+  for (int ch = 0; ch < kChannels; ch++)
+    for (int i = 0; i < len; i++)
+      ASSERT_NEAR(pairs[ch][i], multi[ch][i], 1e-5) << ch << " " << i;
+}
+
+/* Runs data through a biquad in double precision. */
+static void run_biquad_double(const struct biquad* bq,
+                              std::vector<double>* data) {
+  double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+  for (double& x : *data) {
+    double y = bq->b0 * x + bq->b1 * x1 + bq->b2 * x2 - bq->a1 * y1 -
+               bq->a2 * y2;
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    x = y;
+  }
+}
+
+TEST(Eq2Q31Test, MatchesFloat) {
+  const int kChannels = 3;
+  const int len = 48000;
+  float NQ = 24000;
+  std::vector<std::vector<float>> ref(kChannels, std::vector<float>(len));
+  std::vector<std::vector<int32_t>> fixed(kChannels,
+                                          std::vector<int32_t>(len));
+  std::vector<double> exact(len);
+  struct biquad bq;
+  float* ref_ptr[kChannels];
+  int32_t* fixed_ptr[kChannels];
+  struct eq2* eq2;
+  struct eq2_q31* eq2_q31;
+
+  EXPECT_EQ((void*)NULL, eq2_q31_new(0));
+  EXPECT_EQ((void*)NULL, eq2_q31_new(EQ2_MAX_CHANNELS + 1));
+
+  /* Sines from the bass to the treble, with some headroom for the gains. */
+  for (int ch = 0; ch < kChannels; ch++) {
+    add_sine(ref[ch].data(), len, 30 / NQ, ch, 0.1);
+    add_sine(ref[ch].data(), len, 997 / NQ, 0, 0.1);
+    add_sine(ref[ch].data(), len, 12000 / NQ, 0, 0.05);
+    dsp_util_float_to_q28(ref[ch].data(), fixed[ch].data(), len);
+    ref_ptr[ch] = ref[ch].data();
+    fixed_ptr[ch] = fixed[ch].data();
+  }
+
+  /* A low cutoff highpass has poles near z = 1, the hardest case for
+   * fixed point, and a 12dB peak needs coefficients above 2. */
+  eq2 = eq2_new_channels(kChannels);
+  eq2_q31 = eq2_q31_new(kChannels);
+  ASSERT_NE((void*)NULL, eq2_q31);
+  for (int ch = 0; ch < kChannels; ch++) {
+    EXPECT_EQ(0, eq2_append_biquad(eq2, ch, BQ_HIGHPASS, 20 / NQ, 0.7, 0));
+    EXPECT_EQ(0, eq2_q31_append_biquad(eq2_q31, ch, BQ_HIGHPASS, 20 / NQ, 0.7,
+                                       0));
+    EXPECT_EQ(0, eq2_append_biquad(eq2, ch, BQ_PEAKING, 1000 / NQ, 2, 12));
+    EXPECT_EQ(0, eq2_q31_append_biquad(eq2_q31, ch, BQ_PEAKING, 1000 / NQ, 2,
+                                       12));
+    EXPECT_EQ(0, eq2_append_biquad(eq2, ch, BQ_LOWSHELF, 200 / NQ, 0, -6));
+    EXPECT_EQ(0, eq2_q31_append_biquad(eq2_q31, ch, BQ_LOWSHELF, 200 / NQ, 0,
+                                       -6));
+  }
+  exact.assign(ref[0].begin(), ref[0].end());
+  biquad_set(&bq, BQ_HIGHPASS, 20 / NQ, 0.7, 0);
+  run_biquad_double(&bq, &exact);
+  biquad_set(&bq, BQ_PEAKING, 1000 / NQ, 2, 12);
+  run_biquad_double(&bq, &exact);
+  biquad_set(&bq, BQ_LOWSHELF, 200 / NQ, 0, -6);
+  run_biquad_double(&bq, &exact);
+  EXPECT_EQ(-1, eq2_q31_append_biquad(eq2_q31, kChannels, BQ_PEAKING,
+                                      1000 / NQ, 2, 12));
+  EXPECT_EQ(-1, eq2_q31_set_biquad(eq2_q31, 0, 3, BQ_PEAKING, 1000 / NQ, 2,
+                                   12));
+
+  for (int start = 0; start < len; start += 480) {
+    for (int ch = 0; ch < kChannels; ch++) {
+      ref_ptr[ch] = ref[ch].data() + start;
+      fixed_ptr[ch] = fixed[ch].data() + start;
+    }
+    eq2_process_channels(eq2, ref_ptr, 480);
+    eq2_q31_process(eq2_q31, fixed_ptr, 480);
+  }
+  eq2_free(eq2);
+  eq2_q31_free(eq2_q31);
+
+  /* The float output is only within about -80dB of the exact one, the Q28
+   * output within -100dB. */
+  for (int ch = 0; ch < kChannels; ch++)
+    for (int i = 0; i < len; i++)
+      ASSERT_NEAR(ref[ch][i], fixed[ch][i] / 268435456.0, 2e-4)
+          << ch << " " << i;
+  for (int i = 0; i < len; i++)
+    ASSERT_NEAR(exact[i], fixed[0][i] / 268435456.0, 1e-5) << i;
+}
+
+TEST(DcblockTest, Q31MatchesFloat) {
+  const int len = 48000;
+  std::vector<float> ref(len, 0.25f);
+  std::vector<int32_t> fixed(len);
+  struct dcblock* dcblock;
+  struct dcblock* dcblock_q31;
+
+  /* A DC offset under a sine, the offset should go away. */
+  add_sine(ref.data(), len, 1000 / 24000.0, 0, 0.5);
+  dsp_util_float_to_q28(ref.data(), fixed.data(), len);
+
+  dcblock = dcblock_new(0.995, 48000);
+  dcblock_q31 = dcblock_new(0.995, 48000);
+  for (int start = 0; start < len; start += 256) {
+    int n = std::min(256, len - start);
+    dcblock_process(dcblock, ref.data() + start, n);
+    dcblock_process_q31(dcblock_q31, fixed.data() + start, n);
+  }
+  dcblock_free(dcblock);
+  dcblock_free(dcblock_q31);
+
+  for (int i = 0; i < len; i++)
+    ASSERT_NEAR(ref[i], fixed[i] / 268435456.0, 1e-5) << i;
+  EXPECT_NEAR(0, magnitude_at(ref.data() + len / 2, len / 2, 0), 1e-3);
+}
+
+TEST(Eq2Q31Test, BoostKeepsHeadroom) {
+  const int len = 4800;
+  float NQ = 24000;
+  std::vector<float> sine(len);
+  std::vector<int16_t> in(len), out_float(len), out_fixed(len);
+  std::vector<float> ref(len);
+  std::vector<int32_t> fixed(len);
+  float* ref_ptr = ref.data();
+  int32_t* fixed_ptr = fixed.data();
+  struct eq2 *boost, *cut;
+  struct eq2_q31 *boost_q31, *cut_q31;
+  float peak = 0;
+
+  /* A near full scale sine at the center of the peak. */
+  add_sine(sine.data(), len, 1000 / NQ, 0, 0.9);
+  for (int i = 0; i < len; i++)
+    in[i] = lrintf(sine[i] * 32767);
+
+  /* Boost 6dB in one module and cut it back in the next, like an EQ
+   * followed by a volume stage. In between the samples go over full
+   * scale, which float keeps and Q28 must keep too. */
+  boost = eq2_new_channels(1);
+  cut = eq2_new_channels(1);
+  boost_q31 = eq2_q31_new(1);
+  cut_q31 = eq2_q31_new(1);
+  eq2_append_biquad(boost, 0, BQ_PEAKING, 1000 / NQ, 1, 6);
+  eq2_append_biquad(cut, 0, BQ_PEAKING, 1000 / NQ, 1, -6);
+  eq2_q31_append_biquad(boost_q31, 0, BQ_PEAKING, 1000 / NQ, 1, 6);
+  eq2_q31_append_biquad(cut_q31, 0, BQ_PEAKING, 1000 / NQ, 1, -6);
+
+  dsp_util_deinterleave((uint8_t*)in.data(), &ref_ptr, 1,
+                        SND_PCM_FORMAT_S16_LE, len);
+  ASSERT_EQ(0, dsp_util_deinterleave_q28((uint8_t*)in.data(), &fixed_ptr, 1,
+                                         SND_PCM_FORMAT_S16_LE, len));
+  eq2_process_channels(boost, &ref_ptr, len);
+  eq2_q31_process(boost_q31, &fixed_ptr, len);
+  for (int i = 0; i < len; i++) {
+    ASSERT_NEAR(ref[i], fixed[i] / 268435456.0, 1e-4) << i;
+    peak = std::max(peak, fabsf(ref[i]));
+  }
+  EXPECT_GT(peak, 1.5);
+
+  eq2_process_channels(cut, &ref_ptr, len);
+  eq2_q31_process(cut_q31, &fixed_ptr, len);
+  dsp_util_interleave(&ref_ptr, (uint8_t*)out_float.data(), 1,
+                      SND_PCM_FORMAT_S16_LE, len);
+  ASSERT_EQ(0, dsp_util_interleave_q28(&fixed_ptr, (uint8_t*)out_fixed.data(),
+                                       1, SND_PCM_FORMAT_S16_LE, len));
+  for (int i = 0; i < len; i++) {
+    ASSERT_NEAR(out_float[i], out_fixed[i], 2) << i;
+    ASSERT_NEAR(in[i], out_fixed[i], 64) << i;
+  }
+
+  eq2_free(boost);
+  eq2_free(cut);
+  eq2_q31_free(boost_q31);
+  eq2_q31_free(cut_q31);
+}
+
 TEST(CrossoverTest, All) {
   struct crossover xo;
   size_t len = 44100;
@@ -425,6 +772,391 @@ TEST(DrcTest, All) {
   free(data_right);
 }
 
+static struct drc* new_test_drc(int num_channels) {
+  struct drc* drc = drc_new(44100);
+  float f1 = 250.0 / 22050;
+  float f3 = 4000.0 / 22050;
+
+  drc->num_channels = num_channels;
+  for (int i = 0; i < 3; i++) {
+    drc_set_param(drc, i, PARAM_ENABLED, 1);
+    drc_set_param(drc, i, PARAM_THRESHOLD, -30);
+    drc_set_param(drc, i, PARAM_KNEE, 0);
+    drc_set_param(drc, i, PARAM_RATIO, 3);
+    drc_set_param(drc, i, PARAM_ATTACK, 0.02);
+    drc_set_param(drc, i, PARAM_RELEASE, 0.2);
+    drc_set_param(drc, i, PARAM_POST_GAIN, 0);
+  }
+  drc_set_param(drc, 0, PARAM_CROSSOVER_LOWER_FREQ, 0);
+  drc_set_param(drc, 1, PARAM_CROSSOVER_LOWER_FREQ, f1);
+  drc_set_param(drc, 2, PARAM_CROSSOVER_LOWER_FREQ, f3);
+  drc_init(drc);
+  return drc;
+}
+
+TEST(DrcTest, MultiChannel) {
+  // An odd count also covers the channel left over after the pairs.
+  const int kChannels = 5;
+  size_t len = 8192;
+  float NQ = 44100 / 2;
+  std::vector<float> sine(len);
+  std::vector<std::vector<float>> multi(kChannels);
+  std::vector<std::vector<float>> stereo(2);
+  float* data[kChannels];
+  float* stereo_data[2];
+  struct drc *drc, *drc2;
+
+  dsp_enable_flush_denormal_to_zero();
+  add_sine(sine.data(), len, 62.5 / NQ, 0, 1);
+  add_sine(sine.data(), len, 1000 / NQ, 0, 1);
+  add_sine(sine.data(), len, 16000 / NQ, 0, 1);
+
+  for (int ch = 0; ch < kChannels; ch++) {
+    multi[ch] = sine;
+    data[ch] = multi[ch].data();
+  }
+  for (int ch = 0; ch < 2; ch++) {
+    stereo[ch] = sine;
+    stereo_data[ch] = stereo[ch].data();
+  }
+
+  // With the same signal on every channel the linked compressor must do
+  // what the stereo one does.
+  drc = new_test_drc(kChannels);
+  drc2 = new_test_drc(2);
+  for (size_t start = 0; start < len; start += DRC_PROCESS_MAX_FRAMES) {
+    int chunk = std::min(len - start, (size_t)DRC_PROCESS_MAX_FRAMES);
+    drc_process(drc, data, chunk);
+    drc_process(drc2, stereo_data, chunk);
+    for (int ch = 0; ch < kChannels; ch++)
+      data[ch] += chunk;
+    stereo_data[0] += chunk;
+    stereo_data[1] += chunk;
+  }
+
+  // The stereo and multichannel paths may round differently, e.g. when
+  // the compiler fuses multiply-adds with -mfma, so compare relative to
+  // the peak of the input rather than to a fixed value.
+  float peak = 0;
+  for (size_t i = 0; i < len; i++)
+    peak = fmaxf(peak, fabsf(sine[i]));
+  for (int ch = 0; ch < kChannels; ch++)
+    for (size_t i = 0; i < len; i++)
+      ASSERT_NEAR(stereo[ch % 2][i], multi[ch][i], 1e-4 * peak)
+          << ch << " " << i;
+
+  drc_free(drc);
+  drc_free(drc2);
+}
+
+TEST(FftTest, MatchesDft) {
+  const int n = 64;
+  float signal[n], re[n / 2 + 1], im[n / 2 + 1], output[n];
+  struct fft* fft = fft_new(n);
+
+  ASSERT_TRUE(fft);
+  for (int i = 0; i < n; i++)
+    signal[i] = (float)(rand() % 2000 - 1000) / 1000;
+
+  fft_forward(fft, signal, re, im);
+  for (int k = 0; k <= n / 2; k++) {
+    double dft_re = 0, dft_im = 0;
+    for (int i = 0; i < n; i++) {
+      dft_re += signal[i] * cos(2 * M_PI * k * i / n);
+      dft_im -= signal[i] * sin(2 * M_PI * k * i / n);
+    }
+    EXPECT_NEAR(dft_re, re[k], 1e-4) << k;
+    EXPECT_NEAR(dft_im, im[k], 1e-4) << k;
+  }
+
+  fft_inverse(fft, re, im, output);
+  for (int i = 0; i < n; i++)
+    EXPECT_NEAR(signal[i] * n, output[i], 1e-3) << i;
+
+  EXPECT_EQ(NULL, fft_new(48));
+  fft_free(fft);
+}
+
+TEST(FirTest, MatchesDirectConvolution) {
+  const int kTaps = 300;
+  const int kBlock = 64;
+  const size_t len = 2000;
+  std::vector<float> taps(kTaps);
+  std::vector<float> input(len), data(len);
+  struct fir* fir;
+
+  for (int i = 0; i < kTaps; i++)
+    taps[i] = (float)(rand() % 2000 - 1000) / 1000 / kTaps;
+  for (size_t i = 0; i < len; i++)
+    input[i] = data[i] = (float)(rand() % 2000 - 1000) / 1000;
+
+  fir = fir_new(taps.data(), kTaps, kBlock);
+  ASSERT_TRUE(fir);
+  EXPECT_EQ(kBlock, fir_get_delay(fir));
+
+  // Chunks not aligned to the blocks.
+  for (size_t start = 0; start < len; start += 37)
+    fir_process(fir, data.data() + start, std::min(len - start, (size_t)37));
+
+  for (size_t i = 0; i < len; i++) {
+    double expected = 0;
+    for (int k = 0; k < kTaps; k++)
+      if (i >= (size_t)(kBlock + k))
+        expected += taps[k] * input[i - kBlock - k];
+    ASSERT_NEAR(expected, data[i], 1e-5) << i;
+  }
+
+  fir_free(fir);
+
+  EXPECT_EQ(NULL, fir_new(taps.data(), kTaps, 100));
+  EXPECT_EQ(NULL, fir_new(taps.data(), 0, kBlock));
+}
+
+TEST(LimiterTest, BelowCeiling) {
+  const size_t len = 4800;
+  std::vector<float> input(len), data(len);
+  float* ptr = data.data();
+  struct limiter* limiter = limiter_new(1, 48000, 0.005);
+  int delay;
+
+  ASSERT_TRUE(limiter);
+  limiter_set_params(limiter, -1, 0.05);
+  delay = limiter_get_delay(limiter);
+  EXPECT_EQ(240 + 5, delay);
+
+  add_sine(input.data(), len, 1000 / 24000.0, 0, 0.5);
+  data = input;
+  limiter_process(limiter, &ptr, len);
+
+  // Quiet audio is only delayed.
+  for (size_t i = 0; i < len; i++) {
+    float expected = i < (size_t)delay ? 0 : input[i - delay];
+    ASSERT_FLOAT_EQ(expected, data[i]) << i;
+  }
+  limiter_free(limiter);
+}
+
+TEST(LimiterTest, IntersamplePeaks) {
+  const int kChannels = 2;
+  const size_t len = 9600;
+  const float ceiling = powf(10, -1 / 20.0);
+  std::vector<std::vector<float>> data(kChannels, std::vector<float>(len));
+  float* ptrs[kChannels];
+  struct limiter* limiter = limiter_new(kChannels, 48000, 0.002);
+
+  ASSERT_TRUE(limiter);
+  limiter_set_params(limiter, -1, 0.05);
+
+  // A quarter of the sample rate, sampled 45 degrees off its peaks. The
+  // samples are at 0.707 of the true peak, so they are below the ceiling
+  // although the waveform is well above it.
+  add_sine(data[0].data(), len, 0.5, M_PI / 4, 1.3);
+  // A few clipped samples on the other channel.
+  for (size_t i = 3000; i < len; i += 1000)
+    data[1][i] = 2;
+  for (int ch = 0; ch < kChannels; ch++)
+    ptrs[ch] = data[ch].data();
+
+  for (size_t start = 0; start < len; start += 100) {
+    limiter_process(limiter, ptrs, 100);
+    for (int ch = 0; ch < kChannels; ch++)
+      ptrs[ch] += 100;
+  }
+
+  for (int ch = 0; ch < kChannels; ch++)
+    for (size_t i = 0; i < len; i++)
+      ASSERT_LE(fabsf(data[ch][i]), ceiling) << ch << " " << i;
+
+  // Once settled and before the clipped samples, the true peak of the sine
+  // is at the ceiling.
+  float peak = 0;
+  for (size_t i = 1000; i < 2900; i++)
+    peak = std::max(peak, fabsf(data[0][i]));
+  EXPECT_NEAR(ceiling * M_SQRT1_2, peak, 0.02);
+
+  limiter_free(limiter);
+}
+
+TEST(LimiterTest, DecayingRamp) {
+  const size_t len = 4800;
+  const float ceiling = powf(10, -1 / 20.0);
+  std::vector<float> data(len);
+  float* ptr = data.data();
+  struct limiter* limiter = limiter_new(1, 48000, 0.001);
+
+  ASSERT_TRUE(limiter);
+  // No release, so the gain follows the sliding minimum directly.
+  limiter_set_params(limiter, -1, 0);
+
+  // Every frame is over the ceiling by less than the one before, so the
+  // gain it needs rises on every frame and none of them drop out of the
+  // sliding minimum before they expire.
+  for (size_t i = 0; i < len; i++)
+    data[i] = 4.0f - 2.5f * i / len;
+  limiter_process(limiter, &ptr, len);
+
+  // The gain is held from the louder frames still in the delay line, so
+  // the output stays under the ceiling without being clipped to it.
+  for (size_t i = limiter_get_delay(limiter); i < len; i++)
+    ASSERT_LT(data[i], ceiling) << i;
+
+  limiter_free(limiter);
+}
+
+// The CPU flags of each cascade kernel the CPU supports.
+static std::vector<unsigned int> cascade_kernels() {
+  std::vector<unsigned int> flags = {0};
+  if (__builtin_cpu_supports("avx2"))
+    flags.push_back(CPU_X86_AVX2);
+  return flags;
+}
+
+static void cascade_matches_eq2(unsigned int cpu_flags) {
+  // More channels than the lanes of a vector, and channels with different
+  // numbers of biquads.
+  const int kChannels = 6;
+  const size_t len = 4096;
+  float NQ = 44100 / 2;
+  std::vector<std::vector<float>> a(kChannels), b(kChannels);
+  float* pa[kChannels];
+  float* pb[kChannels];
+  struct cascade* cascade;
+  struct eq2* eq2 = eq2_new_channels(kChannels);
+
+  cascade_init(cpu_flags);
+  cascade = cascade_new(kChannels);
+  cascade_init(0);
+  ASSERT_TRUE(cascade);
+  for (int ch = 0; ch < kChannels; ch++) {
+    for (int i = 0; i <= ch; i++) {
+      float freq = (200 + 700 * i + 50 * ch) / NQ;
+      float gain = (i % 2) ? 6 : -8;
+      ASSERT_EQ(0, cascade_append_biquad(cascade, ch, BQ_PEAKING, freq, 2,
+                                         gain));
+      eq2_append_biquad(eq2, ch, BQ_PEAKING, freq, 2, gain);
+    }
+    a[ch].resize(len);
+    add_sine(a[ch].data(), len, (100 + 300 * ch) / NQ, 0, 0.5);
+    add_sine(a[ch].data(), len, (2500 + 100 * ch) / NQ, 0, 0.3);
+    b[ch] = a[ch];
+    pa[ch] = a[ch].data();
+    pb[ch] = b[ch].data();
+  }
+
+  cascade_process(cascade, pa, len);
+  eq2_process_channels(eq2, pb, len);
+
+  for (int ch = 0; ch < kChannels; ch++)
+    for (size_t i = 0; i < len; i++)
+      ASSERT_NEAR(b[ch][i], a[ch][i], 1e-4)
+          << cpu_flags << " " << ch << " " << i;
+
+  EXPECT_EQ(-1, cascade_set_biquad(cascade, 0, 1, BQ_NONE, 0, 0, 0));
+  cascade_free(cascade);
+  eq2_free(eq2);
+}
+
+TEST(CascadeTest, MatchesEq2) {
+  for (unsigned int cpu_flags : cascade_kernels())
+    cascade_matches_eq2(cpu_flags);
+}
+
+static void cascade_ramp_matches_scalar(unsigned int cpu_flags) {
+  // Every channel ramps to a new biquad, so all the lanes move at once.
+  const int kChannels = CASCADE_MAX_CHANNELS;
+  const size_t len = 1024;
+  // A multiple of the frames the cascade processes at once, so it lands
+  // on the new biquads on the same frame as the reference below.
+  const int kRamp = 256;
+  std::vector<std::vector<float>> a(kChannels), b(kChannels);
+  float* pa[kChannels];
+  struct cascade* cascade;
+
+  cascade_init(cpu_flags);
+  cascade = cascade_new(kChannels);
+  cascade_init(0);
+  ASSERT_TRUE(cascade);
+  cascade_set_ramp(cascade, kRamp);
+  for (int ch = 0; ch < kChannels; ch++) {
+    cascade_append_biquad(cascade, ch, BQ_LOWPASS, 0.3 + 0.05 * ch, 0, 0);
+    a[ch].resize(len);
+    add_sine(a[ch].data(), len, 0.01 + 0.02 * ch, 0, 0.5);
+    b[ch] = a[ch];
+    pa[ch] = a[ch].data();
+  }
+  cascade_process(cascade, pa, 100);
+  for (int ch = 0; ch < kChannels; ch++) {
+    cascade_set_biquad(cascade, ch, 0, BQ_HIGHPASS, 0.01 + 0.01 * ch, 0, 0);
+    pa[ch] = a[ch].data() + 100;
+  }
+  cascade_process(cascade, pa, len - 100);
+
+  // The same ramp one channel and one frame at a time.
+  for (int ch = 0; ch < kChannels; ch++) {
+    struct biquad from, to;
+    float c[5], step[5];
+    float z1 = 0, z2 = 0;
+
+    biquad_set(&from, BQ_LOWPASS, 0.3 + 0.05 * ch, 0, 0);
+    biquad_set(&to, BQ_HIGHPASS, 0.01 + 0.01 * ch, 0, 0);
+    float f[5] = {from.b0, from.b1, from.b2, from.a1, from.a2};
+    float t[5] = {to.b0, to.b1, to.b2, to.a1, to.a2};
+    for (int k = 0; k < 5; k++) {
+      c[k] = f[k];
+      step[k] = (t[k] - f[k]) * (1.0f / kRamp);
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (i >= 100 && i < 100 + kRamp)
+        for (int k = 0; k < 5; k++)
+          c[k] += step[k];
+      if (i == 100 + kRamp)
+        for (int k = 0; k < 5; k++)
+          c[k] = t[k];
+      float x = b[ch][i];
+      float y = c[0] * x + z1;
+      z1 = c[1] * x - c[3] * y + z2;
+      z2 = c[2] * x - c[4] * y;
+      ASSERT_NEAR(y, a[ch][i], 1e-4) << cpu_flags << " " << ch << " " << i;
+    }
+  }
+
+  cascade_free(cascade);
+}
+
+TEST(CascadeTest, RampMatchesScalar) {
+  for (unsigned int cpu_flags : cascade_kernels())
+    cascade_ramp_matches_scalar(cpu_flags);
+}
+
+TEST(CascadeTest, Ramp) {
+  const size_t len = 2048;
+  const int kRamp = 480;
+  std::vector<float> data(len, 1.0f);
+  float* ptr = data.data();
+  struct cascade* cascade = cascade_new(1);
+
+  // A low shelf up to nearly the Nyquist frequency scales DC by its gain.
+  cascade_append_biquad(cascade, 0, BQ_NONE, 0, 0, 0);
+  cascade_set_ramp(cascade, kRamp);
+  cascade_process(cascade, &ptr, 256);
+  EXPECT_FLOAT_EQ(1.0f, data[255]);
+
+  cascade_set_biquad(cascade, 0, 0, BQ_LOWSHELF, 0.99, 0, -6);
+  cascade_process(cascade, &ptr, 0);
+  for (size_t start = 256; start < len; start += 100) {
+    ptr = data.data() + start;
+    cascade_process(cascade, &ptr, std::min(len - start, (size_t)100));
+  }
+
+  // The gain moves in small steps instead of jumping.
+  for (size_t i = 257; i < len; i++)
+    ASSERT_LT(fabsf(data[i] - data[i - 1]), 0.01) << i;
+  EXPECT_GT(data[256 + kRamp / 2], 0.55);
+  EXPECT_NEAR(powf(10, -6 / 20.0), data[len - 1], 1e-3);
+
+  cascade_free(cascade);
+}
+
 }  //  namespace
 
 int main(int argc, char** argv) {
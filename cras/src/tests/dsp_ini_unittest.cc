@@ -57,6 +57,7 @@ TEST_F(DspIniTestSuite, OneSimplePlugin) {
   fprintf(fp, "library=foo.so\n");
   fprintf(fp, "label=bar\n");
   fprintf(fp, "disable=\"#f\"\n");
+  fprintf(fp, "file=/path/to/data\n");
   CloseFile();
 
   struct ini* ini = cras_dsp_ini_create(filename);
@@ -67,6 +68,7 @@ TEST_F(DspIniTestSuite, OneSimplePlugin) {
   EXPECT_STREQ("test", plugin->title);
   EXPECT_STREQ("foo.so", plugin->library);
   EXPECT_STREQ("bar", plugin->label);
+  EXPECT_STREQ("/path/to/data", plugin->file);
   EXPECT_TRUE(plugin->disable_expr);
   EXPECT_EQ(0, ARRAY_COUNT(&plugin->ports));
 
@@ -89,6 +91,28 @@ TEST_F(DspIniTestSuite, BuiltinPlugin) {
   EXPECT_EQ(0, ARRAY_COUNT(&ini->flows));
   EXPECT_STREQ(ARRAY_ELEMENT(&ini->plugins, 0)->purpose, "playback");
   EXPECT_STREQ(ARRAY_ELEMENT(&ini->plugins, 1)->purpose, "capture");
+  EXPECT_EQ(NULL, ARRAY_ELEMENT(&ini->plugins, 0)->file);
+  cras_dsp_ini_free(ini);
+}
+
+TEST_F(DspIniTestSuite, CpuBudget) {
+  fprintf(fp, "[foo]\n");
+  fprintf(fp, "library=builtin\n");
+  fprintf(fp, "label=source\n");
+  fprintf(fp, "purpose=playback\n");
+  fprintf(fp, "cpu_budget=2.5\n");
+  fprintf(fp, "[bar]\n");
+  fprintf(fp, "library=builtin\n");
+  fprintf(fp, "label=eq2\n");
+  fprintf(fp, "optional=1\n");
+  CloseFile();
+
+  struct ini* ini = cras_dsp_ini_create(filename);
+  EXPECT_EQ(2, ARRAY_COUNT(&ini->plugins));
+  EXPECT_FLOAT_EQ(2.5, ARRAY_ELEMENT(&ini->plugins, 0)->cpu_budget);
+  EXPECT_EQ(0, ARRAY_ELEMENT(&ini->plugins, 0)->optional);
+  EXPECT_FLOAT_EQ(0, ARRAY_ELEMENT(&ini->plugins, 1)->cpu_budget);
+  EXPECT_EQ(1, ARRAY_ELEMENT(&ini->plugins, 1)->optional);
   cras_dsp_ini_free(ini);
 }
 
@@ -0,0 +1,121 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the time a dsp pipeline takes per frame, for a range of tile
+ * sizes. The pipeline is built from a dsp.ini file the same way the server
+ * builds it, and the time comes from the statistic the pipeline keeps.
+ *
+ * Usage: dsp_pipeline_bench <dsp.ini> [purpose] [dsp_name]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cras_dsp_ini.h"
+#include "cras_dsp_pipeline.h"
+#include "cras_expr.h"
+
+#define BENCH_FRAMES 480
+#define BENCH_RATE 48000
+#define MIN_BENCH_SECONDS 0.5
+
+static const int tile_frames[] = { DSP_BUFFER_SIZE, 512, 256, 128, 64, 32 };
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* Returns the nanoseconds per frame the pipeline takes, running it on
+ * BENCH_FRAMES frames at a time, or a negative value on error. */
+static double bench_pipeline(struct pipeline *pipeline, int16_t *buf)
+{
+	struct timespec tp1, tp2;
+	int64_t total_time, total_samples;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	do {
+		for (i = 0; i < 100; i++)
+			if (cras_dsp_pipeline_apply(pipeline, (uint8_t *)buf,
+						    SND_PCM_FORMAT_S16_LE,
+						    BENCH_FRAMES))
+				return -1;
+		clock_gettime(CLOCK_MONOTONIC, &tp2);
+	} while (tp_diff(&tp2, &tp1) < MIN_BENCH_SECONDS);
+
+	cras_dsp_pipeline_get_statistic(pipeline, &total_time, &total_samples);
+	return (double)total_time / total_samples;
+}
+
+int main(int argc, char **argv)
+{
+	struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+	const char *purpose = argc > 2 ? argv[2] : "playback";
+	const char *dsp_name = argc > 3 ? argv[3] : "";
+	struct pipeline *pipeline;
+	struct ini *ini;
+	int16_t *buf;
+	double ns;
+	unsigned int t, i;
+	int channels;
+
+	if (argc < 2) {
+		fprintf(stderr,
+			"Usage: %s <dsp.ini> [purpose] [dsp_name]\n",
+			argv[0]);
+		return 1;
+	}
+
+	ini = cras_dsp_ini_create(argv[1]);
+	if (!ini) {
+		fprintf(stderr, "Failed to read %s\n", argv[1]);
+		return 1;
+	}
+
+	cras_expr_env_install_builtins(&env);
+	cras_expr_env_set_variable_boolean(&env, "disable_eq", 0);
+	cras_expr_env_set_variable_boolean(&env, "disable_drc", 0);
+	cras_expr_env_set_variable_string(&env, "dsp_name", dsp_name);
+	cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+
+	printf("%-8s %10s %8s\n", "tile", "ns/frame", "cpu%");
+
+	for (t = 0; t < sizeof(tile_frames) / sizeof(tile_frames[0]); t++) {
+		/* A new pipeline for each tile size, so the statistic only
+		 * covers this run. */
+		pipeline = cras_dsp_pipeline_create(ini, &env, purpose);
+		if (!pipeline || cras_dsp_pipeline_load(pipeline) ||
+		    cras_dsp_pipeline_instantiate(pipeline, BENCH_RATE)) {
+			fprintf(stderr, "Failed to create the %s pipeline\n",
+				purpose);
+			return 1;
+		}
+		cras_dsp_pipeline_set_tile_frames(pipeline, tile_frames[t]);
+
+		channels = cras_dsp_pipeline_get_num_input_channels(pipeline);
+		buf = (int16_t *)malloc(BENCH_FRAMES * channels *
+					sizeof(*buf));
+		for (i = 0; i < BENCH_FRAMES * channels; i++)
+			buf[i] = rand() % 8192 - 4096;
+
+		ns = bench_pipeline(pipeline, buf);
+		if (ns < 0) {
+			fprintf(stderr, "Failed to run the pipeline\n");
+			return 1;
+		}
+		printf("%-8d %10.2f %8.3f\n", tile_frames[t], ns,
+		       ns * BENCH_RATE * 1e-7);
+
+		free(buf);
+		cras_dsp_pipeline_free(pipeline);
+	}
+
+	cras_dsp_ini_free(ini);
+	cras_expr_env_free(&env);
+	return 0;
+}
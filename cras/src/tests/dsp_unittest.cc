@@ -7,10 +7,18 @@
 #include "cras_dsp.h"
 #include "cras_dsp_module.h"
 
+extern "C" {
+#include "cras_main_message.h"
+}
+
 #define FILENAME_TEMPLATE "DspTest.XXXXXX"
 
 namespace {
 
+static cras_message_callback main_message_callback;
+static int cras_main_message_send_called;
+static int double_free_module_called;
+
 extern "C" {
 struct dsp_module* cras_dsp_module_load_ladspa(struct plugin* plugin) {
   return NULL;
@@ -41,6 +49,16 @@ class DspTestSuite : public testing::Test {
   FILE* fp;
 };
 
+static int count_instance(const char* purpose,
+                          int sample_rate,
+                          const struct dsp_instance_statistic* stat,
+                          void* arg) {
+  EXPECT_STREQ("capture", purpose);
+  EXPECT_EQ(44100, sample_rate);
+  EXPECT_EQ(0, stat->bypassed);
+  return ++*(int*)arg == 2;
+}
+
 TEST_F(DspTestSuite, Simple) {
   const char* content =
       "[M1]\n"
@@ -89,6 +107,23 @@ TEST_F(DspTestSuite, Simple) {
   cras_dsp_set_variable_string(ctx4, "variable", "foo");
   cras_dsp_reload_ini();
   ASSERT_TRUE(cras_dsp_get_pipeline(ctx4));
+  cras_dsp_put_pipeline(ctx4);
+
+  /* Readers skip the DSP instead of waiting while the pipeline is
+   * locked. */
+  pipeline = cras_dsp_lock_pipeline(ctx4);
+  ASSERT_TRUE(pipeline);
+  EXPECT_EQ(NULL, cras_dsp_get_pipeline(ctx4));
+  cras_dsp_unlock_pipeline(ctx4);
+  EXPECT_EQ(pipeline, cras_dsp_get_pipeline(ctx4));
+  cras_dsp_put_pipeline(ctx4);
+
+  /* Only ctx4 has a pipeline, with a source and a sink. The callback
+   * stops at the second one. */
+  int instances = 0;
+  EXPECT_EQ(1, cras_dsp_foreach_instance_statistic(count_instance,
+                                                   &instances));
+  EXPECT_EQ(2, instances);
 
   cras_dsp_context_free(ctx1);
   cras_dsp_context_free(ctx3);
@@ -96,6 +131,89 @@ TEST_F(DspTestSuite, Simple) {
   cras_dsp_stop();
 }
 
+TEST_F(DspTestSuite, CrossfadeReload) {
+  const char* content =
+      "[M1]\n"
+      "library=builtin\n"
+      "label=source\n"
+      "purpose=capture\n"
+      "output_0={a}\n"
+      "[M2]\n"
+      "library=builtin\n"
+      "label=double\n"
+      "purpose=capture\n"
+      "input_0={a}\n"
+      "output_1={b}\n"
+      "disable=(equal? variable \"bypass\")\n"
+      "[M3]\n"
+      "library=builtin\n"
+      "label=sink\n"
+      "purpose=capture\n"
+      "input_0={b}\n"
+      "\n";
+  fprintf(fp, "%s", content);
+  CloseFile();
+
+  float samples[200];
+  float* bufs[1] = {samples};
+  struct cras_dsp_context* ctx;
+
+  main_message_callback = NULL;
+  cras_main_message_send_called = 0;
+  double_free_module_called = 0;
+
+  cras_dsp_init(filename);
+  ASSERT_TRUE(main_message_callback);
+  ctx = cras_dsp_context_new(48000, "capture");
+  cras_dsp_set_fade_frames(ctx, 100);
+  cras_dsp_set_variable_string(ctx, "variable", "foo");
+  cras_dsp_load_pipeline(ctx);
+
+  ASSERT_TRUE(cras_dsp_get_pipeline(ctx));
+  for (int i = 0; i < 50; i++)
+    samples[i] = 1000;
+  EXPECT_EQ(0, cras_dsp_apply_float(ctx, bufs, 1, 50));
+  cras_dsp_put_pipeline(ctx);
+  for (int i = 0; i < 50; i++)
+    EXPECT_FLOAT_EQ(2000, samples[i]);
+
+  /* Setting the variables again, or one no plugin reads, keeps the
+   * pipeline. */
+  struct pipeline* pipeline = cras_dsp_get_pipeline(ctx);
+  cras_dsp_put_pipeline(ctx);
+  cras_dsp_set_variable_string(ctx, "variable", "foo");
+  cras_dsp_set_variable_boolean(ctx, "disable_eq", 1);
+  cras_dsp_load_pipeline(ctx);
+  EXPECT_EQ(pipeline, cras_dsp_get_pipeline(ctx));
+  cras_dsp_put_pipeline(ctx);
+
+  /* Reloading doesn't free the pipeline the audio thread is running. */
+  cras_dsp_set_variable_string(ctx, "variable", "bypass");
+  cras_dsp_load_pipeline(ctx);
+  EXPECT_EQ(0, double_free_module_called);
+
+  ASSERT_TRUE(cras_dsp_get_pipeline(ctx));
+  for (int i = 0; i < 200; i++)
+    samples[i] = 1000;
+  EXPECT_EQ(0, cras_dsp_apply_float(ctx, bufs, 1, 200));
+  cras_dsp_put_pipeline(ctx);
+
+  /* The output ramps from the old pipeline to the new one. */
+  for (int i = 0; i < 100; i++)
+    EXPECT_NEAR(2000 - 10 * i, samples[i], 0.01);
+  for (int i = 100; i < 200; i++)
+    EXPECT_FLOAT_EQ(1000, samples[i]);
+
+  /* Once the fade is done, the main thread frees the old pipeline. */
+  EXPECT_EQ(1, cras_main_message_send_called);
+  EXPECT_EQ(0, double_free_module_called);
+  main_message_callback(NULL, NULL);
+  EXPECT_EQ(1, double_free_module_called);
+
+  cras_dsp_context_free(ctx);
+  cras_dsp_stop();
+}
+
 static int empty_instantiate(struct dsp_module* module,
                              unsigned long sample_rate) {
   return 0;
@@ -125,6 +243,25 @@ static void empty_dump(struct dsp_module* module, struct dumper* d) {
   dumpf(d, "built-in module\n");
 }
 
+static void double_connect_port(struct dsp_module* module,
+                                unsigned long port,
+                                float* data_location) {
+  float** ports = (float**)module->data;
+  ports[port] = data_location;
+}
+
+static void double_run(struct dsp_module* module, unsigned long sample_count) {
+  float** ports = (float**)module->data;
+  for (unsigned long i = 0; i < sample_count; i++)
+    ports[1][i] = ports[0][i] * 2;
+}
+
+static void double_free_module(struct dsp_module* module) {
+  double_free_module_called++;
+  free(module->data);
+  free(module);
+}
+
 static void empty_init_module(struct dsp_module* module) {
   module->instantiate = &empty_instantiate;
   module->connect_port = &empty_connect_port;
@@ -143,10 +280,28 @@ struct dsp_module* cras_dsp_module_load_builtin(struct plugin* plugin) {
   struct dsp_module* module;
   module = (struct dsp_module*)calloc(1, sizeof(struct dsp_module));
   empty_init_module(module);
+  if (strcmp(plugin->label, "double") == 0) {
+    module->data = calloc(2, sizeof(float*));
+    module->connect_port = &double_connect_port;
+    module->run = &double_run;
+    module->free_module = &double_free_module;
+  }
   return module;
 }
 void cras_dsp_module_set_sink_ext_module(struct dsp_module* module,
                                          struct ext_dsp_module* ext_module) {}
+
+int cras_main_message_send(struct cras_main_message* msg) {
+  cras_main_message_send_called++;
+  return 0;
+}
+
+int cras_main_message_add_handler(enum CRAS_MAIN_MESSAGE_TYPE type,
+                                  cras_message_callback callback,
+                                  void* callback_data) {
+  main_message_callback = callback;
+  return 0;
+}
 }  // extern "C"
 
 int main(int argc, char** argv) {
@@ -183,7 +183,15 @@ static void expect_int(int expected,
   cras_expr_expression_eval(expr, env, &value);
   EXPECT_EQ(CRAS_EXPR_VALUE_TYPE_INT, value.type);
   EXPECT_EQ(expected, value.u.integer);
+
+  /* the compiled expression gives the same value */
+  struct cras_expr_program* prog = cras_expr_program_compile(expr);
   cras_expr_expression_free(expr);
+  cras_expr_program_eval(prog, env, &value);
+  EXPECT_EQ(CRAS_EXPR_VALUE_TYPE_INT, value.type);
+  EXPECT_EQ(expected, value.u.integer);
+  cras_expr_program_free(prog);
+  cras_expr_value_free(&value);
 }
 
 static void expect_boolean(char expected,
@@ -196,7 +204,14 @@ static void expect_boolean(char expected,
   cras_expr_expression_eval(expr, env, &value);
   EXPECT_EQ(CRAS_EXPR_VALUE_TYPE_BOOLEAN, value.type);
   EXPECT_EQ(expected, value.u.boolean);
+
+  /* the compiled expression gives the same value */
+  struct cras_expr_program* prog = cras_expr_program_compile(expr);
   cras_expr_expression_free(expr);
+  char boolean = !expected;
+  EXPECT_EQ(0, cras_expr_program_eval_boolean(prog, env, &boolean));
+  EXPECT_EQ(expected, boolean);
+  cras_expr_program_free(prog);
 }
 
 TEST(ExprTest, Builtin) {
@@ -240,6 +255,54 @@ TEST(ExprTest, Builtin) {
   cras_expr_env_free(&env);
 }
 
+TEST(ExprTest, Program) {
+  struct cras_expr_expression* expr;
+  struct cras_expr_program* prog;
+  struct cras_expr_value value = CRAS_EXPR_VALUE_INIT;
+  struct cras_expr_env env1 = CRAS_EXPR_ENV_INIT;
+  struct cras_expr_env env2 = CRAS_EXPR_ENV_INIT;
+  unsigned int serial;
+  char boolean = 0;
+
+  expr = cras_expr_expression_parse("(not (equal? a \"foo\"))");
+  prog = cras_expr_program_compile(expr);
+  cras_expr_expression_free(expr);
+  ASSERT_TRUE(prog);
+  EXPECT_EQ(NULL, cras_expr_program_compile(NULL));
+
+  /* the variable is missing, then found once it is added */
+  cras_expr_env_install_builtins(&env1);
+  cras_expr_program_eval(prog, &env1, &value);
+  EXPECT_EQ(CRAS_EXPR_VALUE_TYPE_BOOLEAN, value.type);
+  EXPECT_EQ(1, value.u.boolean);
+  cras_expr_env_set_variable_string(&env1, "a", "foo");
+  EXPECT_EQ(0, cras_expr_program_eval_boolean(prog, &env1, &boolean));
+  EXPECT_EQ(0, boolean);
+
+  /* the variables are found again in another environment */
+  cras_expr_env_set_variable_string(&env2, "a", "bar");
+  cras_expr_env_install_builtins(&env2);
+  EXPECT_EQ(0, cras_expr_program_eval_boolean(prog, &env2, &boolean));
+  EXPECT_EQ(1, boolean);
+  EXPECT_EQ(0, cras_expr_program_eval_boolean(prog, &env1, &boolean));
+  EXPECT_EQ(0, boolean);
+
+  /* only a change of a variable the program reads counts */
+  serial = cras_expr_env_get_serial(&env1);
+  cras_expr_env_set_variable_string(&env1, "a", "foo");
+  cras_expr_env_set_variable_boolean(&env1, "b", 1);
+  EXPECT_EQ(0, cras_expr_program_changed_since(prog, &env1, serial));
+  cras_expr_env_set_variable_string(&env1, "a", "bar");
+  EXPECT_EQ(1, cras_expr_program_changed_since(prog, &env1, serial));
+  EXPECT_EQ(0, cras_expr_program_changed_since(
+                   prog, &env1, cras_expr_env_get_serial(&env1)));
+
+  cras_expr_value_free(&value);
+  cras_expr_program_free(prog);
+  cras_expr_env_free(&env1);
+  cras_expr_env_free(&env2);
+}
+
 }  //  namespace
 
 int main(int argc, char** argv) {
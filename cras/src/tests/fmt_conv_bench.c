@@ -0,0 +1,154 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the throughput of the format converter, in input frames per
+ * second, over the sample format, channel count and rate conversions covered
+ * by fmt_conv_unittest.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cras_fmt_conv.h"
+
+#define BENCH_FRAMES 480
+#define BENCH_MAX_CHANNELS 6
+#define MIN_BENCH_SECONDS 0.2
+
+static const struct {
+	const char *name;
+	snd_pcm_format_t fmt;
+} formats[] = {
+	{ "U8", SND_PCM_FORMAT_U8 },
+	{ "S16_LE", SND_PCM_FORMAT_S16_LE },
+	{ "S24_3LE", SND_PCM_FORMAT_S24_3LE },
+	{ "S24_LE", SND_PCM_FORMAT_S24_LE },
+	{ "S32_LE", SND_PCM_FORMAT_S32_LE },
+};
+
+static const struct {
+	size_t in_channels;
+	size_t out_channels;
+} channel_pairs[] = {
+	{ 2, 2 }, { 1, 2 }, { 2, 1 }, { 2, 6 }, { 6, 2 }, { 2, 4 }, { 4, 2 },
+};
+
+static const struct {
+	size_t in_rate;
+	size_t out_rate;
+} rate_pairs[] = {
+	{ 48000, 48000 },
+	{ 44100, 48000 },
+	{ 96000, 48000 },
+};
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+static void set_format(struct cras_audio_format *fmt, snd_pcm_format_t format,
+		       size_t num_channels, size_t rate)
+{
+	unsigned int i;
+
+	fmt->format = format;
+	fmt->num_channels = num_channels;
+	fmt->frame_rate = rate;
+	for (i = 0; i < CRAS_CH_MAX; i++)
+		fmt->channel_layout[i] = -1;
+}
+
+/* Returns input frames per second converted by conv, BENCH_FRAMES at a
+ * time. */
+static double bench_conv(struct cras_fmt_conv *conv, const uint8_t *in,
+			 uint8_t *out, size_t out_frames)
+{
+	struct timespec tp1, tp2;
+	unsigned long frames = 0;
+	unsigned int in_frames;
+	unsigned int i;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	do {
+		for (i = 0; i < 100; i++) {
+			in_frames = BENCH_FRAMES;
+			cras_fmt_conv_convert_frames(conv, in, out, &in_frames,
+						     out_frames);
+			frames += in_frames;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tp2);
+		elapsed = tp_diff(&tp2, &tp1);
+	} while (elapsed < MIN_BENCH_SECONDS);
+
+	return frames / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	struct cras_audio_format in_fmt, out_fmt;
+	struct cras_fmt_conv *conv;
+	unsigned int f_in, f_out, c, r, i;
+	size_t max_frames, out_frames, bytes;
+	uint8_t *in, *out;
+
+	max_frames = 4 * BENCH_FRAMES;
+	bytes = max_frames * BENCH_MAX_CHANNELS * 4;
+	in = (uint8_t *)malloc(bytes);
+	out = (uint8_t *)malloc(bytes);
+	for (i = 0; i < bytes; i++)
+		in[i] = rand();
+
+	printf("%-8s %-8s %-6s %-12s %10s\n", "in", "out", "ch", "rate",
+	       "Mframes/s");
+
+	for (f_in = 0; f_in < sizeof(formats) / sizeof(formats[0]); f_in++) {
+		for (f_out = 0; f_out < sizeof(formats) / sizeof(formats[0]);
+		     f_out++) {
+			for (c = 0;
+			     c < sizeof(channel_pairs) / sizeof(channel_pairs[0]);
+			     c++) {
+				for (r = 0;
+				     r < sizeof(rate_pairs) / sizeof(rate_pairs[0]);
+				     r++) {
+					set_format(&in_fmt, formats[f_in].fmt,
+						   channel_pairs[c].in_channels,
+						   rate_pairs[r].in_rate);
+					set_format(&out_fmt, formats[f_out].fmt,
+						   channel_pairs[c].out_channels,
+						   rate_pairs[r].out_rate);
+					conv = cras_fmt_conv_create(
+						&in_fmt, &out_fmt, max_frames, 0);
+					if (!conv) {
+						fprintf(stderr,
+							"Failed to create converter\n");
+						return 1;
+					}
+					out_frames = cras_fmt_conv_in_frames_to_out(
+						conv, BENCH_FRAMES);
+
+					printf("%-8s %-8s %zu->%-3zu %zu->%-6zu %10.1f\n",
+					       formats[f_in].name,
+					       formats[f_out].name,
+					       in_fmt.num_channels,
+					       out_fmt.num_channels,
+					       in_fmt.frame_rate / 1000,
+					       out_fmt.frame_rate / 1000,
+					       bench_conv(conv, in, out,
+							  out_frames) /
+						       1e6);
+					cras_fmt_conv_destroy(&conv);
+				}
+			}
+		}
+	}
+
+	free(in);
+	free(out);
+	return 0;
+}
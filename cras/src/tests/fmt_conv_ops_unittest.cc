@@ -85,6 +85,15 @@ static int16_t S16AddAndClip(int16_t a, int16_t b) {
   return sum;
 }
 
+static int32_t S32AddAndClip(int32_t a, int32_t b) {
+  int64_t sum;
+
+  sum = (int64_t)a + (int64_t)b;
+  sum = MAX(sum, INT_MIN);
+  sum = MIN(sum, INT_MAX);
+  return sum;
+}
+
 // Test U8 to S16_LE conversion.
 TEST(FormatConverterOpsTest, ConvertU8ToS16LE) {
   const size_t frames = 4096;
@@ -676,6 +685,236 @@ TEST(FormatConverterOpsTest, ConvertChannelsS16LE) {
   }
 }
 
+// Test U8 to S32_LE conversion.
+TEST(FormatConverterOpsTest, ConvertU8ToS32LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  U8Ptr src = CreateU8(frames * in_ch);
+  S32LEPtr dst = CreateS32LE(frames * in_ch);
+
+  convert_u8_to_s32le(src.get(), frames * in_ch, (uint8_t*)dst.get());
+
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ((int32_t)((uint32_t)((int32_t)src[i] - 0x80) << 24), dst[i]);
+  }
+}
+
+// Test S24_3LE to S32_LE conversion.
+TEST(FormatConverterOpsTest, ConvertS243LEToS32LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  S243LEPtr src = CreateS243LE(frames * in_ch);
+  S32LEPtr dst = CreateS32LE(frames * in_ch);
+
+  convert_s243le_to_s32le(src.get(), frames * in_ch, (uint8_t*)dst.get());
+
+  uint8_t* p = src.get();
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ((int32_t)((uint32_t)ToS243LE(p) << 8), dst[i]);
+    p += 3;
+  }
+}
+
+// Test S24_LE to S32_LE conversion.
+TEST(FormatConverterOpsTest, ConvertS24LEToS32LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  S24LEPtr src = CreateS24LE(frames * in_ch);
+  S32LEPtr dst = CreateS32LE(frames * in_ch);
+
+  convert_s24le_to_s32le((uint8_t*)src.get(), frames * in_ch,
+                         (uint8_t*)dst.get());
+
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ((int32_t)((uint32_t)src[i] << 8), dst[i]);
+  }
+}
+
+// Test S32_LE to U8 conversion.
+TEST(FormatConverterOpsTest, ConvertS32LEToU8) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  S32LEPtr src = CreateS32LE(frames * in_ch);
+  U8Ptr dst = CreateU8(frames * in_ch);
+
+  convert_s32le_to_u8((uint8_t*)src.get(), frames * in_ch, dst.get());
+
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ((uint8_t)((src[i] >> 24) + 128), dst[i]);
+  }
+}
+
+// Test S32_LE to S24_3LE conversion.
+TEST(FormatConverterOpsTest, ConvertS32LEToS243LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  S32LEPtr src = CreateS32LE(frames * in_ch);
+  S243LEPtr dst = CreateS243LE(frames * in_ch);
+
+  convert_s32le_to_s243le((uint8_t*)src.get(), frames * in_ch, dst.get());
+
+  uint8_t* p = dst.get();
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ((src[i] >> 8) & 0x00ffffff, ToS243LE(p));
+    p += 3;
+  }
+}
+
+// Test S32_LE to S24_LE conversion.
+TEST(FormatConverterOpsTest, ConvertS32LEToS24LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 2;
+
+  S32LEPtr src = CreateS32LE(frames * in_ch);
+  S24LEPtr dst = CreateS24LE(frames * in_ch);
+
+  convert_s32le_to_s24le((uint8_t*)src.get(), frames * in_ch,
+                         (uint8_t*)dst.get());
+
+  for (size_t i = 0; i < frames * in_ch; ++i) {
+    EXPECT_EQ(src[i] >> 8, dst[i]);
+  }
+}
+
+// Test Mono to Stereo conversion.  S32_LE.
+TEST(FormatConverterOpsTest, MonoToStereoS32LE) {
+  const size_t frames = 4096;
+
+  S32LEPtr src = CreateS32LE(frames);
+  S32LEPtr dst = CreateS32LE(frames * 2);
+
+  size_t ret =
+      s32_mono_to_stereo((uint8_t*)src.get(), frames, (uint8_t*)dst.get());
+  EXPECT_EQ(ret, frames);
+
+  for (size_t i = 0; i < frames; ++i) {
+    EXPECT_EQ(src[i], dst[i * 2 + 0]);
+    EXPECT_EQ(src[i], dst[i * 2 + 1]);
+  }
+}
+
+// Test Stereo to Mono mix keeps all 32 bits and clips.  S32_LE.
+TEST(FormatConverterOpsTest, StereoToMonoS32LE) {
+  const size_t frames = 4096;
+
+  S32LEPtr src = CreateS32LE(frames * 2);
+  S32LEPtr dst = CreateS32LE(frames);
+  src[0] = 13450 << 16;
+  src[1] = -(13450 << 16) + 1;
+  src[2] = INT_MAX - 1;
+  src[3] = 2;
+  src[4] = INT_MIN + 1;
+  src[5] = -2;
+
+  size_t ret =
+      s32_stereo_to_mono((uint8_t*)src.get(), frames, (uint8_t*)dst.get());
+  EXPECT_EQ(ret, frames);
+
+  EXPECT_EQ(1, dst[0]);
+  EXPECT_EQ(INT_MAX, dst[1]);
+  EXPECT_EQ(INT_MIN, dst[2]);
+  for (size_t i = 0; i < frames; ++i) {
+    EXPECT_EQ(S32AddAndClip(src[i * 2], src[i * 2 + 1]), dst[i]);
+  }
+}
+
+// Test 5.1 to Stereo mix.  S32_LE.
+TEST(FormatConverterOpsTest, _51ToStereoS32LE) {
+  const size_t frames = 4096;
+  const size_t in_ch = 6;
+  const size_t out_ch = 2;
+  const size_t left = 0;
+  const size_t right = 1;
+  const size_t center = 4;
+
+  S32LEPtr src = CreateS32LE(frames * in_ch);
+  S32LEPtr dst = CreateS32LE(frames * out_ch);
+
+  size_t ret =
+      s32_51_to_stereo((uint8_t*)src.get(), frames, (uint8_t*)dst.get());
+  EXPECT_EQ(ret, frames);
+
+  for (size_t i = 0; i < frames; ++i) {
+    int32_t half_center = src[i * 6 + center] / 2;
+    EXPECT_EQ(S32AddAndClip(src[i * 6 + left], half_center),
+              dst[i * 2 + left]);
+    EXPECT_EQ(S32AddAndClip(src[i * 6 + right], half_center),
+              dst[i * 2 + right]);
+  }
+}
+
+// Test fused S16_LE mono to S32_LE and S24_LE stereo match the two step
+// conversion.
+TEST(FormatConverterOpsTest, FusedS16LEMonoToS32LEStereo) {
+  const size_t frames = 4096;
+
+  S16LEPtr src = CreateS16LE(frames);
+  S32LEPtr mid = CreateS32LE(frames);
+  S32LEPtr exp = CreateS32LE(frames * 2);
+  S32LEPtr exp24 = CreateS32LE(frames * 2);
+  S32LEPtr dst = CreateS32LE(frames * 2);
+
+  convert_s16le_to_s32le((uint8_t*)src.get(), frames, (uint8_t*)mid.get());
+  s32_mono_to_stereo((uint8_t*)mid.get(), frames, (uint8_t*)exp.get());
+  convert_s32le_to_s24le((uint8_t*)exp.get(), frames * 2,
+                         (uint8_t*)exp24.get());
+
+  size_t ret = s16le_mono_to_s32le_stereo((uint8_t*)src.get(), frames,
+                                          (uint8_t*)dst.get(), 16);
+  EXPECT_EQ(ret, frames);
+  for (size_t i = 0; i < frames * 2; ++i)
+    EXPECT_EQ(exp[i], dst[i]);
+
+  s16le_mono_to_s32le_stereo((uint8_t*)src.get(), frames, (uint8_t*)dst.get(),
+                             8);
+  for (size_t i = 0; i < frames * 2; ++i)
+    EXPECT_EQ(exp24[i], dst[i]);
+}
+
+// Test fused S32_LE stereo to S16_LE mono matches the two step conversion.
+TEST(FormatConverterOpsTest, FusedS32LEStereoToS16LEMono) {
+  const size_t frames = 4096;
+
+  S32LEPtr src = CreateS32LE(frames * 2);
+  S32LEPtr mid = CreateS32LE(frames);
+  S16LEPtr exp = CreateS16LE(frames);
+  S16LEPtr dst = CreateS16LE(frames);
+
+  s32_stereo_to_mono((uint8_t*)src.get(), frames, (uint8_t*)mid.get());
+  convert_s32le_to_s16le((uint8_t*)mid.get(), frames, (uint8_t*)exp.get());
+
+  size_t ret = s32le_stereo_to_s16le_mono((uint8_t*)src.get(), frames,
+                                          (uint8_t*)dst.get());
+  EXPECT_EQ(ret, frames);
+  for (size_t i = 0; i < frames; ++i)
+    EXPECT_EQ(exp[i], dst[i]);
+}
+
+// Test fused S32_LE 5.1 to S16_LE stereo matches the two step conversion.
+TEST(FormatConverterOpsTest, FusedS32LE51ToS16LEStereo) {
+  const size_t frames = 4096;
+
+  S32LEPtr src = CreateS32LE(frames * 6);
+  S32LEPtr mid = CreateS32LE(frames * 2);
+  S16LEPtr exp = CreateS16LE(frames * 2);
+  S16LEPtr dst = CreateS16LE(frames * 2);
+
+  s32_51_to_stereo((uint8_t*)src.get(), frames, (uint8_t*)mid.get());
+  convert_s32le_to_s16le((uint8_t*)mid.get(), frames * 2,
+                         (uint8_t*)exp.get());
+
+  size_t ret = s32le_51_to_s16le_stereo((uint8_t*)src.get(), frames,
+                                        (uint8_t*)dst.get());
+  EXPECT_EQ(ret, frames);
+  for (size_t i = 0; i < frames * 2; ++i)
+    EXPECT_EQ(exp[i], dst[i]);
+}
+
 extern "C" {}  // extern "C"
 
 int main(int argc, char** argv) {
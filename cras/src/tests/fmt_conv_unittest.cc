@@ -25,7 +25,7 @@ static int quad_channel_layout[CRAS_CH_MAX] = {0,  1,  2,  3,  -1, -1,
 static int linear_resampler_needed_val;
 static double linear_resampler_ratio = 1.0;
 static unsigned int linear_resampler_num_channels;
-static unsigned int linear_resampler_format_bytes;
+static snd_pcm_format_t linear_resampler_format;
 static int linear_resampler_src_rate;
 static int linear_resampler_dst_rate;
 
@@ -342,16 +342,15 @@ TEST(FormatConverterTest, StereoToMono24bit) {
 
     in_buff = (int32_t*)malloc(buf_size * cras_get_format_bytes(&in_fmt));
     out_buff = (int32_t*)malloc(buf_size * cras_get_format_bytes(&out_fmt));
-    // TODO(dgreid) - s/0x10000/1/ once it stays full bits the whole way.
     for (i = 0; i < buf_size; i++) {
       in_buff[i * 2] = 13450 << 16;
-      in_buff[i * 2 + 1] = -in_buff[i * 2] + 0x10000;
+      in_buff[i * 2 + 1] = -in_buff[i * 2] + 1;
     }
     out_frames = cras_fmt_conv_convert_frames(
         c, (uint8_t*)in_buff, (uint8_t*)out_buff, &in_buf_size, buf_size);
     EXPECT_EQ(buf_size, out_frames);
     for (i = 0; i < buf_size; i++) {
-      EXPECT_EQ(0x10000, out_buff[i]);
+      EXPECT_EQ(1, out_buff[i]);
     }
 
     cras_fmt_conv_destroy(&c);
@@ -360,6 +359,93 @@ TEST(FormatConverterTest, StereoToMono24bit) {
   }
 }
 
+// Test the bits below the top 16 make it through SRC.
+TEST(FormatConverterTest, S24LEKeepsLowBitsThroughSRC) {
+  struct cras_fmt_conv* c;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+
+  size_t out_frames;
+  int32_t* in_buff;
+  int32_t* out_buff;
+  const size_t buf_size = 4096;
+  unsigned int in_buf_size = 2048;
+  unsigned int low_bits = 0;
+  unsigned int i;
+
+  ResetStub();
+  in_fmt.format = SND_PCM_FORMAT_S24_LE;
+  out_fmt.format = SND_PCM_FORMAT_S24_LE;
+  in_fmt.num_channels = 2;
+  out_fmt.num_channels = 2;
+  in_fmt.frame_rate = 44100;
+  out_fmt.frame_rate = 48000;
+
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  ASSERT_NE(c, (void*)NULL);
+
+  out_frames = cras_fmt_conv_in_frames_to_out(c, in_buf_size);
+  in_buff = (int32_t*)malloc(in_buf_size * cras_get_format_bytes(&in_fmt));
+  out_buff = (int32_t*)malloc(out_frames * cras_get_format_bytes(&out_fmt));
+  for (i = 0; i < in_buf_size * 2; i++)
+    in_buff[i] = (rand() & 0xffff) - 0x8000;
+  out_frames = cras_fmt_conv_convert_frames(
+      c, (uint8_t*)in_buff, (uint8_t*)out_buff, &in_buf_size, out_frames);
+  EXPECT_GT(out_frames, 0);
+
+  // Resampling through S16_LE would leave the low byte zero.
+  for (i = 0; i < out_frames * 2; i++)
+    low_bits |= out_buff[i] & 0xff;
+  EXPECT_NE(0, low_bits);
+
+  cras_fmt_conv_destroy(&c);
+  free(in_buff);
+  free(out_buff);
+}
+
+// Test converting more frames than fit in a block of the stages without SRC.
+TEST(FormatConverterTest, ConvertU8StereoToS24LEMonoInBlocks) {
+  struct cras_fmt_conv* c;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+
+  size_t out_frames;
+  uint8_t* in_buff;
+  int32_t* out_buff;
+  const size_t buf_size = 1000;
+  unsigned int in_buf_size = 1000;
+  unsigned int i;
+
+  ResetStub();
+  in_fmt.format = SND_PCM_FORMAT_U8;
+  out_fmt.format = SND_PCM_FORMAT_S24_LE;
+  in_fmt.num_channels = 2;
+  out_fmt.num_channels = 1;
+  in_fmt.frame_rate = 48000;
+  out_fmt.frame_rate = 48000;
+
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, buf_size, 0);
+  ASSERT_NE(c, (void*)NULL);
+
+  in_buff = (uint8_t*)ralloc(buf_size * cras_get_format_bytes(&in_fmt));
+  out_buff = (int32_t*)malloc(buf_size * cras_get_format_bytes(&out_fmt));
+  out_frames = cras_fmt_conv_convert_frames(
+      c, (uint8_t*)in_buff, (uint8_t*)out_buff, &in_buf_size, buf_size);
+  EXPECT_EQ(buf_size, out_frames);
+  EXPECT_EQ(buf_size, in_buf_size);
+
+  for (i = 0; i < buf_size; i++) {
+    int64_t sum = ((int64_t)in_buff[i * 2] - 0x80 + in_buff[i * 2 + 1] - 0x80)
+                  << 24;
+    sum = MIN(MAX(sum, INT32_MIN), INT32_MAX);
+    EXPECT_EQ((int32_t)sum >> 8, out_buff[i]);
+  }
+
+  cras_fmt_conv_destroy(&c);
+  free(in_buff);
+  free(out_buff);
+}
+
 // Test 5.1 to Stereo mix.
 TEST(FormatConverterTest, SurroundToStereo) {
   struct cras_fmt_conv* c;
@@ -1501,6 +1587,47 @@ TEST(FormatConverterTest, Convert96to48PostLinearResample) {
   free(out_buff);
 }
 
+// Test the linear resampler works on the samples it is given.
+TEST(FormatConverterTest, LinearResamplerFormat) {
+  struct cras_fmt_conv* c;
+  struct cras_audio_format in_fmt;
+  struct cras_audio_format out_fmt;
+
+  ResetStub();
+  in_fmt.format = SND_PCM_FORMAT_S32_LE;
+  out_fmt.format = SND_PCM_FORMAT_S24_LE;
+  in_fmt.num_channels = out_fmt.num_channels = 2;
+  in_fmt.frame_rate = out_fmt.frame_rate = 48000;
+
+  // Pre linear resample runs on the input samples.
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 1);
+  ASSERT_NE(c, (void*)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S32_LE, linear_resampler_format);
+  cras_fmt_conv_destroy(&c);
+
+  // Post linear resample runs on S32_LE samples before converting to the
+  // output, as there are more than 16 bits to keep.
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 0);
+  ASSERT_NE(c, (void*)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S32_LE, linear_resampler_format);
+  cras_fmt_conv_destroy(&c);
+
+  // Unsupported input formats fall back to post linear resample.
+  in_fmt.format = SND_PCM_FORMAT_S24_3LE;
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 1);
+  ASSERT_NE(c, (void*)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S32_LE, linear_resampler_format);
+  cras_fmt_conv_destroy(&c);
+
+  // Formats of 16 bits or less are resampled as S16_LE.
+  in_fmt.format = SND_PCM_FORMAT_U8;
+  out_fmt.format = SND_PCM_FORMAT_S16_LE;
+  c = cras_fmt_conv_create(&in_fmt, &out_fmt, 4096, 1);
+  ASSERT_NE(c, (void*)NULL);
+  EXPECT_EQ(SND_PCM_FORMAT_S16_LE, linear_resampler_format);
+  cras_fmt_conv_destroy(&c);
+}
+
 // Test format converter created in config_format_converter
 TEST(FormatConverterTest, ConfigConverter) {
   int i;
@@ -1649,10 +1776,12 @@ float** cras_channel_conv_matrix_create(const struct cras_audio_format* in,
   return cras_channel_conv_matrix_alloc(in->num_channels, out->num_channels);
 }
 struct linear_resampler* linear_resampler_create(unsigned int num_channels,
-                                                 unsigned int format_bytes,
+                                                 snd_pcm_format_t format,
                                                  float src_rate,
                                                  float dst_rate) {
-  linear_resampler_format_bytes = format_bytes;
+  if (format == SND_PCM_FORMAT_U8 || format == SND_PCM_FORMAT_S24_3LE)
+    return NULL;
+  linear_resampler_format = format;
   linear_resampler_num_channels = num_channels;
   linear_resampler_src_rate = src_rate;
   linear_resampler_dst_rate = dst_rate;
@@ -1693,8 +1822,9 @@ unsigned int linear_resampler_resample(struct linear_resampler* lr,
     resampled_fr = dst_frames;
     *src_frames = dst_frames / linear_resampler_ratio;
   }
-  unsigned int resampled_bytes = resampled_fr * linear_resampler_format_bytes *
-                                 linear_resampler_num_channels;
+  unsigned int resampled_bytes =
+      resampled_fr * snd_pcm_format_physical_width(linear_resampler_format) /
+      8 * linear_resampler_num_channels;
   for (size_t i = 0; i < resampled_bytes; i++)
     dst[i] = (uint8_t)rand() & 0xff;
 
@@ -18,14 +18,17 @@ static cras_audio_format format;
 static int cras_msbc_plc_create_called;
 static int cras_msbc_plc_handle_good_frames_called;
 static int cras_msbc_plc_handle_bad_frames_called;
+static int hfp_batched_sco_io_val;
 
 static thread_callback thread_cb;
 static void* cb_data;
+static struct audio_thread* rm_callback_sync_thread;
 static timespec ts;
 
 void ResetStubData() {
   sbc_codec_stub_reset();
   cras_msbc_plc_create_called = 0;
+  hfp_batched_sco_io_val = 0;
 
   format.format = SND_PCM_FORMAT_S16_LE;
   format.num_channels = 1;
@@ -76,7 +79,7 @@ TEST(HfpInfo, AcquirePlaybackBuffer) {
   info = hfp_info_create(HFP_CODEC_ID_CVSD);
   ASSERT_NE(info, (void*)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, NULL, info);
   dev.direction = CRAS_STREAM_OUTPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -124,7 +127,7 @@ TEST(HfpInfo, AcquireCaptureBuffer) {
   info = hfp_info_create(HFP_CODEC_ID_CVSD);
   ASSERT_NE(info, (void*)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, NULL, info);
   dev.direction = CRAS_STREAM_INPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -173,7 +176,7 @@ TEST(HfpInfo, HfpReadWriteFD) {
   ASSERT_NE(info, (void*)NULL);
 
   dev.direction = CRAS_STREAM_INPUT;
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, NULL, info);
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
   /* Mock the sco fd and send some fake data */
@@ -223,7 +226,7 @@ TEST(HfpInfo, StartHfpInfo) {
   info = hfp_info_create(HFP_CODEC_ID_CVSD);
   ASSERT_NE(info, (void*)NULL);
 
-  hfp_info_start(sock[0], 48, info);
+  hfp_info_start(sock[0], 48, NULL, info);
   ASSERT_EQ(1, hfp_info_running(info));
   ASSERT_EQ(cb_data, (void*)info);
 
@@ -234,6 +237,26 @@ TEST(HfpInfo, StartHfpInfo) {
   hfp_info_destroy(info);
 }
 
+TEST(HfpInfo, StopRemovesCallbackFromStartThread) {
+  struct audio_thread* thread = reinterpret_cast<struct audio_thread*>(0x77);
+  int sock[2];
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create(HFP_CODEC_ID_CVSD);
+  ASSERT_NE(info, (void*)NULL);
+
+  /* The device starting hfp_info may be on another thread than the one
+   * closing it last, the callback is removed where it was added. */
+  rm_callback_sync_thread = NULL;
+  hfp_info_start(sock[0], 48, thread, info);
+  hfp_info_stop(info);
+  EXPECT_EQ(thread, rm_callback_sync_thread);
+
+  close(sock[1]);
+  hfp_info_destroy(info);
+}
+
 TEST(HfpInfo, StartHfpInfoAndRead) {
   int rc;
   int sock[2];
@@ -247,7 +270,7 @@ TEST(HfpInfo, StartHfpInfoAndRead) {
   ASSERT_NE(info, (void*)NULL);
 
   /* Start and send two chunk of fake data */
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, NULL, info);
   send(sock[0], sample, 48, 0);
   send(sock[0], sample, 48, 0);
 
@@ -291,7 +314,7 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   info = hfp_info_create(HFP_CODEC_ID_CVSD);
   ASSERT_NE(info, (void*)NULL);
 
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, NULL, info);
   send(sock[0], sample, 48, 0);
   send(sock[0], sample, 48, 0);
 
@@ -340,12 +363,17 @@ void send_mSBC_packet(int fd, unsigned seq, int broken_pkt) {
       0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77, 0x6d,
       0xb6, 0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77,
       0x6d, 0xb6, 0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6c};
+  uint8_t pkt[HCI_SCO_PKT_SIZE];
+
   if (broken_pkt)
     sco_header[1] = 0x11;
 
-  send(fd, sco_header, 3, 0);
-  send(fd, headers[seq % 4], 3, 0);
-  send(fd, zero_frame, 57, 0);
+  /* Send the packet in one piece, so it is one message on a seqpacket
+   * socket like it is on a SCO socket. */
+  memcpy(pkt, sco_header, 3);
+  memcpy(pkt + 3, headers[seq % 4], 3);
+  memcpy(pkt + 6, zero_frame, 57);
+  send(fd, pkt, sizeof(pkt), 0);
 }
 
 TEST(HfpInfo, StartHfpInfoAndReadMsbc) {
@@ -365,7 +393,7 @@ TEST(HfpInfo, StartHfpInfoAndReadMsbc) {
   ASSERT_EQ(1, cras_msbc_plc_create_called);
 
   /* Start and send an mSBC packets with all zero samples */
-  hfp_info_start(sock[1], 63, info);
+  hfp_info_start(sock[1], 63, NULL, info);
   send_mSBC_packet(sock[0], pkt_count++, 0);
 
   /* Trigger thread callback */
@@ -454,7 +482,7 @@ TEST(HfpInfo, StartHfpInfoAndWriteMsbc) {
   info = hfp_info_create(HFP_CODEC_ID_MSBC);
   ASSERT_NE(info, (void*)NULL);
 
-  hfp_info_start(sock[1], 63, info);
+  hfp_info_start(sock[1], 63, NULL, info);
   send(sock[0], sample, 63, 0);
 
   /* Trigger thread callback */
@@ -480,12 +508,164 @@ TEST(HfpInfo, StartHfpInfoAndWriteMsbc) {
   hfp_info_destroy(info);
 }
 
+TEST(HfpInfo, BatchedReadWrite) {
+  int sock[2];
+  uint8_t sample[480];
+  uint8_t* buf;
+  unsigned int avail;
+  struct cras_iodev idev, odev;
+
+  ResetStubData();
+  hfp_batched_sco_io_val = 1;
+
+  /* Seqpacket keeps the message boundaries of a SCO socket. */
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create(HFP_CODEC_ID_CVSD);
+  ASSERT_NE(info, (void*)NULL);
+
+  idev.direction = CRAS_STREAM_INPUT;
+  idev.format = &format;
+  odev.direction = CRAS_STREAM_OUTPUT;
+  odev.format = &format;
+
+  /* The adapter sends 48 byte packets though the MTU is 60. */
+  hfp_info_start(sock[1], 60, NULL, info);
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &idev));
+  for (int i = 0; i < 3; i++) {
+    memset(sample, i + 1, 48);
+    send(sock[0], sample, 48, 0);
+  }
+
+  /* All three packets are read in one callback, back to back. */
+  thread_cb((struct hfp_info*)cb_data);
+  EXPECT_EQ(48, info->packet_size);
+  ASSERT_EQ(3 * 48 / 2, hfp_buf_queued(info, &idev));
+  buf = buf_read_pointer_size(info->capture_buf, &avail);
+  for (int i = 0; i < 3 * 48; i++)
+    ASSERT_EQ(i / 48 + 1, buf[i]) << "at " << i;
+
+  /* And as many zero packets are written without an odev. */
+  for (int i = 0; i < 3; i++)
+    ASSERT_EQ(48, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ(-1, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+
+  /* With playback samples queued, one packet goes out per packet read. */
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &odev));
+  buf_increment_write(info->playback_buf, 480);
+  send(sock[0], sample, 48, 0);
+  send(sock[0], sample, 48, 0);
+  thread_cb((struct hfp_info*)cb_data);
+  for (int i = 0; i < 2; i++)
+    ASSERT_EQ(48, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ(-1, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ((480 - 2 * 48) / 2, hfp_buf_queued(info, &odev));
+  ASSERT_EQ(5 * 48 / 2, hfp_buf_queued(info, &idev));
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  close(sock[0]);
+}
+
+TEST(HfpInfo, BatchedWriteAcrossWrap) {
+  int sock[2];
+  uint8_t sample[480];
+  uint8_t* buf;
+  unsigned int avail, start;
+  struct cras_iodev odev;
+
+  ResetStubData();
+  hfp_batched_sco_io_val = 1;
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create(HFP_CODEC_ID_CVSD);
+  ASSERT_NE(info, (void*)NULL);
+
+  odev.direction = CRAS_STREAM_OUTPUT;
+  odev.format = &format;
+  hfp_info_start(sock[1], 48, NULL, info);
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &odev));
+
+  /* Leave 72 bytes before the end of the ring, the second packet
+   * straddles the wrap and the third starts after it. */
+  start = info->playback_buf->used_size - 72;
+  buf_increment_write(info->playback_buf, start);
+  buf_increment_read(info->playback_buf, start);
+  for (int i = 0; i < 3 * 48; i++) {
+    buf = buf_write_pointer_size(info->playback_buf, &avail);
+    buf[0] = i;
+    buf_increment_write(info->playback_buf, 1);
+  }
+
+  for (int i = 0; i < 3; i++)
+    send(sock[0], sample, 48, 0);
+  thread_cb((struct hfp_info*)cb_data);
+
+  /* Exactly as many packets go out as were read, in ring order. */
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(48, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+    for (int j = 0; j < 48; j++)
+      ASSERT_EQ((uint8_t)(i * 48 + j), sample[j]) << "at " << i * 48 + j;
+  }
+  ASSERT_EQ(-1, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ(0, hfp_buf_queued(info, &odev));
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  close(sock[0]);
+}
+
+TEST(HfpInfo, BatchedReadWriteMsbc) {
+  int sock[2];
+  uint8_t sample[480];
+  struct cras_iodev idev;
+
+  ResetStubData();
+  hfp_batched_sco_io_val = 1;
+  cras_msbc_plc_handle_good_frames_called = 0;
+  cras_msbc_plc_handle_bad_frames_called = 0;
+  set_sbc_codec_decoded_out(MSBC_CODE_SIZE);
+  set_sbc_codec_encoded_out(57);
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create(HFP_CODEC_ID_MSBC);
+  ASSERT_NE(info, (void*)NULL);
+
+  idev.direction = CRAS_STREAM_INPUT;
+  idev.format = &format;
+  hfp_info_start(sock[1], 63, NULL, info);
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &idev));
+
+  /* Packet 2 is lost, 3 is decoded after it is concealed. */
+  send_mSBC_packet(sock[0], 0, 0);
+  send_mSBC_packet(sock[0], 1, 0);
+  send_mSBC_packet(sock[0], 3, 0);
+  thread_cb((struct hfp_info*)cb_data);
+
+  EXPECT_EQ(3, cras_msbc_plc_handle_good_frames_called);
+  EXPECT_EQ(1, cras_msbc_plc_handle_bad_frames_called);
+  ASSERT_EQ(4 * MSBC_CODE_SIZE / 2, hfp_buf_queued(info, &idev));
+
+  /* One mSBC packet is written for each of the three read. */
+  for (int i = 0; i < 3; i++)
+    ASSERT_EQ(MSBC_PKT_SIZE,
+              recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ(-1, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  EXPECT_EQ(3, info->msbc_num_out_frames);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  close(sock[0]);
+}
+
 }  // namespace
 
 extern "C" {
 
-struct audio_thread* cras_iodev_list_get_audio_thread() {
-  return NULL;
+int cras_system_get_hfp_batched_sco_io() {
+  return hfp_batched_sco_io_val;
 }
 
 void audio_thread_add_callback(int fd, thread_callback cb, void* data) {
@@ -495,6 +675,7 @@ void audio_thread_add_callback(int fd, thread_callback cb, void* data) {
 }
 
 int audio_thread_rm_callback_sync(struct audio_thread* thread, int fd) {
+  rm_callback_sync_thread = thread;
   thread_cb = NULL;
   cb_data = NULL;
   return 0;
@@ -35,6 +35,7 @@ static size_t hfp_info_has_iodev_called;
 static int hfp_info_has_iodev_return_val;
 static size_t hfp_info_start_called;
 static size_t hfp_info_stop_called;
+static struct audio_thread* hfp_info_start_thread;
 static size_t hfp_buf_acquire_called;
 static unsigned hfp_buf_acquire_return_val;
 static size_t hfp_buf_release_called;
@@ -63,6 +64,7 @@ void ResetStubData() {
   hfp_info_has_iodev_return_val = 0;
   hfp_info_start_called = 0;
   hfp_info_stop_called = 0;
+  hfp_info_start_thread = NULL;
   hfp_buf_acquire_called = 0;
   hfp_buf_acquire_return_val = 0;
   hfp_buf_release_called = 0;
@@ -172,6 +174,43 @@ TEST_F(HfpIodev, OpenIodevWithHfpInfoAlreadyRunning) {
   ASSERT_EQ(1, cras_iodev_free_resources_called);
 }
 
+TEST_F(HfpIodev, OpenPairOnTwoThreads) {
+  struct cras_iodev *odev, *idev;
+  struct audio_thread* thread0 = reinterpret_cast<struct audio_thread*>(0x10);
+  struct audio_thread* thread1 = reinterpret_cast<struct audio_thread*>(0x11);
+
+  odev = hfp_iodev_create(CRAS_STREAM_OUTPUT, fake_device, fake_slc,
+                          CRAS_BT_DEVICE_PROFILE_HFP_AUDIOGATEWAY, fake_info);
+  idev = hfp_iodev_create(CRAS_STREAM_INPUT, fake_device, fake_slc,
+                          CRAS_BT_DEVICE_PROFILE_HFP_AUDIOGATEWAY, fake_info);
+  odev->format = &fake_format;
+  idev->format = &fake_format;
+
+  /* The first device opened starts hfp_info on its thread. */
+  odev->thread = thread1;
+  hfp_info_running_return_val = 0;
+  odev->configure_dev(odev);
+  ASSERT_EQ(1, hfp_info_start_called);
+  EXPECT_EQ(thread1, hfp_info_start_thread);
+
+  idev->thread = thread0;
+  hfp_info_running_return_val = 1;
+  idev->configure_dev(idev);
+  ASSERT_EQ(1, hfp_info_start_called);
+
+  /* Closing the other device last still stops hfp_info, which removes its
+   * callback from thread1. */
+  hfp_info_has_iodev_return_val = 1;
+  odev->close_dev(odev);
+  ASSERT_EQ(0, hfp_info_stop_called);
+  hfp_info_has_iodev_return_val = 0;
+  idev->close_dev(idev);
+  ASSERT_EQ(1, hfp_info_stop_called);
+
+  hfp_iodev_destroy(odev);
+  hfp_iodev_destroy(idev);
+}
+
 TEST_F(HfpIodev, PutGetBuffer) {
   cras_audio_area* area;
   unsigned frames;
@@ -303,8 +342,12 @@ int hfp_info_running(struct hfp_info* info) {
   return hfp_info_running_return_val;
 }
 
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info* info) {
+int hfp_info_start(int fd,
+                   unsigned int mtu,
+                   struct audio_thread* thread,
+                   struct hfp_info* info) {
   hfp_info_start_called++;
+  hfp_info_start_thread = thread;
   return 0;
 }
 
@@ -39,7 +39,12 @@ static cras_iodev* audio_thread_add_open_dev_dev;
 static int audio_thread_add_open_dev_called;
 static int audio_thread_rm_open_dev_called;
 static int audio_thread_is_dev_open_ret;
-static struct audio_thread thread;
+static struct audio_thread threads[2];
+static int audio_thread_create_called;
+static int system_get_num_audio_threads_return;
+static int system_get_audio_thread_device_policy_return;
+static struct audio_thread* audio_thread_add_open_dev_thread;
+static struct audio_thread* audio_thread_add_stream_thread;
 static struct cras_iodev loopback_input;
 static int cras_iodev_close_called;
 static struct cras_iodev* cras_iodev_close_dev;
@@ -203,6 +208,12 @@ class IoDevTestSuite : public testing::Test {
     audio_thread_add_open_dev_called = 0;
     audio_thread_set_active_dev_called = 0;
     audio_thread_add_stream_called = 0;
+    audio_thread_add_stream_thread = NULL;
+    audio_thread_add_open_dev_thread = NULL;
+    audio_thread_create_called = 0;
+    system_get_num_audio_threads_return = 1;
+    system_get_audio_thread_device_policy_return =
+        AUDIO_THREAD_DEVICE_POLICY_PER_CARD;
     update_active_node_called = 0;
     cras_observer_add_called = 0;
     cras_observer_remove_called = 0;
@@ -1289,6 +1300,105 @@ TEST_F(IoDevTestSuite, AddActiveNode) {
   cras_iodev_list_deinit();
 }
 
+TEST_F(IoDevTestSuite, PerBusPolicyPlacesDevicesOnThreads) {
+  struct cras_rstream rstream;
+
+  system_get_num_audio_threads_return = 2;
+  system_get_audio_thread_device_policy_return =
+      AUDIO_THREAD_DEVICE_POLICY_PER_BUS;
+  cras_iodev_list_init();
+  EXPECT_EQ(2, audio_thread_create_called);
+
+  node1.type = CRAS_NODE_TYPE_USB;
+  node2.type = CRAS_NODE_TYPE_INTERNAL_SPEAKER;
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d1_));
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d2_));
+
+  // Streams pinned to each device run on the thread of its bus.
+  memset(&rstream, 0, sizeof(rstream));
+  rstream.is_pinned = 1;
+  rstream.pinned_dev_idx = d1_.info.idx;
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(&threads[1], audio_thread_add_open_dev_thread);
+  EXPECT_EQ(&threads[1], audio_thread_add_stream_thread);
+  EXPECT_EQ(&threads[1], d1_.thread);
+
+  rstream.pinned_dev_idx = d2_.info.idx;
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(&threads[0], audio_thread_add_open_dev_thread);
+  EXPECT_EQ(&threads[0], audio_thread_add_stream_thread);
+  EXPECT_EQ(&threads[0], d2_.thread);
+
+  cras_iodev_list_deinit();
+}
+
+TEST_F(IoDevTestSuite, EnabledDevicesShareThread) {
+  struct cras_rstream rstream;
+
+  system_get_num_audio_threads_return = 2;
+  system_get_audio_thread_device_policy_return =
+      AUDIO_THREAD_DEVICE_POLICY_PER_BUS;
+  cras_iodev_list_init();
+
+  node1.type = CRAS_NODE_TYPE_USB;
+  node2.type = CRAS_NODE_TYPE_INTERNAL_SPEAKER;
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d1_));
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d2_));
+  cras_iodev_list_select_node(CRAS_STREAM_OUTPUT,
+                              cras_make_node_id(d1_.info.idx, 0));
+  cras_iodev_list_add_active_node(CRAS_STREAM_OUTPUT,
+                                  cras_make_node_id(d2_.info.idx, 0));
+
+  // The stream mixes into both devices, which must share a thread even
+  // though the policy would split them.
+  memset(&rstream, 0, sizeof(rstream));
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(&threads[1], d1_.thread);
+  EXPECT_EQ(&threads[1], d2_.thread);
+  EXPECT_EQ(&threads[1], audio_thread_add_stream_thread);
+
+  cras_iodev_list_deinit();
+}
+
+TEST_F(IoDevTestSuite, StreamNotSplitAcrossThreads) {
+  struct cras_rstream pinned1, pinned2, rstream;
+
+  system_get_num_audio_threads_return = 2;
+  system_get_audio_thread_device_policy_return =
+      AUDIO_THREAD_DEVICE_POLICY_PER_BUS;
+  cras_iodev_list_init();
+
+  node1.type = CRAS_NODE_TYPE_USB;
+  node2.type = CRAS_NODE_TYPE_INTERNAL_SPEAKER;
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d1_));
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d2_));
+
+  // Pinned streams open the devices on the threads of their buses.
+  memset(&pinned1, 0, sizeof(pinned1));
+  pinned1.is_pinned = 1;
+  pinned1.pinned_dev_idx = d1_.info.idx;
+  EXPECT_EQ(0, stream_add_cb(&pinned1));
+  memset(&pinned2, 0, sizeof(pinned2));
+  pinned2.is_pinned = 1;
+  pinned2.pinned_dev_idx = d2_.info.idx;
+  EXPECT_EQ(0, stream_add_cb(&pinned2));
+  ASSERT_EQ(&threads[1], d1_.thread);
+  ASSERT_EQ(&threads[0], d2_.thread);
+
+  cras_iodev_list_select_node(CRAS_STREAM_OUTPUT,
+                              cras_make_node_id(d1_.info.idx, 0));
+  cras_iodev_list_add_active_node(CRAS_STREAM_OUTPUT,
+                                  cras_make_node_id(d2_.info.idx, 0));
+
+  // A stream for both can't run on either thread alone.
+  memset(&rstream, 0, sizeof(rstream));
+  audio_thread_add_stream_called = 0;
+  EXPECT_EQ(-EINVAL, stream_add_cb(&rstream));
+  EXPECT_EQ(0, audio_thread_add_stream_called);
+
+  cras_iodev_list_deinit();
+}
+
 TEST_F(IoDevTestSuite, DrainTimerCancel) {
   int rc;
   struct cras_rstream rstream;
@@ -1612,8 +1722,52 @@ int cras_system_get_mute() {
   return system_get_mute_return;
 }
 
+int cras_system_get_audio_thread_use_epoll() {
+  return 0;
+}
+
+int cras_system_get_num_audio_threads() {
+  return system_get_num_audio_threads_return;
+}
+
+int cras_system_get_audio_thread_device_policy() {
+  return system_get_audio_thread_device_policy_return;
+}
+
+int cras_system_get_audio_thread_cpu_mask() {
+  return 0;
+}
+
 struct audio_thread* audio_thread_create() {
-  return &thread;
+  return &threads[audio_thread_create_called++ % 2];
+}
+
+void audio_thread_select(struct audio_thread* thread) {}
+
+int audio_thread_dump_thread_info(struct audio_thread* thread,
+                                  struct audio_debug_info* info) {
+  return 0;
+}
+
+int audio_thread_config_global_remix(struct audio_thread* thread,
+                                     unsigned int num_channels,
+                                     const float* coefficient) {
+  return 0;
+}
+
+int audio_thread_set_aec_dump(struct audio_thread* thread,
+                              cras_stream_id_t stream_id,
+                              unsigned int start,
+                              int fd) {
+  return 0;
+}
+
+int audio_thread_set_cpu(struct audio_thread* thread, int cpu) {
+  return 0;
+}
+
+int audio_thread_use_epoll(struct audio_thread* thread, int enable) {
+  return 0;
 }
 
 int audio_thread_start(struct audio_thread* thread) {
@@ -1637,6 +1791,7 @@ void audio_thread_remove_streams(struct audio_thread* thread,
 int audio_thread_add_open_dev(struct audio_thread* thread,
                               struct cras_iodev* dev) {
   audio_thread_add_open_dev_dev = dev;
+  audio_thread_add_open_dev_thread = thread;
   audio_thread_add_open_dev_called++;
   return 0;
 }
@@ -1658,6 +1813,7 @@ int audio_thread_add_stream(struct audio_thread* thread,
                             struct cras_iodev** devs,
                             unsigned int num_devs) {
   audio_thread_add_stream_called++;
+  audio_thread_add_stream_thread = thread;
   audio_thread_add_stream_stream = stream;
   audio_thread_add_stream_dev = (num_devs ? devs[0] : NULL);
   return 0;
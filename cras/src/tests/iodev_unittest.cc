@@ -39,6 +39,8 @@ static size_t notify_nodes_changed_called;
 static size_t notify_active_node_changed_called;
 static int dsp_context_new_sample_rate;
 static const char* dsp_context_new_purpose;
+static unsigned int dsp_set_fade_frames_val;
+static int cras_system_get_dsp_crossfade_ms_return;
 static int dsp_context_free_called;
 static int update_channel_layout_called;
 static int update_channel_layout_return_val;
@@ -47,14 +49,23 @@ static unsigned int cras_system_get_volume_return;
 static int cras_dsp_get_pipeline_called;
 static int cras_dsp_get_pipeline_ret;
 static int cras_dsp_put_pipeline_called;
+static int cras_dsp_lock_pipeline_called;
+static int cras_dsp_unlock_pipeline_called;
 static int cras_dsp_pipeline_get_source_buffer_called;
 static int cras_dsp_pipeline_get_sink_buffer_called;
 static float cras_dsp_pipeline_source_buffer[2][DSP_BUFFER_SIZE];
 static float cras_dsp_pipeline_sink_buffer[2][DSP_BUFFER_SIZE];
 static int cras_dsp_pipeline_get_delay_called;
-static int cras_dsp_pipeline_apply_called;
+static int cras_dsp_apply_called;
 static int cras_dsp_pipeline_set_sink_ext_module_called;
-static int cras_dsp_pipeline_apply_sample_count;
+static int cras_dsp_apply_sample_count;
+static int cras_dsp_apply_float_called;
+static unsigned int cras_dsp_apply_float_frames;
+static int cras_system_get_float_mix_bus_return;
+static unsigned int cras_mix_bus_quantize_called;
+static unsigned int cras_mix_bus_consume_frames;
+static float cras_mix_bus_scale_scaler;
+static unsigned int cras_mix_bus_zero_called;
 static unsigned int cras_mix_mute_count;
 static unsigned int cras_dsp_num_input_channels_return;
 static unsigned int cras_dsp_num_output_channels_return;
@@ -130,11 +141,15 @@ void ResetStubData() {
   notify_active_node_changed_called = 0;
   dsp_context_new_sample_rate = 0;
   dsp_context_new_purpose = NULL;
+  dsp_set_fade_frames_val = 0;
+  cras_system_get_dsp_crossfade_ms_return = 10;
   dsp_context_free_called = 0;
   cras_audio_format_set_channel_layout_called = 0;
   cras_dsp_get_pipeline_called = 0;
   cras_dsp_get_pipeline_ret = 0;
   cras_dsp_put_pipeline_called = 0;
+  cras_dsp_lock_pipeline_called = 0;
+  cras_dsp_unlock_pipeline_called = 0;
   cras_dsp_pipeline_get_source_buffer_called = 0;
   cras_dsp_pipeline_get_sink_buffer_called = 0;
   memset(&cras_dsp_pipeline_source_buffer, 0,
@@ -142,9 +157,16 @@ void ResetStubData() {
   memset(&cras_dsp_pipeline_sink_buffer, 0,
          sizeof(cras_dsp_pipeline_sink_buffer));
   cras_dsp_pipeline_get_delay_called = 0;
-  cras_dsp_pipeline_apply_called = 0;
+  cras_dsp_apply_called = 0;
   cras_dsp_pipeline_set_sink_ext_module_called = 0;
-  cras_dsp_pipeline_apply_sample_count = 0;
+  cras_dsp_apply_sample_count = 0;
+  cras_dsp_apply_float_called = 0;
+  cras_dsp_apply_float_frames = 0;
+  cras_system_get_float_mix_bus_return = 0;
+  cras_mix_bus_quantize_called = 0;
+  cras_mix_bus_consume_frames = 0;
+  cras_mix_bus_scale_scaler = 0.0f;
+  cras_mix_bus_zero_called = 0;
   cras_dsp_num_input_channels_return = 2;
   cras_dsp_num_output_channels_return = 2;
   cras_dsp_context_new_return = NULL;
@@ -297,6 +319,22 @@ TEST_F(IoDevSetFormatTestSuite, SupportedFormatSecondary) {
   EXPECT_STREQ(dsp_context_new_purpose, "playback");
 }
 
+TEST_F(IoDevSetFormatTestSuite, DspCrossfadeFromBoardConfig) {
+  struct cras_audio_format fmt;
+  int rc;
+
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev_.direction = CRAS_STREAM_OUTPUT;
+  ResetStubData();
+  cras_dsp_context_new_return = reinterpret_cast<cras_dsp_context*>(0xf0f);
+  cras_system_get_dsp_crossfade_ms_return = 25;
+  rc = cras_iodev_set_format(&iodev_, &fmt);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1200, dsp_set_fade_frames_val);
+}
+
 TEST_F(IoDevSetFormatTestSuite, SupportedFormat32bit) {
   struct cras_audio_format fmt;
   int rc;
@@ -795,10 +833,90 @@ TEST(IoDevPutOutputBuffer, DSP) {
   EXPECT_EQ((void*)0x5678, post_dsp_hook_cb_data);
   EXPECT_EQ(32, put_buffer_nframes);
   EXPECT_EQ(32, rate_estimator_add_frames_num_frames);
-  EXPECT_EQ(32, cras_dsp_pipeline_apply_sample_count);
+  EXPECT_EQ(32, cras_dsp_apply_sample_count);
+  EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
+}
+
+TEST(IoDevPutOutputBuffer, MixBusDSP) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  uint8_t* frames = reinterpret_cast<uint8_t*>(0x44);
+  int rc;
+  struct cras_loopback pre_dsp;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.dsp_context = reinterpret_cast<cras_dsp_context*>(0x15);
+  iodev.mix_bus = reinterpret_cast<cras_mix_bus*>(0x35);
+  cras_dsp_get_pipeline_ret = 0x25;
+
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.rate_est = reinterpret_cast<struct rate_estimator*>(0xdeadbeef);
+  pre_dsp.type = LOOPBACK_POST_MIX_PRE_DSP;
+  pre_dsp.hook_data = pre_dsp_hook;
+  pre_dsp.hook_control = loopback_hook_control;
+  pre_dsp.cb_data = (void*)0x1234;
+  DL_APPEND(iodev.loopbacks, &pre_dsp);
+
+  rc = cras_iodev_put_output_mix_bus(&iodev, frames, 32, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, pre_dsp_hook_called);
+  EXPECT_EQ(frames, pre_dsp_hook_frames);
+  // The DSP runs on the float bus, not on the quantized samples.
+  EXPECT_EQ(0, cras_dsp_apply_called);
+  EXPECT_EQ(1, cras_dsp_apply_float_called);
+  EXPECT_EQ(32, cras_dsp_apply_float_frames);
+  // Once for the loopback and once for the device.
+  EXPECT_EQ(2, cras_mix_bus_quantize_called);
+  EXPECT_EQ(32, cras_mix_bus_consume_frames);
+  EXPECT_EQ(32, put_buffer_nframes);
   EXPECT_EQ(cras_dsp_get_pipeline_called, cras_dsp_put_pipeline_called);
 }
 
+TEST(IoDevPutOutputBuffer, MixBusSoftVolAndMute) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  uint8_t* frames = reinterpret_cast<uint8_t*>(0x44);
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.software_volume_needed = 1;
+
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.rate_est = reinterpret_cast<struct rate_estimator*>(0xdeadbeef);
+
+  // Without a bus there is nothing to put.
+  rc = cras_iodev_put_output_mix_bus(&iodev, frames, 53, NULL, nullptr);
+  EXPECT_EQ(-EINVAL, rc);
+
+  iodev.mix_bus = reinterpret_cast<cras_mix_bus*>(0x35);
+  cras_system_get_volume_return = 13;
+  softvol_scalers[13] = 0.435;
+  rc = cras_iodev_put_output_mix_bus(&iodev, frames, 53, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(0, cras_scale_buffer_called);
+  EXPECT_FLOAT_EQ(softvol_scalers[13], cras_mix_bus_scale_scaler);
+  EXPECT_EQ(1, cras_mix_bus_quantize_called);
+  EXPECT_EQ(53, put_buffer_nframes);
+
+  ResetStubData();
+  cras_system_get_mute_return = 1;
+  rc = cras_iodev_put_output_mix_bus(&iodev, frames, 53, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(0, cras_mix_mute_count);
+  EXPECT_EQ(1, cras_mix_bus_zero_called);
+  EXPECT_EQ(53, put_buffer_nframes);
+}
+
 TEST(IoDevPutOutputBuffer, SoftVol) {
   struct cras_audio_format fmt;
   struct cras_iodev iodev;
@@ -2219,24 +2337,24 @@ TEST(IoDev, SetExtDspMod) {
 
   cras_iodev_open(&iodev, 240, &fmt);
   EXPECT_EQ(1, ext_mod_configure_called);
-  EXPECT_EQ(1, cras_dsp_get_pipeline_called);
+  EXPECT_EQ(1, cras_dsp_lock_pipeline_called);
   EXPECT_EQ(1, cras_dsp_pipeline_set_sink_ext_module_called);
 
   cras_iodev_set_ext_dsp_module(&iodev, NULL);
   EXPECT_EQ(1, ext_mod_configure_called);
-  EXPECT_EQ(2, cras_dsp_get_pipeline_called);
+  EXPECT_EQ(2, cras_dsp_lock_pipeline_called);
   EXPECT_EQ(2, cras_dsp_pipeline_set_sink_ext_module_called);
 
   cras_iodev_set_ext_dsp_module(&iodev, &ext);
   EXPECT_EQ(2, ext_mod_configure_called);
-  EXPECT_EQ(3, cras_dsp_get_pipeline_called);
+  EXPECT_EQ(3, cras_dsp_lock_pipeline_called);
   EXPECT_EQ(3, cras_dsp_pipeline_set_sink_ext_module_called);
 
   /* If pipeline doesn't exist, dummy pipeline should be loaded. */
   cras_dsp_get_pipeline_ret = 0x0;
   cras_iodev_set_ext_dsp_module(&iodev, &ext);
   EXPECT_EQ(3, ext_mod_configure_called);
-  EXPECT_EQ(5, cras_dsp_get_pipeline_called);
+  EXPECT_EQ(5, cras_dsp_lock_pipeline_called);
   EXPECT_EQ(1, cras_dsp_load_dummy_pipeline_called);
   EXPECT_EQ(4, cras_dsp_pipeline_set_sink_ext_module_called);
 }
@@ -2417,6 +2535,11 @@ struct cras_dsp_context* cras_dsp_context_new(int sample_rate,
   return cras_dsp_context_new_return;
 }
 
+void cras_dsp_set_fade_frames(struct cras_dsp_context* ctx,
+                              unsigned int frames) {
+  dsp_set_fade_frames_val = frames;
+}
+
 void cras_dsp_context_free(struct cras_dsp_context* ctx) {
   dsp_context_free_called++;
 }
@@ -2460,12 +2583,30 @@ int cras_dsp_pipeline_get_delay(struct pipeline* pipeline) {
   return 0;
 }
 
-int cras_dsp_pipeline_apply(struct pipeline* pipeline,
-                            uint8_t* buf,
-                            snd_pcm_format_t format,
-                            unsigned int frames) {
-  cras_dsp_pipeline_apply_called++;
-  cras_dsp_pipeline_apply_sample_count = frames;
+struct pipeline* cras_dsp_lock_pipeline(struct cras_dsp_context* ctx) {
+  cras_dsp_lock_pipeline_called++;
+  return reinterpret_cast<struct pipeline*>(cras_dsp_get_pipeline_ret);
+}
+
+void cras_dsp_unlock_pipeline(struct cras_dsp_context* ctx) {
+  cras_dsp_unlock_pipeline_called++;
+}
+
+int cras_dsp_apply(struct cras_dsp_context* ctx,
+                   uint8_t* buf,
+                   snd_pcm_format_t format,
+                   unsigned int frames) {
+  cras_dsp_apply_called++;
+  cras_dsp_apply_sample_count = frames;
+  return 0;
+}
+
+int cras_dsp_apply_float(struct cras_dsp_context* ctx,
+                         float* const* bufs,
+                         unsigned int num_channels,
+                         unsigned int frames) {
+  cras_dsp_apply_float_called++;
+  cras_dsp_apply_float_frames = frames;
   return 0;
 }
 
@@ -2545,6 +2686,65 @@ long cras_system_get_capture_gain() {
   return cras_system_get_capture_gain_ret_value;
 }
 
+int cras_system_get_dsp_crossfade_ms() {
+  return cras_system_get_dsp_crossfade_ms_return;
+}
+
+int cras_system_get_float_mix_bus() {
+  return cras_system_get_float_mix_bus_return;
+}
+
+int cras_system_get_float_mix_bus_dither() {
+  return 0;
+}
+
+int cras_system_get_shared_playback_conversion() {
+  return 0;
+}
+
+struct cras_mix_bus* cras_mix_bus_create(unsigned int num_channels,
+                                         unsigned int max_frames,
+                                         int dither) {
+  return reinterpret_cast<cras_mix_bus*>(0x35);
+}
+
+void cras_mix_bus_destroy(struct cras_mix_bus* bus) {}
+
+unsigned int cras_mix_bus_num_channels(const struct cras_mix_bus* bus) {
+  return 2;
+}
+
+float* const* cras_mix_bus_channels(struct cras_mix_bus* bus) {
+  return NULL;
+}
+
+void cras_mix_bus_zero(struct cras_mix_bus* bus,
+                       unsigned int offset,
+                       unsigned int frames) {
+  cras_mix_bus_zero_called++;
+}
+
+void cras_mix_bus_scale(struct cras_mix_bus* bus,
+                        unsigned int frames,
+                        float scaler,
+                        float increment,
+                        float target) {
+  cras_mix_bus_scale_scaler = scaler;
+}
+
+int cras_mix_bus_quantize(struct cras_mix_bus* bus,
+                          snd_pcm_format_t fmt,
+                          uint8_t* dst,
+                          unsigned int frames,
+                          int dither) {
+  cras_mix_bus_quantize_called++;
+  return 0;
+}
+
+void cras_mix_bus_consume(struct cras_mix_bus* bus, unsigned int frames) {
+  cras_mix_bus_consume_frames = frames;
+}
+
 int cras_system_get_mute() {
   return cras_system_get_mute_return;
 }
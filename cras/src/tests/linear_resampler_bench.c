@@ -0,0 +1,119 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the throughput of the linear resampler, in output frames per
+ * second, against the float resampler it replaced, across sample formats and
+ * channel counts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "linear_resampler.h"
+#include "linear_resampler_ref.h"
+
+#define BENCH_FRAMES 480
+#define BENCH_MAX_CHANNELS 8
+#define MIN_BENCH_SECONDS 0.2
+#define FROM_RATE 48000
+#define TO_RATE 48048
+
+static const struct {
+	const char *name;
+	snd_pcm_format_t fmt;
+} formats[] = {
+	{ "S16_LE", SND_PCM_FORMAT_S16_LE },
+	{ "S32_LE", SND_PCM_FORMAT_S32_LE },
+	{ "FLOAT_LE", SND_PCM_FORMAT_FLOAT_LE },
+};
+
+static const unsigned int channel_counts[] = { 1, 2, 6, 8 };
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* Returns output frames per second, resampling periods of BENCH_FRAMES input
+ * frames with either lr or ref. */
+static double bench_resample(struct linear_resampler *lr,
+			     struct ref_linear_resampler *ref, uint8_t *src,
+			     uint8_t *dst)
+{
+	struct timespec tp1, tp2;
+	unsigned long frames = 0;
+	unsigned int i, count;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	do {
+		for (i = 0; i < 100; i++) {
+			count = BENCH_FRAMES;
+			if (lr)
+				frames += linear_resampler_resample(
+					lr, src, &count, dst, 2 * BENCH_FRAMES);
+			else
+				frames += ref_linear_resampler_resample(
+					ref, src, &count, dst,
+					2 * BENCH_FRAMES);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tp2);
+		elapsed = tp_diff(&tp2, &tp1);
+	} while (elapsed < MIN_BENCH_SECONDS);
+
+	return frames / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	struct linear_resampler *lr;
+	struct ref_linear_resampler *ref;
+	unsigned int f, c, i;
+	size_t bytes;
+	uint8_t *src, *dst;
+
+	bytes = BENCH_FRAMES * BENCH_MAX_CHANNELS * 4;
+	src = (uint8_t *)malloc(bytes);
+	dst = (uint8_t *)malloc(2 * bytes);
+	for (i = 0; i < bytes; i++)
+		src[i] = rand();
+
+	printf("%-10s %-4s %14s %14s  (Mframes/s)\n", "format", "ch", "ref",
+	       "fixed");
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		for (c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]);
+		     c++) {
+			printf("%-10s %-4u ", formats[f].name,
+			       channel_counts[c]);
+
+			/* The reference only handles S16_LE. */
+			if (formats[f].fmt == SND_PCM_FORMAT_S16_LE) {
+				ref = ref_linear_resampler_create(
+					channel_counts[c],
+					channel_counts[c] * 2, FROM_RATE,
+					TO_RATE);
+				printf("%14.1f ",
+				       bench_resample(NULL, ref, src, dst) /
+					       1e6);
+				ref_linear_resampler_destroy(ref);
+			} else {
+				printf("%14s ", "-");
+			}
+
+			lr = linear_resampler_create(channel_counts[c],
+						     formats[f].fmt, FROM_RATE,
+						     TO_RATE);
+			printf("%14.1f\n",
+			       bench_resample(lr, NULL, src, dst) / 1e6);
+			linear_resampler_destroy(lr);
+		}
+	}
+
+	free(src);
+	free(dst);
+	return 0;
+}
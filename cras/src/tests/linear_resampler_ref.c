@@ -0,0 +1,100 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+
+#include "linear_resampler_ref.h"
+
+struct ref_linear_resampler {
+	unsigned int num_channels;
+	unsigned int format_bytes;
+	unsigned int src_offset;
+	unsigned int dst_offset;
+	unsigned int to_times_100;
+	unsigned int from_times_100;
+	float f;
+};
+
+struct ref_linear_resampler *
+ref_linear_resampler_create(unsigned int num_channels,
+			    unsigned int format_bytes, float src_rate,
+			    float dst_rate)
+{
+	struct ref_linear_resampler *lr;
+
+	lr = (struct ref_linear_resampler *)calloc(1, sizeof(*lr));
+	if (!lr)
+		return NULL;
+	lr->num_channels = num_channels;
+	lr->format_bytes = format_bytes;
+	lr->f = (float)dst_rate / src_rate;
+	lr->to_times_100 = dst_rate * 100;
+	lr->from_times_100 = src_rate * 100;
+	return lr;
+}
+
+void ref_linear_resampler_destroy(struct ref_linear_resampler *lr)
+{
+	free(lr);
+}
+
+unsigned int ref_linear_resampler_resample(struct ref_linear_resampler *lr,
+					   uint8_t *src,
+					   unsigned int *src_frames,
+					   uint8_t *dst, unsigned dst_frames)
+{
+	int ch;
+	unsigned int src_idx = 0;
+	unsigned int dst_idx = 0;
+	float src_pos;
+	int16_t *in, *out;
+
+	if (dst_frames == 0 || *src_frames == 0) {
+		*src_frames = 0;
+		return 0;
+	}
+
+	for (dst_idx = 0; dst_idx <= dst_frames; dst_idx++) {
+		src_pos = (float)(lr->dst_offset + dst_idx) / lr->f;
+		if (src_pos > lr->src_offset)
+			src_pos -= lr->src_offset;
+		else
+			src_pos = 0;
+		src_idx = (unsigned int)src_pos;
+
+		if (src_pos > *src_frames - 1 || dst_idx >= dst_frames) {
+			if (src_pos > *src_frames - 1)
+				src_idx = *src_frames - 1;
+			break;
+		}
+
+		in = (int16_t *)(src + src_idx * lr->format_bytes);
+		out = (int16_t *)(dst + dst_idx * lr->format_bytes);
+
+		if (src_idx == *src_frames - 1) {
+			for (ch = 0; ch < lr->num_channels; ch++)
+				out[ch] = in[ch];
+		} else {
+			for (ch = 0; ch < lr->num_channels; ch++) {
+				out[ch] = in[ch] +
+					  (src_pos - src_idx) *
+						  (in[lr->num_channels + ch] -
+						   in[ch]);
+			}
+		}
+	}
+
+	*src_frames = src_idx + 1;
+
+	lr->src_offset += *src_frames;
+	lr->dst_offset += dst_idx;
+	while ((lr->src_offset > lr->from_times_100) &&
+	       (lr->dst_offset > lr->to_times_100)) {
+		lr->src_offset -= lr->from_times_100;
+		lr->dst_offset -= lr->to_times_100;
+	}
+
+	return dst_idx;
+}
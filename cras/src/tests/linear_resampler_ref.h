@@ -0,0 +1,27 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef LINEAR_RESAMPLER_REF_H_
+#define LINEAR_RESAMPLER_REF_H_
+
+#include <stdint.h>
+
+/* The float, S16 only linear resampler the server used before the fixed
+ * point one, kept to compare quality and speed against. */
+struct ref_linear_resampler;
+
+struct ref_linear_resampler *
+ref_linear_resampler_create(unsigned int num_channels,
+			    unsigned int format_bytes, float src_rate,
+			    float dst_rate);
+
+unsigned int ref_linear_resampler_resample(struct ref_linear_resampler *lr,
+					   uint8_t *src,
+					   unsigned int *src_frames,
+					   uint8_t *dst, unsigned dst_frames);
+
+void ref_linear_resampler_destroy(struct ref_linear_resampler *lr);
+
+#endif /* LINEAR_RESAMPLER_REF_H_ */
@@ -4,18 +4,90 @@
 
 #include <gtest/gtest.h>
 #include <limits.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include <vector>
+
 extern "C" {
 #include "linear_resampler.h"
+#include "linear_resampler_ref.h"
 }
 
 #define BUF_SIZE 2048
+#define SIGNAL_FRAMES 48000
+#define SIGNAL_FREQ 997.0
+#define SIGNAL_RATE 48000.0
 
 static uint8_t in_buf[BUF_SIZE];
 static uint8_t out_buf[BUF_SIZE];
 
+// Fills num_channels interleaved channels of a half scale sine.
+template <typename T>
+static std::vector<T> MakeSine(unsigned int num_channels, double full_scale) {
+  std::vector<T> buf(SIGNAL_FRAMES * num_channels);
+
+  for (unsigned int i = 0; i < SIGNAL_FRAMES; i++)
+    for (unsigned int ch = 0; ch < num_channels; ch++)
+      buf[i * num_channels + ch] =
+          full_scale / 4 * sin(2 * M_PI * SIGNAL_FREQ / SIGNAL_RATE * i);
+  return buf;
+}
+
+// Resamples in the way fmt_conv does, asking for up to 480 frames at a time
+// and moving the input on by the frames reported consumed. Works for both
+// resamplers as they take the same arguments.
+template <typename T, typename R, typename F>
+static std::vector<T> Resample(R* lr,
+                               F resample,
+                               const std::vector<T>& in,
+                               unsigned int num_channels) {
+  std::vector<T> out(in.size() * 2);
+  unsigned int in_pos = 0, out_pos = 0;
+  unsigned int count, rc;
+
+  while (in_pos + 600 < in.size() / num_channels) {
+    count = 600;
+    rc = resample(lr, (uint8_t*)&in[in_pos * num_channels], &count,
+                  (uint8_t*)&out[out_pos * num_channels], 480);
+    in_pos += count;
+    out_pos += rc;
+  }
+  out.resize(out_pos * num_channels);
+  return out;
+}
+
+// Returns THD+N in dB of the first channel of buf, with the fundamental
+// found by a least squares fit at freq radians per frame.
+template <typename T>
+static double ThdN(const std::vector<T>& buf,
+                   unsigned int num_channels,
+                   double freq) {
+  unsigned int frames = buf.size() / num_channels;
+  double scc = 0, sss = 0, scs = 0, sxc = 0, sxs = 0;
+  double a, b, det, fit, total = 0, noise = 0;
+  unsigned int i;
+
+  for (i = 0; i < frames; i++) {
+    double c = cos(freq * i), s = sin(freq * i), x = buf[i * num_channels];
+    scc += c * c;
+    sss += s * s;
+    scs += c * s;
+    sxc += x * c;
+    sxs += x * s;
+  }
+  det = scc * sss - scs * scs;
+  a = (sxc * sss - sxs * scs) / det;
+  b = (sxs * scc - sxc * scs) / det;
+  for (i = 0; i < frames; i++) {
+    fit = a * cos(freq * i) + b * sin(freq * i);
+    total += fit * fit;
+    noise += (buf[i * num_channels] - fit) * (buf[i * num_channels] - fit);
+  }
+  return 10 * log10(noise / total);
+}
+
 TEST(LinearResampler, ReampleToSlightlyLargerRate) {
   int i, rc;
   unsigned int count;
@@ -30,7 +102,7 @@ TEST(LinearResampler, ReampleToSlightlyLargerRate) {
     *((int16_t*)(in_buf + i * 4 + 2)) = i * 20;
   }
 
-  lr = linear_resampler_create(2, 4, 48000, 48001);
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 48000, 48001);
 
   count = 20;
   rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -69,7 +141,7 @@ TEST(LinearResampler, ResampleIntegerFractionToLarger) {
   }
 
   /* Rate 10 -> 11 */
-  lr = linear_resampler_create(2, 4, 10, 11);
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 11);
 
   count = 5;
   rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -119,7 +191,7 @@ TEST(LinearResampler, ResampleIntegerFractionToLess) {
   }
 
   /* Rate 10 -> 9 */
-  lr = linear_resampler_create(2, 4, 10, 9);
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
   count = 6;
   rc = linear_resampler_resample(lr, in_buf + 4 * in_offset, &count,
@@ -161,7 +233,7 @@ TEST(LinearResampler, ResampleIntegerNoSrcBuffer) {
   memset(out_buf, 0, BUF_SIZE);
 
   /* Rate 10 -> 9 */
-  lr = linear_resampler_create(2, 4, 10, 9);
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
   count = 0;
   rc = linear_resampler_resample(lr, in_buf, &count, out_buf, BUF_SIZE);
@@ -179,7 +251,7 @@ TEST(LinearResampler, ResampleIntegerNoDstBuffer) {
   memset(out_buf, 0, BUF_SIZE);
 
   /* Rate 10 -> 9 */
-  lr = linear_resampler_create(2, 4, 10, 9);
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, 10, 9);
 
   count = BUF_SIZE;
   rc = linear_resampler_resample(lr, in_buf, &count, out_buf, 0);
@@ -188,6 +260,106 @@ TEST(LinearResampler, ResampleIntegerNoDstBuffer) {
   linear_resampler_destroy(lr);
 }
 
+TEST(LinearResampler, ThdNBetterThanReference) {
+  const float rates[][2] = {{48000, 48048}, {48000, 47952}, {44100, 44123}};
+
+  for (auto rate : rates) {
+    std::vector<int16_t> in = MakeSine<int16_t>(2, 65536);
+    double freq = 2 * M_PI * SIGNAL_FREQ / SIGNAL_RATE * rate[0] / rate[1];
+    struct linear_resampler* lr =
+        linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, rate[0], rate[1]);
+    struct ref_linear_resampler* ref =
+        ref_linear_resampler_create(2, 4, rate[0], rate[1]);
+
+    std::vector<int16_t> out =
+        Resample(lr, linear_resampler_resample, in, 2);
+    std::vector<int16_t> ref_out =
+        Resample(ref, ref_linear_resampler_resample, in, 2);
+
+    // Linear interpolation of a 1kHz tone alone is around -64dB, the
+    // reference loses more at every buffer boundary.
+    EXPECT_LT(ThdN(out, 2, freq), -60);
+    EXPECT_LT(ThdN(out, 2, freq), ThdN(ref_out, 2, freq) - 10);
+
+    linear_resampler_destroy(lr);
+    ref_linear_resampler_destroy(ref);
+  }
+}
+
+TEST(LinearResampler, ThdNS32AndFloat) {
+  const double freq = 2 * M_PI * SIGNAL_FREQ / SIGNAL_RATE * 48000 / 48048;
+  struct linear_resampler* lr;
+
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_S32_LE, 48000, 48048);
+  std::vector<int32_t> in32 = MakeSine<int32_t>(2, 4294967296.0);
+  std::vector<int32_t> out32 = Resample(lr, linear_resampler_resample, in32, 2);
+  EXPECT_LT(ThdN(out32, 2, freq), -60);
+  linear_resampler_destroy(lr);
+
+  lr = linear_resampler_create(2, SND_PCM_FORMAT_FLOAT_LE, 48000, 48048);
+  std::vector<float> inf = MakeSine<float>(2, 2.0);
+  std::vector<float> outf = Resample(lr, linear_resampler_resample, inf, 2);
+  EXPECT_LT(ThdN(outf, 2, freq), -60);
+  linear_resampler_destroy(lr);
+}
+
+TEST(LinearResampler, ChannelsResampledAlike) {
+  const unsigned int channel_counts[] = {2, 3, 6};
+  std::vector<int16_t> mono_in = MakeSine<int16_t>(1, 65536);
+  struct linear_resampler* lr;
+  unsigned int i;
+
+  // Mono and stereo take the SIMD paths, other counts don't.
+  lr = linear_resampler_create(1, SND_PCM_FORMAT_S16_LE, 48000, 48048);
+  std::vector<int16_t> mono_out =
+      Resample(lr, linear_resampler_resample, mono_in, 1);
+  linear_resampler_destroy(lr);
+
+  for (auto num_channels : channel_counts) {
+    std::vector<int16_t> in = MakeSine<int16_t>(num_channels, 65536);
+    lr = linear_resampler_create(num_channels, SND_PCM_FORMAT_S16_LE, 48000,
+                                 48048);
+    std::vector<int16_t> out =
+        Resample(lr, linear_resampler_resample, in, num_channels);
+    linear_resampler_destroy(lr);
+
+    ASSERT_EQ(mono_out.size() * num_channels, out.size());
+    for (i = 0; i < out.size(); i++)
+      ASSERT_EQ(mono_out[i / num_channels], out[i]) << i;
+  }
+}
+
+TEST(LinearResampler, FrameCountsMatchResample) {
+  const float rates[][2] = {{48000, 48048}, {48000, 47952}, {10, 11}};
+  unsigned int i, count, frames, out_frames, rc;
+
+  memset(in_buf, 0, BUF_SIZE);
+  srand(3);
+  for (auto rate : rates) {
+    struct linear_resampler* lr =
+        linear_resampler_create(2, SND_PCM_FORMAT_S16_LE, rate[0], rate[1]);
+
+    for (i = 0; i < 10000; i++) {
+      // Enough input for the asked output is used up exactly.
+      frames = 1 + rand() % 400;
+      count = linear_resampler_out_frames_to_in(lr, frames);
+      ASSERT_LE(count, BUF_SIZE / 4);
+      rc = linear_resampler_resample(lr, in_buf, &count, out_buf, frames);
+      ASSERT_EQ(frames, rc);
+
+      // All the input is used when there is room for the output.
+      frames = 1 + rand() % 400;
+      count = frames;
+      out_frames = linear_resampler_in_frames_to_out(lr, frames);
+      rc = linear_resampler_resample(lr, in_buf, &count, out_buf,
+                                     BUF_SIZE / 4);
+      ASSERT_EQ(out_frames, rc);
+      ASSERT_EQ(frames, count);
+    }
+    linear_resampler_destroy(lr);
+  }
+}
+
 extern "C" {
 
 void cras_mix_add_scale_stride(int fmt,
@@ -6,6 +6,14 @@
 extern "C" {
 #include "cras_server_metrics.h"
 
+int cras_server_metrics_a2dp_bitpool_decreases(unsigned num_decreases) {
+  return 0;
+}
+
+int cras_server_metrics_a2dp_lowest_bitpool(unsigned percent) {
+  return 0;
+}
+
 int cras_server_metrics_device_runtime(struct cras_iodev* iodev) {
   return 0;
 }
@@ -0,0 +1,162 @@
+// Copyright 2020 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+extern "C" {
+#include "cras_mix_bus.h"
+}
+
+namespace {
+
+static const unsigned int kNumChannels = 2;
+static const unsigned int kMaxFrames = 256;
+
+class MixBusTestSuite : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    bus_ = cras_mix_bus_create(kNumChannels, kMaxFrames, 0);
+    ASSERT_NE(bus_, (void*)NULL);
+    in_.resize(kMaxFrames * kNumChannels);
+    out_.resize(kMaxFrames * kNumChannels);
+    for (size_t i = 0; i < in_.size(); i++)
+      in_[i] = (i * 997) % 65536 - 32768;
+  }
+
+  virtual void TearDown() { cras_mix_bus_destroy(bus_); }
+
+  uint8_t* in() { return reinterpret_cast<uint8_t*>(in_.data()); }
+  uint8_t* out() { return reinterpret_cast<uint8_t*>(out_.data()); }
+
+  struct cras_mix_bus* bus_;
+  std::vector<int16_t> in_;
+  std::vector<int16_t> out_;
+};
+
+TEST_F(MixBusTestSuite, S16RoundTrip) {
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE, in(), 0,
+                                kMaxFrames, 0, 1.0));
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S16_LE, out(),
+                                     kMaxFrames, 1));
+  for (size_t i = 0; i < in_.size(); i++)
+    EXPECT_EQ(in_[i], out_[i]) << i;
+}
+
+TEST_F(MixBusTestSuite, S32RoundTripKeepsLowBits) {
+  std::vector<int32_t> in32(kMaxFrames * kNumChannels);
+  std::vector<int32_t> out32(kMaxFrames * kNumChannels);
+
+  // Values float holds exactly, below the 16 bit resolution.
+  for (size_t i = 0; i < in32.size(); i++)
+    in32[i] = ((int32_t)i - 256) * 256;
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S32_LE,
+                                reinterpret_cast<uint8_t*>(in32.data()), 0,
+                                kMaxFrames, 0, 1.0));
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S32_LE,
+                                     reinterpret_cast<uint8_t*>(out32.data()),
+                                     kMaxFrames, 1));
+  for (size_t i = 0; i < in32.size(); i++)
+    EXPECT_EQ(in32[i], out32[i]) << i;
+}
+
+TEST_F(MixBusTestSuite, AddTwoStreamsAtOffsets) {
+  std::vector<int16_t> a(kMaxFrames * kNumChannels, 1000);
+  std::vector<int16_t> b(kMaxFrames * kNumChannels, -300);
+
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE,
+                                reinterpret_cast<uint8_t*>(a.data()), 0, 100,
+                                0, 1.0));
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE,
+                                reinterpret_cast<uint8_t*>(b.data()), 50, 100,
+                                0, 0.5));
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S16_LE, out(), 150,
+                                     0));
+  for (size_t i = 0; i < 50 * kNumChannels; i++)
+    EXPECT_EQ(1000, out_[i]);
+  for (size_t i = 50 * kNumChannels; i < 100 * kNumChannels; i++)
+    EXPECT_EQ(850, out_[i]);
+  for (size_t i = 100 * kNumChannels; i < 150 * kNumChannels; i++)
+    EXPECT_EQ(-150, out_[i]);
+}
+
+TEST_F(MixBusTestSuite, AddOverflowAndBadFormat) {
+  EXPECT_EQ(-EINVAL, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE, in(), 200,
+                                      100, 0, 1.0));
+  EXPECT_EQ(-EINVAL, cras_mix_bus_add(bus_, SND_PCM_FORMAT_U8, in(), 0, 100,
+                                      0, 1.0));
+}
+
+TEST_F(MixBusTestSuite, MutedStreamLeavesSilence) {
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE, in(), 0,
+                                kMaxFrames, 1, 1.0));
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S16_LE, out(),
+                                     kMaxFrames, 1));
+  for (size_t i = 0; i < out_.size(); i++)
+    EXPECT_EQ(0, out_[i]);
+}
+
+TEST_F(MixBusTestSuite, ConsumeKeepsFramesMixedAhead) {
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE, in(), 0, 100, 0,
+                                1.0));
+  cras_mix_bus_consume(bus_, 60);
+
+  // Frames 60 to 99 move to the start, the rest reads as silence.
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S16_LE, out(), 80,
+                                     0));
+  for (size_t i = 0; i < 40 * kNumChannels; i++)
+    EXPECT_EQ(in_[60 * kNumChannels + i], out_[i]);
+  for (size_t i = 40 * kNumChannels; i < 80 * kNumChannels; i++)
+    EXPECT_EQ(0, out_[i]);
+}
+
+TEST_F(MixBusTestSuite, ScaleWithRamp) {
+  std::vector<int16_t> ones(kMaxFrames * kNumChannels, 10000);
+
+  EXPECT_EQ(0, cras_mix_bus_add(bus_, SND_PCM_FORMAT_S16_LE,
+                                reinterpret_cast<uint8_t*>(ones.data()), 0,
+                                10, 0, 1.0));
+  cras_mix_bus_scale(bus_, 10, 0.0, 0.2, 0.5);
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus_, SND_PCM_FORMAT_S16_LE, out(), 10,
+                                     0));
+  // 0, 0.2, 0.4, then held at the 0.5 target.
+  EXPECT_EQ(0, out_[0]);
+  EXPECT_EQ(2000, out_[2]);
+  EXPECT_EQ(4000, out_[4]);
+  for (size_t i = 6; i < 10 * kNumChannels; i++)
+    EXPECT_EQ(5000, out_[i]);
+}
+
+TEST(MixBusDither, SilenceStaysSilent) {
+  struct cras_mix_bus* bus = cras_mix_bus_create(kNumChannels, kMaxFrames, 1);
+  std::vector<int16_t> in(kMaxFrames * kNumChannels, 0);
+  std::vector<int16_t> out(kMaxFrames * kNumChannels, 1);
+
+  for (size_t i = 0; i < kMaxFrames; i++)
+    in[i * kNumChannels] = 100;
+  EXPECT_EQ(0, cras_mix_bus_add(bus, SND_PCM_FORMAT_S16_LE,
+                                reinterpret_cast<uint8_t*>(in.data()), 0,
+                                kMaxFrames, 0, 1.0));
+  EXPECT_EQ(0, cras_mix_bus_quantize(bus, SND_PCM_FORMAT_S16_LE,
+                                     reinterpret_cast<uint8_t*>(out.data()),
+                                     kMaxFrames, 1));
+  for (size_t i = 0; i < kMaxFrames; i++) {
+    // Dither moves the signal by at most one step, the silent channel not
+    // at all.
+    EXPECT_LE(abs(out[i * kNumChannels] - 100), 1);
+    EXPECT_EQ(0, out[i * kNumChannels + 1]);
+  }
+  cras_mix_bus_destroy(bus);
+}
+
+}  //  namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
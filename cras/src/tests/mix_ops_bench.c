@@ -0,0 +1,151 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures the throughput of each variant of the mix ops this CPU can run, in
+ * frames per second, for mixing a stream into the output and for scaling a
+ * buffer, across sample formats and channel counts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cras_mix_ops.h"
+
+#define BENCH_FRAMES 480
+#define MIN_BENCH_SECONDS 0.2
+
+struct mix_variant {
+	const char *name;
+	const struct cras_mix_ops *ops;
+};
+
+static const struct {
+	const char *name;
+	snd_pcm_format_t fmt;
+} formats[] = {
+	{ "S16_LE", SND_PCM_FORMAT_S16_LE },
+	{ "S24_LE", SND_PCM_FORMAT_S24_LE },
+	{ "S32_LE", SND_PCM_FORMAT_S32_LE },
+	{ "S24_3LE", SND_PCM_FORMAT_S24_3LE },
+};
+
+static const unsigned int channel_counts[] = { 1, 2, 6, 8 };
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec) +
+	       (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+static unsigned int get_variants(struct mix_variant *variants)
+{
+	unsigned int n = 0;
+
+	variants[n].name = "c";
+	variants[n++].ops = &mixer_ops;
+#if defined HAVE_SSE42
+	if (__builtin_cpu_supports("sse4.2")) {
+		variants[n].name = "sse42";
+		variants[n++].ops = &mixer_ops_sse42;
+	}
+#endif
+#if defined HAVE_AVX
+	if (__builtin_cpu_supports("avx")) {
+		variants[n].name = "avx";
+		variants[n++].ops = &mixer_ops_avx;
+	}
+#endif
+#if defined HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		variants[n].name = "avx2";
+		variants[n++].ops = &mixer_ops_avx2;
+	}
+#endif
+#if defined HAVE_FMA
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		variants[n].name = "fma";
+		variants[n++].ops = &mixer_ops_fma;
+	}
+#endif
+	return n;
+}
+
+/* Returns frames per second of op on a period of BENCH_FRAMES frames. */
+static double bench_op(const struct cras_mix_ops *ops, snd_pcm_format_t fmt,
+		       unsigned int channels, int scale_only, uint8_t *dst,
+		       uint8_t *src)
+{
+	unsigned int samples = BENCH_FRAMES * channels;
+	struct timespec tp1, tp2;
+	unsigned long frames = 0;
+	unsigned int i;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp1);
+	do {
+		for (i = 0; i < 100; i++) {
+			if (scale_only)
+				ops->scale_buffer(fmt, dst, samples, 0.5f);
+			else
+				ops->add(fmt, dst, src, samples, 1, 0, 0.5f);
+		}
+		frames += 100 * BENCH_FRAMES;
+		clock_gettime(CLOCK_MONOTONIC, &tp2);
+		elapsed = tp_diff(&tp2, &tp1);
+	} while (elapsed < MIN_BENCH_SECONDS);
+
+	return frames / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	struct mix_variant variants[5];
+	unsigned int num_variants;
+	unsigned int f, c, v, i;
+	size_t bytes;
+	uint8_t *src, *dst;
+
+	num_variants = get_variants(variants);
+	bytes = BENCH_FRAMES * 8 * 4;
+	src = (uint8_t *)malloc(bytes);
+	dst = (uint8_t *)malloc(bytes);
+	for (i = 0; i < bytes; i++)
+		src[i] = rand();
+
+	printf("%-10s %-4s %-6s", "format", "ch", "op");
+	for (v = 0; v < num_variants; v++)
+		printf(" %14s", variants[v].name);
+	printf("  (Mframes/s)\n");
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		for (c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]);
+		     c++) {
+			int scale_only;
+
+			for (scale_only = 0; scale_only < 2; scale_only++) {
+				printf("%-10s %-4u %-6s",
+				       formats[f].name,
+				       channel_counts[c],
+				       scale_only ? "scale" : "mix");
+				for (v = 0; v < num_variants; v++) {
+					memset(dst, 0, bytes);
+					printf(" %14.1f",
+					       bench_op(variants[v].ops,
+							formats[f].fmt,
+							channel_counts[c],
+							scale_only, dst, src) /
+						       1e6);
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	free(src);
+	free(dst);
+	return 0;
+}
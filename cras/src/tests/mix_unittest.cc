@@ -5,8 +5,11 @@
 #include <gtest/gtest.h>
 #include <stdio.h>
 
+#include <vector>
+
 extern "C" {
 #include "cras_mix.h"
+#include "cras_mix_ops.h"
 #include "cras_shm.h"
 #include "cras_types.h"
 }
@@ -1260,6 +1263,132 @@ TEST_F(MixTestSuiteS24_3LE, StrideCopy) {
   TestScaleStride(0.1);
 }
 
+// Checks that every SIMD variant of the mix ops the CPU can run gives the
+// same output as the C implementation.
+class MixOpsSimdSuite : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    AddOps("c", &mixer_ops);
+#if defined HAVE_SSE42
+    if (__builtin_cpu_supports("sse4.2"))
+      AddOps("sse42", &mixer_ops_sse42);
+#endif
+#if defined HAVE_AVX
+    if (__builtin_cpu_supports("avx"))
+      AddOps("avx", &mixer_ops_avx);
+#endif
+#if defined HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+      AddOps("avx2", &mixer_ops_avx2);
+#endif
+#if defined HAVE_FMA
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      AddOps("fma", &mixer_ops_fma);
+#endif
+    srand(1234);
+  }
+
+  void AddOps(const char* name, const struct cras_mix_ops* ops) {
+    names_.push_back(name);
+    ops_.push_back(ops);
+  }
+
+  // Fills buf with random samples, including full scale ones.
+  void FillRandom(snd_pcm_format_t fmt, uint8_t* buf, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+      int32_t v = ((uint32_t)rand() << 16) ^ rand();
+      if (i % 7 == 0)
+        v = (i % 2) ? INT32_MAX : INT32_MIN;
+      if (fmt == SND_PCM_FORMAT_S16_LE)
+        ((int16_t*)buf)[i] = v >> 16;
+      else if (fmt == SND_PCM_FORMAT_S24_LE)
+        ((int32_t*)buf)[i] = v >> 8;
+      else
+        ((int32_t*)buf)[i] = v;
+    }
+  }
+
+  // Runs op on every variant and compares against the C one. op gets the
+  // ops, the destination and the source.
+  template <typename Op>
+  void CheckBitExact(snd_pcm_format_t fmt, size_t samples, Op op) {
+    size_t bytes = samples * snd_pcm_format_physical_width(fmt) / 8;
+    std::vector<uint8_t> src(bytes), dst(bytes), ref(bytes), out(bytes);
+
+    FillRandom(fmt, src.data(), samples);
+    FillRandom(fmt, dst.data(), samples);
+
+    ref = dst;
+    op(ops_[0], ref.data(), src.data());
+    for (size_t i = 1; i < ops_.size(); i++) {
+      out = dst;
+      op(ops_[i], out.data(), src.data());
+      EXPECT_EQ(0, memcmp(ref.data(), out.data(), bytes))
+          << names_[i] << " fmt " << fmt << " samples " << samples;
+    }
+  }
+
+  std::vector<const char*> names_;
+  std::vector<const struct cras_mix_ops*> ops_;
+};
+
+static const snd_pcm_format_t kSimdFormats[] = {
+    SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_LE, SND_PCM_FORMAT_S32_LE};
+// Includes counts that leave a partial vector.
+static const size_t kSimdCounts[] = {1, 7, 64, 1027};
+
+TEST_F(MixOpsSimdSuite, Add) {
+  const float vols[] = {1.0, 0.7, 0.5, 0.0001};
+
+  for (snd_pcm_format_t fmt : kSimdFormats) {
+    for (size_t count : kSimdCounts) {
+      for (float vol : vols) {
+        for (unsigned int index = 0; index < 2; index++) {
+          CheckBitExact(fmt, count,
+                        [=](const struct cras_mix_ops* ops, uint8_t* dst,
+                            uint8_t* src) {
+                          ops->add(fmt, dst, src, count, index, 0, vol);
+                        });
+        }
+      }
+    }
+  }
+}
+
+TEST_F(MixOpsSimdSuite, ScaleBuffer) {
+  const float scalers[] = {0.99, 0.5, 0.001};
+
+  for (snd_pcm_format_t fmt : kSimdFormats) {
+    for (size_t count : kSimdCounts) {
+      for (float scaler : scalers) {
+        CheckBitExact(fmt, count,
+                      [=](const struct cras_mix_ops* ops, uint8_t* dst,
+                          uint8_t* src) {
+                        ops->scale_buffer(fmt, dst, count, scaler);
+                      });
+      }
+    }
+  }
+}
+
+TEST_F(MixOpsSimdSuite, AddScaleStride) {
+  const float scalers[] = {1.0, 0.3, 1.5, 2.0};
+
+  for (snd_pcm_format_t fmt : kSimdFormats) {
+    unsigned int stride = snd_pcm_format_physical_width(fmt) / 8;
+    for (size_t count : kSimdCounts) {
+      for (float scaler : scalers) {
+        CheckBitExact(fmt, count,
+                      [=](const struct cras_mix_ops* ops, uint8_t* dst,
+                          uint8_t* src) {
+                        ops->add_scale_stride(fmt, dst, src, count, stride,
+                                              stride, scaler);
+                      });
+      }
+    }
+  }
+}
+
 /* Stubs */
 extern "C" {}  // extern "C"
 
@@ -0,0 +1,203 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Compares the frames per second libsbc and the native codec encode and
+ * decode, for the A2DP configuration CRAS asks headsets for and for mSBC.
+ * The native codec runs with the baseline SIMD kernels of the architecture
+ * and, where the CPU has it, with AVX2. The filterbank kernels are also timed
+ * on their own against the plain C ones.
+ */
+
+#include <math.h>
+#include <sbc/sbc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cras_sbc_filter.h"
+#include "cras_sbc_native.h"
+#include "cras_util.h"
+
+#define NUM_FRAMES 20000
+#define MAX_CODESIZE 512
+#define MAX_FRAME_LENGTH 128
+#define FILTER_BLOCKS 1000000
+
+struct config {
+	const char *name;
+	int msbc;
+	uint8_t freq, mode, subbands, alloc, blocks, bitpool;
+};
+
+static const struct config configs[] = {
+	{ "a2dp", 0, SBC_FREQ_44100, SBC_MODE_JOINT_STEREO, SBC_SB_8,
+	  SBC_AM_LOUDNESS, SBC_BLK_16, 53 },
+	{ "msbc", 1 },
+};
+
+static int16_t pcm[NUM_FRAMES * MAX_CODESIZE / 2];
+static uint8_t frames[NUM_FRAMES * MAX_FRAME_LENGTH];
+static int16_t out[MAX_CODESIZE / 2];
+
+static double now_s()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_pcm()
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(pcm) / sizeof(pcm[0]); i++)
+		pcm[i] = 6000 * sin(0.013 * i) + 4000 * sin(0.29 * i) +
+			 rand() % 4000 - 2000;
+}
+
+static void report(const char *config, const char *codec, const char *what,
+		   double seconds)
+{
+	printf("%-6s %-14s %-8s %12.0f\n", config, codec, what,
+	       NUM_FRAMES / seconds);
+}
+
+static void bench_libsbc(const struct config *c)
+{
+	sbc_t sbc;
+	size_t codesize, frame_length, decoded;
+	ssize_t written;
+	unsigned int i;
+	double start;
+
+	if (c->msbc) {
+		sbc_init_msbc(&sbc, 0L);
+	} else {
+		sbc_init(&sbc, 0L);
+		sbc.endian = SBC_LE;
+		sbc.frequency = c->freq;
+		sbc.mode = c->mode;
+		sbc.subbands = c->subbands;
+		sbc.allocation = c->alloc;
+		sbc.blocks = c->blocks;
+		sbc.bitpool = c->bitpool;
+	}
+	codesize = sbc_get_codesize(&sbc);
+	frame_length = sbc_get_frame_length(&sbc);
+
+	start = now_s();
+	for (i = 0; i < NUM_FRAMES; i++)
+		sbc_encode(&sbc, (uint8_t *)pcm + i * codesize, codesize,
+			   frames + i * frame_length, frame_length, &written);
+	report(c->name, "libsbc", "encode", now_s() - start);
+	sbc_finish(&sbc);
+
+	/* Decode with a fresh instance, as a sink would. */
+	if (c->msbc)
+		sbc_init_msbc(&sbc, 0L);
+	else
+		sbc_init(&sbc, 0L);
+	start = now_s();
+	for (i = 0; i < NUM_FRAMES; i++)
+		sbc_decode(&sbc, frames + i * frame_length, frame_length, out,
+			   sizeof(out), &decoded);
+	report(c->name, "libsbc", "decode", now_s() - start);
+	sbc_finish(&sbc);
+}
+
+static struct cras_sbc_native *create_native(const struct config *c,
+					     unsigned int cpu_flags)
+{
+	if (c->msbc)
+		return cras_msbc_native_create(cpu_flags);
+	return cras_sbc_native_create(c->freq, c->mode, c->subbands, c->alloc,
+				      c->blocks, c->bitpool, cpu_flags);
+}
+
+static void bench_native(const struct config *c, const char *name,
+			 unsigned int cpu_flags)
+{
+	struct cras_sbc_native *sbc;
+	size_t codesize, frame_length, decoded;
+	ssize_t written;
+	unsigned int i;
+	double start;
+
+	sbc = create_native(c, cpu_flags);
+	codesize = cras_sbc_native_get_codesize(sbc);
+	frame_length = cras_sbc_native_get_frame_length(sbc);
+
+	start = now_s();
+	for (i = 0; i < NUM_FRAMES; i++)
+		cras_sbc_native_encode(sbc, (uint8_t *)pcm + i * codesize,
+				       codesize, frames + i * frame_length,
+				       frame_length, &written);
+	report(c->name, name, "encode", now_s() - start);
+	cras_sbc_native_destroy(sbc);
+
+	sbc = create_native(c, cpu_flags);
+	start = now_s();
+	for (i = 0; i < NUM_FRAMES; i++)
+		cras_sbc_native_decode(sbc, frames + i * frame_length,
+				       frame_length, out, sizeof(out),
+				       &decoded);
+	report(c->name, name, "decode", now_s() - start);
+	cras_sbc_native_destroy(sbc);
+}
+
+/* Times the eight subband kernels, in blocks per second. */
+static void bench_filter(const char *name,
+			 const struct cras_sbc_filter_ops *ops)
+{
+	static float x[80 + 1024 * 8];
+	static float v[10 * 16 + 1024 * 16];
+	struct cras_sbc_filter f;
+	float s[8], o[8];
+	unsigned int i;
+	double start, analyze_s;
+
+	cras_sbc_filter_init(&f, 8);
+	for (i = 0; i < ARRAY_SIZE(x); i++)
+		x[i] = rand() % 65536 - 32768;
+
+	start = now_s();
+	for (i = 0; i < FILTER_BLOCKS; i++)
+		ops->analyze(&f, x + i % 1024 * 8, s);
+	analyze_s = now_s() - start;
+
+	start = now_s();
+	for (i = 0; i < FILTER_BLOCKS; i++)
+		ops->synthesize(&f, s, v + 18 * 8 + i % 1024 * 16, o);
+	printf("%-6s %-14s %12.0f %12.0f\n", "filter", name,
+	       FILTER_BLOCKS / analyze_s, FILTER_BLOCKS / (now_s() - start));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int avx2 = 0;
+	unsigned int i;
+
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2"))
+		avx2 = CPU_X86_AVX2;
+#endif
+
+	fill_pcm();
+	printf("%-6s %-14s %-8s %12s\n", "", "", "", "frames/s");
+	for (i = 0; i < ARRAY_SIZE(configs); i++) {
+		bench_libsbc(&configs[i]);
+		bench_native(&configs[i], "native", 0);
+		if (avx2)
+			bench_native(&configs[i], "native avx2", avx2);
+	}
+
+	printf("\n%-6s %-14s %12s %12s\n", "", "", "analyze/s", "synth/s");
+	bench_filter("c", &cras_sbc_filter_ops_c);
+	bench_filter("simd", cras_sbc_filter_get_ops(0));
+	if (avx2)
+		bench_filter("avx2", cras_sbc_filter_get_ops(avx2));
+	return 0;
+}
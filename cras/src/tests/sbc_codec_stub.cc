@@ -21,6 +21,8 @@ static uint8_t subbands_val;
 static uint8_t alloc_val;
 static uint8_t blocks_val;
 static uint8_t bitpool_val;
+static int set_bitpool_called;
+static uint8_t set_bitpool_val;
 static struct cras_audio_codec* sbc_codec;
 static size_t decode_out_decoded_return_val;
 static int decode_fail;
@@ -42,6 +44,8 @@ void sbc_codec_stub_reset() {
   alloc_val = 0;
   blocks_val = 0;
   bitpool_val = 0;
+  set_bitpool_called = 0;
+  set_bitpool_val = 0;
 
   sbc_codec = NULL;
   decode_out_decoded_return_val = 0;
@@ -89,6 +93,14 @@ uint8_t get_sbc_codec_create_bitpool_val() {
   return bitpool_val;
 }
 
+int get_sbc_codec_set_bitpool_called() {
+  return set_bitpool_called;
+}
+
+uint8_t get_sbc_codec_set_bitpool_val() {
+  return set_bitpool_val;
+}
+
 int get_sbc_codec_destroy_called() {
   return destroy_called;
 }
@@ -172,3 +184,10 @@ int cras_sbc_get_codesize(struct cras_audio_codec* codec) {
 int cras_sbc_get_frame_length(struct cras_audio_codec* codec) {
   return cras_sbc_get_frame_length_val;
 }
+
+int cras_sbc_codec_set_bitpool(struct cras_audio_codec* codec,
+                               uint8_t bitpool) {
+  set_bitpool_called++;
+  set_bitpool_val = bitpool;
+  return 0;
+}
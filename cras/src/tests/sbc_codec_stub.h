@@ -24,6 +24,8 @@ void set_sbc_codec_decoded_out(size_t ret);
 void set_sbc_codec_decoded_fail(int fail);
 void set_sbc_codec_encoded_out(size_t ret);
 void set_sbc_codec_encoded_fail(int fail);
+int get_sbc_codec_set_bitpool_called();
+uint8_t get_sbc_codec_set_bitpool_val();
 
 struct cras_audio_codec* cras_sbc_codec_create(uint8_t freq,
                                                uint8_t mode,
@@ -35,5 +37,7 @@ struct cras_audio_codec* cras_msbc_codec_create();
 void cras_sbc_codec_destroy(struct cras_audio_codec* codec);
 int cras_sbc_get_codesize(struct cras_audio_codec* codec);
 int cras_sbc_get_frame_length(struct cras_audio_codec* codec);
+int cras_sbc_codec_set_bitpool(struct cras_audio_codec* codec,
+                               uint8_t bitpool);
 
 #endif  // SBC_CODEC_STUB_H_
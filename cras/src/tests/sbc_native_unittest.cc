@@ -0,0 +1,313 @@
+// Copyright 2020 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+extern "C" {
+#include "cras_sbc_filter.h"
+#include "cras_sbc_native.h"
+#include "cras_util.h"
+}
+
+namespace {
+
+// The mSBC frame of silence, as used by the packet loss concealment.
+static const uint8_t msbc_zero_frame[] = {
+    0xad, 0x00, 0x00, 0xc5, 0x00, 0x00, 0x00, 0x00, 0x77, 0x6d, 0xb6, 0xdd,
+    0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77, 0x6d, 0xb6,
+    0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77, 0x6d,
+    0xb6, 0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6d, 0xdd, 0xb6, 0xdb, 0x77,
+    0x6d, 0xb6, 0xdd, 0xdb, 0x6d, 0xb7, 0x76, 0xdb, 0x6c};
+
+// libsbc codes of the configurations.
+enum { FREQ_16000, FREQ_32000, FREQ_44100, FREQ_48000 };
+enum { BLK_4, BLK_8, BLK_12, BLK_16 };
+enum { MODE_MONO, MODE_DUAL_CHANNEL, MODE_STEREO, MODE_JOINT_STEREO };
+enum { AM_LOUDNESS, AM_SNR };
+enum { SB_4, SB_8 };
+
+static unsigned int cpu_flags() {
+#if defined(__x86_64__)
+  return __builtin_cpu_supports("avx2") ? CPU_X86_AVX2 : 0;
+#else
+  return 0;
+#endif
+}
+
+// Encodes then decodes |frames| frames of two tones, a different pair per
+// channel, and returns the SNR in dB of the output against the input
+// delayed by the filterbanks, 73 samples for 8 subbands and 37 for 4.
+static double RoundTripSnr(struct cras_sbc_native* enc,
+                           struct cras_sbc_native* dec,
+                           unsigned int channels,
+                           unsigned int delay,
+                           unsigned int frames) {
+  size_t codesize = cras_sbc_native_get_codesize(enc);
+  size_t frame_length = cras_sbc_native_get_frame_length(enc);
+  size_t samples = codesize / 2 * frames;
+  std::vector<int16_t> in(samples), out(samples);
+  std::vector<uint8_t> frame(frame_length);
+  double signal = 0, noise = 0;
+  ssize_t encoded, written;
+  ssize_t decoded;
+  size_t decoded_bytes;
+
+  for (size_t i = 0; i < samples; i++) {
+    size_t t = i / channels, ch = i % channels;
+    in[i] = 8000 * sin(0.031 * (ch + 1) * t) + 6000 * sin(0.47 * t + ch);
+  }
+
+  for (unsigned int f = 0; f < frames; f++) {
+    encoded = cras_sbc_native_encode(enc, &in[f * codesize / 2], codesize,
+                                     frame.data(), frame.size(), &written);
+    EXPECT_EQ(codesize, encoded);
+    EXPECT_EQ(frame_length, written);
+    decoded = cras_sbc_native_decode(dec, frame.data(), frame.size(),
+                                     &out[f * codesize / 2], codesize,
+                                     &decoded_bytes);
+    EXPECT_EQ(frame_length, decoded);
+    EXPECT_EQ(codesize, decoded_bytes);
+  }
+
+  // Skip the first frame, while the filterbanks fill up.
+  for (size_t i = codesize / 2; i < samples; i++) {
+    double ref = in[i - delay * channels];
+    signal += ref * ref;
+    noise += (out[i] - ref) * (out[i] - ref);
+  }
+  return 10 * log10(signal / noise);
+}
+
+TEST(SbcNative, MsbcSizes) {
+  struct cras_sbc_native* msbc = cras_msbc_native_create(0);
+
+  ASSERT_TRUE(msbc);
+  EXPECT_EQ(240, cras_sbc_native_get_codesize(msbc));
+  EXPECT_EQ(57, cras_sbc_native_get_frame_length(msbc));
+  cras_sbc_native_destroy(msbc);
+}
+
+TEST(SbcNative, SbcSizes) {
+  struct cras_sbc_native* sbc;
+
+  // The usual A2DP high quality configuration.
+  sbc = cras_sbc_native_create(FREQ_44100, MODE_JOINT_STEREO, SB_8,
+                               AM_LOUDNESS, BLK_16, 53, 0);
+  ASSERT_TRUE(sbc);
+  EXPECT_EQ(512, cras_sbc_native_get_codesize(sbc));
+  EXPECT_EQ(119, cras_sbc_native_get_frame_length(sbc));
+  cras_sbc_native_destroy(sbc);
+
+  sbc = cras_sbc_native_create(FREQ_48000, MODE_DUAL_CHANNEL, SB_4, AM_SNR,
+                               BLK_8, 32, 0);
+  ASSERT_TRUE(sbc);
+  EXPECT_EQ(128, cras_sbc_native_get_codesize(sbc));
+  EXPECT_EQ(72, cras_sbc_native_get_frame_length(sbc));
+  cras_sbc_native_destroy(sbc);
+
+  // The bitpool is limited to 16 bits per subband and channel.
+  EXPECT_FALSE(cras_sbc_native_create(FREQ_48000, MODE_MONO, SB_4, AM_SNR,
+                                      BLK_8, 65, 0));
+  EXPECT_FALSE(cras_sbc_native_create(FREQ_48000, MODE_MONO, SB_4, AM_SNR,
+                                      BLK_8, 1, 0));
+}
+
+TEST(SbcNative, MsbcZeroFrame) {
+  struct cras_sbc_native* msbc = cras_msbc_native_create(cpu_flags());
+  int16_t pcm[120] = {};
+  uint8_t frame[57];
+  ssize_t written;
+  size_t decoded;
+
+  ASSERT_EQ(240, cras_sbc_native_encode(msbc, pcm, sizeof(pcm), frame,
+                                        sizeof(frame), &written));
+  ASSERT_EQ(57, written);
+  for (unsigned int i = 0; i < sizeof(frame); i++)
+    EXPECT_EQ(msbc_zero_frame[i], frame[i]) << "at " << i;
+
+  for (unsigned int i = 0; i < 120; i++)
+    pcm[i] = 1000;
+  ASSERT_EQ(57, cras_sbc_native_decode(msbc, msbc_zero_frame,
+                                       sizeof(msbc_zero_frame), pcm,
+                                       sizeof(pcm), &decoded));
+  ASSERT_EQ(240, decoded);
+  for (unsigned int i = 0; i < 120; i++)
+    EXPECT_EQ(0, pcm[i]);
+  cras_sbc_native_destroy(msbc);
+}
+
+TEST(SbcNative, MsbcRoundTrip) {
+  struct cras_sbc_native* enc = cras_msbc_native_create(cpu_flags());
+  struct cras_sbc_native* dec = cras_msbc_native_create(cpu_flags());
+
+  EXPECT_GT(RoundTripSnr(enc, dec, 1, 73, 40), 40);
+  cras_sbc_native_destroy(enc);
+  cras_sbc_native_destroy(dec);
+}
+
+// Each channel mode, number of subbands and allocation method, at the
+// highest bitpool the mode allows.
+TEST(SbcNative, SbcRoundTrip) {
+  static const struct {
+    uint8_t mode, subbands, alloc, bitpool;
+  } configs[] = {
+      {MODE_MONO, SB_8, AM_LOUDNESS, 128},
+      {MODE_MONO, SB_4, AM_SNR, 64},
+      {MODE_DUAL_CHANNEL, SB_8, AM_SNR, 128},
+      {MODE_STEREO, SB_8, AM_LOUDNESS, 250},
+      {MODE_STEREO, SB_4, AM_LOUDNESS, 128},
+      {MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, 250},
+      {MODE_JOINT_STEREO, SB_4, AM_SNR, 128},
+  };
+
+  for (auto& c : configs) {
+    unsigned int channels = c.mode == MODE_MONO ? 1 : 2;
+    unsigned int delay = c.subbands == SB_8 ? 73 : 37;
+    struct cras_sbc_native* enc =
+        cras_sbc_native_create(FREQ_44100, c.mode, c.subbands, c.alloc,
+                               BLK_16, c.bitpool, cpu_flags());
+    struct cras_sbc_native* dec =
+        cras_sbc_native_create(FREQ_44100, c.mode, c.subbands, c.alloc,
+                               BLK_16, c.bitpool, cpu_flags());
+
+    ASSERT_TRUE(enc);
+    ASSERT_TRUE(dec);
+    EXPECT_GT(RoundTripSnr(enc, dec, channels, delay, 20), 60)
+        << "mode " << (int)c.mode << " subbands " << (int)c.subbands;
+    cras_sbc_native_destroy(enc);
+    cras_sbc_native_destroy(dec);
+  }
+}
+
+TEST(SbcNative, A2dpRoundTrip) {
+  struct cras_sbc_native* enc = cras_sbc_native_create(
+      FREQ_44100, MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, BLK_16, 53,
+      cpu_flags());
+  struct cras_sbc_native* dec = cras_sbc_native_create(
+      FREQ_44100, MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, BLK_16, 53,
+      cpu_flags());
+
+  EXPECT_GT(RoundTripSnr(enc, dec, 2, 73, 20), 45);
+  cras_sbc_native_destroy(enc);
+  cras_sbc_native_destroy(dec);
+}
+
+TEST(SbcNative, SetBitpool) {
+  struct cras_sbc_native* enc = cras_sbc_native_create(
+      FREQ_44100, MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, BLK_16, 53,
+      cpu_flags());
+  struct cras_sbc_native* dec = cras_sbc_native_create(
+      FREQ_44100, MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, BLK_16, 53,
+      cpu_flags());
+  struct cras_sbc_native* msbc = cras_msbc_native_create(0);
+
+  EXPECT_EQ(-EINVAL, cras_sbc_native_set_bitpool(enc, 1));
+  EXPECT_EQ(-EINVAL, cras_sbc_native_set_bitpool(msbc, 20));
+  EXPECT_EQ(119, cras_sbc_native_get_frame_length(enc));
+
+  // The decoder follows the bitpool in the frame header, and the encoder
+  // keeps its filterbank state so the stream stays continuous.
+  EXPECT_GT(RoundTripSnr(enc, dec, 2, 73, 10), 45);
+  ASSERT_EQ(0, cras_sbc_native_set_bitpool(enc, 33));
+  EXPECT_EQ(79, cras_sbc_native_get_frame_length(enc));
+  EXPECT_GT(RoundTripSnr(enc, dec, 2, 73, 10), 30);
+
+  cras_sbc_native_destroy(enc);
+  cras_sbc_native_destroy(dec);
+  cras_sbc_native_destroy(msbc);
+}
+
+TEST(SbcNative, DecodeFollowsStream) {
+  struct cras_sbc_native* enc = cras_sbc_native_create(
+      FREQ_48000, MODE_STEREO, SB_4, AM_SNR, BLK_8, 40, 0);
+  struct cras_sbc_native* dec = cras_sbc_native_create(
+      FREQ_44100, MODE_JOINT_STEREO, SB_8, AM_LOUDNESS, BLK_16, 53, 0);
+  int16_t pcm[64] = {};
+  uint8_t frame[64];
+  ssize_t written;
+  size_t decoded;
+
+  ASSERT_EQ(128, cras_sbc_native_encode(enc, pcm, sizeof(pcm), frame,
+                                        sizeof(frame), &written));
+  EXPECT_EQ(written, cras_sbc_native_decode(dec, frame, written, pcm,
+                                            sizeof(pcm), &decoded));
+  EXPECT_EQ(128, decoded);
+  EXPECT_EQ(128, cras_sbc_native_get_codesize(dec));
+  cras_sbc_native_destroy(enc);
+  cras_sbc_native_destroy(dec);
+}
+
+TEST(SbcNative, Errors) {
+  struct cras_sbc_native* msbc = cras_msbc_native_create(0);
+  int16_t pcm[120] = {};
+  uint8_t frame[57];
+  ssize_t written;
+  size_t decoded;
+
+  EXPECT_EQ(0, cras_sbc_native_encode(msbc, pcm, sizeof(pcm) - 2, frame,
+                                      sizeof(frame), &written));
+  EXPECT_EQ(-ENOSPC, cras_sbc_native_encode(msbc, pcm, sizeof(pcm), frame,
+                                            sizeof(frame) - 1, &written));
+
+  EXPECT_EQ(-EINVAL,
+            cras_sbc_native_decode(msbc, msbc_zero_frame,
+                                   sizeof(msbc_zero_frame) - 1, pcm,
+                                   sizeof(pcm), &decoded));
+  memcpy(frame, msbc_zero_frame, sizeof(frame));
+  frame[0] = 0x9c;
+  EXPECT_EQ(-EINVAL, cras_sbc_native_decode(msbc, frame, sizeof(frame), pcm,
+                                            sizeof(pcm), &decoded));
+  memcpy(frame, msbc_zero_frame, sizeof(frame));
+  frame[5] ^= 0x10;
+  EXPECT_EQ(-EBADMSG, cras_sbc_native_decode(msbc, frame, sizeof(frame), pcm,
+                                             sizeof(pcm), &decoded));
+  EXPECT_EQ(-ENOSPC, cras_sbc_native_decode(
+                         msbc, msbc_zero_frame, sizeof(msbc_zero_frame), pcm,
+                         sizeof(pcm) - 2, &decoded));
+  cras_sbc_native_destroy(msbc);
+}
+
+// The kernels picked for this CPU give what the C ones do.
+TEST(SbcFilter, KernelsMatchC) {
+  const struct cras_sbc_filter_ops* ops = cras_sbc_filter_get_ops(cpu_flags());
+  const struct cras_sbc_filter_ops* ref = &cras_sbc_filter_ops_c;
+  struct cras_sbc_filter f;
+  float x[80], s[8], s_ref[8];
+  float v[10 * 16], v_ref[10 * 16], out[8], out_ref[8];
+
+  for (unsigned int m = 4; m <= 8; m += 4) {
+    cras_sbc_filter_init(&f, m);
+    for (int iter = 0; iter < 100; iter++) {
+      for (unsigned int i = 0; i < 80; i++)
+        x[i] = rand() % 65536 - 32768;
+      for (unsigned int i = 0; i < 10 * 16; i++)
+        v[i] = v_ref[i] = rand() % 65536 - 32768;
+
+      ops->analyze(&f, x, s);
+      ref->analyze(&f, x, s_ref);
+      for (unsigned int k = 0; k < m; k++)
+        EXPECT_NEAR(s_ref[k], s[k], 0.05);
+
+      ops->synthesize(&f, s_ref, v + 18 * m, out);
+      ref->synthesize(&f, s_ref, v_ref + 18 * m, out_ref);
+      for (unsigned int k = 0; k < 2 * m; k++)
+        EXPECT_NEAR(v_ref[18 * m + k], v[18 * m + k], 0.05);
+      for (unsigned int j = 0; j < m; j++)
+        EXPECT_NEAR(out_ref[j], out[j], 0.05);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
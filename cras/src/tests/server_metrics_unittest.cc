@@ -145,6 +145,22 @@ TEST(ServerMetricsTestSuite, SetMetricsLongestFetchDelay) {
   EXPECT_EQ(sent_msgs[0].data.value, delay);
 }
 
+TEST(ServerMetricsTestSuite, SetMetricsA2dpBitpool) {
+  ResetStubData();
+
+  cras_server_metrics_a2dp_bitpool_decreases(3);
+  cras_server_metrics_a2dp_lowest_bitpool(60);
+
+  EXPECT_EQ(sent_msgs.size(), 2);
+  EXPECT_EQ(sent_msgs[0].header.type, CRAS_MAIN_METRICS);
+  EXPECT_EQ(sent_msgs[0].header.length,
+            sizeof(struct cras_server_metrics_message));
+  EXPECT_EQ(sent_msgs[0].metrics_type, A2DP_BITPOOL_DECREASES);
+  EXPECT_EQ(sent_msgs[0].data.value, 3);
+  EXPECT_EQ(sent_msgs[1].metrics_type, A2DP_LOWEST_BITPOOL);
+  EXPECT_EQ(sent_msgs[1].data.value, 60);
+}
+
 TEST(ServerMetricsTestSuite, SetMetricsNumUnderruns) {
   ResetStubData();
   unsigned int underrun = 10;
@@ -1135,6 +1135,8 @@ struct cras_audio_format* cras_rstream_post_processing_format(
     void* dev_ptr) {
   return NULL;
 }
+void audio_thread_poll_stream(struct cras_rstream* stream) {}
+void audio_thread_unpoll_stream(struct cras_rstream* stream) {}
 }  // extern "C"
 
 }  //  namespace
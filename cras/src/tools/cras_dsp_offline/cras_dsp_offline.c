@@ -0,0 +1,376 @@
+/* Copyright 2020 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Runs an audio file through a dsp pipeline offline, the way the server
+ * would run it on a device, and reports how much CPU it takes. This helps
+ * tuning the dsp.ini of a board before deploying it.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "cras_dsp_ini.h"
+#include "cras_dsp_pipeline.h"
+#include "cras_expr.h"
+#include "cras_util.h"
+
+#define DEFAULT_RATE 48000
+#define DEFAULT_BLOCK_FRAMES 480
+
+/* An audio file loaded in memory. */
+struct audio_file {
+	uint8_t *buf;
+	size_t size;
+	/* The samples, inside buf. */
+	uint8_t *data;
+	size_t frames;
+	int channels;
+	int rate;
+	snd_pcm_format_t format;
+	/* Whether it has a WAV header, to write the output the same way. */
+	int wav;
+};
+
+static void show_usage(const char *name)
+{
+	printf("Usage: %s [options] <dsp.ini> <input> [output]\n", name);
+	printf("The input is a WAV file with 16, 24 or 32 bit samples, or raw\n"
+	       "S16_LE samples with the rate and channels given below.\n"
+	       "  -p <purpose>   The pipeline to run, playback (default) or "
+	       "capture.\n"
+	       "  -n <dsp_name>  The dsp_name variable of the ini.\n"
+	       "  -r <rate>      The rate of a raw input (default %d).\n"
+	       "  -c <channels>  The channels of a raw input (default: the\n"
+	       "                 pipeline input channels).\n"
+	       "  -b <frames>    The frames per call to the pipeline, like\n"
+	       "                 the period of a device (default %d).\n"
+	       "  -t <frames>    The tile size of the pipeline (default %d).\n"
+	       "  -h             Show this help.\n",
+	       DEFAULT_RATE, DEFAULT_BLOCK_FRAMES, DSP_BUFFER_SIZE);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+/* Finds the format and the samples of a WAV file loaded in file->buf.
+ * Returns 0 if successful, -EINVAL if it is not a WAV file we can read. */
+static int parse_wav(struct audio_file *file)
+{
+	const uint8_t *fmt = NULL;
+	size_t pos = 12;
+	uint32_t chunk_size;
+	int bits;
+
+	if (file->size < 12 || memcmp(file->buf, "RIFF", 4) ||
+	    memcmp(file->buf + 8, "WAVE", 4))
+		return -EINVAL;
+
+	while (pos + 8 <= file->size) {
+		chunk_size = get_le32(file->buf + pos + 4);
+		if (!memcmp(file->buf + pos, "fmt ", 4) && chunk_size >= 16) {
+			fmt = file->buf + pos + 8;
+		} else if (!memcmp(file->buf + pos, "data", 4)) {
+			file->data = file->buf + pos + 8;
+			file->size = MIN(chunk_size, file->size - pos - 8);
+			break;
+		}
+		pos += 8 + chunk_size + (chunk_size & 1);
+	}
+	if (!fmt || !file->data)
+		return -EINVAL;
+
+	/* PCM, or WAVE_FORMAT_EXTENSIBLE which we take as PCM too. */
+	if (get_le16(fmt) != 1 && get_le16(fmt) != 0xfffe)
+		return -EINVAL;
+	file->channels = get_le16(fmt + 2);
+	file->rate = get_le32(fmt + 4);
+	bits = get_le16(fmt + 14);
+	switch (bits) {
+	case 16:
+		file->format = SND_PCM_FORMAT_S16_LE;
+		break;
+	case 24:
+		file->format = SND_PCM_FORMAT_S24_3LE;
+		break;
+	case 32:
+		file->format = SND_PCM_FORMAT_S32_LE;
+		break;
+	default:
+		return -EINVAL;
+	}
+	file->wav = 1;
+	return 0;
+}
+
+/* Reads a WAV file, or a raw one if it has no WAV header. */
+static int read_audio_file(const char *path, struct audio_file *file)
+{
+	FILE *fp;
+	long size;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -errno;
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET)) {
+		fclose(fp);
+		return -EIO;
+	}
+	file->size = size;
+	file->buf = (uint8_t *)malloc(size ? size : 1);
+	if (!file->buf) {
+		fclose(fp);
+		return -ENOMEM;
+	}
+	if (fread(file->buf, 1, size, fp) != (size_t)size) {
+		free(file->buf);
+		file->buf = NULL;
+		fclose(fp);
+		return -EIO;
+	}
+	fclose(fp);
+
+	if (parse_wav(file)) {
+		file->data = file->buf;
+		file->format = SND_PCM_FORMAT_S16_LE;
+		file->wav = 0;
+	}
+	return 0;
+}
+
+/* Writes the samples of file, with a WAV header if the input had one. */
+static int write_audio_file(const char *path, const struct audio_file *file)
+{
+	int bytes = PCM_FORMAT_WIDTH(file->format) / 8;
+	size_t size = file->frames * file->channels * bytes;
+	uint8_t header[44];
+	FILE *fp;
+	int rc = 0;
+
+	fp = fopen(path, "wb");
+	if (!fp)
+		return -errno;
+
+	if (file->wav) {
+		memcpy(header, "RIFF", 4);
+		put_le32(header + 4, 36 + size);
+		memcpy(header + 8, "WAVEfmt ", 8);
+		put_le32(header + 16, 16);
+		put_le16(header + 20, 1);
+		put_le16(header + 22, file->channels);
+		put_le32(header + 24, file->rate);
+		put_le32(header + 28, file->rate * file->channels * bytes);
+		put_le16(header + 32, file->channels * bytes);
+		put_le16(header + 34, bytes * 8);
+		memcpy(header + 36, "data", 4);
+		put_le32(header + 40, size);
+		if (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+			rc = -EIO;
+	}
+	if (!rc && fwrite(file->data, 1, size, fp) != size)
+		rc = -EIO;
+	fclose(fp);
+	return rc;
+}
+
+static void print_share(const char *name, int64_t time, int64_t total_time,
+			size_t frames, const char *note)
+{
+	printf("%-24s %12.2f %8.2f %s\n", name, (double)time / frames,
+	       total_time ? time * 100.0 / total_time : 0, note);
+}
+
+/* Prints the throughput of the pipeline and the share of each instance. */
+static void print_report(struct pipeline *pipeline, size_t frames, int rate)
+{
+	int64_t total_time, total_samples, other_time;
+	struct dsp_instance_statistic stat;
+	double seconds;
+	int i;
+
+	cras_dsp_pipeline_get_statistic(pipeline, &total_time, &total_samples);
+	seconds = total_time * 1e-9;
+
+	printf("frames: %zu (%.2f seconds of audio)\n", frames,
+	       (double)frames / rate);
+	printf("processing time: %.6f seconds\n", seconds);
+	if (seconds > 0)
+		printf("throughput: %.1fx realtime (%.3f%% cpu)\n",
+		       frames / (double)rate / seconds,
+		       seconds * rate / frames * 100);
+	printf("delay: %d frames\n", cras_dsp_pipeline_get_delay(pipeline));
+	printf("peak audio buffers: %d (%zu bytes)\n",
+	       cras_dsp_pipeline_get_peak_audio_buffers(pipeline),
+	       cras_dsp_pipeline_get_peak_audio_buffers(pipeline) *
+		       DSP_BUFFER_SIZE * sizeof(float));
+
+	printf("\n%-24s %12s %8s\n", "instance", "ns/frame", "share%");
+	other_time = total_time;
+	for (i = 0; i < cras_dsp_pipeline_get_num_instances(pipeline); i++) {
+		cras_dsp_pipeline_get_instance_statistic(pipeline, i, &stat);
+		print_share(stat.title, stat.total_time, total_time, frames,
+			    stat.bypassed ? "bypassed" :
+			    stat.optional ? "optional" : "");
+		other_time -= stat.total_time;
+	}
+	/* The sample format conversion and the copies around the pipeline. */
+	print_share("(other)", other_time, total_time, frames, "");
+}
+
+int main(int argc, char **argv)
+{
+	struct cras_expr_env env = CRAS_EXPR_ENV_INIT;
+	struct audio_file file;
+	const char *purpose = "playback";
+	const char *dsp_name = "";
+	struct pipeline *pipeline;
+	struct ini *ini;
+	int rate = DEFAULT_RATE;
+	int channels = 0;
+	int block_frames = DEFAULT_BLOCK_FRAMES;
+	int tile_frames = DSP_BUFFER_SIZE;
+	size_t done, chunk, frame_bytes;
+	int c, rc;
+
+	while ((c = getopt(argc, argv, "p:n:r:c:b:t:h")) != -1) {
+		switch (c) {
+		case 'p':
+			purpose = optarg;
+			break;
+		case 'n':
+			dsp_name = optarg;
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'b':
+			block_frames = atoi(optarg);
+			break;
+		case 't':
+			tile_frames = atoi(optarg);
+			break;
+		case 'h':
+			show_usage(argv[0]);
+			return 0;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind < 2 || rate <= 0 || block_frames <= 0) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	memset(&file, 0, sizeof(file));
+	rc = read_audio_file(argv[optind + 1], &file);
+	if (rc) {
+		fprintf(stderr, "Failed to read %s: %s\n", argv[optind + 1],
+			strerror(-rc));
+		return 1;
+	}
+	if (!file.wav)
+		file.rate = rate;
+
+	ini = cras_dsp_ini_create(argv[optind]);
+	if (!ini) {
+		fprintf(stderr, "Failed to read %s\n", argv[optind]);
+		return 1;
+	}
+
+	cras_expr_env_install_builtins(&env);
+	cras_expr_env_set_variable_boolean(&env, "disable_eq", 0);
+	cras_expr_env_set_variable_boolean(&env, "disable_drc", 0);
+	cras_expr_env_set_variable_string(&env, "dsp_name", dsp_name);
+	cras_expr_env_set_variable_boolean(&env, "swap_lr_disabled", 1);
+
+	pipeline = cras_dsp_pipeline_create(ini, &env, purpose);
+	if (!pipeline || cras_dsp_pipeline_load(pipeline) ||
+	    cras_dsp_pipeline_instantiate(pipeline, file.rate)) {
+		fprintf(stderr, "Failed to create the %s pipeline\n", purpose);
+		return 1;
+	}
+	cras_dsp_pipeline_set_tile_frames(pipeline, tile_frames);
+	cras_dsp_pipeline_set_profile(pipeline, 1);
+
+	if (!file.wav)
+		file.channels =
+			channels ? channels :
+				   cras_dsp_pipeline_get_num_input_channels(
+					   pipeline);
+	/* The pipeline runs in place on the interleaved samples. */
+	if (file.channels !=
+		    cras_dsp_pipeline_get_num_input_channels(pipeline) ||
+	    file.channels !=
+		    cras_dsp_pipeline_get_num_output_channels(pipeline)) {
+		fprintf(stderr,
+			"The file has %d channels, the pipeline takes %d and "
+			"gives %d\n",
+			file.channels,
+			cras_dsp_pipeline_get_num_input_channels(pipeline),
+			cras_dsp_pipeline_get_num_output_channels(pipeline));
+		return 1;
+	}
+
+	frame_bytes = file.channels * PCM_FORMAT_WIDTH(file.format) / 8;
+	file.frames = file.size / frame_bytes;
+	for (done = 0; done < file.frames; done += chunk) {
+		chunk = MIN(file.frames - done, (size_t)block_frames);
+		rc = cras_dsp_pipeline_apply(pipeline,
+					     file.data + done * frame_bytes,
+					     file.format, chunk);
+		if (rc) {
+			fprintf(stderr, "Failed to run the pipeline: %d\n", rc);
+			return 1;
+		}
+	}
+
+	printf("%s: %s pipeline, %d channels, %d Hz, blocks of %d frames, "
+	       "tiles of %d\n",
+	       argv[optind], purpose, file.channels, file.rate, block_frames,
+	       cras_dsp_pipeline_get_tile_frames(pipeline));
+	print_report(pipeline, file.frames, file.rate);
+
+	if (argc - optind > 2) {
+		rc = write_audio_file(argv[optind + 2], &file);
+		if (rc) {
+			fprintf(stderr, "Failed to write %s: %s\n",
+				argv[optind + 2], strerror(-rc));
+			return 1;
+		}
+	}
+
+	cras_dsp_pipeline_free(pipeline);
+	cras_dsp_ini_free(ini);
+	cras_expr_env_free(&env);
+	free(file.buf);
+	return 0;
+}
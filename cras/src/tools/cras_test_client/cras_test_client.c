@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include "cras_client.h"
+#include "cras_latency_hist.h"
 #include "cras_types.h"
 #include "cras_util.h"
 #include "cras_version.h"
@@ -587,6 +588,10 @@ static void show_alog_tag(const struct audio_thread_event_log *log,
 		printf("%-30s written:%d queued:%u\n", "A2DP_WRITE", data1,
 		       data2);
 		break;
+	case AUDIO_THREAD_A2DP_HANDOFF:
+		printf("%-30s frames:%u pcm_queued:%u encoded:%u\n",
+		       "A2DP_HANDOFF", data1, data2, data3);
+		break;
 	case AUDIO_THREAD_DEV_STREAM_MIX:
 		printf("%-30s written:%u read:%u\n", "DEV_STREAM_MIX", data1,
 		       data2);
@@ -681,6 +686,28 @@ static void show_alog_tag(const struct audio_thread_event_log *log,
 	}
 }
 
+static void
+print_audio_thread_latency(const struct audio_thread_latency_stats *stats)
+{
+	const struct audio_thread_latency_hist *hist;
+	int i;
+
+	printf("%-16s %10s %10s %10s %10s %10s %10s\n", "phase(us)", "count",
+	       "mean", "p50", "p90", "p99", "max");
+	for (i = 0; i < AUDIO_THREAD_LATENCY_NUM_PHASES; i++) {
+		hist = &stats->hists[i];
+		printf("%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		       audio_thread_latency_phase_name(i),
+		       (unsigned long long)hist->count,
+		       hist->count ? hist->sum_ns / 1000.0 / hist->count : 0.0,
+		       latency_hist_quantile(hist, 0.5) / 1000.0,
+		       latency_hist_quantile(hist, 0.9) / 1000.0,
+		       latency_hist_quantile(hist, 0.99) / 1000.0,
+		       hist->max_ns / 1000.0);
+	}
+	printf("\n");
+}
+
 static void print_audio_debug_info(const struct audio_debug_info *info)
 {
 	time_t sec_offset;
@@ -709,7 +736,9 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       "num_severe_underruns: %u\n"
 		       "highest_hw_level: %u\n"
 		       "runtime: %u.%09u\n"
-		       "software_gain_scaler: %lf\n",
+		       "software_gain_scaler: %lf\n"
+		       "capture_conversions: %u\n"
+		       "capture_conversions_saved: %u\n",
 		       (unsigned int)info->devs[i].buffer_size,
 		       (unsigned int)info->devs[i].min_buffer_level,
 		       (unsigned int)info->devs[i].min_cb_level,
@@ -722,7 +751,9 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       (unsigned int)info->devs[i].highest_hw_level,
 		       (unsigned int)info->devs[i].runtime_sec,
 		       (unsigned int)info->devs[i].runtime_nsec,
-		       info->devs[i].software_gain_scaler);
+		       info->devs[i].software_gain_scaler,
+		       (unsigned int)info->devs[i].capture_conversions,
+		       (unsigned int)info->devs[i].capture_conversions_saved);
 		printf("\n");
 	}
 
@@ -794,11 +825,19 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 static void audio_debug_info(struct cras_client *client)
 {
 	const struct audio_debug_info *info;
+	const struct audio_thread_latency_stats *latency;
+
 	info = cras_client_get_audio_debug_info(client);
 	if (!info)
 		return;
 	print_audio_debug_info(info);
 
+	latency = cras_client_get_audio_thread_latency(client);
+	if (latency) {
+		printf("-------------latency------------\n");
+		print_audio_thread_latency(latency);
+	}
+
 	/* Signal main thread we are done after the last chunk. */
 	pthread_mutex_lock(&done_mutex);
 	pthread_cond_signal(&done_cond);